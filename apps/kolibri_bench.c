@@ -0,0 +1,518 @@
+#include "kolibri/decimal.h"
+#include "kolibri/formula.h"
+#include "kolibri/genome.h"
+#include "kolibri/knowledge_index.h"
+#include "kolibri/random.h"
+#include "kolibri/script.h"
+#include "kolibri/sigma.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Микробенчмарки горячих путей ядра. Данные строятся из фиксированного
+ * зерна, результат — один JSON-документ в stdout или в --output. */
+
+#if defined(KOLIBRI_BENCH_COUNT_ALLOCS)
+/* Обёртки компоновщика (--wrap) считают выделения кода ядра; библиотеки,
+ * подключённые динамически (OpenSSL, libc), в счёт не попадают. */
+static uint64_t bench_alloc_count;
+static uint64_t bench_alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&bench_alloc_count, 1U, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_alloc_bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&bench_alloc_count, 1U, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_alloc_bytes, (uint64_t)count * (uint64_t)size, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&bench_alloc_count, 1U, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_alloc_bytes, (uint64_t)size, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+static void alloc_snapshot(uint64_t *count, uint64_t *bytes) {
+    *count = __atomic_load_n(&bench_alloc_count, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&bench_alloc_bytes, __ATOMIC_RELAXED);
+}
+#define KOLIBRI_BENCH_HAS_ALLOCS 1
+#else
+static void alloc_snapshot(uint64_t *count, uint64_t *bytes) {
+    *count = 0U;
+    *bytes = 0U;
+}
+#define KOLIBRI_BENCH_HAS_ALLOCS 0
+#endif
+
+typedef struct {
+    const char *filter;
+    double min_time_ms;
+    uint64_t seed;
+    int quick;
+    FILE *out;
+    size_t emitted;
+    char workdir[256];
+} BenchContext;
+
+/* Одна операция бенчмарка; items и bytes — объём работы за операцию для
+ * пропускной способности (0 — не считать). */
+typedef void (*BenchFn)(void *state);
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bench_selected(const BenchContext *ctx, const char *name) {
+    return !ctx->filter || strstr(name, ctx->filter) != NULL;
+}
+
+/* Число повторов удваивается, пока партия не займёт min_time_ms; в отчёт
+ * идёт последняя партия, разогретая предыдущими. */
+static void bench_run(BenchContext *ctx, const char *name, BenchFn fn, void *state, double items, double bytes) {
+    if (!bench_selected(ctx, name)) {
+        return;
+    }
+    uint64_t target_ns = (uint64_t)(ctx->min_time_ms * 1e6);
+    uint64_t iterations = 1U;
+    uint64_t elapsed = 0U;
+    uint64_t allocs = 0U;
+    uint64_t alloc_bytes = 0U;
+    for (;;) {
+        uint64_t allocs_before = 0U;
+        uint64_t bytes_before = 0U;
+        alloc_snapshot(&allocs_before, &bytes_before);
+        uint64_t started = monotonic_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            fn(state);
+        }
+        elapsed = monotonic_ns() - started;
+        alloc_snapshot(&allocs, &alloc_bytes);
+        allocs -= allocs_before;
+        alloc_bytes -= bytes_before;
+        if (elapsed >= target_ns || iterations >= (1ULL << 40)) {
+            break;
+        }
+        uint64_t next = elapsed > 0U ? iterations * target_ns / elapsed + 1U : iterations * 16U;
+        if (next > iterations * 16U) {
+            next = iterations * 16U;
+        }
+        iterations = next > iterations * 2U ? next : iterations * 2U;
+    }
+    double ns_per_op = (double)elapsed / (double)iterations;
+    double seconds = (double)elapsed / 1e9;
+    fprintf(ctx->out, "%s\n    {\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f",
+            ctx->emitted ? "," : "", name, (unsigned long long)iterations, ns_per_op,
+            seconds > 0.0 ? (double)iterations / seconds : 0.0);
+    if (items > 0.0) {
+        fprintf(ctx->out, ",\"items_per_sec\":%.1f", seconds > 0.0 ? items * (double)iterations / seconds : 0.0);
+    }
+    if (bytes > 0.0) {
+        fprintf(ctx->out, ",\"bytes_per_sec\":%.1f", seconds > 0.0 ? bytes * (double)iterations / seconds : 0.0);
+    }
+    if (KOLIBRI_BENCH_HAS_ALLOCS) {
+        fprintf(ctx->out, ",\"allocs_per_op\":%.3f,\"alloc_bytes_per_op\":%.1f",
+                (double)allocs / (double)iterations, (double)alloc_bytes / (double)iterations);
+    } else {
+        fprintf(ctx->out, ",\"allocs_per_op\":null,\"alloc_bytes_per_op\":null");
+    }
+    fputc('}', ctx->out);
+    ctx->emitted++;
+    fflush(ctx->out);
+}
+
+/* ---- Поиск по индексу знаний ---- */
+
+/* Слово словаря с перекошенным распределением: частые номера малы. */
+static void bench_word(KolibriRng *rng, size_t vocabulary, char *out, size_t out_size) {
+    double u = k_rng_next_double(rng);
+    size_t id = (size_t)(u * u * (double)vocabulary);
+    if (id >= vocabulary) {
+        id = vocabulary - 1U;
+    }
+    snprintf(out, out_size, "w%zx", id);
+}
+
+#define KOLIBRI_BENCH_QUERIES 64U
+
+typedef struct {
+    KolibriKnowledgeIndex *index;
+    char queries[KOLIBRI_BENCH_QUERIES][64];
+    size_t next;
+    unsigned flags;
+} SearchState;
+
+static void bench_search_op(void *arg) {
+    SearchState *state = (SearchState *)arg;
+    size_t indices[10];
+    float scores[10];
+    size_t count = 0U;
+    kolibri_knowledge_index_search_flags(state->index, state->queries[state->next], 10U, state->flags, indices,
+                                         scores, &count);
+    state->next = (state->next + 1U) % KOLIBRI_BENCH_QUERIES;
+}
+
+static void bench_knowledge_search(BenchContext *ctx, size_t docs, size_t vocabulary) {
+    char name[128];
+    snprintf(name, sizeof(name), "knowledge_search/docs=%zu/vocab=%zu", docs, vocabulary);
+    if (!bench_selected(ctx, name)) {
+        return;
+    }
+    const char *roots[1] = { ctx->workdir };
+    SearchState state;
+    memset(&state, 0, sizeof(state));
+    if (kolibri_knowledge_index_create(roots, 1U, 1024U, &state.index) != 0) {
+        fprintf(stderr, "[kolibri-bench] index create failed\n");
+        return;
+    }
+    KolibriRng rng;
+    k_rng_seed(&rng, ctx->seed);
+    char content[1024];
+    char word[32];
+    for (size_t d = 0; d < docs; ++d) {
+        size_t length = 0U;
+        for (int w = 0; w < 60; ++w) {
+            bench_word(&rng, vocabulary, word, sizeof(word));
+            length += (size_t)snprintf(content + length, sizeof(content) - length, "%s ", word);
+        }
+        char id[32];
+        snprintf(id, sizeof(id), "doc%zu", d);
+        kolibri_knowledge_index_add_document(state.index, id, id, "bench", content, NULL);
+    }
+    kolibri_knowledge_index_merge(state.index);
+    for (size_t q = 0; q < KOLIBRI_BENCH_QUERIES; ++q) {
+        size_t length = 0U;
+        for (int w = 0; w < 3; ++w) {
+            bench_word(&rng, vocabulary, word, sizeof(word));
+            length += (size_t)snprintf(state.queries[q] + length, sizeof(state.queries[q]) - length, "%s ", word);
+        }
+    }
+    bench_run(ctx, name, bench_search_op, &state, 0.0, 0.0);
+    state.flags = KOLIBRI_KNOWLEDGE_SEARCH_PRUNE;
+    state.next = 0U;
+    snprintf(name, sizeof(name), "knowledge_search/docs=%zu/vocab=%zu/prune", docs, vocabulary);
+    bench_run(ctx, name, bench_search_op, &state, 0.0, 0.0);
+    kolibri_knowledge_index_destroy(state.index);
+}
+
+/* ---- Эволюция пула формул ---- */
+
+static void bench_pool_tick_op(void *arg) {
+    kf_pool_tick((KolibriFormulaPool *)arg, 1U);
+}
+
+static void bench_pool_tick(BenchContext *ctx) {
+    if (!bench_selected(ctx, "kf_pool_tick")) {
+        return;
+    }
+    KolibriFormulaPool pool;
+    if (kf_pool_init(&pool, ctx->seed) != 0) {
+        return;
+    }
+    for (int i = 0; i < 16; ++i) {
+        kf_pool_add_example(&pool, i, 2 * i + 1);
+    }
+    bench_run(ctx, "kf_pool_tick", bench_pool_tick_op, &pool, (double)pool.count, 0.0);
+    kf_pool_destroy(&pool);
+}
+
+/* ---- Геном ---- */
+
+static const unsigned char bench_key[] = "kolibri-bench-key";
+
+typedef struct {
+    KolibriGenome genome;
+    char payload[65];
+} AppendState;
+
+static void bench_append_op(void *arg) {
+    AppendState *state = (AppendState *)arg;
+    kg_append(&state->genome, "BENCH", state->payload, NULL);
+}
+
+typedef struct {
+    char path[300];
+} VerifyState;
+
+static void bench_verify_op(void *arg) {
+    VerifyState *state = (VerifyState *)arg;
+    kg_verify_file(state->path, bench_key, sizeof(bench_key) - 1U);
+}
+
+static void bench_genome(BenchContext *ctx) {
+    if (!bench_selected(ctx, "kg_append") && !bench_selected(ctx, "kg_verify_file")) {
+        return;
+    }
+    AppendState append;
+    memset(&append, 0, sizeof(append));
+    /* Полезная нагрузка генома — только десятичные цифры. */
+    for (size_t i = 0; i + 1U < sizeof(append.payload); ++i) {
+        append.payload[i] = (char)('0' + i % 10U);
+    }
+    VerifyState verify;
+    snprintf(verify.path, sizeof(verify.path), "%s/append.dat", ctx->workdir);
+    if (kg_open(&append.genome, verify.path, bench_key, sizeof(bench_key) - 1U) != 0) {
+        fprintf(stderr, "[kolibri-bench] genome open failed\n");
+        return;
+    }
+    if (kg_append(&append.genome, "BENCH", append.payload, NULL) != 0) {
+        fprintf(stderr, "[kolibri-bench] genome append failed\n");
+        kg_close(&append.genome);
+        return;
+    }
+    bench_run(ctx, "kg_append", bench_append_op, &append, 1.0, (double)(sizeof(append.payload) - 1U));
+    kg_close(&append.genome);
+
+    /* Проверка идёт по файлу фиксированного размера, а не по тому, что
+     * успел набрать kg_append. */
+    snprintf(verify.path, sizeof(verify.path), "%s/verify.dat", ctx->workdir);
+    size_t blocks = ctx->quick ? 500U : 20000U;
+    if (kg_open(&append.genome, verify.path, bench_key, sizeof(bench_key) - 1U) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        kg_append(&append.genome, "BENCH", append.payload, NULL);
+    }
+    kg_close(&append.genome);
+    struct stat st;
+    double file_bytes = stat(verify.path, &st) == 0 ? (double)st.st_size : 0.0;
+    if (kg_verify_file(verify.path, bench_key, sizeof(bench_key) - 1U) != 0) {
+        fprintf(stderr, "[kolibri-bench] genome verify failed\n");
+        return;
+    }
+    bench_run(ctx, "kg_verify_file", bench_verify_op, &verify, (double)blocks, file_bytes);
+}
+
+/* ---- KOLIBRI-Σ ---- */
+
+static const char bench_corpus[] =
+    "kolibri learns digits and words from every observation while the swarm shares formulas "
+    "alpha beta gamma delta alpha beta kolibri swarm genome journal formula digits words ";
+
+typedef struct {
+    uintptr_t state;
+    uint8_t out[128];
+} SigmaState;
+
+static void bench_observe_op(void *arg) {
+    SigmaState *state = (SigmaState *)arg;
+    k_observe(state->state, (const uint8_t *)bench_corpus, sizeof(bench_corpus) - 1U);
+}
+
+static void bench_decode_op(void *arg) {
+    SigmaState *state = (SigmaState *)arg;
+    k_decode(state->state, (const uint8_t *)"kolibri", 7U, state->out, sizeof(state->out), 0, 3);
+}
+
+static void bench_sigma(BenchContext *ctx) {
+    if (!bench_selected(ctx, "k_observe") && !bench_selected(ctx, "k_decode")) {
+        return;
+    }
+    SigmaState state;
+    state.state = k_state_new(0U);
+    if (state.state == 0U) {
+        return;
+    }
+    bench_run(ctx, "k_observe", bench_observe_op, &state, 0.0, (double)(sizeof(bench_corpus) - 1U));
+    bench_run(ctx, "k_decode", bench_decode_op, &state, 0.0, 0.0);
+    k_state_free(state.state);
+}
+
+/* ---- Сценарии ---- */
+
+static const struct {
+    const char *name;
+    const char *text;
+} bench_scripts[] = {
+    { "ks_execute/teach_ask",
+      "начало:\n"
+      "    обучить связь \"2\" -> \"4\"\n"
+      "    обучить связь \"привет\" -> \"здравствуй\"\n"
+      "    создать формулу ответ из \"ассоциация\"\n"
+      "    вызвать эволюцию\n"
+      "    оценить ответ на задаче \"привет\"\n"
+      "конец.\n" },
+    { "ks_execute/variables",
+      "начало:\n"
+      "    переменная имя = \"Колибри\"\n"
+      "    переменная город = \"Москва\"\n"
+      "    показать имя\n"
+      "    показать город\n"
+      "конец.\n" },
+};
+
+static void bench_discard_sink(void *user_data, const char *text, size_t length) {
+    (void)user_data;
+    (void)text;
+    (void)length;
+}
+
+static void bench_script_op(void *arg) {
+    ks_execute((KolibriScript *)arg);
+}
+
+static void bench_scripts_run(BenchContext *ctx) {
+    for (size_t i = 0; i < sizeof(bench_scripts) / sizeof(bench_scripts[0]); ++i) {
+        if (!bench_selected(ctx, bench_scripts[i].name)) {
+            continue;
+        }
+        KolibriFormulaPool pool;
+        if (kf_pool_init(&pool, ctx->seed) != 0) {
+            continue;
+        }
+        KolibriScript script;
+        if (ks_init(&script, &pool, NULL) != 0) {
+            kf_pool_destroy(&pool);
+            continue;
+        }
+        ks_set_sink(&script, bench_discard_sink, NULL);
+        if (ks_load_text(&script, bench_scripts[i].text) == 0 && ks_compile(&script) == 0) {
+            bench_run(ctx, bench_scripts[i].name, bench_script_op, &script, 0.0, 0.0);
+        }
+        ks_free(&script);
+        kf_pool_destroy(&pool);
+    }
+}
+
+/* ---- Десятичный транскодер ---- */
+
+typedef struct {
+    unsigned char *text;
+    size_t length;
+    k_digit_stream stream;
+} TransduceState;
+
+static void bench_transduce_op(void *arg) {
+    TransduceState *state = (TransduceState *)arg;
+    k_digit_stream_reset(&state->stream);
+    k_transduce_utf8(&state->stream, state->text, state->length);
+}
+
+static void bench_transduce(BenchContext *ctx) {
+    if (!bench_selected(ctx, "k_transduce_utf8")) {
+        return;
+    }
+    static const char sample[] = "Колибри видит цифры: kolibri sees digits 0123456789. ";
+    TransduceState state;
+    state.length = 64U * 1024U;
+    state.text = (unsigned char *)malloc(state.length);
+    uint8_t *digits = (uint8_t *)malloc(state.length * 3U);
+    if (!state.text || !digits) {
+        free(state.text);
+        free(digits);
+        return;
+    }
+    for (size_t i = 0; i < state.length; ++i) {
+        state.text[i] = (unsigned char)sample[i % (sizeof(sample) - 1U)];
+    }
+    k_digit_stream_init(&state.stream, digits, state.length * 3U);
+    bench_run(ctx, "k_transduce_utf8", bench_transduce_op, &state, 0.0, (double)state.length);
+    free(state.text);
+    free(digits);
+}
+
+static void remove_workdir(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+    struct dirent *entry;
+    char child[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        unlink(child);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  kolibri_bench [--filter NAME] [--min-time-ms MS] [--seed N] [--quick] [--output PATH]\n");
+}
+
+int main(int argc, char **argv) {
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.min_time_ms = 200.0;
+    ctx.seed = 20250101ULL;
+    ctx.out = stdout;
+    const char *output = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            ctx.filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            ctx.min_time_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            ctx.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            ctx.quick = 1;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (ctx.quick && ctx.min_time_ms > 5.0) {
+        ctx.min_time_ms = 5.0;
+    }
+    if (output) {
+        ctx.out = fopen(output, "w");
+        if (!ctx.out) {
+            perror("[kolibri-bench] fopen");
+            return 1;
+        }
+    }
+    const char *tmp = getenv("TMPDIR");
+    snprintf(ctx.workdir, sizeof(ctx.workdir), "%s/kolibri_benchXXXXXX", tmp && *tmp ? tmp : "/tmp");
+    if (!mkdtemp(ctx.workdir)) {
+        perror("[kolibri-bench] mkdtemp");
+        return 1;
+    }
+
+    fprintf(ctx.out, "{\"schema\":\"kolibri-bench/1\",\"seed\":%llu,\"quick\":%s,\"min_time_ms\":%.1f,"
+                     "\"allocs_counted\":%s,\"results\":[",
+            (unsigned long long)ctx.seed, ctx.quick ? "true" : "false", ctx.min_time_ms,
+            KOLIBRI_BENCH_HAS_ALLOCS ? "true" : "false");
+    if (ctx.quick) {
+        bench_knowledge_search(&ctx, 200U, 500U);
+    } else {
+        bench_knowledge_search(&ctx, 1000U, 2000U);
+        bench_knowledge_search(&ctx, 10000U, 20000U);
+        bench_knowledge_search(&ctx, 10000U, 2000U);
+    }
+    bench_pool_tick(&ctx);
+    bench_genome(&ctx);
+    bench_sigma(&ctx);
+    bench_scripts_run(&ctx);
+    bench_transduce(&ctx);
+    fprintf(ctx.out, "\n]}\n");
+
+    remove_workdir(ctx.workdir);
+    if (ctx.out != stdout) {
+        fclose(ctx.out);
+    }
+    return 0;
+}
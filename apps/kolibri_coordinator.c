@@ -1,5 +1,12 @@
 /*
- * Kolibri Coordinator: collects best formulas from nodes and rebroadcasts.
+ * Kolibri Coordinator: collects the best formulas from nodes and pushes
+ * changes of its top-N set to every target.
+ *
+ * Each target remembers which (gene, fitness) pairs it has already received;
+ * a broadcast round only queues the missing ones, so all changed genes go
+ * out in one batched write and an unchanged set costs nothing. Coordinators
+ * stack into a relay tree: a relay lists its slice of nodes as --node and
+ * the root as --parent, the root lists the relays as --node.
  */
 
 #include "kolibri/formula.h"
@@ -13,11 +20,23 @@
 #include <sys/time.h>
 #include <time.h>
 
+#define COORD_TOP_MAX 32U
+
 typedef struct {
   char host[64];
   uint16_t port;
+  /* Отпечатки формул, доставленных этой цели. */
+  uint64_t acked[COORD_TOP_MAX];
+  size_t acked_count;
 } Target;
 
+typedef struct {
+  KolibriFormula items[COORD_TOP_MAX];
+  uint64_t prints[COORD_TOP_MAX];
+  size_t count;
+  size_t limit;
+} TopSet;
+
 typedef struct {
   Target *items;
   size_t count;
@@ -42,11 +61,138 @@ static void targets_push(TargetList *list, const char *host, uint16_t port) {
     list->capacity = new_cap;
   }
   Target *t = &list->items[list->count++];
+  memset(t, 0, sizeof(*t));
   strncpy(t->host, host, sizeof(t->host) - 1);
   t->host[sizeof(t->host) - 1] = '\0';
   t->port = port;
 }
 
+static void targets_push_spec(TargetList *list, const char *arg) {
+  const char *colon = strchr(arg, ':');
+  if (colon) {
+    char host[64];
+    size_t host_len = (size_t)(colon - arg);
+    if (host_len >= sizeof(host)) host_len = sizeof(host) - 1U;
+    memcpy(host, arg, host_len);
+    host[host_len] = '\0';
+    uint16_t port = (uint16_t)strtoul(colon + 1, NULL, 10);
+    targets_push(list, host, port);
+  } else {
+    targets_push(list, "127.0.0.1", (uint16_t)strtoul(arg, NULL, 10));
+  }
+}
+
+/* Отпечаток гена вместе с приспособленностью: изменение любой части
+ * делает формулу новой для всех целей. */
+static uint64_t formula_print(const KolibriFormula *formula) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (size_t i = 0; i < formula->gene.length; ++i) {
+    hash ^= formula->gene.digits[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= formula->gene.length;
+  hash *= 1099511628211ULL;
+  uint64_t bits;
+  memcpy(&bits, &formula->fitness, sizeof(bits));
+  hash ^= bits;
+  hash *= 1099511628211ULL;
+  return hash ? hash : 1U;
+}
+
+static int gene_equal(const KolibriGene *a, const KolibriGene *b) {
+  return a->length == b->length && memcmp(a->digits, b->digits, a->length) == 0;
+}
+
+/* Вставляет формулу в упорядоченный по убыванию набор; одинаковый ген
+ * хранится один раз с лучшей приспособленностью. Возвращает 1 при
+ * изменении набора. */
+static int top_offer(TopSet *top, const KolibriFormula *formula) {
+  size_t pos = top->count;
+  for (size_t i = 0; i < top->count; ++i) {
+    if (gene_equal(&top->items[i].gene, &formula->gene)) {
+      if (formula->fitness <= top->items[i].fitness) {
+        return 0;
+      }
+      pos = i;
+      break;
+    }
+  }
+  if (pos == top->count) {
+    if (top->count == top->limit) {
+      if (formula->fitness <= top->items[top->count - 1].fitness) {
+        return 0;
+      }
+      pos = top->count - 1;
+    } else {
+      top->count++;
+    }
+  }
+  /* Поднимаем на место: набор мал, сдвиг дешевле любой структуры. */
+  while (pos > 0 && top->items[pos - 1].fitness < formula->fitness) {
+    top->items[pos] = top->items[pos - 1];
+    top->prints[pos] = top->prints[pos - 1];
+    pos--;
+  }
+  top->items[pos] = *formula;
+  top->prints[pos] = formula_print(formula);
+  return 1;
+}
+
+static int target_has(const Target *target, uint64_t print) {
+  for (size_t i = 0; i < target->acked_count; ++i) {
+    if (target->acked[i] == print) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Ставит в очередь цели недоставленные формулы набора и отправляет их
+ * одной записью; возвращает число отправленных формул. */
+static size_t target_push_delta(KolibriNetClient *client, Target *target,
+                                const TopSet *top) {
+  uint64_t sent[COORD_TOP_MAX];
+  size_t sent_count = 0U;
+  for (size_t i = 0; i < top->count; ++i) {
+    if (target_has(target, top->prints[i])) {
+      continue;
+    }
+    if (kn_client_queue_formula(client, target->host, target->port, &top->items[i]) != 0) {
+      target->acked_count = 0U;
+      return 0U;
+    }
+    sent[sent_count++] = top->prints[i];
+  }
+  if (sent_count == 0U) {
+    return 0U;
+  }
+  int rc = kn_client_flush_peer(client, target->host, target->port);
+  if (rc < 0) {
+    target->acked_count = 0U;
+    return 0U;
+  }
+  /* Прежние подтверждения действительны, только если соединение не
+   * переоткрывалось; выпавшие из набора формулы забываются. */
+  size_t kept = 0U;
+  uint64_t next[COORD_TOP_MAX];
+  for (size_t i = 0; i < top->count; ++i) {
+    uint64_t print = top->prints[i];
+    int delivered = 0;
+    for (size_t j = 0; j < sent_count; ++j) {
+      if (sent[j] == print) {
+        delivered = 1;
+        break;
+      }
+    }
+    if (delivered || (rc == 0 && target_has(target, print))) {
+      next[kept++] = print;
+    }
+  }
+  memcpy(target->acked, next, kept * sizeof(uint64_t));
+  target->acked_count = kept;
+  return sent_count;
+}
+
 static volatile sig_atomic_t running = 1;
 
 static void handle_sig(int sig) {
@@ -74,26 +220,24 @@ int main(int argc, char **argv) {
   /* Defaults: localhost base-port/count via flags */
   uint16_t base_port = 0U;
   int count = 0;
+  unsigned long top_limit = 8UL;
+  unsigned long resync_ms = 30000UL;
 
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
       listen_port = (uint16_t)strtoul(argv[++i], NULL, 10);
       continue;
     }
-    if (strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
-      const char *arg = argv[++i];
-      const char *colon = strchr(arg, ':');
-      if (colon) {
-        char host[64];
-        size_t host_len = (size_t)(colon - arg);
-        if (host_len >= sizeof(host)) host_len = sizeof(host) - 1U;
-        memcpy(host, arg, host_len);
-        host[host_len] = '\0';
-        uint16_t port = (uint16_t)strtoul(colon + 1, NULL, 10);
-        targets_push(&targets, host, port);
-      } else {
-        targets_push(&targets, "127.0.0.1", (uint16_t)strtoul(arg, NULL, 10));
-      }
+    if ((strcmp(argv[i], "--node") == 0 || strcmp(argv[i], "--parent") == 0) && i + 1 < argc) {
+      targets_push_spec(&targets, argv[++i]);
+      continue;
+    }
+    if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+      top_limit = strtoul(argv[++i], NULL, 10);
+      continue;
+    }
+    if (strcmp(argv[i], "--resync-ms") == 0 && i + 1 < argc) {
+      resync_ms = strtoul(argv[++i], NULL, 10);
       continue;
     }
     if (strcmp(argv[i], "--base-port") == 0 && i + 1 < argc) {
@@ -105,7 +249,8 @@ int main(int argc, char **argv) {
       continue;
     }
     if (strcmp(argv[i], "--help") == 0) {
-      printf("Usage: %s [--listen PORT] [--node HOST:PORT]... [--base-port P --count N]\n", argv[0]);
+      printf("Usage: %s [--listen PORT] [--node HOST:PORT]... [--parent HOST:PORT]\n"
+             "          [--base-port P --count N] [--top N] [--resync-ms MS]\n", argv[0]);
       return 0;
     }
   }
@@ -127,51 +272,66 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  KolibriNetClient client;
+  kn_client_init(&client, 0U);
+
   signal(SIGINT, handle_sig);
   signal(SIGTERM, handle_sig);
 
-  KolibriFormula best;
-  memset(&best, 0, sizeof(best));
-  double best_fitness = -1e9;
+  if (top_limit == 0UL || top_limit > COORD_TOP_MAX) {
+    top_limit = COORD_TOP_MAX;
+  }
+  TopSet top;
+  memset(&top, 0, sizeof(top));
+  top.limit = (size_t)top_limit;
   uint64_t last_broadcast = now_ms();
+  uint64_t last_resync = last_broadcast;
   const uint32_t interval_ms = 2000U;
 
-  printf("[coord] listening on %u; targets=%zu\n", listen_port, targets.count);
+  printf("[coord] listening on %u; targets=%zu top=%zu\n", listen_port, targets.count, top.limit);
 
+  KolibriNetMessage batch[32];
   while (running) {
-    KolibriNetMessage msg;
-    int rc = kn_listener_poll(&listener, 200U, &msg);
-    if (rc > 0) {
-      if (msg.type == KOLIBRI_MSG_MIGRATE_RULE) {
-        KolibriFormula incoming;
-        memset(&incoming, 0, sizeof(incoming));
-        incoming.gene.length = msg.data.formula.length;
-        if (incoming.gene.length > sizeof(incoming.gene.digits)) {
-          incoming.gene.length = sizeof(incoming.gene.digits);
-        }
-        memcpy(incoming.gene.digits, msg.data.formula.digits, incoming.gene.length);
-        incoming.fitness = msg.data.formula.fitness;
-        incoming.feedback = 0.0;
-
-        if (incoming.fitness > best_fitness) {
-          best = incoming;
-          best_fitness = incoming.fitness;
-          printf("[coord] updated best: fitness=%.3f len=%u\n", best_fitness, (unsigned)best.gene.length);
-        }
+    int rc = kn_listener_poll_batch(&listener, 200U, batch, sizeof(batch) / sizeof(batch[0]));
+    for (int m = 0; m < rc; ++m) {
+      const KolibriNetMessage *msg = &batch[m];
+      if (msg->type != KOLIBRI_MSG_MIGRATE_RULE) {
+        continue;
+      }
+      KolibriFormula incoming;
+      memset(&incoming, 0, sizeof(incoming));
+      incoming.gene.length = msg->data.formula.length;
+      if (incoming.gene.length > sizeof(incoming.gene.digits)) {
+        incoming.gene.length = sizeof(incoming.gene.digits);
+      }
+      memcpy(incoming.gene.digits, msg->data.formula.digits, incoming.gene.length);
+      incoming.fitness = msg->data.formula.fitness;
+      incoming.feedback = 0.0;
+
+      if (top_offer(&top, &incoming) && top.items[0].fitness == incoming.fitness &&
+          gene_equal(&top.items[0].gene, &incoming.gene)) {
+        printf("[coord] updated best: fitness=%.3f len=%u\n", incoming.fitness,
+               (unsigned)incoming.gene.length);
       }
     }
 
     uint64_t now = now_ms();
-    if (best_fitness > -1e8 && (now - last_broadcast) >= interval_ms) {
-      for (size_t i = 0; i < targets.count; ++i) {
-        if (kn_share_formula(targets.items[i].host, targets.items[i].port, 0U, &best) == 0) {
-          /* ok */
+    if (top.count > 0 && (now - last_broadcast) >= interval_ms) {
+      /* Редкая полная пересылка страхует от потерь, которых TCP не видит. */
+      if (resync_ms > 0 && now - last_resync >= resync_ms) {
+        for (size_t i = 0; i < targets.count; ++i) {
+          targets.items[i].acked_count = 0U;
         }
+        last_resync = now;
+      }
+      for (size_t i = 0; i < targets.count; ++i) {
+        target_push_delta(&client, &targets.items[i], &top);
       }
       last_broadcast = now;
     }
   }
 
+  kn_client_close(&client);
   kn_listener_close(&listener);
   printf("[coord] shutdown\n");
   return 0;
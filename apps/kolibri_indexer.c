@@ -1,39 +1,103 @@
 #include "kolibri/knowledge_index.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
 static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
-            "  kolibri_indexer build --output DIR ROOT...\n"
+            "  kolibri_indexer build [--threads N] [--shards N] --output DIR ROOT...\n"
             "  kolibri_indexer search --query TEXT [--limit N] ROOT...\n");
 }
 
+static int write_index(const KolibriKnowledgeIndex *index, const char *output_dir) {
+    int err = kolibri_knowledge_index_write_json(index, output_dir);
+    if (err == 0) {
+        err = kolibri_knowledge_index_write_binary(index, output_dir);
+    }
+    return err;
+}
+
+/* DIR/shard-K для каждого шарда; запускаются отдельными серверами с
+ * KOLIBRI_KNOWLEDGE_INDEX_JSON=DIR/shard-K. */
+static int write_shards(const KolibriKnowledgeIndex *index, const char *output_dir, size_t shards) {
+    if (mkdir(output_dir, 0777) != 0 && errno != EEXIST) {
+        return errno;
+    }
+    for (size_t k = 0; k < shards; ++k) {
+        KolibriKnowledgeIndex *shard = NULL;
+        int err = kolibri_knowledge_index_partition(index, k, shards, &shard);
+        if (err != 0) {
+            return err;
+        }
+        char shard_dir[4096];
+        snprintf(shard_dir, sizeof(shard_dir), "%s/shard-%zu", output_dir, k);
+        err = write_index(shard, shard_dir);
+        fprintf(stderr,
+                "Shard %zu: %zu documents -> %s\n",
+                k,
+                kolibri_knowledge_index_document_count(shard),
+                shard_dir);
+        kolibri_knowledge_index_destroy(shard);
+        if (err != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
 static int handle_build(int argc, char **argv) {
     const char *output_dir = NULL;
+    size_t threads = 0U;
+    size_t shards = 1U;
     size_t root_start = 0U;
     for (int i = 0; i < argc; ++i) {
-        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = (size_t)atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            int value = atoi(argv[i + 1]);
+            shards = value > 0 ? (size_t)value : 0U;
+            i++;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             output_dir = argv[i + 1];
             root_start = (size_t)(i + 2);
             break;
         }
     }
-    if (!output_dir || root_start >= (size_t)argc) {
+    if (!output_dir || root_start >= (size_t)argc || shards == 0U) {
         print_usage();
         return 1;
     }
 
     size_t root_count = (size_t)argc - root_start;
     KolibriKnowledgeIndex *index = NULL;
-    int err = kolibri_knowledge_index_create((const char *const *)&argv[root_start], root_count, 1024U, &index);
+    struct timespec started;
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int err = kolibri_knowledge_index_create_threads((const char *const *)&argv[root_start],
+                                                     root_count,
+                                                     1024U,
+                                                     threads,
+                                                     &index);
     if (err != 0 || !index) {
         fprintf(stderr, "Failed to build index: %d\n", err);
         return 1;
     }
-    err = kolibri_knowledge_index_write_json(index, output_dir);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (double)(finished.tv_sec - started.tv_sec) +
+                     (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
+    size_t documents = kolibri_knowledge_index_document_count(index);
+    fprintf(stderr,
+            "Indexed %zu documents in %.3f s (%.0f docs/s)\n",
+            documents,
+            seconds,
+            seconds > 0.0 ? (double)documents / seconds : 0.0);
+    err = shards > 1U ? write_shards(index, output_dir, shards) : write_index(index, output_dir);
     kolibri_knowledge_index_destroy(index);
     if (err != 0) {
         fprintf(stderr, "Failed to write index: %d\n", err);
@@ -3,13 +3,26 @@
  * to node genomes, re-signing with node HMAC keys.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "kolibri/genome.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <libgen.h>
+#include <sys/inotify.h>
+#endif
 
 static int ends_with(const char *s, const char *suffix) {
   size_t ls = strlen(s), lsf = strlen(suffix);
@@ -18,18 +31,119 @@ static int ends_with(const char *s, const char *suffix) {
 
 static int is_genome_file(const char *name) { return ends_with(name, ".dat"); }
 
-static void relay_event_to_target(const char *target_path, const unsigned char *key,
-                                  size_t key_len, const char *event_type,
-                                  const char *payload) {
-  KolibriGenome g;
-  if (kg_open(&g, target_path, key, key_len) != 0) {
-    fprintf(stderr, "[relay] open target failed: %s\n", target_path);
-    return;
+#define RELAY_BATCH 512
+#define RELAY_POLL_MS 500
+
+typedef struct {
+  char event_type[KOLIBRI_EVENT_TYPE_SIZE + 1];
+  char payload[KOLIBRI_PAYLOAD_SIZE + 1];
+} RelayEvent;
+
+/* Целевой геном, открытый на всё время работы ретранслятора. */
+typedef struct {
+  char path[512];
+  KolibriGenome genome;
+  int open;
+} RelayTarget;
+
+typedef struct {
+  RelayTarget *items;
+  size_t count;
+  size_t capacity;
+} RelayTargets;
+
+static volatile sig_atomic_t relay_stop = 0;
+
+static void relay_on_signal(int sig) {
+  (void)sig;
+  relay_stop = 1;
+}
+
+static RelayTarget *targets_find_or_add(RelayTargets *targets, const char *path) {
+  for (size_t i = 0; i < targets->count; ++i) {
+    if (strcmp(targets->items[i].path, path) == 0) {
+      return &targets->items[i];
+    }
   }
-  if (kg_append(&g, event_type, payload, NULL) != 0) {
-    fprintf(stderr, "[relay] append failed: %s\n", target_path);
+  if (targets->count == targets->capacity) {
+    size_t capacity = targets->capacity ? targets->capacity * 2 : 16;
+    RelayTarget *items = (RelayTarget *)realloc(targets->items, capacity * sizeof(RelayTarget));
+    if (!items) return NULL;
+    targets->items = items;
+    targets->capacity = capacity;
   }
-  kg_close(&g);
+  RelayTarget *target = &targets->items[targets->count++];
+  memset(target, 0, sizeof(*target));
+  snprintf(target->path, sizeof(target->path), "%s", path);
+  return target;
+}
+
+static void targets_close(RelayTargets *targets) {
+  for (size_t i = 0; i < targets->count; ++i) {
+    if (targets->items[i].open) {
+      kg_close(&targets->items[i].genome);
+    }
+  }
+  free(targets->items);
+  memset(targets, 0, sizeof(*targets));
+}
+
+/* Узел мог дописать свой геном в обход нас: тогда кэшированный хвост цепочки
+ * устарел и геном открывается заново. */
+static int target_ready(RelayTarget *target, const unsigned char *key, size_t key_len) {
+  if (target->open) {
+    struct stat st;
+    if (fflush(target->genome.file) == 0 && fstat(fileno(target->genome.file), &st) == 0 &&
+        (uint64_t)st.st_size == target->genome.end_offset) {
+      return 0;
+    }
+    kg_close(&target->genome);
+    target->open = 0;
+  }
+  if (kg_open(&target->genome, target->path, key, key_len) != 0) {
+    fprintf(stderr, "[relay] open target failed: %s\n", target->path);
+    return -1;
+  }
+  target->open = 1;
+  return 0;
+}
+
+/* Каталог перечитывается на каждую пачку, чтобы подхватывать новые узлы;
+ * уже известные геномы остаются открытыми. */
+static int relay_flush(const char *targets_dir, RelayTargets *targets,
+                       const unsigned char *key, size_t key_len,
+                       const RelayEvent *pending, size_t count) {
+  if (count == 0) return 0;
+  KolibriGenomeEvent events[RELAY_BATCH];
+  for (size_t i = 0; i < count; ++i) {
+    events[i].event_type = pending[i].event_type;
+    events[i].payload = pending[i].payload;
+  }
+  DIR *dir = opendir(targets_dir);
+  if (!dir) {
+    fprintf(stderr, "[relay] cannot open targets-dir %s\n", targets_dir);
+    return -1;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] == '.') continue;
+    if (!is_genome_file(ent->d_name)) continue;
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", targets_dir, ent->d_name);
+    RelayTarget *target = targets_find_or_add(targets, path);
+    if (!target) {
+      fprintf(stderr, "[relay] out of memory\n");
+      break;
+    }
+    if (target_ready(target, key, key_len) != 0) continue;
+    if (kg_append_batch(&target->genome, events, count, NULL) != 0) {
+      fprintf(stderr, "[relay] append failed: %s\n", path);
+      kg_close(&target->genome);
+      target->open = 0;
+    }
+  }
+  closedir(dir);
+  return 0;
 }
 
 static int load_key_from_file(const char *path, unsigned char *out, size_t *out_len) {
@@ -42,12 +156,133 @@ static int load_key_from_file(const char *path, unsigned char *out, size_t *out_
   return 0;
 }
 
+static void save_offset(const char *offset_path, unsigned long long offset) {
+  FILE *ofs = fopen(offset_path, "w");
+  if (ofs) {
+    fprintf(ofs, "%llu\n", offset);
+    fclose(ofs);
+  }
+}
+
+/* Источник читается через kg_reader любого формата: для v1 переход к блоку
+ * start_index мгновенный, для v2 — по индексу сегмента или заголовкам кадров
+ * без распаковки.
+ * Недописанный хвост пропускается до следующего прохода. */
+static int relay_pass(const char *source_path, const char *targets_dir, RelayTargets *targets,
+                      const unsigned char *key, size_t key_len, RelayEvent *pending,
+                      unsigned long long *start_index, unsigned long long *processed) {
+  KolibriGenomeReader reader;
+  if (kg_reader_open(&reader, source_path) != 0) {
+    fprintf(stderr, "[relay] cannot open source %s\n", source_path);
+    return -1;
+  }
+  if (kg_reader_seek(&reader, *start_index) != 0) {
+    fprintf(stderr, "[relay] cannot seek source %s\n", source_path);
+    kg_reader_close(&reader);
+    return -1;
+  }
+
+  size_t pending_count = 0U;
+  /* Смещение фиксируется только после того, как пачка разослана. */
+  unsigned long long pending_next = *start_index;
+  int rc = 0;
+
+  ReasonBlock block;
+  int got = 0;
+  while ((got = kg_reader_next(&reader, &block)) == 1) {
+    unsigned long long idx = (unsigned long long)block.index;
+    if (idx < *start_index) {
+      continue;
+    }
+
+    RelayEvent *event = &pending[pending_count];
+    memset(event, 0, sizeof(*event));
+    memcpy(event->event_type, block.event_type, KOLIBRI_EVENT_TYPE_SIZE);
+    memcpy(event->payload, block.payload, KOLIBRI_PAYLOAD_SIZE);
+    pending_next = idx + 1ULL;
+
+    /* Filter events */
+    if (strncmp(event->event_type, "TEACH", 5) != 0 && strncmp(event->event_type, "USER_FEEDBACK", 13) != 0) {
+      if (pending_count == 0U) {
+        *start_index = pending_next;
+      }
+      continue;
+    }
+
+    pending_count += 1U;
+    if (pending_count == RELAY_BATCH) {
+      if (relay_flush(targets_dir, targets, key, key_len, pending, pending_count) != 0) {
+        pending_count = 0U;
+        rc = -1;
+        break;
+      }
+      *processed += pending_count;
+      pending_count = 0U;
+      *start_index = pending_next;
+    }
+  }
+  if (pending_count > 0U) {
+    if (relay_flush(targets_dir, targets, key, key_len, pending, pending_count) == 0) {
+      *processed += pending_count;
+      *start_index = pending_next;
+    } else {
+      rc = -1;
+    }
+  }
+  if (got < 0) {
+    fprintf(stderr, "[relay] corrupt source %s\n", source_path);
+    rc = -1;
+  }
+  kg_reader_close(&reader);
+  return rc;
+}
+
+static void sleep_ms(int ms) {
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+  nanosleep(&ts, NULL);
+}
+
+#ifdef __linux__
+/* Следим за каталогом источника, а не за файлом: так переживаем замену генома
+ * через rename. */
+static int follow_watch(const char *source_path) {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) return -1;
+  char dir[512];
+  snprintf(dir, sizeof(dir), "%s", source_path);
+  if (inotify_add_watch(fd, dirname(dir), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+#endif
+
+/* Ждёт изменения источника; без inotify просто спит poll_ms. Таймаут
+ * сохраняется и с inotify, чтобы не пропустить запись, сделанную через mmap. */
+static void follow_wait(int watch_fd, int poll_ms) {
+  if (watch_fd < 0) {
+    sleep_ms(poll_ms);
+    return;
+  }
+  struct pollfd pfd = {.fd = watch_fd, .events = POLLIN, .revents = 0};
+  if (poll(&pfd, 1, poll_ms) > 0) {
+    char buf[4096];
+    while (read(watch_fd, buf, sizeof(buf)) > 0) {
+    }
+  }
+}
+
 int main(int argc, char **argv) {
   const char *source_path = ".kolibri/knowledge_genome.dat";
   const char *targets_dir = "build/cluster";
   const char *target_key_path = "build/cluster/swarm.key";
   const char *target_key_inline = NULL;
   const char *offset_path = ".kolibri/knowledge_relay.offset";
+  int follow = 0;
+  int poll_ms = RELAY_POLL_MS;
 
   for (int i = 1; i < argc; ++i) {
     if (strcmp(argv[i], "--source") == 0 && i + 1 < argc) {
@@ -70,8 +305,19 @@ int main(int argc, char **argv) {
       offset_path = argv[++i];
       continue;
     }
+    if (strcmp(argv[i], "--follow") == 0) {
+      follow = 1;
+      continue;
+    }
+    if (strcmp(argv[i], "--poll-ms") == 0 && i + 1 < argc) {
+      poll_ms = atoi(argv[++i]);
+      if (poll_ms <= 0) poll_ms = RELAY_POLL_MS;
+      continue;
+    }
     if (strcmp(argv[i], "--help") == 0) {
-      printf("Usage: %s [--source PATH] [--targets-dir DIR] [--target-key FILE] [--offset FILE]\n", argv[0]);
+      printf("Usage: %s [--source PATH] [--targets-dir DIR] [--target-key FILE] [--offset FILE]"
+             " [--follow] [--poll-ms MS]\n",
+             argv[0]);
       return 0;
     }
   }
@@ -90,8 +336,7 @@ int main(int argc, char **argv) {
     }
   }
 
-  FILE *src = fopen(source_path, "rb");
-  if (!src) {
+  if (access(source_path, R_OK) != 0) {
     fprintf(stderr, "[relay] cannot open source %s: %s\n", source_path, strerror(errno));
     return 1;
   }
@@ -105,63 +350,39 @@ int main(int argc, char **argv) {
     fclose(ofs);
   }
 
-  /* Iterate over fixed-size blocks */
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  unsigned long long processed = 0ULL;
-
-  /* Skip blocks below start_index by reading and counting */
-  while (fread(bytes, 1, KOLIBRI_BLOCK_SIZE, src) == KOLIBRI_BLOCK_SIZE) {
-    /* Deserialize minimal fields: index, event_type, payload */
-    unsigned long long idx = 0ULL;
-    for (int i = 0; i < 8; ++i) {
-      idx = (idx << 8) | (unsigned long long)bytes[i];
-    }
-    if (idx < start_index) {
-      continue;
-    }
-
-    char event_type[KOLIBRI_EVENT_TYPE_SIZE + 1];
-    char payload[KOLIBRI_PAYLOAD_SIZE + 1];
-    memset(event_type, 0, sizeof(event_type));
-    memset(payload, 0, sizeof(payload));
-    memcpy(event_type, bytes + 16 + KOLIBRI_HASH_SIZE * 2, KOLIBRI_EVENT_TYPE_SIZE);
-    memcpy(payload, bytes + 16 + KOLIBRI_HASH_SIZE * 2 + KOLIBRI_EVENT_TYPE_SIZE, KOLIBRI_PAYLOAD_SIZE);
-    event_type[KOLIBRI_EVENT_TYPE_SIZE] = '\0';
-    payload[KOLIBRI_PAYLOAD_SIZE] = '\0';
+  RelayEvent *pending = (RelayEvent *)malloc(RELAY_BATCH * sizeof(RelayEvent));
+  if (!pending) {
+    fprintf(stderr, "[relay] out of memory\n");
+    return 1;
+  }
 
-    /* Filter events */
-    if (strncmp(event_type, "TEACH", 5) != 0 && strncmp(event_type, "USER_FEEDBACK", 13) != 0) {
-      start_index = idx + 1ULL;
-      continue;
-    }
+  int watch_fd = -1;
+  if (follow) {
+    signal(SIGINT, relay_on_signal);
+    signal(SIGTERM, relay_on_signal);
+#ifdef __linux__
+    watch_fd = follow_watch(source_path);
+#endif
+  }
 
-    /* Broadcast to all genomes in targets_dir */
-    DIR *dir = opendir(targets_dir);
-    if (!dir) {
-      fprintf(stderr, "[relay] cannot open targets-dir %s\n", targets_dir);
-      break;
+  RelayTargets targets = {0};
+  unsigned long long processed = 0ULL;
+  do {
+    unsigned long long before = start_index;
+    relay_pass(source_path, targets_dir, &targets, target_key, target_key_len, pending,
+               &start_index, &processed);
+    if (start_index != before) {
+      save_offset(offset_path, start_index);
     }
-    struct dirent *ent;
-    while ((ent = readdir(dir)) != NULL) {
-      if (ent->d_name[0] == '.') continue;
-      if (!is_genome_file(ent->d_name)) continue;
-      char path[512];
-      snprintf(path, sizeof(path), "%s/%s", targets_dir, ent->d_name);
-      relay_event_to_target(path, target_key, target_key_len, event_type, payload);
+    if (follow && !relay_stop) {
+      follow_wait(watch_fd, poll_ms);
     }
-    closedir(dir);
+  } while (follow && !relay_stop);
 
-    start_index = idx + 1ULL;
-    processed += 1ULL;
-  }
-
-  fclose(src);
-
-  ofs = fopen(offset_path, "w");
-  if (ofs) {
-    fprintf(ofs, "%llu\n", start_index);
-    fclose(ofs);
-  }
+  if (watch_fd >= 0) close(watch_fd);
+  targets_close(&targets);
+  free(pending);
+  save_offset(offset_path, start_index);
 
   printf("[relay] processed %llu events\n", processed);
   return 0;
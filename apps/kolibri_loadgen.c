@@ -0,0 +1,953 @@
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Замкнутый нагрузочный генератор для kolibri_knowledge_server: каждое
+ * соединение ждёт ответа перед следующим запросом. Журнал запросов
+ * проигрывается по кругу, результат — JSON с перцентилями латентности. */
+
+typedef enum {
+    LOADGEN_ROUTE_SEARCH = 0,
+    LOADGEN_ROUTE_TEACH,
+    LOADGEN_ROUTE_FEEDBACK,
+    LOADGEN_ROUTE_COUNT
+} LoadgenRoute;
+
+static const char *const loadgen_route_names[LOADGEN_ROUTE_COUNT] = { "search", "teach", "feedback" };
+
+typedef struct {
+    LoadgenRoute route;
+    char *request;
+    size_t length;
+} LoadgenEntry;
+
+/* Логарифмическая гистограмма микросекунд: 32 корзины на октаву,
+ * относительная погрешность не больше 1/32. */
+#define LOADGEN_SUB_BUCKETS 32U
+#define LOADGEN_BUCKETS (LOADGEN_SUB_BUCKETS * 33U)
+
+typedef struct {
+    uint64_t requests;
+    uint64_t ok;
+    uint64_t rate_limited;
+    uint64_t client_errors;
+    uint64_t server_errors;
+    uint64_t transport_errors;
+    uint64_t latency_sum_us;
+    uint64_t latency_max_us;
+    uint64_t histogram[LOADGEN_BUCKETS];
+} LoadgenRouteStats;
+
+typedef struct {
+    LoadgenRouteStats routes[LOADGEN_ROUTE_COUNT];
+    uint64_t connects;
+    uint64_t bytes_received;
+} LoadgenStats;
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    const LoadgenEntry *entries;
+    size_t entry_count;
+    uint64_t total_requests;
+    uint64_t deadline_ns;
+    uint64_t started_ns;
+    double rps;
+    int keepalive;
+    int timeout_ms;
+    atomic_uint_fast64_t next;
+} LoadgenPlan;
+
+typedef struct {
+    LoadgenPlan *plan;
+    LoadgenStats stats;
+    pthread_t thread;
+} LoadgenWorker;
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} LoadgenBuffer;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t target) {
+    uint64_t now = monotonic_ns();
+    if (target <= now) {
+        return;
+    }
+    uint64_t delta = target - now;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(delta / 1000000000ULL);
+    ts.tv_nsec = (long)(delta % 1000000000ULL);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static size_t histogram_bucket(uint64_t value) {
+    if (value < LOADGEN_SUB_BUCKETS) {
+        return (size_t)value;
+    }
+    unsigned magnitude = 63U - (unsigned)__builtin_clzll(value);
+    if (magnitude > 36U) {
+        return LOADGEN_BUCKETS - 1U;
+    }
+    uint64_t top = value >> (magnitude - 5U);
+    return LOADGEN_SUB_BUCKETS + (size_t)(magnitude - 5U) * LOADGEN_SUB_BUCKETS + (size_t)(top - LOADGEN_SUB_BUCKETS);
+}
+
+/* Верхняя граница корзины: перцентили не занижаются. */
+static uint64_t histogram_bucket_upper(size_t bucket) {
+    if (bucket < LOADGEN_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    unsigned magnitude = (unsigned)((bucket - LOADGEN_SUB_BUCKETS) / LOADGEN_SUB_BUCKETS) + 5U;
+    uint64_t top = (uint64_t)((bucket - LOADGEN_SUB_BUCKETS) % LOADGEN_SUB_BUCKETS) + LOADGEN_SUB_BUCKETS;
+    return ((top + 1U) << (magnitude - 5U)) - 1U;
+}
+
+static uint64_t histogram_percentile(const LoadgenRouteStats *stats, double percentile) {
+    uint64_t total = 0U;
+    for (size_t i = 0; i < LOADGEN_BUCKETS; ++i) {
+        total += stats->histogram[i];
+    }
+    if (total == 0U) {
+        return 0U;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.999999);
+    if (rank == 0U) {
+        rank = 1U;
+    }
+    uint64_t seen = 0U;
+    for (size_t i = 0; i < LOADGEN_BUCKETS; ++i) {
+        seen += stats->histogram[i];
+        if (seen >= rank) {
+            uint64_t upper = histogram_bucket_upper(i);
+            return upper < stats->latency_max_us ? upper : stats->latency_max_us;
+        }
+    }
+    return stats->latency_max_us;
+}
+
+static void route_stats_merge(LoadgenRouteStats *into, const LoadgenRouteStats *from) {
+    into->requests += from->requests;
+    into->ok += from->ok;
+    into->rate_limited += from->rate_limited;
+    into->client_errors += from->client_errors;
+    into->server_errors += from->server_errors;
+    into->transport_errors += from->transport_errors;
+    into->latency_sum_us += from->latency_sum_us;
+    if (from->latency_max_us > into->latency_max_us) {
+        into->latency_max_us = from->latency_max_us;
+    }
+    for (size_t i = 0; i < LOADGEN_BUCKETS; ++i) {
+        into->histogram[i] += from->histogram[i];
+    }
+}
+
+static int buffer_reserve(LoadgenBuffer *buffer, size_t extra) {
+    if (buffer->length + extra + 1U <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096U;
+    while (capacity < buffer->length + extra + 1U) {
+        capacity *= 2U;
+    }
+    char *data = (char *)realloc(buffer->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(LoadgenBuffer *buffer, const char *text, size_t length) {
+    if (buffer_reserve(buffer, length) != 0) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+static int buffer_append_urlencoded(LoadgenBuffer *buffer, const char *text) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        char encoded[3];
+        if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '-' ||
+            *p == '_' || *p == '.' || *p == '~') {
+            encoded[0] = (char)*p;
+            if (buffer_append(buffer, encoded, 1U) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        encoded[0] = '%';
+        encoded[1] = hex[*p >> 4];
+        encoded[2] = hex[*p & 0x0F];
+        if (buffer_append(buffer, encoded, 3U) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ---- Разбор журнала запросов ---- */
+
+static void utf8_append(LoadgenBuffer *out, unsigned code) {
+    char bytes[4];
+    size_t length = 0U;
+    if (code < 0x80U) {
+        bytes[length++] = (char)code;
+    } else if (code < 0x800U) {
+        bytes[length++] = (char)(0xC0U | (code >> 6));
+        bytes[length++] = (char)(0x80U | (code & 0x3FU));
+    } else {
+        bytes[length++] = (char)(0xE0U | (code >> 12));
+        bytes[length++] = (char)(0x80U | ((code >> 6) & 0x3FU));
+        bytes[length++] = (char)(0x80U | (code & 0x3FU));
+    }
+    buffer_append(out, bytes, length);
+}
+
+/* Находит значение поля верхнего уровня строки JSONL; строки раскрываются,
+ * числа копируются как есть. Вложенные объекты не поддерживаются. */
+static int json_field(const char *line, const char *key, LoadgenBuffer *out) {
+    out->length = 0U;
+    if (buffer_reserve(out, 0U) != 0) {
+        return -1;
+    }
+    out->data[0] = '\0';
+    size_t key_len = strlen(key);
+    const char *cursor = line;
+    while ((cursor = strchr(cursor, '"')) != NULL) {
+        const char *name = cursor + 1;
+        const char *end = name;
+        while (*end && *end != '"') {
+            end += (*end == '\\' && end[1]) ? 2 : 1;
+        }
+        if (!*end) {
+            return -1;
+        }
+        const char *after = end + 1;
+        while (*after == ' ' || *after == '\t') {
+            ++after;
+        }
+        if (*after != ':') {
+            cursor = end + 1;
+            continue;
+        }
+        const char *value = after + 1;
+        while (*value == ' ' || *value == '\t') {
+            ++value;
+        }
+        if ((size_t)(end - name) != key_len || strncmp(name, key, key_len) != 0) {
+            cursor = value;
+            continue;
+        }
+        if (*value != '"') {
+            const char *stop = value;
+            while (*stop && *stop != ',' && *stop != '}' && *stop != ' ') {
+                ++stop;
+            }
+            return buffer_append(out, value, (size_t)(stop - value));
+        }
+        for (const char *p = value + 1; *p && *p != '"'; ++p) {
+            if (*p != '\\') {
+                buffer_append(out, p, 1U);
+                continue;
+            }
+            ++p;
+            switch (*p) {
+            case 'n':
+                buffer_append(out, "\n", 1U);
+                break;
+            case 't':
+                buffer_append(out, "\t", 1U);
+                break;
+            case 'r':
+                buffer_append(out, "\r", 1U);
+                break;
+            case 'u': {
+                unsigned code = 0U;
+                int digits = 0;
+                while (digits < 4 && p[1]) {
+                    char c = p[1];
+                    unsigned nibble = (c >= '0' && c <= '9')   ? (unsigned)(c - '0')
+                                      : (c >= 'a' && c <= 'f') ? (unsigned)(c - 'a' + 10)
+                                      : (c >= 'A' && c <= 'F') ? (unsigned)(c - 'A' + 10)
+                                                               : 16U;
+                    if (nibble > 15U) {
+                        break;
+                    }
+                    code = code * 16U + nibble;
+                    ++digits;
+                    ++p;
+                }
+                utf8_append(out, code);
+                break;
+            }
+            case '\0':
+                return 0;
+            default:
+                buffer_append(out, p, 1U);
+                break;
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
+
+static int render_entry(const char *line, const char *host, const char *token, int keepalive, LoadgenEntry *entry) {
+    LoadgenBuffer field = { 0 };
+    LoadgenBuffer body = { 0 };
+    LoadgenBuffer request = { 0 };
+    int rc = -1;
+    entry->route = LOADGEN_ROUTE_SEARCH;
+    if (line[0] == '{') {
+        if (json_field(line, "route", &field) == 0) {
+            if (strcmp(field.data, "teach") == 0) {
+                entry->route = LOADGEN_ROUTE_TEACH;
+            } else if (strcmp(field.data, "feedback") == 0) {
+                entry->route = LOADGEN_ROUTE_FEEDBACK;
+            } else if (strcmp(field.data, "search") != 0) {
+                fprintf(stderr, "[kolibri-loadgen] unknown route: %s\n", field.data);
+                goto done;
+            }
+        }
+    }
+    const char *connection = keepalive ? "keep-alive" : "close";
+    if (entry->route == LOADGEN_ROUTE_SEARCH) {
+        static const char search_prefix[] = "GET /api/knowledge/search?q=";
+        buffer_append(&request, search_prefix, sizeof(search_prefix) - 1U);
+        if (line[0] == '{') {
+            if (json_field(line, "q", &field) != 0) {
+                fprintf(stderr, "[kolibri-loadgen] search entry without q: %s\n", line);
+                goto done;
+            }
+            buffer_append_urlencoded(&request, field.data);
+            if (json_field(line, "limit", &field) == 0 && field.length > 0U) {
+                buffer_append(&request, "&limit=", 7U);
+                buffer_append_urlencoded(&request, field.data);
+            }
+            if (json_field(line, "mode", &field) == 0 && field.length > 0U) {
+                buffer_append(&request, "&mode=", 6U);
+                buffer_append_urlencoded(&request, field.data);
+            }
+        } else {
+            buffer_append_urlencoded(&request, line);
+        }
+        char tail[512];
+        int length = snprintf(tail, sizeof(tail), " HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n\r\n", host, connection);
+        buffer_append(&request, tail, (size_t)length);
+    } else {
+        static const char *const fields[] = { "q", "a", "rating" };
+        size_t field_count = entry->route == LOADGEN_ROUTE_FEEDBACK ? 3U : 2U;
+        for (size_t i = 0; i < field_count; ++i) {
+            if (json_field(line, fields[i], &field) != 0) {
+                continue;
+            }
+            if (body.length > 0U) {
+                buffer_append(&body, "&", 1U);
+            }
+            buffer_append(&body, fields[i], strlen(fields[i]));
+            buffer_append(&body, "=", 1U);
+            buffer_append_urlencoded(&body, field.data);
+        }
+        char head[1024];
+        int length = snprintf(head,
+                              sizeof(head),
+                              "POST /api/knowledge/%s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\n"
+                              "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n"
+                              "%s%s%s\r\n",
+                              loadgen_route_names[entry->route],
+                              host,
+                              connection,
+                              body.length,
+                              token ? "Authorization: Bearer " : "",
+                              token ? token : "",
+                              token ? "\r\n" : "");
+        if (length < 0 || (size_t)length >= sizeof(head)) {
+            goto done;
+        }
+        buffer_append(&request, head, (size_t)length);
+        if (body.length > 0U) {
+            buffer_append(&request, body.data, body.length);
+        }
+    }
+    if (!request.data) {
+        goto done;
+    }
+    entry->request = request.data;
+    entry->length = request.length;
+    request.data = NULL;
+    rc = 0;
+done:
+    free(field.data);
+    free(body.data);
+    free(request.data);
+    return rc;
+}
+
+static int load_entries(const char *path, const char *host, const char *token, int keepalive,
+                        LoadgenEntry **out_entries, size_t *out_count) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "[kolibri-loadgen] cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    LoadgenEntry *entries = NULL;
+    size_t count = 0U;
+    size_t capacity = 0U;
+    char *line = NULL;
+    size_t line_capacity = 0U;
+    ssize_t length;
+    int rc = 0;
+    while ((length = getline(&line, &line_capacity, fp)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        char *start = line;
+        while (*start == ' ' || *start == '\t') {
+            ++start;
+        }
+        if (*start == '\0' || *start == '#') {
+            continue;
+        }
+        if (count == capacity) {
+            size_t next = capacity ? capacity * 2U : 64U;
+            LoadgenEntry *grown = (LoadgenEntry *)realloc(entries, next * sizeof(*entries));
+            if (!grown) {
+                rc = -1;
+                break;
+            }
+            entries = grown;
+            capacity = next;
+        }
+        if (render_entry(start, host, token, keepalive, &entries[count]) != 0) {
+            rc = -1;
+            break;
+        }
+        ++count;
+    }
+    free(line);
+    fclose(fp);
+    if (rc == 0 && count == 0U) {
+        fprintf(stderr, "[kolibri-loadgen] %s has no requests\n", path);
+        rc = -1;
+    }
+    if (rc != 0) {
+        for (size_t i = 0; i < count; ++i) {
+            free(entries[i].request);
+        }
+        free(entries);
+        return -1;
+    }
+    *out_entries = entries;
+    *out_count = count;
+    return 0;
+}
+
+/* ---- HTTP-клиент ---- */
+
+static int connect_plan(const LoadgenPlan *plan) {
+    int fd = socket(plan->addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct timeval tv;
+    tv.tv_sec = plan->timeout_ms / 1000;
+    tv.tv_usec = (plan->timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr *)&plan->addr, plan->addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char *data, size_t length) {
+    while (length > 0U) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static int header_equals(const char *headers, size_t headers_length, const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    const char *cursor = headers;
+    const char *end = headers + headers_length;
+    while (cursor < end) {
+        const char *eol = memchr(cursor, '\n', (size_t)(end - cursor));
+        if (!eol) {
+            eol = end;
+        }
+        if ((size_t)(eol - cursor) > name_len + 1U && strncasecmp(cursor, name, name_len) == 0 &&
+            cursor[name_len] == ':') {
+            const char *v = cursor + name_len + 1;
+            while (v < eol && *v == ' ') {
+                ++v;
+            }
+            if (!value) {
+                return (int)strtol(v, NULL, 10);
+            }
+            return strncasecmp(v, value, strlen(value)) == 0;
+        }
+        cursor = eol + 1;
+    }
+    return value ? 0 : -1;
+}
+
+/* Читает один ответ; возвращает HTTP-статус или -1. *close_after
+ * выставляется, если сервер закрывает соединение. */
+static int read_response(int fd, LoadgenBuffer *buffer, int *close_after, uint64_t *bytes_received) {
+    buffer->length = 0U;
+    size_t header_end = 0U;
+    long content_length = -1;
+    for (;;) {
+        if (buffer_reserve(buffer, 4096U) != 0) {
+            return -1;
+        }
+        ssize_t got = recv(fd, buffer->data + buffer->length, buffer->capacity - buffer->length - 1U, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            if (header_end > 0U && content_length < 0) {
+                *close_after = 1;
+                break;
+            }
+            return -1;
+        }
+        buffer->length += (size_t)got;
+        buffer->data[buffer->length] = '\0';
+        *bytes_received += (uint64_t)got;
+        if (header_end == 0U) {
+            char *marker = strstr(buffer->data, "\r\n\r\n");
+            if (!marker) {
+                continue;
+            }
+            header_end = (size_t)(marker - buffer->data) + 4U;
+            content_length = header_equals(buffer->data, header_end, "Content-Length", NULL);
+            *close_after = header_equals(buffer->data, header_end, "Connection", "close");
+        }
+        if (content_length >= 0 && buffer->length >= header_end + (size_t)content_length) {
+            break;
+        }
+    }
+    int status = 0;
+    if (sscanf(buffer->data, "HTTP/%*d.%*d %d", &status) != 1) {
+        return -1;
+    }
+    if (content_length < 0) {
+        *close_after = 1;
+    }
+    return status;
+}
+
+static void record(LoadgenRouteStats *stats, int status, uint64_t latency_us) {
+    stats->requests++;
+    if (status < 0) {
+        stats->transport_errors++;
+    } else if (status >= 200 && status < 300) {
+        stats->ok++;
+    } else if (status == 429) {
+        stats->rate_limited++;
+    } else if (status >= 500) {
+        stats->server_errors++;
+    } else {
+        stats->client_errors++;
+    }
+    if (status < 0) {
+        return;
+    }
+    stats->latency_sum_us += latency_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+    stats->histogram[histogram_bucket(latency_us)]++;
+}
+
+static void *worker_main(void *arg) {
+    LoadgenWorker *worker = (LoadgenWorker *)arg;
+    LoadgenPlan *plan = worker->plan;
+    LoadgenBuffer buffer = { 0 };
+    int fd = -1;
+    for (;;) {
+        uint64_t k = atomic_fetch_add(&plan->next, 1U);
+        if (plan->total_requests > 0U && k >= plan->total_requests) {
+            break;
+        }
+        uint64_t started = monotonic_ns();
+        if (plan->rps > 0.0) {
+            /* Латентность считается от запланированного момента отправки,
+             * чтобы задержки сервера не маскировались паузами клиента. */
+            started = plan->started_ns + (uint64_t)((double)k * 1e9 / plan->rps);
+            sleep_until_ns(started);
+        }
+        if (plan->deadline_ns > 0U && monotonic_ns() >= plan->deadline_ns) {
+            break;
+        }
+        const LoadgenEntry *entry = &plan->entries[k % plan->entry_count];
+        int status = -1;
+        int close_after = 0;
+        for (int attempt = 0; attempt < 2 && status < 0; ++attempt) {
+            int reused = fd >= 0;
+            if (fd < 0) {
+                fd = connect_plan(plan);
+                if (fd < 0) {
+                    break;
+                }
+                worker->stats.connects++;
+            }
+            if (send_all(fd, entry->request, entry->length) == 0) {
+                status = read_response(fd, &buffer, &close_after, &worker->stats.bytes_received);
+            }
+            if (status < 0) {
+                close(fd);
+                fd = -1;
+                /* Простаивающее keep-alive соединение сервер мог закрыть — повторяем
+                 * один раз на свежем. */
+                if (!reused) {
+                    break;
+                }
+            }
+        }
+        uint64_t finished = monotonic_ns();
+        record(&worker->stats.routes[entry->route], status, (finished - started) / 1000U);
+        if (fd >= 0 && (close_after || !plan->keepalive)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buffer.data);
+    return NULL;
+}
+
+/* ---- Метрики журнала ---- */
+
+typedef struct {
+    int valid;
+    unsigned long long written;
+    unsigned long long dropped;
+    unsigned long long coalesced;
+    unsigned long long queue_depth;
+} JournalMetrics;
+
+static unsigned long long metric_value(const char *text, const char *name) {
+    size_t name_len = strlen(name);
+    const char *cursor = text;
+    while ((cursor = strstr(cursor, name)) != NULL) {
+        if ((cursor == text || cursor[-1] == '\n') && cursor[name_len] == ' ') {
+            return strtoull(cursor + name_len + 1U, NULL, 10);
+        }
+        cursor += name_len;
+    }
+    return 0ULL;
+}
+
+static JournalMetrics scrape_journal(const LoadgenPlan *plan, const char *host) {
+    JournalMetrics metrics = { 0 };
+    int fd = connect_plan(plan);
+    if (fd < 0) {
+        return metrics;
+    }
+    char request[512];
+    int length = snprintf(request, sizeof(request), "GET /metrics HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", host);
+    LoadgenBuffer buffer = { 0 };
+    int close_after = 0;
+    uint64_t bytes = 0U;
+    if (send_all(fd, request, (size_t)length) == 0 && read_response(fd, &buffer, &close_after, &bytes) == 200 &&
+        strstr(buffer.data, "kolibri_journal_written_total")) {
+        metrics.valid = 1;
+        metrics.written = metric_value(buffer.data, "kolibri_journal_written_total");
+        metrics.dropped = metric_value(buffer.data, "kolibri_journal_dropped_total");
+        metrics.coalesced = metric_value(buffer.data, "kolibri_journal_coalesced_total");
+        metrics.queue_depth = metric_value(buffer.data, "kolibri_journal_queue_depth");
+    }
+    close(fd);
+    free(buffer.data);
+    return metrics;
+}
+
+/* ---- Отчёт ---- */
+
+static double route_error_rate(const LoadgenRouteStats *stats) {
+    if (stats->requests == 0U) {
+        return 0.0;
+    }
+    return (double)(stats->client_errors + stats->server_errors + stats->transport_errors) / (double)stats->requests;
+}
+
+static void print_route(FILE *out, const LoadgenRouteStats *stats) {
+    uint64_t answered = stats->requests - stats->transport_errors;
+    fprintf(out,
+            "{\"requests\":%llu,\"ok\":%llu,\"rate_limited\":%llu,\"client_errors\":%llu,\"server_errors\":%llu,"
+            "\"transport_errors\":%llu,\"error_rate\":%.4f,\"latency_us\":{\"mean\":%.1f,\"p50\":%llu,\"p90\":%llu,"
+            "\"p99\":%llu,\"p999\":%llu,\"max\":%llu}}",
+            (unsigned long long)stats->requests,
+            (unsigned long long)stats->ok,
+            (unsigned long long)stats->rate_limited,
+            (unsigned long long)stats->client_errors,
+            (unsigned long long)stats->server_errors,
+            (unsigned long long)stats->transport_errors,
+            route_error_rate(stats),
+            answered ? (double)stats->latency_sum_us / (double)answered : 0.0,
+            (unsigned long long)histogram_percentile(stats, 50.0),
+            (unsigned long long)histogram_percentile(stats, 90.0),
+            (unsigned long long)histogram_percentile(stats, 99.0),
+            (unsigned long long)histogram_percentile(stats, 99.9),
+            (unsigned long long)stats->latency_max_us);
+}
+
+static int load_token_file(const char *path, char *out, size_t out_size) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    size_t length = fread(out, 1U, out_size - 1U, fp);
+    fclose(fp);
+    while (length > 0U && (out[length - 1U] == '\n' || out[length - 1U] == '\r')) {
+        --length;
+    }
+    out[length] = '\0';
+    return length > 0U ? 0 : -1;
+}
+
+static void print_usage(void) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  kolibri_loadgen --log PATH [--host HOST] [--port N] [--connections N] [--rps R]\n"
+            "                  [--requests N | --duration SEC] [--token T | --token-file PATH]\n"
+            "                  [--no-keepalive] [--timeout-ms MS] [--max-error-rate X] [--output PATH]\n");
+}
+
+int main(int argc, char **argv) {
+    const char *log_path = NULL;
+    const char *host = "127.0.0.1";
+    const char *port = "8000";
+    const char *token = getenv("KOLIBRI_KNOWLEDGE_ADMIN_TOKEN");
+    const char *token_file = NULL;
+    const char *output = NULL;
+    unsigned long connections = 4UL;
+    unsigned long long requests = 0ULL;
+    double duration = 0.0;
+    double rps = 0.0;
+    double max_error_rate = -1.0;
+    int keepalive = 1;
+    int timeout_ms = 10000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            host = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = argv[++i];
+        } else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            connections = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rps") == 0 && i + 1 < argc) {
+            rps = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc) {
+            requests = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--token") == 0 && i + 1 < argc) {
+            token = argv[++i];
+        } else if (strcmp(argv[i], "--token-file") == 0 && i + 1 < argc) {
+            token_file = argv[++i];
+        } else if (strcmp(argv[i], "--no-keepalive") == 0) {
+            keepalive = 0;
+        } else if (strcmp(argv[i], "--timeout-ms") == 0 && i + 1 < argc) {
+            timeout_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-error-rate") == 0 && i + 1 < argc) {
+            max_error_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (!log_path || connections == 0UL || connections > 4096UL || rps < 0.0 || duration < 0.0 || timeout_ms <= 0) {
+        print_usage();
+        return 1;
+    }
+    char token_buffer[256];
+    if (token_file) {
+        if (load_token_file(token_file, token_buffer, sizeof(token_buffer)) != 0) {
+            fprintf(stderr, "[kolibri-loadgen] cannot read token file %s\n", token_file);
+            return 1;
+        }
+        token = token_buffer;
+    }
+    if (token && !*token) {
+        token = NULL;
+    }
+
+    LoadgenPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *resolved = NULL;
+    int gai = getaddrinfo(host, port, &hints, &resolved);
+    if (gai != 0 || !resolved) {
+        fprintf(stderr, "[kolibri-loadgen] cannot resolve %s:%s: %s\n", host, port, gai_strerror(gai));
+        return 1;
+    }
+    memcpy(&plan.addr, resolved->ai_addr, resolved->ai_addrlen);
+    plan.addr_len = resolved->ai_addrlen;
+    freeaddrinfo(resolved);
+
+    LoadgenEntry *entries = NULL;
+    size_t entry_count = 0U;
+    if (load_entries(log_path, host, token, keepalive, &entries, &entry_count) != 0) {
+        return 1;
+    }
+    int needs_token = 0;
+    for (size_t i = 0; i < entry_count; ++i) {
+        needs_token |= entries[i].route != LOADGEN_ROUTE_SEARCH;
+    }
+    if (needs_token && !token) {
+        fprintf(stderr, "[kolibri-loadgen] warning: teach/feedback entries without --token will get 401\n");
+    }
+
+    plan.entries = entries;
+    plan.entry_count = entry_count;
+    plan.total_requests = requests;
+    if (requests == 0ULL && duration == 0.0) {
+        plan.total_requests = entry_count;
+    }
+    plan.rps = rps;
+    plan.keepalive = keepalive;
+    plan.timeout_ms = timeout_ms;
+    atomic_init(&plan.next, 0U);
+
+    JournalMetrics before = scrape_journal(&plan, host);
+    LoadgenWorker *workers = (LoadgenWorker *)calloc(connections, sizeof(*workers));
+    if (!workers) {
+        return 1;
+    }
+    plan.started_ns = monotonic_ns();
+    if (duration > 0.0) {
+        plan.deadline_ns = plan.started_ns + (uint64_t)(duration * 1e9);
+    }
+    size_t started = 0U;
+    for (; started < connections; ++started) {
+        workers[started].plan = &plan;
+        if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+            fprintf(stderr, "[kolibri-loadgen] cannot start worker %zu\n", started);
+            break;
+        }
+    }
+    LoadgenStats total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        for (int r = 0; r < LOADGEN_ROUTE_COUNT; ++r) {
+            route_stats_merge(&total.routes[r], &workers[i].stats.routes[r]);
+        }
+        total.connects += workers[i].stats.connects;
+        total.bytes_received += workers[i].stats.bytes_received;
+    }
+    double elapsed = (double)(monotonic_ns() - plan.started_ns) / 1e9;
+    free(workers);
+    JournalMetrics after = scrape_journal(&plan, host);
+
+    LoadgenRouteStats all;
+    memset(&all, 0, sizeof(all));
+    for (int r = 0; r < LOADGEN_ROUTE_COUNT; ++r) {
+        route_stats_merge(&all, &total.routes[r]);
+    }
+
+    FILE *out = stdout;
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            perror("[kolibri-loadgen] fopen");
+            out = stdout;
+        }
+    }
+    fprintf(out,
+            "{\"schema\":\"kolibri-loadgen/1\",\"target\":\"%s:%s\",\"connections\":%lu,\"keepalive\":%s,"
+            "\"target_rps\":%.1f,\"elapsed_s\":%.3f,\"achieved_rps\":%.1f,\"connects\":%llu,\"bytes_received\":%llu,"
+            "\"routes\":{",
+            host,
+            port,
+            (unsigned long)started,
+            keepalive ? "true" : "false",
+            rps,
+            elapsed,
+            elapsed > 0.0 ? (double)all.requests / elapsed : 0.0,
+            (unsigned long long)total.connects,
+            (unsigned long long)total.bytes_received);
+    int first = 1;
+    for (int r = 0; r < LOADGEN_ROUTE_COUNT; ++r) {
+        if (total.routes[r].requests == 0U) {
+            continue;
+        }
+        fprintf(out, "%s\"%s\":", first ? "" : ",", loadgen_route_names[r]);
+        print_route(out, &total.routes[r]);
+        first = 0;
+    }
+    fprintf(out, "},\"total\":");
+    print_route(out, &all);
+    if (before.valid && after.valid) {
+        fprintf(out,
+                ",\"journal\":{\"written\":%llu,\"dropped\":%llu,\"coalesced\":%llu,\"queue_depth\":%llu}",
+                after.written - before.written,
+                after.dropped - before.dropped,
+                after.coalesced - before.coalesced,
+                after.queue_depth);
+    } else {
+        fprintf(out, ",\"journal\":null");
+    }
+    fprintf(out, "}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    for (size_t i = 0; i < entry_count; ++i) {
+        free(entries[i].request);
+    }
+    free(entries);
+    if (started == 0U) {
+        return 1;
+    }
+    if (max_error_rate >= 0.0 && route_error_rate(&all) > max_error_rate) {
+        fprintf(stderr, "[kolibri-loadgen] error rate %.4f exceeds %.4f\n", route_error_rate(&all), max_error_rate);
+        return 2;
+    }
+    return 0;
+}
@@ -7,18 +7,38 @@
 #include "kolibri/genome.h"
 #include "kolibri/net.h"
 #include "kolibri/script.h"
+#include "kolibri/trace.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define KOLIBRI_NODE_USE_EPOLL 1
+#else
+#include <poll.h>
+#endif
 
 #define KOLIBRI_MEMORY_CAPACITY 8192U
+#define KOLIBRI_NODE_LINE_MAX 512U
+#define KOLIBRI_NODE_EVENTS 4
+#define KOLIBRI_NODE_LISTENER_SLICE_MS 50U
+#define KOLIBRI_NODE_SOURCE_STDIN 0U
+#define KOLIBRI_NODE_SOURCE_LISTENER 1U
+#define KOLIBRI_NODE_SOURCE_WORKER 2U
+/* Поколений за один захват пула фоновым потоком. */
+#define KOLIBRI_NODE_WORKER_SLICE 1U
 
 typedef enum {
     KOLIBRI_KEY_SOURCE_DEFAULT,
@@ -35,8 +55,11 @@ typedef struct {
     char peer_host[64];
     uint16_t peer_port;
     bool verify_genome;
+    bool genome_v2;
+    uint32_t genome_segment_mb;
     char genome_path[260];
     char bootstrap_script[260];
+    char pool_checkpoint[260];
     KolibriKeySource hmac_key_source;
     unsigned char hmac_key_inline[KOLIBRI_HMAC_KEY_SIZE];
     size_t hmac_key_inline_len;
@@ -47,17 +70,26 @@ typedef struct {
     uint32_t auto_sync_ms;
 } KolibriNodeOptions;
 
+typedef struct {
+    bool active;
+    uint32_t period_ms;
+    uint64_t due_ms;
+} KolibriNodeTimer;
+
 typedef struct {
     KolibriNodeOptions options;
     KolibriGenome genome;
     bool genome_ready;
     KolibriFormulaPool pool;
+    /* Пул поднят из контрольной точки: bootstrap-сценарий не переигрывается. */
+    bool pool_restored;
     KolibriScript script;
     bool script_ready;
     uint8_t memory_buffer[KOLIBRI_MEMORY_CAPACITY];
     k_digit_stream memory;
     bool listener_ready;
     KolibriNetListener listener;
+    KolibriNetClient peers;
     KolibriGene last_gene;
     bool last_gene_valid;
     int last_question;
@@ -65,8 +97,28 @@ typedef struct {
     unsigned char hmac_key[KOLIBRI_HMAC_KEY_SIZE];
     size_t hmac_key_len;
     char hmac_key_origin[320];
-    uint64_t last_evolve_ms;
-    uint64_t last_sync_ms;
+    KolibriNodeTimer evolve_timer;
+    KolibriNodeTimer sync_timer;
+    int loop_fd;
+    bool stdin_polled;
+    char input[KOLIBRI_NODE_LINE_MAX];
+    size_t input_len;
+    /* Фоновая эволюция: поток держит pool_lock на срез поколений, передний
+     * план меняет пул между срезами, а отвечает по опубликованной копии
+     * лучшей формулы. Поколения по командам считаются отдельно от автоцикла
+     * и импорта, чтобы о них сообщить; о завершении поток пишет в worker_pipe. */
+    pthread_mutex_t pool_lock;
+    pthread_cond_t worker_wake;
+    atomic_int pool_waiters;
+    pthread_t worker;
+    bool worker_started;
+    bool worker_stop;
+    size_t evolve_requested;
+    size_t evolve_background;
+    size_t evolve_reported;
+    int worker_pipe[2];
+    pthread_mutex_t best_lock;
+    KolibriFormula best;
 } KolibriNode;
 
 static const unsigned char KOLIBRI_HMAC_KEY[] = "kolibri-secret-key";
@@ -80,9 +132,12 @@ static void options_init(KolibriNodeOptions *options) {
    options->peer_host[0] = '\0';
    options->peer_port = 4050U;
    options->verify_genome = false;
+    options->genome_v2 = false;
+    options->genome_segment_mb = 0U;
     strncpy(options->genome_path, "genome.dat", sizeof(options->genome_path) - 1);
     options->genome_path[sizeof(options->genome_path) - 1] = '\0';
     options->bootstrap_script[0] = '\0';
+    options->pool_checkpoint[0] = '\0';
     options->hmac_key_source = KOLIBRI_KEY_SOURCE_DEFAULT;
     memset(options->hmac_key_inline, 0, sizeof(options->hmac_key_inline));
     options->hmac_key_inline_len = 0U;
@@ -135,6 +190,16 @@ static void parse_options(int argc, char **argv, KolibriNodeOptions *options) {
             ++i;
             continue;
         }
+        if (strcmp(argv[i], "--genome-format") == 0 && i + 1 < argc) {
+            options->genome_v2 = strcmp(argv[i + 1], "v2") == 0;
+            ++i;
+            continue;
+        }
+        if (strcmp(argv[i], "--genome-segment-mb") == 0 && i + 1 < argc) {
+            options->genome_segment_mb = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+            ++i;
+            continue;
+        }
         if (strcmp(argv[i], "--bootstrap") == 0 && i + 1 < argc) {
             strncpy(options->bootstrap_script, argv[i + 1],
                     sizeof(options->bootstrap_script) - 1);
@@ -142,6 +207,13 @@ static void parse_options(int argc, char **argv, KolibriNodeOptions *options) {
             ++i;
             continue;
         }
+        if (strcmp(argv[i], "--pool-checkpoint") == 0 && i + 1 < argc) {
+            strncpy(options->pool_checkpoint, argv[i + 1],
+                    sizeof(options->pool_checkpoint) - 1);
+            options->pool_checkpoint[sizeof(options->pool_checkpoint) - 1] = '\0';
+            ++i;
+            continue;
+        }
         if (strcmp(argv[i], "--verify-genome") == 0) {
             options->verify_genome = true;
             continue;
@@ -403,6 +475,142 @@ static void node_reset_last_answer(KolibriNode *node) {
     memset(&node->last_gene, 0, sizeof(node->last_gene));
 }
 
+/* ------------------------- Фоновая эволюция ------------------------------ */
+
+static void node_pool_acquire(KolibriNode *node) {
+    atomic_fetch_add(&node->pool_waiters, 1);
+    pthread_mutex_lock(&node->pool_lock);
+    atomic_fetch_sub(&node->pool_waiters, 1);
+}
+
+static void node_pool_release(KolibriNode *node) {
+    pthread_mutex_unlock(&node->pool_lock);
+}
+
+/* Вызывается под pool_lock. */
+static void node_publish_best(KolibriNode *node) {
+    const KolibriFormula *best = kf_pool_best(&node->pool);
+    if (!best) {
+        return;
+    }
+    pthread_mutex_lock(&node->best_lock);
+    node->best = *best;
+    pthread_mutex_unlock(&node->best_lock);
+}
+
+static void node_current_best(KolibriNode *node, KolibriFormula *out) {
+    pthread_mutex_lock(&node->best_lock);
+    *out = node->best;
+    pthread_mutex_unlock(&node->best_lock);
+}
+
+static void *node_worker_main(void *arg) {
+    KolibriNode *node = (KolibriNode *)arg;
+    pthread_mutex_lock(&node->pool_lock);
+    while (!node->worker_stop) {
+        if (node->evolve_requested == 0 && node->evolve_background == 0) {
+            pthread_cond_wait(&node->worker_wake, &node->pool_lock);
+            continue;
+        }
+        bool requested = node->evolve_requested > 0;
+        size_t *queue = requested ? &node->evolve_requested : &node->evolve_background;
+        size_t slice = *queue < KOLIBRI_NODE_WORKER_SLICE ? *queue : KOLIBRI_NODE_WORKER_SLICE;
+        *queue -= slice;
+        kf_pool_tick(&node->pool, slice);
+        node_publish_best(node);
+        if (requested) {
+            node->evolve_reported += slice;
+            if (node->evolve_requested == 0) {
+                /* Полный канал уже несёт непрочитанное уведомление. */
+                uint8_t signal = 1U;
+                ssize_t written = write(node->worker_pipe[1], &signal, sizeof(signal));
+                (void)written;
+            }
+        }
+        /* Между срезами пул отдаётся переднему плану, если тот ждёт. */
+        pthread_mutex_unlock(&node->pool_lock);
+        while (atomic_load(&node->pool_waiters) > 0) {
+            sched_yield();
+        }
+        pthread_mutex_lock(&node->pool_lock);
+    }
+    pthread_mutex_unlock(&node->pool_lock);
+    return NULL;
+}
+
+static int node_worker_start(KolibriNode *node) {
+    if (pipe(node->worker_pipe) != 0) {
+        node->worker_pipe[0] = node->worker_pipe[1] = -1;
+        return -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(node->worker_pipe[i], F_SETFL, fcntl(node->worker_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(node->worker_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    node->worker_stop = false;
+    if (pthread_create(&node->worker, NULL, node_worker_main, node) != 0) {
+        close(node->worker_pipe[0]);
+        close(node->worker_pipe[1]);
+        node->worker_pipe[0] = node->worker_pipe[1] = -1;
+        return -1;
+    }
+    node->worker_started = true;
+    return 0;
+}
+
+static void node_worker_stop(KolibriNode *node) {
+    if (!node->worker_started) {
+        return;
+    }
+    node_pool_acquire(node);
+    node->worker_stop = true;
+    pthread_cond_signal(&node->worker_wake);
+    node_pool_release(node);
+    pthread_join(node->worker, NULL);
+    node->worker_started = false;
+    close(node->worker_pipe[0]);
+    close(node->worker_pipe[1]);
+    node->worker_pipe[0] = node->worker_pipe[1] = -1;
+}
+
+/* Поколения по команде (report) копятся и выводятся по завершении; фоновые
+ * (автоцикл, импорт) не накапливаются сверх самой большой заявки. Без
+ * потока эволюция идёт сразу. */
+static void node_request_evolution(KolibriNode *node, size_t generations, bool report) {
+    node_pool_acquire(node);
+    if (!node->worker_started) {
+        kf_pool_tick(&node->pool, generations);
+        node_publish_best(node);
+        node->evolve_reported += report ? generations : 0U;
+    } else if (report) {
+        node->evolve_requested += generations;
+    } else if (node->evolve_background < generations) {
+        node->evolve_background = generations;
+    }
+    pthread_cond_signal(&node->worker_wake);
+    node_pool_release(node);
+}
+
+/* Выводит поколения, завершённые по командам с прошлого вызова. */
+static void node_collect_evolution(KolibriNode *node) {
+    if (node->worker_pipe[0] >= 0) {
+        uint8_t drain[64];
+        while (read(node->worker_pipe[0], drain, sizeof(drain)) > 0) {
+            continue;
+        }
+    }
+    node_pool_acquire(node);
+    size_t done = node->evolve_reported;
+    node->evolve_reported = 0U;
+    node_pool_release(node);
+    if (done == 0U) {
+        return;
+    }
+    printf("[Формулы] выполнено поколений: %zu\n", done);
+    node_record_event(node, "EVOLVE", "цикл выполнен");
+    node_reset_last_answer(node);
+}
+
 static void node_apply_feedback(KolibriNode *node, double delta, const char *rating, const char *message) {
     if (!node) {
         return;
@@ -411,7 +619,11 @@ static void node_apply_feedback(KolibriNode *node, double delta, const char *rat
         printf("[Учитель] нет последнего ответа для оценки\n");
         return;
     }
-    if (kf_pool_feedback(&node->pool, &node->last_gene, delta) != 0) {
+    node_pool_acquire(node);
+    int status = kf_pool_feedback(&node->pool, &node->last_gene, delta);
+    node_publish_best(node);
+    node_pool_release(node);
+    if (status != 0) {
         printf("[Учитель] текущий ген уже изменился, повторите запрос\n");
         node_reset_last_answer(node);
         return;
@@ -423,12 +635,11 @@ static void node_apply_feedback(KolibriNode *node, double delta, const char *rat
     snprintf(payload, sizeof(payload), "rating=%s input=%d output=%d delta=%.3f",
              rating ? rating : "unknown", node->last_question, node->last_answer, delta);
     node_record_event(node, "USER_FEEDBACK", payload);
-    const KolibriFormula *best = kf_pool_best(&node->pool);
-    if (best) {
-        char description[128];
-        if (kf_formula_describe(best, description, sizeof(description)) == 0) {
-            printf("[Формулы] %s\n", description);
-        }
+    KolibriFormula best;
+    node_current_best(node, &best);
+    char description[128];
+    if (kf_formula_describe(&best, description, sizeof(description)) == 0) {
+        printf("[Формулы] %s\n", description);
     }
 }
 
@@ -462,8 +673,16 @@ static int node_open_genome(KolibriNode *node) {
                    node->hmac_key_origin);
         }
     }
-    if (kg_open(&node->genome, node->options.genome_path, node->hmac_key,
-                node->hmac_key_len) != 0) {
+    /* Формат важен только для нового журнала: существующий открывается в своём. */
+    KolibriGenomeOptions genome_options = {.format = KOLIBRI_GENOME_FORMAT_V1};
+    if (node->options.genome_v2) {
+        genome_options.format = KOLIBRI_GENOME_FORMAT_V2;
+        genome_options.flags = KOLIBRI_GENOME_COMPRESS;
+    }
+    genome_options.segment_bytes =
+        (uint64_t)node->options.genome_segment_mb * 1024U * 1024U;
+    if (kg_open_with(&node->genome, node->options.genome_path, node->hmac_key,
+                     node->hmac_key_len, &genome_options) != 0) {
         fprintf(stderr,
                 "[Геном] не удалось открыть %s (ключ: %s)\n",
                 node->options.genome_path, node->hmac_key_origin);
@@ -511,19 +730,20 @@ static void node_print_canvas(const KolibriNode *node) {
     }
 }
 
-static void node_report_formula(const KolibriNode *node) {
-    const KolibriFormula *best = kf_pool_best(&node->pool);
-    if (!best) {
+static void node_report_formula(KolibriNode *node) {
+    KolibriFormula best;
+    node_current_best(node, &best);
+    if (best.gene.length == 0) {
         printf("[Формулы] пока нет подходящих генов\n");
         return;
     }
     char description[128];
-    if (kf_formula_describe(best, description, sizeof(description)) != 0) {
+    if (kf_formula_describe(&best, description, sizeof(description)) != 0) {
         printf("[Формулы] не удалось построить описание\n");
         return;
     }
     uint8_t digits[32];
-    size_t len = kf_formula_digits(best, digits, sizeof(digits));
+    size_t len = kf_formula_digits(&best, digits, sizeof(digits));
     printf("[Формулы] %s\n", description);
     printf("[Формулы] ген: ");
     for (size_t i = 0; i < len; ++i) {
@@ -537,13 +757,14 @@ static void node_share_formula(KolibriNode *node) {
         printf("[Рой] соседи не заданы\n");
         return;
     }
-    const KolibriFormula *best = kf_pool_best(&node->pool);
-    if (!best) {
+    KolibriFormula best;
+    node_current_best(node, &best);
+    if (best.gene.length == 0) {
         printf("[Рой] подходящая формула отсутствует\n");
         return;
     }
-    if (kn_share_formula(node->options.peer_host, node->options.peer_port,
-                         node->options.node_id, best) == 0) {
+    if (kn_client_share_formula(&node->peers, node->options.peer_host,
+                                node->options.peer_port, &best) == 0) {
         printf("[Рой] формула отправлена на %s:%u\n", node->options.peer_host,
                node->options.peer_port);
         node_record_event(node, "SYNC", "передан лучший ген");
@@ -552,28 +773,23 @@ static void node_share_formula(KolibriNode *node) {
     }
 }
 
-static void node_poll_listener(KolibriNode *node) {
-    if (!node->listener_ready) {
-        return;
-    }
-    KolibriNetMessage message;
-    int status = kn_listener_poll(&node->listener, 0U, &message);
-    if (status <= 0) {
-        return;
-    }
-    switch (message.type) {
+/* Возвращает true, если ген импортирован в пул. */
+static bool node_handle_message(KolibriNode *node, const KolibriNetMessage *message) {
+    bool imported_gene = false;
+    switch (message->type) {
     case KOLIBRI_MSG_HELLO:
-        printf("[Рой] приветствие от узла %u\n", message.data.hello.node_id);
+        printf("[Рой] приветствие от узла %u\n", message->data.hello.node_id);
         break;
     case KOLIBRI_MSG_MIGRATE_RULE: {
         KolibriFormula imported;
-        imported.gene.length = message.data.formula.length;
+        memset(&imported, 0, sizeof(imported));
+        imported.gene.length = message->data.formula.length;
         if (imported.gene.length > sizeof(imported.gene.digits)) {
             imported.gene.length = sizeof(imported.gene.digits);
         }
-        memcpy(imported.gene.digits, message.data.formula.digits,
+        memcpy(imported.gene.digits, message->data.formula.digits,
                imported.gene.length);
-        imported.fitness = message.data.formula.fitness;
+        imported.fitness = message->data.formula.fitness;
         imported.feedback = 0.0;
 
         char digits_text[33];
@@ -594,25 +810,53 @@ static void node_poll_listener(KolibriNode *node) {
         bool preview_ok = kf_formula_apply(&imported, 4, &preview) == 0;
         if (preview_ok) {
             printf("[Рой] получен ген от узла %u %s fitness=%.3f f(4)=%d\n",
-                   message.data.formula.node_id, description,
-                   message.data.formula.fitness, preview);
+                   message->data.formula.node_id, description,
+                   message->data.formula.fitness, preview);
         } else {
             printf("[Рой] получен ген от узла %u %s fitness=%.3f\n",
-                   message.data.formula.node_id, description,
-                   message.data.formula.fitness);
+                   message->data.formula.node_id, description,
+                   message->data.formula.fitness);
         }
         if (node->pool.count > 0) {
-            size_t slot = node->pool.count - 1U;
-            node->pool.formulas[slot] = imported;
-            kf_pool_tick(&node->pool, 4);
+            node_pool_acquire(node);
+            kf_pool_import(&node->pool, &imported);
+            node_publish_best(node);
+            node_pool_release(node);
             node_record_event(node, "IMPORT", "ген принят от соседа");
+            imported_gene = true;
         }
         break;
     }
     case KOLIBRI_MSG_ACK:
-        printf("[Рой] ACK=%u\n", message.data.ack.status);
+        printf("[Рой] ACK=%u\n", message->data.ack.status);
         break;
     }
+    return imported_gene;
+}
+
+#define KOLIBRI_NODE_MESSAGE_BATCH 32U
+
+/* Разбирает всё, что накопил слушатель; пул эволюционирует один раз на
+ * пакет импортированных генов. */
+static void node_poll_listener(KolibriNode *node) {
+    if (!node->listener_ready) {
+        return;
+    }
+    KolibriNetMessage batch[KOLIBRI_NODE_MESSAGE_BATCH];
+    bool imported = false;
+    int count;
+    while ((count = kn_listener_poll_batch(&node->listener, 0U, batch,
+                                           KOLIBRI_NODE_MESSAGE_BATCH)) > 0) {
+        for (int i = 0; i < count; ++i) {
+            imported |= node_handle_message(node, &batch[i]);
+        }
+        if ((size_t)count < KOLIBRI_NODE_MESSAGE_BATCH) {
+            break;
+        }
+    }
+    if (imported) {
+        node_request_evolution(node, 4, false);
+    }
 }
 
 static void node_handle_tick(KolibriNode *node, size_t generations) {
@@ -620,13 +864,15 @@ static void node_handle_tick(KolibriNode *node, size_t generations) {
         printf("[Формулы] нет обучающих примеров\n");
         return;
     }
-    kf_pool_tick(&node->pool, generations);
-    printf("[Формулы] выполнено поколений: %zu\n", generations);
-    node_record_event(node, "EVOLVE", "цикл выполнен");
-    node_reset_last_answer(node);
+    node_request_evolution(node, generations, true);
+    if (node->worker_started) {
+        printf("[Формулы] поколений в очереди: %zu\n", generations);
+    } else {
+        node_collect_evolution(node);
+    }
 }
 
-static void node_execute_script(KolibriNode *node, const char *path) {
+static void node_execute_script(KolibriNode *node, const char *path, bool streaming) {
     if (!node || !path || path[0] == '\0') {
         printf("[KolibriScript] требуется путь к файлу\n");
         return;
@@ -644,11 +890,27 @@ static void node_execute_script(KolibriNode *node, const char *path) {
     }
 
     ks_set_output(&node->script, stdout);
-    if (ks_load_file(&node->script, path) != 0) {
+    FILE *vhod = NULL;
+    if (streaming) {
+        /* Большие сценарии исполняются по мере чтения, без загрузки в память. */
+        vhod = fopen(path, "rb");
+        if (!vhod) {
+            fprintf(stderr, "[KolibriScript] не удалось открыть сценарий %s\n", path);
+            return;
+        }
+    } else if (ks_load_file(&node->script, path) != 0) {
         fprintf(stderr, "[KolibriScript] не удалось загрузить сценарий %s\n", path);
         return;
     }
-    if (ks_execute(&node->script) != 0) {
+    /* Сценарий работает с пулом напрямую и держит его до конца. */
+    node_pool_acquire(node);
+    int status = vhod ? ks_execute_stream(&node->script, vhod) : ks_execute(&node->script);
+    node_publish_best(node);
+    node_pool_release(node);
+    if (vhod) {
+        fclose(vhod);
+    }
+    if (status != 0) {
         fprintf(stderr, "[KolibriScript] выполнение завершилось ошибкой для %s\n", path);
         return;
     }
@@ -679,7 +941,10 @@ static void node_handle_teach(KolibriNode *node, const char *payload) {
             printf("[Учитель] не удалось разобрать числа\n");
             return;
         }
-        if (kf_pool_add_example(&node->pool, input, target) != 0) {
+        node_pool_acquire(node);
+        int added = kf_pool_add_example(&node->pool, input, target);
+        node_pool_release(node);
+        if (added != 0) {
             printf("[Учитель] буфер примеров заполнен\n");
             return;
         }
@@ -693,7 +958,7 @@ static void node_handle_teach(KolibriNode *node, const char *payload) {
     printf("[Учитель] сохранён числовой импульс\n");
 }
 
-static void node_handle_ask(KolibriNode *node, const char *payload) {
+static void node_answer(KolibriNode *node, const char *payload) {
     if (!payload || payload[0] == '\0') {
         printf("[Вопрос] требуется аргумент\n");
         return;
@@ -703,8 +968,11 @@ static void node_handle_ask(KolibriNode *node, const char *payload) {
         printf("[Вопрос] ожидалось целое число\n");
         return;
     }
-    const KolibriFormula *best = kf_pool_best(&node->pool);
-    if (!best) {
+    /* Ответ даёт последняя опубликованная формула, не дожидаясь эволюции. */
+    KolibriFormula formula;
+    node_current_best(node, &formula);
+    const KolibriFormula *best = &formula;
+    if (best->gene.length == 0) {
         printf("[Вопрос] эволюция ещё не дала формулы\n");
         return;
     }
@@ -725,6 +993,12 @@ static void node_handle_ask(KolibriNode *node, const char *payload) {
     node_record_event(node, "ASK", "вопрос обработан");
 }
 
+static void node_handle_ask(KolibriNode *node, const char *payload) {
+    KOLIBRI_TRACE_BEGIN(span, "node.ask");
+    node_answer(node, payload);
+    KOLIBRI_TRACE_END(span);
+}
+
 static void node_handle_verify(KolibriNode *node) {
     printf("[Геном] проверяем %s (ключ: %s)\n", node->options.genome_path,
            node->hmac_key_origin);
@@ -739,6 +1013,47 @@ static void node_handle_verify(KolibriNode *node) {
     }
 }
 
+static int node_init_pool(KolibriNode *node) {
+    const char *path = node->options.pool_checkpoint;
+    if (path[0] != '\0' && access(path, F_OK) == 0) {
+        int rc = kf_pool_load_checkpoint(&node->pool, path);
+        if (rc == 0) {
+            node->pool_restored = true;
+            printf("[Формулы] пул восстановлен из %s: %zu формул, %zu примеров, %zu ассоциаций\n", path,
+                   node->pool.count, node->pool.examples, node->pool.association_count);
+            return 0;
+        }
+        fprintf(stderr, "[Формулы] контрольная точка %s не прочитана (код %d), пул создаётся заново\n", path, rc);
+    }
+    return kf_pool_init(&node->pool, node->options.seed);
+}
+
+/* Вызывается под pool_lock или без фонового потока. */
+static int node_save_pool(KolibriNode *node) {
+    const char *path = node->options.pool_checkpoint;
+    if (path[0] == '\0') {
+        return 0;
+    }
+    if (kf_pool_save_checkpoint(&node->pool, path) != 0) {
+        fprintf(stderr, "[Формулы] не удалось записать контрольную точку %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static void node_handle_checkpoint(KolibriNode *node) {
+    if (node->options.pool_checkpoint[0] == '\0') {
+        printf("[Формулы] путь не задан: запустите узел с --pool-checkpoint\n");
+        return;
+    }
+    node_pool_acquire(node);
+    int rc = node_save_pool(node);
+    node_pool_release(node);
+    if (rc == 0) {
+        printf("[Формулы] пул сохранён в %s\n", node->options.pool_checkpoint);
+    }
+}
+
 static void node_print_help(void) {
     printf(":teach a->b — добавить обучающий пример\n");
     printf(":ask x — вычислить значение лучшей формулы\n");
@@ -750,154 +1065,348 @@ static void node_print_help(void) {
     printf(":canvas — вывести канву памяти\n");
     printf(":sync — поделиться формулой с соседом\n");
     printf(":verify — проверить геном\n");
+    printf(":checkpoint — сохранить пул формул в контрольную точку\n");
     printf(":script <файл> — выполнить KolibriScript из файла\n");
+    printf(":stream <файл> — выполнить большой сценарий потоково, по командам\n");
     printf(":fractal — показать фрактальную канву памяти\n");
     printf(":quit — завершить работу\n");
 }
 
+/* --------------------------- Цикл событий узла --------------------------- */
+
+static void node_timer_start(KolibriNodeTimer *timer, uint32_t period_ms, uint64_t now) {
+    timer->active = true;
+    timer->period_ms = period_ms;
+    timer->due_ms = now + period_ms;
+}
+
+/* Сработавший таймер перезаводится от текущего момента: после долгой
+ * команды пропущенные периоды не догоняются пачкой. */
+static bool node_timer_fire(KolibriNodeTimer *timer, uint64_t now) {
+    if (!timer->active || now < timer->due_ms) {
+        return false;
+    }
+    timer->due_ms = now + timer->period_ms;
+    return true;
+}
+
+static int node_loop_timeout(const KolibriNode *node, uint64_t now) {
+    int timeout = -1;
+    const KolibriNodeTimer *timers[] = { &node->evolve_timer, &node->sync_timer };
+    for (size_t i = 0; i < sizeof(timers) / sizeof(timers[0]); ++i) {
+        if (!timers[i]->active) {
+            continue;
+        }
+        uint64_t wait = timers[i]->due_ms > now ? timers[i]->due_ms - now : 0U;
+        if (timeout < 0 || wait < (uint64_t)timeout) {
+            timeout = wait > INT32_MAX ? INT32_MAX : (int)wait;
+        }
+    }
+#ifndef KOLIBRI_NODE_USE_EPOLL
+    /* Без epoll наружу виден только слушающий сокет, данные открытых
+     * соединений забираются опросом. */
+    if (node->listener_ready &&
+        (timeout < 0 || timeout > (int)KOLIBRI_NODE_LISTENER_SLICE_MS)) {
+        timeout = (int)KOLIBRI_NODE_LISTENER_SLICE_MS;
+    }
+#endif
+    return timeout;
+}
+
+static int node_loop_open(KolibriNode *node) {
+    node->stdin_polled = true;
+#ifdef KOLIBRI_NODE_USE_EPOLL
+    node->loop_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (node->loop_fd < 0) {
+        return -1;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = KOLIBRI_NODE_SOURCE_STDIN;
+    if (epoll_ctl(node->loop_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event) != 0) {
+        if (errno != EPERM) {
+            close(node->loop_fd);
+            node->loop_fd = -1;
+            return -1;
+        }
+        /* Обычный файл на stdin epoll не принимает, а читается без ожидания. */
+        node->stdin_polled = false;
+    }
+    if (node->listener_ready) {
+        event.data.u32 = KOLIBRI_NODE_SOURCE_LISTENER;
+        if (epoll_ctl(node->loop_fd, EPOLL_CTL_ADD, kn_listener_fd(&node->listener), &event) != 0) {
+            close(node->loop_fd);
+            node->loop_fd = -1;
+            return -1;
+        }
+    }
+    if (node->worker_pipe[0] >= 0) {
+        event.data.u32 = KOLIBRI_NODE_SOURCE_WORKER;
+        if (epoll_ctl(node->loop_fd, EPOLL_CTL_ADD, node->worker_pipe[0], &event) != 0) {
+            close(node->loop_fd);
+            node->loop_fd = -1;
+            return -1;
+        }
+    }
+#else
+    struct stat info;
+    if (fstat(STDIN_FILENO, &info) == 0 && S_ISREG(info.st_mode)) {
+        node->stdin_polled = false;
+    }
+#endif
+    return 0;
+}
+
+static void node_loop_close(KolibriNode *node) {
+#ifdef KOLIBRI_NODE_USE_EPOLL
+    if (node->loop_fd >= 0) {
+        close(node->loop_fd);
+        node->loop_fd = -1;
+    }
+#else
+    (void)node;
+#endif
+}
+
+/* Ждёт stdin, слушателя, фоновой эволюции или ближайшего таймера. */
+static int node_loop_wait(KolibriNode *node, int timeout_ms, bool *stdin_ready, bool *listener_ready,
+                          bool *worker_ready) {
+    *stdin_ready = !node->stdin_polled;
+    *listener_ready = false;
+    *worker_ready = false;
+    if (*stdin_ready) {
+        timeout_ms = 0;
+    }
+#ifdef KOLIBRI_NODE_USE_EPOLL
+    struct epoll_event events[KOLIBRI_NODE_EVENTS];
+    int ready = epoll_wait(node->loop_fd, events, KOLIBRI_NODE_EVENTS, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.u32 == KOLIBRI_NODE_SOURCE_STDIN) {
+            *stdin_ready = true;
+        } else if (events[i].data.u32 == KOLIBRI_NODE_SOURCE_WORKER) {
+            *worker_ready = true;
+        } else {
+            *listener_ready = true;
+        }
+    }
+#else
+    struct pollfd fds[3];
+    nfds_t count = 0;
+    if (node->stdin_polled) {
+        fds[count].fd = STDIN_FILENO;
+        fds[count].events = POLLIN;
+        ++count;
+    }
+    nfds_t worker_slot = count;
+    if (node->worker_pipe[0] >= 0) {
+        fds[count].fd = node->worker_pipe[0];
+        fds[count].events = POLLIN;
+        ++count;
+    }
+    if (node->listener_ready) {
+        fds[count].fd = kn_listener_fd(&node->listener);
+        fds[count].events = POLLIN;
+        ++count;
+    }
+    int ready = poll(fds, count, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (node->stdin_polled && fds[0].revents) {
+        *stdin_ready = true;
+    }
+    if (node->worker_pipe[0] >= 0 && fds[worker_slot].revents) {
+        *worker_ready = true;
+    }
+    /* Соединения слушателя опрашиваются на каждом витке. */
+    *listener_ready = node->listener_ready;
+#endif
+    return 0;
+}
+
+/* Возвращает false, если команда завершает сессию. */
+static bool node_handle_line(KolibriNode *node, char *line) {
+    trim_newline(line);
+    trim_spaces(line);
+    if (line[0] == '\0') {
+        return true;
+    }
+    if (line[0] != ':') {
+        node_store_text(node, line);
+        node_record_event(node, "NOTE", "свободный текст сохранён");
+        return true;
+    }
+    const char *command = line + 1;
+    while (*command && !isspace((unsigned char)*command)) {
+        ++command;
+    }
+    size_t prefix = (size_t)(command - (line + 1));
+    char name[32];
+    if (prefix >= sizeof(name)) {
+        prefix = sizeof(name) - 1U;
+    }
+    strncpy(name, line + 1, prefix);
+    name[prefix] = '\0';
+    while (*command && isspace((unsigned char)*command)) {
+        ++command;
+    }
+    if (strcmp(name, "teach") == 0) {
+        node_handle_teach(node, command);
+    } else if (strcmp(name, "ask") == 0) {
+        node_handle_ask(node, command);
+    } else if (strcmp(name, "good") == 0) {
+        node_handle_good(node);
+    } else if (strcmp(name, "bad") == 0) {
+        node_handle_bad(node);
+    } else if (strcmp(name, "tick") == 0 || strcmp(name, "evolve") == 0) {
+        int gens = strcmp(name, "tick") == 0 ? 1 : 32;
+        if (command[0] != '\0' && (!parse_int32(command, &gens) || gens <= 0)) {
+            printf("[Формулы] ожидалось натуральное число\n");
+        } else {
+            node_handle_tick(node, (size_t)gens);
+        }
+    } else if (strcmp(name, "why") == 0) {
+        node_report_formula(node);
+    } else if (strcmp(name, "canvas") == 0 || strcmp(name, "fractal") == 0) {
+        node_print_canvas(node);
+    } else if (strcmp(name, "sync") == 0) {
+        node_share_formula(node);
+    } else if (strcmp(name, "verify") == 0) {
+        node_handle_verify(node);
+    } else if (strcmp(name, "checkpoint") == 0) {
+        node_handle_checkpoint(node);
+    } else if (strcmp(name, "script") == 0 || strcmp(name, "stream") == 0) {
+        if (command[0] == '\0') {
+            printf("[KolibriScript] требуется путь к файлу\n");
+        } else {
+            node_execute_script(node, command, strcmp(name, "stream") == 0);
+        }
+    } else if (strcmp(name, "help") == 0) {
+        node_print_help();
+    } else if (strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0) {
+        printf("[Сессия] завершение работы по команде\n");
+        return false;
+    } else {
+        printf("[Команда] неизвестная директива %s\n", name);
+    }
+    return true;
+}
+
+/* Дочитывает stdin в буфер строк и исполняет все целые строки; строка
+ * длиннее буфера режется, как раньше у fgets. Возвращает false на конце
+ * ввода или :quit. */
+static bool node_read_input(KolibriNode *node) {
+    size_t room = sizeof(node->input) - 1U - node->input_len;
+    ssize_t got = read(STDIN_FILENO, node->input + node->input_len, room);
+    if (got < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    bool eof = got == 0;
+    node->input_len += (size_t)got;
+    size_t start = 0U;
+    for (size_t i = 0; i < node->input_len; ++i) {
+        if (node->input[i] != '\n') {
+            continue;
+        }
+        node->input[i] = '\0';
+        if (!node_handle_line(node, node->input + start)) {
+            return false;
+        }
+        start = i + 1U;
+    }
+    node->input_len -= start;
+    memmove(node->input, node->input + start, node->input_len);
+    if (node->input_len > 0 && (eof || node->input_len == sizeof(node->input) - 1U)) {
+        node->input[node->input_len] = '\0';
+        node->input_len = 0U;
+        if (!node_handle_line(node, node->input)) {
+            return false;
+        }
+    }
+    if (eof) {
+        printf("\n[Сессия] входной поток закрыт\n");
+        return false;
+    }
+    return true;
+}
+
+static void node_run_timers(KolibriNode *node) {
+    uint64_t now = now_ms();
+    if (node_timer_fire(&node->evolve_timer, now) && node->pool.examples > 0) {
+        node_request_evolution(node, 1, false);
+        node_record_event(node, "EVOLVE", "автоцикл");
+    }
+    if (node_timer_fire(&node->sync_timer, now)) {
+        node_share_formula(node);
+    }
+}
+
 static void node_run(KolibriNode *node) {
     printf("Колибри узел %u готов. :help для списка команд.\n",
            node->options.node_id);
     if (node->options.bootstrap_script[0] != '\0') {
-        node_execute_script(node, node->options.bootstrap_script);
+        if (node->pool_restored) {
+            printf("[KolibriScript] пул из контрольной точки, %s пропущен\n", node->options.bootstrap_script);
+        } else {
+            node_execute_script(node, node->options.bootstrap_script, false);
+        }
+    }
+    node_pool_acquire(node);
+    node_publish_best(node);
+    node_pool_release(node);
+    if (node_worker_start(node) != 0) {
+        fprintf(stderr, "[Формулы] фоновая эволюция недоступна, поколения идут в цикле команд\n");
+    }
+    if (node_loop_open(node) != 0) {
+        fprintf(stderr, "[Сессия] не удалось запустить цикл событий\n");
+        node_worker_stop(node);
+        return;
+    }
+    uint64_t start = now_ms();
+    if (node->options.auto_learn) {
+        uint32_t evolve_ms = node->options.auto_evolve_ms > 0 ? node->options.auto_evolve_ms : 500U;
+        node_timer_start(&node->evolve_timer, evolve_ms, start);
+        if (node->options.peer_enabled) {
+            node_timer_start(&node->sync_timer,
+                             node->options.auto_sync_ms > 0 ? node->options.auto_sync_ms : evolve_ms, start);
+        }
     }
-    node->last_evolve_ms = now_ms();
-    node->last_sync_ms = node->last_evolve_ms;
-    char line[512];
     bool prompt_printed = false;
-    while (true) {
-        node_poll_listener(node);
-        fd_set rfds;
-        FD_ZERO(&rfds);
-        FD_SET(0, &rfds);
-        struct timeval tv;
-        uint32_t timeout_ms = node->options.auto_learn ? (node->options.auto_evolve_ms > 0 ? node->options.auto_evolve_ms : 500U) : 1000U;
-        tv.tv_sec = timeout_ms / 1000U;
-        tv.tv_usec = (timeout_ms % 1000U) * 1000U;
+    bool running = true;
+    while (running) {
         if (!prompt_printed) {
             printf("колибри-%u> ", node->options.node_id);
             fflush(stdout);
             prompt_printed = true;
         }
-        int ready = select(1, &rfds, NULL, NULL, &tv);
-        if (ready > 0 && FD_ISSET(0, &rfds)) {
-            if (!fgets(line, sizeof(line), stdin)) {
-                printf("\n[Сессия] входной поток закрыт\n");
-                break;
-            }
-            prompt_printed = false;
-            trim_newline(line);
-            trim_spaces(line);
-            if (line[0] == '\0') {
-                continue;
-            }
+        bool stdin_ready = false;
+        bool listener_ready = false;
+        bool worker_ready = false;
+        if (node_loop_wait(node, node_loop_timeout(node, now_ms()), &stdin_ready, &listener_ready,
+                           &worker_ready) != 0) {
+            fprintf(stderr, "[Сессия] ошибка ожидания событий: %s\n", strerror(errno));
+            break;
+        }
+        if (listener_ready) {
             node_poll_listener(node);
-            if (line[0] == ':') {
-            const char *command = line + 1;
-            while (*command && !isspace((unsigned char)*command)) {
-                ++command;
-            }
-            size_t prefix = (size_t)(command - (line + 1));
-            char name[32];
-            strncpy(name, line + 1, prefix);
-            name[prefix] = '\0';
-            while (*command && isspace((unsigned char)*command)) {
-                ++command;
-            }
-            if (strcmp(name, "teach") == 0) {
-                node_handle_teach(node, command);
-                continue;
-            }
-            if (strcmp(name, "ask") == 0) {
-                node_handle_ask(node, command);
-                continue;
-            }
-            if (strcmp(name, "good") == 0) {
-                node_handle_good(node);
-                continue;
-            }
-            if (strcmp(name, "bad") == 0) {
-                node_handle_bad(node);
-                continue;
-            }
-            if (strcmp(name, "tick") == 0) {
-                int gens = 1;
-                if (command[0] != '\0') {
-                    if (!parse_int32(command, &gens) || gens <= 0) {
-                        printf("[Формулы] ожидалось натуральное число\n");
-                        continue;
-                    }
-                }
-                node_handle_tick(node, (size_t)gens);
-                continue;
-            }
-            if (strcmp(name, "evolve") == 0) {
-                int gens = 32;
-                if (command[0] != '\0') {
-                    if (!parse_int32(command, &gens) || gens <= 0) {
-                        printf("[Формулы] ожидалось натуральное число\n");
-                        continue;
-                    }
-                }
-                node_handle_tick(node, (size_t)gens);
-                continue;
-            }
-            if (strcmp(name, "why") == 0) {
-                node_report_formula(node);
-                continue;
-            }
-            if (strcmp(name, "canvas") == 0) {
-                node_print_canvas(node);
-                continue;
-            }
-            if (strcmp(name, "sync") == 0) {
-                node_share_formula(node);
-                continue;
-            }
-            if (strcmp(name, "verify") == 0) {
-                node_handle_verify(node);
-                continue;
-            }
-            if (strcmp(name, "script") == 0) {
-                if (command[0] == '\0') {
-                    printf("[KolibriScript] требуется путь к файлу\n");
-                    continue;
-                }
-                node_execute_script(node, command);
-                continue;
-            }
-            if (strcmp(name, "fractal") == 0) {
-                node_print_canvas(node);
-                continue;
-            }
-            if (strcmp(name, "help") == 0) {
-                node_print_help();
-                continue;
-            }
-            if (strcmp(name, "quit") == 0 || strcmp(name, "exit") == 0) {
-                printf("[Сессия] завершение работы по команде\n");
-                break;
-            }
-            printf("[Команда] неизвестная директива %s\n", name);
-            continue;
-            }
-            node_store_text(node, line);
-            node_record_event(node, "NOTE", "свободный текст сохранён");
-        } else {
-            if (node->options.auto_learn) {
-                uint64_t now = now_ms();
-                if (node->pool.examples > 0 && (now - node->last_evolve_ms) >= node->options.auto_evolve_ms) {
-                    kf_pool_tick(&node->pool, 1);
-                    node_record_event(node, "EVOLVE", "автоцикл");
-                    node->last_evolve_ms = now;
-                }
-                if (node->options.peer_enabled && (now - node->last_sync_ms) >= node->options.auto_sync_ms) {
-                    node_share_formula(node);
-                    node->last_sync_ms = now;
-                }
-            }
         }
+        if (worker_ready) {
+            node_collect_evolution(node);
+            prompt_printed = false;
+        }
+        if (stdin_ready) {
+            running = node_read_input(node);
+            prompt_printed = node->input_len > 0;
+        }
+        node_run_timers(node);
+        fflush(stdout);
     }
+    node_loop_close(node);
+    node_worker_stop(node);
 }
 
 static int node_start_listener(KolibriNode *node) {
@@ -925,29 +1434,89 @@ static void node_stop_listener(KolibriNode *node) {
 static int node_init(KolibriNode *node, const KolibriNodeOptions *options) {
     memset(node, 0, sizeof(*node));
     node->options = *options;
+    node->loop_fd = -1;
+    node->worker_pipe[0] = node->worker_pipe[1] = -1;
+    pthread_mutex_init(&node->pool_lock, NULL);
+    pthread_cond_init(&node->worker_wake, NULL);
+    pthread_mutex_init(&node->best_lock, NULL);
+    atomic_init(&node->pool_waiters, 0);
+    kn_client_init(&node->peers, node->options.node_id);
     if (node_load_hmac_key(node) != 0) {
         return -1;
     }
     node_reset_last_answer(node);
     k_digit_stream_init(&node->memory, node->memory_buffer, sizeof(node->memory_buffer));
-    kf_pool_init(&node->pool, node->options.seed);
+    if (node_init_pool(node) != 0) {
+        return -1;
+    }
     if (node_open_genome(node) != 0) {
+        kf_pool_destroy(&node->pool);
         return -1;
     }
     if (node_start_listener(node) != 0) {
         node_close_genome(node);
+        kf_pool_destroy(&node->pool);
         return -1;
     }
     return 0;
 }
 
 static void node_shutdown(KolibriNode *node) {
+    if (!node->options.health_check) {
+        node_save_pool(node);
+    }
     node_stop_listener(node);
+    kn_client_close(&node->peers);
     if (node->script_ready) {
         ks_free(&node->script);
         node->script_ready = false;
     }
     node_close_genome(node);
+    kf_pool_destroy(&node->pool);
+    pthread_mutex_destroy(&node->best_lock);
+    pthread_cond_destroy(&node->worker_wake);
+    pthread_mutex_destroy(&node->pool_lock);
+}
+
+/* Профиль эволюции пула: счётчики, время стадий и гистограмма поколений. */
+static void node_format_pool_profile(const KolibriNode *node, char *buffer, size_t buffer_len) {
+    const KolibriPoolProfile *profile = kf_pool_profile(&node->pool);
+    if (!profile || buffer_len == 0) {
+        snprintf(buffer, buffer_len, "null");
+        return;
+    }
+    size_t offset = 0;
+    int written = snprintf(buffer, buffer_len,
+                           "{\"generations\":%" PRIu64 ",\"evaluations\":%" PRIu64
+                           ",\"cache_hits\":%" PRIu64 ",\"last_tick_ms\":%.3f,\"stage_ns\":{",
+                           profile->generation_steps, profile->evaluation_calls,
+                           profile->evaluation_cache_hits, profile->last_generation_ms);
+    for (size_t stage = 0; written >= 0 && stage < KOLIBRI_STAGE_COUNT; ++stage) {
+        offset += (size_t)written;
+        if (offset >= buffer_len) {
+            break;
+        }
+        written = snprintf(buffer + offset, buffer_len - offset, "%s\"%s\":%" PRIu64,
+                           stage == 0 ? "" : ",", kf_pool_stage_name((KolibriPoolStage)stage),
+                           profile->stage_ns[stage]);
+    }
+    for (size_t bucket = 0; written >= 0 && bucket < KOLIBRI_PROFILE_LATENCY_BUCKETS; ++bucket) {
+        offset += (size_t)written;
+        if (offset >= buffer_len) {
+            break;
+        }
+        written = snprintf(buffer + offset, buffer_len - offset, "%s%" PRIu64,
+                           bucket == 0 ? "},\"generation_latency_us_log2\":[" : ",",
+                           profile->generation_latency[bucket]);
+    }
+    if (written >= 0) {
+        offset += (size_t)written;
+    }
+    if (written < 0 || offset + 3U > buffer_len) {
+        snprintf(buffer, buffer_len, "null");
+        return;
+    }
+    memcpy(buffer + offset, "]}", 3U);
 }
 
 static int node_emit_health(KolibriNode *node) {
@@ -963,13 +1532,16 @@ static int node_emit_health(KolibriNode *node) {
         genome_state = "invalid";
     }
     const char *overall = (genome_status == 0) ? "ok" : "degraded";
-    printf("{\"status\":\"%s\",\"node_id\":%u,\"seed\":%" PRIu64 ",\"genome\":{\"path\":\"%s\",\"origin\":\"%s\",\"state\":\"%s\"}}\n",
+    char pool_json[1024];
+    node_format_pool_profile(node, pool_json, sizeof(pool_json));
+    printf("{\"status\":\"%s\",\"node_id\":%u,\"seed\":%" PRIu64 ",\"genome\":{\"path\":\"%s\",\"origin\":\"%s\",\"state\":\"%s\"},\"pool\":%s}\n",
            overall,
            node->options.node_id,
            node->options.seed,
            node->options.genome_path,
            node->hmac_key_origin,
-           genome_state);
+           genome_state,
+           pool_json);
     return (genome_status == 0) ? 0 : 1;
 }
 
@@ -988,8 +1560,10 @@ int main(int argc, char **argv) {
         node_shutdown(&node);
         return status;
     }
+    kolibri_trace_start_from_env();
     node_run(&node);
     node_shutdown(&node);
+    kolibri_trace_stop();
     printf("Колибри узел %u завершил работу\n", options.node_id);
     return 0;
 }
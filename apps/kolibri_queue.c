@@ -9,9 +9,9 @@ static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
             "  kolibri_queue enqueue --db PATH --title TITLE --content TEXT [--source S] [--metadata JSON]\n"
-            "  kolibri_queue list --db PATH [--status pending|approved|rejected] [--limit N]\n"
+            "  kolibri_queue list --db PATH [--status pending|approved|rejected] [--limit N] [--after ID]\n"
             "  kolibri_queue moderate --db PATH --id ID --status approved|rejected --moderator NAME [--note TEXT]\n"
-            "  kolibri_queue export --db PATH --status approved|rejected --output DIR\n");
+            "  kolibri_queue export --db PATH --status approved|rejected --output DIR [--incremental]\n");
 }
 
 static int parse_status(const char *text, KolibriQueueStatus *out_status) {
@@ -61,10 +61,27 @@ static int cmd_enqueue(int argc, char **argv) {
     return 0;
 }
 
+static int print_record(const KolibriQueueRecord *rec, void *user_data) {
+    size_t *count = (size_t *)user_data;
+    *count += 1U;
+    printf("#%lld [%s] %s\n", rec->submission_id, kolibri_queue_status_to_string(rec->status), rec->title ? rec->title : "-");
+    if (rec->source) {
+        printf("  источник: %s\n", rec->source);
+    }
+    if (rec->moderator) {
+        printf("  модератор: %s\n", rec->moderator);
+    }
+    if (rec->moderation_note) {
+        printf("  заметка: %s\n", rec->moderation_note);
+    }
+    return 0;
+}
+
 static int cmd_list(int argc, char **argv) {
     const char *db_path = NULL;
     KolibriQueueStatus status = KOLIBRI_QUEUE_STATUS_PENDING;
     size_t limit = 20U;
+    long long after_id = 0;
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
             db_path = argv[++i];
@@ -74,6 +91,8 @@ static int cmd_list(int argc, char **argv) {
             }
         } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
             limit = (size_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--after") == 0 && i + 1 < argc) {
+            after_id = atoll(argv[++i]);
         }
     }
     if (!db_path) {
@@ -85,33 +104,19 @@ static int cmd_list(int argc, char **argv) {
         fprintf(stderr, "Unable to open queue database\n");
         return 1;
     }
-    KolibriQueueRecord *records = NULL;
     size_t count = 0U;
-    int rc = kolibri_queue_fetch(queue, status, limit, &records, &count);
+    long long last_id = after_id;
+    int rc = kolibri_queue_scan(queue, status, after_id, limit, print_record, &count, &last_id);
+    kolibri_queue_close(queue);
     if (rc != SQLITE_OK) {
         fprintf(stderr, "Fetch failed: %d\n", rc);
-        kolibri_queue_close(queue);
         return 1;
     }
     if (count == 0U) {
         printf("Заявок не найдено\n");
-    } else {
-        for (size_t i = 0; i < count; ++i) {
-            KolibriQueueRecord *rec = &records[i];
-            printf("#%lld [%s] %s\n", rec->submission_id, kolibri_queue_status_to_string(rec->status), rec->title ? rec->title : "-");
-            if (rec->source) {
-                printf("  источник: %s\n", rec->source);
-            }
-            if (rec->moderator) {
-                printf("  модератор: %s\n", rec->moderator);
-            }
-            if (rec->moderation_note) {
-                printf("  заметка: %s\n", rec->moderation_note);
-            }
-        }
+    } else if (limit != 0U && count == limit) {
+        printf("Следующая страница: --after %lld\n", last_id);
     }
-    kolibri_queue_free_records(records, count);
-    kolibri_queue_close(queue);
     return 0;
 }
 
@@ -159,6 +164,7 @@ static int cmd_export(int argc, char **argv) {
     const char *db_path = NULL;
     const char *output_dir = NULL;
     KolibriQueueStatus status = KOLIBRI_QUEUE_STATUS_APPROVED;
+    int incremental = 0;
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) {
             db_path = argv[++i];
@@ -168,6 +174,8 @@ static int cmd_export(int argc, char **argv) {
             }
         } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             output_dir = argv[++i];
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            incremental = 1;
         }
     }
     if (!db_path || !output_dir) {
@@ -180,7 +188,8 @@ static int cmd_export(int argc, char **argv) {
         return 1;
     }
     size_t exported = 0U;
-    int rc = kolibri_queue_export_markdown(queue, status, output_dir, &exported);
+    int rc = incremental ? kolibri_queue_export_markdown_incremental(queue, status, output_dir, &exported)
+                         : kolibri_queue_export_markdown(queue, status, output_dir, &exported);
     kolibri_queue_close(queue);
     if (rc != SQLITE_OK) {
         fprintf(stderr, "Export failed: %d\n", rc);
@@ -1,16 +1,22 @@
 #include "kolibri/sim.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 static void print_usage(void) {
     fprintf(stderr,
             "Usage:\n"
-            "  kolibri_sim tick [--seed N] [--steps S]\n"
+            "  kolibri_sim tick [--seed N] [--steps S] [--log-every K] [--checkpoint PATH]\n"
             "  kolibri_sim reset [--seed N]\n"
-            "  kolibri_sim soak [--seed N] [--minutes M] [--log PATH]\n");
+            "  kolibri_sim soak [--seed N] [--minutes M] [--log PATH] [--checkpoint PATH]\n"
+            "  kolibri_sim batch [--seed N] [--runs R] [--steps S] [--workers W]\n"
+            "                    [--lambda-b A,B,..] [--lambda-d A,B,..] [--temperature A,B,..] [--top-k A,B,..]\n"
+            "                    [--format jsonl|binary] [--output PATH]\n");
 }
 
 static void json_escape(FILE *out, const char *text) {
@@ -83,11 +89,17 @@ static void sim_print_logs(KolibriSim *sim) {
 static int cmd_tick(int argc, char **argv) {
     uint32_t seed = 0U;
     size_t steps = 1U;
+    size_t log_every = 1U;
+    const char *checkpoint = NULL;
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
             seed = (uint32_t)strtoul(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
             steps = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--log-every") == 0 && i + 1 < argc) {
+            log_every = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint = argv[++i];
         }
     }
 
@@ -97,6 +109,7 @@ static int cmd_tick(int argc, char **argv) {
         .trace_path = NULL,
         .trace_include_genome = 0,
         .genome_path = NULL,
+        .pool_checkpoint_path = checkpoint,
     };
 
     KolibriSim *sim = kolibri_sim_create(&cfg);
@@ -105,15 +118,18 @@ static int cmd_tick(int argc, char **argv) {
         return 1;
     }
 
-    for (size_t step = 0; step < steps; ++step) {
-        if (kolibri_sim_tick(sim) != 0) {
-            fprintf(stderr, "kolibri_sim_tick failed\n");
-            kolibri_sim_destroy(sim);
-            return 1;
-        }
+    if (kolibri_sim_tick_n(sim, steps, log_every) != 0) {
+        fprintf(stderr, "kolibri_sim_tick failed\n");
+        kolibri_sim_destroy(sim);
+        return 1;
     }
 
     sim_print_logs(sim);
+    if (checkpoint && kolibri_sim_save_pool(sim, NULL) != 0) {
+        fprintf(stderr, "unable to write checkpoint: %s\n", checkpoint);
+        kolibri_sim_destroy(sim);
+        return 1;
+    }
     kolibri_sim_destroy(sim);
     return 0;
 }
@@ -152,6 +168,7 @@ static int cmd_soak(int argc, char **argv) {
     uint32_t seed = 0U;
     size_t minutes = 5U;
     const char *log_path = NULL;
+    const char *checkpoint = NULL;
     for (int i = 0; i < argc; ++i) {
         if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
             seed = (uint32_t)strtoul(argv[++i], NULL, 10);
@@ -159,6 +176,8 @@ static int cmd_soak(int argc, char **argv) {
             minutes = (size_t)strtoul(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
             log_path = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint = argv[++i];
         }
     }
 
@@ -168,6 +187,7 @@ static int cmd_soak(int argc, char **argv) {
         .trace_path = NULL,
         .trace_include_genome = 0,
         .genome_path = NULL,
+        .pool_checkpoint_path = checkpoint,
     };
 
     KolibriSim *sim = kolibri_sim_create(&cfg);
@@ -204,6 +224,10 @@ static int cmd_soak(int argc, char **argv) {
                 dump_logs(sim, log_file, &last_offset_file, 1);
             }
         }
+        /* Точка раз в минуту: прерванный прогон продолжается с неё. */
+        if (checkpoint && kolibri_sim_save_pool(sim, NULL) != 0) {
+            fprintf(stderr, "unable to write checkpoint: %s\n", checkpoint);
+        }
     }
 
     if (log_file) {
@@ -228,6 +252,271 @@ static int cmd_soak(int argc, char **argv) {
     return 0;
 }
 
+#define KOLIBRI_SIM_SWEEP_MAX 16U
+#define KOLIBRI_SIM_BATCH_MAGIC "KSB1"
+
+typedef struct {
+    double values[KOLIBRI_SIM_SWEEP_MAX];
+    size_t count;
+} SweepAxis;
+
+typedef struct {
+    uint32_t run;
+    uint32_t seed;
+    KolibriSimPoolParams params;
+    double fitness;
+    double elapsed_ms;
+    char best[128];
+    int failed;
+} BatchResult;
+
+typedef struct {
+    BatchResult *results;
+    size_t run_count;
+    size_t steps;
+    atomic_size_t next;
+} BatchJob;
+
+/* Разбирает список через запятую; пустой список оставляет одно значение по умолчанию. */
+static int parse_axis(const char *text, SweepAxis *axis) {
+    axis->count = 0U;
+    const char *cursor = text;
+    while (*cursor) {
+        char *end = NULL;
+        double value = strtod(cursor, &end);
+        if (end == cursor || axis->count == KOLIBRI_SIM_SWEEP_MAX) {
+            fprintf(stderr, "invalid sweep list: %s\n", text);
+            return 1;
+        }
+        axis->values[axis->count++] = value;
+        cursor = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') {
+            fprintf(stderr, "invalid sweep list: %s\n", text);
+            return 1;
+        }
+    }
+    return axis->count == 0U;
+}
+
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void batch_run_one(BatchResult *result, size_t steps) {
+    KolibriSimConfig cfg = {
+        .seed = result->seed,
+        .hmac_key = "kolibri-hmac",
+        .trace_path = NULL,
+        .trace_include_genome = 0,
+        .genome_path = NULL,
+    };
+    double started = monotonic_ms();
+    KolibriSim *sim = kolibri_sim_create(&cfg);
+    if (!sim || kolibri_sim_configure_pool(sim, &result->params) != 0 || kolibri_sim_tick_n(sim, steps, 0U) != 0) {
+        result->failed = 1;
+        kolibri_sim_destroy(sim);
+        return;
+    }
+    KolibriSimFormula best;
+    size_t formula_count = 0U;
+    if (kolibri_sim_get_formulas(sim, &best, 1U, &formula_count) == 0 && formula_count == 1U) {
+        result->fitness = best.fitness;
+    }
+    KolibriSimLog logs[KOLIBRI_SIM_SWEEP_MAX];
+    size_t log_count = 0U;
+    size_t offset = 0U;
+    if (kolibri_sim_get_logs(sim, logs, KOLIBRI_SIM_SWEEP_MAX, &log_count, &offset) == 0 && log_count > 0U) {
+        snprintf(result->best, sizeof(result->best), "%s", logs[log_count - 1U].soobshenie);
+    }
+    kolibri_sim_destroy(sim);
+    result->elapsed_ms = monotonic_ms() - started;
+}
+
+/* Рабочие разбирают прогоны по общему счётчику; результат пишется в слот прогона,
+ * поэтому вывод не зависит от числа потоков. */
+static void *batch_worker(void *arg) {
+    BatchJob *job = (BatchJob *)arg;
+    for (;;) {
+        size_t run = atomic_fetch_add(&job->next, 1U);
+        if (run >= job->run_count) {
+            return NULL;
+        }
+        batch_run_one(&job->results[run], job->steps);
+    }
+}
+
+static void batch_write_jsonl(FILE *out, const BatchResult *results, size_t count, size_t steps) {
+    for (size_t i = 0; i < count; ++i) {
+        const BatchResult *r = &results[i];
+        fprintf(out,
+                "{\"run\":%u,\"seed\":%u,\"lambda_b\":%g,\"lambda_d\":%g,\"temperature\":%g,"
+                "\"top_k\":%zu,\"steps\":%zu,\"ok\":%s,\"fitness\":%.6f,\"elapsed_ms\":%.3f,\"best\":\"",
+                r->run,
+                r->seed,
+                r->params.lambda_b,
+                r->params.lambda_d,
+                r->params.temperature,
+                r->params.top_k,
+                steps,
+                r->failed ? "false" : "true",
+                r->fitness,
+                r->elapsed_ms);
+        json_escape(out, r->best);
+        fputs("\"}\n", out);
+    }
+}
+
+/* Двоичный формат: "KSB1", uint32 число записей, затем записи фиксированной
+ * длины в порядке байтов машины: run, seed (uint32), lambda_b, lambda_d,
+ * temperature (double), top_k, steps (uint64), fitness, elapsed_ms (double). */
+static void batch_write_binary(FILE *out, const BatchResult *results, size_t count, size_t steps) {
+    uint32_t total = (uint32_t)count;
+    fwrite(KOLIBRI_SIM_BATCH_MAGIC, 1U, 4U, out);
+    fwrite(&total, sizeof(total), 1U, out);
+    for (size_t i = 0; i < count; ++i) {
+        const BatchResult *r = &results[i];
+        uint64_t top_k = (uint64_t)r->params.top_k;
+        uint64_t steps64 = (uint64_t)steps;
+        double fitness = r->failed ? -1.0 : r->fitness;
+        fwrite(&r->run, sizeof(r->run), 1U, out);
+        fwrite(&r->seed, sizeof(r->seed), 1U, out);
+        fwrite(&r->params.lambda_b, sizeof(double), 1U, out);
+        fwrite(&r->params.lambda_d, sizeof(double), 1U, out);
+        fwrite(&r->params.temperature, sizeof(double), 1U, out);
+        fwrite(&top_k, sizeof(top_k), 1U, out);
+        fwrite(&steps64, sizeof(steps64), 1U, out);
+        fwrite(&fitness, sizeof(fitness), 1U, out);
+        fwrite(&r->elapsed_ms, sizeof(double), 1U, out);
+    }
+}
+
+static int cmd_batch(int argc, char **argv) {
+    uint32_t seed = 0U;
+    size_t runs = 1U;
+    size_t steps = 100U;
+    size_t workers = 0U;
+    int binary = 0;
+    const char *output_path = NULL;
+    SweepAxis lambda_b = {{0.0}, 1U};
+    SweepAxis lambda_d = {{0.0}, 1U};
+    SweepAxis temperature = {{1.0}, 1U};
+    SweepAxis top_k = {{0.0}, 1U};
+    for (int i = 0; i < argc; ++i) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+            steps = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            binary = strcmp(argv[++i], "binary") == 0;
+        } else if (strcmp(argv[i], "--lambda-b") == 0 && i + 1 < argc) {
+            if (parse_axis(argv[++i], &lambda_b) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--lambda-d") == 0 && i + 1 < argc) {
+            if (parse_axis(argv[++i], &lambda_d) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--temperature") == 0 && i + 1 < argc) {
+            if (parse_axis(argv[++i], &temperature) != 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--top-k") == 0 && i + 1 < argc) {
+            if (parse_axis(argv[++i], &top_k) != 0) {
+                return 1;
+            }
+        }
+    }
+    size_t combos = lambda_b.count * lambda_d.count * temperature.count * top_k.count;
+    size_t run_count = runs * combos;
+    if (run_count == 0U || run_count > UINT32_MAX) {
+        print_usage();
+        return 1;
+    }
+    if (workers == 0U) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = online > 0 ? (size_t)online : 1U;
+    }
+    if (workers > run_count) {
+        workers = run_count;
+    }
+
+    BatchResult *results = (BatchResult *)calloc(run_count, sizeof(BatchResult));
+    pthread_t *threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+    if (!results || !threads) {
+        fprintf(stderr, "out of memory\n");
+        free(results);
+        free(threads);
+        return 1;
+    }
+    /* Прогон r: комбинация параметров r / runs, зерно seed + r % runs —
+     * одинаковые зёрна для каждой точки сетки делают точки сравнимыми. */
+    for (size_t r = 0; r < run_count; ++r) {
+        size_t combo = r / runs;
+        BatchResult *result = &results[r];
+        result->run = (uint32_t)r;
+        result->seed = seed + (uint32_t)(r % runs);
+        result->params.top_k = (size_t)top_k.values[combo % top_k.count];
+        combo /= top_k.count;
+        result->params.temperature = temperature.values[combo % temperature.count];
+        combo /= temperature.count;
+        result->params.lambda_d = lambda_d.values[combo % lambda_d.count];
+        combo /= lambda_d.count;
+        result->params.lambda_b = lambda_b.values[combo];
+    }
+
+    BatchJob job = {.results = results, .run_count = run_count, .steps = steps};
+    atomic_init(&job.next, 0U);
+    double started = monotonic_ms();
+    size_t spawned = 0U;
+    for (; spawned < workers; ++spawned) {
+        if (pthread_create(&threads[spawned], NULL, batch_worker, &job) != 0) {
+            break;
+        }
+    }
+    if (spawned == 0U) {
+        batch_worker(&job);
+    }
+    for (size_t i = 0; i < spawned; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = monotonic_ms() - started;
+
+    FILE *out = stdout;
+    if (output_path) {
+        out = fopen(output_path, binary ? "wb" : "w");
+        if (!out) {
+            fprintf(stderr, "unable to open output file: %s\n", output_path);
+            free(results);
+            free(threads);
+            return 1;
+        }
+    }
+    if (binary) {
+        batch_write_binary(out, results, run_count, steps);
+    } else {
+        batch_write_jsonl(out, results, run_count, steps);
+    }
+    int failed = 0;
+    for (size_t r = 0; r < run_count; ++r) {
+        failed |= results[r].failed;
+    }
+    if (output_path) {
+        fclose(out);
+    }
+    fprintf(stderr, "{\"runs\":%zu,\"workers\":%zu,\"elapsed_ms\":%.3f}\n", run_count, spawned ? spawned : 1U, elapsed);
+    free(results);
+    free(threads);
+    return failed ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         print_usage();
@@ -243,6 +532,9 @@ int main(int argc, char **argv) {
     if (strcmp(command, "soak") == 0) {
         return cmd_soak(argc - 2, &argv[2]);
     }
+    if (strcmp(command, "batch") == 0) {
+        return cmd_batch(argc - 2, &argv[2]);
+    }
     print_usage();
     return 1;
 }
@@ -4,38 +4,104 @@
 
 #include "kolibri/decimal.h"
 #include "kolibri/digits.h"
+#include "kolibri/script.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+/* Размер куска потокового перекодирования: память не зависит от длины входа. */
+#define KS_KUSOK_BAJT 65536U
+
+typedef enum {
+    KS_REZHIM_KODIROVAT,
+    KS_REZHIM_DEKODIROVAT,
+    KS_REZHIM_BAJTKOD
+} KsRezhim;
+
+typedef struct {
+    const char *vhod;
+    char *vyhod;
+    int kod;
+} KsZadanie;
+
+typedef struct {
+    KsZadanie *zadanija;
+    size_t kolichestvo;
+    KsRezhim rezhim;
+    atomic_size_t sledujuschee;
+} KsOchered;
 
 static void vyvesti_spravku(void) {
     fprintf(stderr,
-            "Использование: ks_compiler [--decode] [-o файл] [вход]\n"
+            "Использование: ks_compiler [--decode | --bytecode] [-j N] [-o путь] [вход...]\n"
             "  --decode       Преобразовать цифровой поток обратно в текст\n"
-            "  -o файл        Путь для сохранения результата (по умолчанию stdout)\n"
-            "  вход           Файл KolibriScript (.ks или .ksd), '-' — stdin\n");
+            "  --bytecode     Скомпилировать сценарий в образ байткода (.ksc)\n"
+            "  -j, --jobs N   Число рабочих потоков для нескольких входов (по умолчанию — число ядер)\n"
+            "  -o путь        Файл результата (по умолчанию stdout); при нескольких\n"
+            "                 входах — каталог (по умолчанию рядом со входом)\n"
+            "  вход           Файл KolibriScript (.ks или .ksd), '-' — stdin\n"
+            "Кодирование и декодирование идут потоково кусками по %u байт.\n",
+            KS_KUSOK_BAJT);
 }
 
-static unsigned char *chtenie_vseh_bajtov(const char *put, size_t *dlina) {
-    FILE *istochnik = NULL;
+static FILE *otkryt_vhod(const char *put) {
     if (!put || strcmp(put, "-") == 0) {
-        istochnik = stdin;
-    } else {
-        istochnik = fopen(put, "rb");
-        if (!istochnik) {
-            fprintf(stderr, "[Ошибка] Не удалось открыть '%s': %s\n", put,
-                    strerror(errno));
-            return NULL;
+        return stdin;
+    }
+    FILE *istochnik = fopen(put, "rb");
+    if (!istochnik) {
+        fprintf(stderr, "[Ошибка] Не удалось открыть '%s': %s\n", put,
+                strerror(errno));
+    }
+    return istochnik;
+}
+
+static FILE *otkryt_vyhod(const char *put) {
+    if (!put || strcmp(put, "-") == 0) {
+        return stdout;
+    }
+    FILE *naznachenie = fopen(put, "wb");
+    if (!naznachenie) {
+        fprintf(stderr, "[Ошибка] Не удалось открыть '%s' для записи: %s\n",
+                put, strerror(errno));
+    }
+    return naznachenie;
+}
+
+/* Закрывает результат; недописанный файл удаляется, чтобы не оставлять обрывков. */
+static int zakryt_vyhod(FILE *naznachenie, const char *put, int kod) {
+    if (naznachenie == stdout) {
+        if (fflush(stdout) != 0) {
+            kod = -1;
         }
+        return kod;
+    }
+    if (fclose(naznachenie) != 0) {
+        kod = -1;
+    }
+    if (kod != 0) {
+        remove(put);
+    }
+    return kod;
+}
+
+/* Читает вход целиком и завершает его нулём — буфер сразу годится как текст. */
+static char *chtenie_vseh_bajtov(const char *put, size_t *dlina) {
+    FILE *istochnik = otkryt_vhod(put);
+    if (!istochnik) {
+        return NULL;
     }
 
     size_t emkost = 4096U;
     size_t dlina_chtenija = 0U;
-    unsigned char *dannye = (unsigned char *)malloc(emkost);
+    char *dannye = (char *)malloc(emkost);
     if (!dannye) {
         fprintf(stderr, "[Ошибка] Недостаточно памяти для чтения\n");
         if (istochnik != stdin) {
@@ -45,10 +111,9 @@ static unsigned char *chtenie_vseh_bajtov(const char *put, size_t *dlina) {
     }
 
     while (1) {
-        if (dlina_chtenija == emkost) {
+        if (dlina_chtenija + 1U >= emkost) {
             size_t novaja = emkost * 2U;
-            unsigned char *novyj =
-                (unsigned char *)realloc(dannye, novaja);
+            char *novyj = (char *)realloc(dannye, novaja);
             if (!novyj) {
                 fprintf(stderr, "[Ошибка] Недостаточно памяти при чтении\n");
                 free(dannye);
@@ -61,7 +126,7 @@ static unsigned char *chtenie_vseh_bajtov(const char *put, size_t *dlina) {
             emkost = novaja;
         }
         size_t prochitano = fread(dannye + dlina_chtenija, 1U,
-                                  emkost - dlina_chtenija, istochnik);
+                                  emkost - 1U - dlina_chtenija, istochnik);
         dlina_chtenija += prochitano;
         if (prochitano == 0U) {
             if (ferror(istochnik)) {
@@ -81,164 +146,331 @@ static unsigned char *chtenie_vseh_bajtov(const char *put, size_t *dlina) {
         fclose(istochnik);
     }
 
+    dannye[dlina_chtenija] = '\0';
     *dlina = dlina_chtenija;
     return dannye;
 }
 
-static int zapisat_vyhod(const char *put, const unsigned char *dannye,
-                         size_t dlina) {
-    FILE *naznachenie = NULL;
-    if (!put || strcmp(put, "-") == 0) {
-        naznachenie = stdout;
-    } else {
-        naznachenie = fopen(put, "wb");
-        if (!naznachenie) {
-            fprintf(stderr, "[Ошибка] Не удалось открыть '%s' для записи: %s\n",
-                    put, strerror(errno));
-            return -1;
-        }
+static int dekodirovat(FILE *istochnik, FILE *naznachenie) {
+    unsigned char *kusok = (unsigned char *)malloc(KS_KUSOK_BAJT);
+    char *cifry = (char *)malloc(KS_KUSOK_BAJT + 2U);
+    unsigned char *rezultat = (unsigned char *)malloc(
+        kolibri_dlina_dekodirovki_teksta(KS_KUSOK_BAJT + 2U));
+    if (!kusok || !cifry || !rezultat) {
+        fprintf(stderr, "[Ошибка] Недостаточно памяти для цифрового буфера\n");
+        free(kusok);
+        free(cifry);
+        free(rezultat);
+        return -1;
     }
 
-    size_t zapisano = fwrite(dannye, 1U, dlina, naznachenie);
-    if (zapisano != dlina) {
-        fprintf(stderr, "[Ошибка] Не удалось полностью записать данные\n");
-        if (naznachenie != stdout) {
-            fclose(naznachenie);
+    /* Пробелы и переводы строк пропускаем; неполная тройка переносится
+     * в начало следующего куска. */
+    int kod = 0;
+    size_t ostatok = 0U;
+    size_t vsego = 0U;
+    size_t prochitano = 0U;
+    while ((prochitano = fread(kusok, 1U, KS_KUSOK_BAJT, istochnik)) > 0U) {
+        size_t kolichestvo = ostatok;
+        for (size_t indeks = 0U; indeks < prochitano; ++indeks) {
+            unsigned char simvol = kusok[indeks];
+            if (simvol >= '0' && simvol <= '9') {
+                cifry[kolichestvo++] = (char)simvol;
+            }
         }
-        return -1;
+        size_t polnye = kolichestvo - kolichestvo % 3U;
+        if (polnye > 0U) {
+            if (k_decode_ascii_bulk(cifry, polnye, rezultat) != 0) {
+                fprintf(stderr, "[Ошибка] Не удалось декодировать цифровой поток\n");
+                kod = -1;
+                break;
+            }
+            size_t bajty = kolibri_dlina_dekodirovki_teksta(polnye);
+            if (fwrite(rezultat, 1U, bajty, naznachenie) != bajty) {
+                fprintf(stderr, "[Ошибка] Не удалось полностью записать данные\n");
+                kod = -1;
+                break;
+            }
+        }
+        vsego += polnye;
+        ostatok = kolichestvo - polnye;
+        memmove(cifry, cifry + polnye, ostatok);
     }
-
-    if (naznachenie != stdout) {
-        fclose(naznachenie);
+    if (kod == 0 && ferror(istochnik)) {
+        fprintf(stderr, "[Ошибка] Ошибка чтения: %s\n", strerror(errno));
+        kod = -1;
+    }
+    if (kod == 0 && (ostatok != 0U || vsego == 0U)) {
+        fprintf(stderr, "[Ошибка] Некратное тройке количество цифр\n");
+        kod = -1;
     }
-    return 0;
+
+    free(kusok);
+    free(cifry);
+    free(rezultat);
+    return kod;
 }
 
-static int dekodirovat(const char *vyhod, const unsigned char *vhod,
-                       size_t dlina) {
-    uint8_t *cifry = (uint8_t *)malloc(dlina * sizeof(uint8_t));
-    if (!cifry) {
-        fprintf(stderr, "[Ошибка] Недостаточно памяти для цифрового буфера\n");
+static int kodirovat(FILE *istochnik, FILE *naznachenie) {
+    unsigned char *kusok = (unsigned char *)malloc(KS_KUSOK_BAJT);
+    char *stroka = (char *)malloc(kolibri_dlina_kodirovki_teksta(KS_KUSOK_BAJT));
+    if (!kusok || !stroka) {
+        fprintf(stderr, "[Ошибка] Недостаточно памяти для результата\n");
+        free(kusok);
+        free(stroka);
         return -1;
     }
-    kolibri_potok_cifr potok;
-    kolibri_potok_cifr_init(&potok, cifry, dlina);
-    for (size_t indeks = 0U; indeks < dlina; ++indeks) {
-        unsigned char simvol = vhod[indeks];
-        if (simvol >= '0' && simvol <= '9') {
-            if (kolibri_potok_cifr_push(&potok, (uint8_t)(simvol - '0')) != 0) {
-                free(cifry);
-                fprintf(stderr,
-                        "[Ошибка] Цифровой поток превышает допустимую длину\n");
-                return -1;
-            }
+
+    int kod = 0;
+    size_t prochitano = 0U;
+    while ((prochitano = fread(kusok, 1U, KS_KUSOK_BAJT, istochnik)) > 0U) {
+        size_t trebuemye_cifry = kolibri_dlina_kodirovki_teksta(prochitano);
+        k_encode_ascii_bulk(kusok, prochitano, stroka);
+        if (fwrite(stroka, 1U, trebuemye_cifry, naznachenie) != trebuemye_cifry) {
+            fprintf(stderr, "[Ошибка] Не удалось полностью записать данные\n");
+            kod = -1;
+            break;
         }
     }
+    if (kod == 0 && ferror(istochnik)) {
+        fprintf(stderr, "[Ошибка] Ошибка чтения: %s\n", strerror(errno));
+        kod = -1;
+    }
+    if (kod == 0 && fputc('\n', naznachenie) == EOF) {
+        fprintf(stderr, "[Ошибка] Не удалось полностью записать данные\n");
+        kod = -1;
+    }
 
-    size_t ocenennaja_dlina = kolibri_dlina_dekodirovki_teksta(potok.dlina);
-    if (ocenennaja_dlina == 0U) {
-        fprintf(stderr, "[Ошибка] Некратное тройке количество цифр\n");
-        free(cifry);
+    free(kusok);
+    free(stroka);
+    return kod;
+}
+
+/* Байткод требует сценарий целиком: ks_load_text разбирает весь текст сразу. */
+static int skompilirovat(const char *vhod, const char *vyhod) {
+    size_t dlina = 0U;
+    char *tekst = chtenie_vseh_bajtov(vhod, &dlina);
+    if (!tekst) {
         return -1;
     }
 
-    unsigned char *rezultat =
-        (unsigned char *)malloc(ocenennaja_dlina * sizeof(unsigned char));
-    if (!rezultat) {
-        fprintf(stderr, "[Ошибка] Недостаточно памяти для результата\n");
-        free(cifry);
+    KolibriScript skript;
+    if (ks_init(&skript, NULL, NULL) != 0) {
+        fprintf(stderr, "[Ошибка] Не удалось инициализировать интерпретатор\n");
+        free(tekst);
         return -1;
     }
-
-    size_t zapisano = 0U;
-    int kod = kolibri_izluchit_utf8(&potok, rezultat, ocenennaja_dlina,
-                                    &zapisano);
-    if (kod != 0) {
-        fprintf(stderr, "[Ошибка] Не удалось декодировать цифровой поток\n");
-        free(cifry);
-        free(rezultat);
+    int zagruzka = ks_load_text(&skript, tekst);
+    free(tekst);
+    if (zagruzka != 0) {
+        fprintf(stderr, "[Ошибка] Не удалось загрузить сценарий\n");
+        ks_free(&skript);
+        return -1;
+    }
+    if (ks_compile(&skript) != 0) {
+        fprintf(stderr, "[Ошибка] Сценарий содержит ошибки и не скомпилирован\n");
+        ks_free(&skript);
         return -1;
     }
 
-    int zapis = zapisat_vyhod(vyhod, rezultat, zapisano);
-    free(cifry);
-    free(rezultat);
-    return zapis;
+    FILE *naznachenie = otkryt_vyhod(vyhod);
+    if (!naznachenie) {
+        ks_free(&skript);
+        return -1;
+    }
+    int kod = zakryt_vyhod(naznachenie, vyhod,
+                           ks_save_compiled(&skript, naznachenie));
+    if (kod != 0) {
+        fprintf(stderr, "[Ошибка] Не удалось записать образ байткода\n");
+    }
+    ks_free(&skript);
+    return kod;
 }
 
-static int kodirovat(const char *vyhod, const unsigned char *vhod,
-                     size_t dlina) {
-    size_t trebuemye_cifry = kolibri_dlina_kodirovki_teksta(dlina);
-    uint8_t *cifry = (uint8_t *)calloc(trebuemye_cifry, sizeof(uint8_t));
-    if (!cifry) {
-        fprintf(stderr, "[Ошибка] Недостаточно памяти для цифрового потока\n");
+static int obrabotat(KsRezhim rezhim, const char *vhod, const char *vyhod) {
+    if (rezhim == KS_REZHIM_BAJTKOD) {
+        return skompilirovat(vhod, vyhod);
+    }
+    FILE *istochnik = otkryt_vhod(vhod);
+    if (!istochnik) {
         return -1;
     }
-    kolibri_potok_cifr potok;
-    kolibri_potok_cifr_init(&potok, cifry, trebuemye_cifry);
-    if (kolibri_transducirovat_utf8(&potok, vhod, dlina) != 0) {
-        fprintf(stderr, "[Ошибка] Не удалось преобразовать текст в цифры\n");
-        free(cifry);
+    FILE *naznachenie = otkryt_vyhod(vyhod);
+    if (!naznachenie) {
+        if (istochnik != stdin) {
+            fclose(istochnik);
+        }
         return -1;
     }
+    int kod = rezhim == KS_REZHIM_DEKODIROVAT ? dekodirovat(istochnik, naznachenie)
+                                              : kodirovat(istochnik, naznachenie);
+    if (istochnik != stdin) {
+        fclose(istochnik);
+    }
+    return zakryt_vyhod(naznachenie, vyhod, kod);
+}
 
-    char *stroka = (char *)malloc(potok.dlina + 2U);
-    if (!stroka) {
-        fprintf(stderr, "[Ошибка] Недостаточно памяти для результата\n");
-        free(cifry);
-        return -1;
+/* Имя результата: основа входа с расширением режима, в каталоге katalog
+ * или рядом со входом. */
+static char *put_vyhoda(const char *vhod, const char *katalog, KsRezhim rezhim) {
+    static const char *const rasshirenija[] = {".ksd", ".ks", ".ksc"};
+    const char *imja = strrchr(vhod, '/');
+    imja = imja ? imja + 1 : vhod;
+    const char *tochka = strrchr(imja, '.');
+    size_t osnova = tochka && tochka != imja ? (size_t)(tochka - imja) : strlen(imja);
+    const char *kat = katalog ? katalog : vhod;
+    size_t dlina_kat = katalog ? strlen(katalog) : (size_t)(imja - vhod);
+    const char *rasshirenie = rasshirenija[rezhim];
+
+    size_t dlina = dlina_kat + 1U + osnova + strlen(rasshirenie) + 1U;
+    char *put = (char *)malloc(dlina);
+    if (!put) {
+        return NULL;
+    }
+    const char *razdelitel = katalog && dlina_kat > 0U && kat[dlina_kat - 1U] != '/' ? "/" : "";
+    snprintf(put, dlina, "%.*s%s%.*s%s", (int)dlina_kat, kat, razdelitel,
+             (int)osnova, imja, rasshirenie);
+    return put;
+}
+
+/* Рабочие разбирают входы по общему счётчику; итог каждого пишется в его слот. */
+static void *rabochij(void *arg) {
+    KsOchered *ochered = (KsOchered *)arg;
+    for (;;) {
+        size_t nomer = atomic_fetch_add(&ochered->sledujuschee, 1U);
+        if (nomer >= ochered->kolichestvo) {
+            return NULL;
+        }
+        KsZadanie *zadanie = &ochered->zadanija[nomer];
+        zadanie->kod = obrabotat(ochered->rezhim, zadanie->vhod, zadanie->vyhod);
     }
-    for (size_t indeks = 0U; indeks < potok.dlina; ++indeks) {
-        stroka[indeks] = (char)('0' + potok.danniye[indeks]);
+}
+
+static int obrabotat_mnogo(KsRezhim rezhim, const char **vhody, size_t kolichestvo,
+                           const char *katalog, size_t potoki) {
+    KsZadanie *zadanija = (KsZadanie *)calloc(kolichestvo, sizeof(KsZadanie));
+    if (!zadanija) {
+        fprintf(stderr, "[Ошибка] Недостаточно памяти для списка входов\n");
+        return 1;
+    }
+    int itog = 0;
+    for (size_t indeks = 0U; indeks < kolichestvo && itog == 0; ++indeks) {
+        zadanija[indeks].vhod = vhody[indeks];
+        if (strcmp(vhody[indeks], "-") == 0) {
+            fprintf(stderr, "[Ошибка] stdin допустим только как единственный вход\n");
+            itog = 1;
+            break;
+        }
+        zadanija[indeks].vyhod = put_vyhoda(vhody[indeks], katalog, rezhim);
+        if (!zadanija[indeks].vyhod) {
+            fprintf(stderr, "[Ошибка] Недостаточно памяти для списка входов\n");
+            itog = 1;
+        } else if (strcmp(zadanija[indeks].vyhod, vhody[indeks]) == 0) {
+            fprintf(stderr, "[Ошибка] Результат '%s' затёр бы вход\n", vhody[indeks]);
+            itog = 1;
+        }
     }
-    stroka[potok.dlina] = '\n';
-    stroka[potok.dlina + 1U] = '\0';
 
-    int zapis = zapisat_vyhod(vyhod, (const unsigned char *)stroka,
-                              potok.dlina + 1U);
-    free(stroka);
-    free(cifry);
-    return zapis;
+    if (itog == 0) {
+        if (potoki == 0U) {
+            long jadra = sysconf(_SC_NPROCESSORS_ONLN);
+            potoki = jadra > 0 ? (size_t)jadra : 1U;
+        }
+        if (potoki > kolichestvo) {
+            potoki = kolichestvo;
+        }
+        KsOchered ochered = {.zadanija = zadanija, .kolichestvo = kolichestvo,
+                             .rezhim = rezhim};
+        atomic_init(&ochered.sledujuschee, 0U);
+        pthread_t *niti = (pthread_t *)calloc(potoki, sizeof(pthread_t));
+        size_t zapuscheno = 0U;
+        for (; niti && zapuscheno < potoki; ++zapuscheno) {
+            if (pthread_create(&niti[zapuscheno], NULL, rabochij, &ochered) != 0) {
+                break;
+            }
+        }
+        if (zapuscheno == 0U) {
+            rabochij(&ochered);
+        }
+        for (size_t indeks = 0U; indeks < zapuscheno; ++indeks) {
+            pthread_join(niti[indeks], NULL);
+        }
+        free(niti);
+        for (size_t indeks = 0U; indeks < kolichestvo; ++indeks) {
+            if (zadanija[indeks].kod != 0) {
+                fprintf(stderr, "[Ошибка] Вход '%s' не обработан\n", zadanija[indeks].vhod);
+                itog = 1;
+            }
+        }
+    }
+
+    for (size_t indeks = 0U; indeks < kolichestvo; ++indeks) {
+        free(zadanija[indeks].vyhod);
+    }
+    free(zadanija);
+    return itog;
 }
 
 int main(int argc, char **argv) {
     const char *vyhod = NULL;
-    const char *vhod = NULL;
+    const char **vhody = (const char **)calloc((size_t)argc, sizeof(const char *));
+    size_t kolichestvo = 0U;
+    size_t potoki = 0U;
     bool decode = false;
+    bool bytecode = false;
 
+    if (!vhody) {
+        fprintf(stderr, "[Ошибка] Недостаточно памяти для списка входов\n");
+        return 1;
+    }
     for (int indeks = 1; indeks < argc; ++indeks) {
         if (strcmp(argv[indeks], "--decode") == 0) {
             decode = true;
+        } else if (strcmp(argv[indeks], "--bytecode") == 0) {
+            bytecode = true;
         } else if (strcmp(argv[indeks], "-o") == 0) {
             if (indeks + 1 >= argc) {
                 vyvesti_spravku();
+                free(vhody);
                 return 1;
             }
             vyhod = argv[++indeks];
+        } else if (strcmp(argv[indeks], "-j") == 0 ||
+                   strcmp(argv[indeks], "--jobs") == 0) {
+            char *konec = NULL;
+            unsigned long chislo = indeks + 1 < argc
+                                       ? strtoul(argv[indeks + 1], &konec, 10)
+                                       : 0UL;
+            if (!konec || *konec != '\0' || chislo == 0UL) {
+                vyvesti_spravku();
+                free(vhody);
+                return 1;
+            }
+            potoki = (size_t)chislo;
+            ++indeks;
         } else if (strcmp(argv[indeks], "-h") == 0 ||
                    strcmp(argv[indeks], "--help") == 0) {
             vyvesti_spravku();
+            free(vhody);
             return 0;
-        } else if (!vhod) {
-            vhod = argv[indeks];
         } else {
-            fprintf(stderr, "[Ошибка] Лишний аргумент '%s'\n", argv[indeks]);
-            vyvesti_spravku();
-            return 1;
+            vhody[kolichestvo++] = argv[indeks];
         }
     }
 
-    size_t dlina = 0U;
-    unsigned char *dannye = chtenie_vseh_bajtov(vhod, &dlina);
-    if (!dannye) {
+    if (decode && bytecode) {
+        fprintf(stderr, "[Ошибка] --decode и --bytecode несовместимы\n");
+        free(vhody);
         return 1;
     }
-    if (decode) {
-        int kod = dekodirovat(vyhod, dannye, dlina);
-        free(dannye);
-        return kod == 0 ? 0 : 1;
+    KsRezhim rezhim = bytecode ? KS_REZHIM_BAJTKOD
+                               : decode ? KS_REZHIM_DEKODIROVAT : KS_REZHIM_KODIROVAT;
+    int kod = 0;
+    if (kolichestvo <= 1U) {
+        kod = obrabotat(rezhim, kolichestvo ? vhody[0] : NULL, vyhod) == 0 ? 0 : 1;
+    } else {
+        kod = obrabotat_mnogo(rezhim, vhody, kolichestvo, vyhod, potoki);
     }
-    int kod = kodirovat(vyhod, dannye, dlina);
-    free(dannye);
-    return kod == 0 ? 0 : 1;
+    free(vhody);
+    return kod;
 }
@@ -24,6 +24,14 @@ size_t k_digit_stream_remaining(const k_digit_stream *stream);
 int k_transduce_utf8(k_digit_stream *stream, const unsigned char *bytes, size_t len);
 int k_emit_utf8(const k_digit_stream *stream, unsigned char *out, size_t out_len, size_t *written);
 
+/* Пакетный кодек: len байт -> len * 3 цифр (0..9 или ASCII '0'..'9') и обратно.
+ * Буфер назначения должен вмещать результат целиком; декодер возвращает -1,
+ * если длина не кратна трём, встретилась не цифра или тройка больше 255. */
+void k_encode_digits_bulk(const unsigned char *bytes, size_t len, uint8_t *digits);
+int k_decode_digits_bulk(const uint8_t *digits, size_t len, unsigned char *out);
+void k_encode_ascii_bulk(const unsigned char *bytes, size_t len, char *out);
+int k_decode_ascii_bulk(const char *digits, size_t len, unsigned char *out);
+
 
 size_t k_encode_text_length(size_t input_len);
 size_t k_decode_text_length(size_t digits_len);
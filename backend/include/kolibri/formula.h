@@ -31,7 +31,13 @@ typedef struct {
 
 #define KOLIBRI_FORMULA_MAX_ASSOCIATIONS 32
 #define KOLIBRI_POOL_MAX_ASSOCIATIONS 64
+#define KOLIBRI_POOL_CAPACITY 24
+#define KOLIBRI_POOL_MAX_EXAMPLES 64
 
+struct KolibriAssociationIndex;
+
+/* Представление формулы. Ассоциации не копируются: формула ссылается на
+ * общее хранилище пула по номерам слотов и действительна, пока жив пул. */
 typedef struct {
     KolibriGene gene;
     double fitness;
@@ -39,25 +45,96 @@ typedef struct {
     double invariant_drift_b;
     double invariant_drift_d;
     double phase;
-    KolibriAssociation associations[KOLIBRI_FORMULA_MAX_ASSOCIATIONS];
+    const KolibriAssociation *association_store;
+    size_t association_store_size;
+    uint32_t association_ids[KOLIBRI_FORMULA_MAX_ASSOCIATIONS];
     size_t association_count;
+    /* Индекс хранилища пула; NULL — только собственные association_ids. */
+    const struct KolibriAssociationIndex *association_index;
 } KolibriFormula;
 
+typedef enum {
+    KOLIBRI_STAGE_EVALUATE = 0,
+    KOLIBRI_STAGE_COHERENCE,
+    KOLIBRI_STAGE_SORT,
+    KOLIBRI_STAGE_REPRODUCE,
+    KOLIBRI_STAGE_ASSOCIATIONS,
+    KOLIBRI_STAGE_COUNT
+} KolibriPoolStage;
+
+#define KOLIBRI_PROFILE_LATENCY_BUCKETS 16
+
 typedef struct {
     uint64_t generation_steps;
     uint64_t evaluation_calls;
+    /* Оценки, взятые из памятки вместо повторного прогона по примерам. */
+    uint64_t evaluation_cache_hits;
+    /* Длительность последнего тика по монотонным часам. */
     double last_generation_ms;
+    /* Накопленное время стадий тика, нс. */
+    uint64_t stage_ns[KOLIBRI_STAGE_COUNT];
+    /* Гистограмма длительности поколения: ячейка 0 — меньше 1 мкс,
+     * ячейка i — [2^(i-1), 2^i) мкс, последняя — всё, что длиннее. */
+    uint64_t generation_latency[KOLIBRI_PROFILE_LATENCY_BUCKETS];
 } KolibriPoolProfile;
 
+struct KolibriFitnessMemo;
+
+/* Вычисление когерентности лучей: гистограммы цифр по позициям с суммами
+ * cos/sin фаз (линейно по числу лучей) или прямой попарный проход. */
+typedef enum {
+    KOLIBRI_COHERENCE_HISTOGRAM = 0,
+    KOLIBRI_COHERENCE_PAIRWISE = 1,
+} KolibriCoherenceMode;
+
+/* Ёмкости пула, задаваемые при создании. */
+typedef struct {
+    size_t formulas;
+    size_t examples;
+    size_t associations;
+} KolibriPoolCapacity;
+
 typedef struct {
-    KolibriFormula formulas[24];
+    /* Горячие данные эволюции хранятся структурой массивов по слотам;
+     * сортируется только перестановка order (ранг -> слот). Все массивы
+     * лежат в одной арене arena, её хвост — scratch-область поколения. */
+    KolibriGene *genes;
+    double *fitness;
+    double *feedback;
+    double *invariant_drift_b;
+    double *invariant_drift_d;
+    double *phase;
+    uint32_t *order;
+    /* count * KOLIBRI_FORMULA_MAX_ASSOCIATIONS номеров ассоциаций. */
+    uint32_t *association_ids;
+    uint8_t *association_counts;
+    /* Оценка слота действительна, пока evaluated_version == dataset_version;
+     * памятка по дайджесту гена ловит одинаковых потомков разных слотов. */
+    double *base_score;
+    uint64_t *evaluated_version;
+    struct KolibriFitnessMemo *fitness_memo;
+    size_t fitness_memo_mask;
+    uint64_t dataset_version;
+    KolibriFormula best;
     size_t count;
     KolibriRng rng;
-    int inputs[64];
-    int targets[64];
+    int *inputs;
+    int *targets;
     size_t examples;
-    KolibriAssociation associations[KOLIBRI_POOL_MAX_ASSOCIATIONS];
+    size_t example_capacity;
+    /* Общее хранилище ассоциаций; при переполнении вытесняется самый старый
+     * слот association_head. */
+    KolibriAssociation *associations;
     size_t association_count;
+    size_t association_head;
+    size_t association_capacity;
+    /* input_hash -> слот и триграммы вопросов; ведёт kf_pool_add_association. */
+    struct KolibriAssociationIndex *association_index;
+    unsigned char *arena;
+    size_t arena_size;
+    size_t scratch_offset;
+    size_t scratch_size;
+    size_t scratch_used;
     double lambda_b;
     double lambda_d;
     double target_b;
@@ -65,12 +142,22 @@ typedef struct {
     int use_custom_target_b;
     int use_custom_target_d;
     double coherence_gain;
+    KolibriCoherenceMode coherence_mode;
     double temperature;
     size_t top_k;
+    /* Островной режим kf_pool_tick_parallel. */
+    size_t island_count;
+    size_t migration_interval;
+    size_t island_threads;
     KolibriPoolProfile profile;
 } KolibriFormulaPool;
 
-void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed);
+/* Пул ёмкостей по умолчанию. Повторная инициализация требует kf_pool_destroy. */
+int kf_pool_init(KolibriFormulaPool *pool, uint64_t seed);
+int kf_pool_init_with_capacity(KolibriFormulaPool *pool,
+                               const KolibriPoolCapacity *capacity,
+                               uint64_t seed);
+void kf_pool_destroy(KolibriFormulaPool *pool);
 void kf_pool_clear_examples(KolibriFormulaPool *pool);
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target);
 int kf_pool_add_association(KolibriFormulaPool *pool,
@@ -79,9 +166,33 @@ int kf_pool_add_association(KolibriFormulaPool *pool,
                             const char *answer,
                             const char *source,
                             uint64_t timestamp);
+/* Ассоциация с точно таким вопросом или NULL. */
+const KolibriAssociation *kf_pool_find_association(const KolibriFormulaPool *pool, const char *question);
+/* Самый длинный вопрос, содержащий запрос или содержащийся в нём без учёта
+ * регистра ASCII; кандидатов отбирает триграммный индекс. */
+const KolibriAssociation *kf_pool_match_association(const KolibriFormulaPool *pool, const char *question);
 void kf_pool_tick(KolibriFormulaPool *pool, size_t generations);
+/* Островная эволюция: island_count копий пула со своими ГСЧ эволюционируют
+ * параллельно и каждые migration_interval поколений передают элиту соседу по
+ * кольцу; лучшие формулы всех островов возвращаются в пул. */
+void kf_pool_tick_parallel(KolibriFormulaPool *pool, size_t generations);
+void kf_pool_set_islands(KolibriFormulaPool *pool,
+                         size_t island_count,
+                         size_t migration_interval,
+                         size_t threads);
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool);
+/* Копирует формулу ранга rank (0 — лучшая) в out. */
+int kf_pool_formula(const KolibriFormulaPool *pool, size_t rank, KolibriFormula *out);
+/* Заменяет худшую формулу пула импортированным геном. */
+int kf_pool_import(KolibriFormulaPool *pool, const KolibriFormula *formula);
 int kf_formula_apply(const KolibriFormula *formula, int input, int *output);
+/* Ошибка гена формулы на наборе примеров той же пакетной оценкой, что и при отборе:
+ * сумма |target - prediction| и, если prediction_sum не NULL, сумма предсказаний.
+ * Ассоциации формулы не учитываются. */
+int kf_formula_batch_error(const KolibriFormula *formula, const int *inputs, const int *targets,
+                           size_t count, int64_t *abs_error, int64_t *prediction_sum);
+/* Набор инструкций пакетной оценки в этой сборке: "avx2", "neon", "wasm-simd" или "scalar". */
+const char *kf_formula_batch_kernel(void);
 size_t kf_formula_digits(const KolibriFormula *formula, uint8_t *out, size_t out_len);
 int kf_formula_describe(const KolibriFormula *formula, char *buffer, size_t buffer_len);
 int kf_pool_feedback(KolibriFormulaPool *pool, const KolibriGene *gene, double delta);
@@ -91,8 +202,19 @@ int kf_hash_from_text(const char *text);
 void kf_pool_set_penalties(KolibriFormulaPool *pool, double lambda_b, double lambda_d);
 void kf_pool_set_targets(KolibriFormulaPool *pool, double target_b, double target_d);
 void kf_pool_set_coherence_gain(KolibriFormulaPool *pool, double gain);
+void kf_pool_set_coherence_mode(KolibriFormulaPool *pool, KolibriCoherenceMode mode);
 void kf_pool_set_sampling(KolibriFormulaPool *pool, double temperature, size_t top_k);
 const KolibriPoolProfile *kf_pool_profile(const KolibriFormulaPool *pool);
+/* Арена пула и индекс ассоциаций в байтах (без временных островов). */
+size_t kf_pool_memory_usage(const KolibriFormulaPool *pool);
+/* Версионированная двоичная контрольная точка: гены, оценки, состояние
+ * генератора, примеры, ассоциации и настройки отбора. Запись идёт во
+ * временный файл с переименованием. Загрузка инициализирует pool заново
+ * (как kf_pool_init): -1 — файл недоступен, -2 — неверный формат или
+ * версия, -3 — не сошлась контрольная сумма. */
+int kf_pool_save_checkpoint(const KolibriFormulaPool *pool, const char *path);
+int kf_pool_load_checkpoint(KolibriFormulaPool *pool, const char *path);
+const char *kf_pool_stage_name(KolibriPoolStage stage);
 
 
 #endif /* KOLIBRI_FORMULA_H */
@@ -15,6 +15,17 @@ extern "C" {
 #define KOLIBRI_BLOCK_SIZE                                                     \
   (sizeof(uint64_t) + sizeof(uint64_t) + KOLIBRI_HASH_SIZE +                   \
    KOLIBRI_HASH_SIZE + KOLIBRI_EVENT_TYPE_SIZE + KOLIBRI_PAYLOAD_SIZE)
+/* kg_append/kg_append_batch: блоки записаны и приняты в цепочку, но
+ * плановый fdatasync не прошёл. Повторять запись нельзя — будут дубли. */
+#define KOLIBRI_GENOME_SYNC_FAILED 1
+
+/* v1 — блоки фиксированной длины KOLIBRI_BLOCK_SIZE; v2 — кадры переменной
+ * длины со словарём типов и упакованными цифрами. Подписи и цепочка хэшей в
+ * обоих форматах считаются по каноническому блоку v1. */
+#define KOLIBRI_GENOME_FORMAT_V1 1
+#define KOLIBRI_GENOME_FORMAT_V2 2
+/* Сжимать кадры v2 через deflate (при сборке с zlib), если это выгодно. */
+#define KOLIBRI_GENOME_COMPRESS 0x1U
 
 typedef struct {
   uint64_t index;
@@ -25,24 +36,125 @@ typedef struct {
   char payload[KOLIBRI_PAYLOAD_SIZE];
 } ReasonBlock;
 
+/* Словарь типов событий v2: номер типа — порядок его первого появления. */
+typedef struct {
+  char (*names)[KOLIBRI_EVENT_TYPE_SIZE];
+  size_t count;
+  size_t capacity;
+} KolibriGenomeTypes;
+
+typedef struct {
+  int format;         /* формат нового файла; существующий сохраняет свой */
+  unsigned int flags; /* KOLIBRI_GENOME_COMPRESS */
+  /* > 0 — начинать новый сегмент <path>.N, когда текущий дорос до этого
+   * размера; 0 — один растущий файл. */
+  uint64_t segment_bytes;
+} KolibriGenomeOptions;
+
+/* Разреженный индекс сегмента (<сегмент>.idx): индекс и время блока →
+ * смещение, битовые карты типов событий по участкам. */
+struct kolibri_segment_index;
+
+/* Контекст HMAC OpenSSL (EVP_MAC_CTX) с уже раскрытым ключом генома. */
+struct evp_mac_ctx_st;
+
 typedef struct {
   FILE *file;
   unsigned char last_hash[KOLIBRI_HASH_SIZE];
   unsigned char last_block[KOLIBRI_BLOCK_SIZE];
   unsigned char hmac_key[KOLIBRI_HMAC_KEY_SIZE];
   size_t hmac_key_len;
+  struct evp_mac_ctx_st *hmac_ctx;
   char path[260];
   uint64_t next_index;
   int has_last_block;
+  uint64_t sync_interval_ns;
+  uint64_t last_sync_ns;
+  int format;
+  unsigned int flags;
+  uint64_t end_offset;
+  KolibriGenomeTypes types;
+  uint64_t segment_bytes;
+  uint32_t segment;
+  uint64_t segment_first;
 } KolibriGenome;
 
+typedef struct {
+  const char *event_type;
+  const char *payload;
+} KolibriGenomeEvent;
+
+/* Последовательное чтение блоков любого формата без проверки подписей;
+ * сегменты читаются подряд как одна цепочка. Поля — внутреннее состояние. */
+typedef struct {
+  char path[260];
+  uint32_t segment;
+  uint64_t segment_first;
+  struct kolibri_segment_index *index;
+  const unsigned char *data;
+  size_t size;
+  size_t offset;
+  int format;
+  uint64_t next_index;
+  KolibriGenomeTypes types;
+  unsigned char *body;
+  size_t body_capacity;
+  const unsigned char *records;
+  size_t records_len;
+  size_t record_pos;
+  uint64_t frame_left;
+  size_t frame_types;
+  uint64_t prev_timestamp;
+  unsigned char prev_hash[KOLIBRI_HASH_SIZE];
+} KolibriGenomeReader;
+
 int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
             size_t key_len);
+/* options == NULL равносильно kg_open: новый файл создаётся в формате v1. */
+int kg_open_with(KolibriGenome *ctx, const char *path, const unsigned char *key,
+                 size_t key_len, const KolibriGenomeOptions *options);
 void kg_close(KolibriGenome *ctx);
 int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload,
               ReasonBlock *out_block);
+/* Групповая запись: все блоки цепочки подписываются в памяти и уходят одним
+ * fwrite. Либо принимаются все события, либо ни одного; 0 или
+ * KOLIBRI_GENOME_SYNC_FAILED означают, что события приняты. */
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEvent *events,
+                    size_t count, ReasonBlock *out_blocks);
+/* interval_ms > 0 включает fdatasync не чаще одного раза за интервал. */
+void kg_set_sync_interval(KolibriGenome *ctx, uint64_t interval_ms);
+int kg_sync(KolibriGenome *ctx);
+/* Полная проверка цепочки через mmap по всем сегментам; threads == 0 выбирает
+ * число потоков автоматически. Возвращает 1, если файла нет. */
 int kg_verify_file(const char *path, const unsigned char *key,
                    size_t key_len);
+int kg_verify_file_threads(const char *path, const unsigned char *key,
+                           size_t key_len, size_t threads);
+/* Сохраняет контрольную точку <path>.ckpt, чтобы kg_open проверял только
+ * хвост генома. Вызывается автоматически из kg_open и kg_close. */
+int kg_write_checkpoint(KolibriGenome *ctx);
+/* Переписывает проверенный геном src в dst в формате options; блоки,
+ * подписи и хэши цепочки остаются прежними. */
+int kg_convert_file(const char *src, const char *dst, const unsigned char *key,
+                    size_t key_len, const KolibriGenomeOptions *options);
+/* Возвращает 1, если файла нет. Недописанный хвост считается концом. */
+int kg_reader_open(KolibriGenomeReader *reader, const char *path);
+/* Следующий kg_reader_next вернёт блок index. */
+int kg_reader_seek(KolibriGenomeReader *reader, uint64_t index);
+/* Следующий kg_reader_next вернёт первый блок с timestamp >= timestamp;
+ * сегменты и участки, целиком лежащие раньше, не читаются. */
+int kg_reader_seek_time(KolibriGenomeReader *reader, uint64_t timestamp);
+/* 1 — блок прочитан, 0 — блоки кончились, -1 — файл повреждён. */
+int kg_reader_next(KolibriGenomeReader *reader, ReasonBlock *block);
+/* Как kg_reader_next, но только блоки с типом события event_type; участки
+ * без таких событий пропускаются по индексу. */
+int kg_reader_next_type(KolibriGenomeReader *reader, const char *event_type,
+                        ReasonBlock *block);
+void kg_reader_close(KolibriGenomeReader *reader);
+/* Читает до count блоков начиная с first; *out_count — сколько прочитано.
+ * Возвращает 1, если генома нет. */
+int kg_read_range(const char *path, uint64_t first, size_t count,
+                  ReasonBlock *out, size_t *out_count);
 int kg_encode_payload(const char *utf8, char *out, size_t out_len);
 
 #ifdef __cplusplus
@@ -11,14 +11,19 @@ typedef struct {
     char *source;
 } KolibriKnowledgeDocument;
 
+/* Словарь слов документов со сжатыми битовыми картами вхождений. */
+typedef struct KolibriKnowledgeTermIndex KolibriKnowledgeTermIndex;
+
 typedef struct {
     KolibriKnowledgeDocument *documents;
     size_t count;
     size_t capacity;
+    KolibriKnowledgeTermIndex *terms; /* NULL — поиск полным просмотром */
 } KolibriKnowledgeIndex;
 
 int kolibri_knowledge_index_init(KolibriKnowledgeIndex *index);
 void kolibri_knowledge_index_free(KolibriKnowledgeIndex *index);
+/* После загрузки перестраивает словарь terms по всем документам индекса. */
 int kolibri_knowledge_index_load_directory(KolibriKnowledgeIndex *index, const char *root_path);
 size_t kolibri_knowledge_search(const KolibriKnowledgeIndex *index,
                                 const char *query,
@@ -18,6 +18,9 @@ typedef struct {
     float weight;
 } KolibriKnowledgeVectorItem;
 
+/* Длина превью содержимого для журнала генома (без многоточия). */
+#define KOLIBRI_KNOWLEDGE_PREVIEW_BYTES 200U
+
 typedef struct {
     const char *id;
     const char *title;
@@ -26,6 +29,13 @@ typedef struct {
     const KolibriKnowledgeVectorItem *vector;
     size_t vector_size;
     float norm;
+    /* Строятся один раз при сборке или загрузке: уже экранированный фрагмент
+     * "id":…,"title":…,"content":…,"source":… для ответа поиска и превью
+     * content, обрезанное до KOLIBRI_KNOWLEDGE_PREVIEW_BYTES с "...". */
+    const char *json;
+    size_t json_length;
+    const char *preview;
+    size_t preview_length;
 } KolibriKnowledgeDoc;
 
 typedef struct {
@@ -38,6 +48,14 @@ int kolibri_knowledge_index_create(const char *const *roots,
                                    size_t max_length,
                                    KolibriKnowledgeIndex **out_index);
 
+/* Разбирает файлы пулом потоков; threads == 0 выбирает число потоков
+ * автоматически. Результат совпадает с последовательной сборкой. */
+int kolibri_knowledge_index_create_threads(const char *const *roots,
+                                           size_t root_count,
+                                           size_t max_length,
+                                           size_t threads,
+                                           KolibriKnowledgeIndex **out_index);
+
 void kolibri_knowledge_index_destroy(KolibriKnowledgeIndex *index);
 
 size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index);
@@ -57,12 +75,64 @@ int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
                                    float *out_scores,
                                    size_t *out_result_count);
 
+/* Флаги kolibri_knowledge_index_search_flags. */
+#define KOLIBRI_KNOWLEDGE_SEARCH_PRUNE 0x1U /* MaxScore: пропуск документов ниже порога top-k */
+#define KOLIBRI_KNOWLEDGE_SEARCH_PREFIX 0x2U /* терм дополняется токенами словаря с тем же началом */
+#define KOLIBRI_KNOWLEDGE_SEARCH_FUZZY 0x4U /* незнакомый терм заменяется близкими по правке токенами */
+#define KOLIBRI_KNOWLEDGE_SEARCH_APPROX 0x8U /* оценки по int8-весам постингов без точного переранжирования */
+
+int kolibri_knowledge_index_search_flags(const KolibriKnowledgeIndex *index,
+                                         const char *query,
+                                         size_t limit,
+                                         unsigned flags,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_count);
+
+/* Инкрементальное обновление: документ попадает в живой сегмент и сразу
+ * участвует в поиске; kolibri_knowledge_index_merge переносит сегмент в
+ * постинги и пересчитывает IDF. Веса ранее проиндексированных документов
+ * не пересчитываются до полной перестройки. Все функции индекса
+ * потокобезопасны, указатели на документы живут до destroy. */
+int kolibri_knowledge_index_add_document(KolibriKnowledgeIndex *index,
+                                         const char *id,
+                                         const char *title,
+                                         const char *source,
+                                         const char *content,
+                                         size_t *out_doc_index);
+
+size_t kolibri_knowledge_index_pending_count(const KolibriKnowledgeIndex *index);
+
+/* Возвращает число документов, перенесённых из живого сегмента. */
+size_t kolibri_knowledge_index_merge(KolibriKnowledgeIndex *index);
+
+/* Копия документов шарда shard из shard_count (по хешу id) с полным словарём
+ * исходного индекса: df и idf остаются глобальными, поэтому оценки разных
+ * шардов сравнимы и фронт может сливать их top-k. Слияние живого сегмента в
+ * самом шарде пересчитает idf по его документам. */
+int kolibri_knowledge_index_partition(const KolibriKnowledgeIndex *index,
+                                      size_t shard,
+                                      size_t shard_count,
+                                      KolibriKnowledgeIndex **out_shard);
+
+/* Оценка памяти индекса: байты в куче и, через out_mapped_bytes, размер
+ * отображения index.bin (может быть NULL). */
+size_t kolibri_knowledge_index_memory_usage(const KolibriKnowledgeIndex *index, size_t *out_mapped_bytes);
+
 int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
                                        const char *output_dir);
 
 int kolibri_knowledge_index_load_json(const char *input_dir,
                                       KolibriKnowledgeIndex **out_index);
 
+/* Двоичный снимок <dir>/index.bin. Загруженный индекс отображает файл в память
+ * и читает строки, векторы и постинги прямо из него, без разбора. */
+int kolibri_knowledge_index_write_binary(const KolibriKnowledgeIndex *index,
+                                         const char *output_dir);
+
+int kolibri_knowledge_index_load_binary(const char *input_dir,
+                                        KolibriKnowledgeIndex **out_index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,24 @@ typedef struct {
     char *moderated_at;
 } KolibriQueueRecord;
 
+typedef struct {
+    const char *title;
+    const char *content;
+    const char *source;
+    const char *metadata_json;
+} KolibriQueueSubmission;
+
+typedef struct {
+    long long submission_id;
+    KolibriQueueStatus status;
+    const char *moderator;
+    const char *note;
+} KolibriQueueModeration;
+
+/* Строки записи указывают во внутренний буфер SQLite и действительны только
+ * внутри вызова. Ненулевой результат останавливает обход. */
+typedef int (*KolibriQueueVisitor)(const KolibriQueueRecord *record, void *user_data);
+
 int kolibri_queue_open(const char *database_path, KolibriQueue **out_queue);
 
 void kolibri_queue_close(KolibriQueue *queue);
@@ -43,12 +61,30 @@ int kolibri_queue_enqueue(KolibriQueue *queue,
                           const char *metadata_json,
                           long long *out_submission_id);
 
+/* Пакетные операции выполняются одной транзакцией: ошибка откатывает весь пакет.
+ * out_submission_ids (может быть NULL) получает count идентификаторов. */
+int kolibri_queue_enqueue_many(KolibriQueue *queue,
+                               const KolibriQueueSubmission *items,
+                               size_t count,
+                               long long *out_submission_ids);
+
 int kolibri_queue_fetch(KolibriQueue *queue,
                         KolibriQueueStatus status,
                         size_t limit,
                         KolibriQueueRecord **out_records,
                         size_t *out_count);
 
+/* Потоковый обход заявок с id > after_id в порядке id, не более limit строк
+ * (0 — без ограничения). out_last_id получает id последней строки — курсор
+ * для следующей страницы. Обход не реентерабелен для одной очереди. */
+int kolibri_queue_scan(KolibriQueue *queue,
+                       KolibriQueueStatus status,
+                       long long after_id,
+                       size_t limit,
+                       KolibriQueueVisitor visitor,
+                       void *user_data,
+                       long long *out_last_id);
+
 void kolibri_queue_free_records(KolibriQueueRecord *records, size_t count);
 
 int kolibri_queue_moderate(KolibriQueue *queue,
@@ -57,11 +93,25 @@ int kolibri_queue_moderate(KolibriQueue *queue,
                            const char *moderator,
                            const char *note);
 
+/* Отсутствующие id пропускаются; out_updated — число обновлённых заявок. */
+int kolibri_queue_moderate_many(KolibriQueue *queue,
+                                const KolibriQueueModeration *items,
+                                size_t count,
+                                size_t *out_updated);
+
 int kolibri_queue_export_markdown(KolibriQueue *queue,
                                   KolibriQueueStatus status,
                                   const char *destination_dir,
                                   size_t *out_exported);
 
+/* Дописывает только заявки, изменённые после прошлого экспорта в destination_dir
+ * (отметка хранится там же в .kolibri_export_<status>). Файлы отозванных заявок
+ * удаляет только полный экспорт. */
+int kolibri_queue_export_markdown_incremental(KolibriQueue *queue,
+                                              KolibriQueueStatus status,
+                                              const char *destination_dir,
+                                              size_t *out_exported);
+
 const char *kolibri_queue_status_to_string(KolibriQueueStatus status);
 
 int kolibri_queue_status_from_string(const char *text, KolibriQueueStatus *out_status);
@@ -0,0 +1,74 @@
+#ifndef KOLIBRI_MEMORY_H
+#define KOLIBRI_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Учёт памяти по подсистемам ядра. Индекс знаний, KOLIBRI-Σ, пул формул и
+ * KolibriScript выделяют память через kolibri_memory_*; каждый блок несёт
+ * заголовок с размером и подсистемой, поэтому счётчики точны и освобождать
+ * блок можно из любой подсистемы. */
+
+typedef enum {
+    KOLIBRI_MEMORY_KNOWLEDGE_INDEX = 0,
+    KOLIBRI_MEMORY_SIGMA,
+    KOLIBRI_MEMORY_FORMULA,
+    KOLIBRI_MEMORY_SCRIPT,
+    KOLIBRI_MEMORY_SUBSYSTEM_COUNT
+} KolibriMemorySubsystem;
+
+typedef struct {
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    uint64_t live_allocations;
+    uint64_t total_allocations;
+    uint64_t failed_allocations;
+} KolibriMemoryStats;
+
+/* Подключаемый распределитель; функции получают user_data первым аргументом
+ * и обязаны вести себя как malloc/realloc/free. */
+typedef struct {
+    void *(*malloc_fn)(void *user_data, size_t size);
+    void *(*realloc_fn)(void *user_data, void *ptr, size_t size);
+    void (*free_fn)(void *user_data, void *ptr);
+    void *user_data;
+} KolibriAllocator;
+
+/* Меняет распределитель; NULL возвращает malloc/realloc/free. Допустимо,
+ * только пока нет живых блоков, иначе возвращает -1. */
+int kolibri_memory_set_allocator(const KolibriAllocator *allocator);
+
+void *kolibri_memory_alloc(KolibriMemorySubsystem subsystem, size_t size);
+void *kolibri_memory_calloc(KolibriMemorySubsystem subsystem, size_t count, size_t size);
+void *kolibri_memory_realloc(KolibriMemorySubsystem subsystem, void *ptr, size_t size);
+char *kolibri_memory_strdup(KolibriMemorySubsystem subsystem, const char *text);
+void kolibri_memory_free(void *ptr);
+
+int kolibri_memory_stats(KolibriMemorySubsystem subsystem, KolibriMemoryStats *out);
+const char *kolibri_memory_subsystem_name(KolibriMemorySubsystem subsystem);
+
+/* Исходник подсистемы определяет KOLIBRI_MEMORY_SUBSYSTEM перед включением
+ * этого заголовка (после системных): malloc/calloc/realloc/strdup/free
+ * файла уходят в учёт. */
+#ifdef KOLIBRI_MEMORY_SUBSYSTEM
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef free
+#define malloc(size) kolibri_memory_alloc(KOLIBRI_MEMORY_SUBSYSTEM, (size))
+#define calloc(count, size) kolibri_memory_calloc(KOLIBRI_MEMORY_SUBSYSTEM, (count), (size))
+#define realloc(ptr, size) kolibri_memory_realloc(KOLIBRI_MEMORY_SUBSYSTEM, (ptr), (size))
+#define strdup(text) kolibri_memory_strdup(KOLIBRI_MEMORY_SUBSYSTEM, (text))
+#define free(ptr) kolibri_memory_free(ptr)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KOLIBRI_MEMORY_H */
@@ -45,13 +45,66 @@ int kn_message_decode(const uint8_t *buffer, size_t buffer_len, KolibriNetMessag
 
 int kn_share_formula(const char *host, uint16_t port, uint32_t node_id, const KolibriFormula *formula);
 
+/* Пул исходящих соединений: сокет к узлу живёт между рассылками, HELLO
+ * уходит один раз на соединение, а накопленные сообщения — одной записью.
+ * Разорванное соединение переоткрывается при следующей отправке. */
+#define KN_CLIENT_BATCH_BYTES 2048U
+
+typedef struct {
+    char host[64];
+    uint16_t port;
+    int socket_fd;
+    size_t pending_len;
+    uint8_t pending[KN_CLIENT_BATCH_BYTES];
+} KolibriNetPeer;
+
+typedef struct {
+    uint32_t node_id;
+    KolibriNetPeer *peers;
+    size_t count;
+    size_t capacity;
+} KolibriNetClient;
+
+void kn_client_init(KolibriNetClient *client, uint32_t node_id);
+/* Ставит формулу в очередь узла; полная очередь сначала отправляется. */
+int kn_client_queue_formula(KolibriNetClient *client, const char *host, uint16_t port,
+                            const KolibriFormula *formula);
+/* Отправляет очереди всех узлов; возвращает число узлов с ошибкой, их
+ * очереди сбрасываются. */
+int kn_client_flush(KolibriNetClient *client);
+/* Отправляет очередь одного узла: 0 — по живому соединению, 1 — по новому
+ * (получатель мог потерять прежнее состояние), -1 — ошибка. */
+int kn_client_flush_peer(KolibriNetClient *client, const char *host, uint16_t port);
+int kn_client_share_formula(KolibriNetClient *client, const char *host, uint16_t port,
+                            const KolibriFormula *formula);
+void kn_client_close(KolibriNetClient *client);
+
+typedef struct KolibriNetConnection KolibriNetConnection;
+
+/* Слушатель держит постоянные соединения узлов (epoll на Linux, poll в
+ * остальных системах) и разбирает все целые кадры, пришедшие по каждому
+ * событию готовности, в очередь готовых сообщений. */
 typedef struct {
     int socket_fd;
     uint16_t port;
+    int event_fd;
+    KolibriNetConnection **connections;
+    size_t connection_count;
+    size_t connection_capacity;
+    KolibriNetMessage *ready;
+    size_t ready_head;
+    size_t ready_count;
+    size_t ready_capacity;
 } KolibriNetListener;
 
 int kn_listener_start(KolibriNetListener *listener, uint16_t port);
 int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms, KolibriNetMessage *out_message);
+/* Ждёт до timeout_ms первого сообщения и отдаёт до max готовых; возвращает
+ * их число. */
+int kn_listener_poll_batch(KolibriNetListener *listener, uint32_t timeout_ms,
+                           KolibriNetMessage *out_messages, size_t max);
+/* Дескриптор, читаемый при событиях слушателя, для внешнего select/poll. */
+int kn_listener_fd(const KolibriNetListener *listener);
 void kn_listener_close(KolibriNetListener *listener);
 
 #ifdef __cplusplus
@@ -0,0 +1,48 @@
+#ifndef KOLIBRI_RATE_LIMIT_H
+#define KOLIBRI_RATE_LIMIT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Ведро на KOLIBRI_RATE_LIMIT_BURST запросов клиента, которое пополняется
+ * равномерно за KOLIBRI_RATE_LIMIT_WINDOW секунд. */
+#define KOLIBRI_RATE_LIMIT_WINDOW 60
+#define KOLIBRI_RATE_LIMIT_BURST 30
+#define KOLIBRI_RATE_SHARDS 16
+#define KOLIBRI_RATE_SHARD_SLOTS 64
+#define KOLIBRI_RATE_PROBE 8
+
+/* Ведро токенов клиента в форме GCRA: вместо счётчика и времени пополнения хранится
+ * одно «теоретическое время прибытия» в наносекундах, поэтому проверка и списание —
+ * один CAS. tat <= now означает полное ведро. */
+typedef struct {
+    atomic_uint_least64_t key;
+    atomic_uint_least64_t tat;
+} KolibriRateSlot;
+
+/* Клиент ищется в пределах KOLIBRI_RATE_PROBE слотов своего шарда; когда все они
+ * заняты клиентами с неполными вёдрами, он делит ведро overflow с такими же. */
+typedef struct {
+    _Alignas(64) KolibriRateSlot slots[KOLIBRI_RATE_SHARD_SLOTS];
+    KolibriRateSlot overflow;
+} KolibriRateShard;
+
+/* Нулевая инициализация даёт пустой ограничитель. */
+typedef struct {
+    KolibriRateShard shards[KOLIBRI_RATE_SHARDS];
+} KolibriRateLimiter;
+
+/* 1 — запрос пропущен; 0 — отказ, и *retry_after_ns (если не NULL) получает
+ * время до следующего пропускаемого запроса. Потокобезопасна без блокировок. */
+int kolibri_rate_limit_allow(KolibriRateLimiter *limiter, uint32_t client, uint64_t now_ns,
+                             uint64_t *retry_after_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
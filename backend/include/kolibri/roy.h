@@ -14,8 +14,14 @@ extern "C" {
 #endif
 
 #define KOLIBRI_ROY_MAGIC "KSP1"
+/* Верхняя граница активного вида; желаемый размер — log2(N) + 1. */
 #define KOLIBRI_ROY_MAX_SOSSEDI 64U
-#define KOLIBRI_ROY_MAX_OCHERED 32U
+/* Сколько узлов роя помнится всего: активный и пассивный вид. */
+#define KOLIBRI_ROY_MAX_IZVESTNYH 4096U
+/* Сколько раз формула из kolibri_roy_otpravit_vsem пересылается дальше. */
+#define KOLIBRI_ROY_TTL 8U
+/* Размер кольца событий по умолчанию; округляется до степени двойки. */
+#define KOLIBRI_ROY_MAX_OCHERED 256U
 #define KOLIBRI_ROY_HMAC_SIZE 32U
 #define KOLIBRI_ROY_PRIVET_INTERVAL 5U
 #define KOLIBRI_ROY_SROK_GODA 30U
@@ -33,29 +39,38 @@ typedef enum {
     KOLIBRI_ROY_SOBYTIE_FORMULA = 2
 } KolibriRoySobytieTip;
 
+/* Событие несёт только ген и приспособленность: ассоциаций по сети нет. */
 typedef struct {
     KolibriRoySobytieTip tip;
     uint32_t identifikator;
     struct sockaddr_in adres;
-    KolibriFormula formula;
+    KolibriGene gene;
+    double fitness;
 } KolibriRoySobytie;
 
+/* Кольцо событий без блокировок: пишет только поток роя, читает один
+ * потребитель. */
+typedef struct KolibriRoyOchered KolibriRoyOchered;
+
+/* Частичный вид роя: хэш-индексированная таблица известных узлов, из
+ * которой O(log N) активных получают формулы и пульс (HyParView). */
+typedef struct KolibriRoyVid KolibriRoyVid;
+
+/* Заранее раскрытые контексты HMAC для подписи и проверки пакетов. */
+typedef struct KolibriRoyPodpis KolibriRoyPodpis;
+
 typedef struct {
     uint32_t sobstvennyj_id;
     uint16_t port;
     int soket;
     unsigned char klyuch[KOLIBRI_ROY_HMAC_SIZE];
     size_t dlina_klyucha;
+    KolibriRoyPodpis *podpis;
     pthread_t potok;
     int zapushchen;
     pthread_mutex_t zamek;
-    KolibriRoySosed sosedi[KOLIBRI_ROY_MAX_SOSSEDI];
-    size_t chislo_sosedey;
-    pthread_mutex_t ochered_zamek;
-    KolibriRoySobytie ochered[KOLIBRI_ROY_MAX_OCHERED];
-    size_t ochered_golova;
-    size_t ochered_hvost;
-    size_t ochered_schetchik;
+    KolibriRoyVid *vid;
+    KolibriRoyOchered *ochered;
     time_t poslednij_privet;
 } KolibriRoy;
 
@@ -63,16 +78,40 @@ typedef struct {
 int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
         const unsigned char *klyuch, size_t dlina_klyucha);
 
+/* То же с явным размером кольца событий (0 — KOLIBRI_ROY_MAX_OCHERED). */
+int kolibri_roy_zapustit_s_ocheredyu(KolibriRoy *roy, uint32_t identifikator,
+        uint16_t port, const unsigned char *klyuch, size_t dlina_klyucha,
+        size_t razmer_ocheredi);
+
 /* Останавливает потоки и закрывает сокеты роя. */
 void kolibri_roy_ostanovit(KolibriRoy *roy);
 
-/* Возвращает очередное событие роя, если оно присутствует. */
+/* Возвращает очередное событие роя, если оно присутствует. Читать события
+ * должен один поток. */
 int kolibri_roy_poluchit_sobytie(KolibriRoy *roy, KolibriRoySobytie *sobytie);
 
-/* Возвращает копию списка соседей в предоставленный буфер. */
+/* Забирает до maksimalno событий за раз; возвращает их число. */
+size_t kolibri_roy_poluchit_sobytiya(KolibriRoy *roy, KolibriRoySobytie *naznachenie,
+        size_t maksimalno);
+
+/* Число событий, отброшенных из-за переполненного кольца. */
+uint64_t kolibri_roy_poteryano_sobytiy(const KolibriRoy *roy);
+
+/* Проверяет HMAC пачки датаграмм (подпись в последних KOLIBRI_ROY_HMAC_SIZE
+ * байтах) одним захватом контекста. verno[i] получает 1 для подлинных
+ * пакетов; возвращается их число. */
+size_t kolibri_roy_proverit_pakety(KolibriRoy *roy, const uint8_t *const *pakety,
+        const size_t *dliny, size_t chislo, uint8_t *verno);
+
+/* Возвращает копию списка известных узлов в предоставленный буфер:
+ * сначала активный вид, затем пассивный. */
 size_t kolibri_roy_spisok_sosedey(KolibriRoy *roy, KolibriRoySosed *naznachenie,
         size_t maksimalno);
 
+/* Размер активного вида; passivnyh (если не NULL) получает размер
+ * пассивного. */
+size_t kolibri_roy_razmer_vida(KolibriRoy *roy, size_t *passivnyh);
+
 /* Отправляет широковещательное приветствие в сеть. */
 int kolibri_roy_otpravit_privet(KolibriRoy *roy);
 
@@ -80,11 +119,13 @@ int kolibri_roy_otpravit_privet(KolibriRoy *roy);
 int kolibri_roy_dobavit_soseda(KolibriRoy *roy, const struct sockaddr_in *adres,
         uint32_t identifikator);
 
-/* Отправляет формулу случайному соседу, используя внешнее случайное число. */
+/* Отправляет формулу случайному активному соседу, используя внешнее
+ * случайное число. */
 int kolibri_roy_otpravit_sluchajnomu(KolibriRoy *roy, uint64_t sluchajnoe,
         const KolibriFormula *formula);
 
-/* Рассылает формулу всем соседям и широковещательно. */
+/* Рассылает формулу активному виду и широковещательно; получатели
+ * пересылают её своим активным соседям, пока не исчерпан KOLIBRI_ROY_TTL. */
 int kolibri_roy_otpravit_vsem(KolibriRoy *roy, const KolibriFormula *formula);
 
 #ifdef __cplusplus
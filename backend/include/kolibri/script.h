@@ -22,6 +22,7 @@ extern "C" {
 struct KolibriScriptVariable;
 struct KolibriScriptAssociation;
 struct KolibriScriptFormulaBinding;
+struct KolibriBytecode;
 
 typedef struct {
     double lambda_b;
@@ -33,16 +34,30 @@ typedef struct {
     int cf_beam;
 } KolibriScriptControls;
 
+/* Приёмник вывода: получает каждый готовый фрагмент текста без FILE. */
+typedef void (*KolibriScriptSink)(void *user_data, const char *text, size_t length);
+
+/* Буфер вызывающего для ks_buffer_sink: лишний текст отбрасывается
+ * и учитывается в dropped, data всегда завершается нулём. */
+typedef struct {
+    char *data;
+    size_t capacity;
+    size_t length;
+    size_t dropped;
+} KolibriScriptBuffer;
+
 typedef struct {
     KolibriFormulaPool *pool;
     KolibriGenome *genome;
     FILE *vyvod;
+    KolibriScriptSink sink;
+    void *sink_data;
     char *source_text;
     KolibriSymbolTable symbol_table;
     char mode[32];
     KolibriScriptControls controls;
 
-    /* Runtime state */
+    /* Runtime state; переменные и формулы индексируются слотами байткода */
     struct KolibriScriptVariable *variables;
     size_t variables_count;
     size_t variables_capacity;
@@ -54,6 +69,11 @@ typedef struct {
     struct KolibriScriptFormulaBinding *formulas;
     size_t formulas_count;
     size_t formulas_capacity;
+
+    /* Байткод последнего ks_compile; сбрасывается при загрузке текста. */
+    struct KolibriBytecode *bytecode;
+    /* Арена лексера и парсера; живёт до ks_free и переиспользуется. */
+    struct KolibriScriptArena *arena;
 } KolibriScript;
 
 /* Инициализирует интерпретатор и выделяет внутренний цифровой буфер. */
@@ -66,17 +86,40 @@ void ks_free(KolibriScript *skript);
 /* Переназначает поток вывода интерпретатора (по умолчанию stdout). */
 void ks_set_output(KolibriScript *skript, FILE *vyvod);
 
+/* Направляет вывод в приёмник вместо потока; NULL возвращает вывод в vyvod. */
+void ks_set_sink(KolibriScript *skript, KolibriScriptSink sink, void *user_data);
+
+/* Готовый приёмник, дописывающий текст в KolibriScriptBuffer. */
+void ks_buffer_sink(void *user_data, const char *text, size_t length);
+
 /* Загружает русскоязычный сценарий из текстовой строки. */
 int ks_load_text(KolibriScript *skript, const char *text);
 
-/* Загружает сценарий из файла на диске. */
+/* Загружает сценарий из файла на диске: текст .ks или образ байткода .ksc.
+ * Для текста подхватывает соседний .ksc, если он собран из того же текста. */
 int ks_load_file(KolibriScript *skript, const char *path);
 
+/* Компилирует загруженный сценарий в байткод со слотами переменных.
+ * ks_execute вызывает её сам, если байткод ещё не построен. */
+int ks_compile(KolibriScript *skript);
+
+/* Записывает образ байткода (формат .ksc), при необходимости компилируя. */
+int ks_save_compiled(KolibriScript *skript, FILE *out);
+
 /* Выполняет сценарий, возвращает 0 при успехе. */
 int ks_execute(KolibriScript *skript);
 
+/* Читает сценарий из потока и выполняет его по одной команде верхнего
+ * уровня, не держа весь текст в памяти. Загруженный текст не меняется;
+ * associations хранит только связи последней команды. */
+int ks_execute_stream(KolibriScript *skript, FILE *vhod);
+
 int ks_set_controls(KolibriScript *skript, const KolibriScriptControls *controls);
 
+/* Байты кучи сценария: текст, переменные, связи, формулы, байткод (общий
+ * с кэшем учитывается целиком) и арена компиляции. */
+size_t ks_memory_usage(const KolibriScript *skript);
+
 #ifdef __cplusplus
 }
 #endif
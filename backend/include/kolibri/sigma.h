@@ -23,16 +23,48 @@ int k_decode(uintptr_t state,
              int temp_q8,
              int topk);
 
+/* Пакет запросов декодирования одного состояния под одной блокировкой;
+ * result получает то же, что вернул бы k_decode. */
+typedef struct {
+    const uint8_t *in;
+    size_t         n;
+    uint8_t       *out;
+    size_t         cap;
+    int            temp_q8;
+    int            topk;
+    int            result;
+} KSigmaDecodeRequest;
+
+/* Возвращает число запросов с ошибкой. */
+int k_decode_many(uintptr_t state, KSigmaDecodeRequest *requests, size_t count);
+
 int k_digit_add_syll(uintptr_t state, uint8_t digit, const uint8_t *u8, uint16_t len);
 
 int k_state_save(uintptr_t state, uint8_t *out, size_t cap);
 int k_state_load(uintptr_t state, const uint8_t *in, size_t n);
 
+/* Подключает снимок v2 без копирования: буфер (выровненный на 4 байта)
+ * должен жить, пока состояние его использует. Разряд копирует свои данные
+ * при первом k_observe/k_digit_add_syll, сам буфер не изменяется. */
+int k_state_map(uintptr_t state, const uint8_t *in, size_t n);
+/* То же для файла: снимок отображается в память только для чтения и
+ * освобождается вместе с состоянием или при следующей загрузке. */
+int k_state_map_file(uintptr_t state, const char *path);
+/* Оценка кучи состояния по ёмкостям массивов; отображённый снимок
+ * возвращается отдельно в out_mapped_bytes. */
+size_t k_state_memory_usage(uintptr_t state, size_t *out_mapped_bytes);
+
 int k_profile(uintptr_t state, uint32_t what, uint8_t *out, size_t cap);
 
+/* Умолчания процесса: действуют на состояния без собственных настроек. */
 int k_set_constraints(float breadth, float depth);
 int k_vote_mode(int mode);
 
+/* Собственные ограничения и режим состояния; снимок сохраняет их. Состояние
+ * потокобезопасно: k_decode параллелен, запись его исключает. */
+int k_state_set_constraints(uintptr_t state, float breadth, float depth);
+int k_state_vote_mode(uintptr_t state, int mode);
+
 #ifdef __cplusplus
 }
 #endif
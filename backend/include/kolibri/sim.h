@@ -20,6 +20,9 @@ typedef struct {
     const char *trace_path;
     int trace_include_genome;
     const char *genome_path;
+    /* Контрольная точка пула: если файл читается, пул поднимается из него
+     * вместо засева по seed. */
+    const char *pool_checkpoint_path;
 } KolibriSimConfig;
 
 typedef struct {
@@ -43,11 +46,26 @@ typedef struct {
     const char *result_hash;
 } KolibriSimGenomeBlock;
 
+/* Параметры отбора пула; kolibri_sim_reset возвращает значения по умолчанию. */
+typedef struct {
+    double lambda_b;
+    double lambda_d;
+    double temperature;
+    size_t top_k;
+} KolibriSimPoolParams;
+
 KolibriSim *kolibri_sim_create(const KolibriSimConfig *config);
 void kolibri_sim_destroy(KolibriSim *sim);
 
+int kolibri_sim_configure_pool(KolibriSim *sim, const KolibriSimPoolParams *params);
+
 int kolibri_sim_tick(KolibriSim *sim);
 
+/* Выполняет ticks тиков подряд; лучшая формула журналируется каждые
+ * log_every тиков (0 — только после последнего). */
+int kolibri_sim_tick_n(KolibriSim *sim, size_t ticks, size_t log_every);
+
+/* Строки журнала принадлежат симуляции и живут до следующего тика или сброса. */
 int kolibri_sim_get_logs(KolibriSim *sim,
                          KolibriSimLog *buffer,
                          size_t capacity,
@@ -66,6 +84,9 @@ int kolibri_sim_get_genome(KolibriSim *sim,
 
 int kolibri_sim_reset(KolibriSim *sim, const KolibriSimConfig *config);
 
+/* Сохраняет пул в контрольную точку; path == NULL — путь из конфигурации. */
+int kolibri_sim_save_pool(KolibriSim *sim, const char *path);
+
 #ifdef __cplusplus
 }
 #endif
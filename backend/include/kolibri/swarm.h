@@ -1,6 +1,7 @@
 #ifndef KOLIBRI_SWARM_H
 #define KOLIBRI_SWARM_H
 
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
@@ -12,6 +13,8 @@ extern "C" {
 #define KOLIBRI_SWARM_DIGITS 10
 #define KOLIBRI_SWARM_ID_MAX 96
 #define KOLIBRI_SWARM_ENDPOINT_MAX 192
+/* Сколько лидеров по базовой оценке переоцениваются с учётом исследования. */
+#define KOLIBRI_SWARM_TOP_K 8
 
 typedef struct {
     char id[KOLIBRI_SWARM_ID_MAX];
@@ -20,6 +23,9 @@ typedef struct {
     double signature[KOLIBRI_SWARM_DIGITS];
     time_t last_activity;
     uint64_t exchange_count;
+    /* Базовая оценка 0.55·согласие + 0.25·энергия, поддерживается
+     * при каждом обновлении узла или собственной сигнатуры. */
+    double score;
 } KolibriSwarmNode;
 
 typedef struct {
@@ -31,6 +37,14 @@ typedef struct {
     KolibriSwarmNode *nodes;
     size_t node_count;
     size_t node_capacity;
+    /* Хэш-индекс по id (позиция + 1) и пирамида узлов по score. */
+    uint32_t *index;
+    size_t index_mask;
+    size_t *heap;
+    size_t *heap_slot;
+    /* Писатели (add/record) берут замок на запись; выбор и статус — на
+     * чтение и друг друга не блокируют. */
+    pthread_rwlock_t lock;
 } KolibriSwarm;
 
 int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_capacity);
@@ -38,6 +52,8 @@ void kolibri_swarm_free(KolibriSwarm *swarm);
 int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char *endpoint);
 void kolibri_swarm_record_local_activity(KolibriSwarm *swarm, const char *stimulus, double impact);
 void kolibri_swarm_record_peer_activity(KolibriSwarm *swarm, const char *node_id, double impact, const char *stimulus);
+/* Берёт KOLIBRI_SWARM_TOP_K лидеров пирамиды и выбирает среди них с учётом
+ * фрактального исследования и давности: O(K log K) вместо обхода всех. */
 const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, double exploration_bias);
 int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size);
 
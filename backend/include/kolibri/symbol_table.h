@@ -12,14 +12,21 @@ extern "C" {
 
 #define KOLIBRI_SYMBOL_MAX 256
 #define KOLIBRI_SYMBOL_DIGITS 3
+#define KOLIBRI_SYMBOL_ASCII 128
+#define KOLIBRI_SYMBOL_HASH_SIZE 512
+#define KOLIBRI_SYMBOL_CODES 1000
 
 typedef struct {
     uint32_t codepoint;
     uint8_t digits[KOLIBRI_SYMBOL_DIGITS];
 } KolibriSymbolEntry;
 
+/* Индексы хранят номер записи + 1, ноль означает «нет записи». */
 typedef struct {
     KolibriSymbolEntry entries[KOLIBRI_SYMBOL_MAX];
+    uint16_t ascii_index[KOLIBRI_SYMBOL_ASCII];
+    uint16_t hash_index[KOLIBRI_SYMBOL_HASH_SIZE];
+    uint16_t digits_index[KOLIBRI_SYMBOL_CODES];
     size_t count;
     uint64_t version;
     KolibriGenome *genome;
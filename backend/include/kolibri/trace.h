@@ -0,0 +1,69 @@
+#ifndef KOLIBRI_TRACE_H
+#define KOLIBRI_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Спаны пишутся в потоковые кольцевые буферы без блокировок; фоновый поток
+ * сбрасывает их в файл. Инструментация в ядре включается флагом сборки
+ * KOLIBRI_TRACING (опция CMake KOLIBRI_ENABLE_TRACING), запись — во время
+ * выполнения через kolibri_trace_start. */
+
+typedef enum {
+    /* Строки kolibri_trace.jsonl: {"event": {"metka", "soobshenie", "tip": "SPAN"}, "span": {...}}. */
+    KOLIBRI_TRACE_FORMAT_JSONL = 0,
+    /* Chrome Trace Event (массив событий "ph":"X"), открывается в Perfetto. */
+    KOLIBRI_TRACE_FORMAT_CHROME = 1,
+} KolibriTraceFormat;
+
+typedef struct {
+    const char *path;
+    KolibriTraceFormat format;
+    /* Доля корневых спанов, попадающих в запись (0..1); вложенные наследуют решение. */
+    double sample_rate;
+    /* Период фонового сброса; 0 — 100 мс. */
+    unsigned flush_interval_ms;
+} KolibriTraceConfig;
+
+typedef struct {
+    const char *name;
+    /* 0 — спан не выбран выборкой или трассировка выключена. */
+    uint64_t start_ns;
+    uint32_t depth;
+} KolibriTraceSpan;
+
+typedef struct {
+    uint64_t written;
+    uint64_t dropped;
+} KolibriTraceStats;
+
+int kolibri_trace_start(const KolibriTraceConfig *config);
+/* KOLIBRI_TRACE_PATH, KOLIBRI_TRACE_FORMAT (jsonl|chrome), KOLIBRI_TRACE_SAMPLE;
+ * без KOLIBRI_TRACE_PATH ничего не делает и возвращает 0. */
+int kolibri_trace_start_from_env(void);
+/* Останавливает фоновый поток и дописывает накопленные спаны. */
+void kolibri_trace_stop(void);
+int kolibri_trace_enabled(void);
+void kolibri_trace_stats(KolibriTraceStats *out);
+
+/* name должен жить до остановки трассировки (обычно строковый литерал). */
+KolibriTraceSpan kolibri_trace_begin(const char *name);
+void kolibri_trace_end(KolibriTraceSpan *span);
+
+#if defined(KOLIBRI_TRACING) && KOLIBRI_TRACING
+#define KOLIBRI_TRACE_BEGIN(var, name) KolibriTraceSpan var = kolibri_trace_begin(name)
+#define KOLIBRI_TRACE_END(var) kolibri_trace_end(&(var))
+#else
+#define KOLIBRI_TRACE_BEGIN(var, name) ((void)0)
+#define KOLIBRI_TRACE_END(var) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KOLIBRI_TRACE_H */
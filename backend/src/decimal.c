@@ -8,6 +8,239 @@
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define KOLIBRI_DECIMAL_HAS_SSSE3 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KOLIBRI_DECIMAL_HAS_NEON 1
+#endif
+
+/* Таблица байт -> три десятичные цифры, строится на этапе компиляции. */
+#define K_D3(n) {(uint8_t)((n) / 100U), (uint8_t)((n) / 10U % 10U), (uint8_t)((n) % 10U)}
+#define K_D3_4(n) K_D3(n), K_D3((n) + 1U), K_D3((n) + 2U), K_D3((n) + 3U)
+#define K_D3_16(n) K_D3_4(n), K_D3_4((n) + 4U), K_D3_4((n) + 8U), K_D3_4((n) + 12U)
+#define K_D3_64(n) K_D3_16(n), K_D3_16((n) + 16U), K_D3_16((n) + 32U), K_D3_16((n) + 48U)
+
+static const uint8_t k_byte_digits[256][3] = {
+    K_D3_64(0U), K_D3_64(64U), K_D3_64(128U), K_D3_64(192U)};
+
+#undef K_D3_64
+#undef K_D3_16
+#undef K_D3_4
+#undef K_D3
+
+#if defined(KOLIBRI_DECIMAL_HAS_SSSE3)
+/* Маски pshufb: чередование сотен/десятков/единиц в 48 цифр и обратно. */
+static const int8_t k_interleave_mask[3][3][16] = {
+    {{0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5},
+     {-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1},
+     {-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1}},
+    {{-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1},
+     {5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10},
+     {-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1}},
+    {{-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1},
+     {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1},
+     {10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15}}};
+
+static const int8_t k_deinterleave_mask[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}};
+
+static inline __m128i mask_load(const int8_t *mask) {
+    return _mm_loadu_si128((const __m128i *)(const void *)mask);
+}
+
+/* x / 100 = (x * 41) >> 12 и r / 10 = (r * 103) >> 10 точны для байтов. */
+static inline void split_u16(__m128i x, __m128i *h, __m128i *t, __m128i *o) {
+    __m128i hundreds = _mm_srli_epi16(_mm_mullo_epi16(x, _mm_set1_epi16(41)), 12);
+    __m128i rest = _mm_sub_epi16(x, _mm_mullo_epi16(hundreds, _mm_set1_epi16(100)));
+    __m128i tens = _mm_srli_epi16(_mm_mullo_epi16(rest, _mm_set1_epi16(103)), 10);
+    *h = hundreds;
+    *t = tens;
+    *o = _mm_sub_epi16(rest, _mm_mullo_epi16(tens, _mm_set1_epi16(10)));
+}
+
+static void encode_block16(const unsigned char *bytes, uint8_t *out, uint8_t bias) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(const void *)bytes);
+    __m128i zero = _mm_setzero_si128();
+    __m128i hl, tl, ol, hh, th, oh;
+    split_u16(_mm_unpacklo_epi8(v, zero), &hl, &tl, &ol);
+    split_u16(_mm_unpackhi_epi8(v, zero), &hh, &th, &oh);
+    __m128i b = _mm_set1_epi8((char)bias);
+    __m128i parts[3] = {_mm_add_epi8(_mm_packus_epi16(hl, hh), b),
+                        _mm_add_epi8(_mm_packus_epi16(tl, th), b),
+                        _mm_add_epi8(_mm_packus_epi16(ol, oh), b)};
+    for (int k = 0; k < 3; ++k) {
+        __m128i block = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(parts[0], mask_load(k_interleave_mask[0][k])),
+                         _mm_shuffle_epi8(parts[1], mask_load(k_interleave_mask[1][k]))),
+            _mm_shuffle_epi8(parts[2], mask_load(k_interleave_mask[2][k])));
+        _mm_storeu_si128((__m128i *)(void *)(out + 16 * k), block);
+    }
+}
+
+static int decode_block16(const uint8_t *digits, unsigned char *out, uint8_t bias) {
+    __m128i b = _mm_set1_epi8((char)bias);
+    __m128i in[3];
+    for (int k = 0; k < 3; ++k) {
+        in[k] = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(const void *)(digits + 16 * k)), b);
+    }
+    __m128i parts[3];
+    for (int s = 0; s < 3; ++s) {
+        parts[s] = _mm_or_si128(
+            _mm_or_si128(_mm_shuffle_epi8(in[0], mask_load(k_deinterleave_mask[s][0])),
+                         _mm_shuffle_epi8(in[1], mask_load(k_deinterleave_mask[s][1]))),
+            _mm_shuffle_epi8(in[2], mask_load(k_deinterleave_mask[s][2])));
+    }
+    __m128i top = _mm_max_epu8(_mm_max_epu8(parts[0], parts[1]), parts[2]);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(top, _mm_set1_epi8(9)), top)) != 0xFFFF) {
+        return -1;
+    }
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(parts[0], zero), _mm_set1_epi16(100)),
+                      _mm_mullo_epi16(_mm_unpacklo_epi8(parts[1], zero), _mm_set1_epi16(10))),
+        _mm_unpacklo_epi8(parts[2], zero));
+    __m128i hi = _mm_add_epi16(
+        _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(parts[0], zero), _mm_set1_epi16(100)),
+                      _mm_mullo_epi16(_mm_unpackhi_epi8(parts[1], zero), _mm_set1_epi16(10))),
+        _mm_unpackhi_epi8(parts[2], zero));
+    __m128i limit = _mm_set1_epi16(255);
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpgt_epi16(lo, limit), _mm_cmpgt_epi16(hi, limit))) != 0) {
+        return -1;
+    }
+    _mm_storeu_si128((__m128i *)(void *)out, _mm_packus_epi16(lo, hi));
+    return 0;
+}
+#elif defined(KOLIBRI_DECIMAL_HAS_NEON)
+static inline void split_u16(uint16x8_t x, uint16x8_t *h, uint16x8_t *t, uint16x8_t *o) {
+    uint16x8_t hundreds = vshrq_n_u16(vmulq_n_u16(x, 41), 12);
+    uint16x8_t rest = vmlsq_n_u16(x, hundreds, 100);
+    uint16x8_t tens = vshrq_n_u16(vmulq_n_u16(rest, 103), 10);
+    *h = hundreds;
+    *t = tens;
+    *o = vmlsq_n_u16(rest, tens, 10);
+}
+
+static void encode_block16(const unsigned char *bytes, uint8_t *out, uint8_t bias) {
+    uint8x16_t v = vld1q_u8(bytes);
+    uint16x8_t hl, tl, ol, hh, th, oh;
+    split_u16(vmovl_u8(vget_low_u8(v)), &hl, &tl, &ol);
+    split_u16(vmovl_u8(vget_high_u8(v)), &hh, &th, &oh);
+    uint8x16_t b = vdupq_n_u8(bias);
+    uint8x16x3_t parts;
+    parts.val[0] = vaddq_u8(vcombine_u8(vmovn_u16(hl), vmovn_u16(hh)), b);
+    parts.val[1] = vaddq_u8(vcombine_u8(vmovn_u16(tl), vmovn_u16(th)), b);
+    parts.val[2] = vaddq_u8(vcombine_u8(vmovn_u16(ol), vmovn_u16(oh)), b);
+    vst3q_u8(out, parts);
+}
+
+static int decode_block16(const uint8_t *digits, unsigned char *out, uint8_t bias) {
+    uint8x16x3_t parts = vld3q_u8(digits);
+    uint8x16_t b = vdupq_n_u8(bias);
+    uint8x16_t h = vsubq_u8(parts.val[0], b);
+    uint8x16_t t = vsubq_u8(parts.val[1], b);
+    uint8x16_t o = vsubq_u8(parts.val[2], b);
+    if (vmaxvq_u8(vmaxq_u8(vmaxq_u8(h, t), o)) > 9U) {
+        return -1;
+    }
+    uint16x8_t lo = vaddw_u8(vmlal_u8(vmull_u8(vget_low_u8(h), vdup_n_u8(100)),
+                                      vget_low_u8(t), vdup_n_u8(10)),
+                             vget_low_u8(o));
+    uint16x8_t hi = vaddw_u8(vmlal_u8(vmull_u8(vget_high_u8(h), vdup_n_u8(100)),
+                                      vget_high_u8(t), vdup_n_u8(10)),
+                             vget_high_u8(o));
+    if (vmaxvq_u16(vmaxq_u16(lo, hi)) > 255U) {
+        return -1;
+    }
+    vst1q_u8(out, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    return 0;
+}
+#endif
+
+/* Общие ядра пакетного кодека; bias = 0 для цифр, '0' для ASCII. */
+static void encode_bulk(const unsigned char *bytes, size_t len, uint8_t *out, uint8_t bias) {
+    size_t i = 0;
+#if defined(KOLIBRI_DECIMAL_HAS_SSSE3) || defined(KOLIBRI_DECIMAL_HAS_NEON)
+    for (; i + 16U <= len; i += 16U) {
+        encode_block16(bytes + i, out + i * 3U, bias);
+    }
+#endif
+    for (; i < len; ++i) {
+        const uint8_t *d = k_byte_digits[bytes[i]];
+        uint8_t *dst = out + i * 3U;
+        dst[0] = (uint8_t)(d[0] + bias);
+        dst[1] = (uint8_t)(d[1] + bias);
+        dst[2] = (uint8_t)(d[2] + bias);
+    }
+}
+
+static int decode_bulk(const uint8_t *digits, size_t len, unsigned char *out, uint8_t bias) {
+    if (len % 3U != 0U) {
+        return -1;
+    }
+    size_t count = len / 3U;
+    size_t i = 0;
+#if defined(KOLIBRI_DECIMAL_HAS_SSSE3) || defined(KOLIBRI_DECIMAL_HAS_NEON)
+    for (; i + 16U <= count; i += 16U) {
+        if (decode_block16(digits + i * 3U, out + i, bias) != 0) {
+            return -1;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        const uint8_t *src = digits + i * 3U;
+        unsigned int h = (unsigned int)(uint8_t)(src[0] - bias);
+        unsigned int t = (unsigned int)(uint8_t)(src[1] - bias);
+        unsigned int o = (unsigned int)(uint8_t)(src[2] - bias);
+        if (h > 9U || t > 9U || o > 9U) {
+            return -1;
+        }
+        unsigned int value = h * 100U + t * 10U + o;
+        if (value > 255U) {
+            return -1;
+        }
+        out[i] = (unsigned char)value;
+    }
+    return 0;
+}
+
+void k_encode_digits_bulk(const unsigned char *bytes, size_t len, uint8_t *digits) {
+    if (!bytes || !digits) {
+        return;
+    }
+    encode_bulk(bytes, len, digits, 0U);
+}
+
+int k_decode_digits_bulk(const uint8_t *digits, size_t len, unsigned char *out) {
+    if (!digits || !out) {
+        return -1;
+    }
+    return decode_bulk(digits, len, out, 0U);
+}
+
+void k_encode_ascii_bulk(const unsigned char *bytes, size_t len, char *out) {
+    if (!bytes || !out) {
+        return;
+    }
+    encode_bulk(bytes, len, (uint8_t *)out, (uint8_t)'0');
+}
+
+int k_decode_ascii_bulk(const char *digits, size_t len, unsigned char *out) {
+    if (!digits || !out) {
+        return -1;
+    }
+    return decode_bulk((const uint8_t *)digits, len, out, (uint8_t)'0');
+}
+
 static int ensure_space(k_digit_stream *stream) {
     if (!stream || !stream->digits) {
         return -1;
@@ -79,27 +312,16 @@ size_t k_digit_stream_remaining(const k_digit_stream *stream) {
     return stream->length - stream->cursor;
 }
 
-static int encode_byte(k_digit_stream *stream, unsigned char value) {
-    uint8_t hundreds = (uint8_t)(value / 100U);
-    uint8_t tens = (uint8_t)((value / 10U) % 10U);
-    uint8_t ones = (uint8_t)(value % 10U);
-    if (k_digit_stream_push(stream, hundreds) != 0 ||
-        k_digit_stream_push(stream, tens) != 0 ||
-        k_digit_stream_push(stream, ones) != 0) {
-        return -1;
-    }
-    return 0;
-}
-
 int k_transduce_utf8(k_digit_stream *stream, const unsigned char *bytes, size_t len) {
-    if (!stream || !bytes) {
+    if (!stream || !bytes || !stream->digits) {
         return -1;
     }
-    for (size_t i = 0; i < len; ++i) {
-        if (encode_byte(stream, bytes[i]) != 0) {
-            return -1;
-        }
+    if (stream->length > stream->capacity ||
+        len > (stream->capacity - stream->length) / 3U) {
+        return -1;
     }
+    encode_bulk(bytes, len, stream->digits + stream->length, 0U);
+    stream->length += len * 3U;
     return 0;
 }
 
@@ -115,12 +337,8 @@ int k_emit_utf8(const k_digit_stream *stream, unsigned char *out, size_t out_len
     if (out_len < expected) {
         return -1;
     }
-    for (size_t i = 0; i < expected; ++i) {
-        size_t offset = i * 3U;
-        unsigned int value = (unsigned int)(stream->digits[offset] * 100U +
-                                            stream->digits[offset + 1] * 10U +
-                                            stream->digits[offset + 2]);
-        out[i] = (unsigned char)value;
+    if (decode_bulk(stream->digits, stream->length, out, 0U) != 0) {
+        return -1;
     }
     if (written) {
         *written = expected;
@@ -144,23 +362,11 @@ int k_encode_text(const char *input, char *out, size_t out_len) {
         return -1;
     }
     size_t len = strlen(input);
-    size_t need = len * 3U + 1U;
-    if (out_len < need) {
+    if (len > (SIZE_MAX - 1U) / 3U || out_len < len * 3U + 1U) {
         return -1;
     }
-    uint8_t buffer[512];
-    if (len * 3U > sizeof(buffer)) {
-        return -1;
-    }
-    k_digit_stream stream;
-    k_digit_stream_init(&stream, buffer, sizeof(buffer));
-    if (k_transduce_utf8(&stream, (const unsigned char *)input, len) != 0) {
-        return -1;
-    }
-    for (size_t i = 0; i < stream.length; ++i) {
-        out[i] = (char)('0' + stream.digits[i]);
-    }
-    out[stream.length] = '\0';
+    encode_bulk((const unsigned char *)input, len, (uint8_t *)out, (uint8_t)'0');
+    out[len * 3U] = '\0';
     return 0;
 }
 
@@ -176,27 +382,9 @@ int k_decode_text(const char *digits, char *out, size_t out_len) {
     if (out_len < expected + 1U) {
         return -1;
     }
-    uint8_t buffer[512];
-    if (len > sizeof(buffer)) {
-        return -1;
-    }
-    k_digit_stream stream;
-    k_digit_stream_init(&stream, buffer, len);
-    for (size_t i = 0; i < len; ++i) {
-        if (digits[i] < '0' || digits[i] > '9') {
-            return -1;
-        }
-        stream.digits[i] = (uint8_t)(digits[i] - '0');
-    }
-    stream.length = len;
-    unsigned char decoded[256];
-    size_t produced = 0;
-    if (k_emit_utf8(&stream, decoded, sizeof(decoded), &produced) != 0) {
+    if (decode_bulk((const uint8_t *)digits, len, (unsigned char *)out, (uint8_t)'0') != 0) {
         return -1;
     }
-    for (size_t i = 0; i < produced; ++i) {
-        out[i] = (char)decoded[i];
-    }
-    out[produced] = '\0';
+    out[expected] = '\0';
     return 0;
 }
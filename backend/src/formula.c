@@ -6,6 +6,7 @@
 
 #include "kolibri/decimal.h"
 #include "kolibri/symbol_table.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
 #include <limits.h>
@@ -16,6 +17,12 @@
 #include <string.h>
 #include <time.h>
 
+#if !defined(__EMSCRIPTEN__)
+#include <pthread.h>
+#include <unistd.h>
+#define KOLIBRI_FORMULA_HAS_THREADS 1
+#endif
+
 #if defined(__GNUC__) || defined(__clang__)
 #define KOLIBRI_FORCE_INLINE static inline __attribute__((always_inline))
 #else
@@ -23,10 +30,8 @@
 #endif
 
 #if defined(__GNUC__) || defined(__clang__)
-#define KOLIBRI_ATOMIC_STORE_U64(ptr, value) __atomic_store_n((ptr), (uint64_t)(value), __ATOMIC_RELAXED)
 #define KOLIBRI_ATOMIC_ADD_U64(ptr, value) __atomic_add_fetch((ptr), (uint64_t)(value), __ATOMIC_RELAXED)
 #else
-#define KOLIBRI_ATOMIC_STORE_U64(ptr, value) (*(ptr) = (uint64_t)(value))
 #define KOLIBRI_ATOMIC_ADD_U64(ptr, value) ((*(ptr) += (uint64_t)(value)))
 #endif
 
@@ -43,9 +48,9 @@
 #define KOLIBRI_BEAM_MAX_LANES 4U
 #endif
 
-#if (KOLIBRI_BEAM_MAX_LANES) > 8U
+#if (KOLIBRI_BEAM_MAX_LANES) > 32U
 #undef KOLIBRI_BEAM_MAX_LANES
-#define KOLIBRI_BEAM_MAX_LANES 8U
+#define KOLIBRI_BEAM_MAX_LANES 32U
 #endif
 
 #if defined(KOLIBRI_USE_WASM_SIMD) && defined(__wasm_simd128__)
@@ -71,12 +76,141 @@ KOLIBRI_FORCE_INLINE size_t kolibri_popcount16(uint32_t mask) {
 }
 #endif
 
-#define KOLIBRI_FORMULA_CAPACITY (sizeof(((KolibriFormulaPool *)0)->formulas) / sizeof(KolibriFormula))
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KOLIBRI_HAS_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KOLIBRI_HAS_NEON 1
+#endif
+
+#define KOLIBRI_MEMORY_SUBSYSTEM KOLIBRI_MEMORY_FORMULA
+#include "kolibri/memory.h"
+
+#define KOLIBRI_POOL_FORMULAS_LIMIT (1U << 20)
+#define KOLIBRI_POOL_EXAMPLES_LIMIT (1U << 24)
+#define KOLIBRI_POOL_ASSOCIATIONS_LIMIT (1U << 20)
+#define KOLIBRI_ARENA_ALIGN 64U
+#define KOLIBRI_RANK_INSERTION_LIMIT 32U
 #define KOLIBRI_DIGIT_MAX 9U
+#define KOLIBRI_MAX_ISLANDS 64U
+#define KOLIBRI_ISLAND_MIGRANTS 2U
 #define KOLIBRI_ASSOC_TEXT_LIMIT (sizeof(((KolibriAssociation *)0)->question))
 
 /* ---------------------------- Утилиты ----------------------------- */
 
+static uint64_t monotonic_ns(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+#endif
+    clock_t ticks = clock();
+    if (ticks == (clock_t)-1) {
+        return 0ULL;
+    }
+    return (uint64_t)((double)ticks * 1e9 / (double)CLOCKS_PER_SEC);
+}
+
+static size_t latency_bucket(uint64_t elapsed_ns) {
+    uint64_t micros = elapsed_ns / 1000ULL;
+    size_t bucket = 0U;
+    while (micros > 0ULL && bucket + 1U < KOLIBRI_PROFILE_LATENCY_BUCKETS) {
+        micros >>= 1U;
+        ++bucket;
+    }
+    return bucket;
+}
+
+/* Замеры тика копятся локально и публикуются в профиль одним проходом. */
+typedef struct {
+    uint64_t evaluations;
+    uint64_t hits;
+    uint64_t stage_ns[KOLIBRI_STAGE_COUNT];
+    uint64_t latency[KOLIBRI_PROFILE_LATENCY_BUCKETS];
+} KolibriTickStats;
+
+typedef struct {
+    double base_score;
+    double drift_b;
+    double drift_d;
+    double phase;
+} KolibriEvaluation;
+
+struct KolibriFitnessMemo {
+    KolibriGene gene;
+    uint64_t digest;
+    uint64_t version;
+    KolibriEvaluation evaluation;
+};
+
+static size_t fitness_memo_entries(size_t formulas) {
+    size_t entries = 64U;
+    while (entries < formulas * 4U) {
+        entries <<= 1U;
+    }
+    return entries;
+}
+
+#define SLOT_ASSOCIATIONS(pool, slot) (&(pool)->association_ids[(size_t)(slot) * KOLIBRI_FORMULA_MAX_ASSOCIATIONS])
+
+/* Выдаёт выровненный срез арены; при base == NULL только считает размер. */
+static void *arena_slice(unsigned char *base, size_t *offset, size_t bytes) {
+    size_t at = (*offset + (KOLIBRI_ARENA_ALIGN - 1U)) & ~(size_t)(KOLIBRI_ARENA_ALIGN - 1U);
+    *offset = at + bytes;
+    return base ? base + at : NULL;
+}
+
+/* Размещает массивы пула в арене кусками по слотам, данным и scratch.
+ * Без with_dataset примеры и ассоциации не трогаются (они общие). */
+static size_t pool_layout(KolibriFormulaPool *pool, unsigned char *base, size_t formulas, int with_dataset) {
+    size_t offset = 0U;
+    pool->genes = (KolibriGene *)arena_slice(base, &offset, formulas * sizeof(KolibriGene));
+    pool->fitness = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->feedback = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->invariant_drift_b = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->invariant_drift_d = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->phase = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->order = (uint32_t *)arena_slice(base, &offset, formulas * sizeof(uint32_t));
+    pool->association_ids = (uint32_t *)arena_slice(
+        base, &offset, formulas * KOLIBRI_FORMULA_MAX_ASSOCIATIONS * sizeof(uint32_t));
+    pool->association_counts = (uint8_t *)arena_slice(base, &offset, formulas);
+    pool->base_score = (double *)arena_slice(base, &offset, formulas * sizeof(double));
+    pool->evaluated_version = (uint64_t *)arena_slice(base, &offset, formulas * sizeof(uint64_t));
+    size_t memo_entries = fitness_memo_entries(formulas);
+    pool->fitness_memo = (struct KolibriFitnessMemo *)arena_slice(
+        base, &offset, memo_entries * sizeof(struct KolibriFitnessMemo));
+    pool->fitness_memo_mask = memo_entries - 1U;
+    if (with_dataset) {
+        pool->inputs = (int *)arena_slice(base, &offset, pool->example_capacity * sizeof(int));
+        pool->targets = (int *)arena_slice(base, &offset, pool->example_capacity * sizeof(int));
+        pool->associations = (KolibriAssociation *)arena_slice(
+            base, &offset, pool->association_capacity * sizeof(KolibriAssociation));
+    }
+    /* scratch: потомки reproduce и буфер сортировки ранга. */
+    size_t scratch = formulas * (sizeof(KolibriGene) + sizeof(uint32_t)) + 2U * KOLIBRI_ARENA_ALIGN;
+    arena_slice(base, &offset, 0U);
+    pool->scratch_offset = offset;
+    pool->scratch_size = scratch;
+    pool->scratch_used = 0U;
+    return offset + scratch;
+}
+
+static void scratch_reset(KolibriFormulaPool *pool) {
+    pool->scratch_used = 0U;
+}
+
+static void *scratch_alloc(KolibriFormulaPool *pool, size_t bytes) {
+    size_t offset = pool->scratch_used;
+    void *ptr = arena_slice(pool->arena + pool->scratch_offset, &offset, bytes);
+    if (offset > pool->scratch_size) {
+        return NULL;
+    }
+    pool->scratch_used = offset;
+    return ptr;
+}
+
 KOLIBRI_FORCE_INLINE uint8_t random_digit(KolibriFormulaPool *pool) {
     return (uint8_t)(k_rng_next(&pool->rng) % 10ULL);
 }
@@ -269,6 +403,301 @@ static void association_set(KolibriAssociation *assoc,
     }
 }
 
+/* Индекс ассоциаций лежит вне арены: острова копируют пул побайтно и только
+ * читают его. exact — открытая адресация по input_hash (номер слота + 1,
+ * 0 — пусто), trigrams — триграммы вопросов в нижнем регистре -> слоты. */
+typedef struct {
+    uint32_t key;
+    uint32_t start;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *slots;
+} KolibriTrigramPosting;
+
+struct KolibriAssociationIndex {
+    uint32_t *exact;
+    size_t exact_mask;
+    KolibriTrigramPosting *trigrams;
+    size_t trigram_mask;
+    size_t trigram_used;
+    /* Различных триграмм в вопросе слота; 0 — вопрос короче трёх байт. */
+    uint16_t *trigram_counts;
+    uint32_t *short_slots;
+    size_t short_count;
+};
+
+#define KOLIBRI_QUESTION_BYTES sizeof(((KolibriAssociation *)0)->question)
+
+static uint32_t index_mix(uint32_t value) {
+    value ^= value >> 16;
+    value *= 0x7feb352dU;
+    value ^= value >> 15;
+    value *= 0x846ca68bU;
+    value ^= value >> 16;
+    return value;
+}
+
+static void question_lower(const char *src, char *dst) {
+    size_t i = 0;
+    for (; src[i] && i + 1U < KOLIBRI_QUESTION_BYTES; ++i) {
+        dst[i] = (char)tolower((unsigned char)src[i]);
+    }
+    dst[i] = '\0';
+}
+
+static int compare_trigram(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t *)lhs;
+    uint32_t b = *(const uint32_t *)rhs;
+    return (a > b) - (a < b);
+}
+
+/* Различные триграммы строки в порядке возрастания. */
+static size_t question_trigrams(const char *lowered, uint32_t *out) {
+    const unsigned char *bytes = (const unsigned char *)lowered;
+    size_t len = strlen(lowered);
+    if (len < 3U) {
+        return 0U;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i + 2U < len; ++i) {
+        out[count++] = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i + 1U] << 8) | bytes[i + 2U];
+    }
+    qsort(out, count, sizeof(*out), compare_trigram);
+    size_t unique = 1U;
+    for (size_t i = 1; i < count; ++i) {
+        if (out[i] != out[unique - 1U]) {
+            out[unique++] = out[i];
+        }
+    }
+    return unique;
+}
+
+static struct KolibriAssociationIndex *index_create(size_t capacity) {
+    struct KolibriAssociationIndex *index =
+        (struct KolibriAssociationIndex *)calloc(1U, sizeof(*index));
+    if (!index) {
+        return NULL;
+    }
+    size_t exact = 16U;
+    while (exact < capacity * 2U) {
+        exact <<= 1U;
+    }
+    index->exact = (uint32_t *)calloc(exact, sizeof(uint32_t));
+    index->exact_mask = exact - 1U;
+    index->trigrams = (KolibriTrigramPosting *)calloc(64U, sizeof(KolibriTrigramPosting));
+    index->trigram_mask = 63U;
+    index->trigram_counts = (uint16_t *)calloc(capacity, sizeof(uint16_t));
+    index->short_slots = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    if (!index->exact || !index->trigrams || !index->trigram_counts || !index->short_slots) {
+        free(index->exact);
+        free(index->trigrams);
+        free(index->trigram_counts);
+        free(index->short_slots);
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+static void index_destroy(struct KolibriAssociationIndex *index) {
+    if (!index) {
+        return;
+    }
+    for (size_t i = 0; i <= index->trigram_mask; ++i) {
+        free(index->trigrams[i].slots);
+    }
+    free(index->trigrams);
+    free(index->exact);
+    free(index->trigram_counts);
+    free(index->short_slots);
+    free(index);
+}
+
+static void index_reset(struct KolibriAssociationIndex *index, size_t capacity) {
+    memset(index->exact, 0, (index->exact_mask + 1U) * sizeof(uint32_t));
+    for (size_t i = 0; i <= index->trigram_mask; ++i) {
+        index->trigrams[i].start = 0U;
+        index->trigrams[i].count = 0U;
+    }
+    memset(index->trigram_counts, 0, capacity * sizeof(uint16_t));
+    index->short_count = 0U;
+}
+
+static KolibriTrigramPosting *posting_find(const struct KolibriAssociationIndex *index, uint32_t key) {
+    size_t pos = index_mix(key) & index->trigram_mask;
+    while (index->trigrams[pos].key != 0U) {
+        if (index->trigrams[pos].key == key) {
+            return &index->trigrams[pos];
+        }
+        pos = (pos + 1U) & index->trigram_mask;
+    }
+    return NULL;
+}
+
+static KolibriTrigramPosting *posting_insert(struct KolibriAssociationIndex *index, uint32_t key) {
+    KolibriTrigramPosting *posting = posting_find(index, key);
+    if (posting) {
+        return posting;
+    }
+    if ((index->trigram_used + 1U) * 2U > index->trigram_mask + 1U) {
+        size_t grown = (index->trigram_mask + 1U) * 2U;
+        KolibriTrigramPosting *table = (KolibriTrigramPosting *)calloc(grown, sizeof(KolibriTrigramPosting));
+        if (!table) {
+            return NULL;
+        }
+        for (size_t i = 0; i <= index->trigram_mask; ++i) {
+            if (index->trigrams[i].key == 0U) {
+                continue;
+            }
+            size_t pos = index_mix(index->trigrams[i].key) & (grown - 1U);
+            while (table[pos].key != 0U) {
+                pos = (pos + 1U) & (grown - 1U);
+            }
+            table[pos] = index->trigrams[i];
+        }
+        free(index->trigrams);
+        index->trigrams = table;
+        index->trigram_mask = grown - 1U;
+    }
+    size_t pos = index_mix(key) & index->trigram_mask;
+    while (index->trigrams[pos].key != 0U) {
+        pos = (pos + 1U) & index->trigram_mask;
+    }
+    index->trigrams[pos].key = key;
+    index->trigram_used++;
+    return &index->trigrams[pos];
+}
+
+static int posting_append(KolibriTrigramPosting *posting, uint32_t slot) {
+    if (posting->count == posting->capacity) {
+        if (posting->start > 0U) {
+            memmove(posting->slots, posting->slots + posting->start,
+                    (posting->count - posting->start) * sizeof(uint32_t));
+            posting->count -= posting->start;
+            posting->start = 0U;
+        } else {
+            uint32_t grown = posting->capacity ? posting->capacity * 2U : 4U;
+            uint32_t *slots = (uint32_t *)realloc(posting->slots, grown * sizeof(uint32_t));
+            if (!slots) {
+                return -1;
+            }
+            posting->slots = slots;
+            posting->capacity = grown;
+        }
+    }
+    posting->slots[posting->count++] = slot;
+    return 0;
+}
+
+/* Вытесняется самый старый слот, а списки растут в порядке добавления,
+ * поэтому удаляемый номер почти всегда первый в списке. */
+static void posting_remove(KolibriTrigramPosting *posting, uint32_t slot) {
+    if (posting->start < posting->count && posting->slots[posting->start] == slot) {
+        posting->start++;
+        return;
+    }
+    for (uint32_t i = posting->start; i < posting->count; ++i) {
+        if (posting->slots[i] == slot) {
+            memmove(&posting->slots[i], &posting->slots[i + 1U], (posting->count - i - 1U) * sizeof(uint32_t));
+            posting->count--;
+            return;
+        }
+    }
+}
+
+static void index_insert(KolibriFormulaPool *pool, size_t slot) {
+    struct KolibriAssociationIndex *index = pool->association_index;
+    const KolibriAssociation *assoc = &pool->associations[slot];
+    size_t pos = index_mix((uint32_t)assoc->input_hash) & index->exact_mask;
+    while (index->exact[pos] != 0U) {
+        pos = (pos + 1U) & index->exact_mask;
+    }
+    index->exact[pos] = (uint32_t)slot + 1U;
+
+    char lowered[KOLIBRI_QUESTION_BYTES];
+    uint32_t keys[KOLIBRI_QUESTION_BYTES];
+    question_lower(assoc->question, lowered);
+    size_t count = question_trigrams(lowered, keys);
+    size_t indexed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        KolibriTrigramPosting *posting = posting_insert(index, keys[i]);
+        if (posting && posting_append(posting, (uint32_t)slot) == 0) {
+            keys[indexed++] = keys[i];
+        }
+    }
+    /* Без памяти под списки вопрос ищется как короткий, полным проходом. */
+    if (indexed < count) {
+        for (size_t i = 0; i < indexed; ++i) {
+            posting_remove(posting_find(index, keys[i]), (uint32_t)slot);
+        }
+        count = 0;
+    }
+    index->trigram_counts[slot] = (uint16_t)count;
+    if (count == 0U) {
+        index->short_slots[index->short_count++] = (uint32_t)slot;
+    }
+}
+
+static void index_remove(KolibriFormulaPool *pool, size_t slot) {
+    struct KolibriAssociationIndex *index = pool->association_index;
+    const KolibriAssociation *assoc = &pool->associations[slot];
+    size_t pos = index_mix((uint32_t)assoc->input_hash) & index->exact_mask;
+    while (index->exact[pos] != (uint32_t)slot + 1U) {
+        pos = (pos + 1U) & index->exact_mask;
+    }
+    /* Обратный сдвиг вместо надгробий: цепочки зондирования не рвутся. */
+    size_t hole = pos;
+    for (size_t next = (hole + 1U) & index->exact_mask; index->exact[next] != 0U;
+         next = (next + 1U) & index->exact_mask) {
+        const KolibriAssociation *moved = &pool->associations[index->exact[next] - 1U];
+        size_t home = index_mix((uint32_t)moved->input_hash) & index->exact_mask;
+        if (((next - home) & index->exact_mask) >= ((next - hole) & index->exact_mask)) {
+            index->exact[hole] = index->exact[next];
+            hole = next;
+        }
+    }
+    index->exact[hole] = 0U;
+
+    if (index->trigram_counts[slot] == 0U) {
+        for (size_t i = 0; i < index->short_count; ++i) {
+            if (index->short_slots[i] == (uint32_t)slot) {
+                index->short_slots[i] = index->short_slots[--index->short_count];
+                break;
+            }
+        }
+        return;
+    }
+    char lowered[KOLIBRI_QUESTION_BYTES];
+    uint32_t keys[KOLIBRI_QUESTION_BYTES];
+    question_lower(assoc->question, lowered);
+    size_t count = question_trigrams(lowered, keys);
+    for (size_t i = 0; i < count; ++i) {
+        KolibriTrigramPosting *posting = posting_find(index, keys[i]);
+        if (posting) {
+            posting_remove(posting, (uint32_t)slot);
+        }
+    }
+    index->trigram_counts[slot] = 0U;
+}
+
+/* question == NULL — первая запись с таким input_hash. */
+static const KolibriAssociation *index_find(const struct KolibriAssociationIndex *index,
+                                            const KolibriAssociation *associations,
+                                            int input_hash, const char *question) {
+    if (!index) {
+        return NULL;
+    }
+    size_t pos = index_mix((uint32_t)input_hash) & index->exact_mask;
+    while (index->exact[pos] != 0U) {
+        const KolibriAssociation *assoc = &associations[index->exact[pos] - 1U];
+        if (assoc->input_hash == input_hash && (!question || strcmp(assoc->question, question) == 0)) {
+            return assoc;
+        }
+        pos = (pos + 1U) & index->exact_mask;
+    }
+    return NULL;
+}
+
 static int association_equals(const KolibriAssociation *a, const KolibriAssociation *b) {
     if (!a || !b) {
         return 0;
@@ -329,39 +758,50 @@ static int decode_bias(const KolibriGene *gene, size_t offset, int *bias) {
     return 0;
 }
 
-static int formula_predict_numeric(const KolibriFormula *formula, int input, int *output) {
-    if (!formula || !output) {
-        return -1;
-    }
-    int operation = 0;
-    int slope = 0;
-    int bias = 0;
-    int auxiliary = 0;
-    if (decode_operation(&formula->gene, 0, &operation) != 0 ||
-        decode_signed(&formula->gene, 1, &slope) != 0 ||
-        decode_bias(&formula->gene, 4, &bias) != 0 ||
-        decode_signed(&formula->gene, 7, &auxiliary) != 0) {
+/* Ген, раскодированный один раз на оценку, а не на каждый пример. */
+typedef struct {
+    int operation;
+    int slope;
+    int bias;
+    int auxiliary;
+} KolibriGeneOp;
+
+typedef struct {
+    int64_t abs_error;
+    int64_t predictions;
+    int64_t targets;
+} KolibriBatchSums;
+
+static int gene_decode_op(const KolibriGene *gene, KolibriGeneOp *op) {
+    if (decode_operation(gene, 0, &op->operation) != 0 ||
+        decode_signed(gene, 1, &op->slope) != 0 ||
+        decode_bias(gene, 4, &op->bias) != 0 ||
+        decode_signed(gene, 7, &op->auxiliary) != 0) {
         return -1;
     }
+    return 0;
+}
+
+static int op_apply(const KolibriGeneOp *op, int input) {
     long long result = 0;
-    switch (operation) {
+    switch (op->operation) {
     case 0:
-        result = (long long)slope * (long long)input + bias;
+        result = (long long)op->slope * (long long)input + op->bias;
         break;
     case 1:
-        result = (long long)slope * (long long)input - bias;
+        result = (long long)op->slope * (long long)input - op->bias;
         break;
     case 2: {
-        long long divisor = auxiliary == 0 ? 1 : auxiliary;
-        result = ((long long)slope * (long long)input) % divisor;
-        result += bias;
+        long long divisor = op->auxiliary == 0 ? 1 : op->auxiliary;
+        result = ((long long)op->slope * (long long)input) % divisor;
+        result += op->bias;
         break;
     }
     case 3:
-        result = (long long)slope * (long long)input * (long long)input + bias;
+        result = (long long)op->slope * (long long)input * (long long)input + op->bias;
         break;
     default:
-        result = bias;
+        result = op->bias;
         break;
     }
     if (result > 2147483647LL) {
@@ -370,10 +810,139 @@ static int formula_predict_numeric(const KolibriFormula *formula, int input, int
     if (result < -2147483648LL) {
         result = -2147483648LL;
     }
-    *output = (int)result;
+    return (int)result;
+}
+
+static int gene_predict_numeric(const KolibriGene *gene, int input, int *output) {
+    if (!gene || !output) {
+        return -1;
+    }
+    KolibriGeneOp op;
+    if (gene_decode_op(gene, &op) != 0) {
+        return -1;
+    }
+    *output = op_apply(&op, input);
     return 0;
 }
 
+/* Векторная ветка для линейных операций 0 и 1: prediction = clamp(k*x + c).
+ * |k| <= 99, поэтому произведение с 32-битным входом укладывается в int64.
+ * Возвращает число обработанных примеров (кратно четырём). */
+static size_t batch_affine(int slope, int offset, const int *inputs, const int *targets,
+                           size_t count, KolibriBatchSums *sums) {
+    size_t i = 0U;
+#if defined(KOLIBRI_HAS_AVX2)
+    const __m256i k = _mm256_set1_epi64x(slope);
+    const __m256i c = _mm256_set1_epi64x(offset);
+    const __m256i upper = _mm256_set1_epi64x(INT32_MAX);
+    const __m256i lower = _mm256_set1_epi64x(INT32_MIN);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i error = zero;
+    __m256i predicted = zero;
+    __m256i expected = zero;
+    for (; i + 4U <= count; i += 4U) {
+        __m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(inputs + i)));
+        __m256i t = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(targets + i)));
+        __m256i p = _mm256_add_epi64(_mm256_mul_epi32(x, k), c);
+        p = _mm256_blendv_epi8(p, upper, _mm256_cmpgt_epi64(p, upper));
+        p = _mm256_blendv_epi8(p, lower, _mm256_cmpgt_epi64(lower, p));
+        __m256i d = _mm256_sub_epi64(t, p);
+        __m256i sign = _mm256_cmpgt_epi64(zero, d);
+        error = _mm256_add_epi64(error, _mm256_sub_epi64(_mm256_xor_si256(d, sign), sign));
+        predicted = _mm256_add_epi64(predicted, p);
+        expected = _mm256_add_epi64(expected, t);
+    }
+    int64_t lanes[3][4];
+    _mm256_storeu_si256((__m256i *)lanes[0], error);
+    _mm256_storeu_si256((__m256i *)lanes[1], predicted);
+    _mm256_storeu_si256((__m256i *)lanes[2], expected);
+    for (size_t lane = 0; lane < 4U; ++lane) {
+        sums->abs_error += lanes[0][lane];
+        sums->predictions += lanes[1][lane];
+        sums->targets += lanes[2][lane];
+    }
+#elif defined(KOLIBRI_HAS_NEON)
+    const int32x2_t k = vdup_n_s32(slope);
+    const int64x2_t c = vdupq_n_s64(offset);
+    const int64x2_t upper = vdupq_n_s64(INT32_MAX);
+    const int64x2_t lower = vdupq_n_s64(INT32_MIN);
+    int64x2_t error = vdupq_n_s64(0);
+    int64x2_t predicted = vdupq_n_s64(0);
+    int64x2_t expected = vdupq_n_s64(0);
+    for (; i + 4U <= count; i += 4U) {
+        int32x4_t x = vld1q_s32(inputs + i);
+        int32x4_t t = vld1q_s32(targets + i);
+        int64x2_t halves[2] = {
+            vaddq_s64(vmull_s32(vget_low_s32(x), k), c),
+            vaddq_s64(vmull_s32(vget_high_s32(x), k), c),
+        };
+        int64x2_t goals[2] = {vmovl_s32(vget_low_s32(t)), vmovl_s32(vget_high_s32(t))};
+        for (size_t h = 0; h < 2U; ++h) {
+            int64x2_t p = vbslq_s64(vcgtq_s64(halves[h], upper), upper, halves[h]);
+            p = vbslq_s64(vcgtq_s64(lower, p), lower, p);
+            error = vaddq_s64(error, vabsq_s64(vsubq_s64(goals[h], p)));
+            predicted = vaddq_s64(predicted, p);
+            expected = vaddq_s64(expected, goals[h]);
+        }
+    }
+    sums->abs_error += vgetq_lane_s64(error, 0) + vgetq_lane_s64(error, 1);
+    sums->predictions += vgetq_lane_s64(predicted, 0) + vgetq_lane_s64(predicted, 1);
+    sums->targets += vgetq_lane_s64(expected, 0) + vgetq_lane_s64(expected, 1);
+#elif defined(KOLIBRI_HAS_WASM_SIMD)
+    const v128_t k = wasm_i64x2_splat(slope);
+    const v128_t c = wasm_i64x2_splat(offset);
+    const v128_t upper = wasm_i64x2_splat(INT32_MAX);
+    const v128_t lower = wasm_i64x2_splat(INT32_MIN);
+    v128_t error = wasm_i64x2_splat(0);
+    v128_t predicted = wasm_i64x2_splat(0);
+    v128_t expected = wasm_i64x2_splat(0);
+    for (; i + 4U <= count; i += 4U) {
+        v128_t x = wasm_v128_load(inputs + i);
+        v128_t t = wasm_v128_load(targets + i);
+        v128_t halves[2] = {
+            wasm_i64x2_add(wasm_i64x2_mul(wasm_i64x2_extend_low_i32x4(x), k), c),
+            wasm_i64x2_add(wasm_i64x2_mul(wasm_i64x2_extend_high_i32x4(x), k), c),
+        };
+        v128_t goals[2] = {wasm_i64x2_extend_low_i32x4(t), wasm_i64x2_extend_high_i32x4(t)};
+        for (size_t h = 0; h < 2U; ++h) {
+            v128_t p = wasm_v128_bitselect(upper, halves[h], wasm_i64x2_gt(halves[h], upper));
+            p = wasm_v128_bitselect(lower, p, wasm_i64x2_gt(lower, p));
+            error = wasm_i64x2_add(error, wasm_i64x2_abs(wasm_i64x2_sub(goals[h], p)));
+            predicted = wasm_i64x2_add(predicted, p);
+            expected = wasm_i64x2_add(expected, goals[h]);
+        }
+    }
+    sums->abs_error += wasm_i64x2_extract_lane(error, 0) + wasm_i64x2_extract_lane(error, 1);
+    sums->predictions += wasm_i64x2_extract_lane(predicted, 0) + wasm_i64x2_extract_lane(predicted, 1);
+    sums->targets += wasm_i64x2_extract_lane(expected, 0) + wasm_i64x2_extract_lane(expected, 1);
+#else
+    (void)slope;
+    (void)offset;
+    (void)inputs;
+    (void)targets;
+    (void)count;
+    (void)sums;
+#endif
+    return i;
+}
+
+/* Оценивает раскодированный ген на всём наборе примеров за один проход. */
+static void batch_evaluate(const KolibriGeneOp *op, const int *inputs, const int *targets,
+                           size_t count, KolibriBatchSums *sums) {
+    size_t i = 0U;
+    if (op->operation == 0 || op->operation == 1) {
+        i = batch_affine(op->slope, op->operation == 0 ? op->bias : -op->bias,
+                         inputs, targets, count, sums);
+    }
+    for (; i < count; ++i) {
+        int64_t prediction = op_apply(op, inputs[i]);
+        int64_t diff = (int64_t)targets[i] - prediction;
+        sums->abs_error += diff < 0 ? -diff : diff;
+        sums->predictions += prediction;
+        sums->targets += targets[i];
+    }
+}
+
 static double complexity_penalty(const KolibriGene *gene) {
     double penalty = 0.0;
     for (size_t i = 0; i < gene->length; ++i) {
@@ -385,13 +954,6 @@ static double complexity_penalty(const KolibriGene *gene) {
     return penalty;
 }
 
-typedef struct {
-    double base_score;
-    double drift_b;
-    double drift_d;
-    double phase;
-} KolibriEvaluation;
-
 static double compute_gene_diversity(const KolibriGene *gene) {
     if (!gene || gene->length == 0) {
         return 0.0;
@@ -462,35 +1024,31 @@ static double clamp_score(double value) {
     return value;
 }
 
-static KolibriEvaluation evaluate_formula_metrics(const KolibriFormula *formula,
-                                                  const KolibriFormulaPool *pool) {
+static KolibriEvaluation evaluate_gene_metrics(const KolibriGene *gene,
+                                               const KolibriFormulaPool *pool) {
     KolibriEvaluation eval = {0.0, 0.0, 0.0, 0.0};
-    if (!formula || !pool) {
+    if (!gene || !pool) {
         return eval;
     }
 
-    eval.phase = compute_gene_phase(&formula->gene);
+    eval.phase = compute_gene_phase(gene);
 
     if (pool->examples == 0) {
         return eval;
     }
 
-    double total_error = 0.0;
-    double sum_predictions = 0.0;
-    double sum_targets = 0.0;
-    for (size_t i = 0; i < pool->examples; ++i) {
-        int prediction = 0;
-        if (formula_predict_numeric(formula, pool->inputs[i], &prediction) != 0) {
-            eval.base_score = 0.0;
-            return eval;
-        }
-        int diff = pool->targets[i] - prediction;
-        total_error += fabs((double)diff);
-        sum_predictions += (double)prediction;
-        sum_targets += (double)pool->targets[i];
+    KolibriGeneOp op;
+    if (gene_decode_op(gene, &op) != 0) {
+        eval.base_score = 0.0;
+        return eval;
     }
+    KolibriBatchSums sums = {0, 0, 0};
+    batch_evaluate(&op, pool->inputs, pool->targets, pool->examples, &sums);
+    double total_error = (double)sums.abs_error;
+    double sum_predictions = (double)sums.predictions;
+    double sum_targets = (double)sums.targets;
 
-    double penalty = complexity_penalty(&formula->gene);
+    double penalty = complexity_penalty(gene);
     eval.base_score = 1.0 / (1.0 + total_error + penalty);
 
     double mean_prediction = sum_predictions / (double)pool->examples;
@@ -511,64 +1069,236 @@ static KolibriEvaluation evaluate_formula_metrics(const KolibriFormula *formula,
         baseline_d = 1.0;
     }
 
-    double diversity = compute_gene_diversity(&formula->gene);
+    double diversity = compute_gene_diversity(gene);
     eval.drift_b = fabs(mean_prediction - baseline_b);
     eval.drift_d = fabs(diversity - baseline_d);
     return eval;
 }
 
-static void apply_feedback_bonus(KolibriFormula *formula, double *fitness) {
-    if (!formula || !fitness) {
+static void apply_feedback_bonus(double feedback, double *fitness) {
+    if (!fitness) {
         return;
     }
-    double adjusted = *fitness + formula->feedback;
+    double adjusted = *fitness + feedback;
     *fitness = clamp_score(adjusted);
 }
 
 typedef struct {
-    KolibriFormula *formula;
+    size_t slot;
     KolibriEvaluation evaluation;
     double score;
 } KolibriBeamLane;
 
-static void evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count) {
+static uint64_t gene_digest(const KolibriGene *gene) {
+    uint64_t hash = 1469598103934665603ULL ^ (uint64_t)gene->length;
+    for (size_t i = 0; i < gene->length; ++i) {
+        hash ^= gene->digits[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Элиты переживают reproduce без изменений, поэтому их оценка берётся из
+ * памятки, пока не сменился набор примеров. Возвращает 1 при попадании. */
+static int memo_matches(const struct KolibriFitnessMemo *entry, const KolibriFormulaPool *pool,
+                        const KolibriGene *gene, uint64_t digest) {
+    return entry->version == pool->dataset_version && entry->digest == digest &&
+           entry->gene.length == gene->length &&
+           memcmp(entry->gene.digits, gene->digits, gene->length) == 0;
+}
+
+/* Двухпутевая памятка: ген проверяется в паре соседних ячеек, при промахе
+ * занимается устаревшая ячейка или та, на которую указывает старший бит. */
+static int memo_evaluate(KolibriFormulaPool *pool, const KolibriGene *gene, KolibriEvaluation *out) {
+    uint64_t digest = gene_digest(gene);
+    size_t index = (size_t)digest & pool->fitness_memo_mask;
+    struct KolibriFitnessMemo *ways[2] = {
+        &pool->fitness_memo[index],
+        &pool->fitness_memo[index ^ 1U],
+    };
+    for (size_t w = 0; w < 2U; ++w) {
+        if (memo_matches(ways[w], pool, gene, digest)) {
+            *out = ways[w]->evaluation;
+            return 1;
+        }
+    }
+    struct KolibriFitnessMemo *entry = ways[(digest >> 63) & 1U];
+    if (ways[0]->version != pool->dataset_version) {
+        entry = ways[0];
+    } else if (ways[1]->version != pool->dataset_version) {
+        entry = ways[1];
+    }
+    *out = evaluate_gene_metrics(gene, pool);
+    entry->gene = *gene;
+    entry->digest = digest;
+    entry->version = pool->dataset_version;
+    entry->evaluation = *out;
+    return 0;
+}
+
+static void dataset_changed(KolibriFormulaPool *pool) {
+    pool->dataset_version += 1U;
+}
+
+static void coherence_pairwise(const KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count) {
+    for (size_t i = 0; i < lane_count; ++i) {
+        double adjustment = 0.0;
+        for (size_t j = 0; j < lane_count; ++j) {
+            if (i == j) {
+                continue;
+            }
+            double phase_diff = lanes[j].evaluation.phase - lanes[i].evaluation.phase;
+            double coherence = topo_coherence(&pool->genes[lanes[i].slot], &pool->genes[lanes[j].slot]);
+            adjustment += pool->coherence_gain * cos(phase_diff) * coherence;
+        }
+        lanes[i].score += adjustment;
+    }
+}
+
+/* Σ_j cos(φj - φi) · совпадения(i, j) / L раскладывается в
+ * cos φi · Σ cos φj + sin φi · Σ sin φj по ячейкам (позиция, цифра), так что
+ * сумма по лучам считается за O(лучи · L) и совпадает с попарной. Требует
+ * генов одной длины из цифр 0–9; иначе возвращает -1. */
+static int coherence_histogram(const KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count) {
+    size_t length = pool->genes[lanes[0].slot].length;
+    if (length == 0U) {
+        return -1;
+    }
+    double cos_sum[sizeof(((KolibriGene *)0)->digits)][KOLIBRI_DIGIT_MAX + 1U];
+    double sin_sum[sizeof(((KolibriGene *)0)->digits)][KOLIBRI_DIGIT_MAX + 1U];
+    double cos_phase[KOLIBRI_BEAM_MAX_LANES];
+    double sin_phase[KOLIBRI_BEAM_MAX_LANES];
+    for (size_t i = 0; i < lane_count; ++i) {
+        const KolibriGene *gene = &pool->genes[lanes[i].slot];
+        if (gene->length != length) {
+            return -1;
+        }
+        for (size_t pos = 0; pos < length; ++pos) {
+            if (gene->digits[pos] > KOLIBRI_DIGIT_MAX) {
+                return -1;
+            }
+        }
+    }
+    memset(cos_sum, 0, length * sizeof(cos_sum[0]));
+    memset(sin_sum, 0, length * sizeof(sin_sum[0]));
+    for (size_t i = 0; i < lane_count; ++i) {
+        const uint8_t *digits = pool->genes[lanes[i].slot].digits;
+        cos_phase[i] = cos(lanes[i].evaluation.phase);
+        sin_phase[i] = sin(lanes[i].evaluation.phase);
+        for (size_t pos = 0; pos < length; ++pos) {
+            cos_sum[pos][digits[pos]] += cos_phase[i];
+            sin_sum[pos][digits[pos]] += sin_phase[i];
+        }
+    }
+    for (size_t i = 0; i < lane_count; ++i) {
+        const uint8_t *digits = pool->genes[lanes[i].slot].digits;
+        double matched_cos = 0.0;
+        double matched_sin = 0.0;
+        for (size_t pos = 0; pos < length; ++pos) {
+            matched_cos += cos_sum[pos][digits[pos]];
+            matched_sin += sin_sum[pos][digits[pos]];
+        }
+        /* Вычитаем вклад самого луча: cos 0 · L совпадений. */
+        double total = cos_phase[i] * matched_cos + sin_phase[i] * matched_sin - (double)length;
+        lanes[i].score += pool->coherence_gain * total / (double)length;
+    }
+    return 0;
+}
+
+/* Возвращает число попаданий в памятку оценок. */
+static size_t evaluate_beam_group(KolibriFormulaPool *pool, KolibriBeamLane *lanes, size_t lane_count,
+                                  KolibriTickStats *stats) {
+    size_t hits = 0U;
     if (!pool || !lanes || lane_count == 0U) {
-        return;
+        return hits;
     }
 
     for (size_t i = 0; i < lane_count; ++i) {
-        lanes[i].evaluation = evaluate_formula_metrics(lanes[i].formula, pool);
+        size_t slot = lanes[i].slot;
+        if (pool->evaluated_version[slot] == pool->dataset_version) {
+            lanes[i].evaluation.base_score = pool->base_score[slot];
+            lanes[i].evaluation.drift_b = pool->invariant_drift_b[slot];
+            lanes[i].evaluation.drift_d = pool->invariant_drift_d[slot];
+            lanes[i].evaluation.phase = pool->phase[slot];
+            hits += 1U;
+        } else {
+            hits += (size_t)memo_evaluate(pool, &pool->genes[slot], &lanes[i].evaluation);
+        }
         double penalty = pool->lambda_b * fmax(0.0, lanes[i].evaluation.drift_b) +
                          pool->lambda_d * fmax(0.0, lanes[i].evaluation.drift_d);
         double score = lanes[i].evaluation.base_score - penalty;
         if (score < 0.0) {
             score = 0.0;
         }
-        apply_feedback_bonus(lanes[i].formula, &score);
+        apply_feedback_bonus(pool->feedback[lanes[i].slot], &score);
         lanes[i].score = score;
     }
 
     if (pool->coherence_gain != 0.0) {
-        for (size_t i = 0; i < lane_count; ++i) {
-            double adjustment = 0.0;
-            for (size_t j = 0; j < lane_count; ++j) {
-                if (i == j) {
-                    continue;
-                }
-                double phase_diff = lanes[j].evaluation.phase - lanes[i].evaluation.phase;
-                double coherence = topo_coherence(&lanes[i].formula->gene, &lanes[j].formula->gene);
-                adjustment += pool->coherence_gain * cos(phase_diff) * coherence;
-            }
-            lanes[i].score += adjustment;
+        uint64_t started = monotonic_ns();
+        if (pool->coherence_mode == KOLIBRI_COHERENCE_PAIRWISE ||
+            coherence_histogram(pool, lanes, lane_count) != 0) {
+            coherence_pairwise(pool, lanes, lane_count);
         }
+        stats->stage_ns[KOLIBRI_STAGE_COHERENCE] += monotonic_ns() - started;
     }
 
     for (size_t i = 0; i < lane_count; ++i) {
+        size_t slot = lanes[i].slot;
         lanes[i].score = clamp_score(lanes[i].score);
-        lanes[i].formula->fitness = lanes[i].score;
-        lanes[i].formula->invariant_drift_b = lanes[i].evaluation.drift_b;
-        lanes[i].formula->invariant_drift_d = lanes[i].evaluation.drift_d;
-        lanes[i].formula->phase = lanes[i].evaluation.phase;
+        pool->fitness[slot] = lanes[i].score;
+        pool->invariant_drift_b[slot] = lanes[i].evaluation.drift_b;
+        pool->invariant_drift_d[slot] = lanes[i].evaluation.drift_d;
+        pool->phase[slot] = lanes[i].evaluation.phase;
+        pool->base_score[slot] = lanes[i].evaluation.base_score;
+        pool->evaluated_version[slot] = pool->dataset_version;
+    }
+    return hits;
+}
+
+/* Оценивает пул группами лучей в порядке текущего ранга. */
+static void evaluate_pool(KolibriFormulaPool *pool, KolibriTickStats *stats) {
+    uint64_t started = monotonic_ns();
+    uint64_t coherence_before = stats->stage_ns[KOLIBRI_STAGE_COHERENCE];
+    size_t hits = 0U;
+    size_t index = 0;
+    while (index < pool->count) {
+        KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
+        size_t lane_count = 0U;
+        while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
+            lanes[lane_count].slot = pool->order[index];
+            lanes[lane_count].score = 0.0;
+            lanes[lane_count].evaluation.base_score = 0.0;
+            ++lane_count;
+            ++index;
+        }
+        hits += evaluate_beam_group(pool, lanes, lane_count, stats);
+    }
+    stats->hits += (uint64_t)hits;
+    stats->evaluations += (uint64_t)(pool->count - hits);
+    uint64_t coherence = stats->stage_ns[KOLIBRI_STAGE_COHERENCE] - coherence_before;
+    uint64_t elapsed = monotonic_ns() - started;
+    stats->stage_ns[KOLIBRI_STAGE_EVALUATE] += elapsed > coherence ? elapsed - coherence : 0ULL;
+}
+
+static void profile_reset(KolibriFormulaPool *pool) {
+    memset(&pool->profile, 0, sizeof(pool->profile));
+}
+
+static void profile_publish(KolibriFormulaPool *pool, size_t generations, const KolibriTickStats *stats,
+                            uint64_t elapsed_ns) {
+    KolibriPoolProfile *profile = &pool->profile;
+    profile->last_generation_ms = (double)elapsed_ns / 1e6;
+    KOLIBRI_ATOMIC_ADD_U64(&profile->generation_steps, generations);
+    KOLIBRI_ATOMIC_ADD_U64(&profile->evaluation_calls, stats->evaluations);
+    KOLIBRI_ATOMIC_ADD_U64(&profile->evaluation_cache_hits, stats->hits);
+    for (size_t i = 0; i < KOLIBRI_STAGE_COUNT; ++i) {
+        KOLIBRI_ATOMIC_ADD_U64(&profile->stage_ns[i], stats->stage_ns[i]);
+    }
+    for (size_t i = 0; i < KOLIBRI_PROFILE_LATENCY_BUCKETS; ++i) {
+        if (stats->latency[i] != 0U) {
+            KOLIBRI_ATOMIC_ADD_U64(&profile->generation_latency[i], stats->latency[i]);
+        }
     }
 }
 
@@ -622,16 +1352,100 @@ static void crossover(KolibriFormulaPool *pool, const KolibriGene *parent_a, con
     }
 }
 
-static int compare_formulas(const void *lhs, const void *rhs) {
-    const KolibriFormula *a = (const KolibriFormula *)lhs;
-    const KolibriFormula *b = (const KolibriFormula *)rhs;
-    if (a->fitness < b->fitness) {
-        return 1;
+static void rank_insertion(KolibriFormulaPool *pool, uint32_t *order, size_t count) {
+    for (size_t i = 1; i < count; ++i) {
+        uint32_t slot = order[i];
+        double fitness = pool->fitness[slot];
+        size_t j = i;
+        while (j > 0 && pool->fitness[order[j - 1]] < fitness) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = slot;
     }
-    if (a->fitness > b->fitness) {
-        return -1;
+}
+
+/* Устойчивая сортировка перестановки по убыванию fitness: перемещаются
+ * номера слотов, а не сами формулы. Малые пулы сортируются вставками,
+ * большие — восходящим слиянием через буфер scratch-области. */
+static void rank_pool(KolibriFormulaPool *pool) {
+    size_t count = pool->count;
+    size_t mark = pool->scratch_used;
+    uint32_t *buffer = count > KOLIBRI_RANK_INSERTION_LIMIT
+                           ? (uint32_t *)scratch_alloc(pool, count * sizeof(uint32_t))
+                           : NULL;
+    if (!buffer) {
+        rank_insertion(pool, pool->order, count);
+        return;
     }
-    return 0;
+    for (size_t start = 0; start < count; start += KOLIBRI_RANK_INSERTION_LIMIT) {
+        size_t run = count - start < KOLIBRI_RANK_INSERTION_LIMIT ? count - start : KOLIBRI_RANK_INSERTION_LIMIT;
+        rank_insertion(pool, pool->order + start, run);
+    }
+    uint32_t *src = pool->order;
+    uint32_t *dst = buffer;
+    for (size_t width = KOLIBRI_RANK_INSERTION_LIMIT; width < count; width *= 2U) {
+        for (size_t left = 0; left < count; left += 2U * width) {
+            size_t mid = left + width < count ? left + width : count;
+            size_t right = left + 2U * width < count ? left + 2U * width : count;
+            size_t i = left;
+            size_t j = mid;
+            size_t k = left;
+            while (i < mid && j < right) {
+                dst[k++] = pool->fitness[src[j]] > pool->fitness[src[i]] ? src[j++] : src[i++];
+            }
+            while (i < mid) {
+                dst[k++] = src[i++];
+            }
+            while (j < right) {
+                dst[k++] = src[j++];
+            }
+        }
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != pool->order) {
+        memcpy(pool->order, src, count * sizeof(uint32_t));
+    }
+    pool->scratch_used = mark;
+}
+
+static void timed_rank(KolibriFormulaPool *pool, KolibriTickStats *stats) {
+    uint64_t started = monotonic_ns();
+    rank_pool(pool);
+    stats->stage_ns[KOLIBRI_STAGE_SORT] += monotonic_ns() - started;
+}
+
+static void reset_slot_state(KolibriFormulaPool *pool, size_t slot) {
+    pool->fitness[slot] = 0.0;
+    pool->feedback[slot] = 0.0;
+    pool->invariant_drift_b[slot] = 0.0;
+    pool->invariant_drift_d[slot] = 0.0;
+    pool->phase[slot] = 0.0;
+    pool->association_counts[slot] = 0U;
+    pool->evaluated_version[slot] = 0U;
+}
+
+static void materialize_formula(const KolibriFormulaPool *pool, size_t slot, KolibriFormula *out) {
+    out->gene = pool->genes[slot];
+    out->fitness = pool->fitness[slot];
+    out->feedback = pool->feedback[slot];
+    out->invariant_drift_b = pool->invariant_drift_b[slot];
+    out->invariant_drift_d = pool->invariant_drift_d[slot];
+    out->phase = pool->phase[slot];
+    out->association_store = pool->associations;
+    out->association_count = pool->association_counts[slot];
+    out->association_store_size = pool->association_capacity;
+    out->association_index = pool->association_index;
+    memcpy(out->association_ids, SLOT_ASSOCIATIONS(pool, slot), out->association_count * sizeof(uint32_t));
+}
+
+static void refresh_best(KolibriFormulaPool *pool) {
+    if (pool->count == 0) {
+        return;
+    }
+    materialize_formula(pool, pool->order[0], &pool->best);
 }
 
 static void reproduce(KolibriFormulaPool *pool) {
@@ -647,85 +1461,131 @@ static void reproduce(KolibriFormulaPool *pool) {
         parent_pool = elite;
     }
 
-    for (size_t i = elite; i < pool->count; ++i) {
+    /* Потомки собираются в scratch-области поколения, поэтому родители
+     * не затираются, пока идёт отбор. */
+    scratch_reset(pool);
+    size_t children = pool->count - elite;
+    KolibriGene *brood = (KolibriGene *)scratch_alloc(pool, children * sizeof(KolibriGene));
+    if (!brood) {
+        return;
+    }
+    for (size_t i = 0; i < children; ++i) {
         size_t parent_a_index = (size_t)(k_rng_next(&pool->rng) % parent_pool);
         size_t parent_b_index = (size_t)(k_rng_next(&pool->rng) % parent_pool);
         if (parent_pool > 1U && parent_a_index == parent_b_index) {
             parent_b_index = (parent_b_index + 1U) % parent_pool;
         }
-        KolibriGene child;
-        crossover(pool, &pool->formulas[parent_a_index].gene,
-                  &pool->formulas[parent_b_index].gene, &child);
-        mutate_gene(pool, &child);
-        gene_copy(&child, &pool->formulas[i].gene);
-        pool->formulas[i].fitness = 0.0;
-        pool->formulas[i].feedback = 0.0;
-        pool->formulas[i].invariant_drift_b = 0.0;
-        pool->formulas[i].invariant_drift_d = 0.0;
-        pool->formulas[i].phase = 0.0;
-        pool->formulas[i].association_count = 0;
+        crossover(pool, &pool->genes[pool->order[parent_a_index]],
+                  &pool->genes[pool->order[parent_b_index]], &brood[i]);
+        mutate_gene(pool, &brood[i]);
     }
+    for (size_t i = 0; i < children; ++i) {
+        size_t slot = pool->order[elite + i];
+        gene_copy(&brood[i], &pool->genes[slot]);
+        reset_slot_state(pool, slot);
+    }
+    scratch_reset(pool);
 }
 
-static void copy_dataset_into_formula(const KolibriFormulaPool *pool, KolibriFormula *formula) {
-    if (!pool || !formula) {
-        return;
-    }
+/* Привязывает к слоту самые старые ассоциации пула (не более
+ * KOLIBRI_FORMULA_MAX_ASSOCIATIONS) по номерам. */
+static void assign_dataset_to_slot(KolibriFormulaPool *pool, size_t slot) {
     size_t limit = pool->association_count;
     if (limit > KOLIBRI_FORMULA_MAX_ASSOCIATIONS) {
         limit = KOLIBRI_FORMULA_MAX_ASSOCIATIONS;
     }
-    formula->association_count = limit;
+    uint32_t *ids = SLOT_ASSOCIATIONS(pool, slot);
     for (size_t i = 0; i < limit; ++i) {
-        formula->associations[i] = pool->associations[i];
+        ids[i] = (uint32_t)((pool->association_head + i) % pool->association_capacity);
     }
-    formula->invariant_drift_b = 0.0;
-    formula->invariant_drift_d = 0.0;
+    pool->association_counts[slot] = (uint8_t)limit;
+    pool->invariant_drift_b[slot] = 0.0;
+    pool->invariant_drift_d[slot] = 0.0;
+    /* Дрейфы обнулены вручную: слот оценивается заново, памятка по гену цела. */
+    pool->evaluated_version[slot] = 0U;
 }
 
-static double evaluate_association_fitness(const KolibriFormulaPool *pool) {
-    if (!pool || pool->association_count == 0) {
-        return 0.0;
+static const KolibriAssociation *formula_association(const KolibriFormula *formula, size_t index) {
+    if (!formula->association_store || index >= formula->association_count ||
+        formula->association_ids[index] >= formula->association_store_size) {
+        return NULL;
+    }
+    return &formula->association_store[formula->association_ids[index]];
+}
+
+static double evaluate_association_fitness(const KolibriFormulaPool *pool) {
+    if (!pool || pool->association_count == 0) {
+        return 0.0;
     }
     return 1.0; /* Полное соответствие ассоциациям */
 }
 
 /* ---------------------- Публичные функции ------------------------- */
 
-void kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
+int kf_pool_init(KolibriFormulaPool *pool, uint64_t seed) {
+    KolibriPoolCapacity capacity = {
+        KOLIBRI_POOL_CAPACITY,
+        KOLIBRI_POOL_MAX_EXAMPLES,
+        KOLIBRI_POOL_MAX_ASSOCIATIONS,
+    };
+    return kf_pool_init_with_capacity(pool, &capacity, seed);
+}
+
+int kf_pool_init_with_capacity(KolibriFormulaPool *pool,
+                               const KolibriPoolCapacity *capacity,
+                               uint64_t seed) {
     if (!pool) {
-        return;
+        return -1;
     }
-    pool->count = KOLIBRI_FORMULA_CAPACITY;
-    pool->examples = 0;
-    pool->association_count = 0;
-    pool->lambda_b = 0.0;
-    pool->lambda_d = 0.0;
-    pool->target_b = 0.0;
+    memset(pool, 0, sizeof(*pool));
+    if (!capacity || capacity->formulas == 0U || capacity->formulas > KOLIBRI_POOL_FORMULAS_LIMIT ||
+        capacity->examples == 0U || capacity->examples > KOLIBRI_POOL_EXAMPLES_LIMIT ||
+        capacity->associations == 0U || capacity->associations > KOLIBRI_POOL_ASSOCIATIONS_LIMIT) {
+        return -1;
+    }
+    pool->example_capacity = capacity->examples;
+    pool->association_capacity = capacity->associations;
+    size_t arena_size = pool_layout(pool, NULL, capacity->formulas, 1);
+    /* calloc: нулевые ассоциации уже сброшены, страницы данных не трогаются. */
+    unsigned char *arena = (unsigned char *)calloc(1U, arena_size);
+    if (!arena) {
+        memset(pool, 0, sizeof(*pool));
+        return -1;
+    }
+    pool->association_index = index_create(capacity->associations);
+    if (!pool->association_index) {
+        free(arena);
+        memset(pool, 0, sizeof(*pool));
+        return -1;
+    }
+    pool->arena = arena;
+    pool->arena_size = arena_size;
+    pool_layout(pool, arena, capacity->formulas, 1);
+    pool->count = capacity->formulas;
+    pool->dataset_version = 1U;
     pool->target_d = 0.5;
-    pool->use_custom_target_b = 0;
-    pool->use_custom_target_d = 0;
-    pool->coherence_gain = 0.0;
     pool->temperature = 1.0;
     pool->top_k = pool->count;
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.generation_steps, 0ULL);
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.evaluation_calls, 0ULL);
-    pool->profile.generation_steps = 0ULL;
-    pool->profile.evaluation_calls = 0ULL;
-    pool->profile.last_generation_ms = 0.0;
+    pool->island_count = 1U;
+    pool->migration_interval = 8U;
+    pool->island_threads = 0U;
     k_rng_seed(&pool->rng, seed);
     for (size_t i = 0; i < pool->count; ++i) {
-        gene_randomize(pool, &pool->formulas[i].gene);
-        pool->formulas[i].fitness = 0.0;
-        pool->formulas[i].feedback = 0.0;
-        pool->formulas[i].invariant_drift_b = 0.0;
-        pool->formulas[i].invariant_drift_d = 0.0;
-        pool->formulas[i].phase = 0.0;
-        pool->formulas[i].association_count = 0;
-    }
-    for (size_t i = 0; i < KOLIBRI_POOL_MAX_ASSOCIATIONS; ++i) {
-        association_reset(&pool->associations[i]);
+        gene_randomize(pool, &pool->genes[i]);
+        reset_slot_state(pool, i);
+        pool->order[i] = (uint32_t)i;
     }
+    refresh_best(pool);
+    return 0;
+}
+
+void kf_pool_destroy(KolibriFormulaPool *pool) {
+    if (!pool) {
+        return;
+    }
+    free(pool->arena);
+    index_destroy(pool->association_index);
+    memset(pool, 0, sizeof(*pool));
 }
 
 void kf_pool_clear_examples(KolibriFormulaPool *pool) {
@@ -733,27 +1593,35 @@ void kf_pool_clear_examples(KolibriFormulaPool *pool) {
         return;
     }
     pool->examples = 0;
-    pool->association_count = 0;
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.generation_steps, 0ULL);
-    KOLIBRI_ATOMIC_STORE_U64(&pool->profile.evaluation_calls, 0ULL);
-    pool->profile.generation_steps = 0ULL;
-    pool->profile.evaluation_calls = 0ULL;
-    pool->profile.last_generation_ms = 0.0;
-    for (size_t i = 0; i < KOLIBRI_POOL_MAX_ASSOCIATIONS; ++i) {
+    pool->association_head = 0;
+    dataset_changed(pool);
+    profile_reset(pool);
+    size_t used = pool->association_count;
+    for (size_t i = 0; i < used; ++i) {
         association_reset(&pool->associations[i]);
     }
+    pool->association_count = 0;
+    if (pool->association_index) {
+        index_reset(pool->association_index, pool->association_capacity);
+    }
+    /* Номера слотов хранилища больше ничего не значат. */
+    for (size_t i = 0; i < pool->count; ++i) {
+        pool->association_counts[i] = 0U;
+    }
+    refresh_best(pool);
 }
 
 int kf_pool_add_example(KolibriFormulaPool *pool, int input, int target) {
     if (!pool) {
         return -1;
     }
-    if (pool->examples >= sizeof(pool->inputs) / sizeof(pool->inputs[0])) {
+    if (pool->examples >= pool->example_capacity) {
         return -1;
     }
     pool->inputs[pool->examples] = input;
     pool->targets[pool->examples] = target;
     pool->examples++;
+    dataset_changed(pool);
     return 0;
 }
 
@@ -769,27 +1637,123 @@ int kf_pool_add_association(KolibriFormulaPool *pool,
     KolibriAssociation assoc;
     association_set(&assoc, symbols, question, answer, source, timestamp);
 
-    /* Обновляем существующую запись, если такой вопрос уже был */
-    for (size_t i = 0; i < pool->association_count; ++i) {
-        if (pool->associations[i].input_hash == assoc.input_hash &&
-            strcmp(pool->associations[i].question, assoc.question) == 0) {
-            pool->associations[i] = assoc;
-            return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
-        }
+    if (!pool->association_index) {
+        return -1;
     }
 
-    if (pool->association_count >= KOLIBRI_POOL_MAX_ASSOCIATIONS) {
-        /* вытесняем самое старое знание */
-        memmove(&pool->associations[0], &pool->associations[1],
-                (KOLIBRI_POOL_MAX_ASSOCIATIONS - 1U) * sizeof(KolibriAssociation));
-        pool->associations[KOLIBRI_POOL_MAX_ASSOCIATIONS - 1U] = assoc;
+    /* Обновляем существующую запись, если такой вопрос уже был: вопрос тот же,
+     * поэтому индекс остаётся в силе. */
+    KolibriAssociation *existing =
+        (KolibriAssociation *)index_find(pool->association_index, pool->associations, assoc.input_hash, assoc.question);
+    if (existing) {
+        *existing = assoc;
         return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
     }
 
-    pool->associations[pool->association_count++] = assoc;
+    if (pool->association_count >= pool->association_capacity) {
+        /* вытесняем самое старое знание, не сдвигая остальные слоты */
+        size_t slot = pool->association_head;
+        index_remove(pool, slot);
+        pool->associations[slot] = assoc;
+        index_insert(pool, slot);
+        pool->association_head = (pool->association_head + 1U) % pool->association_capacity;
+        return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
+    }
+
+    size_t slot = pool->association_count++;
+    pool->associations[slot] = assoc;
+    index_insert(pool, slot);
     return kf_pool_add_example(pool, assoc.input_hash, assoc.output_hash);
 }
 
+const KolibriAssociation *kf_pool_find_association(const KolibriFormulaPool *pool, const char *question) {
+    if (!pool || !question) {
+        return NULL;
+    }
+    KolibriAssociation probe;
+    probe.question[0] = '\0';
+    strncpy(probe.question, question, sizeof(probe.question) - 1U);
+    probe.question[sizeof(probe.question) - 1U] = '\0';
+    return index_find(pool->association_index, pool->associations,
+                      kolibri_hash_to_int(fnv1a32(probe.question)), probe.question);
+}
+
+static int match_better(const KolibriFormulaPool *pool, size_t slot, const char *lowered_query,
+                        const KolibriAssociation *best, size_t best_len) {
+    const KolibriAssociation *assoc = &pool->associations[slot];
+    size_t len = strlen(assoc->question);
+    if (len < best_len || (len == best_len && (len == 0U || (best && best < assoc)))) {
+        return 0;
+    }
+    char lowered[KOLIBRI_QUESTION_BYTES];
+    question_lower(assoc->question, lowered);
+    return strstr(lowered_query, lowered) || strstr(lowered, lowered_query);
+}
+
+const KolibriAssociation *kf_pool_match_association(const KolibriFormulaPool *pool, const char *question) {
+    if (!pool || !question) {
+        return NULL;
+    }
+    char lowered[KOLIBRI_QUESTION_BYTES];
+    uint32_t keys[KOLIBRI_QUESTION_BYTES];
+    question_lower(question, lowered);
+    size_t key_count = question_trigrams(lowered, keys);
+    const struct KolibriAssociationIndex *index = pool->association_index;
+    const KolibriAssociation *best = NULL;
+    size_t best_len = 0U;
+    uint8_t *hits = NULL;
+    uint32_t *touched = NULL;
+    if (index && key_count > 0U && pool->association_count > 0U) {
+        hits = (uint8_t *)calloc(pool->association_count, sizeof(uint8_t));
+        touched = (uint32_t *)malloc(pool->association_count * sizeof(uint32_t));
+    }
+    if (!hits || !touched) {
+        /* Короткий запрос (или нет памяти): подстрокой может оказаться любой вопрос. */
+        free(hits);
+        free(touched);
+        for (size_t i = 0; i < pool->association_count; ++i) {
+            if (match_better(pool, i, lowered, best, best_len)) {
+                best = &pool->associations[i];
+                best_len = strlen(best->question);
+            }
+        }
+        return best;
+    }
+    /* Вопрос внутри запроса делит с ним все свои триграммы, запрос внутри
+     * вопроса — все триграммы запроса; strstr проверяет только таких. */
+    size_t touched_count = 0;
+    for (size_t k = 0; k < key_count; ++k) {
+        const KolibriTrigramPosting *posting = posting_find(index, keys[k]);
+        if (!posting) {
+            continue;
+        }
+        for (uint32_t i = posting->start; i < posting->count; ++i) {
+            uint32_t slot = posting->slots[i];
+            if (hits[slot]++ == 0U) {
+                touched[touched_count++] = slot;
+            }
+        }
+    }
+    for (size_t i = 0; i < touched_count; ++i) {
+        uint32_t slot = touched[i];
+        if ((hits[slot] == index->trigram_counts[slot] || hits[slot] == key_count) &&
+            match_better(pool, slot, lowered, best, best_len)) {
+            best = &pool->associations[slot];
+            best_len = strlen(best->question);
+        }
+    }
+    for (size_t i = 0; i < index->short_count; ++i) {
+        uint32_t slot = index->short_slots[i];
+        if (match_better(pool, slot, lowered, best, best_len)) {
+            best = &pool->associations[slot];
+            best_len = strlen(best->question);
+        }
+    }
+    free(hits);
+    free(touched);
+    return best;
+}
+
 void kf_pool_tick(KolibriFormulaPool *pool, size_t generations) {
     if (!pool || pool->count == 0) {
         return;
@@ -799,73 +1763,320 @@ void kf_pool_tick(KolibriFormulaPool *pool, size_t generations) {
         generations = 1;
     }
 
-    clock_t start_clock = clock();
-    uint64_t evaluations = 0ULL;
+    KOLIBRI_TRACE_BEGIN(span, "pool.tick");
+    uint64_t tick_started = monotonic_ns();
+    KolibriTickStats stats;
+    memset(&stats, 0, sizeof(stats));
 
     for (size_t g = 0; g < generations; ++g) {
-        size_t index = 0;
-        while (index < pool->count) {
-            KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
-            size_t lane_count = 0U;
-            while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
-                lanes[lane_count].formula = &pool->formulas[index];
-                lanes[lane_count].score = 0.0;
-                lanes[lane_count].evaluation.base_score = 0.0;
-                ++lane_count;
-                ++index;
-            }
-            evaluate_beam_group(pool, lanes, lane_count);
-        }
-        evaluations += (uint64_t)pool->count;
-        qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
+        uint64_t generation_started = monotonic_ns();
+        evaluate_pool(pool, &stats);
+        timed_rank(pool, &stats);
+        uint64_t reproduce_started = monotonic_ns();
         reproduce(pool);
+        uint64_t generation_finished = monotonic_ns();
+        stats.stage_ns[KOLIBRI_STAGE_REPRODUCE] += generation_finished - reproduce_started;
+        stats.latency[latency_bucket(generation_finished - generation_started)] += 1U;
     }
 
-    size_t index = 0;
-    while (index < pool->count) {
-        KolibriBeamLane lanes[KOLIBRI_BEAM_MAX_LANES];
-        size_t lane_count = 0U;
-        while (lane_count < KOLIBRI_BEAM_MAX_LANES && index < pool->count) {
-            lanes[lane_count].formula = &pool->formulas[index];
-            lanes[lane_count].score = 0.0;
-            lanes[lane_count].evaluation.base_score = 0.0;
-            ++lane_count;
-            ++index;
-        }
-        evaluate_beam_group(pool, lanes, lane_count);
-    }
-    evaluations += (uint64_t)pool->count;
-
-    qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
+    evaluate_pool(pool, &stats);
+    timed_rank(pool, &stats);
 
     if (pool->association_count > 0) {
+        uint64_t started = monotonic_ns();
         double assoc_fitness = evaluate_association_fitness(pool);
         size_t limit = pool->count < 3 ? pool->count : 3;
         for (size_t i = 0; i < limit; ++i) {
-            copy_dataset_into_formula(pool, &pool->formulas[i]);
-            pool->formulas[i].fitness = assoc_fitness;
-            pool->formulas[i].invariant_drift_b = 0.0;
-            pool->formulas[i].invariant_drift_d = 0.0;
+            size_t slot = pool->order[i];
+            assign_dataset_to_slot(pool, slot);
+            pool->fitness[slot] = assoc_fitness;
         }
-        qsort(pool->formulas, pool->count, sizeof(KolibriFormula), compare_formulas);
+        stats.stage_ns[KOLIBRI_STAGE_ASSOCIATIONS] += monotonic_ns() - started;
+        timed_rank(pool, &stats);
     }
+    refresh_best(pool);
+
+    profile_publish(pool, generations, &stats, monotonic_ns() - tick_started);
+    KOLIBRI_TRACE_END(span);
+}
+
+typedef struct {
+    KolibriFormulaPool *islands;
+    size_t island_count;
+    size_t first;
+    size_t stride;
+    size_t generations;
+} KolibriIslandTask;
+
+static void *island_worker(void *arg) {
+    KolibriIslandTask *task = (KolibriIslandTask *)arg;
+    for (size_t i = task->first; i < task->island_count; i += task->stride) {
+        kf_pool_tick(&task->islands[i], task->generations);
+    }
+    return NULL;
+}
 
-    clock_t end_clock = clock();
-    if (start_clock != (clock_t)-1 && end_clock != (clock_t)-1 && end_clock >= start_clock) {
-        double elapsed = ((double)(end_clock - start_clock) * 1000.0) / (double)CLOCKS_PER_SEC;
-        pool->profile.last_generation_ms = elapsed;
+static size_t island_thread_count(const KolibriFormulaPool *pool, size_t islands) {
+    size_t threads = pool->island_threads;
+#if defined(KOLIBRI_FORMULA_HAS_THREADS)
+    if (threads == 0U) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (size_t)cpus : 1U;
     }
-    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.generation_steps, generations);
-    KOLIBRI_ATOMIC_ADD_U64(&pool->profile.evaluation_calls, evaluations);
-    pool->profile.generation_steps += generations;
-    pool->profile.evaluation_calls += evaluations;
+#else
+    threads = 1U;
+#endif
+    if (threads > islands) {
+        threads = islands;
+    }
+    return threads > 0U ? threads : 1U;
+}
+
+static void run_islands(KolibriFormulaPool *islands, size_t island_count, size_t threads, size_t generations) {
+    KolibriIslandTask tasks[KOLIBRI_MAX_ISLANDS];
+    for (size_t t = 0; t < threads; ++t) {
+        tasks[t].islands = islands;
+        tasks[t].island_count = island_count;
+        tasks[t].first = t;
+        tasks[t].stride = threads;
+        tasks[t].generations = generations;
+    }
+#if defined(KOLIBRI_FORMULA_HAS_THREADS)
+    pthread_t handles[KOLIBRI_MAX_ISLANDS];
+    int started[KOLIBRI_MAX_ISLANDS];
+    for (size_t t = 1; t < threads; ++t) {
+        started[t] = pthread_create(&handles[t], NULL, island_worker, &tasks[t]) == 0;
+    }
+    island_worker(&tasks[0]);
+    for (size_t t = 1; t < threads; ++t) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        } else {
+            island_worker(&tasks[t]);
+        }
+    }
+#else
+    for (size_t t = 0; t < threads; ++t) {
+        island_worker(&tasks[t]);
+    }
+#endif
+}
+
+typedef struct {
+    KolibriGene gene;
+    double fitness;
+    double feedback;
+    double invariant_drift_b;
+    double invariant_drift_d;
+    double phase;
+    uint32_t association_ids[KOLIBRI_FORMULA_MAX_ASSOCIATIONS];
+    uint8_t association_count;
+} KolibriMigrant;
+
+static void export_slot(const KolibriFormulaPool *pool, size_t slot, KolibriMigrant *out) {
+    out->gene = pool->genes[slot];
+    out->fitness = pool->fitness[slot];
+    out->feedback = pool->feedback[slot];
+    out->invariant_drift_b = pool->invariant_drift_b[slot];
+    out->invariant_drift_d = pool->invariant_drift_d[slot];
+    out->phase = pool->phase[slot];
+    out->association_count = pool->association_counts[slot];
+    memcpy(out->association_ids, SLOT_ASSOCIATIONS(pool, slot), out->association_count * sizeof(uint32_t));
+}
+
+static void import_slot(KolibriFormulaPool *pool, size_t slot, const KolibriMigrant *in) {
+    pool->genes[slot] = in->gene;
+    pool->fitness[slot] = in->fitness;
+    pool->feedback[slot] = in->feedback;
+    pool->invariant_drift_b[slot] = in->invariant_drift_b;
+    pool->invariant_drift_d[slot] = in->invariant_drift_d;
+    pool->phase[slot] = in->phase;
+    pool->association_counts[slot] = in->association_count;
+    pool->evaluated_version[slot] = 0U;
+    memcpy(SLOT_ASSOCIATIONS(pool, slot), in->association_ids, in->association_count * sizeof(uint32_t));
+}
+
+/* Кольцевая миграция: элита острова i замещает худших на острове i + 1.
+ * Элита снимается до переноса, чтобы мигранты не обходили кольцо за шаг. */
+static void migrate_elites(KolibriFormulaPool *islands, size_t island_count) {
+    size_t migrants = KOLIBRI_ISLAND_MIGRANTS;
+    if (migrants > islands[0].count / 2U) {
+        migrants = islands[0].count / 2U;
+    }
+    if (migrants == 0U) {
+        return;
+    }
+    KolibriMigrant *elite = (KolibriMigrant *)malloc(island_count * migrants * sizeof(KolibriMigrant));
+    if (!elite) {
+        return;
+    }
+    for (size_t i = 0; i < island_count; ++i) {
+        for (size_t m = 0; m < migrants; ++m) {
+            export_slot(&islands[i], islands[i].order[m], &elite[i * migrants + m]);
+        }
+    }
+    for (size_t i = 0; i < island_count; ++i) {
+        KolibriFormulaPool *target = &islands[(i + 1U) % island_count];
+        for (size_t m = 0; m < migrants; ++m) {
+            import_slot(target, target->order[target->count - 1U - m], &elite[i * migrants + m]);
+        }
+    }
+    for (size_t i = 0; i < island_count; ++i) {
+        rank_pool(&islands[i]);
+    }
+    free(elite);
+}
+
+void kf_pool_set_islands(KolibriFormulaPool *pool,
+                         size_t island_count,
+                         size_t migration_interval,
+                         size_t threads) {
+    if (!pool) {
+        return;
+    }
+    if (island_count == 0U) {
+        island_count = 1U;
+    }
+    if (island_count > KOLIBRI_MAX_ISLANDS) {
+        island_count = KOLIBRI_MAX_ISLANDS;
+    }
+    if (threads > KOLIBRI_MAX_ISLANDS) {
+        threads = KOLIBRI_MAX_ISLANDS;
+    }
+    pool->island_count = island_count;
+    pool->migration_interval = migration_interval == 0U ? 1U : migration_interval;
+    pool->island_threads = threads;
+}
+
+void kf_pool_tick_parallel(KolibriFormulaPool *pool, size_t generations) {
+    if (!pool || pool->count == 0) {
+        return;
+    }
+    size_t island_count = pool->island_count;
+    if (island_count > KOLIBRI_MAX_ISLANDS) {
+        island_count = KOLIBRI_MAX_ISLANDS;
+    }
+    KolibriFormulaPool *islands = NULL;
+    if (island_count > 1U) {
+        islands = (KolibriFormulaPool *)malloc(island_count * sizeof(KolibriFormulaPool));
+    }
+    if (!islands) {
+        kf_pool_tick(pool, generations);
+        return;
+    }
+    if (generations == 0) {
+        generations = 1;
+    }
+
+    /* Острова получают свои слоты и scratch, а примеры и ассоциации
+     * читают из арены пула: за тик они не меняются. */
+    size_t slot_arena = pool_layout(&islands[0], NULL, pool->count, 0);
+    arena_slice(NULL, &slot_arena, 0U);
+    unsigned char *arenas = (unsigned char *)malloc(island_count * slot_arena);
+    if (!arenas) {
+        free(islands);
+        kf_pool_tick(pool, generations);
+        return;
+    }
+
+    uint64_t tick_started = monotonic_ns();
+    /* Зерно каждого острова берётся из ГСЧ пула, поэтому результат
+     * детерминирован и не зависит от числа потоков. */
+    for (size_t i = 0; i < island_count; ++i) {
+        KolibriFormulaPool *island = &islands[i];
+        memcpy(island, pool, sizeof(*pool));
+        island->arena = arenas + i * slot_arena;
+        island->arena_size = slot_arena;
+        pool_layout(island, island->arena, pool->count, 0);
+        memcpy(island->arena, pool->arena, island->scratch_offset);
+        k_rng_seed(&island->rng, k_rng_next(&pool->rng));
+        profile_reset(island);
+    }
+
+    size_t threads = island_thread_count(pool, island_count);
+    size_t remaining = generations;
+    while (remaining > 0) {
+        size_t epoch = remaining < pool->migration_interval ? remaining : pool->migration_interval;
+        run_islands(islands, island_count, threads, epoch);
+        remaining -= epoch;
+        if (remaining > 0) {
+            migrate_elites(islands, island_count);
+        }
+    }
+
+    /* Итоговый пул — лучшие слоты всех островов в порядке убывания fitness. */
+    size_t cursor[KOLIBRI_MAX_ISLANDS];
+    memset(cursor, 0, sizeof(cursor));
+    /* Профили островов складываются; гистограмма считает поколения всех островов. */
+    KolibriTickStats stats;
+    memset(&stats, 0, sizeof(stats));
+    for (size_t i = 0; i < island_count; ++i) {
+        const KolibriPoolProfile *profile = &islands[i].profile;
+        stats.evaluations += profile->evaluation_calls;
+        stats.hits += profile->evaluation_cache_hits;
+        for (size_t stage = 0; stage < KOLIBRI_STAGE_COUNT; ++stage) {
+            stats.stage_ns[stage] += profile->stage_ns[stage];
+        }
+        for (size_t bucket = 0; bucket < KOLIBRI_PROFILE_LATENCY_BUCKETS; ++bucket) {
+            stats.latency[bucket] += profile->generation_latency[bucket];
+        }
+    }
+    for (size_t rank = 0; rank < pool->count; ++rank) {
+        size_t best_island = 0;
+        double best_fitness = -1.0;
+        for (size_t i = 0; i < island_count; ++i) {
+            if (cursor[i] >= islands[i].count) {
+                continue;
+            }
+            double fitness = islands[i].fitness[islands[i].order[cursor[i]]];
+            if (fitness > best_fitness) {
+                best_fitness = fitness;
+                best_island = i;
+            }
+        }
+        KolibriFormulaPool *source = &islands[best_island];
+        KolibriMigrant migrant;
+        export_slot(source, source->order[cursor[best_island]], &migrant);
+        import_slot(pool, rank, &migrant);
+        pool->order[rank] = (uint32_t)rank;
+        cursor[best_island] += 1U;
+    }
+    free(arenas);
+    free(islands);
+    refresh_best(pool);
+
+    profile_publish(pool, generations, &stats, monotonic_ns() - tick_started);
 }
 
 const KolibriFormula *kf_pool_best(const KolibriFormulaPool *pool) {
     if (!pool || pool->count == 0) {
         return NULL;
     }
-    return &pool->formulas[0];
+    return &pool->best;
+}
+
+int kf_pool_formula(const KolibriFormulaPool *pool, size_t rank, KolibriFormula *out) {
+    if (!pool || !out || rank >= pool->count) {
+        return -1;
+    }
+    materialize_formula(pool, pool->order[rank], out);
+    return 0;
+}
+
+int kf_pool_import(KolibriFormulaPool *pool, const KolibriFormula *formula) {
+    if (!pool || !formula || pool->count == 0) {
+        return -1;
+    }
+    size_t slot = pool->order[pool->count - 1U];
+    if (gene_copy(&formula->gene, &pool->genes[slot]) != 0) {
+        return -1;
+    }
+    reset_slot_state(pool, slot);
+    pool->fitness[slot] = formula->fitness;
+    pool->feedback[slot] = formula->feedback;
+    rank_pool(pool);
+    refresh_best(pool);
+    return 0;
 }
 
 int kf_formula_lookup_answer(const KolibriFormula *formula, int input,
@@ -873,9 +2084,19 @@ int kf_formula_lookup_answer(const KolibriFormula *formula, int input,
     if (!formula || !buffer || buffer_len == 0) {
         return -1;
     }
+    /* Формула пула отвечает из всего хранилища через индекс по input_hash. */
+    if (formula->association_store) {
+        const KolibriAssociation *assoc =
+            index_find(formula->association_index, formula->association_store, input, NULL);
+        if (assoc) {
+            strncpy(buffer, assoc->answer, buffer_len - 1U);
+            buffer[buffer_len - 1U] = '\0';
+            return 0;
+        }
+    }
     for (size_t i = 0; i < formula->association_count; ++i) {
-        const KolibriAssociation *assoc = &formula->associations[i];
-        if (assoc->input_hash == input && buffer) {
+        const KolibriAssociation *assoc = formula_association(formula, i);
+        if (assoc && assoc->input_hash == input) {
             strncpy(buffer, assoc->answer, buffer_len - 1U);
             buffer[buffer_len - 1U] = '\0';
             return 0;
@@ -889,13 +2110,43 @@ int kf_formula_apply(const KolibriFormula *formula, int input, int *output) {
         return -1;
     }
     for (size_t i = 0; i < formula->association_count; ++i) {
-        const KolibriAssociation *assoc = &formula->associations[i];
-        if (assoc->input_hash == input) {
+        const KolibriAssociation *assoc = formula_association(formula, i);
+        if (assoc && assoc->input_hash == input) {
             *output = assoc->output_hash;
             return 0;
         }
     }
-    return formula_predict_numeric(formula, input, output);
+    return gene_predict_numeric(&formula->gene, input, output);
+}
+
+int kf_formula_batch_error(const KolibriFormula *formula, const int *inputs, const int *targets,
+                           size_t count, int64_t *abs_error, int64_t *prediction_sum) {
+    if (!formula || !abs_error || (count > 0U && (!inputs || !targets))) {
+        return -1;
+    }
+    KolibriGeneOp op;
+    if (gene_decode_op(&formula->gene, &op) != 0) {
+        return -1;
+    }
+    KolibriBatchSums sums = {0, 0, 0};
+    batch_evaluate(&op, inputs, targets, count, &sums);
+    *abs_error = sums.abs_error;
+    if (prediction_sum) {
+        *prediction_sum = sums.predictions;
+    }
+    return 0;
+}
+
+const char *kf_formula_batch_kernel(void) {
+#if defined(KOLIBRI_HAS_AVX2)
+    return "avx2";
+#elif defined(KOLIBRI_HAS_NEON)
+    return "neon";
+#elif defined(KOLIBRI_HAS_WASM_SIMD)
+    return "wasm-simd";
+#else
+    return "scalar";
+#endif
 }
 
 static size_t encode_associations_digits(const KolibriFormula *formula, uint8_t *out, size_t out_len) {
@@ -909,15 +2160,9 @@ static size_t encode_associations_digits(const KolibriFormula *formula, uint8_t
     size_t offset = 0;
     offset += snprintf(json_buffer + offset, sizeof(json_buffer) - offset, "{\"associations\":[");
     for (size_t i = 0; i < formula->association_count && offset < sizeof(json_buffer); ++i) {
-        const KolibriAssociation *assoc = &formula->associations[i];
-        const char *q = assoc->question;
-        const char *a = assoc->answer;
-        if (!q) {
-            q = "";
-        }
-        if (!a) {
-            a = "";
-        }
+        const KolibriAssociation *assoc = formula_association(formula, i);
+        const char *q = assoc ? assoc->question : "";
+        const char *a = assoc ? assoc->answer : "";
         offset += snprintf(json_buffer + offset, sizeof(json_buffer) - offset,
                            "%s{\"q\":\"%s\",\"a\":\"%s\"}",
                            i == 0 ? "" : ",",
@@ -954,8 +2199,8 @@ int kf_formula_describe(const KolibriFormula *formula, char *buffer, size_t buff
     if (!formula || !buffer || buffer_len == 0) {
         return -1;
     }
-    if (formula->association_count > 0) {
-        const KolibriAssociation *assoc = &formula->associations[0];
+    const KolibriAssociation *assoc = formula_association(formula, 0);
+    if (assoc) {
         int written = snprintf(buffer, buffer_len,
                                "ассоциаций=%zu пример: '%s' -> '%s' фитнес=%.6f",
                                formula->association_count, assoc->question,
@@ -1003,23 +2248,20 @@ int kf_formula_describe(const KolibriFormula *formula, char *buffer, size_t buff
     return 0;
 }
 
-static void adjust_feedback(KolibriFormula *formula, double delta) {
-    if (!formula) {
-        return;
-    }
-    formula->feedback += delta;
-    if (formula->feedback > 1.0) {
-        formula->feedback = 1.0;
+static void adjust_feedback(KolibriFormulaPool *pool, size_t slot, double delta) {
+    pool->feedback[slot] += delta;
+    if (pool->feedback[slot] > 1.0) {
+        pool->feedback[slot] = 1.0;
     }
-    if (formula->feedback < -1.0) {
-        formula->feedback = -1.0;
+    if (pool->feedback[slot] < -1.0) {
+        pool->feedback[slot] = -1.0;
     }
-    formula->fitness += delta;
-    if (formula->fitness < 0.0) {
-        formula->fitness = 0.0;
+    pool->fitness[slot] += delta;
+    if (pool->fitness[slot] < 0.0) {
+        pool->fitness[slot] = 0.0;
     }
-    if (formula->fitness > 1.0) {
-        formula->fitness = 1.0;
+    if (pool->fitness[slot] > 1.0) {
+        pool->fitness[slot] = 1.0;
     }
 }
 
@@ -1028,30 +2270,32 @@ int kf_pool_feedback(KolibriFormulaPool *pool, const KolibriGene *gene, double d
         return -1;
     }
     for (size_t i = 0; i < pool->count; ++i) {
-        if (pool->formulas[i].gene.length != gene->length) {
+        size_t slot = pool->order[i];
+        if (pool->genes[slot].length != gene->length) {
             continue;
         }
-        if (memcmp(pool->formulas[i].gene.digits, gene->digits, gene->length) != 0) {
+        if (memcmp(pool->genes[slot].digits, gene->digits, gene->length) != 0) {
             continue;
         }
-        adjust_feedback(&pool->formulas[i], delta);
+        adjust_feedback(pool, slot, delta);
         size_t index = i;
         if (delta > 0.0) {
-            while (index > 0 && pool->formulas[index].fitness > pool->formulas[index - 1].fitness) {
-                KolibriFormula tmp = pool->formulas[index - 1];
-                pool->formulas[index - 1] = pool->formulas[index];
-                pool->formulas[index] = tmp;
+            while (index > 0 && pool->fitness[pool->order[index]] > pool->fitness[pool->order[index - 1]]) {
+                uint32_t tmp = pool->order[index - 1];
+                pool->order[index - 1] = pool->order[index];
+                pool->order[index] = tmp;
                 index--;
             }
         } else if (delta < 0.0) {
             while (index + 1 < pool->count &&
-                   pool->formulas[index].fitness < pool->formulas[index + 1].fitness) {
-                KolibriFormula tmp = pool->formulas[index + 1];
-                pool->formulas[index + 1] = pool->formulas[index];
-                pool->formulas[index] = tmp;
+                   pool->fitness[pool->order[index]] < pool->fitness[pool->order[index + 1]]) {
+                uint32_t tmp = pool->order[index + 1];
+                pool->order[index + 1] = pool->order[index];
+                pool->order[index] = tmp;
                 index++;
             }
         }
+        refresh_best(pool);
         return 0;
     }
     return -1;
@@ -1087,6 +2331,7 @@ void kf_pool_set_targets(KolibriFormulaPool *pool, double target_b, double targe
     } else {
         pool->use_custom_target_d = 0;
     }
+    dataset_changed(pool);
 }
 
 void kf_pool_set_coherence_gain(KolibriFormulaPool *pool, double gain) {
@@ -1100,6 +2345,14 @@ void kf_pool_set_coherence_gain(KolibriFormulaPool *pool, double gain) {
     }
 }
 
+void kf_pool_set_coherence_mode(KolibriFormulaPool *pool, KolibriCoherenceMode mode) {
+    if (!pool) {
+        return;
+    }
+    pool->coherence_mode = mode == KOLIBRI_COHERENCE_PAIRWISE ? KOLIBRI_COHERENCE_PAIRWISE
+                                                             : KOLIBRI_COHERENCE_HISTOGRAM;
+}
+
 void kf_pool_set_sampling(KolibriFormulaPool *pool, double temperature, size_t top_k) {
     if (!pool) {
         return;
@@ -1116,16 +2369,423 @@ void kf_pool_set_sampling(KolibriFormulaPool *pool, double temperature, size_t t
     }
     pool->temperature = temperature;
 
-    size_t capacity = sizeof(pool->formulas) / sizeof(pool->formulas[0]);
+    size_t capacity = pool->count;
     if (top_k == 0U || top_k > capacity) {
         top_k = capacity;
     }
     pool->top_k = top_k;
 }
 
+const char *kf_pool_stage_name(KolibriPoolStage stage) {
+    switch (stage) {
+    case KOLIBRI_STAGE_EVALUATE:
+        return "evaluate";
+    case KOLIBRI_STAGE_COHERENCE:
+        return "coherence";
+    case KOLIBRI_STAGE_SORT:
+        return "sort";
+    case KOLIBRI_STAGE_REPRODUCE:
+        return "reproduce";
+    case KOLIBRI_STAGE_ASSOCIATIONS:
+        return "associations";
+    default:
+        return "unknown";
+    }
+}
+
 const KolibriPoolProfile *kf_pool_profile(const KolibriFormulaPool *pool) {
     if (!pool) {
         return NULL;
     }
     return &pool->profile;
 }
+
+size_t kf_pool_memory_usage(const KolibriFormulaPool *pool) {
+    if (!pool) {
+        return 0U;
+    }
+    size_t total = pool->arena_size;
+    const struct KolibriAssociationIndex *index = pool->association_index;
+    if (index) {
+        total += sizeof(*index);
+        total += (index->exact_mask + 1U) * sizeof(uint32_t);
+        total += (index->trigram_mask + 1U) * sizeof(KolibriTrigramPosting);
+        for (size_t i = 0; i <= index->trigram_mask; ++i) {
+            total += (size_t)index->trigrams[i].capacity * sizeof(uint32_t);
+        }
+        total += pool->association_capacity * (sizeof(uint16_t) + sizeof(uint32_t));
+    }
+    return total;
+}
+
+/* ---------------------- Контрольная точка пула ---------------------- */
+
+/* Файл: заголовок фиксированной длины и полезная нагрузка в порядке байтов
+ * машины. Нагрузка: по слотам гены, оценки и ассоциации формул, затем
+ * перестановка order, примеры и хранилище ассоциаций по номерам слотов.
+ * Оценки примеров не сохраняются: слоты пересчитываются на первом тике. */
+#define KOLIBRI_CHECKPOINT_MAGIC "KFPC"
+#define KOLIBRI_CHECKPOINT_VERSION 1U
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t formulas;
+    uint64_t example_capacity;
+    uint64_t examples;
+    uint64_t association_capacity;
+    uint64_t association_count;
+    uint64_t association_head;
+    uint64_t rng_state;
+    uint64_t dataset_version;
+    double lambda_b;
+    double lambda_d;
+    double target_b;
+    double target_d;
+    double coherence_gain;
+    double temperature;
+    uint32_t use_custom_target_b;
+    uint32_t use_custom_target_d;
+    uint32_t coherence_mode;
+    uint32_t reserved;
+    uint64_t top_k;
+    uint64_t island_count;
+    uint64_t migration_interval;
+    uint64_t island_threads;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+} KolibriPoolCheckpointHeader;
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} KolibriCheckpointWriter;
+
+typedef struct {
+    const unsigned char *data;
+    size_t length;
+    size_t offset;
+} KolibriCheckpointReader;
+
+static uint64_t checkpoint_hash(const unsigned char *data, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void checkpoint_put(KolibriCheckpointWriter *writer, const void *bytes, size_t length) {
+    if (writer->failed) {
+        return;
+    }
+    if (writer->capacity - writer->length < length) {
+        size_t grown = writer->capacity ? writer->capacity : 4096U;
+        while (grown - writer->length < length) {
+            grown *= 2U;
+        }
+        unsigned char *data = (unsigned char *)realloc(writer->data, grown);
+        if (!data) {
+            writer->failed = 1;
+            return;
+        }
+        writer->data = data;
+        writer->capacity = grown;
+    }
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void checkpoint_put_u32(KolibriCheckpointWriter *writer, uint32_t value) {
+    checkpoint_put(writer, &value, sizeof(value));
+}
+
+/* Строка фиксированного поля: длина и байты без завершающего нуля. */
+static void checkpoint_put_text(KolibriCheckpointWriter *writer, const char *text, size_t field_size) {
+    size_t length = strnlen(text, field_size - 1U);
+    checkpoint_put_u32(writer, (uint32_t)length);
+    checkpoint_put(writer, text, length);
+}
+
+static int checkpoint_get(KolibriCheckpointReader *reader, void *out, size_t length) {
+    if (reader->length - reader->offset < length) {
+        return -1;
+    }
+    memcpy(out, reader->data + reader->offset, length);
+    reader->offset += length;
+    return 0;
+}
+
+static int checkpoint_get_bytes(KolibriCheckpointReader *reader, void *out, size_t field_size, size_t *out_length) {
+    uint32_t length = 0U;
+    if (checkpoint_get(reader, &length, sizeof(length)) != 0 || length > field_size ||
+        checkpoint_get(reader, out, length) != 0) {
+        return -1;
+    }
+    *out_length = length;
+    return 0;
+}
+
+static int checkpoint_get_text(KolibriCheckpointReader *reader, char *out, size_t field_size) {
+    size_t length = 0U;
+    if (checkpoint_get_bytes(reader, out, field_size - 1U, &length) != 0) {
+        return -1;
+    }
+    memset(out + length, 0, field_size - length);
+    return 0;
+}
+
+static void checkpoint_write_payload(const KolibriFormulaPool *pool, KolibriCheckpointWriter *writer) {
+    for (size_t slot = 0; slot < pool->count; ++slot) {
+        const KolibriGene *gene = &pool->genes[slot];
+        uint8_t lengths[2] = { (uint8_t)gene->length, pool->association_counts[slot] };
+        const double scores[5] = { pool->fitness[slot], pool->feedback[slot], pool->invariant_drift_b[slot],
+                                   pool->invariant_drift_d[slot], pool->phase[slot] };
+        checkpoint_put(writer, gene->digits, sizeof(gene->digits));
+        checkpoint_put(writer, lengths, sizeof(lengths));
+        checkpoint_put(writer, scores, sizeof(scores));
+        checkpoint_put(writer, SLOT_ASSOCIATIONS(pool, slot), lengths[1] * sizeof(uint32_t));
+    }
+    checkpoint_put(writer, pool->order, pool->count * sizeof(uint32_t));
+    for (size_t i = 0; i < pool->examples; ++i) {
+        const int32_t example[2] = { (int32_t)pool->inputs[i], (int32_t)pool->targets[i] };
+        checkpoint_put(writer, example, sizeof(example));
+    }
+    for (size_t slot = 0; slot < pool->association_count; ++slot) {
+        const KolibriAssociation *assoc = &pool->associations[slot];
+        const int32_t hashes[2] = { (int32_t)assoc->input_hash, (int32_t)assoc->output_hash };
+        checkpoint_put(writer, hashes, sizeof(hashes));
+        checkpoint_put(writer, &assoc->timestamp, sizeof(assoc->timestamp));
+        checkpoint_put_text(writer, assoc->question, sizeof(assoc->question));
+        checkpoint_put_text(writer, assoc->answer, sizeof(assoc->answer));
+        checkpoint_put_text(writer, assoc->source, sizeof(assoc->source));
+        checkpoint_put_u32(writer, (uint32_t)assoc->question_digits_length);
+        checkpoint_put(writer, assoc->question_digits, assoc->question_digits_length);
+        checkpoint_put_u32(writer, (uint32_t)assoc->answer_digits_length);
+        checkpoint_put(writer, assoc->answer_digits, assoc->answer_digits_length);
+    }
+}
+
+static int checkpoint_read_payload(KolibriFormulaPool *pool, KolibriCheckpointReader *reader) {
+    for (size_t slot = 0; slot < pool->count; ++slot) {
+        KolibriGene *gene = &pool->genes[slot];
+        uint8_t lengths[2];
+        double scores[5];
+        if (checkpoint_get(reader, gene->digits, sizeof(gene->digits)) != 0 ||
+            checkpoint_get(reader, lengths, sizeof(lengths)) != 0 || lengths[0] > sizeof(gene->digits) ||
+            lengths[1] > KOLIBRI_FORMULA_MAX_ASSOCIATIONS || checkpoint_get(reader, scores, sizeof(scores)) != 0) {
+            return -1;
+        }
+        uint32_t *ids = SLOT_ASSOCIATIONS(pool, slot);
+        if (checkpoint_get(reader, ids, lengths[1] * sizeof(uint32_t)) != 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < lengths[1]; ++i) {
+            if (ids[i] >= pool->association_capacity) {
+                return -1;
+            }
+        }
+        gene->length = lengths[0];
+        pool->association_counts[slot] = lengths[1];
+        pool->fitness[slot] = scores[0];
+        pool->feedback[slot] = scores[1];
+        pool->invariant_drift_b[slot] = scores[2];
+        pool->invariant_drift_d[slot] = scores[3];
+        pool->phase[slot] = scores[4];
+        pool->evaluated_version[slot] = 0U;
+    }
+    if (checkpoint_get(reader, pool->order, pool->count * sizeof(uint32_t)) != 0) {
+        return -1;
+    }
+    /* order обязана быть перестановкой слотов: scratch-область служит
+     * отметками, пока пул не тикал. */
+    uint8_t *seen = (uint8_t *)scratch_alloc(pool, pool->count);
+    if (!seen) {
+        return -1;
+    }
+    memset(seen, 0, pool->count);
+    for (size_t i = 0; i < pool->count; ++i) {
+        if (pool->order[i] >= pool->count || seen[pool->order[i]]) {
+            scratch_reset(pool);
+            return -1;
+        }
+        seen[pool->order[i]] = 1U;
+    }
+    scratch_reset(pool);
+    for (size_t i = 0; i < pool->examples; ++i) {
+        int32_t example[2];
+        if (checkpoint_get(reader, example, sizeof(example)) != 0) {
+            return -1;
+        }
+        pool->inputs[i] = example[0];
+        pool->targets[i] = example[1];
+    }
+    for (size_t slot = 0; slot < pool->association_count; ++slot) {
+        KolibriAssociation *assoc = &pool->associations[slot];
+        int32_t hashes[2];
+        if (checkpoint_get(reader, hashes, sizeof(hashes)) != 0 ||
+            checkpoint_get(reader, &assoc->timestamp, sizeof(assoc->timestamp)) != 0 ||
+            checkpoint_get_text(reader, assoc->question, sizeof(assoc->question)) != 0 ||
+            checkpoint_get_text(reader, assoc->answer, sizeof(assoc->answer)) != 0 ||
+            checkpoint_get_text(reader, assoc->source, sizeof(assoc->source)) != 0 ||
+            checkpoint_get_bytes(reader, assoc->question_digits, sizeof(assoc->question_digits),
+                                 &assoc->question_digits_length) != 0 ||
+            checkpoint_get_bytes(reader, assoc->answer_digits, sizeof(assoc->answer_digits),
+                                 &assoc->answer_digits_length) != 0) {
+            return -1;
+        }
+        assoc->input_hash = hashes[0];
+        assoc->output_hash = hashes[1];
+        index_insert(pool, slot);
+    }
+    return reader->offset == reader->length ? 0 : -1;
+}
+
+int kf_pool_save_checkpoint(const KolibriFormulaPool *pool, const char *path) {
+    if (!pool || !pool->arena || !path) {
+        return -1;
+    }
+    KolibriPoolCheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KOLIBRI_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = KOLIBRI_CHECKPOINT_VERSION;
+    header.formulas = pool->count;
+    header.example_capacity = pool->example_capacity;
+    header.examples = pool->examples;
+    header.association_capacity = pool->association_capacity;
+    header.association_count = pool->association_count;
+    header.association_head = pool->association_head;
+    header.rng_state = pool->rng.state;
+    header.dataset_version = pool->dataset_version;
+    header.lambda_b = pool->lambda_b;
+    header.lambda_d = pool->lambda_d;
+    header.target_b = pool->target_b;
+    header.target_d = pool->target_d;
+    header.coherence_gain = pool->coherence_gain;
+    header.temperature = pool->temperature;
+    header.use_custom_target_b = (uint32_t)pool->use_custom_target_b;
+    header.use_custom_target_d = (uint32_t)pool->use_custom_target_d;
+    header.coherence_mode = (uint32_t)pool->coherence_mode;
+    header.top_k = pool->top_k;
+    header.island_count = pool->island_count;
+    header.migration_interval = pool->migration_interval;
+    header.island_threads = pool->island_threads;
+
+    KolibriCheckpointWriter writer = { NULL, 0U, 0U, 0 };
+    checkpoint_write_payload(pool, &writer);
+    if (writer.failed) {
+        free(writer.data);
+        return -1;
+    }
+    header.payload_size = writer.length;
+    header.payload_hash = checkpoint_hash(writer.data, writer.length);
+
+    /* Временный файл и rename: упавшая запись не портит прежнюю точку. */
+    size_t path_length = strlen(path);
+    char *tmp_path = (char *)malloc(path_length + sizeof(".tmp"));
+    if (!tmp_path) {
+        free(writer.data);
+        return -1;
+    }
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", sizeof(".tmp"));
+    FILE *file = fopen(tmp_path, "wb");
+    int rc = file ? 0 : -1;
+    if (rc == 0 && (fwrite(&header, sizeof(header), 1U, file) != 1U ||
+                    (writer.length > 0U && fwrite(writer.data, writer.length, 1U, file) != 1U))) {
+        rc = -1;
+    }
+    if (file && fclose(file) != 0) {
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp_path, path) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        remove(tmp_path);
+    }
+    free(tmp_path);
+    free(writer.data);
+    return rc;
+}
+
+int kf_pool_load_checkpoint(KolibriFormulaPool *pool, const char *path) {
+    if (!pool || !path) {
+        return -1;
+    }
+    memset(pool, 0, sizeof(*pool));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    KolibriPoolCheckpointHeader header;
+    if (fread(&header, sizeof(header), 1U, file) != 1U) {
+        fclose(file);
+        return -2;
+    }
+    if (memcmp(header.magic, KOLIBRI_CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != KOLIBRI_CHECKPOINT_VERSION || header.examples > header.example_capacity ||
+        header.association_count > header.association_capacity ||
+        (header.association_count > 0U && header.association_head >= header.association_capacity) ||
+        header.coherence_mode > (uint32_t)KOLIBRI_COHERENCE_PAIRWISE || header.payload_size > SIZE_MAX) {
+        fclose(file);
+        return -2;
+    }
+    unsigned char *payload = (unsigned char *)malloc(header.payload_size ? (size_t)header.payload_size : 1U);
+    if (!payload) {
+        fclose(file);
+        return -1;
+    }
+    size_t got = fread(payload, 1U, (size_t)header.payload_size, file);
+    int trailing = fgetc(file) != EOF;
+    fclose(file);
+    if (got != header.payload_size || trailing) {
+        free(payload);
+        return -2;
+    }
+    if (checkpoint_hash(payload, got) != header.payload_hash) {
+        free(payload);
+        return -3;
+    }
+
+    KolibriPoolCapacity capacity = {
+        (size_t)header.formulas,
+        (size_t)header.example_capacity,
+        (size_t)header.association_capacity,
+    };
+    if (kf_pool_init_with_capacity(pool, &capacity, 0U) != 0) {
+        free(payload);
+        return -2;
+    }
+    pool->rng.state = header.rng_state;
+    pool->dataset_version = header.dataset_version;
+    pool->examples = (size_t)header.examples;
+    pool->association_count = (size_t)header.association_count;
+    pool->association_head = (size_t)header.association_head;
+    pool->lambda_b = header.lambda_b;
+    pool->lambda_d = header.lambda_d;
+    pool->target_b = header.target_b;
+    pool->target_d = header.target_d;
+    pool->coherence_gain = header.coherence_gain;
+    pool->temperature = header.temperature;
+    pool->use_custom_target_b = header.use_custom_target_b != 0U;
+    pool->use_custom_target_d = header.use_custom_target_d != 0U;
+    pool->coherence_mode = (KolibriCoherenceMode)header.coherence_mode;
+    pool->top_k = (size_t)header.top_k;
+    pool->island_count = header.island_count ? (size_t)header.island_count : 1U;
+    pool->migration_interval = (size_t)header.migration_interval;
+    pool->island_threads = (size_t)header.island_threads;
+
+    KolibriCheckpointReader reader = { payload, got, 0U };
+    int rc = checkpoint_read_payload(pool, &reader);
+    free(payload);
+    if (rc != 0) {
+        kf_pool_destroy(pool);
+        return -2;
+    }
+    refresh_best(pool);
+    return 0;
+}
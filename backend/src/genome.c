@@ -6,18 +6,61 @@
 
 #include "kolibri/decimal.h"
 
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+
+#if defined(KOLIBRI_HAVE_ZLIB)
+#include <zlib.h>
+#endif
 
 #define KOLIBRI_HMAC_INPUT_SIZE                                                \
   (KOLIBRI_BLOCK_SIZE - KOLIBRI_HASH_SIZE)
 
+#define KOLIBRI_CHECKPOINT_MAGIC "KGCK"
+#define KOLIBRI_CHECKPOINT_BODY_SIZE (8 + 8 + KOLIBRI_HASH_SIZE)
+#define KOLIBRI_CHECKPOINT_SIZE (KOLIBRI_CHECKPOINT_BODY_SIZE + KOLIBRI_HASH_SIZE)
+#define KOLIBRI_VERIFY_MAX_THREADS 16
+/* Меньше этого числа блоков на поток распараллеливание не окупается. */
+#define KOLIBRI_VERIFY_MIN_BLOCKS_PER_THREAD 2048
+
+/* Формат v2: заголовок "KGN2" + версия, затем кадры. Кадр — флаги, число
+ * блоков, индекс первого, prev_hash первого, новые типы событий, длина тела и
+ * тело из записей {тип, дельта времени, HMAC, упакованные цифры}. */
+#define KOLIBRI_GENOME_MAGIC "KGN2"
+#define KOLIBRI_GENOME_HEADER_SIZE 8
+#define KOLIBRI_FRAME_DEFLATE 0x1U
+/* Верхняя граница записи v2: два varint, HMAC и 255 упакованных цифр. */
+#define KOLIBRI_RECORD_MAX_SIZE (10 + 10 + KOLIBRI_HASH_SIZE + 2 + 107)
+/* Блоков в кадре при конвертации: крупные кадры лучше сжимаются. */
+#define KOLIBRI_CONVERT_FRAME_BLOCKS 4096
+/* Более короткие тела deflate не сокращает. */
+#define KOLIBRI_COMPRESS_MIN_BYTES 256
+
+/* Индекс сегмента: заголовок "KGIX", участки {первый блок, наибольшее время,
+ * смещение, размер словаря v2}, имена типов, битовые карты типов по участкам
+ * и SHA-256 всего предыдущего. */
+#define KOLIBRI_INDEX_MAGIC "KGIX"
+#define KOLIBRI_INDEX_VERSION 1
+#define KOLIBRI_INDEX_HEADER_SIZE (8 + 6 * 8)
+#define KOLIBRI_INDEX_ENTRY_SIZE (4 * 8)
+/* Блоков на участок; в v2 участок начинается с границы кадра. */
+#define KOLIBRI_INDEX_SPAN_BLOCKS 256
+#define KOLIBRI_SEGMENT_PATH_SIZE (sizeof(((KolibriGenome *)0)->path) + 16)
+
 static void reset_context(KolibriGenome *ctx) {
   if (!ctx) {
     return;
@@ -27,9 +70,54 @@ static void reset_context(KolibriGenome *ctx) {
   memset(ctx->last_block, 0, sizeof(ctx->last_block));
   memset(ctx->hmac_key, 0, sizeof(ctx->hmac_key));
   ctx->hmac_key_len = 0;
+  ctx->hmac_ctx = NULL;
   memset(ctx->path, 0, sizeof(ctx->path));
   ctx->next_index = 0;
   ctx->has_last_block = 0;
+  ctx->sync_interval_ns = 0;
+  ctx->last_sync_ns = 0;
+  ctx->format = KOLIBRI_GENOME_FORMAT_V1;
+  ctx->flags = 0;
+  ctx->end_offset = 0;
+  memset(&ctx->types, 0, sizeof(ctx->types));
+  ctx->segment_bytes = 0;
+  ctx->segment = 0;
+  ctx->segment_first = 0;
+}
+
+/* Ключ раскрывается в блоки ipad/opad один раз; дальше каждый блок лишь
+ * сбрасывает контекст к этому состоянию. */
+static EVP_MAC_CTX *mac_context_new(const unsigned char *key, size_t key_len) {
+  EVP_MAC *mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+  if (!mac) {
+    return NULL;
+  }
+  EVP_MAC_CTX *mac_ctx = EVP_MAC_CTX_new(mac);
+  EVP_MAC_free(mac);
+  if (!mac_ctx) {
+    return NULL;
+  }
+  OSSL_PARAM params[2];
+  params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                               (char *)"SHA256", 0);
+  params[1] = OSSL_PARAM_construct_end();
+  if (EVP_MAC_init(mac_ctx, key, key_len, params) != 1) {
+    EVP_MAC_CTX_free(mac_ctx);
+    return NULL;
+  }
+  return mac_ctx;
+}
+
+static int mac_compute(EVP_MAC_CTX *mac_ctx, const unsigned char *data,
+                       size_t len, unsigned char *out) {
+  size_t out_len = 0;
+  if (!mac_ctx || EVP_MAC_init(mac_ctx, NULL, 0, NULL) != 1 ||
+      EVP_MAC_update(mac_ctx, data, len) != 1 ||
+      EVP_MAC_final(mac_ctx, out, &out_len, KOLIBRI_HASH_SIZE) != 1 ||
+      out_len != KOLIBRI_HASH_SIZE) {
+    return -1;
+  }
+  return 0;
 }
 
 static void encode_u64_be(uint64_t value, unsigned char *out) {
@@ -96,6 +184,537 @@ static int payload_is_digits(const char *payload) {
   return 0;
 }
 
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t cap;
+} ByteBuf;
+
+static int buf_reserve(ByteBuf *buf, size_t extra) {
+  if (extra > SIZE_MAX - buf->len) {
+    return -1;
+  }
+  size_t need = buf->len + extra;
+  if (need <= buf->cap) {
+    return 0;
+  }
+  size_t cap = buf->cap ? buf->cap : 256;
+  while (cap < need) {
+    cap = cap > SIZE_MAX / 2 ? need : cap * 2;
+  }
+  unsigned char *data = (unsigned char *)realloc(buf->data, cap);
+  if (!data) {
+    return -1;
+  }
+  buf->data = data;
+  buf->cap = cap;
+  return 0;
+}
+
+static int buf_put(ByteBuf *buf, const void *src, size_t len) {
+  if (buf_reserve(buf, len) != 0) {
+    return -1;
+  }
+  if (len > 0) {
+    memcpy(buf->data + buf->len, src, len);
+  }
+  buf->len += len;
+  return 0;
+}
+
+static int buf_varint(ByteBuf *buf, uint64_t value) {
+  unsigned char bytes[10];
+  size_t len = 0;
+  do {
+    unsigned char byte = (unsigned char)(value & 0x7FU);
+    value >>= 7;
+    bytes[len++] = (unsigned char)(byte | (value ? 0x80U : 0U));
+  } while (value);
+  return buf_put(buf, bytes, len);
+}
+
+/* 1 — данные кончились посреди числа. */
+static int get_varint(const unsigned char *data, size_t size, size_t *pos,
+                      uint64_t *out) {
+  uint64_t value = 0;
+  for (unsigned int shift = 0; shift < 64; shift += 7) {
+    if (*pos >= size) {
+      return 1;
+    }
+    unsigned char byte = data[(*pos)++];
+    value |= (uint64_t)(byte & 0x7FU) << shift;
+    if (!(byte & 0x80U)) {
+      *out = value;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Время хранится разностью с предыдущим блоком кадра; часы могут идти назад. */
+static uint64_t zigzag_encode(uint64_t delta) {
+  int64_t value = (int64_t)delta;
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static uint64_t zigzag_decode(uint64_t value) {
+  return (value >> 1) ^ (~(value & 1U) + 1U);
+}
+
+static size_t packed_digits_size(size_t count) {
+  static const size_t tail_bits[3] = {0, 4, 7};
+  return ((count / 3) * 10 + tail_bits[count % 3] + 7) / 8;
+}
+
+/* Тройка цифр 000..999 занимает 10 бит, хвост из одной или двух цифр — 4 или
+ * 7 бит: 1,25 байта на исходный байт вместо трёх. */
+static int pack_digits(ByteBuf *buf, const char *digits, size_t count) {
+  size_t size = packed_digits_size(count);
+  if (buf_varint(buf, count) != 0 || buf_reserve(buf, size) != 0) {
+    return -1;
+  }
+  unsigned char *out = buf->data + buf->len;
+  uint32_t acc = 0;
+  unsigned int bits = 0;
+  size_t at = 0;
+  for (size_t i = 0; i < count; i += 3) {
+    size_t left = count - i;
+    unsigned int width = left >= 3 ? 10U : (left == 2 ? 7U : 4U);
+    uint32_t value = (uint32_t)(digits[i] - '0');
+    if (left >= 2) {
+      value = value * 10U + (uint32_t)(digits[i + 1] - '0');
+    }
+    if (left >= 3) {
+      value = value * 10U + (uint32_t)(digits[i + 2] - '0');
+    }
+    acc |= value << bits;
+    bits += width;
+    while (bits >= 8) {
+      out[at++] = (unsigned char)(acc & 0xFFU);
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+  if (bits > 0) {
+    out[at++] = (unsigned char)acc;
+  }
+  buf->len += size;
+  return 0;
+}
+
+/* Биты заполнения обязаны быть нулевыми: у каждой строки цифр одна запись. */
+static int unpack_digits(const unsigned char *data, size_t size, size_t *pos,
+                         char *out) {
+  uint64_t count = 0;
+  if (get_varint(data, size, pos, &count) != 0 ||
+      count >= KOLIBRI_PAYLOAD_SIZE) {
+    return -1;
+  }
+  size_t bytes = packed_digits_size((size_t)count);
+  if (bytes > size - *pos) {
+    return -1;
+  }
+  const unsigned char *in = data + *pos;
+  uint32_t acc = 0;
+  unsigned int bits = 0;
+  size_t at = 0;
+  memset(out, 0, KOLIBRI_PAYLOAD_SIZE);
+  for (size_t i = 0; i < (size_t)count; i += 3) {
+    size_t left = (size_t)count - i;
+    unsigned int width = left >= 3 ? 10U : (left == 2 ? 7U : 4U);
+    while (bits < width) {
+      acc |= (uint32_t)in[at++] << bits;
+      bits += 8;
+    }
+    uint32_t value = acc & ((1U << width) - 1U);
+    acc >>= width;
+    bits -= width;
+    if (left >= 3) {
+      if (value > 999U) {
+        return -1;
+      }
+      out[i] = (char)('0' + value / 100U);
+      out[i + 1] = (char)('0' + value / 10U % 10U);
+      out[i + 2] = (char)('0' + value % 10U);
+    } else if (left == 2) {
+      if (value > 99U) {
+        return -1;
+      }
+      out[i] = (char)('0' + value / 10U);
+      out[i + 1] = (char)('0' + value % 10U);
+    } else {
+      if (value > 9U) {
+        return -1;
+      }
+      out[i] = (char)('0' + value);
+    }
+  }
+  if (acc != 0) {
+    return -1;
+  }
+  *pos += bytes;
+  return 0;
+}
+
+static int types_reserve(KolibriGenomeTypes *types, size_t extra) {
+  if (extra <= types->capacity - types->count) {
+    return 0;
+  }
+  size_t capacity = types->capacity ? types->capacity : 16;
+  while (capacity - types->count < extra) {
+    if (capacity > SIZE_MAX / 2 / KOLIBRI_EVENT_TYPE_SIZE) {
+      return -1;
+    }
+    capacity *= 2;
+  }
+  char(*names)[KOLIBRI_EVENT_TYPE_SIZE] =
+      realloc(types->names, capacity * KOLIBRI_EVENT_TYPE_SIZE);
+  if (!names) {
+    return -1;
+  }
+  types->names = names;
+  types->capacity = capacity;
+  return 0;
+}
+
+static int types_add(KolibriGenomeTypes *types, const char *name, size_t len) {
+  if (len >= KOLIBRI_EVENT_TYPE_SIZE || types_reserve(types, 1) != 0) {
+    return -1;
+  }
+  memset(types->names[types->count], 0, KOLIBRI_EVENT_TYPE_SIZE);
+  memcpy(types->names[types->count], name, len);
+  types->count += 1;
+  return 0;
+}
+
+static int types_find(const KolibriGenomeTypes *types, const char *name,
+                      size_t *out_id) {
+  for (size_t i = 0; i < types->count; ++i) {
+    if (strncmp(types->names[i], name, KOLIBRI_EVENT_TYPE_SIZE) == 0) {
+      *out_id = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void types_free(KolibriGenomeTypes *types) {
+  free(types->names);
+  memset(types, 0, sizeof(*types));
+}
+
+/* v2 хранит только значащую часть полей, поэтому хвост после нуля обязан быть
+ * нулевым — иначе канонический блок не восстановится байт в байт. */
+static int block_is_canonical(const ReasonBlock *block) {
+  size_t type_len = strnlen(block->event_type, KOLIBRI_EVENT_TYPE_SIZE);
+  size_t payload_len = strnlen(block->payload, KOLIBRI_PAYLOAD_SIZE);
+  if (type_len == KOLIBRI_EVENT_TYPE_SIZE ||
+      payload_len == KOLIBRI_PAYLOAD_SIZE) {
+    return 0;
+  }
+  for (size_t i = type_len; i < KOLIBRI_EVENT_TYPE_SIZE; ++i) {
+    if (block->event_type[i] != '\0') {
+      return 0;
+    }
+  }
+  for (size_t i = 0; i < KOLIBRI_PAYLOAD_SIZE; ++i) {
+    char ch = block->payload[i];
+    if (i < payload_len ? (ch < '0' || ch > '9') : ch != '\0') {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+typedef struct {
+  ByteBuf body;
+  KolibriGenomeTypes added;
+  uint64_t first_index;
+  uint64_t count;
+  uint64_t prev_timestamp;
+  unsigned char prev_hash[KOLIBRI_HASH_SIZE];
+} FrameBuilder;
+
+/* known — словарь файла; незнакомые типы копятся в added и получают номера
+ * следом за ним. */
+static int frame_add(FrameBuilder *frame, const KolibriGenomeTypes *known,
+                     const ReasonBlock *block) {
+  if (!block_is_canonical(block)) {
+    return -1;
+  }
+  if (frame->count == 0) {
+    frame->first_index = block->index;
+    memcpy(frame->prev_hash, block->prev_hash, KOLIBRI_HASH_SIZE);
+  }
+  size_t id = 0;
+  if (types_find(known, block->event_type, &id) != 0) {
+    if (types_find(&frame->added, block->event_type, &id) != 0) {
+      if (types_add(&frame->added, block->event_type,
+                    strlen(block->event_type)) != 0) {
+        return -1;
+      }
+      id = frame->added.count - 1;
+    }
+    id += known->count;
+  }
+  if (buf_varint(&frame->body, id) != 0 ||
+      buf_varint(&frame->body,
+                 zigzag_encode(block->timestamp - frame->prev_timestamp)) != 0 ||
+      buf_put(&frame->body, block->hmac, KOLIBRI_HASH_SIZE) != 0 ||
+      pack_digits(&frame->body, block->payload, strlen(block->payload)) != 0) {
+    return -1;
+  }
+  frame->prev_timestamp = block->timestamp;
+  frame->count += 1;
+  return 0;
+}
+
+static int frame_finish(FrameBuilder *frame, unsigned int flags, ByteBuf *out) {
+  unsigned char frame_flags = 0;
+  const unsigned char *body = frame->body.data;
+  size_t body_len = frame->body.len;
+  unsigned char *packed = NULL;
+#if defined(KOLIBRI_HAVE_ZLIB)
+  if ((flags & KOLIBRI_GENOME_COMPRESS) &&
+      body_len >= KOLIBRI_COMPRESS_MIN_BYTES) {
+    uLongf packed_len = compressBound((uLong)body_len);
+    packed = (unsigned char *)malloc(packed_len);
+    if (packed &&
+        compress2(packed, &packed_len, body, (uLong)body_len,
+                  Z_DEFAULT_COMPRESSION) == Z_OK &&
+        packed_len < body_len) {
+      frame_flags = KOLIBRI_FRAME_DEFLATE;
+      body = packed;
+      body_len = packed_len;
+    }
+  }
+#else
+  (void)flags;
+#endif
+  out->len = 0;
+  int rc = 0;
+  if (buf_put(out, &frame_flags, 1) != 0 ||
+      buf_varint(out, frame->count) != 0 ||
+      buf_varint(out, frame->first_index) != 0 ||
+      buf_put(out, frame->prev_hash, KOLIBRI_HASH_SIZE) != 0 ||
+      buf_varint(out, frame->added.count) != 0) {
+    rc = -1;
+  }
+  for (size_t i = 0; rc == 0 && i < frame->added.count; ++i) {
+    unsigned char len = (unsigned char)strlen(frame->added.names[i]);
+    if (buf_put(out, &len, 1) != 0 ||
+        buf_put(out, frame->added.names[i], len) != 0) {
+      rc = -1;
+    }
+  }
+  if (rc == 0 &&
+      (buf_varint(out, body_len) != 0 ||
+       ((frame_flags & KOLIBRI_FRAME_DEFLATE) &&
+        buf_varint(out, frame->body.len) != 0) ||
+       buf_put(out, body, body_len) != 0)) {
+    rc = -1;
+  }
+  free(packed);
+  return rc;
+}
+
+static void frame_builder_free(FrameBuilder *frame) {
+  free(frame->body.data);
+  types_free(&frame->added);
+  memset(frame, 0, sizeof(*frame));
+}
+
+typedef struct {
+  size_t end;
+  unsigned int flags;
+  uint64_t count;
+  uint64_t first_index;
+  const unsigned char *prev_hash;
+  const unsigned char *body;
+  size_t body_len;
+  size_t raw_len;
+  size_t types_end;
+} GenomeFrame;
+
+static int genome_is_v2(const unsigned char *data, size_t size) {
+  return size >= KOLIBRI_GENOME_HEADER_SIZE &&
+         memcmp(data, KOLIBRI_GENOME_MAGIC, 4) == 0;
+}
+
+static int genome_header_valid(const unsigned char *data) {
+  return data[4] == KOLIBRI_GENOME_FORMAT_V2 && data[5] == 0 && data[6] == 0 &&
+         data[7] == 0;
+}
+
+/* Разбирает заголовок кадра и дописывает его типы в словарь; тело не
+ * трогается. 1 — кадр обрывается концом файла. */
+static int frame_parse(const unsigned char *data, size_t size, size_t offset,
+                       KolibriGenomeTypes *types, GenomeFrame *frame) {
+  size_t pos = offset;
+  uint64_t value = 0;
+  int rc = 0;
+  if (pos >= size) {
+    return 1;
+  }
+  frame->flags = data[pos++];
+  if (frame->flags & ~KOLIBRI_FRAME_DEFLATE) {
+    return -1;
+  }
+  if ((rc = get_varint(data, size, &pos, &frame->count)) != 0 ||
+      (rc = get_varint(data, size, &pos, &frame->first_index)) != 0) {
+    return rc;
+  }
+  if (frame->count == 0 ||
+      frame->count > SIZE_MAX / KOLIBRI_RECORD_MAX_SIZE) {
+    return -1;
+  }
+  if (size - pos < KOLIBRI_HASH_SIZE) {
+    return 1;
+  }
+  frame->prev_hash = data + pos;
+  pos += KOLIBRI_HASH_SIZE;
+  if ((rc = get_varint(data, size, &pos, &value)) != 0) {
+    return rc;
+  }
+  for (uint64_t i = 0; i < value; ++i) {
+    if (pos >= size) {
+      return 1;
+    }
+    size_t len = data[pos++];
+    if (len >= KOLIBRI_EVENT_TYPE_SIZE) {
+      return -1;
+    }
+    if (size - pos < len) {
+      return 1;
+    }
+    if (memchr(data + pos, '\0', len) ||
+        types_add(types, (const char *)(data + pos), len) != 0) {
+      return -1;
+    }
+    pos += len;
+  }
+  frame->types_end = types->count;
+  if ((rc = get_varint(data, size, &pos, &value)) != 0) {
+    return rc;
+  }
+  frame->body_len = (size_t)value;
+  frame->raw_len = frame->body_len;
+  if ((frame->flags & KOLIBRI_FRAME_DEFLATE) &&
+      (rc = get_varint(data, size, &pos, &value)) != 0) {
+    return rc;
+  }
+  if (frame->flags & KOLIBRI_FRAME_DEFLATE) {
+    frame->raw_len = (size_t)value;
+  }
+  if (frame->raw_len > frame->count * KOLIBRI_RECORD_MAX_SIZE) {
+    return -1;
+  }
+  if (frame->body_len > size - pos) {
+    return 1;
+  }
+  frame->body = data + pos;
+  frame->end = pos + frame->body_len;
+  return 0;
+}
+
+/* Тело кадра; сжатое распаковывается в scratch. */
+static const unsigned char *frame_body(const GenomeFrame *frame,
+                                       unsigned char **scratch,
+                                       size_t *capacity) {
+  if (!(frame->flags & KOLIBRI_FRAME_DEFLATE)) {
+    return frame->body;
+  }
+#if defined(KOLIBRI_HAVE_ZLIB)
+  if (frame->raw_len == 0) {
+    return NULL;
+  }
+  if (frame->raw_len > *capacity) {
+    unsigned char *grown = (unsigned char *)realloc(*scratch, frame->raw_len);
+    if (!grown) {
+      return NULL;
+    }
+    *scratch = grown;
+    *capacity = frame->raw_len;
+  }
+  uLongf len = (uLongf)frame->raw_len;
+  if (uncompress(*scratch, &len, frame->body, (uLong)frame->body_len) != Z_OK ||
+      len != frame->raw_len) {
+    return NULL;
+  }
+  return *scratch;
+#else
+  (void)scratch;
+  (void)capacity;
+  return NULL;
+#endif
+}
+
+/* out_type, если не NULL, получает номер типа в словаре. */
+static int record_decode(const unsigned char *data, size_t size, size_t *pos,
+                         const KolibriGenomeTypes *types, size_t types_end,
+                         uint64_t *timestamp, ReasonBlock *block,
+                         size_t *out_type) {
+  uint64_t id = 0;
+  uint64_t delta = 0;
+  if (get_varint(data, size, pos, &id) != 0 || id >= types_end ||
+      get_varint(data, size, pos, &delta) != 0 ||
+      size - *pos < KOLIBRI_HASH_SIZE) {
+    return -1;
+  }
+  memcpy(block->event_type, types->names[id], KOLIBRI_EVENT_TYPE_SIZE);
+  if (out_type) {
+    *out_type = (size_t)id;
+  }
+  *timestamp += zigzag_decode(delta);
+  block->timestamp = *timestamp;
+  memcpy(block->hmac, data + *pos, KOLIBRI_HASH_SIZE);
+  *pos += KOLIBRI_HASH_SIZE;
+  return unpack_digits(data, size, pos, block->payload);
+}
+
+typedef int (*BlockVisit)(void *arg, const ReasonBlock *block,
+                          const unsigned char *bytes);
+
+/* Раскрывает кадр в канонические блоки v1: prev_hash первого берётся из
+ * заголовка, каждого следующего — SHA-256 предыдущего. */
+static int frame_expand(const GenomeFrame *frame, const unsigned char *body,
+                        const KolibriGenomeTypes *types, BlockVisit visit,
+                        void *arg, unsigned char *last_hash,
+                        unsigned char *last_bytes) {
+  ReasonBlock block;
+  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
+  unsigned char prev[KOLIBRI_HASH_SIZE];
+  memcpy(prev, frame->prev_hash, KOLIBRI_HASH_SIZE);
+  uint64_t timestamp = 0;
+  size_t pos = 0;
+  for (uint64_t i = 0; i < frame->count; ++i) {
+    memset(&block, 0, sizeof(block));
+    if (record_decode(body, frame->raw_len, &pos, types, frame->types_end,
+                      &timestamp, &block, NULL) != 0) {
+      return -1;
+    }
+    block.index = frame->first_index + i;
+    memcpy(block.prev_hash, prev, KOLIBRI_HASH_SIZE);
+    serialize_block(&block, bytes);
+    if (visit && visit(arg, &block, bytes) != 0) {
+      return -1;
+    }
+    if (!SHA256(bytes, KOLIBRI_BLOCK_SIZE, prev)) {
+      return -1;
+    }
+  }
+  if (pos != frame->raw_len) {
+    return -1;
+  }
+  if (last_hash) {
+    memcpy(last_hash, prev, KOLIBRI_HASH_SIZE);
+  }
+  if (last_bytes) {
+    memcpy(last_bytes, bytes, KOLIBRI_BLOCK_SIZE);
+  }
+  return 0;
+}
+
 static uint64_t current_time_ns(void) {
 #if defined(CLOCK_REALTIME)
   struct timespec ts;
@@ -111,7 +730,7 @@ static uint64_t current_time_ns(void) {
 }
 
 static int parse_and_verify_block(const unsigned char *bytes,
-                                  const unsigned char *key, size_t key_len,
+                                  EVP_MAC_CTX *mac_ctx,
                                   uint64_t expected_index,
                                   const unsigned char *expected_prev,
                                   ReasonBlock *out_block,
@@ -136,11 +755,7 @@ static int parse_and_verify_block(const unsigned char *bytes,
   build_hmac_message(&block, message);
 
   unsigned char computed[KOLIBRI_HASH_SIZE];
-  unsigned int hmac_len = 0;
-  unsigned char *result =
-      HMAC(EVP_sha256(), key, (int)key_len, message, sizeof(message), computed,
-           &hmac_len);
-  if (!result || hmac_len != KOLIBRI_HASH_SIZE) {
+  if (mac_compute(mac_ctx, message, sizeof(message), computed) != 0) {
     return -1;
   }
 
@@ -161,86 +776,1243 @@ static int parse_and_verify_block(const unsigned char *bytes,
   return 0;
 }
 
-int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
-            size_t key_len) {
-  if (!ctx || !path || !key || key_len == 0 ||
-      key_len > sizeof(ctx->hmac_key)) {
-    return -1;
+typedef struct {
+  const unsigned char *data;
+  uint64_t base;
+  size_t begin;
+  size_t end;
+  const unsigned char *key;
+  size_t key_len;
+  const unsigned char *first_prev;
+  int status;
+} VerifyTask;
+
+/* Проверяет блоки [begin, end). Ссылка prev_hash первого блока диапазона
+ * сверяется с first_prev либо с хэшем предыдущего блока в отображении, так что
+ * диапазоны независимы и проверяются параллельно. */
+static void *verify_range(void *arg) {
+  VerifyTask *task = (VerifyTask *)arg;
+  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
+  if (task->first_prev) {
+    memcpy(expected_prev, task->first_prev, KOLIBRI_HASH_SIZE);
+  } else if (!SHA256(task->data + (task->begin - 1) * KOLIBRI_BLOCK_SIZE,
+                     KOLIBRI_BLOCK_SIZE, expected_prev)) {
+    task->status = -1;
+    return NULL;
+  }
+  EVP_MAC_CTX *mac_ctx = mac_context_new(task->key, task->key_len);
+  if (!mac_ctx) {
+    task->status = -1;
+    return NULL;
+  }
+  task->status = 0;
+  for (size_t i = task->begin; i < task->end; ++i) {
+    unsigned char block_hash[KOLIBRI_HASH_SIZE];
+    if (parse_and_verify_block(task->data + i * KOLIBRI_BLOCK_SIZE, mac_ctx,
+                               task->base + i, expected_prev, NULL,
+                               block_hash) != 0) {
+      task->status = -1;
+      break;
+    }
+    memcpy(expected_prev, block_hash, KOLIBRI_HASH_SIZE);
   }
+  EVP_MAC_CTX_free(mac_ctx);
+  return NULL;
+}
 
-  reset_context(ctx);
+static size_t verify_thread_count(size_t blocks) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = cpus > 0 ? (size_t)cpus : 1;
+  if (threads > KOLIBRI_VERIFY_MAX_THREADS) {
+    threads = KOLIBRI_VERIFY_MAX_THREADS;
+  }
+  size_t useful = blocks / KOLIBRI_VERIFY_MIN_BLOCKS_PER_THREAD;
+  if (threads > useful) {
+    threads = useful;
+  }
+  return threads > 0 ? threads : 1;
+}
 
-  FILE *file = fopen(path, "r+b");
-  if (!file) {
-    file = fopen(path, "w+b");
-    if (!file) {
-      return -1;
-    }
+/* Проверяет блоки [begin, end) отображённого сегмента; base — индекс первого
+ * блока сегмента, first_prev — ожидаемый prev_hash блока begin. */
+static int verify_mapped(const unsigned char *data, uint64_t base,
+                         size_t begin, size_t end,
+                         const unsigned char *first_prev,
+                         const unsigned char *key, size_t key_len,
+                         size_t threads) {
+  if (begin >= end) {
+    return 0;
+  }
+  if (threads == 0) {
+    threads = verify_thread_count(end - begin);
+  }
+  if (threads > end - begin) {
+    threads = end - begin;
+  }
+  if (threads > KOLIBRI_VERIFY_MAX_THREADS) {
+    threads = KOLIBRI_VERIFY_MAX_THREADS;
   }
 
-  ctx->file = file;
-  strncpy(ctx->path, path, sizeof(ctx->path) - 1);
-  memcpy(ctx->hmac_key, key, key_len);
-  ctx->hmac_key_len = key_len;
+  VerifyTask tasks[KOLIBRI_VERIFY_MAX_THREADS];
+  pthread_t handles[KOLIBRI_VERIFY_MAX_THREADS];
+  int started[KOLIBRI_VERIFY_MAX_THREADS];
+  size_t span = (end - begin) / threads;
+  for (size_t t = 0; t < threads; ++t) {
+    tasks[t].data = data;
+    tasks[t].base = base;
+    tasks[t].begin = begin + t * span;
+    tasks[t].end = (t + 1 == threads) ? end : begin + (t + 1) * span;
+    tasks[t].key = key;
+    tasks[t].key_len = key_len;
+    tasks[t].first_prev = (t == 0) ? first_prev : NULL;
+    tasks[t].status = -1;
+    started[t] = t > 0 &&
+                 pthread_create(&handles[t], NULL, verify_range, &tasks[t]) == 0;
+  }
+  verify_range(&tasks[0]);
+  int rc = tasks[0].status;
+  for (size_t t = 1; t < threads; ++t) {
+    if (started[t]) {
+      pthread_join(handles[t], NULL);
+    } else {
+      verify_range(&tasks[t]);
+    }
+    if (tasks[t].status != 0) {
+      rc = -1;
+    }
+  }
+  return rc;
+}
 
-  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
-  memset(expected_prev, 0, sizeof(expected_prev));
-  uint64_t expected_index = 0;
+typedef struct {
+  GenomeFrame *items;
+  size_t count;
+  size_t capacity;
+  uint64_t blocks;
+} FrameList;
 
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  size_t read = 0;
-  while ((read = fread(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file)) ==
-         KOLIBRI_BLOCK_SIZE) {
-    unsigned char block_hash[KOLIBRI_HASH_SIZE];
-    ReasonBlock block;
-    if (parse_and_verify_block(bytes, key, key_len, expected_index,
-                               expected_prev, &block, block_hash) != 0) {
-      kg_close(ctx);
+/* Проходит только заголовки кадров: словарь и число блоков без распаковки тел. */
+static int scan_frames(const unsigned char *data, size_t size,
+                       KolibriGenomeTypes *types, FrameList *list) {
+  if (!genome_header_valid(data)) {
+    return -1;
+  }
+  size_t offset = KOLIBRI_GENOME_HEADER_SIZE;
+  while (offset < size) {
+    if (list->count == list->capacity) {
+      size_t capacity = list->capacity ? list->capacity * 2 : 64;
+      GenomeFrame *items =
+          (GenomeFrame *)realloc(list->items, capacity * sizeof(GenomeFrame));
+      if (!items) {
+        return -1;
+      }
+      list->items = items;
+      list->capacity = capacity;
+    }
+    GenomeFrame *frame = &list->items[list->count];
+    if (frame_parse(data, size, offset, types, frame) != 0 ||
+        frame->first_index != list->blocks) {
       return -1;
     }
+    list->blocks += frame->count;
+    list->count += 1;
+    offset = frame->end;
+  }
+  return 0;
+}
 
-    memcpy(ctx->last_hash, block.hmac, KOLIBRI_HASH_SIZE);
-    memcpy(ctx->last_block, bytes, KOLIBRI_BLOCK_SIZE);
-    ctx->has_last_block = 1;
-    memcpy(expected_prev, block_hash, KOLIBRI_HASH_SIZE);
-    expected_index = block.index + 1;
+/* Кадр, которому принадлежит блок index. */
+static size_t frame_containing(const FrameList *list, uint64_t index) {
+  size_t lo = 0;
+  size_t hi = list->count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (list->items[mid].first_index <= index) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
   }
+  return lo;
+}
 
-  if (read != 0) {
-    kg_close(ctx);
+typedef struct {
+  uint64_t index;
+  unsigned char *hash;
+} BlockHashVisit;
+
+static int capture_hash_visit(void *arg, const ReasonBlock *block,
+                              const unsigned char *bytes) {
+  BlockHashVisit *visit = (BlockHashVisit *)arg;
+  if (block->index == visit->index &&
+      !SHA256(bytes, KOLIBRI_BLOCK_SIZE, visit->hash)) {
     return -1;
   }
+  return 0;
+}
 
-  if (ferror(ctx->file)) {
-    kg_close(ctx);
+static int verify_visit(void *arg, const ReasonBlock *block,
+                        const unsigned char *bytes) {
+  (void)bytes;
+  unsigned char message[KOLIBRI_HMAC_INPUT_SIZE];
+  unsigned char computed[KOLIBRI_HASH_SIZE];
+  build_hmac_message(block, message);
+  if (mac_compute((EVP_MAC_CTX *)arg, message, sizeof(message), computed) != 0) {
     return -1;
   }
+  return memcmp(computed, block->hmac, KOLIBRI_HASH_SIZE) == 0 ? 0 : -1;
+}
 
-  ctx->next_index = expected_index;
+typedef struct {
+  const GenomeFrame *frames;
+  size_t begin;
+  size_t end;
+  const KolibriGenomeTypes *types;
+  const unsigned char *key;
+  size_t key_len;
+  unsigned char *last_hashes;
+  int status;
+} FrameVerifyTask;
 
-  if (fseek(ctx->file, 0, SEEK_END) != 0) {
-    kg_close(ctx);
-    return -1;
+static void *verify_frame_range(void *arg) {
+  FrameVerifyTask *task = (FrameVerifyTask *)arg;
+  EVP_MAC_CTX *mac_ctx = mac_context_new(task->key, task->key_len);
+  if (!mac_ctx) {
+    task->status = -1;
+    return NULL;
   }
-
-  return 0;
+  unsigned char *scratch = NULL;
+  size_t capacity = 0;
+  task->status = 0;
+  for (size_t i = task->begin; i < task->end; ++i) {
+    const unsigned char *body = frame_body(&task->frames[i], &scratch, &capacity);
+    if (!body ||
+        frame_expand(&task->frames[i], body, task->types, verify_visit, mac_ctx,
+                     task->last_hashes + i * KOLIBRI_HASH_SIZE, NULL) != 0) {
+      task->status = -1;
+      break;
+    }
+  }
+  free(scratch);
+  EVP_MAC_CTX_free(mac_ctx);
+  return NULL;
 }
 
-void kg_close(KolibriGenome *ctx) {
-  if (!ctx) {
-    return;
+/* Проверяет кадры с begin до конца. Внутри кадра цепочка восстанавливается
+ * при раскрытии, поэтому кадры проверяются параллельно, а стыки — prev_hash
+ * кадра против хэша последнего блока предыдущего — сверяются после. first_prev
+ * == NULL доверяет prev_hash первого кадра (он заверен контрольной точкой). */
+static int verify_frames(const FrameList *list, size_t begin,
+                         const unsigned char *first_prev,
+                         const KolibriGenomeTypes *types,
+                         const unsigned char *key, size_t key_len,
+                         size_t threads) {
+  if (begin >= list->count) {
+    return 0;
   }
-  if (ctx->file) {
-    fclose(ctx->file);
-    ctx->file = NULL;
+  if (first_prev &&
+      memcmp(list->items[begin].prev_hash, first_prev, KOLIBRI_HASH_SIZE) != 0) {
+    return -1;
   }
-  memset(ctx->last_hash, 0, sizeof(ctx->last_hash));
-  memset(ctx->last_block, 0, sizeof(ctx->last_block));
+  unsigned char *last_hashes =
+      (unsigned char *)malloc(list->count * KOLIBRI_HASH_SIZE);
+  if (!last_hashes) {
+    return -1;
+  }
+  uint64_t base = list->items[begin].first_index;
+  uint64_t blocks = list->blocks - base;
+  if (threads == 0) {
+    threads = verify_thread_count((size_t)blocks);
+  }
+  if (threads > list->count - begin) {
+    threads = list->count - begin;
+  }
+  if (threads > KOLIBRI_VERIFY_MAX_THREADS) {
+    threads = KOLIBRI_VERIFY_MAX_THREADS;
+  }
+
+  /* Границы диапазонов — по числу блоков, а не кадров: кадры бывают из
+   * одного блока и из тысяч. */
+  FrameVerifyTask tasks[KOLIBRI_VERIFY_MAX_THREADS];
+  pthread_t handles[KOLIBRI_VERIFY_MAX_THREADS];
+  int started[KOLIBRI_VERIFY_MAX_THREADS];
+  size_t cursor = begin;
+  for (size_t t = 0; t < threads; ++t) {
+    uint64_t goal = base + blocks * (t + 1) / threads;
+    tasks[t].frames = list->items;
+    tasks[t].begin = cursor;
+    while (cursor < list->count &&
+           (t + 1 == threads || list->items[cursor].first_index < goal)) {
+      ++cursor;
+    }
+    tasks[t].end = cursor;
+    tasks[t].types = types;
+    tasks[t].key = key;
+    tasks[t].key_len = key_len;
+    tasks[t].last_hashes = last_hashes;
+    tasks[t].status = -1;
+    started[t] = t > 0 && pthread_create(&handles[t], NULL, verify_frame_range,
+                                         &tasks[t]) == 0;
+  }
+  verify_frame_range(&tasks[0]);
+  int rc = tasks[0].status;
+  for (size_t t = 1; t < threads; ++t) {
+    if (started[t]) {
+      pthread_join(handles[t], NULL);
+    } else {
+      verify_frame_range(&tasks[t]);
+    }
+    if (tasks[t].status != 0) {
+      rc = -1;
+    }
+  }
+  for (size_t i = begin + 1; rc == 0 && i < list->count; ++i) {
+    if (memcmp(list->items[i].prev_hash,
+               last_hashes + (i - 1) * KOLIBRI_HASH_SIZE,
+               KOLIBRI_HASH_SIZE) != 0) {
+      rc = -1;
+    }
+  }
+  free(last_hashes);
+  return rc;
+}
+
+static void checkpoint_path(const char *path, char *out, size_t out_len) {
+  snprintf(out, out_len, "%s.ckpt", path);
+}
+
+static int checkpoint_mac(const unsigned char *key, size_t key_len,
+                          const unsigned char *body, unsigned char *out) {
+  unsigned int mac_len = 0;
+  if (!HMAC(EVP_sha256(), key, (int)key_len, body, KOLIBRI_CHECKPOINT_BODY_SIZE,
+            out, &mac_len) ||
+      mac_len != KOLIBRI_HASH_SIZE) {
+    return -1;
+  }
+  return 0;
+}
+
+/* Контрольная точка: число проверенных блоков и SHA-256 последнего из них,
+ * подписанные ключом генома. */
+static int read_checkpoint(const char *path, const unsigned char *key,
+                           size_t key_len, uint64_t *out_count,
+                           unsigned char *out_hash) {
+  char ckpt[sizeof(((KolibriGenome *)0)->path) + 8];
+  checkpoint_path(path, ckpt, sizeof(ckpt));
+  FILE *file = fopen(ckpt, "rb");
+  if (!file) {
+    return -1;
+  }
+  unsigned char bytes[KOLIBRI_CHECKPOINT_SIZE];
+  size_t read = fread(bytes, 1, sizeof(bytes), file);
+  fclose(file);
+  if (read != sizeof(bytes) || memcmp(bytes, KOLIBRI_CHECKPOINT_MAGIC, 4) != 0) {
+    return -1;
+  }
+  unsigned char mac[KOLIBRI_HASH_SIZE];
+  if (checkpoint_mac(key, key_len, bytes, mac) != 0 ||
+      memcmp(mac, bytes + KOLIBRI_CHECKPOINT_BODY_SIZE, KOLIBRI_HASH_SIZE) != 0) {
+    return -1;
+  }
+  *out_count = decode_u64_be(bytes + 8);
+  memcpy(out_hash, bytes + 16, KOLIBRI_HASH_SIZE);
+  return 0;
+}
+
+int kg_write_checkpoint(KolibriGenome *ctx) {
+  if (!ctx || !ctx->file || !ctx->has_last_block) {
+    return -1;
+  }
+  unsigned char bytes[KOLIBRI_CHECKPOINT_SIZE];
+  memset(bytes, 0, sizeof(bytes));
+  memcpy(bytes, KOLIBRI_CHECKPOINT_MAGIC, 4);
+  encode_u64_be(ctx->next_index, bytes + 8);
+  if (!SHA256(ctx->last_block, KOLIBRI_BLOCK_SIZE, bytes + 16) ||
+      checkpoint_mac(ctx->hmac_key, ctx->hmac_key_len, bytes,
+                     bytes + KOLIBRI_CHECKPOINT_BODY_SIZE) != 0) {
+    return -1;
+  }
+
+  char ckpt[sizeof(ctx->path) + 8];
+  char tmp[sizeof(ctx->path) + 16];
+  checkpoint_path(ctx->path, ckpt, sizeof(ckpt));
+  snprintf(tmp, sizeof(tmp), "%s.tmp", ckpt);
+  FILE *file = fopen(tmp, "wb");
+  if (!file) {
+    return -1;
+  }
+  int rc = fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes) ? 0 : -1;
+  if (fclose(file) != 0) {
+    rc = -1;
+  }
+  if (rc == 0 && rename(tmp, ckpt) != 0) {
+    rc = -1;
+  }
+  if (rc != 0) {
+    remove(tmp);
+  }
+  return rc;
+}
+
+/* Отображает геном в память; пустой файл даёт *out_data == NULL. */
+static int map_genome(int fd, const unsigned char **out_data, size_t *out_size) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 0) {
+    return -1;
+  }
+  size_t size = (size_t)st.st_size;
+  *out_data = NULL;
+  *out_size = size;
+  if (size == 0) {
+    return 0;
+  }
+  void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    return -1;
+  }
+  *out_data = (const unsigned char *)mapped;
+  return 0;
+}
+
+/* Сегмент 0 — сам path, следующие — path.1, path.2, ... */
+static void segment_path(const char *path, uint32_t segment, char *out,
+                         size_t out_len) {
+  if (segment == 0) {
+    snprintf(out, out_len, "%s", path);
+  } else {
+    snprintf(out, out_len, "%s.%u", path, (unsigned int)segment);
+  }
+}
+
+static void index_path(const char *segment, char *out, size_t out_len) {
+  snprintf(out, out_len, "%s.idx", segment);
+}
+
+static int segment_exists(const char *path, uint32_t segment) {
+  char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(path, segment, seg, sizeof(seg));
+  return access(seg, F_OK) == 0;
+}
+
+/* 1 — файла нет. */
+static int map_path(const char *path, const unsigned char **out_data,
+                    size_t *out_size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno == ENOENT ? 1 : -1;
+  }
+  int rc = map_genome(fd, out_data, out_size);
+  close(fd);
+  return rc;
+}
+
+static void unmap_genome(const unsigned char *data, size_t size) {
+  if (data) {
+    munmap((void *)data, size);
+  }
+}
+
+/* Индекс первого блока сегмента по первым байтам файла; -1 — сегмента нет
+ * или в нём ещё нет блоков. */
+static int segment_first_index(const char *path, uint32_t segment,
+                               uint64_t *out_index) {
+  char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(path, segment, seg, sizeof(seg));
+  FILE *file = fopen(seg, "rb");
+  if (!file) {
+    return -1;
+  }
+  unsigned char head[KOLIBRI_GENOME_HEADER_SIZE + 1 + 20];
+  size_t len = fread(head, 1, sizeof(head), file);
+  fclose(file);
+  if (genome_is_v2(head, len)) {
+    size_t pos = KOLIBRI_GENOME_HEADER_SIZE + 1;
+    uint64_t count = 0;
+    if (!genome_header_valid(head) || get_varint(head, len, &pos, &count) != 0 ||
+        get_varint(head, len, &pos, out_index) != 0) {
+      return -1;
+    }
+    return 0;
+  }
+  if (len < 8) {
+    return -1;
+  }
+  *out_index = decode_u64_be(head);
+  return 0;
+}
+
+typedef struct {
+  uint64_t index;
+  uint64_t max_timestamp;
+  uint64_t offset;
+  uint64_t types_before;
+} SegmentEntry;
+
+/* Участок e — блоки от entries[e].index до начала следующего участка; бит e
+ * в карте типа t означает, что тип t в участке встречается. */
+struct kolibri_segment_index {
+  int format;
+  uint64_t first_index;
+  uint64_t blocks;
+  uint64_t size;
+  uint64_t max_timestamp;
+  SegmentEntry *entries;
+  size_t entry_count;
+  size_t entry_capacity;
+  KolibriGenomeTypes types;
+  unsigned char *spans;
+};
+
+typedef struct kolibri_segment_index SegmentIndex;
+
+static size_t index_span_bytes(const SegmentIndex *index) {
+  return (index->entry_count + 7) / 8;
+}
+
+static void index_free(SegmentIndex *index) {
+  free(index->entries);
+  types_free(&index->types);
+  free(index->spans);
+  memset(index, 0, sizeof(*index));
+}
+
+/* Участок, которому принадлежит блок. */
+static size_t index_span_of(const SegmentIndex *index, uint64_t block) {
+  size_t lo = 0;
+  size_t hi = index->entry_count;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (index->entries[mid].index <= block) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int index_span_has(const SegmentIndex *index, size_t type, size_t span) {
+  return (index->spans[type * index_span_bytes(index) + span / 8] >>
+          (span % 8)) & 1U;
+}
+
+/* Пары (тип, участок) копятся при обходе и раскладываются в карты в конце,
+ * когда известны и число участков, и словарь. */
+typedef struct {
+  SegmentIndex *index;
+  size_t *seen;
+  size_t seen_capacity;
+  size_t *marks;
+  size_t mark_count;
+  size_t mark_capacity;
+} IndexBuilder;
+
+static int index_begin_span(SegmentIndex *index, uint64_t block,
+                            uint64_t offset, size_t types_before) {
+  if (index->entry_count == index->entry_capacity) {
+    size_t capacity = index->entry_capacity ? index->entry_capacity * 2 : 64;
+    SegmentEntry *entries = (SegmentEntry *)realloc(
+        index->entries, capacity * sizeof(SegmentEntry));
+    if (!entries) {
+      return -1;
+    }
+    index->entries = entries;
+    index->entry_capacity = capacity;
+  }
+  SegmentEntry *entry = &index->entries[index->entry_count++];
+  entry->index = block;
+  entry->max_timestamp = 0;
+  entry->offset = offset;
+  entry->types_before = types_before;
+  return 0;
+}
+
+static int index_note(IndexBuilder *builder, size_t type, uint64_t timestamp) {
+  SegmentIndex *index = builder->index;
+  SegmentEntry *entry = &index->entries[index->entry_count - 1];
+  if (timestamp > entry->max_timestamp) {
+    entry->max_timestamp = timestamp;
+  }
+  if (timestamp > index->max_timestamp) {
+    index->max_timestamp = timestamp;
+  }
+  index->blocks += 1;
+  if (type >= builder->seen_capacity) {
+    size_t capacity = index->types.capacity > type ? index->types.capacity
+                                                   : type + 1;
+    size_t *seen = (size_t *)realloc(builder->seen, capacity * sizeof(size_t));
+    if (!seen) {
+      return -1;
+    }
+    memset(seen + builder->seen_capacity, 0,
+           (capacity - builder->seen_capacity) * sizeof(size_t));
+    builder->seen = seen;
+    builder->seen_capacity = capacity;
+  }
+  /* seen хранит номер участка + 1, чтобы ноль означал «ещё не встречался». */
+  if (builder->seen[type] == index->entry_count) {
+    return 0;
+  }
+  builder->seen[type] = index->entry_count;
+  if (builder->mark_count == builder->mark_capacity) {
+    size_t capacity = builder->mark_capacity ? builder->mark_capacity * 2 : 64;
+    size_t *marks =
+        (size_t *)realloc(builder->marks, capacity * 2 * sizeof(size_t));
+    if (!marks) {
+      return -1;
+    }
+    builder->marks = marks;
+    builder->mark_capacity = capacity;
+  }
+  builder->marks[builder->mark_count * 2] = type;
+  builder->marks[builder->mark_count * 2 + 1] = index->entry_count - 1;
+  builder->mark_count += 1;
+  return 0;
+}
+
+static int index_finish(IndexBuilder *builder) {
+  SegmentIndex *index = builder->index;
+  size_t bytes = index->types.count * index_span_bytes(index);
+  if (bytes == 0) {
+    return 0;
+  }
+  index->spans = (unsigned char *)calloc(bytes, 1);
+  if (!index->spans) {
+    return -1;
+  }
+  size_t span_bytes = index_span_bytes(index);
+  for (size_t i = 0; i < builder->mark_count; ++i) {
+    size_t type = builder->marks[i * 2];
+    size_t span = builder->marks[i * 2 + 1];
+    index->spans[type * span_bytes + span / 8] |=
+        (unsigned char)(1U << (span % 8));
+  }
+  return 0;
+}
+
+/* Строит индекс по содержимому сегмента без проверки подписей: время и тип
+ * каждого блока читаются из записи, хэши не считаются. Недописанный хвост
+ * в индекс не попадает. */
+static int index_build(const unsigned char *data, size_t size, uint64_t base,
+                       SegmentIndex *index) {
+  memset(index, 0, sizeof(*index));
+  index->first_index = base;
+  index->size = size;
+  IndexBuilder builder;
+  memset(&builder, 0, sizeof(builder));
+  builder.index = index;
+  int rc = 0;
+  if (genome_is_v2(data, size)) {
+    index->format = KOLIBRI_GENOME_FORMAT_V2;
+    rc = genome_header_valid(data) ? 0 : -1;
+    unsigned char *scratch = NULL;
+    size_t capacity = 0;
+    size_t offset = KOLIBRI_GENOME_HEADER_SIZE;
+    while (rc == 0 && offset < size) {
+      size_t types_before = index->types.count;
+      GenomeFrame frame;
+      int parsed = frame_parse(data, size, offset, &index->types, &frame);
+      if (parsed > 0) {
+        index->types.count = types_before;
+        break;
+      }
+      if (parsed < 0 || frame.first_index != base + index->blocks) {
+        rc = -1;
+        break;
+      }
+      if (index->entry_count == 0 ||
+          frame.first_index - index->entries[index->entry_count - 1].index >=
+              KOLIBRI_INDEX_SPAN_BLOCKS) {
+        rc = index_begin_span(index, frame.first_index, offset, types_before);
+      }
+      const unsigned char *body =
+          rc == 0 ? frame_body(&frame, &scratch, &capacity) : NULL;
+      if (!body) {
+        rc = -1;
+        break;
+      }
+      uint64_t timestamp = 0;
+      size_t pos = 0;
+      for (uint64_t i = 0; rc == 0 && i < frame.count; ++i) {
+        ReasonBlock block;
+        size_t type = 0;
+        if (record_decode(body, frame.raw_len, &pos, &index->types,
+                          frame.types_end, &timestamp, &block, &type) != 0 ||
+            index_note(&builder, type, timestamp) != 0) {
+          rc = -1;
+        }
+      }
+      offset = frame.end;
+    }
+    free(scratch);
+  } else {
+    index->format = KOLIBRI_GENOME_FORMAT_V1;
+    size_t blocks = size / KOLIBRI_BLOCK_SIZE;
+    for (size_t i = 0; rc == 0 && i < blocks; ++i) {
+      const unsigned char *bytes = data + i * KOLIBRI_BLOCK_SIZE;
+      const char *type = (const char *)(bytes + 16 + KOLIBRI_HASH_SIZE * 2);
+      size_t id = 0;
+      if (i % KOLIBRI_INDEX_SPAN_BLOCKS == 0) {
+        rc = index_begin_span(index, base + i, (uint64_t)i * KOLIBRI_BLOCK_SIZE,
+                              0);
+      }
+      if (rc == 0 && !memchr(type, '\0', KOLIBRI_EVENT_TYPE_SIZE)) {
+        rc = -1;
+      }
+      if (rc == 0 && types_find(&index->types, type, &id) != 0) {
+        rc = types_add(&index->types, type, strlen(type));
+        id = index->types.count - 1;
+      }
+      if (rc == 0) {
+        rc = index_note(&builder, id, decode_u64_be(bytes + 8));
+      }
+    }
+  }
+  if (rc == 0) {
+    rc = index_finish(&builder);
+  }
+  free(builder.seen);
+  free(builder.marks);
+  if (rc != 0) {
+    index_free(index);
+  }
+  return rc;
+}
+
+static int buf_u64(ByteBuf *buf, uint64_t value) {
+  unsigned char bytes[8];
+  encode_u64_be(value, bytes);
+  return buf_put(buf, bytes, sizeof(bytes));
+}
+
+static int index_write(const char *segment, const SegmentIndex *index) {
+  ByteBuf out;
+  memset(&out, 0, sizeof(out));
+  unsigned char head[8] = {'K', 'G', 'I', 'X', KOLIBRI_INDEX_VERSION,
+                           (unsigned char)index->format, 0, 0};
+  int rc = 0;
+  if (buf_put(&out, head, sizeof(head)) != 0 ||
+      buf_u64(&out, index->first_index) != 0 ||
+      buf_u64(&out, index->blocks) != 0 || buf_u64(&out, index->size) != 0 ||
+      buf_u64(&out, index->max_timestamp) != 0 ||
+      buf_u64(&out, index->entry_count) != 0 ||
+      buf_u64(&out, index->types.count) != 0) {
+    rc = -1;
+  }
+  for (size_t i = 0; rc == 0 && i < index->entry_count; ++i) {
+    const SegmentEntry *entry = &index->entries[i];
+    if (buf_u64(&out, entry->index) != 0 ||
+        buf_u64(&out, entry->max_timestamp) != 0 ||
+        buf_u64(&out, entry->offset) != 0 ||
+        buf_u64(&out, entry->types_before) != 0) {
+      rc = -1;
+    }
+  }
+  unsigned char digest[KOLIBRI_HASH_SIZE];
+  if (rc == 0 &&
+      (buf_put(&out, index->types.names,
+               index->types.count * KOLIBRI_EVENT_TYPE_SIZE) != 0 ||
+       buf_put(&out, index->spans,
+               index->types.count * index_span_bytes(index)) != 0 ||
+       !SHA256(out.data, out.len, digest) ||
+       buf_put(&out, digest, sizeof(digest)) != 0)) {
+    rc = -1;
+  }
+
+  char path[KOLIBRI_SEGMENT_PATH_SIZE + 8];
+  char tmp[KOLIBRI_SEGMENT_PATH_SIZE + 16];
+  index_path(segment, path, sizeof(path));
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *file = rc == 0 ? fopen(tmp, "wb") : NULL;
+  if (file) {
+    if (fwrite(out.data, 1, out.len, file) != out.len) {
+      rc = -1;
+    }
+    if (fclose(file) != 0) {
+      rc = -1;
+    }
+    if (rc == 0 && rename(tmp, path) != 0) {
+      rc = -1;
+    }
+    if (rc != 0) {
+      remove(tmp);
+    }
+  } else {
+    rc = -1;
+  }
+  free(out.data);
+  return rc;
+}
+
+static int index_parse(const unsigned char *data, size_t len, uint64_t size,
+                       SegmentIndex *index) {
+  unsigned char digest[KOLIBRI_HASH_SIZE];
+  if (len < KOLIBRI_INDEX_HEADER_SIZE + KOLIBRI_HASH_SIZE ||
+      memcmp(data, KOLIBRI_INDEX_MAGIC, 4) != 0 ||
+      data[4] != KOLIBRI_INDEX_VERSION ||
+      (data[5] != KOLIBRI_GENOME_FORMAT_V1 &&
+       data[5] != KOLIBRI_GENOME_FORMAT_V2) ||
+      !SHA256(data, len - KOLIBRI_HASH_SIZE, digest) ||
+      memcmp(digest, data + len - KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE) != 0) {
+    return -1;
+  }
+  index->format = data[5];
+  index->first_index = decode_u64_be(data + 8);
+  index->blocks = decode_u64_be(data + 16);
+  index->size = decode_u64_be(data + 24);
+  index->max_timestamp = decode_u64_be(data + 32);
+  uint64_t entries = decode_u64_be(data + 40);
+  uint64_t types = decode_u64_be(data + 48);
+  /* Индекс другого размера сегмента устарел: сегмент дописан после него. */
+  if (index->size != size || entries > len / KOLIBRI_INDEX_ENTRY_SIZE ||
+      types > len / KOLIBRI_EVENT_TYPE_SIZE || (entries == 0) != (index->blocks == 0)) {
+    return -1;
+  }
+  size_t span_bytes = ((size_t)entries + 7) / 8;
+  size_t names_at = KOLIBRI_INDEX_HEADER_SIZE +
+                    (size_t)entries * KOLIBRI_INDEX_ENTRY_SIZE;
+  size_t spans_at = names_at + (size_t)types * KOLIBRI_EVENT_TYPE_SIZE;
+  if (spans_at + (size_t)types * span_bytes + KOLIBRI_HASH_SIZE != len) {
+    return -1;
+  }
+  index->entries = entries ? (SegmentEntry *)malloc((size_t)entries *
+                                                    sizeof(SegmentEntry))
+                           : NULL;
+  if ((entries && !index->entries) ||
+      types_reserve(&index->types, (size_t)types) != 0) {
+    return -1;
+  }
+  index->entry_count = (size_t)entries;
+  index->entry_capacity = (size_t)entries;
+  for (size_t i = 0; i < index->entry_count; ++i) {
+    const unsigned char *at = data + KOLIBRI_INDEX_HEADER_SIZE +
+                              i * KOLIBRI_INDEX_ENTRY_SIZE;
+    SegmentEntry *entry = &index->entries[i];
+    entry->index = decode_u64_be(at);
+    entry->max_timestamp = decode_u64_be(at + 8);
+    entry->offset = decode_u64_be(at + 16);
+    entry->types_before = decode_u64_be(at + 24);
+    if (entry->offset >= size || entry->types_before > types ||
+        entry->index - index->first_index >= index->blocks ||
+        (i == 0 ? entry->index != index->first_index
+                : entry->index <= index->entries[i - 1].index)) {
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < (size_t)types; ++i) {
+    const unsigned char *name = data + names_at + i * KOLIBRI_EVENT_TYPE_SIZE;
+    if (!memchr(name, '\0', KOLIBRI_EVENT_TYPE_SIZE)) {
+      return -1;
+    }
+    memcpy(index->types.names[i], name, KOLIBRI_EVENT_TYPE_SIZE);
+  }
+  index->types.count = (size_t)types;
+  if (types > 0) {
+    index->spans = (unsigned char *)malloc((size_t)types * span_bytes);
+    if (!index->spans) {
+      return -1;
+    }
+    memcpy(index->spans, data + spans_at, (size_t)types * span_bytes);
+  }
+  return 0;
+}
+
+/* Загружает <segment>.idx, если он построен по сегменту размера size. */
+static int index_load(const char *segment, uint64_t size, SegmentIndex *index) {
+  memset(index, 0, sizeof(*index));
+  char path[KOLIBRI_SEGMENT_PATH_SIZE + 8];
+  index_path(segment, path, sizeof(path));
+  const unsigned char *data = NULL;
+  size_t len = 0;
+  if (map_path(path, &data, &len) != 0) {
+    return -1;
+  }
+  int rc = data ? index_parse(data, len, size, index) : -1;
+  unmap_genome(data, len);
+  if (rc != 0) {
+    index_free(index);
+  }
+  return rc;
+}
+
+/* Индекс закрытого сегмента; недостающий или устаревший строится заново и
+ * сохраняется. */
+static int sealed_segment_index(const char *path, uint32_t segment,
+                                uint64_t base, SegmentIndex *index) {
+  char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(path, segment, seg, sizeof(seg));
+  const unsigned char *data = NULL;
+  size_t size = 0;
+  if (map_path(seg, &data, &size) != 0) {
+    return -1;
+  }
+  int rc = index_load(seg, size, index);
+  if (rc != 0) {
+    rc = index_build(data, size, base, index);
+    if (rc == 0) {
+      index_write(seg, index);
+    }
+  }
+  unmap_genome(data, size);
+  return rc;
+}
+
+typedef struct {
+  uint64_t blocks;
+  int checkpointed;
+  unsigned char last_block[KOLIBRI_BLOCK_SIZE];
+} SegmentCheck;
+
+static int verify_segment_v1(const unsigned char *data, size_t size,
+                             uint64_t base, const unsigned char *chain_prev,
+                             uint64_t ckpt_count, const unsigned char *ckpt_hash,
+                             const unsigned char *key, size_t key_len,
+                             size_t threads, SegmentCheck *out) {
+  if (size % KOLIBRI_BLOCK_SIZE != 0) {
+    return -1;
+  }
+  size_t blocks = size / KOLIBRI_BLOCK_SIZE;
+  const unsigned char *first_prev = chain_prev;
+  size_t begin = 0;
+  unsigned char actual[KOLIBRI_HASH_SIZE];
+  if (ckpt_hash && ckpt_count > base && ckpt_count - base <= blocks) {
+    const unsigned char *last =
+        data + (size_t)(ckpt_count - base - 1) * KOLIBRI_BLOCK_SIZE;
+    if (SHA256(last, KOLIBRI_BLOCK_SIZE, actual) &&
+        memcmp(actual, ckpt_hash, KOLIBRI_HASH_SIZE) == 0 &&
+        decode_u64_be(last) == ckpt_count - 1) {
+      begin = (size_t)(ckpt_count - base);
+      first_prev = actual;
+      out->checkpointed = 1;
+    }
+  }
+  if (!first_prev) {
+    return 1;
+  }
+  int rc = verify_mapped(data, base, begin, blocks, first_prev, key, key_len,
+                         threads);
+  if (rc == 0 && blocks > 0) {
+    memcpy(out->last_block, data + (blocks - 1) * KOLIBRI_BLOCK_SIZE,
+           KOLIBRI_BLOCK_SIZE);
+  }
+  out->blocks = blocks;
+  return rc;
+}
+
+/* Заголовки кадров читаются всегда — из них собирается словарь типов; тела
+ * кадров до контрольной точки не распаковываются. */
+static int verify_segment_v2(const unsigned char *data, size_t size,
+                             uint64_t base, const unsigned char *chain_prev,
+                             uint64_t ckpt_count, const unsigned char *ckpt_hash,
+                             const unsigned char *key, size_t key_len,
+                             size_t threads, KolibriGenomeTypes *types,
+                             SegmentCheck *out) {
+  FrameList list;
+  memset(&list, 0, sizeof(list));
+  list.blocks = base;
+  int rc = scan_frames(data, size, types, &list);
+
+  size_t begin = 0;
+  const unsigned char *first_prev = chain_prev;
+  unsigned char *scratch = NULL;
+  size_t capacity = 0;
+  if (rc == 0 && ckpt_hash && ckpt_count > base && ckpt_count <= list.blocks) {
+    size_t frame = frame_containing(&list, ckpt_count - 1);
+    unsigned char actual[KOLIBRI_HASH_SIZE];
+    BlockHashVisit visit = {ckpt_count - 1, actual};
+    const unsigned char *body = frame_body(&list.items[frame], &scratch, &capacity);
+    if (body &&
+        frame_expand(&list.items[frame], body, types, capture_hash_visit,
+                     &visit, NULL, NULL) == 0 &&
+        memcmp(actual, ckpt_hash, KOLIBRI_HASH_SIZE) == 0) {
+      begin = frame;
+      first_prev = NULL;
+      out->checkpointed = 1;
+    }
+  }
+  if (rc == 0 && !out->checkpointed && !chain_prev) {
+    rc = 1;
+  }
+
+  if (rc == 0) {
+    rc = verify_frames(&list, begin, first_prev, types, key, key_len, threads);
+  }
+  if (rc == 0 && list.count > 0) {
+    const GenomeFrame *last = &list.items[list.count - 1];
+    const unsigned char *body = frame_body(last, &scratch, &capacity);
+    if (!body ||
+        frame_expand(last, body, types, NULL, NULL, NULL, out->last_block) != 0) {
+      rc = -1;
+    }
+  }
+  free(scratch);
+  free(list.items);
+  out->blocks = list.blocks - base;
+  return rc;
+}
+
+/* Проверяет сегмент, блоки которого начинаются с base. chain_prev — ожидаемый
+ * prev_hash первого блока; NULL допустим, только если сегмент заверен
+ * контрольной точкой, иначе возвращается 1. Префикс до контрольной точки не
+ * перепроверяется: достаточно, чтобы последний заверенный блок совпал с
+ * сохранённым хэшем. */
+static int verify_segment(const unsigned char *data, size_t size, uint64_t base,
+                          const unsigned char *chain_prev, uint64_t ckpt_count,
+                          const unsigned char *ckpt_hash,
+                          const unsigned char *key, size_t key_len,
+                          size_t threads, KolibriGenomeTypes *types,
+                          SegmentCheck *out) {
+  memset(out, 0, sizeof(*out));
+  if (genome_is_v2(data, size)) {
+    return verify_segment_v2(data, size, base, chain_prev, ckpt_count,
+                             ckpt_hash, key, key_len, threads, types, out);
+  }
+  return verify_segment_v1(data, size, base, chain_prev, ckpt_count, ckpt_hash,
+                           key, key_len, threads, out);
+}
+
+static int write_v2_header(FILE *file) {
+  unsigned char header[KOLIBRI_GENOME_HEADER_SIZE] = {
+      'K', 'G', 'N', '2', KOLIBRI_GENOME_FORMAT_V2, 0, 0, 0};
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+      fflush(file) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+/* Закрытый сегмент, в котором лежит блок index, по индексам сегментов. */
+static int locate_segment(const char *path, uint32_t count, uint64_t index,
+                          uint32_t *out_segment, uint64_t *out_base) {
+  uint64_t base = 0;
+  uint32_t segment = 0;
+  for (; segment + 1 < count; ++segment) {
+    SegmentIndex seg_index;
+    if (sealed_segment_index(path, segment, base, &seg_index) != 0) {
+      return -1;
+    }
+    uint64_t first = seg_index.first_index;
+    uint64_t end = first + seg_index.blocks;
+    index_free(&seg_index);
+    if (first != base) {
+      return -1;
+    }
+    if (index < end) {
+      break;
+    }
+    base = end;
+  }
+  *out_segment = segment;
+  *out_base = base;
+  return 0;
+}
+
+/* Проверяет сегменты с start до последнего, который становится текущим для
+ * записи. Сегменты до start не читаются: их заверяет контрольная точка. */
+static int open_segments(KolibriGenome *ctx, uint32_t count, uint32_t start,
+                         uint64_t base, uint64_t ckpt_count,
+                         const unsigned char *ckpt_hash,
+                         uint64_t *out_verified) {
+  unsigned char prev[KOLIBRI_HASH_SIZE];
+  memset(prev, 0, sizeof(prev));
+  const unsigned char *chain_prev = start == 0 ? prev : NULL;
+  int format = ctx->format;
+  if (ctx->file) {
+    fclose(ctx->file);
+    ctx->file = NULL;
+  }
+  ctx->types.count = 0;
+  ctx->has_last_block = 0;
+  *out_verified = 0;
+  for (uint32_t segment = start; segment < count; ++segment) {
+    char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+    segment_path(ctx->path, segment, seg, sizeof(seg));
+    int last = segment + 1 == count;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    int rc = 0;
+    if (last) {
+      ctx->file = fopen(seg, "r+b");
+      if (!ctx->file) {
+        ctx->file = fopen(seg, "w+b");
+      }
+      rc = ctx->file ? map_genome(fileno(ctx->file), &data, &size) : -1;
+    } else {
+      rc = map_path(seg, &data, &size);
+    }
+    if (rc != 0) {
+      return -1;
+    }
+    KolibriGenomeTypes scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    SegmentCheck check;
+    rc = verify_segment(data, size, base, chain_prev, ckpt_count, ckpt_hash,
+                        ctx->hmac_key, ctx->hmac_key_len, 0,
+                        last ? &ctx->types : &scratch, &check);
+    if (size > 0) {
+      format = genome_is_v2(data, size) ? KOLIBRI_GENOME_FORMAT_V2
+                                        : KOLIBRI_GENOME_FORMAT_V1;
+    }
+    unmap_genome(data, size);
+    types_free(&scratch);
+    if (rc != 0) {
+      return rc;
+    }
+    if (check.checkpointed) {
+      *out_verified = ckpt_count;
+    }
+    if (check.blocks > 0) {
+      memcpy(ctx->last_block, check.last_block, KOLIBRI_BLOCK_SIZE);
+      memcpy(ctx->last_hash, ctx->last_block + 16 + KOLIBRI_HASH_SIZE,
+             KOLIBRI_HASH_SIZE);
+      ctx->has_last_block = 1;
+      if (!SHA256(check.last_block, KOLIBRI_BLOCK_SIZE, prev)) {
+        return -1;
+      }
+    }
+    chain_prev = prev;
+    if (last) {
+      ctx->segment = segment;
+      ctx->segment_first = base;
+      ctx->end_offset = (uint64_t)size;
+    }
+    base += check.blocks;
+  }
+  /* Пустой сегмент получает формат предыдущего, новый геном — из options. */
+  ctx->format = format;
+  ctx->next_index = base;
+  if (ctx->end_offset == 0 && ctx->format == KOLIBRI_GENOME_FORMAT_V2) {
+    if (write_v2_header(ctx->file) != 0) {
+      return -1;
+    }
+    ctx->end_offset = KOLIBRI_GENOME_HEADER_SIZE;
+  }
+  return 0;
+}
+
+int kg_open_with(KolibriGenome *ctx, const char *path, const unsigned char *key,
+                 size_t key_len, const KolibriGenomeOptions *options) {
+  if (!ctx || !path || !key || key_len == 0 ||
+      key_len > sizeof(ctx->hmac_key) || strlen(path) >= sizeof(ctx->path)) {
+    return -1;
+  }
+
+  reset_context(ctx);
+
+  strncpy(ctx->path, path, sizeof(ctx->path) - 1);
+  memcpy(ctx->hmac_key, key, key_len);
+  ctx->hmac_key_len = key_len;
+  ctx->hmac_ctx = mac_context_new(key, key_len);
+  if (!ctx->hmac_ctx) {
+    kg_close(ctx);
+    return -1;
+  }
+  /* Существующий геном сохраняет свой формат; формат из options — только для
+   * нового. */
+  if (options) {
+    ctx->format = options->format == KOLIBRI_GENOME_FORMAT_V2
+                      ? KOLIBRI_GENOME_FORMAT_V2
+                      : KOLIBRI_GENOME_FORMAT_V1;
+    ctx->flags = options->flags;
+    ctx->segment_bytes = options->segment_bytes;
+  }
+
+  uint32_t count = 1;
+  while (segment_exists(path, count)) {
+    ++count;
+  }
+
+  /* Проверка начинается с сегмента, где лежит последний заверенный блок;
+   * если контрольная точка не подтвердилась, цепочка проверяется целиком. */
+  uint64_t ckpt_count = 0;
+  unsigned char ckpt_hash[KOLIBRI_HASH_SIZE];
+  uint32_t start = 0;
+  uint64_t base = 0;
+  int have_ckpt = read_checkpoint(ctx->path, ctx->hmac_key, ctx->hmac_key_len,
+                                  &ckpt_count, ckpt_hash) == 0 &&
+                  ckpt_count > 0;
+  if (have_ckpt &&
+      locate_segment(path, count, ckpt_count - 1, &start, &base) != 0) {
+    start = 0;
+    base = 0;
+  }
+  uint64_t verified = 0;
+  int rc = open_segments(ctx, count, start, base, ckpt_count,
+                         have_ckpt ? ckpt_hash : NULL, &verified);
+  if (rc == 1) {
+    rc = open_segments(ctx, count, 0, 0, 0, NULL, &verified);
+  }
+  if (rc != 0 || fseek(ctx->file, 0, SEEK_END) != 0) {
+    kg_close(ctx);
+    return -1;
+  }
+
+  if (verified < ctx->next_index) {
+    kg_write_checkpoint(ctx);
+  }
+
+  return 0;
+}
+
+/* Индекс строится по файлу сегмента целиком. Ошибка не мешает записи:
+ * читатель тогда построит индекс сам. */
+static void index_active_segment(KolibriGenome *ctx) {
+  const unsigned char *data = NULL;
+  size_t size = 0;
+  if (fflush(ctx->file) != 0 ||
+      map_genome(fileno(ctx->file), &data, &size) != 0) {
+    return;
+  }
+  SegmentIndex index;
+  if (index_build(data, size, ctx->segment_first, &index) == 0) {
+    char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+    segment_path(ctx->path, ctx->segment, seg, sizeof(seg));
+    index_write(seg, &index);
+    index_free(&index);
+  }
+  unmap_genome(data, size);
+}
+
+int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key,
+            size_t key_len) {
+  return kg_open_with(ctx, path, key, key_len, NULL);
+}
+
+void kg_close(KolibriGenome *ctx) {
+  if (!ctx) {
+    return;
+  }
+  if (ctx->file) {
+    if (ctx->sync_interval_ns > 0) {
+      kg_sync(ctx);
+    }
+    if (ctx->has_last_block) {
+      kg_write_checkpoint(ctx);
+    }
+    if (ctx->segment_bytes > 0) {
+      index_active_segment(ctx);
+    }
+    fclose(ctx->file);
+    ctx->file = NULL;
+  }
+  memset(ctx->last_hash, 0, sizeof(ctx->last_hash));
+  memset(ctx->last_block, 0, sizeof(ctx->last_block));
   memset(ctx->hmac_key, 0, sizeof(ctx->hmac_key));
   ctx->hmac_key_len = 0;
+  EVP_MAC_CTX_free(ctx->hmac_ctx);
+  ctx->hmac_ctx = NULL;
   memset(ctx->path, 0, sizeof(ctx->path));
   ctx->next_index = 0;
   ctx->has_last_block = 0;
+  ctx->sync_interval_ns = 0;
+  ctx->last_sync_ns = 0;
+  ctx->format = KOLIBRI_GENOME_FORMAT_V1;
+  ctx->flags = 0;
+  ctx->end_offset = 0;
+  types_free(&ctx->types);
+  ctx->segment_bytes = 0;
+  ctx->segment = 0;
+  ctx->segment_first = 0;
 }
 
 int kg_encode_payload(const char *utf8, char *out, size_t out_len) {
@@ -258,118 +2030,717 @@ int kg_encode_payload(const char *utf8, char *out, size_t out_len) {
   return k_encode_text(utf8, out, out_len);
 }
 
-int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload,
-              ReasonBlock *out_block) {
-  if (!ctx || !ctx->file || !event_type) {
+static int validate_event(const char *event_type, const char *payload) {
+  if (!event_type) {
+    return -1;
+  }
+  if (!payload_is_digits(payload ? payload : "")) {
     return -1;
   }
+  if (strnlen(event_type, KOLIBRI_EVENT_TYPE_SIZE) >= KOLIBRI_EVENT_TYPE_SIZE) {
+    return -1;
+  }
+  return 0;
+}
+
+/* Строит и подписывает блок; prev_bytes — сериализованный предыдущий блок или
+ * NULL для первого блока цепочки. */
+static int seal_block(const KolibriGenome *ctx, uint64_t index,
+                      uint64_t timestamp, const unsigned char *prev_bytes,
+                      const char *event_type, const char *payload,
+                      ReasonBlock *block, unsigned char *out_bytes) {
+  memset(block, 0, sizeof(*block));
+  block->index = index;
+  block->timestamp = timestamp;
+
+  if (prev_bytes) {
+    if (!SHA256(prev_bytes, KOLIBRI_BLOCK_SIZE, block->prev_hash)) {
+      return -1;
+    }
+  }
 
   const char *digits = payload ? payload : "";
-  if (!payload_is_digits(digits)) {
+  memcpy(block->event_type, event_type,
+         strnlen(event_type, KOLIBRI_EVENT_TYPE_SIZE));
+  memcpy(block->payload, digits, strnlen(digits, KOLIBRI_PAYLOAD_SIZE));
+
+  unsigned char message[KOLIBRI_HMAC_INPUT_SIZE];
+  build_hmac_message(block, message);
+
+  if (mac_compute(ctx->hmac_ctx, message, sizeof(message), block->hmac) != 0) {
     return -1;
   }
 
-  size_t event_len = strnlen(event_type, KOLIBRI_EVENT_TYPE_SIZE);
-  if (event_len >= KOLIBRI_EVENT_TYPE_SIZE) {
+  serialize_block(block, out_bytes);
+  return 0;
+}
+
+static int sync_file(FILE *file) {
+  int fd = fileno(file);
+  if (fd < 0) {
     return -1;
   }
+#if defined(__APPLE__)
+  return fsync(fd);
+#else
+  return fdatasync(fd);
+#endif
+}
 
-  ReasonBlock block;
-  memset(&block, 0, sizeof(block));
+int kg_sync(KolibriGenome *ctx) {
+  if (!ctx || !ctx->file) {
+    return -1;
+  }
+  if (fflush(ctx->file) != 0 || sync_file(ctx->file) != 0) {
+    return -1;
+  }
+  ctx->last_sync_ns = current_time_ns();
+  return 0;
+}
 
-  block.index = ctx->next_index;
-  block.timestamp = current_time_ns();
+void kg_set_sync_interval(KolibriGenome *ctx, uint64_t interval_ms) {
+  if (!ctx) {
+    return;
+  }
+  ctx->sync_interval_ns = interval_ms * 1000000ULL;
+  ctx->last_sync_ns = current_time_ns();
+}
 
-  if (ctx->has_last_block) {
-    if (!SHA256(ctx->last_block, KOLIBRI_BLOCK_SIZE, block.prev_hash)) {
-      return -1;
-    }
-  } else {
-    memset(block.prev_hash, 0, KOLIBRI_HASH_SIZE);
+/* Закрытый сегмент больше не меняется: он сбрасывается на диск и получает
+ * индекс, а цепочка продолжается в <path>.N+1 с собственным словарём. */
+static int roll_segment(KolibriGenome *ctx) {
+  if (fflush(ctx->file) != 0 || sync_file(ctx->file) != 0) {
+    return -1;
+  }
+  index_active_segment(ctx);
+  char next[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(ctx->path, ctx->segment + 1, next, sizeof(next));
+  FILE *file = fopen(next, "wb+x");
+  if (!file) {
+    return -1;
+  }
+  if (ctx->format == KOLIBRI_GENOME_FORMAT_V2 && write_v2_header(file) != 0) {
+    fclose(file);
+    remove(next);
+    return -1;
   }
+  fclose(ctx->file);
+  ctx->file = file;
+  ctx->segment += 1;
+  ctx->segment_first = ctx->next_index;
+  ctx->end_offset =
+      ctx->format == KOLIBRI_GENOME_FORMAT_V2 ? KOLIBRI_GENOME_HEADER_SIZE : 0;
+  ctx->types.count = 0;
+  return 0;
+}
 
-  memcpy(block.event_type, event_type, event_len);
-  size_t payload_len = strnlen(digits, KOLIBRI_PAYLOAD_SIZE);
-  if (payload_len >= KOLIBRI_PAYLOAD_SIZE) {
+/* Дописывает уже подписанные блоки: v1 — канонические байты как есть, v2 —
+ * одним кадром. Словарь пополняется только после успешной записи. Сегмент
+ * сменяется перед пачкой, поэтому пачка никогда не делится между файлами. */
+static int commit_blocks(KolibriGenome *ctx, const ReasonBlock *blocks,
+                         const unsigned char *bytes, size_t count) {
+  if (ctx->segment_bytes > 0 && ctx->next_index > ctx->segment_first &&
+      ctx->end_offset >= ctx->segment_bytes && roll_segment(ctx) != 0) {
     return -1;
   }
-  memcpy(block.payload, digits, payload_len);
+  FrameBuilder frame;
+  ByteBuf out;
+  memset(&frame, 0, sizeof(frame));
+  memset(&out, 0, sizeof(out));
+  size_t written = count * KOLIBRI_BLOCK_SIZE;
+  int rc = 0;
+  if (ctx->format == KOLIBRI_GENOME_FORMAT_V2) {
+    for (size_t i = 0; rc == 0 && i < count; ++i) {
+      rc = frame_add(&frame, &ctx->types, &blocks[i]);
+    }
+    if (rc == 0 && (frame_finish(&frame, ctx->flags, &out) != 0 ||
+                    types_reserve(&ctx->types, frame.added.count) != 0)) {
+      rc = -1;
+    }
+    if (rc == 0 && (fwrite(out.data, 1, out.len, ctx->file) != out.len ||
+                    fflush(ctx->file) != 0)) {
+      rc = -1;
+    }
+    written = out.len;
+    for (size_t i = 0; rc == 0 && i < frame.added.count; ++i) {
+      types_add(&ctx->types, frame.added.names[i],
+                strlen(frame.added.names[i]));
+    }
+  } else if (fwrite(bytes, KOLIBRI_BLOCK_SIZE, count, ctx->file) != count ||
+             fflush(ctx->file) != 0) {
+    rc = -1;
+  }
+  frame_builder_free(&frame);
+  free(out.data);
 
-  unsigned char message[KOLIBRI_HMAC_INPUT_SIZE];
-  build_hmac_message(&block, message);
+  if (rc == 0) {
+    memcpy(ctx->last_hash, blocks[count - 1].hmac, KOLIBRI_HASH_SIZE);
+    memcpy(ctx->last_block, bytes + (count - 1) * KOLIBRI_BLOCK_SIZE,
+           KOLIBRI_BLOCK_SIZE);
+    ctx->has_last_block = 1;
+    ctx->next_index += count;
+    ctx->end_offset += written;
+    if (ctx->sync_interval_ns > 0 &&
+        current_time_ns() - ctx->last_sync_ns >= ctx->sync_interval_ns &&
+        kg_sync(ctx) != 0) {
+      rc = KOLIBRI_GENOME_SYNC_FAILED;
+    }
+  }
+  return rc;
+}
 
-  unsigned int hmac_len = 0;
-  if (!HMAC(EVP_sha256(), ctx->hmac_key, (int)ctx->hmac_key_len, message,
-            sizeof(message), block.hmac, &hmac_len) ||
-      hmac_len != KOLIBRI_HASH_SIZE) {
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEvent *events,
+                    size_t count, ReasonBlock *out_blocks) {
+  if (!ctx || !ctx->file || (!events && count > 0)) {
     return -1;
   }
+  if (count == 0) {
+    return 0;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (validate_event(events[i].event_type, events[i].payload) != 0) {
+      return -1;
+    }
+  }
 
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  serialize_block(&block, bytes);
+  unsigned char single[KOLIBRI_BLOCK_SIZE];
+  ReasonBlock single_block;
+  unsigned char *bytes = single;
+  ReasonBlock *blocks = out_blocks ? out_blocks : &single_block;
+  if (count > 1) {
+    if (count > SIZE_MAX / KOLIBRI_BLOCK_SIZE) {
+      return -1;
+    }
+    bytes = (unsigned char *)malloc(count * KOLIBRI_BLOCK_SIZE);
+    if (!out_blocks) {
+      blocks = (ReasonBlock *)malloc(count * sizeof(ReasonBlock));
+    }
+    if (!bytes || !blocks) {
+      free(bytes);
+      if (blocks != out_blocks) {
+        free(blocks);
+      }
+      return -1;
+    }
+  }
+
+  uint64_t timestamp = current_time_ns();
+  const unsigned char *prev = ctx->has_last_block ? ctx->last_block : NULL;
+  int rc = 0;
+  for (size_t i = 0; i < count; ++i) {
+    unsigned char *out = bytes + i * KOLIBRI_BLOCK_SIZE;
+    if (seal_block(ctx, ctx->next_index + i, timestamp, prev,
+                   events[i].event_type, events[i].payload, &blocks[i],
+                   out) != 0) {
+      rc = -1;
+      break;
+    }
+    prev = out;
+  }
+
+  if (rc == 0) {
+    rc = commit_blocks(ctx, blocks, bytes, count);
+  }
+
+  if (bytes != single) {
+    free(bytes);
+  }
+  if (blocks != out_blocks && blocks != &single_block) {
+    free(blocks);
+  }
+  return rc;
+}
 
-  if (fwrite(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file) != KOLIBRI_BLOCK_SIZE) {
+int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload,
+              ReasonBlock *out_block) {
+  KolibriGenomeEvent event = {event_type, payload};
+  return kg_append_batch(ctx, &event, 1, out_block);
+}
+
+int kg_verify_file_threads(const char *path, const unsigned char *key,
+                           size_t key_len, size_t threads) {
+  if (!path || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
     return -1;
   }
 
-  if (fflush(ctx->file) != 0) {
+  /* Сегменты проверяются по очереди; prev_hash первого блока сегмента
+   * сверяется с хэшем последнего блока предыдущего. */
+  unsigned char prev[KOLIBRI_HASH_SIZE];
+  memset(prev, 0, sizeof(prev));
+  uint64_t base = 0;
+  int rc = 0;
+  for (uint32_t segment = 0;; ++segment) {
+    char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+    segment_path(path, segment, seg, sizeof(seg));
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    rc = map_path(seg, &data, &size);
+    if (rc != 0) {
+      if (rc > 0 && segment > 0) {
+        rc = 0;
+      }
+      break;
+    }
+    KolibriGenomeTypes types;
+    memset(&types, 0, sizeof(types));
+    SegmentCheck check;
+    rc = verify_segment(data, size, base, prev, 0, NULL, key, key_len, threads,
+                        &types, &check);
+    unmap_genome(data, size);
+    types_free(&types);
+    if (rc != 0 || (check.blocks > 0 &&
+                    !SHA256(check.last_block, KOLIBRI_BLOCK_SIZE, prev))) {
+      rc = -1;
+      break;
+    }
+    base += check.blocks;
+  }
+  return rc;
+}
+
+int kg_verify_file(const char *path, const unsigned char *key,
+                   size_t key_len) {
+  return kg_verify_file_threads(path, key, key_len, 0);
+}
+
+static void reader_release_segment(KolibriGenomeReader *reader) {
+  unmap_genome(reader->data, reader->size);
+  reader->data = NULL;
+  reader->size = 0;
+  if (reader->index) {
+    index_free(reader->index);
+    free(reader->index);
+    reader->index = NULL;
+  }
+}
+
+/* Переключает читателя на сегмент segment, первый блок которого — first.
+ * 1 — такого сегмента нет; текущий тогда остаётся открытым. */
+static int reader_map(KolibriGenomeReader *reader, uint32_t segment,
+                      uint64_t first) {
+  char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(reader->path, segment, seg, sizeof(seg));
+  const unsigned char *data = NULL;
+  size_t size = 0;
+  int rc = map_path(seg, &data, &size);
+  if (rc != 0) {
+    return rc;
+  }
+  int v2 = genome_is_v2(data, size);
+  if (v2 && !genome_header_valid(data)) {
+    unmap_genome(data, size);
     return -1;
   }
+  reader_release_segment(reader);
+  reader->segment = segment;
+  reader->segment_first = first;
+  reader->data = data;
+  reader->size = size;
+  reader->format = v2 ? KOLIBRI_GENOME_FORMAT_V2 : KOLIBRI_GENOME_FORMAT_V1;
+  reader->offset = v2 ? KOLIBRI_GENOME_HEADER_SIZE : 0;
+  reader->next_index = first;
+  reader->frame_left = 0;
+  reader->types.count = 0;
+#ifdef MADV_SEQUENTIAL
+  if (reader->data) {
+    madvise((void *)reader->data, reader->size, MADV_SEQUENTIAL);
+  }
+#endif
+  return 0;
+}
 
-  memcpy(ctx->last_hash, block.hmac, KOLIBRI_HASH_SIZE);
-  memcpy(ctx->last_block, bytes, KOLIBRI_BLOCK_SIZE);
-  ctx->has_last_block = 1;
-  ctx->next_index = block.index + 1;
+int kg_reader_open(KolibriGenomeReader *reader, const char *path) {
+  if (!reader || !path) {
+    return -1;
+  }
+  memset(reader, 0, sizeof(*reader));
+  if (strlen(path) >= sizeof(reader->path)) {
+    return -1;
+  }
+  memcpy(reader->path, path, strlen(path));
+  return reader_map(reader, 0, 0);
+}
 
-  if (out_block) {
-    *out_block = block;
+/* Индекс текущего сегмента: с диска, если он не устарел, иначе при build —
+ * построенный по отображению. */
+static const SegmentIndex *reader_index(KolibriGenomeReader *reader,
+                                        int build) {
+  if (reader->index) {
+    return reader->index;
+  }
+  SegmentIndex *index = (SegmentIndex *)calloc(1, sizeof(*index));
+  if (!index) {
+    return NULL;
+  }
+  char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+  segment_path(reader->path, reader->segment, seg, sizeof(seg));
+  int rc = index_load(seg, reader->size, index);
+  if (rc == 0 && index->first_index != reader->segment_first) {
+    index_free(index);
+    rc = -1;
   }
+  if (rc != 0 && (!build || index_build(reader->data, reader->size,
+                                        reader->segment_first, index) != 0)) {
+    free(index);
+    return NULL;
+  }
+  reader->index = index;
+  return index;
+}
 
+static int reader_enter_frame(KolibriGenomeReader *reader,
+                              const GenomeFrame *frame) {
+  if (frame->first_index != reader->next_index) {
+    return -1;
+  }
+  const unsigned char *body =
+      frame_body(frame, &reader->body, &reader->body_capacity);
+  if (!body) {
+    return -1;
+  }
+  reader->records = body;
+  reader->records_len = frame->raw_len;
+  reader->record_pos = 0;
+  reader->frame_left = frame->count;
+  reader->frame_types = frame->types_end;
+  reader->prev_timestamp = 0;
+  memcpy(reader->prev_hash, frame->prev_hash, KOLIBRI_HASH_SIZE);
+  reader->offset = frame->end;
   return 0;
 }
 
-int kg_verify_file(const char *path, const unsigned char *key,
-                   size_t key_len) {
-  if (!path || !key || key_len == 0 || key_len > KOLIBRI_HMAC_KEY_SIZE) {
+static int reader_next_in_segment(KolibriGenomeReader *reader,
+                                  ReasonBlock *block) {
+  if (reader->format == KOLIBRI_GENOME_FORMAT_V1) {
+    uint64_t pos = reader->next_index - reader->segment_first;
+    if (pos >= reader->size / KOLIBRI_BLOCK_SIZE) {
+      return 0;
+    }
+    deserialize_block(reader->data + pos * KOLIBRI_BLOCK_SIZE, block);
+    reader->next_index += 1;
+    return 1;
+  }
+  if (reader->frame_left == 0) {
+    GenomeFrame frame;
+    int rc = frame_parse(reader->data, reader->size, reader->offset,
+                         &reader->types, &frame);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+    if (reader_enter_frame(reader, &frame) != 0) {
+      return -1;
+    }
+  }
+  memset(block, 0, sizeof(*block));
+  if (record_decode(reader->records, reader->records_len, &reader->record_pos,
+                    &reader->types, reader->frame_types,
+                    &reader->prev_timestamp, block, NULL) != 0) {
+    return -1;
+  }
+  block->index = reader->next_index++;
+  memcpy(block->prev_hash, reader->prev_hash, KOLIBRI_HASH_SIZE);
+  reader->frame_left -= 1;
+  if (reader->frame_left == 0 && reader->record_pos != reader->records_len) {
     return -1;
   }
+  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
+  serialize_block(block, bytes);
+  if (!SHA256(bytes, KOLIBRI_BLOCK_SIZE, reader->prev_hash)) {
+    return -1;
+  }
+  return 1;
+}
 
-  FILE *file = fopen(path, "rb");
-  if (!file) {
-    if (errno == ENOENT) {
-      return 1;
+int kg_reader_next(KolibriGenomeReader *reader, ReasonBlock *block) {
+  if (!reader || !block) {
+    return -1;
+  }
+  for (;;) {
+    int rc = reader_next_in_segment(reader, block);
+    if (rc != 0) {
+      return rc;
     }
+    rc = reader_map(reader, reader->segment + 1, reader->next_index);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+  }
+}
+
+/* Переход к блоку index внутри текущего сегмента. В v2 словарь копится от
+ * начала сегмента: с индексом поиск начинается с ближайшего участка и его
+ * размера словаря, без индекса — по заголовкам кадров с начала. Тела
+ * пропущенных кадров не распаковываются. */
+static int reader_seek_in(KolibriGenomeReader *reader, uint64_t index) {
+  reader->frame_left = 0;
+  if (reader->format == KOLIBRI_GENOME_FORMAT_V1) {
+    uint64_t end = reader->segment_first + reader->size / KOLIBRI_BLOCK_SIZE;
+    reader->next_index = index < end ? index : end;
+    return 0;
+  }
+  reader->types.count = 0;
+  reader->offset = KOLIBRI_GENOME_HEADER_SIZE;
+  reader->next_index = reader->segment_first;
+  const SegmentIndex *seg_index = reader_index(reader, 0);
+  if (seg_index && seg_index->entry_count > 0) {
+    const SegmentEntry *entry =
+        &seg_index->entries[index_span_of(seg_index, index)];
+    if (types_reserve(&reader->types, (size_t)entry->types_before) != 0) {
+      return -1;
+    }
+    if (entry->types_before > 0) {
+      memcpy(reader->types.names, seg_index->types.names,
+             (size_t)entry->types_before * KOLIBRI_EVENT_TYPE_SIZE);
+    }
+    reader->types.count = (size_t)entry->types_before;
+    reader->offset = (size_t)entry->offset;
+    reader->next_index = entry->index;
+  }
+  while (reader->offset < reader->size) {
+    GenomeFrame frame;
+    int rc = frame_parse(reader->data, reader->size, reader->offset,
+                         &reader->types, &frame);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+    if (frame.first_index != reader->next_index) {
+      return -1;
+    }
+    if (index < frame.first_index + frame.count) {
+      if (reader_enter_frame(reader, &frame) != 0) {
+        return -1;
+      }
+      ReasonBlock skipped;
+      while (reader->next_index < index) {
+        if (reader_next_in_segment(reader, &skipped) != 1) {
+          return -1;
+        }
+      }
+      return 0;
+    }
+    reader->next_index += frame.count;
+    reader->offset = frame.end;
+  }
+  return 0;
+}
+
+/* Сегмент с блоком index находится по индексам первых блоков следующих
+ * сегментов — прочитанные сегменты не отображаются. */
+int kg_reader_seek(KolibriGenomeReader *reader, uint64_t index) {
+  if (!reader) {
     return -1;
   }
+  if (index < reader->segment_first && reader_map(reader, 0, 0) != 0) {
+    return -1;
+  }
+  uint64_t first = 0;
+  while (segment_first_index(reader->path, reader->segment + 1, &first) == 0 &&
+         first <= index) {
+    if (reader_map(reader, reader->segment + 1, first) != 0) {
+      return -1;
+    }
+  }
+  return reader_seek_in(reader, index);
+}
 
-  unsigned char expected_prev[KOLIBRI_HASH_SIZE];
-  memset(expected_prev, 0, sizeof(expected_prev));
-  uint64_t expected_index = 0;
+/* Переходит к следующему сегменту; если его нет — к концу текущего. 1 —
+ * сегменты кончились. */
+static int reader_skip_segment(KolibriGenomeReader *reader,
+                               const SegmentIndex *index) {
+  uint64_t end = index->first_index + index->blocks;
+  int rc = reader_map(reader, reader->segment + 1, end);
+  if (rc > 0) {
+    return reader_seek_in(reader, end) == 0 ? 1 : -1;
+  }
+  return rc;
+}
 
-  unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-  size_t read = 0;
-  while ((read = fread(bytes, 1, KOLIBRI_BLOCK_SIZE, file)) ==
-         KOLIBRI_BLOCK_SIZE) {
-    unsigned char block_hash[KOLIBRI_HASH_SIZE];
-    if (parse_and_verify_block(bytes, key, key_len, expected_index,
-                               expected_prev, NULL, block_hash) != 0) {
-      fclose(file);
+/* Первый участок с наибольшим временем не раньше timestamp содержит искомый
+ * блок, даже если часы шли назад: все более ранние участки целиком раньше. */
+int kg_reader_seek_time(KolibriGenomeReader *reader, uint64_t timestamp) {
+  if (!reader) {
+    return -1;
+  }
+  if (reader->segment != 0 &&
+      reader_map(reader, 0, 0) != 0) {
+    return -1;
+  }
+  const SegmentIndex *index = NULL;
+  for (;;) {
+    index = reader_index(reader, 1);
+    if (!index) {
       return -1;
     }
-    memcpy(expected_prev, block_hash, KOLIBRI_HASH_SIZE);
-    expected_index += 1;
+    if (index->blocks > 0 && index->max_timestamp >= timestamp) {
+      break;
+    }
+    int rc = reader_skip_segment(reader, index);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+  }
+  size_t span = 0;
+  while (index->entries[span].max_timestamp < timestamp) {
+    ++span;
+  }
+  if (reader_seek_in(reader, index->entries[span].index) != 0) {
+    return -1;
   }
+  ReasonBlock block;
+  do {
+    if (reader_next_in_segment(reader, &block) != 1) {
+      return -1;
+    }
+  } while (block.timestamp < timestamp);
+  return reader_seek_in(reader, block.index);
+}
 
-  if (read != 0) {
-    fclose(file);
+int kg_reader_next_type(KolibriGenomeReader *reader, const char *event_type,
+                        ReasonBlock *block) {
+  if (!reader || !event_type || !block) {
+    return -1;
+  }
+  for (;;) {
+    const SegmentIndex *index = reader_index(reader, 1);
+    if (!index) {
+      return -1;
+    }
+    size_t type = 0;
+    if (reader->next_index < index->first_index + index->blocks &&
+        types_find(&index->types, event_type, &type) == 0) {
+      size_t span = index_span_of(index, reader->next_index);
+      if (index_span_has(index, type, span)) {
+        int rc = reader_next_in_segment(reader, block);
+        if (rc != 1) {
+          return rc;
+        }
+        if (strncmp(block->event_type, event_type, KOLIBRI_EVENT_TYPE_SIZE) ==
+            0) {
+          return 1;
+        }
+        continue;
+      }
+      if (span + 1 < index->entry_count) {
+        if (reader_seek_in(reader, index->entries[span + 1].index) != 0) {
+          return -1;
+        }
+        continue;
+      }
+    }
+    int rc = reader_skip_segment(reader, index);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+  }
+}
+
+void kg_reader_close(KolibriGenomeReader *reader) {
+  if (!reader) {
+    return;
+  }
+  reader_release_segment(reader);
+  types_free(&reader->types);
+  free(reader->body);
+  memset(reader, 0, sizeof(*reader));
+}
+
+int kg_read_range(const char *path, uint64_t first, size_t count,
+                  ReasonBlock *out, size_t *out_count) {
+  if (!path || (!out && count > 0) || !out_count) {
     return -1;
   }
+  *out_count = 0;
+  KolibriGenomeReader reader;
+  int rc = kg_reader_open(&reader, path);
+  if (rc != 0) {
+    return rc;
+  }
+  rc = kg_reader_seek(&reader, first);
+  while (rc == 0 && *out_count < count) {
+    int got = kg_reader_next(&reader, &out[*out_count]);
+    if (got < 0) {
+      rc = -1;
+    }
+    if (got != 1) {
+      break;
+    }
+    *out_count += 1;
+  }
+  kg_reader_close(&reader);
+  return rc;
+}
 
-  if (ferror(file)) {
-    fclose(file);
+/* Удаляет все сегменты генома вместе с их индексами и контрольной точкой. */
+static void remove_genome(const char *path) {
+  char ckpt[sizeof(((KolibriGenome *)0)->path) + 8];
+  checkpoint_path(path, ckpt, sizeof(ckpt));
+  remove(ckpt);
+  for (uint32_t segment = 0;; ++segment) {
+    char seg[KOLIBRI_SEGMENT_PATH_SIZE];
+    char idx[KOLIBRI_SEGMENT_PATH_SIZE + 8];
+    segment_path(path, segment, seg, sizeof(seg));
+    index_path(seg, idx, sizeof(idx));
+    remove(idx);
+    if (remove(seg) != 0 && segment > 0) {
+      break;
+    }
+  }
+}
+
+/* Блоки переносятся вместе с подписями; при записи в v2 они собираются в
+ * крупные кадры, чтобы словарь и сжатие окупались. Сегменты src читаются
+ * подряд, dst режется на сегменты по options->segment_bytes. */
+int kg_convert_file(const char *src, const char *dst, const unsigned char *key,
+                    size_t key_len, const KolibriGenomeOptions *options) {
+  if (!src || !dst || strcmp(src, dst) == 0 ||
+      kg_verify_file(src, key, key_len) != 0) {
+    return -1;
+  }
+  KolibriGenomeReader reader;
+  if (kg_reader_open(&reader, src) != 0) {
     return -1;
   }
+  remove_genome(dst);
 
-  fclose(file);
-  return 0;
+  KolibriGenome out;
+  if (kg_open_with(&out, dst, key, key_len, options) != 0) {
+    kg_reader_close(&reader);
+    return -1;
+  }
+  ReasonBlock *blocks =
+      (ReasonBlock *)malloc(KOLIBRI_CONVERT_FRAME_BLOCKS * sizeof(ReasonBlock));
+  unsigned char *bytes =
+      (unsigned char *)malloc(KOLIBRI_CONVERT_FRAME_BLOCKS * KOLIBRI_BLOCK_SIZE);
+  int rc = blocks && bytes ? 0 : -1;
+  while (rc == 0) {
+    size_t count = 0;
+    int got = 1;
+    while (count < KOLIBRI_CONVERT_FRAME_BLOCKS &&
+           (got = kg_reader_next(&reader, &blocks[count])) == 1) {
+      serialize_block(&blocks[count], bytes + count * KOLIBRI_BLOCK_SIZE);
+      ++count;
+    }
+    if (got < 0) {
+      rc = -1;
+    } else if (count > 0) {
+      rc = commit_blocks(&out, blocks, bytes, count);
+    }
+    if (got != 1) {
+      break;
+    }
+  }
+  free(blocks);
+  free(bytes);
+  kg_reader_close(&reader);
+  kg_close(&out);
+
+  /* Канонический вид восстанавливается при чтении: итог проверяется тем же
+   * ключом, прежде чем им можно пользоваться. */
+  if (rc == 0 && kg_verify_file(dst, key, key_len) != 0) {
+    rc = -1;
+  }
+  if (rc != 0) {
+    remove_genome(dst);
+  }
+  return rc;
 }
@@ -3,11 +3,47 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+/* Контейнер покрывает 65536 номеров документов с общими старшими битами:
+ * разреженный хранит отсортированный массив младших 16 бит, плотный —
+ * битовую карту, как в roaring bitmaps. */
+#define KOLIBRI_POSTING_ARRAY_MAX 4096U
+#define KOLIBRI_POSTING_WORDS 1024U
+
+typedef struct {
+    uint32_t key;
+    uint32_t cardinality;
+    uint32_t capacity;
+    uint16_t *values;
+    uint64_t *bits;
+} KolibriPostingContainer;
+
+typedef struct {
+    KolibriPostingContainer *containers;
+    size_t count;
+    size_t capacity;
+} KolibriPostingBitmap;
+
+typedef struct {
+    char *word;
+    KolibriPostingBitmap postings;
+} KolibriKnowledgeTerm;
+
+struct KolibriKnowledgeTermIndex {
+    KolibriKnowledgeTerm *terms;
+    size_t count;
+    size_t capacity;
+    size_t *slots; /* открытая адресация: номер терма + 1, 0 — пусто */
+    size_t slot_count;
+};
+
+static void term_index_free(KolibriKnowledgeTermIndex *terms);
+
 static int ensure_capacity(KolibriKnowledgeIndex *index, size_t additional) {
     if (!index) {
         return -1;
@@ -37,6 +73,7 @@ int kolibri_knowledge_index_init(KolibriKnowledgeIndex *index) {
     index->documents = NULL;
     index->count = 0;
     index->capacity = 0;
+    index->terms = NULL;
     return 0;
 }
 
@@ -64,9 +101,11 @@ void kolibri_knowledge_index_free(KolibriKnowledgeIndex *index) {
         free_document(&index->documents[i]);
     }
     free(index->documents);
+    term_index_free(index->terms);
     index->documents = NULL;
     index->count = 0;
     index->capacity = 0;
+    index->terms = NULL;
 }
 
 static char *duplicate_string(const char *src) {
@@ -275,6 +314,201 @@ static int load_directory_recursive(KolibriKnowledgeIndex *index, const char *ro
     return 0;
 }
 
+static int posting_add(KolibriPostingBitmap *bitmap, uint32_t doc) {
+    uint32_t key = doc >> 16;
+    uint16_t low = (uint16_t)(doc & 0xFFFFU);
+    KolibriPostingContainer *container = bitmap->count ? &bitmap->containers[bitmap->count - 1U] : NULL;
+    if (!container || container->key != key) {
+        if (bitmap->count == bitmap->capacity) {
+            size_t new_capacity = bitmap->capacity ? bitmap->capacity * 2U : 1U;
+            KolibriPostingContainer *containers = (KolibriPostingContainer *)realloc(
+                bitmap->containers, new_capacity * sizeof(KolibriPostingContainer));
+            if (!containers) {
+                return -1;
+            }
+            bitmap->containers = containers;
+            bitmap->capacity = new_capacity;
+        }
+        container = &bitmap->containers[bitmap->count++];
+        memset(container, 0, sizeof(*container));
+        container->key = key;
+    }
+    if (container->bits) {
+        uint64_t mask = 1ULL << (low & 63U);
+        if (!(container->bits[low >> 6] & mask)) {
+            container->bits[low >> 6] |= mask;
+            container->cardinality += 1U;
+        }
+        return 0;
+    }
+    /* Документы приходят по возрастанию, поэтому достаточно сравнить с последним. */
+    if (container->cardinality > 0U && container->values[container->cardinality - 1U] == low) {
+        return 0;
+    }
+    if (container->cardinality == KOLIBRI_POSTING_ARRAY_MAX) {
+        uint64_t *bits = (uint64_t *)calloc(KOLIBRI_POSTING_WORDS, sizeof(uint64_t));
+        if (!bits) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < container->cardinality; ++i) {
+            bits[container->values[i] >> 6] |= 1ULL << (container->values[i] & 63U);
+        }
+        bits[low >> 6] |= 1ULL << (low & 63U);
+        free(container->values);
+        container->values = NULL;
+        container->capacity = 0U;
+        container->bits = bits;
+        container->cardinality += 1U;
+        return 0;
+    }
+    if (container->cardinality == container->capacity) {
+        uint32_t new_capacity = container->capacity ? container->capacity * 2U : 4U;
+        uint16_t *values = (uint16_t *)realloc(container->values, new_capacity * sizeof(uint16_t));
+        if (!values) {
+            return -1;
+        }
+        container->values = values;
+        container->capacity = new_capacity;
+    }
+    container->values[container->cardinality++] = low;
+    return 0;
+}
+
+/* Объединяет карту в плотное множество размера всего индекса. */
+static void posting_union_into(const KolibriPostingBitmap *bitmap, uint64_t *dense, size_t dense_words) {
+    for (size_t c = 0; c < bitmap->count; ++c) {
+        const KolibriPostingContainer *container = &bitmap->containers[c];
+        size_t base = (size_t)container->key * KOLIBRI_POSTING_WORDS;
+        if (container->bits) {
+            for (size_t w = 0; w < KOLIBRI_POSTING_WORDS && base + w < dense_words; ++w) {
+                dense[base + w] |= container->bits[w];
+            }
+            continue;
+        }
+        for (uint32_t i = 0; i < container->cardinality; ++i) {
+            size_t doc = (size_t)container->key << 16 | container->values[i];
+            dense[doc >> 6] |= 1ULL << (doc & 63U);
+        }
+    }
+}
+
+static void posting_free(KolibriPostingBitmap *bitmap) {
+    for (size_t c = 0; c < bitmap->count; ++c) {
+        free(bitmap->containers[c].values);
+        free(bitmap->containers[c].bits);
+    }
+    free(bitmap->containers);
+}
+
+static void term_index_free(KolibriKnowledgeTermIndex *terms) {
+    if (!terms) {
+        return;
+    }
+    for (size_t i = 0; i < terms->count; ++i) {
+        free(terms->terms[i].word);
+        posting_free(&terms->terms[i].postings);
+    }
+    free(terms->terms);
+    free(terms->slots);
+    free(terms);
+}
+
+static size_t hash_word(const char *word, size_t length) {
+    size_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)word[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int term_index_grow(KolibriKnowledgeTermIndex *terms) {
+    size_t slot_count = terms->slot_count ? terms->slot_count * 2U : 1024U;
+    size_t *slots = (size_t *)calloc(slot_count, sizeof(size_t));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < terms->count; ++i) {
+        const char *word = terms->terms[i].word;
+        size_t slot = hash_word(word, strlen(word)) & (slot_count - 1U);
+        while (slots[slot] != 0U) {
+            slot = (slot + 1U) & (slot_count - 1U);
+        }
+        slots[slot] = i + 1U;
+    }
+    free(terms->slots);
+    terms->slots = slots;
+    terms->slot_count = slot_count;
+    return 0;
+}
+
+static KolibriKnowledgeTerm *term_index_intern(KolibriKnowledgeTermIndex *terms, const char *word, size_t length) {
+    if ((terms->count + 1U) * 2U > terms->slot_count && term_index_grow(terms) != 0) {
+        return NULL;
+    }
+    size_t slot = hash_word(word, length) & (terms->slot_count - 1U);
+    while (terms->slots[slot] != 0U) {
+        KolibriKnowledgeTerm *term = &terms->terms[terms->slots[slot] - 1U];
+        if (strncmp(term->word, word, length) == 0 && term->word[length] == '\0') {
+            return term;
+        }
+        slot = (slot + 1U) & (terms->slot_count - 1U);
+    }
+    if (terms->count == terms->capacity) {
+        size_t new_capacity = terms->capacity ? terms->capacity * 2U : 256U;
+        KolibriKnowledgeTerm *grown =
+            (KolibriKnowledgeTerm *)realloc(terms->terms, new_capacity * sizeof(KolibriKnowledgeTerm));
+        if (!grown) {
+            return NULL;
+        }
+        terms->terms = grown;
+        terms->capacity = new_capacity;
+    }
+    KolibriKnowledgeTerm *term = &terms->terms[terms->count];
+    term->word = string_slice(word, length);
+    if (!term->word) {
+        return NULL;
+    }
+    memset(&term->postings, 0, sizeof(term->postings));
+    terms->slots[slot] = ++terms->count;
+    return term;
+}
+
+/* Слова — те же непрерывные alnum-последовательности, что и в tokenize_query:
+ * такой токен может встретиться в тексте только внутри одного слова, поэтому
+ * поиск по словарю совпадает с strstr по content_lower. */
+static KolibriKnowledgeTermIndex *build_term_index(const KolibriKnowledgeIndex *index) {
+    if (index->count > UINT32_MAX) {
+        return NULL;
+    }
+    KolibriKnowledgeTermIndex *terms = (KolibriKnowledgeTermIndex *)calloc(1, sizeof(KolibriKnowledgeTermIndex));
+    if (!terms) {
+        return NULL;
+    }
+    for (size_t d = 0; d < index->count; ++d) {
+        const char *text = index->documents[d].content_lower;
+        size_t i = 0;
+        while (text[i]) {
+            while (text[i] && !isalnum((unsigned char)text[i])) {
+                ++i;
+            }
+            size_t start = i;
+            while (text[i] && isalnum((unsigned char)text[i])) {
+                ++i;
+            }
+            if (i == start) {
+                continue;
+            }
+            KolibriKnowledgeTerm *term = term_index_intern(terms, text + start, i - start);
+            if (!term || posting_add(&term->postings, (uint32_t)d) != 0) {
+                term_index_free(terms);
+                return NULL;
+            }
+        }
+    }
+    return terms;
+}
+
 int kolibri_knowledge_index_load_directory(KolibriKnowledgeIndex *index, const char *root_path) {
     if (!index || !root_path) {
         return -1;
@@ -282,7 +516,11 @@ int kolibri_knowledge_index_load_directory(KolibriKnowledgeIndex *index, const c
     if (!is_directory(root_path)) {
         return 0;
     }
-    return load_directory_recursive(index, root_path, root_path);
+    int rc = load_directory_recursive(index, root_path, root_path);
+    /* Без словаря (например, при нехватке памяти) поиск остаётся полным просмотром. */
+    term_index_free(index->terms);
+    index->terms = build_term_index(index);
+    return rc;
 }
 
 static size_t tokenize_query(const char *query, char tokens[][64], size_t max_tokens) {
@@ -338,6 +576,82 @@ static int compare_ranked(const void *lhs, const void *rhs) {
     return 0;
 }
 
+/* Куча худших из лучших limit кандидатов: на вершине — первый на вылет. */
+static void ranked_sift_down(RankedDocument *heap, size_t count, size_t pos) {
+    for (;;) {
+        size_t worst = pos;
+        size_t left = pos * 2U + 1U;
+        size_t right = left + 1U;
+        if (left < count && compare_ranked(&heap[left], &heap[worst]) > 0) {
+            worst = left;
+        }
+        if (right < count && compare_ranked(&heap[right], &heap[worst]) > 0) {
+            worst = right;
+        }
+        if (worst == pos) {
+            return;
+        }
+        RankedDocument tmp = heap[pos];
+        heap[pos] = heap[worst];
+        heap[worst] = tmp;
+        pos = worst;
+    }
+}
+
+static void ranked_offer(RankedDocument *heap, size_t *count, size_t limit, RankedDocument candidate) {
+    if (*count < limit) {
+        size_t pos = (*count)++;
+        heap[pos] = candidate;
+        while (pos > 0U) {
+            size_t parent = (pos - 1U) / 2U;
+            if (compare_ranked(&heap[pos], &heap[parent]) <= 0) {
+                break;
+            }
+            RankedDocument tmp = heap[pos];
+            heap[pos] = heap[parent];
+            heap[parent] = tmp;
+            pos = parent;
+        }
+        return;
+    }
+    if (compare_ranked(&candidate, &heap[0]) < 0) {
+        heap[0] = candidate;
+        ranked_sift_down(heap, *count, 0U);
+    }
+}
+
+/* Считает попадания токенов в словаре: вместо strstr по каждому документу
+ * объединяются битовые карты слов, содержащих токен. */
+static int count_term_hits(const KolibriKnowledgeIndex *index,
+                           char tokens[][64],
+                           size_t token_count,
+                           unsigned char *hits) {
+    const KolibriKnowledgeTermIndex *terms = index->terms;
+    size_t dense_words = (index->count + 63U) / 64U;
+    uint64_t *dense = (uint64_t *)malloc(dense_words * sizeof(uint64_t));
+    if (!dense) {
+        return -1;
+    }
+    for (size_t t = 0; t < token_count; ++t) {
+        memset(dense, 0, dense_words * sizeof(uint64_t));
+        for (size_t i = 0; i < terms->count; ++i) {
+            if (strstr(terms->terms[i].word, tokens[t]) != NULL) {
+                posting_union_into(&terms->terms[i].postings, dense, dense_words);
+            }
+        }
+        for (size_t w = 0; w < dense_words; ++w) {
+            uint64_t bits = dense[w];
+            for (size_t bit = 0; bits != 0U; ++bit, bits >>= 1) {
+                if (bits & 1U) {
+                    hits[w * 64U + bit] += 1U;
+                }
+            }
+        }
+    }
+    free(dense);
+    return 0;
+}
+
 size_t kolibri_knowledge_search(const KolibriKnowledgeIndex *index,
                                 const char *query,
                                 size_t limit,
@@ -354,33 +668,37 @@ size_t kolibri_knowledge_search(const KolibriKnowledgeIndex *index,
     if (token_count == 0) {
         return 0;
     }
-    RankedDocument *ranked = (RankedDocument *)malloc(index->count * sizeof(RankedDocument));
-    if (!ranked) {
+    unsigned char *hits = (unsigned char *)calloc(index->count, 1U);
+    if (!hits) {
         return 0;
     }
-    size_t ranked_count = 0;
-    for (size_t i = 0; i < index->count; ++i) {
-        const KolibriKnowledgeDocument *doc = &index->documents[i];
-        double score = 0.0;
-        for (size_t t = 0; t < token_count; ++t) {
-            if (strstr(doc->content_lower, tokens[t]) != NULL) {
-                score += 1.0;
+    if (!index->terms || count_term_hits(index, tokens, token_count, hits) != 0) {
+        memset(hits, 0, index->count);
+        for (size_t i = 0; i < index->count; ++i) {
+            for (size_t t = 0; t < token_count; ++t) {
+                if (strstr(index->documents[i].content_lower, tokens[t]) != NULL) {
+                    hits[i] += 1U;
+                }
             }
         }
-        if (score > 0.0) {
-            ranked[ranked_count].score = score;
-            ranked[ranked_count].index = i;
-            ++ranked_count;
-        }
     }
-    if (ranked_count == 0) {
-        free(ranked);
+    if (limit > index->count) {
+        limit = index->count;
+    }
+    RankedDocument *ranked = (RankedDocument *)malloc(limit * sizeof(RankedDocument));
+    if (!ranked) {
+        free(hits);
         return 0;
     }
-    qsort(ranked, ranked_count, sizeof(RankedDocument), compare_ranked);
-    if (ranked_count > limit) {
-        ranked_count = limit;
+    size_t ranked_count = 0;
+    for (size_t i = 0; i < index->count; ++i) {
+        if (hits[i] > 0U) {
+            RankedDocument candidate = { (double)hits[i], i };
+            ranked_offer(ranked, &ranked_count, limit, candidate);
+        }
     }
+    free(hits);
+    qsort(ranked, ranked_count, sizeof(RankedDocument), compare_ranked);
     for (size_t i = 0; i < ranked_count; ++i) {
         results[i] = &index->documents[ranked[i].index];
         if (scores) {
@@ -1,15 +1,46 @@
 #include "kolibri/knowledge_index.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define KOLIBRI_INDEX_HAS_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KOLIBRI_INDEX_HAS_NEON 1
+#endif
+
+#define KOLIBRI_MEMORY_SUBSYSTEM KOLIBRI_MEMORY_KNOWLEDGE_INDEX
+#include "kolibri/memory.h"
 
 #define KOLIBRI_TOP_TERMS 32U
+/* Веса постингов квантуются в int8 с масштабом на документ. */
+#define KOLIBRI_QUANT_MAX 127
+/* Номера документов в постингах — uint32, gather AVX2 читает их как int32. */
+#define KOLIBRI_POSTING_DOC_LIMIT ((size_t)INT32_MAX)
+/* Кандидатов по квантованной оценке на одно место выдачи перед точным переранжированием. */
+#define KOLIBRI_RERANK_FACTOR 2U
+/* Накопление по термам выгоднее обхода документов, когда постингов запроса
+ * не меньше 1/KOLIBRI_ACCUMULATE_DENSITY от числа документов. */
+#define KOLIBRI_ACCUMULATE_DENSITY 8U
+#define KOLIBRI_INGEST_MAX_THREADS 32U
+#define KOLIBRI_INGEST_MIN_FILES_PER_THREAD 16U
 
 typedef struct {
     char *token;
@@ -20,8 +51,23 @@ typedef struct {
 typedef struct {
     char *token;
     size_t count;
+    size_t global_index;
 } DocToken;
 
+/* Открытая адресация с линейным пробированием: ключи ссылаются на строки,
+ * которыми владеют массивы токенов, значение — позиция в этом массиве. */
+typedef struct {
+    const char *key;
+    uint64_t hash;
+    size_t value;
+} TokenSlot;
+
+typedef struct {
+    TokenSlot *slots;
+    size_t capacity;
+    size_t count;
+} TokenMap;
+
 typedef struct {
     char *id;
     char *title;
@@ -30,14 +76,66 @@ typedef struct {
     KolibriKnowledgeVectorItem *vector;
     size_t vector_size;
     float norm;
+    /* Раскладка совпадает с KolibriKnowledgeDoc. */
+    char *json;
+    size_t json_length;
+    char *preview;
+    size_t preview_length;
 } Document;
 
+/* Вторичный индекс словаря для префиксного и нечёткого поиска по токенам
+ * [0, token_count): номера в лексикографическом порядке и пары
+ * (триграмма строки "^токен$", токен), упорядоченные по триграмме. */
+typedef struct {
+    uint32_t gram;
+    uint32_t token;
+} VocabularyGram;
+
+typedef struct {
+    size_t *sorted;
+    VocabularyGram *grams;
+    size_t gram_count;
+    size_t token_count;
+} Vocabulary;
+
 struct KolibriKnowledgeIndex {
     Document *documents;
     size_t document_count;
     GlobalToken *tokens;
     size_t token_count;
     size_t token_capacity;
+    TokenMap token_map;
+    /* Постинги токена i занимают [posting_offsets[i], posting_offsets[i + 1]) в
+     * параллельных массивах posting_docs (по возрастанию) и posting_weights.
+     * Вклад терма в косинус документа d равен posting_weights * posting_scales[d],
+     * то есть масштаб квантования уже поделён на норму документа. */
+    size_t *posting_offsets;
+    uint32_t *posting_docs;
+    int8_t *posting_weights;
+    float *posting_scales;
+    size_t posting_count;
+    /* Верхняя граница weight / norm по постингам токена — для отсечения MaxScore. */
+    float *max_weights;
+    /* Индекс, загруженный из index.bin: строки, векторы и постинги указывают
+     * внутрь отображения, своими остаются только массивы documents и tokens. */
+    void *mapping;
+    size_t mapping_size;
+    size_t mapped_token_count;
+    int postings_mapped;
+    /* Живой сегмент: документы, добавленные после построения. Каждый выделен
+     * отдельно, поэтому указатели из kolibri_knowledge_index_document не
+     * устаревают ни при добавлении, ни при слиянии. */
+    Document **added;
+    size_t added_count;
+    size_t added_capacity;
+    /* Постинги покрывают документы [0, posted_count) и токены
+     * [0, posting_token_count); остальные документы перебираются целиком. */
+    size_t posted_count;
+    size_t posting_token_count;
+    /* Словарь токенов сверх vocabulary.token_count перебирается целиком. */
+    Vocabulary vocabulary;
+    pthread_rwlock_t lock;
+    pthread_mutex_t merge_lock;
 };
 
 static void *kolibri_alloc(size_t size) {
@@ -63,6 +161,71 @@ static char *kolibri_strdup(const char *text) {
     return copy;
 }
 
+static uint64_t token_hash(const char *text) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *cursor = (const unsigned char *)text; *cursor; ++cursor) {
+        hash ^= (uint64_t)*cursor;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void token_map_init(TokenMap *map) {
+    map->slots = NULL;
+    map->capacity = 0U;
+    map->count = 0U;
+}
+
+static void token_map_free(TokenMap *map) {
+    free(map->slots);
+    token_map_init(map);
+}
+
+static size_t token_map_find(const TokenMap *map, const char *key, uint64_t hash) {
+    if (map->capacity == 0U) {
+        return (size_t)-1;
+    }
+    size_t mask = map->capacity - 1U;
+    for (size_t pos = (size_t)hash & mask;; pos = (pos + 1U) & mask) {
+        const TokenSlot *slot = &map->slots[pos];
+        if (!slot->key) {
+            return (size_t)-1;
+        }
+        if (slot->hash == hash && strcmp(slot->key, key) == 0) {
+            return slot->value;
+        }
+    }
+}
+
+static void token_map_place(TokenSlot *slots, size_t capacity, const char *key, uint64_t hash, size_t value) {
+    size_t mask = capacity - 1U;
+    size_t pos = (size_t)hash & mask;
+    while (slots[pos].key) {
+        pos = (pos + 1U) & mask;
+    }
+    slots[pos].key = key;
+    slots[pos].hash = hash;
+    slots[pos].value = value;
+}
+
+/* Ключ должен отсутствовать в таблице: вызывающий сначала делает token_map_find. */
+static void token_map_insert(TokenMap *map, const char *key, uint64_t hash, size_t value) {
+    if ((map->count + 1U) * 10U > map->capacity * 7U) {
+        size_t new_capacity = map->capacity == 0U ? 64U : map->capacity * 2U;
+        TokenSlot *slots = (TokenSlot *)kolibri_alloc(new_capacity * sizeof(TokenSlot));
+        for (size_t i = 0; i < map->capacity; ++i) {
+            if (map->slots[i].key) {
+                token_map_place(slots, new_capacity, map->slots[i].key, map->slots[i].hash, map->slots[i].value);
+            }
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->capacity = new_capacity;
+    }
+    token_map_place(map->slots, map->capacity, key, hash, value);
+    map->count += 1U;
+}
+
 static int is_markdown_file(const char *path) {
     size_t len = strlen(path);
     return len > 3U && strcmp(path + len - 3U, ".md") == 0;
@@ -128,6 +291,19 @@ static void collect_markdown_files(const char *root, PathList *list) {
             }
             char buffer[4096];
             snprintf(buffer, sizeof(buffer), "%s/%s", root, entry->d_name);
+#ifdef _DIRENT_HAVE_D_TYPE
+            /* Тип из readdir избавляет от stat на каждый файл дерева. */
+            if (entry->d_type == DT_REG) {
+                if (is_markdown_file(buffer)) {
+                    path_list_push(list, buffer);
+                }
+                continue;
+            }
+            if (entry->d_type == DT_DIR) {
+                collect_markdown_files(buffer, list);
+                continue;
+            }
+#endif
             if (path_is_directory(buffer)) {
                 collect_markdown_files(buffer, list);
             } else if (is_markdown_file(buffer)) {
@@ -235,13 +411,86 @@ static char *shorten_content(const char *content, size_t max_length) {
     return result;
 }
 
-static void doc_token_list_add(DocToken **tokens, size_t *count, size_t *capacity, const char *token) {
-    for (size_t i = 0; i < *count; ++i) {
-        if (strcmp((*tokens)[i].token, token) == 0) {
-            (*tokens)[i].count += 1U;
-            return;
+/* Правила экранирования совпадают с выводом JSON сервера. */
+static size_t json_escaped_length(const char *text) {
+    size_t length = 0U;
+    for (const unsigned char *cursor = (const unsigned char *)(text ? text : ""); *cursor; ++cursor) {
+        if (*cursor == '"' || *cursor == '\\' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t') {
+            length += 2U;
+        } else if (*cursor < 0x20U) {
+            length += 6U;
+        } else {
+            length += 1U;
+        }
+    }
+    return length;
+}
+
+static char *json_escape_into(char *out, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    *out++ = '"';
+    for (const unsigned char *cursor = (const unsigned char *)(text ? text : ""); *cursor; ++cursor) {
+        unsigned char ch = *cursor;
+        if (ch == '"' || ch == '\\') {
+            *out++ = '\\';
+            *out++ = (char)ch;
+        } else if (ch == '\n' || ch == '\r' || ch == '\t') {
+            *out++ = '\\';
+            *out++ = ch == '\n' ? 'n' : (ch == '\r' ? 'r' : 't');
+        } else if (ch < 0x20U) {
+            memcpy(out, "\\u00", 4U);
+            out[4] = hex[ch >> 4];
+            out[5] = hex[ch & 0xFU];
+            out += 6;
+        } else {
+            *out++ = (char)ch;
         }
     }
+    *out++ = '"';
+    return out;
+}
+
+/* Готовит JSON-фрагмент и превью документа, чтобы путь ответа только копировал байты. */
+static void document_render(Document *doc) {
+    static const char *const keys[] = { "\"id\":", ",\"title\":", ",\"content\":", ",\"source\":" };
+    const char *fields[] = { doc->id, doc->title, doc->content, doc->source };
+    size_t length = 0U;
+    for (size_t i = 0; i < 4U; ++i) {
+        length += strlen(keys[i]) + json_escaped_length(fields[i]) + 2U;
+    }
+    doc->json = (char *)kolibri_alloc(length + 1U);
+    char *out = doc->json;
+    for (size_t i = 0; i < 4U; ++i) {
+        size_t key_length = strlen(keys[i]);
+        memcpy(out, keys[i], key_length);
+        out = json_escape_into(out + key_length, fields[i]);
+    }
+    *out = '\0';
+    doc->json_length = length;
+
+    const char *content = doc->content ? doc->content : "";
+    size_t content_length = strlen(content);
+    size_t keep = content_length <= KOLIBRI_KNOWLEDGE_PREVIEW_BYTES ? content_length : KOLIBRI_KNOWLEDGE_PREVIEW_BYTES;
+    doc->preview_length = keep + (keep < content_length ? 3U : 0U);
+    doc->preview = (char *)kolibri_alloc(doc->preview_length + 1U);
+    memcpy(doc->preview, content, keep);
+    if (keep < content_length) {
+        memcpy(doc->preview + keep, "...", 3U);
+    }
+    doc->preview[doc->preview_length] = '\0';
+}
+
+static void doc_token_list_add(DocToken **tokens,
+                               size_t *count,
+                               size_t *capacity,
+                               TokenMap *map,
+                               const char *token) {
+    uint64_t hash = token_hash(token);
+    size_t existing = token_map_find(map, token, hash);
+    if (existing != (size_t)-1) {
+        (*tokens)[existing].count += 1U;
+        return;
+    }
     if (*count == *capacity) {
         size_t new_cap = (*capacity == 0U) ? 16U : (*capacity * 2U);
         DocToken *new_tokens = (DocToken *)realloc(*tokens, new_cap * sizeof(DocToken));
@@ -254,20 +503,25 @@ static void doc_token_list_add(DocToken **tokens, size_t *count, size_t *capacit
     }
     (*tokens)[*count].token = kolibri_strdup(token);
     (*tokens)[*count].count = 1U;
+    (*tokens)[*count].global_index = (size_t)-1;
+    token_map_insert(map, (*tokens)[*count].token, hash, *count);
     *count += 1U;
 }
 
-static void global_register_tokens(GlobalToken **tokens, size_t *count, size_t *capacity, DocToken *doc_tokens, size_t doc_count) {
+static void global_register_tokens(GlobalToken **tokens,
+                                   size_t *count,
+                                   size_t *capacity,
+                                   TokenMap *map,
+                                   DocToken *doc_tokens,
+                                   size_t doc_count) {
     for (size_t i = 0; i < doc_count; ++i) {
         const char *token = doc_tokens[i].token;
-        size_t j;
-        for (j = 0; j < *count; ++j) {
-            if (strcmp((*tokens)[j].token, token) == 0) {
-                (*tokens)[j].df += 1U;
-                break;
-            }
-        }
-        if (j == *count) {
+        uint64_t hash = token_hash(token);
+        size_t j = token_map_find(map, token, hash);
+        if (j != (size_t)-1) {
+            (*tokens)[j].df += 1U;
+        } else {
+            j = *count;
             if (*count == *capacity) {
                 size_t new_cap = (*capacity == 0U) ? 64U : (*capacity * 2U);
                 GlobalToken *new_tokens = (GlobalToken *)realloc(*tokens, new_cap * sizeof(GlobalToken));
@@ -281,8 +535,10 @@ static void global_register_tokens(GlobalToken **tokens, size_t *count, size_t *
             (*tokens)[*count].token = kolibri_strdup(token);
             (*tokens)[*count].df = 1U;
             (*tokens)[*count].idf = 0.0f;
+            token_map_insert(map, (*tokens)[*count].token, hash, *count);
             *count += 1U;
         }
+        doc_tokens[i].global_index = j;
     }
 }
 
@@ -299,13 +555,22 @@ static void compute_idf(GlobalToken *tokens, size_t token_count, size_t total_do
     }
 }
 
-static size_t find_global_token(const GlobalToken *tokens, size_t token_count, const char *token) {
-    for (size_t i = 0; i < token_count; ++i) {
-        if (strcmp(tokens[i].token, token) == 0) {
-            return i;
+static size_t find_global_token(const KolibriKnowledgeIndex *index, const char *token) {
+    return token_map_find(&index->token_map, token, token_hash(token));
+}
+
+static void rebuild_token_map(KolibriKnowledgeIndex *index) {
+    token_map_free(&index->token_map);
+    for (size_t i = 0; i < index->token_count; ++i) {
+        const char *token = index->tokens[i].token;
+        if (!token) {
+            continue;
+        }
+        uint64_t hash = token_hash(token);
+        if (token_map_find(&index->token_map, token, hash) == (size_t)-1) {
+            token_map_insert(&index->token_map, token, hash, i);
         }
     }
-    return (size_t)-1;
 }
 
 static int vector_compare(const void *a, const void *b) {
@@ -320,6 +585,17 @@ static int vector_compare(const void *a, const void *b) {
     return 0;
 }
 
+static size_t index_total_documents(const KolibriKnowledgeIndex *index) {
+    return index->document_count + index->added_count;
+}
+
+static const Document *index_doc(const KolibriKnowledgeIndex *index, size_t doc_index) {
+    if (doc_index < index->document_count) {
+        return &index->documents[doc_index];
+    }
+    return index->added[doc_index - index->document_count];
+}
+
 static KolibriKnowledgeIndex *knowledge_index_new(void) {
     KolibriKnowledgeIndex *index = (KolibriKnowledgeIndex *)kolibri_alloc(sizeof(KolibriKnowledgeIndex));
     index->documents = NULL;
@@ -327,33 +603,254 @@ static KolibriKnowledgeIndex *knowledge_index_new(void) {
     index->tokens = NULL;
     index->token_count = 0U;
     index->token_capacity = 0U;
+    token_map_init(&index->token_map);
+    index->posting_offsets = NULL;
+    index->posting_docs = NULL;
+    index->posting_weights = NULL;
+    index->posting_scales = NULL;
+    index->posting_count = 0U;
+    index->max_weights = NULL;
+    index->mapping = NULL;
+    index->mapping_size = 0U;
+    index->mapped_token_count = 0U;
+    index->postings_mapped = 0;
+    index->added = NULL;
+    index->added_count = 0U;
+    index->added_capacity = 0U;
+    index->posted_count = 0U;
+    index->posting_token_count = 0U;
+    memset(&index->vocabulary, 0, sizeof(index->vocabulary));
+    pthread_rwlock_init(&index->lock, NULL);
+    pthread_mutex_init(&index->merge_lock, NULL);
     return index;
 }
 
-static int parse_markdown_document(const char *path,
-                                   size_t max_length,
-                                   Document *out_doc,
-                                   DocToken **out_tokens,
-                                   size_t *out_token_count) {
-    char *content = read_file_utf8(path);
-    if (!content) {
-        return -1;
+typedef struct {
+    const char *text;
+    size_t token;
+} VocabularyEntry;
+
+static int vocabulary_entry_compare(const void *a, const void *b) {
+    return strcmp(((const VocabularyEntry *)a)->text, ((const VocabularyEntry *)b)->text);
+}
+
+static int vocabulary_gram_key_compare(const void *a, const void *b) {
+    uint32_t ga = *(const uint32_t *)a;
+    uint32_t gb = *(const uint32_t *)b;
+    return (ga > gb) - (ga < gb);
+}
+
+static int vocabulary_gram_compare(const void *a, const void *b) {
+    const VocabularyGram *ga = (const VocabularyGram *)a;
+    const VocabularyGram *gb = (const VocabularyGram *)b;
+    if (ga->gram != gb->gram) {
+        return ga->gram < gb->gram ? -1 : 1;
     }
+    return (ga->token > gb->token) - (ga->token < gb->token);
+}
 
-    char *title = extract_title(content);
-    char *short_content = shorten_content(content, max_length);
-    if (!short_content) {
-        short_content = kolibri_strdup(content);
+/* Триграммы токена с границами слова; у токена длины n их ровно n. */
+static size_t token_grams(const char *token, uint32_t *out) {
+    unsigned char padded[132];
+    size_t len = strlen(token);
+    if (len > sizeof(padded) - 3U) {
+        len = sizeof(padded) - 3U;
     }
+    padded[0] = '^';
+    memcpy(padded + 1, token, len);
+    padded[len + 1U] = '$';
+    for (size_t i = 0; i < len; ++i) {
+        out[i] = ((uint32_t)padded[i] << 16) | ((uint32_t)padded[i + 1U] << 8) | padded[i + 2U];
+    }
+    return len;
+}
 
-    DocToken *doc_tokens = NULL;
-    size_t token_count = 0U;
-    size_t token_capacity = 0U;
-    size_t total_tokens = 0U;
+static const char *vocabulary_text(const KolibriKnowledgeIndex *index, size_t token) {
+    return index->tokens[token].token ? index->tokens[token].token : "";
+}
+
+static void vocabulary_free(Vocabulary *vocabulary) {
+    free(vocabulary->sorted);
+    free(vocabulary->grams);
+    memset(vocabulary, 0, sizeof(*vocabulary));
+}
+
+static void vocabulary_build(const KolibriKnowledgeIndex *index, size_t token_count, Vocabulary *out) {
+    memset(out, 0, sizeof(*out));
+    VocabularyEntry *entries = (VocabularyEntry *)kolibri_alloc((token_count ? token_count : 1U) * sizeof(VocabularyEntry));
+    size_t gram_total = 0U;
+    for (size_t i = 0; i < token_count; ++i) {
+        entries[i].text = vocabulary_text(index, i);
+        entries[i].token = i;
+        gram_total += strlen(entries[i].text);
+    }
+    qsort(entries, token_count, sizeof(VocabularyEntry), vocabulary_entry_compare);
+    out->sorted = (size_t *)kolibri_alloc((token_count ? token_count : 1U) * sizeof(size_t));
+    for (size_t i = 0; i < token_count; ++i) {
+        out->sorted[i] = entries[i].token;
+    }
+    free(entries);
+
+    out->grams = (VocabularyGram *)kolibri_alloc((gram_total ? gram_total : 1U) * sizeof(VocabularyGram));
+    uint32_t grams[128];
+    for (size_t i = 0; i < token_count; ++i) {
+        size_t count = token_grams(vocabulary_text(index, i), grams);
+        for (size_t g = 0; g < count; ++g) {
+            out->grams[out->gram_count].gram = grams[g];
+            out->grams[out->gram_count].token = (uint32_t)i;
+            out->gram_count += 1U;
+        }
+    }
+    qsort(out->grams, out->gram_count, sizeof(VocabularyGram), vocabulary_gram_compare);
+    /* Повторы триграммы внутри токена ("^aaa$") считаем один раз. */
+    size_t unique = 0U;
+    for (size_t i = 0; i < out->gram_count; ++i) {
+        if (unique == 0U || out->grams[i].gram != out->grams[unique - 1U].gram ||
+            out->grams[i].token != out->grams[unique - 1U].token) {
+            out->grams[unique++] = out->grams[i];
+        }
+    }
+    out->gram_count = unique;
+    out->token_count = token_count;
+}
+
+typedef struct {
+    size_t *offsets;
+    uint32_t *docs;
+    int8_t *weights;
+    float *scales;
+    size_t count;
+    float *max_weights;
+    Vocabulary vocabulary;
+} PostingArrays;
+
+static int8_t quantize_weight(float weight, float scale) {
+    if (scale <= 0.0f || weight == 0.0f) {
+        return 0;
+    }
+    long level = lrintf(weight / scale);
+    /* Ненулевой вес не должен исчезнуть из постингов при округлении. */
+    if (level == 0L) {
+        level = weight > 0.0f ? 1L : -1L;
+    }
+    if (level > KOLIBRI_QUANT_MAX) {
+        level = KOLIBRI_QUANT_MAX;
+    } else if (level < -KOLIBRI_QUANT_MAX) {
+        level = -KOLIBRI_QUANT_MAX;
+    }
+    return (int8_t)level;
+}
+
+/* Строит постинги по первым doc_count документам и token_count токенам;
+ * индекс только читается, поэтому слияние выполняется под read-блокировкой. */
+static void build_posting_arrays(const KolibriKnowledgeIndex *index,
+                                 size_t doc_count,
+                                 size_t token_count,
+                                 PostingArrays *out) {
+    out->offsets = (size_t *)kolibri_alloc((token_count + 1U) * sizeof(size_t));
+    out->max_weights = (float *)kolibri_alloc((token_count ? token_count : 1U) * sizeof(float));
+    out->scales = (float *)kolibri_alloc((doc_count ? doc_count : 1U) * sizeof(float));
+    out->docs = NULL;
+    out->weights = NULL;
+    out->count = 0U;
+    vocabulary_build(index, token_count, &out->vocabulary);
+
+    for (size_t i = 0; i < doc_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        float peak = 0.0f;
+        for (size_t j = 0; j < doc->vector_size; ++j) {
+            size_t token_index = doc->vector[j].token_index;
+            if (token_index < token_count) {
+                out->offsets[token_index + 1U] += 1U;
+                out->count += 1U;
+            }
+            float magnitude = fabsf(doc->vector[j].weight);
+            if (magnitude > peak) {
+                peak = magnitude;
+            }
+        }
+        out->scales[i] = doc->norm > 0.0f ? peak / (float)KOLIBRI_QUANT_MAX / doc->norm : 0.0f;
+    }
+    for (size_t t = 0; t < token_count; ++t) {
+        out->offsets[t + 1U] += out->offsets[t];
+    }
+    if (out->count == 0U) {
+        return;
+    }
+
+    out->docs = (uint32_t *)kolibri_alloc(out->count * sizeof(uint32_t));
+    out->weights = (int8_t *)kolibri_alloc(out->count * sizeof(int8_t));
+    size_t *fill = (size_t *)kolibri_alloc((token_count ? token_count : 1U) * sizeof(size_t));
+    memcpy(fill, out->offsets, token_count * sizeof(size_t));
+    for (size_t i = 0; i < doc_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        for (size_t j = 0; j < doc->vector_size; ++j) {
+            size_t token_index = doc->vector[j].token_index;
+            if (token_index >= token_count) {
+                continue;
+            }
+            size_t slot = fill[token_index]++;
+            float normalized = doc->norm > 0.0f ? doc->vector[j].weight / doc->norm : 0.0f;
+            int8_t level = quantize_weight(normalized, out->scales[i]);
+            out->docs[slot] = (uint32_t)i;
+            out->weights[slot] = level;
+            /* Граница считается по квантованному весу — именно им оценивается документ. */
+            float bound = (float)level * out->scales[i];
+            if (bound > out->max_weights[token_index]) {
+                out->max_weights[token_index] = bound;
+            }
+        }
+    }
+    free(fill);
+}
+
+static void free_posting_arrays(KolibriKnowledgeIndex *index) {
+    if (!index->postings_mapped) {
+        free(index->posting_offsets);
+        free(index->posting_docs);
+        free(index->posting_weights);
+        free(index->posting_scales);
+        free(index->max_weights);
+    }
+}
+
+static void install_posting_arrays(KolibriKnowledgeIndex *index,
+                                   PostingArrays *arrays,
+                                   size_t doc_count,
+                                   size_t token_count) {
+    free_posting_arrays(index);
+    index->posting_offsets = arrays->offsets;
+    index->posting_docs = arrays->docs;
+    index->posting_weights = arrays->weights;
+    index->posting_scales = arrays->scales;
+    index->posting_count = arrays->count;
+    index->max_weights = arrays->max_weights;
+    index->postings_mapped = 0;
+    index->posted_count = doc_count;
+    index->posting_token_count = token_count;
+    vocabulary_free(&index->vocabulary);
+    index->vocabulary = arrays->vocabulary;
+}
+
+static void build_postings(KolibriKnowledgeIndex *index) {
+    PostingArrays arrays;
+    size_t doc_count = index_total_documents(index);
+    if (doc_count > KOLIBRI_POSTING_DOC_LIMIT) {
+        doc_count = KOLIBRI_POSTING_DOC_LIMIT;
+    }
+    build_posting_arrays(index, doc_count, index->token_count, &arrays);
+    install_posting_arrays(index, &arrays, doc_count, index->token_count);
+}
 
+static size_t tokenize_text(const char *text,
+                            DocToken **tokens,
+                            size_t *count,
+                            size_t *capacity,
+                            TokenMap *map) {
+    size_t total_tokens = 0U;
     char buffer[128];
     size_t buffer_len = 0U;
-    const unsigned char *cursor = (const unsigned char *)content;
+    const unsigned char *cursor = (const unsigned char *)text;
     while (*cursor != '\0') {
         if (isalnum(*cursor)) {
             if (buffer_len < sizeof(buffer) - 1U) {
@@ -362,7 +859,7 @@ static int parse_markdown_document(const char *path,
         } else {
             if (buffer_len > 0U) {
                 buffer[buffer_len] = '\0';
-                doc_token_list_add(&doc_tokens, &token_count, &token_capacity, buffer);
+                doc_token_list_add(tokens, count, capacity, map, buffer);
                 total_tokens += 1U;
                 buffer_len = 0U;
             }
@@ -371,10 +868,35 @@ static int parse_markdown_document(const char *path,
     }
     if (buffer_len > 0U) {
         buffer[buffer_len] = '\0';
-        doc_token_list_add(&doc_tokens, &token_count, &token_capacity, buffer);
+        doc_token_list_add(tokens, count, capacity, map, buffer);
         total_tokens += 1U;
     }
+    return total_tokens;
+}
+
+static int parse_markdown_document(const char *path,
+                                   size_t max_length,
+                                   Document *out_doc,
+                                   DocToken **out_tokens,
+                                   size_t *out_token_count) {
+    char *content = read_file_utf8(path);
+    if (!content) {
+        return -1;
+    }
+
+    char *title = extract_title(content);
+    char *short_content = shorten_content(content, max_length);
+    if (!short_content) {
+        short_content = kolibri_strdup(content);
+    }
 
+    DocToken *doc_tokens = NULL;
+    size_t token_count = 0U;
+    size_t token_capacity = 0U;
+    TokenMap doc_map;
+    token_map_init(&doc_map);
+    size_t total_tokens = tokenize_text(content, &doc_tokens, &token_count, &token_capacity, &doc_map);
+    token_map_free(&doc_map);
     free(content);
 
     out_doc->id = derive_id_from_path(path);
@@ -384,6 +906,7 @@ static int parse_markdown_document(const char *path,
     out_doc->vector = NULL;
     out_doc->vector_size = 0U;
     out_doc->norm = 0.0f;
+    document_render(out_doc);
 
     *out_tokens = doc_tokens;
     *out_token_count = token_count;
@@ -391,7 +914,6 @@ static int parse_markdown_document(const char *path,
 }
 
 static void compute_document_vector(const GlobalToken *tokens,
-                                    size_t token_count,
                                     const DocToken *doc_tokens,
                                     size_t doc_token_count,
                                     size_t total_docs,
@@ -415,7 +937,7 @@ static void compute_document_vector(const GlobalToken *tokens,
 
     double norm = 0.0;
     for (size_t i = 0; i < doc_token_count; ++i) {
-        size_t token_index = find_global_token(tokens, token_count, doc_tokens[i].token);
+        size_t token_index = doc_tokens[i].global_index;
         if (token_index == (size_t)-1) {
             continue;
         }
@@ -452,10 +974,146 @@ static void compute_document_vector(const GlobalToken *tokens,
     doc->norm = (float)(sqrt(norm) ?: 1e-6);
 }
 
-int kolibri_knowledge_index_create(const char *const *roots,
-                                   size_t root_count,
-                                   size_t max_length,
-                                   KolibriKnowledgeIndex **out_index) {
+/* Разбор идёт непрерывными диапазонами файлов: каждый поток ведёт свой словарь
+ * в порядке первого появления, и слияние словарей по порядку диапазонов даёт
+ * ту же нумерацию токенов, что и последовательный проход. */
+typedef struct {
+    const PathList *paths;
+    size_t begin;
+    size_t end;
+    size_t max_length;
+    Document *documents;
+    DocToken **doc_tokens;
+    size_t *doc_token_counts;
+    GlobalToken *tokens;
+    size_t token_count;
+    size_t token_capacity;
+    TokenMap token_map;
+    size_t *remap;
+    const GlobalToken *global_tokens;
+    size_t total_docs;
+} IngestTask;
+
+static void *ingest_parse_range(void *arg) {
+    IngestTask *task = (IngestTask *)arg;
+    for (size_t i = task->begin; i < task->end; ++i) {
+        DocToken *doc_tokens = NULL;
+        size_t doc_token_count = 0U;
+        if (parse_markdown_document(task->paths->items[i],
+                                    task->max_length,
+                                    &task->documents[i],
+                                    &doc_tokens,
+                                    &doc_token_count) < 0) {
+            task->documents[i].id = derive_id_from_path(task->paths->items[i]);
+            task->documents[i].title = kolibri_strdup(task->documents[i].id);
+            task->documents[i].source = kolibri_strdup(task->paths->items[i]);
+            task->documents[i].content = kolibri_strdup("");
+        }
+        task->doc_tokens[i] = doc_tokens;
+        task->doc_token_counts[i] = doc_token_count;
+        if (doc_token_count > 0U) {
+            global_register_tokens(&task->tokens,
+                                   &task->token_count,
+                                   &task->token_capacity,
+                                   &task->token_map,
+                                   doc_tokens,
+                                   doc_token_count);
+        }
+    }
+    return NULL;
+}
+
+static void *ingest_vector_range(void *arg) {
+    IngestTask *task = (IngestTask *)arg;
+    for (size_t i = task->begin; i < task->end; ++i) {
+        DocToken *doc_tokens = task->doc_tokens[i];
+        for (size_t j = 0; j < task->doc_token_counts[i]; ++j) {
+            doc_tokens[j].global_index = task->remap[doc_tokens[j].global_index];
+        }
+        compute_document_vector(task->global_tokens,
+                                doc_tokens,
+                                task->doc_token_counts[i],
+                                task->total_docs,
+                                &task->documents[i]);
+        free_doc_tokens(doc_tokens, task->doc_token_counts[i]);
+        task->doc_tokens[i] = NULL;
+    }
+    return NULL;
+}
+
+static size_t ingest_thread_count(size_t files) {
+#ifdef _WIN32
+    size_t threads = 1U;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 0 ? (size_t)cpus : 1U;
+#endif
+    if (threads > KOLIBRI_INGEST_MAX_THREADS) {
+        threads = KOLIBRI_INGEST_MAX_THREADS;
+    }
+    size_t useful = files / KOLIBRI_INGEST_MIN_FILES_PER_THREAD;
+    if (threads > useful) {
+        threads = useful;
+    }
+    return threads > 0U ? threads : 1U;
+}
+
+/* Первый диапазон обрабатывает вызывающий поток; если поток не создался,
+ * его диапазон выполняется здесь же после остальных. */
+static void run_ingest_tasks(IngestTask *tasks, size_t threads, void *(*fn)(void *)) {
+    pthread_t handles[KOLIBRI_INGEST_MAX_THREADS];
+    int started[KOLIBRI_INGEST_MAX_THREADS];
+    for (size_t t = 1; t < threads; ++t) {
+        started[t] = pthread_create(&handles[t], NULL, fn, &tasks[t]) == 0;
+    }
+    fn(&tasks[0]);
+    for (size_t t = 1; t < threads; ++t) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        } else {
+            fn(&tasks[t]);
+        }
+    }
+}
+
+/* Переносит локальный словарь потока в общий; строки новых токенов
+ * передаются общему словарю без копирования. */
+static void merge_task_vocabulary(KolibriKnowledgeIndex *index, IngestTask *task) {
+    task->remap = (size_t *)kolibri_alloc((task->token_count ? task->token_count : 1U) * sizeof(size_t));
+    for (size_t j = 0; j < task->token_count; ++j) {
+        GlobalToken *local = &task->tokens[j];
+        uint64_t hash = token_hash(local->token);
+        size_t global = token_map_find(&index->token_map, local->token, hash);
+        if (global != (size_t)-1) {
+            index->tokens[global].df += local->df;
+            free(local->token);
+        } else {
+            if (index->token_count == index->token_capacity) {
+                size_t capacity = index->token_capacity ? index->token_capacity * 2U : 64U;
+                GlobalToken *tokens = (GlobalToken *)realloc(index->tokens, capacity * sizeof(GlobalToken));
+                if (!tokens) {
+                    fprintf(stderr, "[kolibri-knowledge] realloc global tokens failed\n");
+                    abort();
+                }
+                index->tokens = tokens;
+                index->token_capacity = capacity;
+            }
+            global = index->token_count++;
+            index->tokens[global] = *local;
+            token_map_insert(&index->token_map, local->token, hash, global);
+        }
+        task->remap[j] = global;
+    }
+    free(task->tokens);
+    task->tokens = NULL;
+    token_map_free(&task->token_map);
+}
+
+int kolibri_knowledge_index_create_threads(const char *const *roots,
+                                           size_t root_count,
+                                           size_t max_length,
+                                           size_t threads,
+                                           KolibriKnowledgeIndex **out_index) {
     if (!roots || root_count == 0U || !out_index) {
         return EINVAL;
     }
@@ -476,35 +1134,48 @@ int kolibri_knowledge_index_create(const char *const *roots,
     index->documents = (Document *)kolibri_alloc(paths.count * sizeof(Document));
     index->document_count = paths.count;
 
-    GlobalToken *global_tokens = NULL;
-    size_t global_token_count = 0U;
-    size_t global_token_capacity = 0U;
-
     DocToken **all_doc_tokens = (DocToken **)kolibri_alloc(paths.count * sizeof(DocToken *));
     size_t *doc_token_counts = (size_t *)kolibri_alloc(paths.count * sizeof(size_t));
 
-    for (size_t i = 0; i < paths.count; ++i) {
-        size_t doc_token_count = 0U;
-        DocToken *doc_tokens = NULL;
-        int total_tokens = parse_markdown_document(paths.items[i], max_length, &index->documents[i], &doc_tokens, &doc_token_count);
-        (void)total_tokens;
-        all_doc_tokens[i] = doc_tokens;
-        doc_token_counts[i] = doc_token_count;
-        if (doc_token_count > 0U) {
-            global_register_tokens(&global_tokens, &global_token_count, &global_token_capacity, doc_tokens, doc_token_count);
-        }
+    if (threads == 0U) {
+        threads = ingest_thread_count(paths.count);
     }
+    if (threads > paths.count) {
+        threads = paths.count;
+    }
+    if (threads > KOLIBRI_INGEST_MAX_THREADS) {
+        threads = KOLIBRI_INGEST_MAX_THREADS;
+    }
+    IngestTask tasks[KOLIBRI_INGEST_MAX_THREADS];
+    size_t span = paths.count / threads;
+    for (size_t t = 0; t < threads; ++t) {
+        IngestTask *task = &tasks[t];
+        memset(task, 0, sizeof(*task));
+        task->paths = &paths;
+        task->begin = t * span;
+        task->end = (t + 1U == threads) ? paths.count : (t + 1U) * span;
+        task->max_length = max_length;
+        task->documents = index->documents;
+        task->doc_tokens = all_doc_tokens;
+        task->doc_token_counts = doc_token_counts;
+        token_map_init(&task->token_map);
+    }
+    run_ingest_tasks(tasks, threads, ingest_parse_range);
 
-    compute_idf(global_tokens, global_token_count, index->document_count);
-
-    index->tokens = global_tokens;
-    index->token_count = global_token_count;
-    index->token_capacity = global_token_capacity;
+    for (size_t t = 0; t < threads; ++t) {
+        merge_task_vocabulary(index, &tasks[t]);
+    }
+    compute_idf(index->tokens, index->token_count, index->document_count);
 
-    for (size_t i = 0; i < paths.count; ++i) {
-        compute_document_vector(global_tokens, global_token_count, all_doc_tokens[i], doc_token_counts[i], index->document_count, &index->documents[i]);
-        free_doc_tokens(all_doc_tokens[i], doc_token_counts[i]);
+    for (size_t t = 0; t < threads; ++t) {
+        tasks[t].global_tokens = index->tokens;
+        tasks[t].total_docs = index->document_count;
     }
+    run_ingest_tasks(tasks, threads, ingest_vector_range);
+    for (size_t t = 0; t < threads; ++t) {
+        free(tasks[t].remap);
+    }
+    build_postings(index);
 
     free(all_doc_tokens);
     free(doc_token_counts);
@@ -514,180 +1185,1095 @@ int kolibri_knowledge_index_create(const char *const *roots,
     return 0;
 }
 
+int kolibri_knowledge_index_create(const char *const *roots,
+                                   size_t root_count,
+                                   size_t max_length,
+                                   KolibriKnowledgeIndex **out_index) {
+    return kolibri_knowledge_index_create_threads(roots, root_count, max_length, 0U, out_index);
+}
+
+static void free_document(Document *doc) {
+    free(doc->json);
+    free(doc->preview);
+    free(doc->id);
+    free(doc->title);
+    free(doc->source);
+    free(doc->content);
+    free(doc->vector);
+}
+
 void kolibri_knowledge_index_destroy(KolibriKnowledgeIndex *index) {
     if (!index) {
         return;
     }
-    for (size_t i = 0; i < index->document_count; ++i) {
-        free(index->documents[i].id);
-        free(index->documents[i].title);
-        free(index->documents[i].source);
-        free(index->documents[i].content);
-        free(index->documents[i].vector);
-    }
-    free(index->documents);
-    for (size_t i = 0; i < index->token_count; ++i) {
-        free(index->tokens[i].token);
+    if (!index->mapping) {
+        for (size_t i = 0; i < index->document_count; ++i) {
+            free_document(&index->documents[i]);
+        }
+    }
+    free(index->documents);
+    for (size_t i = 0; i < index->added_count; ++i) {
+        free_document(index->added[i]);
+        free(index->added[i]);
+    }
+    free(index->added);
+    for (size_t i = index->mapped_token_count; i < index->token_count; ++i) {
+        free(index->tokens[i].token);
+    }
+    free(index->tokens);
+    token_map_free(&index->token_map);
+    free_posting_arrays(index);
+    vocabulary_free(&index->vocabulary);
+#ifndef _WIN32
+    if (index->mapping) {
+        munmap(index->mapping, index->mapping_size);
+    }
+#endif
+    pthread_rwlock_destroy(&index->lock);
+    pthread_mutex_destroy(&index->merge_lock);
+    free(index);
+}
+
+/* Блокировки снимаются с const-указателя: читатели не меняют индекс, но
+ * должны видеть согласованное состояние во время добавления и слияния. */
+static void index_read_lock(const KolibriKnowledgeIndex *index) {
+    pthread_rwlock_rdlock((pthread_rwlock_t *)&index->lock);
+}
+
+static void index_unlock(const KolibriKnowledgeIndex *index) {
+    pthread_rwlock_unlock((pthread_rwlock_t *)&index->lock);
+}
+
+size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index) {
+    if (!index) {
+        return 0U;
+    }
+    index_read_lock(index);
+    size_t count = index_total_documents(index);
+    index_unlock(index);
+    return count;
+}
+
+const KolibriKnowledgeDoc *kolibri_knowledge_index_document(const KolibriKnowledgeIndex *index,
+                                                            size_t idx) {
+    if (!index) {
+        return NULL;
+    }
+    const KolibriKnowledgeDoc *doc = NULL;
+    index_read_lock(index);
+    if (idx < index_total_documents(index)) {
+        doc = (const KolibriKnowledgeDoc *)index_doc(index, idx);
+    }
+    index_unlock(index);
+    return doc;
+}
+
+size_t kolibri_knowledge_index_token_count(const KolibriKnowledgeIndex *index) {
+    if (!index) {
+        return 0U;
+    }
+    index_read_lock(index);
+    size_t count = index->token_count;
+    index_unlock(index);
+    return count;
+}
+
+const KolibriKnowledgeToken *kolibri_knowledge_index_token(const KolibriKnowledgeIndex *index,
+                                                           size_t idx) {
+    if (!index) {
+        return NULL;
+    }
+    const KolibriKnowledgeToken *token = NULL;
+    index_read_lock(index);
+    if (idx < index->token_count) {
+        token = (const KolibriKnowledgeToken *)&index->tokens[idx];
+    }
+    index_unlock(index);
+    return token;
+}
+
+size_t kolibri_knowledge_index_pending_count(const KolibriKnowledgeIndex *index) {
+    if (!index) {
+        return 0U;
+    }
+    index_read_lock(index);
+    size_t pending = index_total_documents(index) - index->posted_count;
+    index_unlock(index);
+    return pending;
+}
+
+static size_t document_heap_bytes(const Document *doc) {
+    size_t bytes = doc->vector_size * sizeof(KolibriKnowledgeVectorItem);
+    const char *fields[] = { doc->id, doc->title, doc->source, doc->content, doc->json, doc->preview };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        if (fields[i]) {
+            bytes += strlen(fields[i]) + 1U;
+        }
+    }
+    return bytes;
+}
+
+size_t kolibri_knowledge_index_memory_usage(const KolibriKnowledgeIndex *index, size_t *out_mapped_bytes) {
+    if (out_mapped_bytes) {
+        *out_mapped_bytes = 0U;
+    }
+    if (!index) {
+        return 0U;
+    }
+    index_read_lock(index);
+    size_t token_slots = index->token_capacity > index->token_count ? index->token_capacity : index->token_count;
+    size_t bytes = sizeof(*index) + index->document_count * sizeof(Document) +
+                   index->added_capacity * sizeof(Document *) + token_slots * sizeof(GlobalToken) +
+                   index->token_map.capacity * sizeof(TokenSlot);
+    if (!index->mapping) {
+        for (size_t i = 0; i < index->document_count; ++i) {
+            bytes += document_heap_bytes(&index->documents[i]);
+        }
+    }
+    for (size_t i = 0; i < index->added_count; ++i) {
+        bytes += sizeof(Document) + document_heap_bytes(index->added[i]);
+    }
+    for (size_t i = index->mapped_token_count; i < index->token_count; ++i) {
+        bytes += strlen(index->tokens[i].token) + 1U;
+    }
+    if (!index->postings_mapped && index->posting_offsets) {
+        bytes += (index->posting_token_count + 1U) * sizeof(size_t) +
+                 index->posting_count * (sizeof(uint32_t) + sizeof(int8_t)) +
+                 index->posted_count * sizeof(float) + index->posting_token_count * sizeof(float);
+    }
+    bytes += index->vocabulary.token_count * sizeof(size_t) + index->vocabulary.gram_count * sizeof(VocabularyGram);
+    if (out_mapped_bytes) {
+        *out_mapped_bytes = index->mapping_size;
+    }
+    index_unlock(index);
+    return bytes;
+}
+
+int kolibri_knowledge_index_add_document(KolibriKnowledgeIndex *index,
+                                         const char *id,
+                                         const char *title,
+                                         const char *source,
+                                         const char *content,
+                                         size_t *out_doc_index) {
+    if (!index || !id || !content) {
+        return EINVAL;
+    }
+    /* Разбор текста не требует блокировки: общий словарь трогается только ниже. */
+    DocToken *doc_tokens = NULL;
+    size_t doc_token_count = 0U;
+    size_t doc_token_capacity = 0U;
+    TokenMap doc_map;
+    token_map_init(&doc_map);
+    if (title) {
+        tokenize_text(title, &doc_tokens, &doc_token_count, &doc_token_capacity, &doc_map);
+    }
+    tokenize_text(content, &doc_tokens, &doc_token_count, &doc_token_capacity, &doc_map);
+    token_map_free(&doc_map);
+
+    Document *doc = (Document *)kolibri_alloc(sizeof(Document));
+    doc->id = kolibri_strdup(id);
+    doc->title = kolibri_strdup(title ? title : id);
+    doc->source = kolibri_strdup(source ? source : "");
+    doc->content = kolibri_strdup(content);
+    document_render(doc);
+
+    pthread_rwlock_wrlock(&index->lock);
+    if (index->added_count == index->added_capacity) {
+        size_t capacity = index->added_capacity ? index->added_capacity * 2U : 16U;
+        Document **added = (Document **)realloc(index->added, capacity * sizeof(Document *));
+        if (!added) {
+            pthread_rwlock_unlock(&index->lock);
+            free_doc_tokens(doc_tokens, doc_token_count);
+            free_document(doc);
+            free(doc);
+            return ENOMEM;
+        }
+        index->added = added;
+        index->added_capacity = capacity;
+    }
+    size_t known_tokens = index->token_count;
+    if (doc_token_count > 0U) {
+        global_register_tokens(&index->tokens,
+                               &index->token_count,
+                               &index->token_capacity,
+                               &index->token_map,
+                               doc_tokens,
+                               doc_token_count);
+    }
+    /* IDF обновляется лениво: сразу считается только для новых токенов,
+     * остальные пересчитываются при слиянии сегмента. */
+    size_t total_docs = index_total_documents(index) + 1U;
+    compute_idf(index->tokens + known_tokens, index->token_count - known_tokens, total_docs);
+    compute_document_vector(index->tokens, doc_tokens, doc_token_count, total_docs, doc);
+    size_t doc_index = index_total_documents(index);
+    index->added[index->added_count++] = doc;
+    pthread_rwlock_unlock(&index->lock);
+
+    free_doc_tokens(doc_tokens, doc_token_count);
+    if (out_doc_index) {
+        *out_doc_index = doc_index;
+    }
+    return 0;
+}
+
+size_t kolibri_knowledge_index_merge(KolibriKnowledgeIndex *index) {
+    if (!index) {
+        return 0U;
+    }
+    pthread_mutex_lock(&index->merge_lock);
+    /* Постинги строятся под read-блокировкой, так что поиск не ждёт слияния;
+     * документы, добавленные тем временем, останутся в живом сегменте. */
+    pthread_rwlock_rdlock(&index->lock);
+    size_t doc_count = index_total_documents(index);
+    if (doc_count > KOLIBRI_POSTING_DOC_LIMIT) {
+        doc_count = KOLIBRI_POSTING_DOC_LIMIT;
+    }
+    size_t token_count = index->token_count;
+    size_t merged = doc_count - index->posted_count;
+    PostingArrays arrays;
+    if (merged > 0U || token_count != index->posting_token_count) {
+        build_posting_arrays(index, doc_count, token_count, &arrays);
+    }
+    pthread_rwlock_unlock(&index->lock);
+
+    if (merged > 0U || token_count != index->posting_token_count) {
+        pthread_rwlock_wrlock(&index->lock);
+        install_posting_arrays(index, &arrays, doc_count, token_count);
+        compute_idf(index->tokens, index->token_count, index_total_documents(index));
+        pthread_rwlock_unlock(&index->lock);
+    }
+    pthread_mutex_unlock(&index->merge_lock);
+    return merged;
+}
+
+static size_t document_shard(const char *id, size_t shard_count) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)(id ? id : ""); *p; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)(hash % shard_count);
+}
+
+static void document_copy(Document *out, const Document *doc) {
+    out->id = kolibri_strdup(doc->id);
+    out->title = kolibri_strdup(doc->title);
+    out->source = kolibri_strdup(doc->source);
+    out->content = kolibri_strdup(doc->content);
+    out->vector = NULL;
+    if (doc->vector_size > 0U) {
+        out->vector = (KolibriKnowledgeVectorItem *)kolibri_alloc(doc->vector_size * sizeof(KolibriKnowledgeVectorItem));
+        memcpy(out->vector, doc->vector, doc->vector_size * sizeof(KolibriKnowledgeVectorItem));
+    }
+    out->vector_size = doc->vector_size;
+    out->norm = doc->norm;
+    out->json = kolibri_strdup(doc->json);
+    out->json_length = doc->json_length;
+    out->preview = kolibri_strdup(doc->preview);
+    out->preview_length = doc->preview_length;
+}
+
+int kolibri_knowledge_index_partition(const KolibriKnowledgeIndex *index,
+                                      size_t shard,
+                                      size_t shard_count,
+                                      KolibriKnowledgeIndex **out_shard) {
+    if (!index || !out_shard || shard_count == 0U || shard >= shard_count) {
+        return EINVAL;
+    }
+    *out_shard = NULL;
+    KolibriKnowledgeIndex *part = knowledge_index_new();
+    index_read_lock(index);
+    size_t total = index_total_documents(index);
+    size_t count = 0U;
+    for (size_t i = 0; i < total; ++i) {
+        count += document_shard(index_doc(index, i)->id, shard_count) == shard;
+    }
+    /* Словарь копируется целиком: норма запроса и idf должны совпадать во всех шардах. */
+    part->tokens = (GlobalToken *)kolibri_alloc((index->token_count ? index->token_count : 1U) * sizeof(GlobalToken));
+    for (size_t t = 0; t < index->token_count; ++t) {
+        part->tokens[t].token = kolibri_strdup(index->tokens[t].token);
+        part->tokens[t].df = index->tokens[t].df;
+        part->tokens[t].idf = index->tokens[t].idf;
+    }
+    part->token_count = index->token_count;
+    part->token_capacity = index->token_count;
+    part->documents = (Document *)kolibri_alloc((count ? count : 1U) * sizeof(Document));
+    for (size_t i = 0; i < total; ++i) {
+        const Document *doc = index_doc(index, i);
+        if (document_shard(doc->id, shard_count) == shard) {
+            document_copy(&part->documents[part->document_count++], doc);
+        }
+    }
+    index_unlock(index);
+    rebuild_token_map(part);
+    build_postings(part);
+    *out_shard = part;
+    return 0;
+}
+
+#define KOLIBRI_QUERY_INLINE_TERMS 32U
+
+typedef struct {
+    size_t token_index;
+    float weight;
+} QueryTerm;
+
+/* Разреженный вектор запроса: первые KOLIBRI_QUERY_INLINE_TERMS различных термов
+ * живут в буфере на стеке, длинные запросы переходят в кучу. */
+typedef struct {
+    QueryTerm inline_terms[KOLIBRI_QUERY_INLINE_TERMS];
+    QueryTerm *terms;
+    size_t count;
+    size_t capacity;
+    float norm;
+} QueryVector;
+
+static void query_vector_init(QueryVector *query) {
+    query->terms = query->inline_terms;
+    query->count = 0U;
+    query->capacity = KOLIBRI_QUERY_INLINE_TERMS;
+    query->norm = 0.0f;
+}
+
+static void query_vector_free(QueryVector *query) {
+    if (query->terms != query->inline_terms) {
+        free(query->terms);
+    }
+    query_vector_init(query);
+}
+
+static void query_vector_add(QueryVector *query, size_t token_index, float weight) {
+    for (size_t i = 0; i < query->count; ++i) {
+        if (query->terms[i].token_index == token_index) {
+            query->terms[i].weight += weight;
+            return;
+        }
+    }
+    if (query->count == query->capacity) {
+        size_t new_capacity = query->capacity * 2U;
+        QueryTerm *terms = (QueryTerm *)kolibri_alloc(new_capacity * sizeof(QueryTerm));
+        memcpy(terms, query->terms, query->count * sizeof(QueryTerm));
+        if (query->terms != query->inline_terms) {
+            free(query->terms);
+        }
+        query->terms = terms;
+        query->capacity = new_capacity;
+    }
+    query->terms[query->count].token_index = token_index;
+    query->terms[query->count].weight = weight;
+    query->count += 1U;
+}
+
+/* Расширение терма: не больше KOLIBRI_QUERY_EXPANSIONS токенов словаря, у
+ * каждого вес меньше точного совпадения. */
+#define KOLIBRI_QUERY_EXPANSIONS 8U
+#define KOLIBRI_PREFIX_SCAN 64U
+#define KOLIBRI_PREFIX_MIN_LENGTH 2U
+#define KOLIBRI_FUZZY_MIN_LENGTH 3U
+/* Триграммы с длинными списками ("^th") пропускаются: время поиска не
+ * зависит от размера словаря. */
+#define KOLIBRI_FUZZY_GRAM_POSTINGS 2048U
+
+typedef struct {
+    size_t token;
+    size_t rank;
+    size_t df;
+} Expansion;
+
+typedef struct {
+    Expansion items[KOLIBRI_QUERY_EXPANSIONS];
+    size_t count;
+} ExpansionSet;
+
+/* Лучше меньший rank (расстояние правки, для префикса 0) и больший df. */
+static void expansion_offer(ExpansionSet *set, size_t token, size_t rank, size_t df) {
+    for (size_t i = 0; i < set->count; ++i) {
+        if (set->items[i].token == token) {
+            return;
+        }
+    }
+    size_t pos = set->count;
+    if (pos == KOLIBRI_QUERY_EXPANSIONS) {
+        const Expansion *last = &set->items[pos - 1U];
+        if (rank > last->rank || (rank == last->rank && df <= last->df)) {
+            return;
+        }
+        pos -= 1U;
+    } else {
+        set->count += 1U;
+    }
+    while (pos > 0U && (set->items[pos - 1U].rank > rank ||
+                        (set->items[pos - 1U].rank == rank && set->items[pos - 1U].df < df))) {
+        set->items[pos] = set->items[pos - 1U];
+        pos -= 1U;
+    }
+    set->items[pos].token = token;
+    set->items[pos].rank = rank;
+    set->items[pos].df = df;
+}
+
+static void expand_prefix(const KolibriKnowledgeIndex *index, const char *term, size_t exact, ExpansionSet *set) {
+    size_t len = strlen(term);
+    if (len < KOLIBRI_PREFIX_MIN_LENGTH) {
+        return;
+    }
+    const Vocabulary *vocabulary = &index->vocabulary;
+    size_t lo = 0U;
+    size_t hi = vocabulary->token_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2U;
+        if (strcmp(vocabulary_text(index, vocabulary->sorted[mid]), term) < 0) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t i = lo; i < vocabulary->token_count && i < lo + KOLIBRI_PREFIX_SCAN; ++i) {
+        size_t token = vocabulary->sorted[i];
+        if (strncmp(vocabulary_text(index, token), term, len) != 0) {
+            break;
+        }
+        if (token != exact) {
+            expansion_offer(set, token, 0U, index->tokens[token].df);
+        }
+    }
+    for (size_t token = vocabulary->token_count; token < index->token_count; ++token) {
+        if (token != exact && strncmp(vocabulary_text(index, token), term, len) == 0) {
+            expansion_offer(set, token, 0U, index->tokens[token].df);
+        }
+    }
+}
+
+/* Расстояние Левенштейна, если оно не больше limit, иначе limit + 1. */
+static size_t edit_distance(const char *a, const char *b, size_t limit) {
+    size_t la = strlen(a);
+    size_t lb = strlen(b);
+    if ((la > lb ? la - lb : lb - la) > limit || la >= 128U || lb >= 128U) {
+        return limit + 1U;
+    }
+    size_t row[128];
+    for (size_t j = 0; j <= lb; ++j) {
+        row[j] = j;
+    }
+    for (size_t i = 1; i <= la; ++i) {
+        size_t diagonal = row[0];
+        row[0] = i;
+        size_t best = row[0];
+        for (size_t j = 1; j <= lb; ++j) {
+            size_t above = row[j];
+            size_t cost = diagonal + (a[i - 1U] != b[j - 1U]);
+            if (above + 1U < cost) {
+                cost = above + 1U;
+            }
+            if (row[j - 1U] + 1U < cost) {
+                cost = row[j - 1U] + 1U;
+            }
+            row[j] = cost;
+            diagonal = above;
+            if (cost < best) {
+                best = cost;
+            }
+        }
+        if (best > limit) {
+            return limit + 1U;
+        }
+    }
+    return row[lb] <= limit ? row[lb] : limit + 1U;
+}
+
+/* Одна правка портит не больше трёх триграмм, поэтому кандидат на
+ * расстоянии k делит с термом хотя бы len - 3k триграмм. */
+static void expand_fuzzy(const KolibriKnowledgeIndex *index, const char *term, ExpansionSet *set) {
+    size_t len = strlen(term);
+    if (len < KOLIBRI_FUZZY_MIN_LENGTH) {
+        return;
+    }
+    size_t limit = len >= 8U ? 2U : 1U;
+    const Vocabulary *vocabulary = &index->vocabulary;
+    uint32_t grams[128];
+    size_t gram_count = token_grams(term, grams);
+    qsort(grams, gram_count, sizeof(uint32_t), vocabulary_gram_key_compare);
+    size_t required = len > 3U * limit ? len - 3U * limit : 1U;
+    uint8_t *hits = NULL;
+    size_t *touched = NULL;
+    size_t touched_count = 0U;
+    if (vocabulary->token_count > 0U) {
+        hits = (uint8_t *)kolibri_alloc(vocabulary->token_count);
+        touched = (size_t *)kolibri_alloc(vocabulary->token_count * sizeof(size_t));
+    }
+    for (size_t g = 0; g < gram_count && hits; ++g) {
+        if (g > 0U && grams[g] == grams[g - 1U]) {
+            continue;
+        }
+        size_t lo = 0U;
+        size_t hi = vocabulary->gram_count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2U;
+            if (vocabulary->grams[mid].gram < grams[g]) {
+                lo = mid + 1U;
+            } else {
+                hi = mid;
+            }
+        }
+        size_t end = lo;
+        while (end < vocabulary->gram_count && vocabulary->grams[end].gram == grams[g]) {
+            end += 1U;
+        }
+        if (end - lo > KOLIBRI_FUZZY_GRAM_POSTINGS) {
+            required = required > 1U ? required - 1U : 1U;
+            continue;
+        }
+        for (size_t i = lo; i < end; ++i) {
+            size_t token = vocabulary->grams[i].token;
+            if (hits[token]++ == 0U) {
+                touched[touched_count++] = token;
+            }
+        }
+    }
+    for (size_t i = 0; i < touched_count; ++i) {
+        size_t token = touched[i];
+        if (hits[token] < required) {
+            continue;
+        }
+        size_t distance = edit_distance(term, vocabulary_text(index, token), limit);
+        if (distance <= limit) {
+            expansion_offer(set, token, distance, index->tokens[token].df);
+        }
+    }
+    free(hits);
+    free(touched);
+    for (size_t token = vocabulary->token_count; token < index->token_count; ++token) {
+        size_t distance = edit_distance(term, vocabulary_text(index, token), limit);
+        if (distance <= limit) {
+            expansion_offer(set, token, distance, index->tokens[token].df);
+        }
+    }
+}
+
+static int query_add_term(const char *term, const KolibriKnowledgeIndex *index, unsigned flags,
+                          QueryVector *out_query) {
+    size_t exact = find_global_token(index, term);
+    ExpansionSet set;
+    set.count = 0U;
+    if (flags & KOLIBRI_KNOWLEDGE_SEARCH_PREFIX) {
+        expand_prefix(index, term, exact, &set);
+    }
+    /* Нечёткий поиск нужен только термам, которых нет в словаре. */
+    if ((flags & KOLIBRI_KNOWLEDGE_SEARCH_FUZZY) && exact == (size_t)-1) {
+        expand_fuzzy(index, term, &set);
+    }
+    if (exact != (size_t)-1) {
+        query_vector_add(out_query, exact, 1.0f);
+    }
+    for (size_t i = 0; i < set.count; ++i) {
+        query_vector_add(out_query, set.items[i].token, 0.5f / (float)(set.items[i].rank + 1U));
+    }
+    return exact != (size_t)-1 || set.count > 0U;
+}
+
+static void tokenize_query(const char *query, const KolibriKnowledgeIndex *index, unsigned flags,
+                           QueryVector *out_query) {
+    query_vector_init(out_query);
+    size_t total_tokens = 0U;
+    char buffer[128];
+    size_t buffer_len = 0U;
+    const unsigned char *cursor = (const unsigned char *)query;
+    while (1) {
+        if (*cursor != '\0' && isalnum(*cursor)) {
+            if (buffer_len < sizeof(buffer) - 1U) {
+                buffer[buffer_len++] = (char)tolower(*cursor);
+            }
+        } else if (buffer_len > 0U) {
+            buffer[buffer_len] = '\0';
+            if (query_add_term(buffer, index, flags, out_query)) {
+                total_tokens += 1U;
+            }
+            buffer_len = 0U;
+        }
+        if (*cursor == '\0') {
+            break;
+        }
+        cursor++;
+    }
+
+    if (total_tokens == 0U) {
+        return;
+    }
+
+    double norm = 0.0;
+    for (size_t i = 0; i < out_query->count; ++i) {
+        QueryTerm *term = &out_query->terms[i];
+        double tf = (double)term->weight / (double)total_tokens;
+        double weight = tf * (double)index->tokens[term->token_index].idf;
+        term->weight = (float)weight;
+        norm += weight * weight;
+    }
+    out_query->norm = (float)(sqrt(norm) ?: 0.0);
+}
+
+/* Курсор по постингам терма; weight идёт в ногу с cursor. */
+typedef struct {
+    const uint32_t *cursor;
+    const uint32_t *end;
+    const int8_t *weight;
+    double query_weight;
+    double upper_bound;
+} PostingCursor;
+
+typedef struct {
+    size_t doc_index;
+    double score;
+} ScoredDoc;
+
+/* Ограниченная min-куча: в корне худший из k лучших кандидатов. */
+typedef struct {
+    ScoredDoc *items;
+    size_t count;
+    size_t limit;
+} TopK;
+
+static int scored_doc_worse(const ScoredDoc *a, const ScoredDoc *b) {
+    if (a->score != b->score) {
+        return a->score < b->score;
+    }
+    return a->doc_index > b->doc_index;
+}
+
+static void topk_sift_down(TopK *heap, size_t pos) {
+    while (1) {
+        size_t left = pos * 2U + 1U;
+        size_t right = left + 1U;
+        size_t worst = pos;
+        if (left < heap->count && scored_doc_worse(&heap->items[left], &heap->items[worst])) {
+            worst = left;
+        }
+        if (right < heap->count && scored_doc_worse(&heap->items[right], &heap->items[worst])) {
+            worst = right;
+        }
+        if (worst == pos) {
+            return;
+        }
+        ScoredDoc tmp = heap->items[pos];
+        heap->items[pos] = heap->items[worst];
+        heap->items[worst] = tmp;
+        pos = worst;
+    }
+}
+
+static void topk_push(TopK *heap, size_t doc_index, double score) {
+    ScoredDoc candidate = {doc_index, score};
+    if (heap->count < heap->limit) {
+        size_t pos = heap->count++;
+        heap->items[pos] = candidate;
+        while (pos > 0U) {
+            size_t parent = (pos - 1U) / 2U;
+            if (!scored_doc_worse(&heap->items[pos], &heap->items[parent])) {
+                break;
+            }
+            ScoredDoc tmp = heap->items[pos];
+            heap->items[pos] = heap->items[parent];
+            heap->items[parent] = tmp;
+            pos = parent;
+        }
+        return;
+    }
+    if (scored_doc_worse(&heap->items[0], &candidate)) {
+        heap->items[0] = candidate;
+        topk_sift_down(heap, 0U);
     }
-    free(index->tokens);
-    free(index);
 }
 
-size_t kolibri_knowledge_index_document_count(const KolibriKnowledgeIndex *index) {
-    return index ? index->document_count : 0U;
+/* Порог, который должен превзойти документ, чтобы попасть в выдачу. */
+static double topk_threshold(const TopK *heap) {
+    return heap->count < heap->limit ? 0.0 : heap->items[0].score;
 }
 
-const KolibriKnowledgeDoc *kolibri_knowledge_index_document(const KolibriKnowledgeIndex *index,
-                                                            size_t idx) {
-    if (!index || idx >= index->document_count) {
-        return NULL;
+/* Извлекает кучу в порядке убывания оценки. */
+static size_t topk_drain(TopK *heap, size_t *out_indices, float *out_scores) {
+    size_t total = heap->count;
+    while (heap->count > 0U) {
+        size_t pos = heap->count - 1U;
+        out_indices[pos] = heap->items[0].doc_index;
+        out_scores[pos] = (float)heap->items[0].score;
+        heap->items[0] = heap->items[pos];
+        heap->count -= 1U;
+        topk_sift_down(heap, 0U);
+    }
+    return total;
+}
+
+static const uint32_t *posting_seek(const uint32_t *cursor, const uint32_t *end, size_t doc_index) {
+    size_t step = 1U;
+    const uint32_t *low = cursor;
+    while (cursor < end && *cursor < doc_index) {
+        low = cursor;
+        if ((size_t)(end - cursor) <= step) {
+            cursor = end;
+            break;
+        }
+        cursor += step;
+        step *= 2U;
+    }
+    const uint32_t *high = cursor;
+    while (low < high) {
+        const uint32_t *mid = low + (high - low) / 2;
+        if (*mid < doc_index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
-    return (const KolibriKnowledgeDoc *)&index->documents[idx];
+    return low;
 }
 
-size_t kolibri_knowledge_index_token_count(const KolibriKnowledgeIndex *index) {
-    return index ? index->token_count : 0U;
+static void cursor_advance(PostingCursor *cursor, const uint32_t *target) {
+    cursor->weight += target - cursor->cursor;
+    cursor->cursor = target;
 }
 
-const KolibriKnowledgeToken *kolibri_knowledge_index_token(const KolibriKnowledgeIndex *index,
-                                                           size_t idx) {
-    if (!index || idx >= index->token_count) {
-        return NULL;
+static int cursor_bound_compare(const void *a, const void *b) {
+    const PostingCursor *ca = (const PostingCursor *)a;
+    const PostingCursor *cb = (const PostingCursor *)b;
+    if (ca->upper_bound < cb->upper_bound) {
+        return -1;
     }
-    return (const KolibriKnowledgeToken *)&index->tokens[idx];
+    if (ca->upper_bound > cb->upper_bound) {
+        return 1;
+    }
+    return 0;
 }
 
-static void tokenize_query(const char *query,
-                           const GlobalToken *tokens,
-                           size_t token_count,
-                           float **out_weights,
-                           float *out_norm) {
-    float *weights = (float *)calloc(token_count, sizeof(float));
-    if (!weights) {
-        fprintf(stderr, "[kolibri-knowledge] alloc query weights failed\n");
-        abort();
+/* Переводит сумму квантованных весов в косинус. */
+static double document_scale(const KolibriKnowledgeIndex *index, size_t doc_index, double query_norm) {
+    return (double)index->posting_scales[doc_index] / query_norm;
+}
+
+/* Точный косинус по float-вектору документа. */
+static double document_exact_score(const KolibriKnowledgeIndex *index,
+                                   const QueryVector *query,
+                                   size_t doc_index,
+                                   double query_norm) {
+    const Document *doc = index_doc(index, doc_index);
+    if (doc->norm == 0.0f) {
+        return 0.0;
     }
-    double norm = 0.0;
-    size_t total_tokens = 0U;
-    char buffer[128];
-    size_t buffer_len = 0U;
-    const unsigned char *cursor = (const unsigned char *)query;
-    while (*cursor != '\0') {
-        if (isalnum(*cursor)) {
-            if (buffer_len < sizeof(buffer) - 1U) {
-                buffer[buffer_len++] = (char)tolower(*cursor);
+    double dot = 0.0;
+    for (size_t j = 0; j < doc->vector_size; ++j) {
+        for (size_t q = 0; q < query->count; ++q) {
+            if (query->terms[q].token_index == doc->vector[j].token_index) {
+                dot += (double)doc->vector[j].weight * (double)query->terms[q].weight;
+                break;
             }
-        } else {
-            if (buffer_len > 0U) {
-                buffer[buffer_len] = '\0';
-                size_t idx = find_global_token(tokens, token_count, buffer);
-                if (idx != (size_t)-1) {
-                    weights[idx] += 1.0f;
-                    total_tokens += 1U;
+        }
+    }
+    return dot / ((double)doc->norm * query_norm);
+}
+
+/* Полный обход «документ за документом»: постинги каждого терма отсортированы по doc_index,
+ * поэтому на каждом шаге берём минимальный документ среди курсоров. */
+static void search_exhaustive(const KolibriKnowledgeIndex *index,
+                              PostingCursor *cursors,
+                              size_t active,
+                              double query_norm,
+                              TopK *heap) {
+    while (active > 0U) {
+        size_t doc_index = *cursors[0].cursor;
+        for (size_t c = 1; c < active; ++c) {
+            if (*cursors[c].cursor < doc_index) {
+                doc_index = *cursors[c].cursor;
+            }
+        }
+        double dot = 0.0;
+        for (size_t c = 0; c < active;) {
+            if (*cursors[c].cursor == doc_index) {
+                dot += (double)*cursors[c].weight * cursors[c].query_weight;
+                cursors[c].cursor++;
+                cursors[c].weight++;
+                if (cursors[c].cursor == cursors[c].end) {
+                    cursors[c] = cursors[active - 1U];
+                    active -= 1U;
+                    continue;
                 }
-                buffer_len = 0U;
             }
+            ++c;
+        }
+        double score = dot * document_scale(index, doc_index, query_norm);
+        if (score > 0.0) {
+            topk_push(heap, doc_index, score);
         }
-        cursor++;
     }
-    if (buffer_len > 0U) {
-        buffer[buffer_len] = '\0';
-        size_t idx = find_global_token(tokens, token_count, buffer);
-        if (idx != (size_t)-1) {
-            weights[idx] += 1.0f;
-            total_tokens += 1U;
+}
+
+/* acc[docs[i]] += weights[i] * query_weight. Внутри одного списка документы
+ * различны, поэтому после gather полосы можно записать обратно по одной. */
+static void accumulate_postings(float *acc,
+                                const uint32_t *docs,
+                                const int8_t *weights,
+                                size_t count,
+                                float query_weight) {
+    size_t i = 0U;
+#if defined(KOLIBRI_INDEX_HAS_AVX2)
+    const __m256 factor = _mm256_set1_ps(query_weight);
+    for (; i + 8U <= count; i += 8U) {
+        __m256i ids = _mm256_loadu_si256((const __m256i *)(docs + i));
+        __m128i raw = _mm_loadl_epi64((const __m128i *)(weights + i));
+        __m256 contribution = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(raw)), factor);
+        __m256 sums = _mm256_add_ps(_mm256_i32gather_ps(acc, ids, 4), contribution);
+        float lanes[8];
+        _mm256_storeu_ps(lanes, sums);
+        for (size_t k = 0; k < 8U; ++k) {
+            acc[docs[i + k]] = lanes[k];
+        }
+    }
+#elif defined(KOLIBRI_INDEX_HAS_NEON)
+    const float32x4_t factor = vdupq_n_f32(query_weight);
+    for (; i + 8U <= count; i += 8U) {
+        int16x8_t wide = vmovl_s8(vld1_s8(weights + i));
+        float lanes[8];
+        vst1q_f32(lanes, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(wide))), factor));
+        vst1q_f32(lanes + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(wide))), factor));
+        for (size_t k = 0; k < 8U; ++k) {
+            acc[docs[i + k]] += lanes[k];
         }
     }
+#endif
+    for (; i < count; ++i) {
+        acc[docs[i]] += (float)weights[i] * query_weight;
+    }
+}
 
-    if (total_tokens == 0U) {
-        *out_weights = weights;
-        *out_norm = 0.0f;
-        return;
+/* Накопление «терм за термом» в плотном массиве оценок: без перебора курсоров
+ * на каждом документе, но с проходом по всем posted_count документам. */
+static void search_accumulate(const KolibriKnowledgeIndex *index,
+                              const PostingCursor *cursors,
+                              size_t active,
+                              double query_norm,
+                              TopK *heap) {
+    size_t doc_count = index->posted_count;
+    float *acc = (float *)kolibri_alloc((doc_count ? doc_count : 1U) * sizeof(float));
+    for (size_t c = 0; c < active; ++c) {
+        accumulate_postings(acc,
+                            cursors[c].cursor,
+                            cursors[c].weight,
+                            (size_t)(cursors[c].end - cursors[c].cursor),
+                            (float)(cursors[c].query_weight / query_norm));
+    }
+    for (size_t doc_index = 0; doc_index < doc_count; ++doc_index) {
+        if (acc[doc_index] > 0.0f) {
+            double score = (double)acc[doc_index] * (double)index->posting_scales[doc_index];
+            if (score > 0.0) {
+                topk_push(heap, doc_index, score);
+            }
+        }
     }
+    free(acc);
+}
 
-    for (size_t i = 0; i < token_count; ++i) {
-        if (weights[i] == 0.0f) {
-            continue;
+/* MaxScore: термы упорядочены по верхней границе вклада. Префикс термов, сумма границ
+ * которых не превышает текущий порог кучи, становится «несущественным» — по нему
+ * не порождаются кандидаты, а курсоры лишь догоняют документы из существенных термов. */
+static void search_maxscore(const KolibriKnowledgeIndex *index,
+                            PostingCursor *cursors,
+                            size_t count,
+                            double query_norm,
+                            TopK *heap,
+                            double *prefix_bounds) {
+    qsort(cursors, count, sizeof(PostingCursor), cursor_bound_compare);
+    double running = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        running += cursors[i].upper_bound;
+        prefix_bounds[i] = running;
+    }
+
+    size_t first_essential = 0U;
+    while (1) {
+        double threshold = topk_threshold(heap);
+        while (first_essential < count && heap->count == heap->limit &&
+               prefix_bounds[first_essential] < threshold) {
+            first_essential += 1U;
+        }
+        if (first_essential == count) {
+            break;
+        }
+
+        size_t doc_index = (size_t)-1;
+        for (size_t c = first_essential; c < count; ++c) {
+            if (cursors[c].cursor < cursors[c].end && *cursors[c].cursor < doc_index) {
+                doc_index = *cursors[c].cursor;
+            }
+        }
+        if (doc_index == (size_t)-1) {
+            break;
+        }
+
+        double scale = document_scale(index, doc_index, query_norm);
+        double score = 0.0;
+        for (size_t c = first_essential; c < count; ++c) {
+            if (cursors[c].cursor < cursors[c].end && *cursors[c].cursor == doc_index) {
+                score += (double)*cursors[c].weight * cursors[c].query_weight * scale;
+                cursors[c].cursor++;
+                cursors[c].weight++;
+            }
+        }
+        for (size_t c = first_essential; c-- > 0U;) {
+            if (heap->count == heap->limit && score + prefix_bounds[c] < threshold) {
+                break;
+            }
+            cursor_advance(&cursors[c], posting_seek(cursors[c].cursor, cursors[c].end, doc_index));
+            if (cursors[c].cursor < cursors[c].end && *cursors[c].cursor == doc_index) {
+                score += (double)*cursors[c].weight * cursors[c].query_weight * scale;
+                cursors[c].cursor++;
+                cursors[c].weight++;
+            }
+        }
+        if (score > 0.0) {
+            topk_push(heap, doc_index, score);
         }
-        double tf = (double)weights[i] / (double)total_tokens;
-        double weight = tf * (double)tokens[i].idf;
-        weights[i] = (float)weight;
-        norm += weight * weight;
     }
+}
 
-    *out_weights = weights;
-    *out_norm = (float)(sqrt(norm) ?: 0.0);
+/* Живой сегмент мал, поэтому его документы сравниваются с запросом напрямую. */
+static void search_live_segment(const KolibriKnowledgeIndex *index,
+                                const QueryVector *query,
+                                double query_norm,
+                                TopK *heap) {
+    size_t total = index_total_documents(index);
+    for (size_t doc_index = index->posted_count; doc_index < total; ++doc_index) {
+        double score = document_exact_score(index, query, doc_index, query_norm);
+        if (score > 0.0) {
+            topk_push(heap, doc_index, score);
+        }
+    }
 }
 
-int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
-                                   const char *query,
-                                   size_t limit,
-                                   size_t *out_indices,
-                                   float *out_scores,
-                                   size_t *out_result_count) {
+static int index_search(const KolibriKnowledgeIndex *index,
+                        const char *query,
+                        size_t limit,
+                        unsigned flags,
+                        size_t *out_indices,
+                        float *out_scores,
+                        size_t *out_result_count) {
     if (!index || !query || limit == 0U || !out_indices || !out_scores || !out_result_count) {
         return EINVAL;
     }
-    float *query_weights = NULL;
-    float query_norm = 0.0f;
-    tokenize_query(query, index->tokens, index->token_count, &query_weights, &query_norm);
-    if (query_norm == 0.0f) {
-        free(query_weights);
+    index_read_lock(index);
+    QueryVector query_vector;
+    KOLIBRI_TRACE_BEGIN(tokenize_span, "index.tokenize");
+    tokenize_query(query, index, flags, &query_vector);
+    KOLIBRI_TRACE_END(tokenize_span);
+    double query_norm = (double)query_vector.norm;
+    if (query_norm == 0.0) {
+        index_unlock(index);
+        query_vector_free(&query_vector);
         *out_result_count = 0U;
         return 0;
     }
 
-    size_t result_count = 0U;
-    for (size_t i = 0; i < index->document_count; ++i) {
-        const Document *doc = &index->documents[i];
-        if (doc->vector_size == 0U || doc->norm == 0.0f) {
-            continue;
-        }
-        double dot = 0.0;
-        for (size_t j = 0; j < doc->vector_size; ++j) {
-            size_t token_index = doc->vector[j].token_index;
-            dot += (double)doc->vector[j].weight * (double)query_weights[token_index];
-        }
-        double score = dot / ((double)doc->norm * (double)query_norm);
-        if (score <= 0.0) {
+    PostingCursor cursor_buffer[KOLIBRI_QUERY_INLINE_TERMS];
+    double bound_buffer[KOLIBRI_QUERY_INLINE_TERMS];
+    PostingCursor *cursors = cursor_buffer;
+    double *prefix_bounds = bound_buffer;
+    if (query_vector.count > KOLIBRI_QUERY_INLINE_TERMS) {
+        cursors = (PostingCursor *)kolibri_alloc(query_vector.count * sizeof(PostingCursor));
+        prefix_bounds = (double *)kolibri_alloc(query_vector.count * sizeof(double));
+    }
+    size_t active = 0U;
+    size_t posting_total = 0U;
+    for (size_t i = 0; i < query_vector.count; ++i) {
+        size_t t = query_vector.terms[i].token_index;
+        if (t >= index->posting_token_count || index->posting_offsets[t] == index->posting_offsets[t + 1U]) {
             continue;
         }
-        if (result_count < limit) {
-            out_indices[result_count] = i;
-            out_scores[result_count] = (float)score;
-            result_count += 1U;
+        cursors[active].cursor = index->posting_docs + index->posting_offsets[t];
+        cursors[active].end = index->posting_docs + index->posting_offsets[t + 1U];
+        cursors[active].weight = index->posting_weights + index->posting_offsets[t];
+        posting_total += index->posting_offsets[t + 1U] - index->posting_offsets[t];
+        cursors[active].query_weight = (double)query_vector.terms[i].weight;
+        /* Граница хранится во float: слегка завышаем её, чтобы округление не отсекло документ. */
+        cursors[active].upper_bound =
+            (double)index->max_weights[t] * cursors[active].query_weight / query_norm * (1.0 + 1e-6);
+        active += 1U;
+    }
+
+    size_t total = index_total_documents(index);
+    size_t heap_limit = limit < total ? limit : total;
+    /* Квантованная оценка отбирает кандидатов с запасом, точная упорядочивает их. */
+    int rerank = !(flags & KOLIBRI_KNOWLEDGE_SEARCH_APPROX);
+    size_t candidate_limit = heap_limit;
+    if (rerank) {
+        candidate_limit = limit <= total / KOLIBRI_RERANK_FACTOR ? limit * KOLIBRI_RERANK_FACTOR : total;
+    }
+    TopK heap;
+    heap.items = (ScoredDoc *)kolibri_alloc((candidate_limit ? candidate_limit : 1U) * sizeof(ScoredDoc));
+    heap.count = 0U;
+    heap.limit = candidate_limit;
+    if (heap_limit > 0U && active > 0U) {
+        if (flags & KOLIBRI_KNOWLEDGE_SEARCH_PRUNE) {
+            search_maxscore(index, cursors, active, query_norm, &heap, prefix_bounds);
+        } else if (posting_total * KOLIBRI_ACCUMULATE_DENSITY >= index->posted_count) {
+            search_accumulate(index, cursors, active, query_norm, &heap);
         } else {
-            size_t min_idx = 0U;
-            for (size_t k = 1; k < limit; ++k) {
-                if (out_scores[k] < out_scores[min_idx]) {
-                    min_idx = k;
-                }
-            }
-            if (score > out_scores[min_idx]) {
-                out_indices[min_idx] = i;
-                out_scores[min_idx] = (float)score;
-            }
+            search_exhaustive(index, cursors, active, query_norm, &heap);
         }
     }
-
-    for (size_t i = 0; i + 1 < result_count; ++i) {
-        for (size_t j = i + 1; j < result_count; ++j) {
-            if (out_scores[j] > out_scores[i]) {
-                float tmp_score = out_scores[i];
-                size_t tmp_idx = out_indices[i];
-                out_scores[i] = out_scores[j];
-                out_indices[i] = out_indices[j];
-                out_scores[j] = tmp_score;
-                out_indices[j] = tmp_idx;
+    if (heap_limit > 0U) {
+        search_live_segment(index, &query_vector, query_norm, &heap);
+    }
+    if (rerank && heap.count > 0U) {
+        TopK exact;
+        exact.items = (ScoredDoc *)kolibri_alloc(heap_limit * sizeof(ScoredDoc));
+        exact.count = 0U;
+        exact.limit = heap_limit;
+        for (size_t i = 0; i < heap.count; ++i) {
+            size_t doc_index = heap.items[i].doc_index;
+            double score = document_exact_score(index, &query_vector, doc_index, query_norm);
+            if (score > 0.0) {
+                topk_push(&exact, doc_index, score);
             }
         }
+        free(heap.items);
+        heap = exact;
+    }
+    index_unlock(index);
+    query_vector_free(&query_vector);
+    if (cursors != cursor_buffer) {
+        free(cursors);
+        free(prefix_bounds);
     }
 
-    free(query_weights);
-    *out_result_count = result_count;
+    *out_result_count = topk_drain(&heap, out_indices, out_scores);
+    free(heap.items);
     return 0;
 }
 
+int kolibri_knowledge_index_search_flags(const KolibriKnowledgeIndex *index,
+                                         const char *query,
+                                         size_t limit,
+                                         unsigned flags,
+                                         size_t *out_indices,
+                                         float *out_scores,
+                                         size_t *out_result_count) {
+    KOLIBRI_TRACE_BEGIN(span, "index.search");
+    int status = index_search(index, query, limit, flags, out_indices, out_scores, out_result_count);
+    KOLIBRI_TRACE_END(span);
+    return status;
+}
+
+int kolibri_knowledge_index_search(const KolibriKnowledgeIndex *index,
+                                   const char *query,
+                                   size_t limit,
+                                   size_t *out_indices,
+                                   float *out_scores,
+                                   size_t *out_result_count) {
+    return kolibri_knowledge_index_search_flags(index,
+                                                query,
+                                                limit,
+                                                0U,
+                                                out_indices,
+                                                out_scores,
+                                                out_result_count);
+}
+
 static void json_escape(FILE *file, const char *text) {
     fputc('"', file);
     for (const unsigned char *cursor = (const unsigned char *)text; *cursor; ++cursor) {
@@ -751,9 +2337,12 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
         return errno;
     }
 
+    index_read_lock(index);
+    size_t document_count = index_total_documents(index);
+
     fprintf(index_file, "{\n");
     fprintf(index_file, "  \"version\": 1,\n");
-    fprintf(index_file, "  \"document_count\": %zu,\n", index->document_count);
+    fprintf(index_file, "  \"document_count\": %zu,\n", document_count);
     fprintf(index_file, "  \"tokens\": [\n");
     for (size_t i = 0; i < index->token_count; ++i) {
         const GlobalToken *token = &index->tokens[i];
@@ -767,8 +2356,8 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
     }
     fprintf(index_file, "  ],\n");
     fprintf(index_file, "  \"documents\": [\n");
-    for (size_t i = 0; i < index->document_count; ++i) {
-        const Document *doc = &index->documents[i];
+    for (size_t i = 0; i < document_count; ++i) {
+        const Document *doc = index_doc(index, i);
         fprintf(index_file, "    {\n");
         fprintf(index_file, "      \"id\": ");
         json_escape(index_file, doc->id);
@@ -795,12 +2384,13 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
         fprintf(index_file, "],\n");
         fprintf(index_file, "      \"norm\": %.6f\n", doc->norm);
         fprintf(index_file, "    }");
-        if (i + 1 < index->document_count) {
+        if (i + 1 < document_count) {
             fprintf(index_file, ",");
         }
         fprintf(index_file, "\n");
     }
     fprintf(index_file, "  ]\n}");
+    index_unlock(index);
     fclose(index_file);
 
     char manifest_path[4096];
@@ -811,7 +2401,7 @@ int kolibri_knowledge_index_write_json(const KolibriKnowledgeIndex *index,
     }
     fprintf(manifest_file, "{\n");
     fprintf(manifest_file, "  \"version\": 1,\n");
-    fprintf(manifest_file, "  \"document_count\": %zu,\n", index->document_count);
+    fprintf(manifest_file, "  \"document_count\": %zu,\n", document_count);
     fprintf(manifest_file, "  \"index_path\": \"index.json\"\n");
     fprintf(manifest_file, "}\n");
     fclose(manifest_file);
@@ -1001,18 +2591,8 @@ static int json_skip_value(const char **cursor) {
     return EINVAL;
 }
 
-static size_t locate_token(const GlobalToken *tokens, size_t count, const char *token) {
-    for (size_t i = 0; i < count; ++i) {
-        if (tokens[i].token && strcmp(tokens[i].token, token) == 0) {
-            return i;
-        }
-    }
-    return (size_t)-1;
-}
-
 static int parse_terms_array(const char **cursor,
-                             const GlobalToken *tokens,
-                             size_t token_count,
+                             const KolibriKnowledgeIndex *index,
                              KolibriKnowledgeVectorItem **out_items,
                              size_t *out_count) {
     if (!out_items || !out_count) {
@@ -1096,7 +2676,7 @@ static int parse_terms_array(const char **cursor,
             free(items);
             return EINVAL;
         }
-        size_t token_index = locate_token(tokens, token_count, term_token);
+        size_t token_index = find_global_token(index, term_token);
         free(term_token);
         if (token_index == (size_t)-1) {
             free(items);
@@ -1129,8 +2709,7 @@ static int parse_terms_array(const char **cursor,
 }
 
 static int parse_documents_array(const char **cursor,
-                                 const GlobalToken *tokens,
-                                 size_t token_count,
+                                 const KolibriKnowledgeIndex *index,
                                  Document **out_docs,
                                  size_t *out_count) {
     if (!out_docs || !out_count) {
@@ -1230,7 +2809,7 @@ static int parse_documents_array(const char **cursor,
                     doc.vector = NULL;
                     doc.vector_size = 0U;
                 }
-                if (parse_terms_array(cursor, tokens, token_count, &doc.vector, &doc.vector_size) != 0) {
+                if (parse_terms_array(cursor, index, &doc.vector, &doc.vector_size) != 0) {
                     free(key);
                     free(doc.id);
                     free(doc.title);
@@ -1536,12 +3115,12 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
             index->tokens = tokens;
             index->token_count = token_count;
             index->token_capacity = token_count;
+            rebuild_token_map(index);
         } else if (strcmp(key, "documents") == 0) {
             Document *docs = NULL;
             size_t doc_count = 0U;
             int err = parse_documents_array(&cursor,
-                                            index->tokens,
-                                            index->token_count,
+                                            index,
                                             &docs,
                                             &doc_count);
             if (err != 0) {
@@ -1553,6 +3132,9 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
             free(index->documents);
             index->documents = docs;
             index->document_count = doc_count;
+            for (size_t i = 0; i < doc_count; ++i) {
+                document_render(&index->documents[i]);
+            }
         } else {
             if (json_skip_value(&cursor) != 0) {
                 free(key);
@@ -1569,7 +3151,448 @@ int kolibri_knowledge_index_load_json(const char *input_dir,
     }
 
     free(index_data);
+    build_postings(index);
     *out_index = index;
     return 0;
 }
 
+
+/* Двоичный индекс index.bin: заголовок и секции по смещениям от начала файла,
+ * каждая выровнена на 8 байт. Строки — NUL-терминированные, адресуются
+ * смещением внутри секции строк. Записи векторов совпадают по раскладке с
+ * KolibriKnowledgeVectorItem на 64-битных платформах, постинги хранятся теми же
+ * массивами uint32/int8/float, что и в памяти, поэтому используются прямо из
+ * отображения. */
+#define KOLIBRI_INDEX_BIN_MAGIC "KOLIDX\0\1"
+#define KOLIBRI_INDEX_BIN_VERSION 4U
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t item_size;
+    uint64_t document_count;
+    uint64_t token_count;
+    uint64_t vector_item_count;
+    uint64_t posting_count;
+    uint64_t posted_document_count;
+    uint64_t posting_token_count;
+    uint64_t strings_size;
+    uint64_t tokens_offset;
+    uint64_t documents_offset;
+    uint64_t vectors_offset;
+    uint64_t posting_offsets_offset;
+    /* С версии 4: номера документов, квантованные веса и масштабы документов. */
+    uint64_t posting_docs_offset;
+    uint64_t posting_weights_offset;
+    uint64_t posting_scales_offset;
+    uint64_t max_weights_offset;
+    uint64_t strings_offset;
+    uint64_t file_size;
+} IndexBinHeader;
+
+typedef struct {
+    uint64_t text;
+    uint64_t df;
+    float idf;
+    uint32_t reserved;
+} IndexBinToken;
+
+typedef struct {
+    uint64_t id;
+    uint64_t title;
+    uint64_t source;
+    uint64_t content;
+    uint64_t vector_start;
+    uint64_t vector_size;
+    float norm;
+    uint32_t reserved;
+    /* С версии 3: готовые фрагменты ответа, длины без завершающего NUL. */
+    uint64_t json;
+    uint64_t json_length;
+    uint64_t preview;
+    uint64_t preview_length;
+} IndexBinDocument;
+
+typedef struct {
+    uint64_t index;
+    float weight;
+    uint32_t reserved;
+} IndexBinItem;
+
+static uint64_t bin_align(uint64_t offset) {
+    return (offset + 7U) & ~(uint64_t)7U;
+}
+
+static int bin_pad(FILE *file, uint64_t *written, uint64_t target) {
+    static const unsigned char zeros[8] = {0};
+    if (target < *written || target - *written > sizeof(zeros)) {
+        return EINVAL;
+    }
+    size_t pad = (size_t)(target - *written);
+    if (pad > 0U && fwrite(zeros, 1U, pad, file) != pad) {
+        return EIO;
+    }
+    *written = target;
+    return 0;
+}
+
+static int bin_write(FILE *file, uint64_t *written, const void *data, size_t size) {
+    if (size > 0U && fwrite(data, 1U, size, file) != size) {
+        return EIO;
+    }
+    *written += size;
+    return 0;
+}
+
+static uint64_t bin_string_size(const char *text) {
+    return (uint64_t)(text ? strlen(text) : 0U) + 1U;
+}
+
+static int bin_write_string(FILE *file, uint64_t *written, const char *text) {
+    return bin_write(file, written, text ? text : "", (size_t)bin_string_size(text));
+}
+
+static int write_binary_sections(const KolibriKnowledgeIndex *index, FILE *file) {
+    IndexBinHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KOLIBRI_INDEX_BIN_MAGIC, sizeof(header.magic));
+    header.version = KOLIBRI_INDEX_BIN_VERSION;
+    header.item_size = (uint32_t)sizeof(IndexBinItem);
+    size_t document_count = index_total_documents(index);
+    header.document_count = document_count;
+    header.token_count = index->token_count;
+    header.posting_count = index->posting_count;
+    header.posted_document_count = index->posted_count;
+    header.posting_token_count = index->posting_token_count;
+    for (size_t i = 0; i < document_count; ++i) {
+        header.vector_item_count += index_doc(index, i)->vector_size;
+    }
+    for (size_t i = 0; i < index->token_count; ++i) {
+        header.strings_size += bin_string_size(index->tokens[i].token);
+    }
+    for (size_t i = 0; i < document_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        header.strings_size += bin_string_size(doc->id) + bin_string_size(doc->title) +
+                               bin_string_size(doc->source) + bin_string_size(doc->content) +
+                               bin_string_size(doc->json) + bin_string_size(doc->preview);
+    }
+    header.tokens_offset = bin_align(sizeof(header));
+    header.documents_offset = bin_align(header.tokens_offset + header.token_count * sizeof(IndexBinToken));
+    header.vectors_offset =
+        bin_align(header.documents_offset + header.document_count * sizeof(IndexBinDocument));
+    header.posting_offsets_offset =
+        bin_align(header.vectors_offset + header.vector_item_count * sizeof(IndexBinItem));
+    header.posting_docs_offset =
+        bin_align(header.posting_offsets_offset + (header.token_count + 1U) * sizeof(uint64_t));
+    header.posting_weights_offset =
+        bin_align(header.posting_docs_offset + header.posting_count * sizeof(uint32_t));
+    header.posting_scales_offset =
+        bin_align(header.posting_weights_offset + header.posting_count * sizeof(int8_t));
+    header.max_weights_offset =
+        bin_align(header.posting_scales_offset + header.posted_document_count * sizeof(float));
+    header.strings_offset = bin_align(header.max_weights_offset + header.token_count * sizeof(float));
+    header.file_size = header.strings_offset + header.strings_size;
+
+    uint64_t written = 0U;
+    int err = bin_write(file, &written, &header, sizeof(header));
+    uint64_t text = 0U;
+
+    if (err == 0) err = bin_pad(file, &written, header.tokens_offset);
+    for (size_t i = 0; err == 0 && i < index->token_count; ++i) {
+        IndexBinToken token;
+        memset(&token, 0, sizeof(token));
+        token.text = text;
+        token.df = index->tokens[i].df;
+        token.idf = index->tokens[i].idf;
+        text += bin_string_size(index->tokens[i].token);
+        err = bin_write(file, &written, &token, sizeof(token));
+    }
+
+    if (err == 0) err = bin_pad(file, &written, header.documents_offset);
+    uint64_t vector_start = 0U;
+    for (size_t i = 0; err == 0 && i < document_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        IndexBinDocument record;
+        memset(&record, 0, sizeof(record));
+        record.id = text;
+        text += bin_string_size(doc->id);
+        record.title = text;
+        text += bin_string_size(doc->title);
+        record.source = text;
+        text += bin_string_size(doc->source);
+        record.content = text;
+        text += bin_string_size(doc->content);
+        record.json = text;
+        record.json_length = doc->json_length;
+        text += bin_string_size(doc->json);
+        record.preview = text;
+        record.preview_length = doc->preview_length;
+        text += bin_string_size(doc->preview);
+        record.vector_start = vector_start;
+        record.vector_size = doc->vector_size;
+        record.norm = doc->norm;
+        vector_start += doc->vector_size;
+        err = bin_write(file, &written, &record, sizeof(record));
+    }
+
+    if (err == 0) err = bin_pad(file, &written, header.vectors_offset);
+    for (size_t i = 0; err == 0 && i < document_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        for (size_t j = 0; err == 0 && j < doc->vector_size; ++j) {
+            IndexBinItem item = {doc->vector[j].token_index, doc->vector[j].weight, 0U};
+            err = bin_write(file, &written, &item, sizeof(item));
+        }
+    }
+
+    if (err == 0) err = bin_pad(file, &written, header.posting_offsets_offset);
+    /* Токены живого сегмента получают пустые списки постингов. */
+    for (size_t i = 0; err == 0 && i <= index->token_count; ++i) {
+        size_t t = i < index->posting_token_count ? i : index->posting_token_count;
+        uint64_t offset = index->posting_offsets ? index->posting_offsets[t] : 0U;
+        err = bin_write(file, &written, &offset, sizeof(offset));
+    }
+
+    if (err == 0) err = bin_pad(file, &written, header.posting_docs_offset);
+    if (err == 0) err = bin_write(file, &written, index->posting_docs, index->posting_count * sizeof(uint32_t));
+    if (err == 0) err = bin_pad(file, &written, header.posting_weights_offset);
+    if (err == 0) err = bin_write(file, &written, index->posting_weights, index->posting_count * sizeof(int8_t));
+    if (err == 0) err = bin_pad(file, &written, header.posting_scales_offset);
+    if (err == 0) err = bin_write(file, &written, index->posting_scales, index->posted_count * sizeof(float));
+
+    if (err == 0) err = bin_pad(file, &written, header.max_weights_offset);
+    if (err == 0 && index->posting_token_count > 0U) {
+        err = bin_write(file, &written, index->max_weights, index->posting_token_count * sizeof(float));
+    }
+    for (size_t i = index->posting_token_count; err == 0 && i < index->token_count; ++i) {
+        float zero = 0.0f;
+        err = bin_write(file, &written, &zero, sizeof(zero));
+    }
+
+    if (err == 0) err = bin_pad(file, &written, header.strings_offset);
+    for (size_t i = 0; err == 0 && i < index->token_count; ++i) {
+        err = bin_write_string(file, &written, index->tokens[i].token);
+    }
+    for (size_t i = 0; err == 0 && i < document_count; ++i) {
+        const Document *doc = index_doc(index, i);
+        err = bin_write_string(file, &written, doc->id);
+        if (err == 0) err = bin_write_string(file, &written, doc->title);
+        if (err == 0) err = bin_write_string(file, &written, doc->source);
+        if (err == 0) err = bin_write_string(file, &written, doc->content);
+        if (err == 0) err = bin_write_string(file, &written, doc->json);
+        if (err == 0) err = bin_write_string(file, &written, doc->preview);
+    }
+    if (err == 0 && written != header.file_size) {
+        err = EIO;
+    }
+    return err;
+}
+
+int kolibri_knowledge_index_write_binary(const KolibriKnowledgeIndex *index,
+                                         const char *output_dir) {
+    if (!index || !output_dir) {
+        return EINVAL;
+    }
+    int err = ensure_directory(output_dir);
+    if (err != 0) {
+        return err;
+    }
+
+    /* Запись во временный файл и rename: сервер может держать старый
+     * index.bin отображённым. */
+    char index_path[4096];
+    char tmp_path[4096];
+    snprintf(index_path, sizeof(index_path), "%s/index.bin", output_dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/index.bin.tmp", output_dir);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return errno;
+    }
+    index_read_lock(index);
+    err = write_binary_sections(index, file);
+    index_unlock(index);
+    if (fclose(file) != 0 && err == 0) {
+        err = errno ? errno : EIO;
+    }
+    if (err == 0 && rename(tmp_path, index_path) != 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        remove(tmp_path);
+    }
+    return err;
+}
+
+static int bin_section_fits(const IndexBinHeader *header, uint64_t offset, uint64_t count,
+                            uint64_t item_size) {
+    if (offset % 8U != 0U || offset > header->file_size) {
+        return 0;
+    }
+    return count <= (header->file_size - offset) / item_size;
+}
+
+/* Проверяет только структуру (границы секций, ссылки на строки, документы и
+ * токены), не трогая сами тексты, чтобы страницы строк подгружались лениво. */
+static int validate_binary(const unsigned char *base, size_t size) {
+    if (size < sizeof(IndexBinHeader)) {
+        return EINVAL;
+    }
+    const IndexBinHeader *header = (const IndexBinHeader *)base;
+    if (memcmp(header->magic, KOLIBRI_INDEX_BIN_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != KOLIBRI_INDEX_BIN_VERSION || header->file_size != size) {
+        return EINVAL;
+    }
+    if (header->item_size != sizeof(IndexBinItem) || sizeof(size_t) != sizeof(uint64_t) ||
+        sizeof(KolibriKnowledgeVectorItem) != sizeof(IndexBinItem) ||
+        offsetof(KolibriKnowledgeVectorItem, weight) != offsetof(IndexBinItem, weight)) {
+        return ENOTSUP;
+    }
+    if (header->token_count >= SIZE_MAX / 2U ||
+        !bin_section_fits(header, header->tokens_offset, header->token_count, sizeof(IndexBinToken)) ||
+        !bin_section_fits(header, header->documents_offset, header->document_count, sizeof(IndexBinDocument)) ||
+        !bin_section_fits(header, header->vectors_offset, header->vector_item_count, sizeof(IndexBinItem)) ||
+        !bin_section_fits(header, header->posting_offsets_offset, header->token_count + 1U, sizeof(uint64_t)) ||
+        !bin_section_fits(header, header->posting_docs_offset, header->posting_count, sizeof(uint32_t)) ||
+        !bin_section_fits(header, header->posting_weights_offset, header->posting_count, sizeof(int8_t)) ||
+        !bin_section_fits(header, header->posting_scales_offset, header->posted_document_count, sizeof(float)) ||
+        !bin_section_fits(header, header->max_weights_offset, header->token_count, sizeof(float)) ||
+        header->strings_offset > size || header->strings_size != size - header->strings_offset ||
+        header->strings_size == 0U || base[size - 1U] != '\0' ||
+        header->posted_document_count > header->document_count ||
+        header->posted_document_count > KOLIBRI_POSTING_DOC_LIMIT ||
+        header->posting_token_count > header->token_count) {
+        return EINVAL;
+    }
+
+    const IndexBinToken *tokens = (const IndexBinToken *)(base + header->tokens_offset);
+    for (uint64_t i = 0; i < header->token_count; ++i) {
+        if (tokens[i].text >= header->strings_size) {
+            return EINVAL;
+        }
+    }
+    const IndexBinDocument *docs = (const IndexBinDocument *)(base + header->documents_offset);
+    for (uint64_t i = 0; i < header->document_count; ++i) {
+        const IndexBinDocument *doc = &docs[i];
+        if (doc->id >= header->strings_size || doc->title >= header->strings_size ||
+            doc->source >= header->strings_size || doc->content >= header->strings_size ||
+            doc->json >= header->strings_size || doc->json_length >= header->strings_size - doc->json ||
+            doc->preview >= header->strings_size || doc->preview_length >= header->strings_size - doc->preview ||
+            doc->vector_start > header->vector_item_count ||
+            doc->vector_size > header->vector_item_count - doc->vector_start) {
+            return EINVAL;
+        }
+    }
+    const IndexBinItem *vectors = (const IndexBinItem *)(base + header->vectors_offset);
+    for (uint64_t i = 0; i < header->vector_item_count; ++i) {
+        if (vectors[i].index >= header->token_count) {
+            return EINVAL;
+        }
+    }
+    const uint64_t *offsets = (const uint64_t *)(base + header->posting_offsets_offset);
+    if (offsets[0] != 0U || offsets[header->token_count] != header->posting_count) {
+        return EINVAL;
+    }
+    for (uint64_t i = 0; i < header->token_count; ++i) {
+        if (offsets[i] > offsets[i + 1U]) {
+            return EINVAL;
+        }
+    }
+    const uint32_t *posting_docs = (const uint32_t *)(base + header->posting_docs_offset);
+    for (uint64_t i = 0; i < header->posting_count; ++i) {
+        if (posting_docs[i] >= header->posted_document_count) {
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+int kolibri_knowledge_index_load_binary(const char *input_dir,
+                                        KolibriKnowledgeIndex **out_index) {
+    if (!input_dir || !out_index) {
+        return EINVAL;
+    }
+    *out_index = NULL;
+#ifdef _WIN32
+    return ENOTSUP;
+#else
+    char index_path[4096];
+    snprintf(index_path, sizeof(index_path), "%s/index.bin", input_dir);
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return errno;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    if (st.st_size < (off_t)sizeof(IndexBinHeader)) {
+        close(fd);
+        return EINVAL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return errno;
+    }
+    const unsigned char *base = (const unsigned char *)mapped;
+    int err = validate_binary(base, size);
+    if (err != 0) {
+        munmap(mapped, size);
+        return err;
+    }
+
+    const IndexBinHeader *header = (const IndexBinHeader *)base;
+    char *strings = (char *)(base + header->strings_offset);
+    KolibriKnowledgeIndex *index = knowledge_index_new();
+    index->mapping = mapped;
+    index->mapping_size = size;
+    index->token_count = (size_t)header->token_count;
+    index->token_capacity = index->token_count;
+    index->document_count = (size_t)header->document_count;
+    index->posting_count = (size_t)header->posting_count;
+    index->posting_offsets = (size_t *)(base + header->posting_offsets_offset);
+    index->posting_docs = (uint32_t *)(base + header->posting_docs_offset);
+    index->posting_weights = (int8_t *)(base + header->posting_weights_offset);
+    index->posting_scales = (float *)(base + header->posting_scales_offset);
+    index->max_weights = (float *)(base + header->max_weights_offset);
+    index->postings_mapped = 1;
+    index->posted_count = (size_t)header->posted_document_count;
+    index->posting_token_count = (size_t)header->posting_token_count;
+    index->mapped_token_count = (size_t)header->token_count;
+
+    const IndexBinToken *tokens = (const IndexBinToken *)(base + header->tokens_offset);
+    index->tokens = (GlobalToken *)kolibri_alloc((index->token_count ? index->token_count : 1U) *
+                                                 sizeof(GlobalToken));
+    for (size_t i = 0; i < index->token_count; ++i) {
+        index->tokens[i].token = strings + tokens[i].text;
+        index->tokens[i].df = (size_t)tokens[i].df;
+        index->tokens[i].idf = tokens[i].idf;
+    }
+    rebuild_token_map(index);
+    vocabulary_build(index, index->token_count, &index->vocabulary);
+
+    const IndexBinDocument *docs = (const IndexBinDocument *)(base + header->documents_offset);
+    KolibriKnowledgeVectorItem *vectors = (KolibriKnowledgeVectorItem *)(base + header->vectors_offset);
+    index->documents = (Document *)kolibri_alloc((index->document_count ? index->document_count : 1U) *
+                                                 sizeof(Document));
+    for (size_t i = 0; i < index->document_count; ++i) {
+        Document *doc = &index->documents[i];
+        doc->id = strings + docs[i].id;
+        doc->title = strings + docs[i].title;
+        doc->source = strings + docs[i].source;
+        doc->content = strings + docs[i].content;
+        doc->vector = docs[i].vector_size > 0U ? vectors + docs[i].vector_start : NULL;
+        doc->vector_size = (size_t)docs[i].vector_size;
+        doc->norm = docs[i].norm;
+        doc->json = strings + docs[i].json;
+        doc->json_length = (size_t)docs[i].json_length;
+        doc->preview = strings + docs[i].preview;
+        doc->preview_length = (size_t)docs[i].preview_length;
+    }
+
+    *out_index = index;
+    return 0;
+#endif
+}
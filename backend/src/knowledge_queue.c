@@ -16,10 +16,46 @@
 #define kolibri_mkdir(path) mkdir(path, 0777)
 #endif
 
+/* Запросы готовятся один раз при открытии и переиспользуются через reset. */
 struct KolibriQueue {
     sqlite3 *db;
+    sqlite3_stmt *insert_stmt;
+    sqlite3_stmt *fetch_stmt;
+    sqlite3_stmt *moderate_stmt;
+    sqlite3_stmt *scan_stmt;
+    sqlite3_stmt *changes_stmt;
 };
 
+#define QUEUE_COLUMNS \
+    "id, created_at, title, content, source, metadata, status, " \
+    "moderator, moderation_note, moderated_at, revision"
+
+/* revision — сквозной номер изменения: растёт при каждой вставке и модерации,
+ * по нему инкрементальный экспорт находит новые заявки. */
+#define QUEUE_NEXT_REVISION "(SELECT COALESCE(MAX(revision), 0) + 1 FROM submissions)"
+
+static const char *QUEUE_INSERT_SQL =
+    "INSERT INTO submissions (created_at, title, content, source, metadata, status, revision) "
+    "VALUES (?, ?, ?, ?, ?, ?, " QUEUE_NEXT_REVISION ")";
+
+static const char *QUEUE_FETCH_SQL =
+    "SELECT " QUEUE_COLUMNS " FROM submissions WHERE status = ? ORDER BY created_at ASC LIMIT ?";
+
+static const char *QUEUE_MODERATE_SQL =
+    "UPDATE submissions SET status = ?, moderator = ?, moderation_note = ?, moderated_at = ?, "
+    "revision = " QUEUE_NEXT_REVISION " WHERE id = ?";
+
+/* Keyset-пагинация по id: индекс по status уже содержит rowid. */
+static const char *QUEUE_SCAN_SQL =
+    "SELECT " QUEUE_COLUMNS " FROM submissions WHERE status = ? AND id > ? ORDER BY id ASC LIMIT ?";
+
+static const char *QUEUE_CHANGES_SQL =
+    "SELECT " QUEUE_COLUMNS " FROM submissions WHERE revision > ? AND status = ? ORDER BY revision ASC";
+
+/* WAL позволяет читать очередь во время записи, а synchronous=NORMAL в WAL
+ * не теряет согласованность при сбое, только последние транзакции. */
+static const char *QUEUE_PRAGMAS = "PRAGMA journal_mode=WAL;PRAGMA synchronous=NORMAL;";
+
 static const char *QUEUE_SCHEMA =
     "CREATE TABLE IF NOT EXISTS submissions ("
     "id INTEGER PRIMARY KEY AUTOINCREMENT,"
@@ -31,10 +67,16 @@ static const char *QUEUE_SCHEMA =
     "status TEXT NOT NULL,"
     "moderator TEXT,"
     "moderation_note TEXT,"
-    "moderated_at TEXT"
+    "moderated_at TEXT,"
+    "revision INTEGER NOT NULL DEFAULT 0"
     ");"
     "CREATE INDEX IF NOT EXISTS submissions_status_idx ON submissions(status);";
 
+static const char *QUEUE_REVISION_INDEX =
+    "CREATE INDEX IF NOT EXISTS submissions_revision_idx ON submissions(revision);";
+
+static const char *EXPORT_STATE_PREFIX = ".kolibri_export_";
+
 static const char *STATUS_PENDING = "pending";
 static const char *STATUS_APPROVED = "approved";
 static const char *STATUS_REJECTED = "rejected";
@@ -97,6 +139,21 @@ static int ensure_directory(const char *path) {
     return 0;
 }
 
+/* Базы, созданные до появления revision, получают колонку при открытии. */
+static int ensure_revision_column(sqlite3 *db) {
+    sqlite3_stmt *probe = NULL;
+    int rc = sqlite3_prepare_v2(db, "SELECT revision FROM submissions LIMIT 0", -1, &probe, NULL);
+    sqlite3_finalize(probe);
+    if (rc != SQLITE_OK) {
+        rc = sqlite3_exec(db, "ALTER TABLE submissions ADD COLUMN revision INTEGER NOT NULL DEFAULT 0",
+                          NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db, QUEUE_REVISION_INDEX, NULL, NULL, NULL);
+    }
+    return rc;
+}
+
 int kolibri_queue_open(const char *database_path, KolibriQueue **out_queue) {
     if (!database_path || !out_queue) {
         return SQLITE_MISUSE;
@@ -106,15 +163,32 @@ int kolibri_queue_open(const char *database_path, KolibriQueue **out_queue) {
         return SQLITE_NOMEM;
     }
     int rc = sqlite3_open(database_path, &queue->db);
-    if (rc != SQLITE_OK) {
-        sqlite3_close(queue->db);
-        free(queue);
-        return rc;
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(queue->db, QUEUE_PRAGMAS, NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(queue->db, QUEUE_SCHEMA, NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = ensure_revision_column(queue->db);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(queue->db, QUEUE_INSERT_SQL, -1, &queue->insert_stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(queue->db, QUEUE_FETCH_SQL, -1, &queue->fetch_stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(queue->db, QUEUE_MODERATE_SQL, -1, &queue->moderate_stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(queue->db, QUEUE_SCAN_SQL, -1, &queue->scan_stmt, NULL);
+    }
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_prepare_v2(queue->db, QUEUE_CHANGES_SQL, -1, &queue->changes_stmt, NULL);
     }
-    rc = sqlite3_exec(queue->db, QUEUE_SCHEMA, NULL, NULL, NULL);
     if (rc != SQLITE_OK) {
-        sqlite3_close(queue->db);
-        free(queue);
+        kolibri_queue_close(queue);
         return rc;
     }
     *out_queue = queue;
@@ -125,11 +199,16 @@ void kolibri_queue_close(KolibriQueue *queue) {
     if (!queue) {
         return;
     }
+    sqlite3_finalize(queue->insert_stmt);
+    sqlite3_finalize(queue->fetch_stmt);
+    sqlite3_finalize(queue->moderate_stmt);
+    sqlite3_finalize(queue->scan_stmt);
+    sqlite3_finalize(queue->changes_stmt);
     sqlite3_close(queue->db);
     free(queue);
 }
 
-static char *current_iso8601(void) {
+static void current_iso8601(char *buffer, size_t buffer_size) {
     time_t now = time(NULL);
     struct tm t;
 #ifdef _WIN32
@@ -137,9 +216,72 @@ static char *current_iso8601(void) {
 #else
     gmtime_r(&now, &t);
 #endif
-    char buffer[32];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &t);
-    return kolibri_strdup(buffer);
+    strftime(buffer, buffer_size, "%Y-%m-%dT%H:%M:%SZ", &t);
+}
+
+/* Строки привязываются без копирования: они живут дольше шага запроса. */
+static void bind_optional_text(sqlite3_stmt *stmt, int column, const char *text) {
+    if (text) {
+        sqlite3_bind_text(stmt, column, text, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_null(stmt, column);
+    }
+}
+
+static int finish_statement(sqlite3_stmt *stmt, int rc) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    return rc;
+}
+
+static int queue_insert(KolibriQueue *queue,
+                        const KolibriQueueSubmission *item,
+                        const char *created,
+                        long long *out_submission_id) {
+    if (!item->title || !item->content) {
+        return SQLITE_MISUSE;
+    }
+    sqlite3_stmt *stmt = queue->insert_stmt;
+    sqlite3_bind_text(stmt, 1, created, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, item->title, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, item->content, -1, SQLITE_STATIC);
+    bind_optional_text(stmt, 4, item->source);
+    bind_optional_text(stmt, 5, item->metadata_json);
+    sqlite3_bind_text(stmt, 6, STATUS_PENDING, -1, SQLITE_STATIC);
+    int rc = finish_statement(stmt, sqlite3_step(stmt));
+    if (rc != SQLITE_DONE) {
+        return rc;
+    }
+    if (out_submission_id) {
+        *out_submission_id = sqlite3_last_insert_rowid(queue->db);
+    }
+    return SQLITE_OK;
+}
+
+static int queue_update(KolibriQueue *queue, const KolibriQueueModeration *item, const char *timestamp) {
+    sqlite3_stmt *stmt = queue->moderate_stmt;
+    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(item->status), -1, SQLITE_STATIC);
+    bind_optional_text(stmt, 2, item->moderator);
+    bind_optional_text(stmt, 3, item->note);
+    sqlite3_bind_text(stmt, 4, timestamp, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 5, item->submission_id);
+    int rc = finish_statement(stmt, sqlite3_step(stmt));
+    if (rc != SQLITE_DONE) {
+        return rc;
+    }
+    return sqlite3_changes(queue->db) == 0 ? SQLITE_NOTFOUND : SQLITE_OK;
+}
+
+static int queue_begin(KolibriQueue *queue) {
+    return sqlite3_exec(queue->db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+}
+
+static int queue_finish(KolibriQueue *queue, int rc) {
+    if (rc != SQLITE_OK) {
+        sqlite3_exec(queue->db, "ROLLBACK", NULL, NULL, NULL);
+        return rc;
+    }
+    return sqlite3_exec(queue->db, "COMMIT", NULL, NULL, NULL);
 }
 
 int kolibri_queue_enqueue(KolibriQueue *queue,
@@ -151,42 +293,45 @@ int kolibri_queue_enqueue(KolibriQueue *queue,
     if (!queue || !title || !content) {
         return SQLITE_MISUSE;
     }
-    char *created = current_iso8601();
-    const char *sql =
-        "INSERT INTO submissions (created_at, title, content, source, metadata, status) "
-        "VALUES (?, ?, ?, ?, ?, ?)";
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
+    KolibriQueueSubmission item = { title, content, source, metadata_json };
+    char created[32];
+    current_iso8601(created, sizeof(created));
+    return queue_insert(queue, &item, created, out_submission_id);
+}
+
+int kolibri_queue_enqueue_many(KolibriQueue *queue,
+                               const KolibriQueueSubmission *items,
+                               size_t count,
+                               long long *out_submission_ids) {
+    if (!queue || (!items && count > 0U)) {
+        return SQLITE_MISUSE;
+    }
+    char created[32];
+    current_iso8601(created, sizeof(created));
+    int rc = queue_begin(queue);
     if (rc != SQLITE_OK) {
-        free(created);
         return rc;
     }
-    sqlite3_bind_text(stmt, 1, created, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, title, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, content, -1, SQLITE_TRANSIENT);
-    if (source) {
-        sqlite3_bind_text(stmt, 4, source, -1, SQLITE_TRANSIENT);
-    } else {
-        sqlite3_bind_null(stmt, 4);
+    for (size_t i = 0; i < count && rc == SQLITE_OK; ++i) {
+        rc = queue_insert(queue, &items[i], created, out_submission_ids ? &out_submission_ids[i] : NULL);
     }
-    if (metadata_json) {
-        sqlite3_bind_text(stmt, 5, metadata_json, -1, SQLITE_TRANSIENT);
-    } else {
-        sqlite3_bind_null(stmt, 5);
-    }
-    sqlite3_bind_text(stmt, 6, STATUS_PENDING, -1, SQLITE_TRANSIENT);
+    return queue_finish(queue, rc);
+}
 
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    if (rc != SQLITE_DONE) {
-        free(created);
-        return rc;
-    }
-    if (out_submission_id) {
-        *out_submission_id = sqlite3_last_insert_rowid(queue->db);
-    }
-    free(created);
-    return SQLITE_OK;
+/* Заполняет запись указателями во внутренний буфер SQLite без копирования. */
+static void read_row(sqlite3_stmt *stmt, KolibriQueueRecord *rec) {
+    rec->submission_id = sqlite3_column_int64(stmt, 0);
+    rec->created_at = (char *)sqlite3_column_text(stmt, 1);
+    rec->title = (char *)sqlite3_column_text(stmt, 2);
+    rec->content = (char *)sqlite3_column_text(stmt, 3);
+    rec->source = (char *)sqlite3_column_text(stmt, 4);
+    rec->metadata = (char *)sqlite3_column_text(stmt, 5);
+    if (kolibri_queue_status_from_string((const char *)sqlite3_column_text(stmt, 6), &rec->status) != 0) {
+        rec->status = KOLIBRI_QUEUE_STATUS_PENDING;
+    }
+    rec->moderator = (char *)sqlite3_column_text(stmt, 7);
+    rec->moderation_note = (char *)sqlite3_column_text(stmt, 8);
+    rec->moderated_at = (char *)sqlite3_column_text(stmt, 9);
 }
 
 int kolibri_queue_fetch(KolibriQueue *queue,
@@ -199,17 +344,10 @@ int kolibri_queue_fetch(KolibriQueue *queue,
     }
     *out_records = NULL;
     *out_count = 0U;
-    const char *sql =
-        "SELECT id, created_at, title, content, source, metadata, status, "
-        "moderator, moderation_note, moderated_at "
-        "FROM submissions WHERE status = ? ORDER BY created_at ASC LIMIT ?";
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        return rc;
-    }
-    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, (int)limit);
+    sqlite3_stmt *stmt = queue->fetch_stmt;
+    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, (sqlite3_int64)limit);
+    int rc = SQLITE_OK;
 
     KolibriQueueRecord *records = NULL;
     size_t capacity = 0U;
@@ -220,31 +358,29 @@ int kolibri_queue_fetch(KolibriQueue *queue,
             size_t new_cap = capacity == 0U ? 16U : capacity * 2U;
             KolibriQueueRecord *new_records = (KolibriQueueRecord *)realloc(records, new_cap * sizeof(KolibriQueueRecord));
             if (!new_records) {
-                sqlite3_finalize(stmt);
-                free(records);
+                finish_statement(stmt, SQLITE_NOMEM);
+                kolibri_queue_free_records(records, count);
                 return SQLITE_NOMEM;
             }
             records = new_records;
             capacity = new_cap;
         }
+        KolibriQueueRecord row;
+        read_row(stmt, &row);
         KolibriQueueRecord *rec = &records[count++];
-        rec->submission_id = sqlite3_column_int64(stmt, 0);
-        rec->created_at = kolibri_strdup((const char *)sqlite3_column_text(stmt, 1));
-        rec->title = kolibri_strdup((const char *)sqlite3_column_text(stmt, 2));
-        rec->content = kolibri_strdup((const char *)sqlite3_column_text(stmt, 3));
-        rec->source = kolibri_strdup((const char *)sqlite3_column_text(stmt, 4));
-        rec->metadata = kolibri_strdup((const char *)sqlite3_column_text(stmt, 5));
-        KolibriQueueStatus st;
-        if (kolibri_queue_status_from_string((const char *)sqlite3_column_text(stmt, 6), &st) != 0) {
-            st = KOLIBRI_QUEUE_STATUS_PENDING;
-        }
-        rec->status = st;
-        rec->moderator = kolibri_strdup((const char *)sqlite3_column_text(stmt, 7));
-        rec->moderation_note = kolibri_strdup((const char *)sqlite3_column_text(stmt, 8));
-        rec->moderated_at = kolibri_strdup((const char *)sqlite3_column_text(stmt, 9));
+        rec->submission_id = row.submission_id;
+        rec->created_at = kolibri_strdup(row.created_at);
+        rec->title = kolibri_strdup(row.title);
+        rec->content = kolibri_strdup(row.content);
+        rec->source = kolibri_strdup(row.source);
+        rec->metadata = kolibri_strdup(row.metadata);
+        rec->status = row.status;
+        rec->moderator = kolibri_strdup(row.moderator);
+        rec->moderation_note = kolibri_strdup(row.moderation_note);
+        rec->moderated_at = kolibri_strdup(row.moderated_at);
     }
 
-    sqlite3_finalize(stmt);
+    finish_statement(stmt, rc);
     if (rc != SQLITE_DONE) {
         kolibri_queue_free_records(records, count);
         return rc;
@@ -254,6 +390,40 @@ int kolibri_queue_fetch(KolibriQueue *queue,
     return SQLITE_OK;
 }
 
+int kolibri_queue_scan(KolibriQueue *queue,
+                       KolibriQueueStatus status,
+                       long long after_id,
+                       size_t limit,
+                       KolibriQueueVisitor visitor,
+                       void *user_data,
+                       long long *out_last_id) {
+    if (out_last_id) {
+        *out_last_id = after_id;
+    }
+    if (!queue || !visitor) {
+        return SQLITE_MISUSE;
+    }
+    sqlite3_stmt *stmt = queue->scan_stmt;
+    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, after_id);
+    /* Отрицательный LIMIT в SQLite означает «без ограничения». */
+    sqlite3_bind_int64(stmt, 3, limit == 0U ? -1 : (sqlite3_int64)limit);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        KolibriQueueRecord row;
+        read_row(stmt, &row);
+        if (out_last_id) {
+            *out_last_id = row.submission_id;
+        }
+        if (visitor(&row, user_data) != 0) {
+            rc = SQLITE_DONE;
+            break;
+        }
+    }
+    rc = finish_statement(stmt, rc);
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
 void kolibri_queue_free_records(KolibriQueueRecord *records, size_t count) {
     if (!records) {
         return;
@@ -279,40 +449,45 @@ int kolibri_queue_moderate(KolibriQueue *queue,
     if (!queue) {
         return SQLITE_MISUSE;
     }
-    char *timestamp = current_iso8601();
-    const char *sql =
-        "UPDATE submissions SET status = ?, moderator = ?, moderation_note = ?, moderated_at = ? "
-        "WHERE id = ?";
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(queue->db, sql, -1, &stmt, NULL);
+    KolibriQueueModeration item = { submission_id, status, moderator, note };
+    char timestamp[32];
+    current_iso8601(timestamp, sizeof(timestamp));
+    return queue_update(queue, &item, timestamp);
+}
+
+int kolibri_queue_moderate_many(KolibriQueue *queue,
+                                const KolibriQueueModeration *items,
+                                size_t count,
+                                size_t *out_updated) {
+    if (out_updated) {
+        *out_updated = 0U;
+    }
+    if (!queue || (!items && count > 0U)) {
+        return SQLITE_MISUSE;
+    }
+    char timestamp[32];
+    current_iso8601(timestamp, sizeof(timestamp));
+    int rc = queue_begin(queue);
     if (rc != SQLITE_OK) {
-        free(timestamp);
         return rc;
     }
-    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_TRANSIENT);
-    if (moderator) {
-        sqlite3_bind_text(stmt, 2, moderator, -1, SQLITE_TRANSIENT);
-    } else {
-        sqlite3_bind_null(stmt, 2);
-    }
-    if (note) {
-        sqlite3_bind_text(stmt, 3, note, -1, SQLITE_TRANSIENT);
-    } else {
-        sqlite3_bind_null(stmt, 3);
-    }
-    sqlite3_bind_text(stmt, 4, timestamp, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(stmt, 5, submission_id);
-
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    free(timestamp);
-    if (rc != SQLITE_DONE) {
-        return rc;
+    size_t updated = 0U;
+    for (size_t i = 0; i < count; ++i) {
+        rc = queue_update(queue, &items[i], timestamp);
+        if (rc == SQLITE_NOTFOUND) {
+            rc = SQLITE_OK;
+            continue;
+        }
+        if (rc != SQLITE_OK) {
+            break;
+        }
+        updated += 1U;
     }
-    if (sqlite3_changes(queue->db) == 0) {
-        return SQLITE_NOTFOUND;
+    rc = queue_finish(queue, rc);
+    if (rc == SQLITE_OK && out_updated) {
+        *out_updated = updated;
     }
-    return SQLITE_OK;
+    return rc;
 }
 
 static void delete_markdown_files(const char *dir) {
@@ -335,7 +510,7 @@ static void delete_markdown_files(const char *dir) {
     closedir(d);
 }
 
-static void write_markdown_file(const KolibriQueueRecord *record, const char *dir, size_t index) {
+static int write_markdown_file(const KolibriQueueRecord *record, const char *dir) {
     char slug[64];
     size_t pos = 0U;
     const char *src = record->title ? record->title : "submission";
@@ -347,24 +522,88 @@ static void write_markdown_file(const KolibriQueueRecord *record, const char *di
         }
     }
     slug[pos] = '\0';
-    char filename[256];
-    snprintf(filename, sizeof(filename), "%s/%06zu_%s.md", dir, index + 1U, slug[0] ? slug : "submission");
+    /* Имя файла строится из id, чтобы повторный экспорт заявки перезаписывал её файл. */
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/%06lld_%s.md", dir, record->submission_id, slug[0] ? slug : "submission");
     FILE *file = fopen(filename, "wb");
     if (!file) {
-        return;
+        return -1;
     }
     fprintf(file, "# %s\n\n", record->title ? record->title : "Без названия");
     if (record->source && record->source[0]) {
         fprintf(file, "Источник: %s\n\n", record->source);
     }
     fprintf(file, "%s\n", record->content ? record->content : "");
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static void export_state_path(const char *dir, KolibriQueueStatus status, char *buffer, size_t buffer_size) {
+    snprintf(buffer, buffer_size, "%s/%s%s", dir, EXPORT_STATE_PREFIX, kolibri_queue_status_to_string(status));
+}
+
+static long long read_export_revision(const char *dir, KolibriQueueStatus status) {
+    char path[4096];
+    export_state_path(dir, status, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    long long revision = 0;
+    if (fscanf(file, "%lld", &revision) != 1 || revision < 0) {
+        revision = 0;
+    }
     fclose(file);
+    return revision;
+}
+
+static int write_export_revision(const char *dir, KolibriQueueStatus status, long long revision) {
+    char path[4096];
+    char tmp_path[4096 + 8];
+    export_state_path(dir, status, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        return -1;
+    }
+    fprintf(file, "%lld\n", revision);
+    if (fclose(file) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return rename(tmp_path, path);
+}
+
+/* Построчно пишет файлы, пока курсор идёт по выборке; ничего не копирует. */
+static int export_rows(sqlite3_stmt *stmt, const char *dir, long long *in_out_revision, size_t *out_exported) {
+    size_t exported = 0U;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        KolibriQueueRecord row;
+        read_row(stmt, &row);
+        if (write_markdown_file(&row, dir) != 0) {
+            rc = SQLITE_CANTOPEN;
+            break;
+        }
+        long long revision = sqlite3_column_int64(stmt, 10);
+        if (revision > *in_out_revision) {
+            *in_out_revision = revision;
+        }
+        exported += 1U;
+    }
+    rc = finish_statement(stmt, rc);
+    if (out_exported) {
+        *out_exported = exported;
+    }
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
 }
 
 int kolibri_queue_export_markdown(KolibriQueue *queue,
                                   KolibriQueueStatus status,
                                   const char *destination_dir,
                                   size_t *out_exported) {
+    if (out_exported) {
+        *out_exported = 0U;
+    }
     if (!queue || !destination_dir) {
         return SQLITE_MISUSE;
     }
@@ -372,18 +611,40 @@ int kolibri_queue_export_markdown(KolibriQueue *queue,
         return SQLITE_ERROR;
     }
     delete_markdown_files(destination_dir);
-    KolibriQueueRecord *records = NULL;
-    size_t count = 0U;
-    int rc = kolibri_queue_fetch(queue, status, 10000U, &records, &count);
-    if (rc != SQLITE_OK) {
-        return rc;
+    sqlite3_stmt *stmt = queue->scan_stmt;
+    sqlite3_bind_text(stmt, 1, kolibri_queue_status_to_string(status), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, 0);
+    sqlite3_bind_int64(stmt, 3, -1);
+    long long revision = 0;
+    int rc = export_rows(stmt, destination_dir, &revision, out_exported);
+    if (rc == SQLITE_OK && write_export_revision(destination_dir, status, revision) != 0) {
+        rc = SQLITE_CANTOPEN;
+    }
+    return rc;
+}
+
+int kolibri_queue_export_markdown_incremental(KolibriQueue *queue,
+                                              KolibriQueueStatus status,
+                                              const char *destination_dir,
+                                              size_t *out_exported) {
+    if (out_exported) {
+        *out_exported = 0U;
     }
-    for (size_t i = 0; i < count; ++i) {
-        write_markdown_file(&records[i], destination_dir, i);
+    if (!queue || !destination_dir) {
+        return SQLITE_MISUSE;
     }
-    kolibri_queue_free_records(records, count);
-    if (out_exported) {
-        *out_exported = count;
+    if (ensure_directory(destination_dir) != 0) {
+        return SQLITE_ERROR;
     }
-    return SQLITE_OK;
+    long long last = read_export_revision(destination_dir, status);
+    long long revision = last;
+    sqlite3_stmt *stmt = queue->changes_stmt;
+    sqlite3_bind_int64(stmt, 1, last);
+    sqlite3_bind_text(stmt, 2, kolibri_queue_status_to_string(status), -1, SQLITE_STATIC);
+    int rc = export_rows(stmt, destination_dir, &revision, out_exported);
+    /* Отметка сдвигается только после успешной записи всех файлов. */
+    if (rc == SQLITE_OK && revision != last && write_export_revision(destination_dir, status, revision) != 0) {
+        rc = SQLITE_CANTOPEN;
+    }
+    return rc;
 }
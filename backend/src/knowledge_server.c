@@ -1,13 +1,23 @@
 #include "kolibri/knowledge_index.h"
 #include "kolibri/genome.h"
+#include "kolibri/memory.h"
+#include "kolibri/rate_limit.h"
 #include "kolibri/swarm.h"
+#include "kolibri/trace.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <strings.h>
 #include <ctype.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +25,7 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -22,30 +33,109 @@
 #define KOLIBRI_DEFAULT_PORT 8000
 #define KOLIBRI_SERVER_BACKLOG 16
 #define KOLIBRI_REQUEST_BUFFER 8192
-#define KOLIBRI_RESPONSE_BUFFER 32768
 #define KOLIBRI_MAX_CONTENT_LENGTH 2048
-#define KOLIBRI_RATE_LIMIT_WINDOW 60
-#define KOLIBRI_RATE_LIMIT_BURST 30
+#define KOLIBRI_BULK_MAX_CONTENT_LENGTH (16U * 1024U * 1024U)
+#define KOLIBRI_BULK_MAX_ITEMS 100000U
+#define KOLIBRI_BULK_LINE_MAX 4096U
+#define KOLIBRI_BULK_BATCH 64U
+#define KOLIBRI_HTTP_MAX_HEADERS 32
 #define KOLIBRI_DEFAULT_INDEX_CACHE ".kolibri/index"
 #define KOLIBRI_BOOTSTRAP_SCRIPT "knowledge_bootstrap.ks"
 #define KOLIBRI_KNOWLEDGE_GENOME ".kolibri/knowledge_genome.dat"
+#define KOLIBRI_MAX_WORKERS 256
+/* Без явного --workers берётся число CPU, но не больше этого. */
+#define KOLIBRI_DEFAULT_MAX_WORKERS 64L
+#define KOLIBRI_CONNECTION_QUEUE 256
+#define KOLIBRI_IDLE_CONNECTIONS 1024
+#define KOLIBRI_KEEPALIVE_TIMEOUT_MS 5000
+#define KOLIBRI_KEEPALIVE_MAX_REQUESTS 100
+#define KOLIBRI_SEARCH_CACHE_DEFAULT 256
+#define KOLIBRI_SEARCH_CACHE_MAX 65536
+#define KOLIBRI_SEARCH_REPLAY_DOCS 3
+#define KOLIBRI_SEARCH_LIMIT_MAX 64
+#define KOLIBRI_JOURNAL_QUEUE_DEFAULT 1024
+#define KOLIBRI_JOURNAL_QUEUE_MAX 65536
+#define KOLIBRI_JOURNAL_BATCH 64
+#define KOLIBRI_SEGMENT_MERGE_DOCS 64
+#define KOLIBRI_SEGMENT_MERGE_MS 2000
+#define KOLIBRI_LATENCY_BUCKETS 20
+#define KOLIBRI_SHARD_MAX 32
+#define KOLIBRI_SHARD_TIMEOUT_DEFAULT_MS 200
+#define KOLIBRI_SHARD_RESPONSE_MAX (1024U * 1024U)
 
-static volatile sig_atomic_t kolibri_server_running = 1;
-static size_t kolibri_requests_total = 0U;
-static size_t kolibri_search_hits = 0U;
-static size_t kolibri_search_misses = 0U;
+/* Читается рабочими потоками, поэтому атомарный, а не sig_atomic_t. */
+static atomic_int kolibri_server_running = 1;
+static atomic_size_t kolibri_requests_total = 0U;
+static atomic_size_t kolibri_search_hits = 0U;
+static atomic_size_t kolibri_search_misses = 0U;
+static atomic_size_t kolibri_search_cache_hits = 0U;
+static atomic_size_t kolibri_search_cache_misses = 0U;
+/* Эпоха содержимого индекса: растёт при teach, слиянии сегментов и перезагрузке.
+ * Поиск запоминает её до начала, и ответ, посчитанный по старому содержимому,
+ * не попадает в кэш после его сброса. */
+static atomic_uint_fast64_t kolibri_index_epoch = 0U;
+static atomic_size_t kolibri_requests_in_flight = 0U;
+static atomic_size_t kolibri_connections_open = 0U;
+static atomic_size_t kolibri_connections_idle = 0U;
 static time_t kolibri_bootstrap_timestamp = 0;
-static time_t kolibri_index_timestamp = 0;
 static time_t kolibri_server_started_at = 0;
 
+typedef enum {
+    KOLIBRI_ROUTE_HEALTHZ,
+    KOLIBRI_ROUTE_METRICS,
+    KOLIBRI_ROUTE_SEARCH,
+    KOLIBRI_ROUTE_FEEDBACK,
+    KOLIBRI_ROUTE_TEACH,
+    KOLIBRI_ROUTE_RELOAD,
+    KOLIBRI_ROUTE_BULK,
+    KOLIBRI_ROUTE_NOT_FOUND,
+    KOLIBRI_ROUTE_INVALID,
+    KOLIBRI_ROUTE_COUNT
+} KolibriRoute;
+
+static const char *const kolibri_route_names[KOLIBRI_ROUTE_COUNT] = {
+    "healthz", "metrics", "search", "feedback", "teach", "reload", "bulk", "not_found", "invalid"
+};
+
+typedef enum {
+    KOLIBRI_STAGE_PARSE,
+    KOLIBRI_STAGE_SEARCH,
+    KOLIBRI_STAGE_SERIALIZE,
+    KOLIBRI_STAGE_JOURNAL,
+    KOLIBRI_STAGE_COUNT
+} KolibriStage;
+
+static const char *const kolibri_stage_names[KOLIBRI_STAGE_COUNT] = { "parse", "search", "serialize", "journal" };
+
+/* Границы корзин в микросекундах: 1-2-5 на декаду от 10 мкс до 10 с, как у
+ * HDR-гистограмм относительная точность одна на всём диапазоне. Последняя
+ * корзина — +Inf. */
+static const uint64_t kolibri_latency_bounds_us[KOLIBRI_LATENCY_BUCKETS - 1] = {
+    10U,     20U,     50U,     100U,     200U,     500U,     1000U,    2000U,    5000U,   10000U,
+    20000U,  50000U,  100000U, 200000U,  500000U,  1000000U, 2000000U, 5000000U, 10000000U
+};
+
+/* Корзины не накопительные; запись — два relaxed-инкремента без блокировок. */
+typedef struct {
+    atomic_size_t buckets[KOLIBRI_LATENCY_BUCKETS];
+    atomic_ullong sum_ns;
+} KolibriLatencyHistogram;
+
+static KolibriLatencyHistogram kolibri_route_latency[KOLIBRI_ROUTE_COUNT];
+static KolibriLatencyHistogram kolibri_stage_latency[KOLIBRI_STAGE_COUNT];
+/* Ответы по маршрутам и классам статуса 1xx..5xx. */
+static atomic_size_t kolibri_route_responses[KOLIBRI_ROUTE_COUNT][5];
+
 static int kolibri_server_port = KOLIBRI_DEFAULT_PORT;
+static size_t kolibri_worker_count = 0U;
+static int kolibri_keepalive_timeout_ms = KOLIBRI_KEEPALIVE_TIMEOUT_MS;
+static size_t kolibri_search_cache_capacity = KOLIBRI_SEARCH_CACHE_DEFAULT;
 static char kolibri_bind_address[64] = "127.0.0.1";
 static char **kolibri_knowledge_directories = NULL;
 static size_t kolibri_knowledge_directory_count = 0U;
 static char kolibri_index_json_path[512];
 static char kolibri_index_cache_dir[512] = KOLIBRI_DEFAULT_INDEX_CACHE;
 static char kolibri_admin_token[256];
-static char kolibri_index_source[64] = "directories";
 
 static KolibriGenome kolibri_genome;
 static int kolibri_genome_ready = 0;
@@ -57,19 +147,263 @@ static int kolibri_swarm_ready = 0;
 static char kolibri_swarm_nodes_config[1024];
 static char kolibri_swarm_node_id[KOLIBRI_SWARM_ID_MAX];
 
+/* Шарды для рассылки поиска: адреса разрешаются один раз при старте. */
+typedef struct {
+    char endpoint[KOLIBRI_SWARM_ENDPOINT_MAX];
+    struct sockaddr_in addr;
+} KolibriShardEndpoint;
+
+typedef enum {
+    KOLIBRI_SHARD_OK,
+    KOLIBRI_SHARD_ERROR,
+    KOLIBRI_SHARD_TIMEOUT,
+    KOLIBRI_SHARD_RESULT_COUNT
+} KolibriShardResult;
+
+static const char *const kolibri_shard_result_names[KOLIBRI_SHARD_RESULT_COUNT] = { "ok", "error", "timeout" };
+static KolibriShardEndpoint kolibri_shards[KOLIBRI_SHARD_MAX];
+static size_t kolibri_shard_count = 0U;
+static int kolibri_shard_timeout_ms = KOLIBRI_SHARD_TIMEOUT_DEFAULT_MS;
+static atomic_size_t kolibri_shard_results[KOLIBRI_SHARD_RESULT_COUNT];
+static atomic_size_t kolibri_shard_partial_responses = 0U;
+
+/* Что делать с событием генома, если очередь журнала заполнена. */
+typedef enum {
+    KOLIBRI_JOURNAL_BLOCK,
+    KOLIBRI_JOURNAL_DROP,
+    KOLIBRI_JOURNAL_COALESCE
+} KolibriJournalPolicy;
+
+typedef struct {
+    atomic_size_t sequence;
+    char event[KOLIBRI_EVENT_TYPE_SIZE];
+    char payload[KOLIBRI_PAYLOAD_SIZE];
+} KolibriJournalCell;
+
+/* Ограниченная MPSC-очередь событий генома (кольцо с номерами последовательности):
+ * обработчики запросов публикуют события без блокировок, в файл пишет один поток. */
 typedef struct {
-    time_t window_start;
+    KolibriJournalCell *cells;
+    size_t mask;
+    atomic_size_t enqueue_pos;
+    atomic_size_t dequeue_pos;
+    atomic_int writer_sleeping;
+    atomic_int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    atomic_int running;
+} KolibriJournal;
+
+static KolibriJournal kolibri_journal = { NULL, 0U, 0U, 0U, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                                          0, 0 };
+static size_t kolibri_journal_capacity = KOLIBRI_JOURNAL_QUEUE_DEFAULT;
+static KolibriJournalPolicy kolibri_journal_policy = KOLIBRI_JOURNAL_BLOCK;
+static uint64_t kolibri_genome_sync_ms = 0U;
+static KolibriGenomeOptions kolibri_genome_options = {.format = KOLIBRI_GENOME_FORMAT_V1};
+static atomic_size_t kolibri_journal_written = 0U;
+static atomic_size_t kolibri_journal_dropped = 0U;
+static atomic_size_t kolibri_journal_coalesced = 0U;
+static atomic_size_t kolibri_journal_coalesce_pending = 0U;
+
+static KolibriRateLimiter kolibri_feedback_rate;
+static KolibriRateLimiter kolibri_teach_rate;
+
+/* Соединение между обработчиками: served переживает возврат в пул простоя. */
+typedef struct {
+    int fd;
+    uint32_t client;
+    size_t served;
+} KolibriQueuedConnection;
+
+/* Очередь принятых соединений между accept-циклом и пулом обработчиков. */
+typedef struct {
+    KolibriQueuedConnection items[KOLIBRI_CONNECTION_QUEUE];
+    size_t head;
+    size_t count;
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} KolibriConnectionQueue;
+
+/* Простаивающие keep-alive соединения ждут следующего запроса в poll accept-цикла,
+ * а не в обработчике. Добавляют обработчики, убирает только accept-цикл, поэтому
+ * первые записи не сдвигаются, пока он спит в poll; wake будит его после добавления. */
+typedef struct {
+    KolibriQueuedConnection items[KOLIBRI_IDLE_CONNECTIONS];
+    uint64_t deadlines[KOLIBRI_IDLE_CONNECTIONS];
     size_t count;
-} KolibriRateLimiter;
+    int wake[2];
+    pthread_mutex_t lock;
+} KolibriIdlePool;
+
+typedef struct {
+    KolibriConnectionQueue *queue;
+    KolibriIdlePool *idle;
+} KolibriWorkerContext;
+
+/* Опубликованный индекс. Запрос держит ссылку только на время ответа: перезагрузка
+ * подменяет текущий указатель, а старый индекс освобождает последний запрос,
+ * который ещё его читал. */
+typedef struct {
+    KolibriKnowledgeIndex *index;
+    char source[64];
+    time_t timestamp;
+    uint64_t generation;
+    atomic_size_t refs;
+} KolibriIndexHandle;
+
+/* Горячая перезагрузка по SIGHUP или POST /api/knowledge/reload. swap_lock покрывает
+ * только подмену указателя и захват ссылки. update_lock упорядочивает teach, запись
+ * снимка в кэш и подмену, чтобы документы живого сегмента не терялись; current
+ * меняется только под обеими блокировками. */
+typedef struct {
+    KolibriIndexHandle *current;
+    pthread_mutex_t swap_lock;
+    pthread_mutex_t update_lock;
+    pthread_t thread;
+    int running;
+    int stopping;
+    int requested;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    atomic_size_t reloads;
+    atomic_size_t failures;
+} KolibriIndexPublisher;
+
+static KolibriIndexPublisher kolibri_publisher = { NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+                                                   0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER,
+                                                   PTHREAD_COND_INITIALIZER, 0U, 0U };
+static volatile sig_atomic_t kolibri_reload_requested = 0;
 
-static KolibriRateLimiter kolibri_feedback_rate = { 0, 0 };
-static KolibriRateLimiter kolibri_teach_rate = { 0, 0 };
+/* Фоновое слияние живого сегмента индекса: по заполнению сегмента или по
+ * тайм-ауту, если в нём есть хоть один документ. */
+typedef struct {
+    pthread_t thread;
+    int running;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} KolibriSegmentMerger;
+
+static KolibriSegmentMerger kolibri_merger = { 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+static atomic_size_t kolibri_teach_documents = 0U;
+static atomic_size_t kolibri_bulk_accepted = 0U;
+static atomic_size_t kolibri_bulk_rejected = 0U;
+
+/* Готовый JSON-ответ поиска. Счётчик ссылок позволяет отправлять тело вне блокировки
+ * кэша, даже если запись тем временем вытеснена; generation отсекает ответы,
+ * посчитанные по индексу, который уже подменила перезагрузка, epoch — по
+ * содержимому до teach или слияния. */
+typedef struct {
+    atomic_size_t refs;
+    uint64_t generation;
+    uint64_t epoch;
+    size_t doc_count;
+    size_t docs[KOLIBRI_SEARCH_REPLAY_DOCS];
+    size_t length;
+    char data[];
+} KolibriCachedBody;
+
+typedef struct {
+    char *key;
+    uint64_t hash;
+    KolibriCachedBody *body;
+    size_t bucket_next;
+    size_t lru_prev;
+    size_t lru_next;
+} KolibriSearchCacheEntry;
+
+/* LRU-кэш ответов /api/knowledge/search: ключ — нормализованный запрос и limit. */
+typedef struct {
+    KolibriSearchCacheEntry *entries;
+    size_t *buckets;
+    size_t capacity;
+    size_t bucket_count;
+    size_t used;
+    size_t lru_head;
+    size_t lru_tail;
+    pthread_mutex_t lock;
+} KolibriSearchCache;
+
+#define KOLIBRI_CACHE_NONE ((size_t)-1)
+
+static KolibriSearchCache kolibri_search_cache = { NULL, NULL, 0U, 0U, 0U, KOLIBRI_CACHE_NONE, KOLIBRI_CACHE_NONE,
+                                                   PTHREAD_MUTEX_INITIALIZER };
+
+/* Участок приёмного буфера; после разбора заголовка завершён нулём на месте. */
+typedef struct {
+    const char *data;
+    size_t length;
+} KolibriSlice;
+
+typedef struct {
+    KolibriSlice name;
+    KolibriSlice value;
+} KolibriHttpHeader;
+
+/* Разбор запроса за один проход: строки, уже пройденные на прошлых recv, повторно
+ * не сканируются, а поля ссылаются прямо в буфер соединения. */
+typedef struct {
+    size_t scanned;
+    int head_done;
+    KolibriSlice method;
+    KolibriSlice path;
+    KolibriSlice query;
+    KolibriSlice version;
+    KolibriHttpHeader headers[KOLIBRI_HTTP_MAX_HEADERS];
+    size_t header_count;
+    size_t header_len;
+    size_t content_length;
+    int has_content_length;
+    /* Тело читает сам обработчик: запрос считается полным сразу после заголовка. */
+    int streamed_body;
+    uint64_t parse_ns;
+} KolibriHttpRequest;
+
+/* Состояние постоянного соединения: буфер может содержать следующий конвейерный запрос. */
+typedef struct {
+    int fd;
+    char buffer[KOLIBRI_REQUEST_BUFFER];
+    size_t length;
+    size_t served;
+    int keep_alive;
+    uint32_t client;
+    KolibriRoute route;
+    int status;
+    KolibriHttpRequest request;
+} KolibriConnection;
 
 static int load_admin_token_from_file(const char *path, char *out, size_t out_size);
 
 static void handle_signal(int sig) {
     (void)sig;
-    kolibri_server_running = 0;
+    atomic_store(&kolibri_server_running, 0);
+}
+
+static void handle_reload_signal(int sig) {
+    (void)sig;
+    kolibri_reload_requested = 1;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void latency_record(KolibriLatencyHistogram *histogram, uint64_t elapsed_ns) {
+    size_t bucket = 0U;
+    while (bucket + 1U < KOLIBRI_LATENCY_BUCKETS && elapsed_ns > kolibri_latency_bounds_us[bucket] * 1000U) {
+        bucket += 1U;
+    }
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1U, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, elapsed_ns, memory_order_relaxed);
+}
+
+static void stage_record(KolibriStage stage, uint64_t started_ns) {
+    latency_record(&kolibri_stage_latency[stage], monotonic_ns() - started_ns);
 }
 
 static void escape_script_string(const char *input, char *output, size_t out_size) {
@@ -284,32 +618,194 @@ static int parse_port_number(const char *text, int *out) {
     return 0;
 }
 
-static void set_index_timestamp_from_path(const char *path) {
-    if (!path) {
-        kolibri_index_timestamp = time(NULL);
-        return;
+/* host:port через запятую; ошибка в любом адресе отключает рассылку целиком. */
+static int parse_shard_list(const char *value) {
+    kolibri_shard_count = 0U;
+    char copy[1024];
+    strncpy(copy, value, sizeof(copy) - 1U);
+    copy[sizeof(copy) - 1U] = '\0';
+    char *saveptr = NULL;
+    for (char *token = strtok_r(copy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        trim_whitespace(token);
+        if (*token == '\0') {
+            continue;
+        }
+        char *colon = strrchr(token, ':');
+        int port = 0;
+        if (!colon || colon == token || kolibri_shard_count >= KOLIBRI_SHARD_MAX ||
+            parse_port_number(colon + 1, &port) != 0) {
+            kolibri_shard_count = 0U;
+            return -1;
+        }
+        KolibriShardEndpoint *shard = &kolibri_shards[kolibri_shard_count];
+        snprintf(shard->endpoint, sizeof(shard->endpoint), "%s", token);
+        *colon = '\0';
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *resolved = NULL;
+        if (getaddrinfo(token, NULL, &hints, &resolved) != 0 || !resolved) {
+            kolibri_shard_count = 0U;
+            return -1;
+        }
+        memcpy(&shard->addr, resolved->ai_addr, sizeof(shard->addr));
+        shard->addr.sin_port = htons((uint16_t)port);
+        freeaddrinfo(resolved);
+        kolibri_shard_count += 1U;
     }
-    struct stat st;
-    if (stat(path, &st) == 0) {
-        kolibri_index_timestamp = st.st_mtime;
-    } else {
-        kolibri_index_timestamp = time(NULL);
+    return 0;
+}
+
+static int parse_worker_count(const char *text, size_t *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
     }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0') {
+        return -1;
+    }
+    if (value < 1L || value > KOLIBRI_MAX_WORKERS) {
+        return -1;
+    }
+    *out = (size_t)value;
+    return 0;
 }
 
-static int rate_limiter_allow(KolibriRateLimiter *limiter, time_t now, size_t limit) {
-    if (!limiter || limit == 0U) {
-        return 0;
+static int parse_cache_capacity(const char *text, size_t *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
+    }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0' || value < 0L || value > KOLIBRI_SEARCH_CACHE_MAX) {
+        return -1;
+    }
+    *out = (size_t)value;
+    return 0;
+}
+
+static int parse_journal_capacity(const char *text, size_t *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
+    }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0' || value < 2L || value > KOLIBRI_JOURNAL_QUEUE_MAX) {
+        return -1;
+    }
+    size_t capacity = 2U;
+    while (capacity < (size_t)value) {
+        capacity *= 2U;
+    }
+    *out = capacity;
+    return 0;
+}
+
+static int parse_sync_interval(const char *text, uint64_t *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
     }
-    if (limiter->window_start == 0 || now - limiter->window_start >= KOLIBRI_RATE_LIMIT_WINDOW) {
-        limiter->window_start = now;
-        limiter->count = 0U;
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0' || value < 0L || value > 3600000L) {
+        return -1;
+    }
+    *out = (uint64_t)value;
+    return 0;
+}
+
+/* v2 включает и сжатие кадров; формат касается только нового генома. */
+static int parse_genome_format(const char *text, KolibriGenomeOptions *out) {
+    if (!text || !out) {
+        return -1;
     }
-    if (limiter->count >= limit) {
+    if (strcmp(text, "v1") == 0) {
+        out->format = KOLIBRI_GENOME_FORMAT_V1;
+        out->flags = 0U;
         return 0;
     }
-    limiter->count += 1U;
-    return 1;
+    if (strcmp(text, "v2") == 0) {
+        out->format = KOLIBRI_GENOME_FORMAT_V2;
+        out->flags = KOLIBRI_GENOME_COMPRESS;
+        return 0;
+    }
+    return -1;
+}
+
+/* Размер сегмента генома в мебибайтах; 0 — без ротации. */
+static int parse_genome_segment(const char *text, KolibriGenomeOptions *out) {
+    if (!text || !out) {
+        return -1;
+    }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0' || value < 0L || value > 1048576L) {
+        return -1;
+    }
+    out->segment_bytes = (uint64_t)value * 1024U * 1024U;
+    return 0;
+}
+
+static int parse_journal_policy(const char *text, KolibriJournalPolicy *out) {
+    if (!text || !out) {
+        return -1;
+    }
+    if (strcmp(text, "block") == 0) {
+        *out = KOLIBRI_JOURNAL_BLOCK;
+    } else if (strcmp(text, "drop") == 0) {
+        *out = KOLIBRI_JOURNAL_DROP;
+    } else if (strcmp(text, "coalesce") == 0) {
+        *out = KOLIBRI_JOURNAL_COALESCE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static const char *journal_policy_name(KolibriJournalPolicy policy) {
+    switch (policy) {
+    case KOLIBRI_JOURNAL_DROP:
+        return "drop";
+    case KOLIBRI_JOURNAL_COALESCE:
+        return "coalesce";
+    case KOLIBRI_JOURNAL_BLOCK:
+    default:
+        return "block";
+    }
+}
+
+static int parse_keepalive_timeout(const char *text, int *out) {
+    if (!text || !out || *text == '\0') {
+        return -1;
+    }
+    char *endptr = NULL;
+    long value = strtol(text, &endptr, 10);
+    if (!endptr || *endptr != '\0' || value < 0L || value > 600000L) {
+        return -1;
+    }
+    *out = (int)value;
+    return 0;
+}
+
+static size_t default_worker_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1L) {
+        return 1U;
+    }
+    if (cpus > KOLIBRI_DEFAULT_MAX_WORKERS) {
+        cpus = KOLIBRI_DEFAULT_MAX_WORKERS;
+    }
+    return (size_t)cpus;
+}
+
+static time_t timestamp_from_path(const char *path) {
+    struct stat st;
+    if (path && stat(path, &st) == 0) {
+        return st.st_mtime;
+    }
+    return time(NULL);
 }
 
 static void compose_manifest_path(char *buffer, size_t buffer_size, const char *base) {
@@ -340,6 +836,62 @@ static void apply_environment_configuration(void) {
         }
     }
 
+    const char *workers_env = getenv("KOLIBRI_KNOWLEDGE_WORKERS");
+    if (workers_env && *workers_env) {
+        if (parse_worker_count(workers_env, &kolibri_worker_count) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_WORKERS value: %s\n", workers_env);
+        }
+    }
+
+    const char *keepalive_env = getenv("KOLIBRI_KNOWLEDGE_KEEPALIVE_MS");
+    if (keepalive_env && *keepalive_env) {
+        if (parse_keepalive_timeout(keepalive_env, &kolibri_keepalive_timeout_ms) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_KEEPALIVE_MS value: %s\n", keepalive_env);
+        }
+    }
+
+    const char *cache_size_env = getenv("KOLIBRI_KNOWLEDGE_SEARCH_CACHE");
+    if (cache_size_env && *cache_size_env) {
+        if (parse_cache_capacity(cache_size_env, &kolibri_search_cache_capacity) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SEARCH_CACHE value: %s\n", cache_size_env);
+        }
+    }
+
+    const char *journal_queue_env = getenv("KOLIBRI_KNOWLEDGE_JOURNAL_QUEUE");
+    if (journal_queue_env && *journal_queue_env) {
+        if (parse_journal_capacity(journal_queue_env, &kolibri_journal_capacity) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_JOURNAL_QUEUE value: %s\n", journal_queue_env);
+        }
+    }
+
+    const char *journal_policy_env = getenv("KOLIBRI_KNOWLEDGE_JOURNAL_POLICY");
+    if (journal_policy_env && *journal_policy_env) {
+        if (parse_journal_policy(journal_policy_env, &kolibri_journal_policy) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_JOURNAL_POLICY value: %s\n", journal_policy_env);
+        }
+    }
+
+    const char *sync_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_SYNC_MS");
+    if (sync_env && *sync_env) {
+        if (parse_sync_interval(sync_env, &kolibri_genome_sync_ms) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_SYNC_MS value: %s\n", sync_env);
+        }
+    }
+
+    const char *format_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_FORMAT");
+    if (format_env && *format_env) {
+        if (parse_genome_format(format_env, &kolibri_genome_options) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_FORMAT value: %s\n", format_env);
+        }
+    }
+
+    const char *segment_env = getenv("KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_MB");
+    if (segment_env && *segment_env) {
+        if (parse_genome_segment(segment_env, &kolibri_genome_options) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_MB value: %s\n", segment_env);
+        }
+    }
+
     const char *bind_env = getenv("KOLIBRI_KNOWLEDGE_BIND");
     if (bind_env && *bind_env) {
         strncpy(kolibri_bind_address, bind_env, sizeof(kolibri_bind_address) - 1U);
@@ -389,6 +941,22 @@ static void apply_environment_configuration(void) {
         kolibri_swarm_nodes_config[0] = '\0';
     }
 
+    const char *shards_env = getenv("KOLIBRI_KNOWLEDGE_SHARDS");
+    if (shards_env && *shards_env) {
+        if (parse_shard_list(shards_env) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SHARDS value: %s\n", shards_env);
+        }
+    }
+
+    const char *shard_timeout_env = getenv("KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS");
+    if (shard_timeout_env && *shard_timeout_env) {
+        if (parse_keepalive_timeout(shard_timeout_env, &kolibri_shard_timeout_ms) != 0) {
+            fprintf(stderr,
+                    "[kolibri-knowledge] invalid KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS value: %s\n",
+                    shard_timeout_env);
+        }
+    }
+
     const char *swarm_id_env = getenv("KOLIBRI_SWARM_ID");
     if (swarm_id_env && *swarm_id_env) {
         strncpy(kolibri_swarm_node_id, swarm_id_env, sizeof(kolibri_swarm_node_id) - 1U);
@@ -411,6 +979,86 @@ static int apply_cli_arguments(int argc, char **argv) {
             }
             kolibri_server_port = parsed_port;
             i += 1;
+        } else if (strcmp(arg, "--workers") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --workers requires a value\n");
+                return -1;
+            }
+            if (parse_worker_count(argv[i + 1], &kolibri_worker_count) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid worker count: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--keepalive-ms") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --keepalive-ms requires a value\n");
+                return -1;
+            }
+            if (parse_keepalive_timeout(argv[i + 1], &kolibri_keepalive_timeout_ms) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid keep-alive timeout: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--search-cache") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --search-cache requires a value\n");
+                return -1;
+            }
+            if (parse_cache_capacity(argv[i + 1], &kolibri_search_cache_capacity) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid search cache size: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--journal-queue") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --journal-queue requires a value\n");
+                return -1;
+            }
+            if (parse_journal_capacity(argv[i + 1], &kolibri_journal_capacity) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid journal queue size: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--journal-policy") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --journal-policy requires a value\n");
+                return -1;
+            }
+            if (parse_journal_policy(argv[i + 1], &kolibri_journal_policy) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid journal policy: %s (block|drop|coalesce)\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--genome-sync-ms") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-sync-ms requires a value\n");
+                return -1;
+            }
+            if (parse_sync_interval(argv[i + 1], &kolibri_genome_sync_ms) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid genome sync interval: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--genome-format") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-format requires a value\n");
+                return -1;
+            }
+            if (parse_genome_format(argv[i + 1], &kolibri_genome_options) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid genome format: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
+        } else if (strcmp(arg, "--genome-segment-mb") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "[kolibri-knowledge] --genome-segment-mb requires a value\n");
+                return -1;
+            }
+            if (parse_genome_segment(argv[i + 1], &kolibri_genome_options) != 0) {
+                fprintf(stderr, "[kolibri-knowledge] invalid genome segment size: %s\n", argv[i + 1]);
+                return -1;
+            }
+            i += 1;
         } else if (strcmp(arg, "--bind") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "[kolibri-knowledge] --bind requires a value\n");
@@ -467,10 +1115,18 @@ static int apply_cli_arguments(int argc, char **argv) {
             fprintf(stdout,
                     "Usage: %s [--port PORT] [--bind ADDRESS] [--knowledge-dir PATH]\n"
                     "             [--index-json DIR] [--index-cache DIR] [--admin-token TOKEN]\n"
+                    "             [--workers N] [--keepalive-ms MS] [--search-cache ENTRIES]\n"
+                    "             [--journal-queue N] [--journal-policy block|drop|coalesce]\n"
+                    "             [--genome-sync-ms MS] [--genome-format v1|v2]\n"
+                    "             [--genome-segment-mb MB]\n"
                     "       Environment overrides: KOLIBRI_KNOWLEDGE_PORT, KOLIBRI_KNOWLEDGE_BIND,"
                     " KOLIBRI_KNOWLEDGE_DIRS (colon-separated),\n"
                     "         KOLIBRI_KNOWLEDGE_INDEX_JSON, KOLIBRI_KNOWLEDGE_INDEX_CACHE,"
-                    " KOLIBRI_KNOWLEDGE_ADMIN_TOKEN\n",
+                    " KOLIBRI_KNOWLEDGE_ADMIN_TOKEN, KOLIBRI_KNOWLEDGE_WORKERS,\n"
+                    "         KOLIBRI_KNOWLEDGE_KEEPALIVE_MS, KOLIBRI_KNOWLEDGE_SEARCH_CACHE,\n"
+                    "         KOLIBRI_KNOWLEDGE_JOURNAL_QUEUE, KOLIBRI_KNOWLEDGE_JOURNAL_POLICY,\n"
+                    "         KOLIBRI_KNOWLEDGE_GENOME_SYNC_MS, KOLIBRI_KNOWLEDGE_GENOME_FORMAT,\n"
+                    "         KOLIBRI_KNOWLEDGE_GENOME_SEGMENT_MB\n",
                     argv[0]);
             return 1;
         } else {
@@ -494,98 +1150,181 @@ static int ensure_default_directories(void) {
     return 0;
 }
 
-static int load_index_from_cache(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
-        return EINVAL;
+static void index_handle_set_source(KolibriIndexHandle *handle, const char *source) {
+    strncpy(handle->source, source, sizeof(handle->source) - 1U);
+    handle->source[sizeof(handle->source) - 1U] = '\0';
+}
+
+static KolibriIndexHandle *index_handle_create(void) {
+    KolibriIndexHandle *handle = (KolibriIndexHandle *)calloc(1U, sizeof(KolibriIndexHandle));
+    if (handle) {
+        atomic_init(&handle->refs, 1U);
     }
-    *out_index = NULL;
-    if (kolibri_index_json_path[0] != '\0') {
-        int err = kolibri_knowledge_index_load_json(kolibri_index_json_path, out_index);
-        if (err == 0 && *out_index) {
-            strncpy(kolibri_index_source, "prebuilt", sizeof(kolibri_index_source) - 1U);
-            kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-            char manifest_path[512];
-            compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_json_path);
-            if (manifest_path[0] != '\0') {
-                set_index_timestamp_from_path(manifest_path);
-            }
-            return 0;
-        }
-        fprintf(stderr,
-                "[kolibri-knowledge] failed to load index from %s (err=%d)\n",
-                kolibri_index_json_path,
-                err);
+    return handle;
+}
+
+static void index_handle_release(KolibriIndexHandle *handle) {
+    if (handle && atomic_fetch_sub(&handle->refs, 1U) == 1U) {
+        kolibri_knowledge_index_destroy(handle->index);
+        free(handle);
     }
-    if (kolibri_index_cache_dir[0] != '\0') {
-        char manifest_path[512];
-        compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
-        struct stat st;
-        if (manifest_path[0] != '\0' && stat(manifest_path, &st) == 0) {
-            int err = kolibri_knowledge_index_load_json(kolibri_index_cache_dir, out_index);
-            if (err == 0 && *out_index) {
-                strncpy(kolibri_index_source, "cache", sizeof(kolibri_index_source) - 1U);
-                kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-                kolibri_index_timestamp = st.st_mtime;
-                return 0;
-            }
-            fprintf(stderr,
-                    "[kolibri-knowledge] failed to load cached index from %s (err=%d)\n",
-                    kolibri_index_cache_dir,
-                    err);
+}
+
+static KolibriIndexHandle *index_acquire(void) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    pthread_mutex_lock(&publisher->swap_lock);
+    KolibriIndexHandle *handle = publisher->current;
+    if (handle) {
+        atomic_fetch_add(&handle->refs, 1U);
+    }
+    pthread_mutex_unlock(&publisher->swap_lock);
+    return handle;
+}
+
+/* Забирает ссылку на handle (NULL снимает индекс); вызывается под update_lock. */
+static void index_publish(KolibriIndexHandle *handle) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    pthread_mutex_lock(&publisher->swap_lock);
+    KolibriIndexHandle *previous = publisher->current;
+    if (handle) {
+        handle->generation = previous ? previous->generation + 1U : 1U;
+    }
+    publisher->current = handle;
+    pthread_mutex_unlock(&publisher->swap_lock);
+    index_handle_release(previous);
+}
+
+/* index.bin не старше manifest.json загружается через mmap без разбора JSON;
+ * устаревший или повреждённый снимок молча уступает JSON. */
+static int load_index_binary(const char *dir, const char *source, KolibriIndexHandle *out) {
+    char bin_path[512];
+    char manifest_path[512];
+    int written = snprintf(bin_path, sizeof(bin_path), "%s/index.bin", dir);
+    if (written < 0 || (size_t)written >= sizeof(bin_path)) {
+        return ENAMETOOLONG;
+    }
+    struct stat bin_st;
+    if (stat(bin_path, &bin_st) != 0) {
+        return ENOENT;
+    }
+    compose_manifest_path(manifest_path, sizeof(manifest_path), dir);
+    struct stat manifest_st;
+    if (manifest_path[0] != '\0' && stat(manifest_path, &manifest_st) == 0 &&
+        manifest_st.st_mtime > bin_st.st_mtime) {
+        return ESTALE;
+    }
+    int err = kolibri_knowledge_index_load_binary(dir, &out->index);
+    if (err != 0 || !out->index) {
+        fprintf(stderr, "[kolibri-knowledge] failed to map binary index %s (err=%d)\n", bin_path, err);
+        return err != 0 ? err : EINVAL;
+    }
+    index_handle_set_source(out, source);
+    out->timestamp = bin_st.st_mtime;
+    return 0;
+}
+
+static int load_prebuilt_index(KolibriIndexHandle *out) {
+    if (kolibri_index_json_path[0] == '\0') {
+        return ENOENT;
+    }
+    if (load_index_binary(kolibri_index_json_path, "prebuilt", out) == 0) {
+        return 0;
+    }
+    int err = kolibri_knowledge_index_load_json(kolibri_index_json_path, &out->index);
+    if (err == 0 && out->index) {
+        index_handle_set_source(out, "prebuilt");
+        char manifest_path[512];
+        compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_json_path);
+        out->timestamp = timestamp_from_path(manifest_path[0] != '\0' ? manifest_path : NULL);
+        return 0;
+    }
+    fprintf(stderr,
+            "[kolibri-knowledge] failed to load index from %s (err=%d)\n",
+            kolibri_index_json_path,
+            err);
+    return err != 0 ? err : ENOENT;
+}
+
+static int load_cached_index(KolibriIndexHandle *out) {
+    if (kolibri_index_cache_dir[0] == '\0') {
+        return ENOENT;
+    }
+    if (load_index_binary(kolibri_index_cache_dir, "cache", out) == 0) {
+        return 0;
+    }
+    char manifest_path[512];
+    compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
+    struct stat st;
+    if (manifest_path[0] != '\0' && stat(manifest_path, &st) == 0) {
+        int err = kolibri_knowledge_index_load_json(kolibri_index_cache_dir, &out->index);
+        if (err == 0 && out->index) {
+            index_handle_set_source(out, "cache");
+            out->timestamp = st.st_mtime;
+            return 0;
         }
+        fprintf(stderr,
+                "[kolibri-knowledge] failed to load cached index from %s (err=%d)\n",
+                kolibri_index_cache_dir,
+                err);
     }
     return ENOENT;
 }
 
-static int build_index_from_directories(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
-        return EINVAL;
-    }
-    *out_index = NULL;
+static int build_index_from_directories(KolibriIndexHandle *out) {
     if (kolibri_knowledge_directory_count == 0U) {
         return ENOENT;
     }
     int err = kolibri_knowledge_index_create((const char *const *)kolibri_knowledge_directories,
                                              kolibri_knowledge_directory_count,
                                              1024U,
-                                             out_index);
+                                             &out->index);
     if (err != 0) {
         return err;
     }
-    if (*out_index) {
-        strncpy(kolibri_index_source, "directories", sizeof(kolibri_index_source) - 1U);
-        kolibri_index_source[sizeof(kolibri_index_source) - 1U] = '\0';
-        kolibri_index_timestamp = time(NULL);
-        if (kolibri_index_cache_dir[0] != '\0') {
-            ensure_dir_exists(kolibri_index_cache_dir);
-            int write_err = kolibri_knowledge_index_write_json(*out_index, kolibri_index_cache_dir);
-            if (write_err != 0) {
-                fprintf(stderr,
-                        "[kolibri-knowledge] failed to write index cache to %s (err=%d)\n",
-                        kolibri_index_cache_dir,
-                        write_err);
-            } else {
-                char manifest_path[512];
-                compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
-                if (manifest_path[0] != '\0') {
-                    set_index_timestamp_from_path(manifest_path);
-                }
-            }
-        }
+    if (!out->index) {
+        return ENOENT;
     }
+    index_handle_set_source(out, "directories");
+    out->timestamp = time(NULL);
     return 0;
 }
 
-static int load_or_build_index(KolibriKnowledgeIndex **out_index) {
-    if (!out_index) {
-        return EINVAL;
+/* Кэш пишется только для индекса, собранного из каталогов: загруженный снимок уже на диске. */
+static void write_index_cache(KolibriIndexHandle *handle) {
+    if (kolibri_index_cache_dir[0] == '\0' || strcmp(handle->source, "directories") != 0) {
+        return;
+    }
+    ensure_dir_exists(kolibri_index_cache_dir);
+    int write_err = kolibri_knowledge_index_write_json(handle->index, kolibri_index_cache_dir);
+    if (write_err != 0) {
+        fprintf(stderr,
+                "[kolibri-knowledge] failed to write index cache to %s (err=%d)\n",
+                kolibri_index_cache_dir,
+                write_err);
+    } else {
+        char manifest_path[512];
+        compose_manifest_path(manifest_path, sizeof(manifest_path), kolibri_index_cache_dir);
+        if (manifest_path[0] != '\0') {
+            handle->timestamp = timestamp_from_path(manifest_path);
+        }
+    }
+    write_err = kolibri_knowledge_index_write_binary(handle->index, kolibri_index_cache_dir);
+    if (write_err != 0) {
+        fprintf(stderr,
+                "[kolibri-knowledge] failed to write binary index to %s (err=%d)\n",
+                kolibri_index_cache_dir,
+                write_err);
     }
-    *out_index = NULL;
-    int err = load_index_from_cache(out_index);
-    if (err == 0 && *out_index) {
+}
+
+static int load_or_build_index(KolibriIndexHandle *out) {
+    if (load_prebuilt_index(out) == 0 || load_cached_index(out) == 0) {
         return 0;
     }
-    err = build_index_from_directories(out_index);
+    int err = build_index_from_directories(out);
+    if (err == 0) {
+        write_index_cache(out);
+    }
     return err;
 }
 
@@ -660,6 +1399,193 @@ static int load_hmac_key_from_environment(void) {
     return -1;
 }
 
+static int journal_try_push(KolibriJournal *journal, const char *event, const char *encoded) {
+    size_t pos = atomic_load_explicit(&journal->enqueue_pos, memory_order_relaxed);
+    KolibriJournalCell *cell = NULL;
+    for (;;) {
+        cell = &journal->cells[pos & journal->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&journal->enqueue_pos,
+                                                      &pos,
+                                                      pos + 1U,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&journal->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    snprintf(cell->event, sizeof(cell->event), "%s", event);
+    snprintf(cell->payload, sizeof(cell->payload), "%s", encoded);
+    atomic_store_explicit(&cell->sequence, pos + 1U, memory_order_release);
+    return 0;
+}
+
+/* Единственный потребитель, поэтому позиция чтения не требует CAS. */
+static KolibriJournalCell *journal_peek_at(KolibriJournal *journal, size_t offset) {
+    size_t pos = atomic_load_explicit(&journal->dequeue_pos, memory_order_relaxed) + offset;
+    KolibriJournalCell *cell = &journal->cells[pos & journal->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    return sequence == pos + 1U ? cell : NULL;
+}
+
+static KolibriJournalCell *journal_peek(KolibriJournal *journal) {
+    return journal_peek_at(journal, 0U);
+}
+
+static void journal_release(KolibriJournal *journal, size_t count) {
+    size_t pos = atomic_load_explicit(&journal->dequeue_pos, memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+        KolibriJournalCell *cell = &journal->cells[(pos + i) & journal->mask];
+        atomic_store_explicit(&cell->sequence, pos + i + journal->mask + 1U, memory_order_release);
+    }
+    atomic_store_explicit(&journal->dequeue_pos, pos + count, memory_order_relaxed);
+}
+
+static void journal_wake_writer(KolibriJournal *journal) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&journal->writer_sleeping)) {
+        pthread_mutex_lock(&journal->lock);
+        pthread_cond_signal(&journal->wake);
+        pthread_mutex_unlock(&journal->lock);
+    }
+}
+
+static void journal_append(const char *event, const char *encoded) {
+    int rc = kg_append(&kolibri_genome, event, encoded, NULL);
+    if (rc == 0 || rc == KOLIBRI_GENOME_SYNC_FAILED) {
+        atomic_fetch_add(&kolibri_journal_written, 1U);
+    }
+}
+
+/* События, не поместившиеся в очередь в режиме coalesce, сводятся в одну запись. */
+static void journal_flush_coalesced(void) {
+    size_t pending = atomic_exchange(&kolibri_journal_coalesce_pending, 0U);
+    if (pending == 0U) {
+        return;
+    }
+    char payload[KOLIBRI_PAYLOAD_SIZE];
+    snprintf(payload, sizeof(payload), "events=%zu", pending);
+    journal_append("COALESCED", payload);
+}
+
+static void *journal_writer(void *arg) {
+    KolibriJournal *journal = (KolibriJournal *)arg;
+    for (;;) {
+        /* Всё накопленное уходит в геном одной групповой записью. */
+        KolibriGenomeEvent batch[KOLIBRI_JOURNAL_BATCH];
+        size_t batch_count = 0U;
+        KolibriJournalCell *cell = NULL;
+        while (batch_count < KOLIBRI_JOURNAL_BATCH && (cell = journal_peek_at(journal, batch_count)) != NULL) {
+            batch[batch_count].event_type = cell->event;
+            batch[batch_count].payload = cell->payload;
+            batch_count += 1U;
+        }
+        if (batch_count > 0U) {
+            KOLIBRI_TRACE_BEGIN(span, "journal.write");
+            int rc = kg_append_batch(&kolibri_genome, batch, batch_count, NULL);
+            KOLIBRI_TRACE_END(span);
+            /* После сбоя fdatasync блоки уже в цепочке: повтор записал бы их дважды. */
+            if (rc == 0 || rc == KOLIBRI_GENOME_SYNC_FAILED) {
+                atomic_fetch_add(&kolibri_journal_written, batch_count);
+            } else {
+                for (size_t i = 0; i < batch_count; ++i) {
+                    journal_append(batch[i].event_type, batch[i].payload);
+                }
+            }
+            journal_release(journal, batch_count);
+            continue;
+        }
+        journal_flush_coalesced();
+        if (atomic_load(&journal->stopping)) {
+            break;
+        }
+        pthread_mutex_lock(&journal->lock);
+        atomic_store(&journal->writer_sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!journal_peek(journal) && !atomic_load(&journal->stopping)) {
+            /* Тайм-аут страхует от пропущенного пробуждения. */
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 100L * 1000L * 1000L;
+            if (deadline.tv_nsec >= 1000L * 1000L * 1000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000L * 1000L * 1000L;
+            }
+            pthread_cond_timedwait(&journal->wake, &journal->lock, &deadline);
+        }
+        atomic_store(&journal->writer_sleeping, 0);
+        pthread_mutex_unlock(&journal->lock);
+    }
+    return NULL;
+}
+
+/* Геном пишет только поток журнала, поэтому без него сервер не стартует. */
+static int journal_start(void) {
+    KolibriJournal *journal = &kolibri_journal;
+    journal->cells = (KolibriJournalCell *)malloc(kolibri_journal_capacity * sizeof(KolibriJournalCell));
+    if (!journal->cells) {
+        fprintf(stderr, "[kolibri-knowledge] journal queue allocation failed\n");
+        return -1;
+    }
+    for (size_t i = 0; i < kolibri_journal_capacity; ++i) {
+        atomic_init(&journal->cells[i].sequence, i);
+    }
+    journal->mask = kolibri_journal_capacity - 1U;
+    atomic_store(&journal->enqueue_pos, 0U);
+    atomic_store(&journal->dequeue_pos, 0U);
+    atomic_store(&journal->stopping, 0);
+
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int rc = pthread_create(&journal->thread, NULL, journal_writer, journal);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (rc != 0) {
+        fprintf(stderr, "[kolibri-knowledge] journal writer failed to start\n");
+        free(journal->cells);
+        journal->cells = NULL;
+        return -1;
+    }
+    journal->running = 1;
+    return 0;
+}
+
+/* Дописывает все принятые события и останавливает поток записи. */
+static void journal_stop(void) {
+    KolibriJournal *journal = &kolibri_journal;
+    if (!journal->running) {
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    atomic_store(&journal->stopping, 1);
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->thread, NULL);
+    journal->running = 0;
+    free(journal->cells);
+    journal->cells = NULL;
+}
+
+static size_t journal_depth(void) {
+    KolibriJournal *journal = &kolibri_journal;
+    if (!journal->running) {
+        return 0U;
+    }
+    size_t head = atomic_load(&journal->enqueue_pos);
+    size_t tail = atomic_load(&journal->dequeue_pos);
+    return head >= tail ? head - tail : 0U;
+}
+
 static int kolibri_genome_init_or_open(void) {
     if (load_hmac_key_from_environment() != 0) {
         fprintf(stderr,
@@ -668,14 +1594,21 @@ static int kolibri_genome_init_or_open(void) {
     }
 
     ensure_dir_exists(".kolibri");
-    if (kg_open(&kolibri_genome, KOLIBRI_KNOWLEDGE_GENOME, kolibri_hmac_key, kolibri_hmac_key_len) == 0) {
+    if (kg_open_with(&kolibri_genome, KOLIBRI_KNOWLEDGE_GENOME, kolibri_hmac_key, kolibri_hmac_key_len,
+                     &kolibri_genome_options) == 0) {
         kolibri_genome_ready = 1;
+        kg_set_sync_interval(&kolibri_genome, kolibri_genome_sync_ms);
         char payload[KOLIBRI_PAYLOAD_SIZE];
         snprintf(payload, sizeof(payload), "knowledge_server стартовал (ключ: %s)", kolibri_hmac_key_origin);
         char encoded[KOLIBRI_PAYLOAD_SIZE];
         if (kg_encode_payload(payload, encoded, sizeof(encoded)) == 0) {
             kg_append(&kolibri_genome, "BOOT", encoded, NULL);
         }
+        if (journal_start() != 0) {
+            kg_close(&kolibri_genome);
+            kolibri_genome_ready = 0;
+            return -1;
+        }
         return 0;
     }
 
@@ -686,12 +1619,14 @@ static int kolibri_genome_init_or_open(void) {
 
 static void kolibri_genome_close(void) {
     if (kolibri_genome_ready) {
+        journal_stop();
         kg_close(&kolibri_genome);
         kolibri_genome_ready = 0;
     }
 }
 
-static void knowledge_record_event(const char *event, const char *payload) {
+/* Ставит событие в очередь, не будя писателя: пакет событий будит его один раз. */
+static void journal_enqueue(const char *event, const char *payload) {
     if (!kolibri_genome_ready || !event || !payload) {
         return;
     }
@@ -699,7 +1634,38 @@ static void knowledge_record_event(const char *event, const char *payload) {
     if (kg_encode_payload(payload, encoded, sizeof(encoded)) != 0) {
         return;
     }
-    kg_append(&kolibri_genome, event, encoded, NULL);
+    KolibriJournal *journal = &kolibri_journal;
+    if (!journal->running) {
+        /* Писатель уже остановлен: kg_append из рабочих потоков гонялся бы друг с другом. */
+        return;
+    }
+    while (journal_try_push(journal, event, encoded) != 0) {
+        if (kolibri_journal_policy == KOLIBRI_JOURNAL_DROP) {
+            atomic_fetch_add(&kolibri_journal_dropped, 1U);
+            return;
+        }
+        if (kolibri_journal_policy == KOLIBRI_JOURNAL_COALESCE) {
+            atomic_fetch_add(&kolibri_journal_coalesced, 1U);
+            atomic_fetch_add(&kolibri_journal_coalesce_pending, 1U);
+            return;
+        }
+        journal_wake_writer(journal);
+        struct timespec pause = { 0, 50L * 1000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+static void journal_record(const char *event, const char *payload) {
+    journal_enqueue(event, payload);
+    if (kolibri_journal.running) {
+        journal_wake_writer(&kolibri_journal);
+    }
+}
+
+static void knowledge_record_event(const char *event, const char *payload) {
+    KOLIBRI_TRACE_BEGIN(span, "journal.enqueue");
+    journal_record(event, payload);
+    KOLIBRI_TRACE_END(span);
 }
 
 static void write_bootstrap_script(const KolibriKnowledgeIndex *index, const char *path) {
@@ -744,483 +1710,2126 @@ static void write_bootstrap_script(const KolibriKnowledgeIndex *index, const cha
     kolibri_bootstrap_timestamp = time(NULL);
 }
 
-static int starts_with(const char *text, const char *prefix) {
-    if (!text || !prefix) {
-        return 0;
-    }
-    while (*prefix) {
-        if (*text++ != *prefix++) {
-            return 0;
-        }
+static void cached_body_release(KolibriCachedBody *body) {
+    if (body && atomic_fetch_sub(&body->refs, 1U) == 1U) {
+        free(body);
     }
-    return 1;
 }
 
-static int extract_header_value(const char *headers,
-                                size_t header_len,
-                                const char *name,
-                                char *output,
-                                size_t output_size) {
-    if (!headers || !name || !output || output_size == 0U) {
-        return -1;
-    }
-    size_t name_len = strlen(name);
-    const char *cursor = headers;
-    const char *end = headers + header_len;
-    while (cursor < end) {
-        const char *line_end = strstr(cursor, "\r\n");
-        size_t line_len = line_end ? (size_t)(line_end - cursor) : (size_t)(end - cursor);
-        if (line_len >= name_len + 1U && strncasecmp(cursor, name, name_len) == 0 && cursor[name_len] == ':') {
-            const char *value_start = cursor + name_len + 1U;
-            while (value_start < cursor + line_len && (*value_start == ' ' || *value_start == '\t')) {
-                value_start++;
-            }
-            size_t value_len = cursor + line_len - value_start;
-            if (value_len >= output_size) {
-                value_len = output_size - 1U;
-            }
-            memcpy(output, value_start, value_len);
-            output[value_len] = '\0';
-            return 0;
-        }
-        if (!line_end) {
-            break;
-        }
-        cursor = line_end + 2;
+static KolibriCachedBody *cached_body_create(const char *data,
+                                             size_t length,
+                                             const size_t *docs,
+                                             size_t doc_count,
+                                             uint64_t generation,
+                                             uint64_t epoch) {
+    KolibriCachedBody *body = (KolibriCachedBody *)malloc(sizeof(KolibriCachedBody) + length + 1U);
+    if (!body) {
+        return NULL;
     }
-    return -1;
+    atomic_init(&body->refs, 1U);
+    body->generation = generation;
+    body->epoch = epoch;
+    body->doc_count = doc_count < KOLIBRI_SEARCH_REPLAY_DOCS ? doc_count : KOLIBRI_SEARCH_REPLAY_DOCS;
+    for (size_t i = 0; i < body->doc_count; ++i) {
+        body->docs[i] = docs[i];
+    }
+    body->length = length;
+    memcpy(body->data, data, length);
+    body->data[length] = '\0';
+    return body;
 }
 
-static size_t parse_content_length_header(const char *headers, size_t header_len, int *has_header) {
-    char value[32];
-    if (extract_header_value(headers, header_len, "Content-Length", value, sizeof(value)) == 0) {
-        char *endptr = NULL;
-        unsigned long long parsed = strtoull(value, &endptr, 10);
-        if (!endptr || *endptr != '\0') {
-            if (has_header) {
-                *has_header = 1;
+/* Ключ кэша: запрос в нижнем регистре ASCII со схлопнутыми пробелами, limit
+ * и флаги поиска. */
+static int search_cache_key(const char *query, size_t limit, unsigned flags, char *out, size_t out_size) {
+    size_t len = 0U;
+    int pending_space = 0;
+    for (const unsigned char *cursor = (const unsigned char *)query; *cursor; ++cursor) {
+        if (isspace(*cursor)) {
+            pending_space = len > 0U;
+            continue;
+        }
+        if (pending_space) {
+            if (len + 1U >= out_size) {
+                return -1;
             }
-            return 0U;
+            out[len++] = ' ';
+            pending_space = 0;
         }
-        if (has_header) {
-            *has_header = 1;
+        if (len + 1U >= out_size) {
+            return -1;
         }
-        return (size_t)parsed;
+        out[len++] = (char)tolower(*cursor);
     }
-    if (has_header) {
-        *has_header = 0;
+    int written = snprintf(out + len, out_size - len, "\x1f%zu\x1f%u", limit, flags);
+    if (written < 0 || (size_t)written >= out_size - len) {
+        return -1;
     }
-    return 0U;
+    return 0;
 }
 
-static void url_decode(char *text) {
-    char *src = text;
-    char *dst = text;
-    while (*src) {
-        if (*src == '%' && src[1] && src[2]) {
-            char buf[3] = { src[1], src[2], '\0' };
-            *dst++ = (char)strtol(buf, NULL, 16);
-            src += 3;
-        } else if (*src == '+') {
-            *dst++ = ' ';
-            ++src;
-        } else {
-            *dst++ = *src++;
-        }
+static uint64_t search_cache_hash(const char *key) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *cursor = (const unsigned char *)key; *cursor; ++cursor) {
+        hash ^= (uint64_t)*cursor;
+        hash *= 1099511628211ULL;
     }
-    *dst = '\0';
+    return hash;
 }
 
-static void parse_query(const char *path, char *query_buffer, size_t query_size, size_t *limit_out) {
-    query_buffer[0] = '\0';
-    if (limit_out) {
-        *limit_out = 3U;
+static void search_cache_init(size_t capacity) {
+    KolibriSearchCache *cache = &kolibri_search_cache;
+    if (capacity == 0U) {
+        return;
     }
-    const char *question_mark = strchr(path, '?');
-    if (!question_mark) {
+    cache->entries = (KolibriSearchCacheEntry *)calloc(capacity, sizeof(KolibriSearchCacheEntry));
+    size_t bucket_count = 16U;
+    while (bucket_count < capacity * 2U) {
+        bucket_count *= 2U;
+    }
+    cache->buckets = (size_t *)malloc(bucket_count * sizeof(size_t));
+    if (!cache->entries || !cache->buckets) {
+        free(cache->entries);
+        free(cache->buckets);
+        cache->entries = NULL;
+        cache->buckets = NULL;
+        fprintf(stderr, "[kolibri-knowledge] search cache disabled: allocation failed\n");
         return;
     }
-    const char *params = question_mark + 1;
-    char temp[1024];
-    strncpy(temp, params, sizeof(temp) - 1U);
-    temp[sizeof(temp) - 1U] = '\0';
-    char *token = strtok(temp, "&");
-    while (token) {
-        if (starts_with(token, "q=")) {
-            strncpy(query_buffer, token + 2, query_size - 1U);
-            query_buffer[query_size - 1U] = '\0';
-            url_decode(query_buffer);
-        } else if (starts_with(token, "limit=")) {
-            int value = atoi(token + 6);
-            if (value > 0 && limit_out) {
-                *limit_out = (size_t)value;
-            }
-        }
-        token = strtok(NULL, "&");
+    for (size_t i = 0; i < bucket_count; ++i) {
+        cache->buckets[i] = KOLIBRI_CACHE_NONE;
     }
+    cache->capacity = capacity;
+    cache->bucket_count = bucket_count;
+    cache->used = 0U;
+    cache->lru_head = KOLIBRI_CACHE_NONE;
+    cache->lru_tail = KOLIBRI_CACHE_NONE;
 }
 
-static void parse_form_field(const char *payload, const char *key, char *output, size_t output_size) {
-    if (!output || output_size == 0U) {
-        return;
-    }
-    output[0] = '\0';
-    if (!payload || !key) {
-        return;
+static void search_cache_lru_unlink(KolibriSearchCache *cache, size_t slot) {
+    KolibriSearchCacheEntry *entry = &cache->entries[slot];
+    if (entry->lru_prev != KOLIBRI_CACHE_NONE) {
+        cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
     }
-    size_t key_len = strlen(key);
-    const char *cursor = payload;
-    while (*cursor) {
-        const char *amp = strchr(cursor, '&');
-        size_t segment_len = amp ? (size_t)(amp - cursor) : strlen(cursor);
-        if (segment_len >= key_len + 1U && strncmp(cursor, key, key_len) == 0 && cursor[key_len] == '=') {
-            size_t copy_len = segment_len - key_len - 1U;
-            if (copy_len >= output_size) {
-                copy_len = output_size - 1U;
-            }
-            memcpy(output, cursor + key_len + 1U, copy_len);
-            output[copy_len] = '\0';
-            url_decode(output);
-            return;
-        }
-        if (!amp) {
-            break;
-        }
-        cursor = amp + 1;
+    if (entry->lru_next != KOLIBRI_CACHE_NONE) {
+        cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
     }
 }
 
-static int require_admin_token(const char *headers, size_t header_len) {
-    if (kolibri_admin_token[0] == '\0') {
-        return 503;
-    }
-    char auth_value[256];
-    if (extract_header_value(headers, header_len, "Authorization", auth_value, sizeof(auth_value)) != 0) {
-        return 401;
-    }
-    const char *prefix = "Bearer ";
-    size_t prefix_len = strlen(prefix);
-    if (strncasecmp(auth_value, prefix, prefix_len) != 0) {
-        return 401;
-    }
-    const char *token = auth_value + prefix_len;
-    while (*token == ' ') {
-        token++;
+static void search_cache_lru_push_front(KolibriSearchCache *cache, size_t slot) {
+    KolibriSearchCacheEntry *entry = &cache->entries[slot];
+    entry->lru_prev = KOLIBRI_CACHE_NONE;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head != KOLIBRI_CACHE_NONE) {
+        cache->entries[cache->lru_head].lru_prev = slot;
     }
-    if (strcmp(token, kolibri_admin_token) != 0) {
-        return 403;
+    cache->lru_head = slot;
+    if (cache->lru_tail == KOLIBRI_CACHE_NONE) {
+        cache->lru_tail = slot;
     }
-    return 0;
 }
 
-static ssize_t receive_http_request(int fd,
-                                    char *buffer,
-                                    size_t buffer_size,
-                                    size_t *header_len_out,
-                                    size_t *content_len_out) {
-    if (!buffer || buffer_size == 0U) {
-        return -1;
-    }
-    size_t total = 0U;
-    size_t header_len = 0U;
-    size_t content_length = 0U;
-    int content_length_present = 0;
-    while (total < buffer_size - 1U) {
-        ssize_t received = recv(fd, buffer + total, buffer_size - 1U - total, 0);
-        if (received < 0) {
-            if (errno == EWOULDBLOCK || errno == EAGAIN) {
-                return -2;
-            }
-            return -1;
-        }
-        if (received == 0) {
-            break;
-        }
-        total += (size_t)received;
-        buffer[total] = '\0';
-        if (header_len == 0U) {
-            char *marker = strstr(buffer, "\r\n\r\n");
-            if (marker) {
-                header_len = (size_t)(marker - buffer) + 4U;
-                content_length = parse_content_length_header(buffer, header_len, &content_length_present);
-                if (content_length > KOLIBRI_MAX_CONTENT_LENGTH) {
-                    return -3;
-                }
-                if (total >= header_len + content_length) {
-                    break;
-                }
-            }
-        } else if (total >= header_len + content_length) {
-            break;
+static size_t search_cache_find_locked(KolibriSearchCache *cache, const char *key, uint64_t hash) {
+    size_t slot = cache->buckets[hash & (cache->bucket_count - 1U)];
+    while (slot != KOLIBRI_CACHE_NONE) {
+        KolibriSearchCacheEntry *entry = &cache->entries[slot];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            return slot;
         }
+        slot = entry->bucket_next;
     }
-    if (header_len == 0U) {
-        return -4;
+    return KOLIBRI_CACHE_NONE;
+}
+
+static void search_cache_bucket_remove(KolibriSearchCache *cache, size_t slot) {
+    size_t *link = &cache->buckets[cache->entries[slot].hash & (cache->bucket_count - 1U)];
+    while (*link != KOLIBRI_CACHE_NONE) {
+        if (*link == slot) {
+            *link = cache->entries[slot].bucket_next;
+            return;
+        }
+        link = &cache->entries[*link].bucket_next;
     }
-    if (total >= buffer_size - 1U) {
-        return -5;
+}
+
+/* Возвращает тело с захваченной ссылкой; вызывающий освобождает cached_body_release. */
+static KolibriCachedBody *search_cache_lookup(const char *key, uint64_t generation) {
+    KolibriSearchCache *cache = &kolibri_search_cache;
+    if (cache->capacity == 0U) {
+        return NULL;
     }
-    if (total < header_len + content_length) {
-        return -6;
+    uint64_t hash = search_cache_hash(key);
+    KolibriCachedBody *body = NULL;
+    pthread_mutex_lock(&cache->lock);
+    size_t slot = search_cache_find_locked(cache, key, hash);
+    if (slot != KOLIBRI_CACHE_NONE && cache->entries[slot].body->generation == generation &&
+        cache->entries[slot].body->epoch == atomic_load(&kolibri_index_epoch)) {
+        body = cache->entries[slot].body;
+        atomic_fetch_add(&body->refs, 1U);
+        search_cache_lru_unlink(cache, slot);
+        search_cache_lru_push_front(cache, slot);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    atomic_fetch_add(body ? &kolibri_search_cache_hits : &kolibri_search_cache_misses, 1U);
+    return body;
+}
+
+/* Забирает ссылку на body. */
+static void search_cache_store(const char *key, KolibriCachedBody *body) {
+    KolibriSearchCache *cache = &kolibri_search_cache;
+    if (cache->capacity == 0U || !body) {
+        cached_body_release(body);
+        return;
     }
-    (void)content_length_present;
-    buffer[total] = '\0';
-    if (header_len_out) {
-        *header_len_out = header_len;
+    char *key_copy = strdup(key);
+    if (!key_copy) {
+        cached_body_release(body);
+        return;
     }
-    if (content_len_out) {
-        *content_len_out = content_length;
+    uint64_t hash = search_cache_hash(key);
+    KolibriCachedBody *evicted = NULL;
+    char *evicted_key = NULL;
+    pthread_mutex_lock(&cache->lock);
+    /* Эпоха сменилась после начала поиска: кэш уже сброшен, тело устарело. */
+    if (body->epoch != atomic_load(&kolibri_index_epoch)) {
+        pthread_mutex_unlock(&cache->lock);
+        free(key_copy);
+        cached_body_release(body);
+        return;
     }
-    return (ssize_t)total;
+    size_t slot = search_cache_find_locked(cache, key, hash);
+    if (slot != KOLIBRI_CACHE_NONE) {
+        evicted = cache->entries[slot].body;
+        cache->entries[slot].body = body;
+        search_cache_lru_unlink(cache, slot);
+        search_cache_lru_push_front(cache, slot);
+        evicted_key = key_copy;
+    } else {
+        if (cache->used < cache->capacity) {
+            slot = cache->used++;
+        } else {
+            slot = cache->lru_tail;
+            search_cache_lru_unlink(cache, slot);
+            search_cache_bucket_remove(cache, slot);
+            evicted = cache->entries[slot].body;
+            evicted_key = cache->entries[slot].key;
+        }
+        KolibriSearchCacheEntry *entry = &cache->entries[slot];
+        entry->key = key_copy;
+        entry->hash = hash;
+        entry->body = body;
+        size_t bucket = hash & (cache->bucket_count - 1U);
+        entry->bucket_next = cache->buckets[bucket];
+        cache->buckets[bucket] = slot;
+        search_cache_lru_push_front(cache, slot);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    free(evicted_key);
+    cached_body_release(evicted);
 }
 
-static int format_iso8601_utc(time_t value, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
-        return -1;
-    }
-    if (value <= 0) {
-        output[0] = '\0';
-        return -1;
+/* Сбрасывает кэш; вызывается при каждой смене индекса. */
+static void search_cache_invalidate(void) {
+    KolibriSearchCache *cache = &kolibri_search_cache;
+    if (cache->capacity == 0U) {
+        return;
     }
-    struct tm tm_value;
-    if (!gmtime_r(&value, &tm_value)) {
-        output[0] = '\0';
-        return -1;
+    pthread_mutex_lock(&cache->lock);
+    for (size_t i = 0; i < cache->used; ++i) {
+        free(cache->entries[i].key);
+        cached_body_release(cache->entries[i].body);
+        cache->entries[i].key = NULL;
+        cache->entries[i].body = NULL;
     }
-    if (strftime(output, out_size, "%Y-%m-%dT%H:%M:%SZ", &tm_value) == 0) {
-        output[0] = '\0';
-        return -1;
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        cache->buckets[i] = KOLIBRI_CACHE_NONE;
     }
+    cache->used = 0U;
+    cache->lru_head = KOLIBRI_CACHE_NONE;
+    cache->lru_tail = KOLIBRI_CACHE_NONE;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Содержимое индекса изменилось: новая эпоха, затем сброс кэша. */
+static void index_content_changed(void) {
+    atomic_fetch_add(&kolibri_index_epoch, 1U);
+    search_cache_invalidate();
+}
+
+static size_t search_cache_size(void) {
+    KolibriSearchCache *cache = &kolibri_search_cache;
+    if (cache->capacity == 0U) {
+        return 0U;
+    }
+    pthread_mutex_lock(&cache->lock);
+    size_t used = cache->used;
+    pthread_mutex_unlock(&cache->lock);
+    return used;
+}
+
+static void search_cache_free(void) {
+    search_cache_invalidate();
+    free(kolibri_search_cache.entries);
+    free(kolibri_search_cache.buckets);
+    kolibri_search_cache.entries = NULL;
+    kolibri_search_cache.buckets = NULL;
+    kolibri_search_cache.capacity = 0U;
+}
+
+/* Снимок в кэше сохраняет документы, добавленные через teach, между перезапусками. */
+static void segment_merge_now(KolibriIndexHandle *handle) {
+    if (kolibri_knowledge_index_merge(handle->index) == 0U) {
+        return;
+    }
+    index_content_changed();
+    if (kolibri_index_cache_dir[0] != '\0') {
+        /* Снимок уже подменённого индекса не должен затереть снимок нового. */
+        pthread_mutex_lock(&kolibri_publisher.update_lock);
+        if (kolibri_publisher.current == handle) {
+            int err = kolibri_knowledge_index_write_binary(handle->index, kolibri_index_cache_dir);
+            if (err != 0) {
+                fprintf(stderr,
+                        "[kolibri-knowledge] failed to write binary index to %s (err=%d)\n",
+                        kolibri_index_cache_dir,
+                        err);
+            }
+        }
+        pthread_mutex_unlock(&kolibri_publisher.update_lock);
+    }
+}
+
+static void *segment_merger(void *arg) {
+    KolibriSegmentMerger *merger = (KolibriSegmentMerger *)arg;
+    pthread_mutex_lock(&merger->lock);
+    while (!merger->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += KOLIBRI_SEGMENT_MERGE_MS / 1000;
+        deadline.tv_nsec += (long)(KOLIBRI_SEGMENT_MERGE_MS % 1000) * 1000L * 1000L;
+        if (deadline.tv_nsec >= 1000L * 1000L * 1000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000L * 1000L * 1000L;
+        }
+        pthread_cond_timedwait(&merger->wake, &merger->lock, &deadline);
+        if (merger->stopping) {
+            continue;
+        }
+        KolibriIndexHandle *handle = index_acquire();
+        if (handle && kolibri_knowledge_index_pending_count(handle->index) > 0U) {
+            pthread_mutex_unlock(&merger->lock);
+            segment_merge_now(handle);
+            pthread_mutex_lock(&merger->lock);
+        }
+        index_handle_release(handle);
+    }
+    pthread_mutex_unlock(&merger->lock);
+    return NULL;
+}
+
+/* Служебные потоки не должны перехватывать сигналы, которые ждёт accept-цикл. */
+static int start_service_thread(pthread_t *thread, void *(*routine)(void *), void *arg) {
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    int rc = pthread_create(thread, NULL, routine, arg);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    return rc;
+}
+
+static void segment_merger_start(void) {
+    KolibriSegmentMerger *merger = &kolibri_merger;
+    merger->stopping = 0;
+    if (start_service_thread(&merger->thread, segment_merger, merger) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] segment merger failed to start, merging on teach\n");
+        return;
+    }
+    merger->running = 1;
+}
+
+/* Будит слияние, когда живой сегмент заполнен; без потока сливает сразу. */
+static void segment_merger_notify(KolibriIndexHandle *handle) {
+    KolibriSegmentMerger *merger = &kolibri_merger;
+    if (kolibri_knowledge_index_pending_count(handle->index) < KOLIBRI_SEGMENT_MERGE_DOCS) {
+        return;
+    }
+    if (!merger->running) {
+        segment_merge_now(handle);
+        return;
+    }
+    pthread_mutex_lock(&merger->lock);
+    pthread_cond_signal(&merger->wake);
+    pthread_mutex_unlock(&merger->lock);
+}
+
+static void segment_merger_stop(void) {
+    KolibriSegmentMerger *merger = &kolibri_merger;
+    if (merger->running) {
+        pthread_mutex_lock(&merger->lock);
+        merger->stopping = 1;
+        pthread_cond_signal(&merger->wake);
+        pthread_mutex_unlock(&merger->lock);
+        pthread_join(merger->thread, NULL);
+        merger->running = 0;
+    }
+    KolibriIndexHandle *handle = index_acquire();
+    if (handle) {
+        segment_merge_now(handle);
+        index_handle_release(handle);
+    }
+}
+
+/* Документы teach есть только в живом сегменте и в снимке кэша, поэтому при
+ * перезагрузке они переносятся в новый индекс. */
+static size_t carry_taught_documents(const KolibriKnowledgeIndex *from, KolibriKnowledgeIndex *to) {
+    size_t carried = 0U;
+    size_t count = kolibri_knowledge_index_document_count(from);
+    for (size_t i = 0; i < count; ++i) {
+        const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(from, i);
+        if (!doc || !doc->source || strcmp(doc->source, "teach") != 0) {
+            continue;
+        }
+        if (kolibri_knowledge_index_add_document(to, doc->id, doc->title, "teach", doc->content, NULL) == 0) {
+            carried += 1U;
+        }
+    }
+    return carried;
+}
+
+/* Новый индекс собирается без блокировок; под update_lock остаются только перенос
+ * teach-документов, запись кэша и подмена указателя. */
+static int index_reload_now(void) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    KolibriIndexHandle *fresh = index_handle_create();
+    if (!fresh) {
+        atomic_fetch_add(&publisher->failures, 1U);
+        return ENOMEM;
+    }
+    int err = load_prebuilt_index(fresh);
+    if (err != 0) {
+        err = build_index_from_directories(fresh);
+    }
+    if (err != 0 || !fresh->index) {
+        fprintf(stderr, "[kolibri-knowledge] index reload failed (err=%d), keeping current index\n", err);
+        index_handle_release(fresh);
+        atomic_fetch_add(&publisher->failures, 1U);
+        return err != 0 ? err : ENOENT;
+    }
+    pthread_mutex_lock(&publisher->update_lock);
+    KolibriIndexHandle *previous = index_acquire();
+    size_t carried = 0U;
+    if (previous) {
+        carried = carry_taught_documents(previous->index, fresh->index);
+        index_handle_release(previous);
+    }
+    kolibri_knowledge_index_merge(fresh->index);
+    write_index_cache(fresh);
+    size_t document_count = kolibri_knowledge_index_document_count(fresh->index);
+    index_publish(fresh);
+    pthread_mutex_unlock(&publisher->update_lock);
+    index_content_changed();
+    atomic_fetch_add(&publisher->reloads, 1U);
+    fprintf(stdout,
+            "[kolibri-knowledge] reloaded %zu documents (%s, %zu taught carried over)\n",
+            document_count,
+            fresh->source,
+            carried);
+    fflush(stdout);
     return 0;
 }
 
-static void send_response(int client_fd, int status_code, const char *content_type, const char *body) {
-    char header[256];
-    int header_len = snprintf(header, sizeof(header),
-                              "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
-                              status_code,
-                              status_code == 200 ? "OK" : "Error",
-                              content_type,
-                              body ? strlen(body) : 0U);
-    if (header_len > 0) {
-        send(client_fd, header, (size_t)header_len, 0);
+static void *index_reloader(void *arg) {
+    KolibriIndexPublisher *publisher = (KolibriIndexPublisher *)arg;
+    pthread_mutex_lock(&publisher->lock);
+    while (!publisher->stopping) {
+        if (!publisher->requested) {
+            pthread_cond_wait(&publisher->wake, &publisher->lock);
+            continue;
+        }
+        publisher->requested = 0;
+        pthread_mutex_unlock(&publisher->lock);
+        index_reload_now();
+        pthread_mutex_lock(&publisher->lock);
+    }
+    pthread_mutex_unlock(&publisher->lock);
+    return NULL;
+}
+
+static void index_reloader_start(void) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    publisher->stopping = 0;
+    if (start_service_thread(&publisher->thread, index_reloader, publisher) != 0) {
+        fprintf(stderr, "[kolibri-knowledge] index reloader failed to start, reload disabled\n");
+        return;
     }
-    if (body && *body) {
-        send(client_fd, body, strlen(body), 0);
+    publisher->running = 1;
+}
+
+/* Повторные запросы во время сборки схлопываются в одну следующую перезагрузку. */
+static int index_reload_request(void) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    if (!publisher->running) {
+        return -1;
     }
+    pthread_mutex_lock(&publisher->lock);
+    publisher->requested = 1;
+    pthread_cond_signal(&publisher->wake);
+    pthread_mutex_unlock(&publisher->lock);
+    return 0;
 }
 
-static size_t json_escape_char(char ch, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
+static void index_reloader_stop(void) {
+    KolibriIndexPublisher *publisher = &kolibri_publisher;
+    if (!publisher->running) {
+        return;
+    }
+    pthread_mutex_lock(&publisher->lock);
+    publisher->stopping = 1;
+    pthread_cond_signal(&publisher->wake);
+    pthread_mutex_unlock(&publisher->lock);
+    pthread_join(publisher->thread, NULL);
+    publisher->running = 0;
+}
+
+static int starts_with(const char *text, const char *prefix) {
+    if (!text || !prefix) {
         return 0;
     }
-    switch (ch) {
-    case '"':
-    case '\\':
-        if (out_size >= 2) {
-            output[0] = '\\';
-            output[1] = ch;
-            return 2;
+    while (*prefix) {
+        if (*text++ != *prefix++) {
+            return 0;
         }
-        return 0;
-    case '\n':
-        if (out_size >= 2) {
-            output[0] = '\\';
-            output[1] = 'n';
-            return 2;
+    }
+    return 1;
+}
+
+static int slice_equals_ci(KolibriSlice slice, const char *text) {
+    size_t text_len = strlen(text);
+    return slice.length == text_len && strncasecmp(slice.data, text, text_len) == 0;
+}
+
+/* Заголовки уже разложены парсером, поэтому поиск идёт по массиву, а не по тексту. */
+static const KolibriSlice *http_request_header(const KolibriHttpRequest *request, const char *name) {
+    for (size_t i = 0; i < request->header_count; ++i) {
+        if (slice_equals_ci(request->headers[i].name, name)) {
+            return &request->headers[i].value;
         }
-        return 0;
-    case '\r':
-        if (out_size >= 2) {
-            output[0] = '\\';
-            output[1] = 'r';
-            return 2;
+    }
+    return NULL;
+}
+
+static void url_decode(char *text) {
+    char *src = text;
+    char *dst = text;
+    while (*src) {
+        if (*src == '%' && src[1] && src[2]) {
+            char buf[3] = { src[1], src[2], '\0' };
+            *dst++ = (char)strtol(buf, NULL, 16);
+            src += 3;
+        } else if (*src == '+') {
+            *dst++ = ' ';
+            ++src;
+        } else {
+            *dst++ = *src++;
         }
-        return 0;
-    case '\t':
-        if (out_size >= 2) {
-            output[0] = '\\';
-            output[1] = 't';
-            return 2;
+    }
+    *dst = '\0';
+}
+
+static void url_decode_slice(const char *src, size_t length, char *output, size_t output_size) {
+    size_t out = 0U;
+    for (size_t i = 0; i < length && out + 1U < output_size; ++out) {
+        if (src[i] == '%' && i + 2U < length && isxdigit((unsigned char)src[i + 1U]) &&
+            isxdigit((unsigned char)src[i + 2U])) {
+            char buf[3] = { src[i + 1U], src[i + 2U], '\0' };
+            output[out] = (char)strtol(buf, NULL, 16);
+            i += 3U;
+        } else {
+            output[out] = src[i] == '+' ? ' ' : src[i];
+            i += 1U;
         }
-        return 0;
-    default:
-        if ((unsigned char)ch < 0x20U) {
-            if (out_size >= 6) {
-                unsigned char value = (unsigned char)ch;
-                snprintf(output, out_size, "\\u%04x", value);
-                return 6;
+    }
+    output[out] = '\0';
+}
+
+/* mode=prefix|fuzzy (через запятую) включает расширение термов по словарю. */
+static unsigned parse_search_mode(const char *value, size_t length) {
+    unsigned flags = 0U;
+    const char *end = value + length;
+    while (value < end) {
+        const char *comma = memchr(value, ',', (size_t)(end - value));
+        size_t word = (size_t)((comma ? comma : end) - value);
+        if (word == 6U && strncmp(value, "prefix", 6U) == 0) {
+            flags |= KOLIBRI_KNOWLEDGE_SEARCH_PREFIX;
+        } else if (word == 5U && strncmp(value, "fuzzy", 5U) == 0) {
+            flags |= KOLIBRI_KNOWLEDGE_SEARCH_FUZZY;
+        } else if (word == 6U && strncmp(value, "approx", 6U) == 0) {
+            flags |= KOLIBRI_KNOWLEDGE_SEARCH_APPROX;
+        }
+        value += word + 1U;
+    }
+    return flags;
+}
+
+static void parse_query(KolibriSlice params, char *query_buffer, size_t query_size, size_t *limit_out,
+                        unsigned *flags_out) {
+    query_buffer[0] = '\0';
+    if (limit_out) {
+        *limit_out = 3U;
+    }
+    if (flags_out) {
+        *flags_out = 0U;
+    }
+    const char *cursor = params.data;
+    const char *end = params.data + params.length;
+    while (cursor < end) {
+        const char *amp = memchr(cursor, '&', (size_t)(end - cursor));
+        const char *segment_end = amp ? amp : end;
+        size_t segment_len = (size_t)(segment_end - cursor);
+        if (segment_len >= 2U && strncmp(cursor, "q=", 2U) == 0) {
+            url_decode_slice(cursor + 2, segment_len - 2U, query_buffer, query_size);
+        } else if (segment_len > 6U && strncmp(cursor, "limit=", 6U) == 0) {
+            size_t value = 0U;
+            for (const char *digit = cursor + 6; digit < segment_end && *digit >= '0' && *digit <= '9'; ++digit) {
+                value = value < KOLIBRI_SEARCH_LIMIT_MAX ? value * 10U + (size_t)(*digit - '0') : value;
+            }
+            if (value > 0U && limit_out) {
+                *limit_out = value;
+            }
+        } else if (segment_len > 5U && strncmp(cursor, "mode=", 5U) == 0 && flags_out) {
+            char mode[64];
+            url_decode_slice(cursor + 5, segment_len - 5U, mode, sizeof(mode));
+            *flags_out = parse_search_mode(mode, strlen(mode));
+        }
+        cursor = segment_end + 1;
+    }
+}
+
+static void parse_form_field(const char *payload, const char *key, char *output, size_t output_size) {
+    if (!output || output_size == 0U) {
+        return;
+    }
+    output[0] = '\0';
+    if (!payload || !key) {
+        return;
+    }
+    size_t key_len = strlen(key);
+    const char *cursor = payload;
+    while (*cursor) {
+        const char *amp = strchr(cursor, '&');
+        size_t segment_len = amp ? (size_t)(amp - cursor) : strlen(cursor);
+        if (segment_len >= key_len + 1U && strncmp(cursor, key, key_len) == 0 && cursor[key_len] == '=') {
+            size_t copy_len = segment_len - key_len - 1U;
+            if (copy_len >= output_size) {
+                copy_len = output_size - 1U;
+            }
+            memcpy(output, cursor + key_len + 1U, copy_len);
+            output[copy_len] = '\0';
+            url_decode(output);
+            return;
+        }
+        if (!amp) {
+            break;
+        }
+        cursor = amp + 1;
+    }
+}
+
+static int require_admin_token(const KolibriHttpRequest *request) {
+    if (kolibri_admin_token[0] == '\0') {
+        return 503;
+    }
+    const KolibriSlice *auth_value = http_request_header(request, "Authorization");
+    if (!auth_value) {
+        return 401;
+    }
+    const char *prefix = "Bearer ";
+    size_t prefix_len = strlen(prefix);
+    if (auth_value->length < prefix_len || strncasecmp(auth_value->data, prefix, prefix_len) != 0) {
+        return 401;
+    }
+    const char *token = auth_value->data + prefix_len;
+    while (*token == ' ') {
+        token++;
+    }
+    if (strcmp(token, kolibri_admin_token) != 0) {
+        return 403;
+    }
+    return 0;
+}
+
+static void http_request_reset(KolibriHttpRequest *request) {
+    request->scanned = 0U;
+    request->head_done = 0;
+    request->method.data = NULL;
+    request->method.length = 0U;
+    request->header_count = 0U;
+    request->header_len = 0U;
+    request->content_length = 0U;
+    request->has_content_length = 0;
+    request->streamed_body = 0;
+    request->parse_ns = 0U;
+}
+
+static KolibriSlice make_slice(const char *begin, const char *end) {
+    KolibriSlice slice = { begin, (size_t)(end - begin) };
+    return slice;
+}
+
+/* Строка «METHOD SP target SP HTTP/x.y»; target делится по '?' на путь и запрос. */
+static int http_parse_request_line(KolibriHttpRequest *request, char *line, size_t length) {
+    char *line_end = line + length;
+    char *method_end = memchr(line, ' ', length);
+    if (!method_end || method_end == line) {
+        return -4;
+    }
+    char *target = method_end + 1;
+    char *target_end = memchr(target, ' ', (size_t)(line_end - target));
+    if (!target_end || target_end == target) {
+        return -4;
+    }
+    char *version = target_end + 1;
+    if (line_end - version < 8 || strncmp(version, "HTTP/", 5U) != 0) {
+        return -4;
+    }
+    *method_end = '\0';
+    *target_end = '\0';
+    request->method = make_slice(line, method_end);
+    char *question = memchr(target, '?', (size_t)(target_end - target));
+    if (question) {
+        *question = '\0';
+        request->path = make_slice(target, question);
+        request->query = make_slice(question + 1, target_end);
+    } else {
+        request->path = make_slice(target, target_end);
+        request->query = make_slice(target_end, target_end);
+    }
+    request->version = make_slice(version, line_end);
+    request->streamed_body = strcmp(line, "POST") == 0 && strcmp(target, "/api/knowledge/bulk") == 0;
+    return 0;
+}
+
+static int http_parse_header_line(KolibriHttpRequest *request, char *line, size_t length) {
+    char *colon = memchr(line, ':', length);
+    if (!colon || colon == line || colon[-1] == ' ' || colon[-1] == '\t') {
+        return -4;
+    }
+    if (request->header_count >= KOLIBRI_HTTP_MAX_HEADERS) {
+        return -8;
+    }
+    char *value = colon + 1;
+    char *value_end = line + length;
+    while (value < value_end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        value_end--;
+    }
+    *colon = '\0';
+    *value_end = '\0';
+    KolibriHttpHeader *header = &request->headers[request->header_count++];
+    header->name = make_slice(line, colon);
+    header->value = make_slice(value, value_end);
+    if (slice_equals_ci(header->name, "Content-Length")) {
+        if (value == value_end) {
+            return -4;
+        }
+        size_t parsed = 0U;
+        for (const char *digit = value; digit < value_end; ++digit) {
+            if (*digit < '0' || *digit > '9') {
+                return -4;
+            }
+            parsed = parsed * 10U + (size_t)(*digit - '0');
+            if (parsed > (request->streamed_body ? KOLIBRI_BULK_MAX_CONTENT_LENGTH : KOLIBRI_MAX_CONTENT_LENGTH)) {
+                return -3;
+            }
+        }
+        /* Расходящиеся дубли Content-Length ломают границы конвейерных запросов. */
+        if (request->has_content_length && request->content_length != parsed) {
+            return -4;
+        }
+        request->content_length = parsed;
+        request->has_content_length = 1;
+    }
+    return 0;
+}
+
+/* Продвигает разбор по принятым байтам с места, где остановился прошлый вызов.
+ * Возвращает длину первого полного запроса, 0 если данных пока мало,
+ * или отрицательный код ошибки. */
+static ssize_t http_parse_step(KolibriHttpRequest *request, char *buffer, size_t length) {
+    while (!request->head_done) {
+        char *line = buffer + request->scanned;
+        char *newline = memchr(line, '\n', length - request->scanned);
+        if (!newline) {
+            return 0;
+        }
+        size_t line_len = (size_t)(newline - line);
+        if (line_len > 0U && line[line_len - 1U] == '\r') {
+            line_len -= 1U;
+        }
+        line[line_len] = '\0';
+        int rc = 0;
+        if (!request->method.data) {
+            rc = http_parse_request_line(request, line, line_len);
+        } else if (line_len == 0U) {
+            request->head_done = 1;
+            request->header_len = (size_t)(newline - buffer) + 1U;
+        } else {
+            rc = http_parse_header_line(request, line, line_len);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+        request->scanned = (size_t)(newline - buffer) + 1U;
+    }
+    size_t total = request->header_len + request->content_length;
+    if (request->streamed_body) {
+        return (ssize_t)(length < total ? length : total);
+    }
+    return length < total ? 0 : (ssize_t)total;
+}
+
+/* Дочитывает соединение до первого полного запроса. Между запросами ждёт не дольше
+ * kolibri_keepalive_timeout_ms; -7 означает, что клиент закрыл или бросил соединение
+ * и отвечать не нужно. */
+static ssize_t receive_http_request(KolibriConnection *connection) {
+    if (!connection) {
+        return -1;
+    }
+    KolibriHttpRequest *request = &connection->request;
+    size_t capacity = sizeof(connection->buffer);
+    while (1) {
+        uint64_t parse_started = monotonic_ns();
+        ssize_t found = http_parse_step(request, connection->buffer, connection->length);
+        request->parse_ns += monotonic_ns() - parse_started;
+        if (found != 0) {
+            return found;
+        }
+        if (connection->length >= capacity - 1U) {
+            return request->head_done ? -5 : -4;
+        }
+        if (connection->length == 0U && connection->served > 0U) {
+            struct pollfd idle = { connection->fd, POLLIN, 0 };
+            int ready = poll(&idle, 1, kolibri_keepalive_timeout_ms);
+            if (ready <= 0) {
+                return -7;
+            }
+        }
+        ssize_t received = recv(connection->fd,
+                                connection->buffer + connection->length,
+                                capacity - 1U - connection->length,
+                                0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                return connection->length == 0U && connection->served > 0U ? -7 : -2;
+            }
+            return -1;
+        }
+        if (received == 0) {
+            if (connection->length == 0U) {
+                return -7;
+            }
+            return request->head_done ? -6 : -4;
+        }
+        connection->length += (size_t)received;
+        connection->buffer[connection->length] = '\0';
+    }
+}
+
+static int format_iso8601_utc(time_t value, char *output, size_t out_size) {
+    if (!output || out_size == 0) {
+        return -1;
+    }
+    if (value <= 0) {
+        output[0] = '\0';
+        return -1;
+    }
+    struct tm tm_value;
+    if (!gmtime_r(&value, &tm_value)) {
+        output[0] = '\0';
+        return -1;
+    }
+    if (strftime(output, out_size, "%Y-%m-%dT%H:%M:%SZ", &tm_value) == 0) {
+        output[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+/* Заголовок и тело уходят одним writev, поэтому ответ не дробится на два
+ * сегмента даже при TCP_NODELAY; частичная запись дописывается в цикле. */
+static void send_response_headers(KolibriConnection *connection,
+                                  int status_code,
+                                  const char *content_type,
+                                  const char *extra_headers,
+                                  const char *body,
+                                  size_t body_len) {
+    connection->status = status_code;
+    char header[320];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n%s\r\n",
+                              status_code,
+                              status_code / 100 == 2 ? "OK" : "Error",
+                              content_type,
+                              body_len,
+                              connection->keep_alive ? "keep-alive" : "close",
+                              extra_headers ? extra_headers : "");
+    if (header_len <= 0 || (size_t)header_len >= sizeof(header)) {
+        connection->keep_alive = 0;
+        return;
+    }
+    struct iovec parts[2];
+    parts[0].iov_base = header;
+    parts[0].iov_len = (size_t)header_len;
+    parts[1].iov_base = (void *)body;
+    parts[1].iov_len = body ? body_len : 0U;
+    struct iovec *pending = parts;
+    int pending_count = parts[1].iov_len > 0U ? 2 : 1;
+    while (pending_count > 0) {
+        ssize_t written = writev(connection->fd, pending, pending_count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            connection->keep_alive = 0;
+            return;
+        }
+        size_t left = (size_t)written;
+        while (pending_count > 0 && left >= pending->iov_len) {
+            left -= pending->iov_len;
+            pending++;
+            pending_count--;
+        }
+        if (pending_count > 0) {
+            pending->iov_base = (char *)pending->iov_base + left;
+            pending->iov_len -= left;
+        }
+    }
+}
+
+static void send_response_bytes(KolibriConnection *connection,
+                                int status_code,
+                                const char *content_type,
+                                const char *body,
+                                size_t body_len) {
+    send_response_headers(connection, status_code, content_type, NULL, body, body_len);
+}
+
+static void send_response(KolibriConnection *connection, int status_code, const char *content_type, const char *body) {
+    send_response_bytes(connection, status_code, content_type, body, body ? strlen(body) : 0U);
+}
+
+/* Пропускает запрос клиента или отвечает 429 с Retry-After в целых секундах. */
+static int rate_limit_admit(KolibriRateLimiter *limiter, KolibriConnection *connection) {
+    uint64_t retry_after_ns = 0U;
+    if (kolibri_rate_limit_allow(limiter, connection->client, monotonic_ns(), &retry_after_ns)) {
+        return 1;
+    }
+    char headers[64];
+    snprintf(headers, sizeof(headers), "Retry-After: %llu\r\n",
+             (unsigned long long)((retry_after_ns + 999999999ULL) / 1000000000ULL));
+    const char *body = "{\"error\":\"rate limited\"}";
+    send_response_headers(connection, 429, "application/json", headers, body, strlen(body));
+    return 0;
+}
+
+static size_t json_escape_char(char ch, char *output, size_t out_size) {
+    if (!output || out_size == 0) {
+        return 0;
+    }
+    switch (ch) {
+    case '"':
+    case '\\':
+        if (out_size >= 2) {
+            output[0] = '\\';
+            output[1] = ch;
+            return 2;
+        }
+        return 0;
+    case '\n':
+        if (out_size >= 2) {
+            output[0] = '\\';
+            output[1] = 'n';
+            return 2;
+        }
+        return 0;
+    case '\r':
+        if (out_size >= 2) {
+            output[0] = '\\';
+            output[1] = 'r';
+            return 2;
+        }
+        return 0;
+    case '\t':
+        if (out_size >= 2) {
+            output[0] = '\\';
+            output[1] = 't';
+            return 2;
+        }
+        return 0;
+    default:
+        if ((unsigned char)ch < 0x20U) {
+            if (out_size >= 6) {
+                unsigned char value = (unsigned char)ch;
+                snprintf(output, out_size, "\\u%04x", value);
+                return 6;
+            }
+            return 0;
+        }
+        output[0] = ch;
+        return 1;
+    }
+}
+
+static void json_escape(const char *input, char *output, size_t out_size) {
+    if (!output || out_size == 0) {
+        return;
+    }
+    if (!input) {
+        output[0] = '\0';
+        return;
+    }
+    size_t out_index = 0;
+    for (size_t i = 0; input[i] != '\0' && out_index + 1 < out_size; ++i) {
+        size_t written = json_escape_char(input[i], output + out_index, out_size - out_index - 1U);
+        if (written == 0) {
+            break;
+        }
+        out_index += written;
+    }
+    output[out_index] = '\0';
+}
+
+/* Растущий буфер ответа: JSON пишется прямо в него без промежуточных копий.
+ * Первые KOLIBRI_OUTPUT_INLINE байт живут на стеке вызывающего. */
+#define KOLIBRI_OUTPUT_INLINE 8192
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+    char inline_data[KOLIBRI_OUTPUT_INLINE];
+} KolibriOutput;
+
+static void output_init(KolibriOutput *out) {
+    out->data = out->inline_data;
+    out->length = 0U;
+    out->capacity = sizeof(out->inline_data);
+    out->failed = 0;
+    out->data[0] = '\0';
+}
+
+static void output_free(KolibriOutput *out) {
+    if (out->data != out->inline_data) {
+        free(out->data);
+    }
+    output_init(out);
+}
+
+/* Резервирует место под extra байт и завершающий NUL. */
+static int output_reserve(KolibriOutput *out, size_t extra) {
+    if (out->failed) {
+        return -1;
+    }
+    if (out->length + extra + 1U <= out->capacity) {
+        return 0;
+    }
+    size_t capacity = out->capacity * 2U;
+    while (capacity < out->length + extra + 1U) {
+        capacity *= 2U;
+    }
+    char *data = out->data == out->inline_data ? (char *)malloc(capacity)
+                                               : (char *)realloc(out->data, capacity);
+    if (!data) {
+        out->failed = 1;
+        return -1;
+    }
+    if (out->data == out->inline_data) {
+        memcpy(data, out->inline_data, out->length + 1U);
+    }
+    out->data = data;
+    out->capacity = capacity;
+    return 0;
+}
+
+static void output_append(KolibriOutput *out, const char *data, size_t len) {
+    if (output_reserve(out, len) != 0) {
+        return;
+    }
+    memcpy(out->data + out->length, data, len);
+    out->length += len;
+    out->data[out->length] = '\0';
+}
+
+static void output_puts(KolibriOutput *out, const char *text) {
+    output_append(out, text, strlen(text));
+}
+
+static void output_printf(KolibriOutput *out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void output_printf(KolibriOutput *out, const char *format, ...) {
+    if (out->failed) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+    va_end(args);
+    if (needed < 0) {
+        out->failed = 1;
+        return;
+    }
+    if ((size_t)needed >= out->capacity - out->length) {
+        if (output_reserve(out, (size_t)needed) != 0) {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+        va_end(args);
+    }
+    out->length += (size_t)needed;
+}
+
+static void build_directories_json(char *buffer, size_t buffer_size) {
+    if (!buffer || buffer_size == 0) {
+        return;
+    }
+    if (buffer_size < 3U) {
+        buffer[0] = '\0';
+        return;
+    }
+    size_t offset = 0U;
+    buffer[offset++] = '[';
+    for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
+        if (offset + 2U >= buffer_size) {
+            break;
+        }
+        if (i > 0U) {
+            buffer[offset++] = ',';
+            if (offset >= buffer_size) {
+                break;
+            }
+        }
+        buffer[offset++] = '"';
+        if (offset >= buffer_size) {
+            break;
+        }
+        char escaped[256];
+        json_escape(kolibri_knowledge_directories[i], escaped, sizeof(escaped));
+        size_t len = strlen(escaped);
+        if (len > buffer_size - offset - 2U) {
+            len = buffer_size - offset - 2U;
+        }
+        memcpy(buffer + offset, escaped, len);
+        offset += len;
+        if (offset < buffer_size) {
+            buffer[offset++] = '"';
+        }
+    }
+    if (offset >= buffer_size - 1U) {
+        buffer[buffer_size - 1U] = '\0';
+        return;
+    }
+    buffer[offset++] = ']';
+    if (offset < buffer_size) {
+        buffer[offset] = '\0';
+    } else {
+        buffer[buffer_size - 1U] = '\0';
+    }
+}
+
+static void prometheus_escape_label(const char *input, char *output, size_t out_size) {
+    if (!output || out_size == 0) {
+        return;
+    }
+    if (!input) {
+        output[0] = '\0';
+        return;
+    }
+    size_t out_index = 0U;
+    for (size_t i = 0; input[i] != '\0' && out_index + 1U < out_size; ++i) {
+        char ch = input[i];
+        if (ch == '\\' || ch == '"') {
+            if (out_index + 2U >= out_size) {
+                break;
+            }
+            output[out_index++] = '\\';
+            output[out_index++] = ch;
+        } else if (ch == '\n') {
+            if (out_index + 2U >= out_size) {
+                break;
+            }
+            output[out_index++] = '\\';
+            output[out_index++] = 'n';
+        } else {
+            output[out_index++] = ch;
+        }
+    }
+    output[out_index] = '\0';
+}
+
+
+static void output_latency_histogram(KolibriOutput *out,
+                                     const char *name,
+                                     const char *label,
+                                     const char *value,
+                                     KolibriLatencyHistogram *histogram) {
+    size_t cumulative = 0U;
+    for (size_t i = 0; i < KOLIBRI_LATENCY_BUCKETS; ++i) {
+        cumulative += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+        if (i + 1U < KOLIBRI_LATENCY_BUCKETS) {
+            output_printf(out,
+                          "%s_bucket{%s=\"%s\",le=\"%g\"} %zu\n",
+                          name,
+                          label,
+                          value,
+                          (double)kolibri_latency_bounds_us[i] / 1e6,
+                          cumulative);
+        } else {
+            output_printf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %zu\n", name, label, value, cumulative);
+        }
+    }
+    unsigned long long sum_ns = atomic_load_explicit(&histogram->sum_ns, memory_order_relaxed);
+    output_printf(out, "%s_sum{%s=\"%s\"} %.6f\n", name, label, value, (double)sum_ns / 1e9);
+    output_printf(out, "%s_count{%s=\"%s\"} %zu\n", name, label, value, cumulative);
+}
+
+/* Рассылка поиска по шардам: запросы уходят всем шардам сразу через
+ * неблокирующие сокеты, общий дедлайн ограничивает хвост задержки, а шарды,
+ * не ответившие вовремя, просто не попадают в слитый top-k. */
+typedef struct {
+    int fd;
+    int connected;
+    int done;
+    size_t sent;
+    char *data;
+    size_t length;
+    size_t capacity;
+    KolibriShardResult result;
+} KolibriShardCall;
+
+typedef struct {
+    const char *json;
+    size_t length;
+    double score;
+    size_t shard;
+    size_t position;
+} KolibriShardHit;
+
+static void shard_call_finish(KolibriShardCall *call, KolibriShardResult result) {
+    if (call->fd >= 0) {
+        close(call->fd);
+        call->fd = -1;
+    }
+    call->done = 1;
+    call->result = result;
+}
+
+static void shard_call_start(KolibriShardCall *call, const KolibriShardEndpoint *shard) {
+    call->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (call->fd < 0) {
+        shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+        return;
+    }
+    int flags = fcntl(call->fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(call->fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+        return;
+    }
+    int one = 1;
+    setsockopt(call->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(call->fd, (const struct sockaddr *)&shard->addr, sizeof(shard->addr)) == 0) {
+        call->connected = 1;
+    } else if (errno != EINPROGRESS) {
+        shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+    }
+}
+
+static void shard_call_write(KolibriShardCall *call, const char *request, size_t request_length) {
+    if (!call->connected) {
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        if (getsockopt(call->fd, SOL_SOCKET, SO_ERROR, &error, &error_length) != 0 || error != 0) {
+            shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+            return;
+        }
+        call->connected = 1;
+    }
+    ssize_t written = send(call->fd, request + call->sent, request_length - call->sent, MSG_NOSIGNAL);
+    if (written < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+        }
+        return;
+    }
+    call->sent += (size_t)written;
+}
+
+/* Ответ готов, когда получены заголовки и Content-Length байт тела. */
+static int shard_response_complete(const KolibriShardCall *call) {
+    const char *headers_end = strstr(call->data, "\r\n\r\n");
+    if (!headers_end) {
+        return 0;
+    }
+    size_t header_length = (size_t)(headers_end - call->data) + 4U;
+    const char *field = strstr(call->data, "Content-Length:");
+    if (!field || field > headers_end) {
+        return 0;
+    }
+    size_t content_length = (size_t)strtoul(field + 15, NULL, 10);
+    return call->length >= header_length + content_length;
+}
+
+static void shard_call_read(KolibriShardCall *call) {
+    if (call->capacity - call->length < 4096U) {
+        size_t capacity = call->capacity ? call->capacity * 2U : 16384U;
+        char *data = capacity <= KOLIBRI_SHARD_RESPONSE_MAX ? (char *)realloc(call->data, capacity + 1U) : NULL;
+        if (!data) {
+            shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+            return;
+        }
+        call->data = data;
+        call->capacity = capacity;
+    }
+    ssize_t received = recv(call->fd, call->data + call->length, call->capacity - call->length, 0);
+    if (received < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+        }
+        return;
+    }
+    call->length += (size_t)received;
+    call->data[call->length] = '\0';
+    if (shard_response_complete(call)) {
+        shard_call_finish(call, KOLIBRI_SHARD_OK);
+    } else if (received == 0) {
+        shard_call_finish(call, KOLIBRI_SHARD_ERROR);
+    }
+}
+
+/* Разбирает {"snippets":[{...},...]} шарда: объекты верхнего уровня
+ * переносятся в ответ фронта как есть, из каждого читается только score. */
+static int shard_collect_hits(const KolibriShardCall *call,
+                              size_t shard,
+                              KolibriShardHit *hits,
+                              size_t *hit_count,
+                              size_t hit_capacity) {
+    if (call->length < 12U || strncmp(call->data + 9, "200", 3U) != 0) {
+        return -1;
+    }
+    const char *body = strstr(call->data, "\r\n\r\n");
+    const char *cursor = body ? strstr(body, "\"snippets\":[") : NULL;
+    if (!cursor) {
+        return -1;
+    }
+    cursor += 12;
+    const char *end = call->data + call->length;
+    size_t position = 0U;
+    while (cursor < end && *cursor != ']') {
+        if (*cursor != '{') {
+            ++cursor;
+            continue;
+        }
+        const char *start = cursor;
+        int depth = 0;
+        int in_string = 0;
+        for (; cursor < end; ++cursor) {
+            if (in_string) {
+                if (*cursor == '\\') {
+                    ++cursor;
+                } else if (*cursor == '"') {
+                    in_string = 0;
+                }
+            } else if (*cursor == '"') {
+                in_string = 1;
+            } else if (*cursor == '{') {
+                ++depth;
+            } else if (*cursor == '}' && --depth == 0) {
+                break;
+            }
+        }
+        if (cursor >= end) {
+            return -1;
+        }
+        ++cursor;
+        const char *score = NULL;
+        for (const char *probe = cursor - 9; probe >= start; --probe) {
+            if (strncmp(probe, "\"score\":", 8U) == 0) {
+                score = probe + 8;
+                break;
+            }
+        }
+        if (score && *hit_count < hit_capacity) {
+            KolibriShardHit *hit = &hits[(*hit_count)++];
+            hit->json = start;
+            hit->length = (size_t)(cursor - start);
+            hit->score = strtod(score, NULL);
+            hit->shard = shard;
+            hit->position = position++;
+        }
+    }
+    return 0;
+}
+
+static int compare_shard_hits(const void *lhs, const void *rhs) {
+    const KolibriShardHit *a = (const KolibriShardHit *)lhs;
+    const KolibriShardHit *b = (const KolibriShardHit *)rhs;
+    if (a->score != b->score) {
+        return a->score > b->score ? -1 : 1;
+    }
+    if (a->shard != b->shard) {
+        return a->shard < b->shard ? -1 : 1;
+    }
+    return a->position < b->position ? -1 : (a->position > b->position);
+}
+
+static void shard_append_url_encoded(KolibriOutput *out, const char *text) {
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        if (isalnum(*p) || *p == '-' || *p == '_' || *p == '.' || *p == '~') {
+            output_append(out, (const char *)p, 1U);
+        } else {
+            output_printf(out, "%%%02X", *p);
+        }
+    }
+}
+
+/* Опрашивает все шарды до общего дедлайна и собирает слитый ответ в out.
+ * Возвращает число шардов, ответивших вовремя. */
+static size_t shard_search(const char *query, size_t limit, unsigned search_flags, KolibriOutput *out) {
+    KolibriOutput request;
+    output_init(&request);
+    output_puts(&request, "GET /api/knowledge/search?q=");
+    shard_append_url_encoded(&request, query);
+    output_printf(&request, "&limit=%zu", limit);
+    if (search_flags != 0U) {
+        output_printf(&request,
+                      "&mode=%s%s%s",
+                      (search_flags & KOLIBRI_KNOWLEDGE_SEARCH_PREFIX) ? "prefix," : "",
+                      (search_flags & KOLIBRI_KNOWLEDGE_SEARCH_FUZZY) ? "fuzzy," : "",
+                      (search_flags & KOLIBRI_KNOWLEDGE_SEARCH_APPROX) ? "approx" : "");
+    }
+    output_puts(&request, " HTTP/1.1\r\nHost: kolibri-shard\r\nConnection: close\r\n\r\n");
+
+    KolibriShardCall calls[KOLIBRI_SHARD_MAX];
+    memset(calls, 0, sizeof(calls));
+    for (size_t i = 0; i < kolibri_shard_count; ++i) {
+        calls[i].fd = -1;
+        if (request.failed) {
+            shard_call_finish(&calls[i], KOLIBRI_SHARD_ERROR);
+        } else {
+            shard_call_start(&calls[i], &kolibri_shards[i]);
+        }
+    }
+
+    uint64_t deadline = monotonic_ns() + (uint64_t)kolibri_shard_timeout_ms * 1000000ULL;
+    for (;;) {
+        struct pollfd fds[KOLIBRI_SHARD_MAX];
+        size_t owners[KOLIBRI_SHARD_MAX];
+        nfds_t pending = 0U;
+        for (size_t i = 0; i < kolibri_shard_count; ++i) {
+            if (!calls[i].done) {
+                fds[pending].fd = calls[i].fd;
+                fds[pending].events = calls[i].sent < request.length ? POLLOUT : POLLIN;
+                fds[pending].revents = 0;
+                owners[pending++] = i;
+            }
+        }
+        uint64_t now = monotonic_ns();
+        if (pending == 0U || now >= deadline) {
+            break;
+        }
+        int wait_ms = (int)((deadline - now + 999999ULL) / 1000000ULL);
+        int ready = poll(fds, pending, wait_ms);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        for (nfds_t p = 0; ready > 0 && p < pending; ++p) {
+            KolibriShardCall *call = &calls[owners[p]];
+            if (fds[p].revents & POLLOUT) {
+                shard_call_write(call, request.data, request.length);
+            } else if (fds[p].revents & (POLLIN | POLLHUP | POLLERR)) {
+                shard_call_read(call);
+            }
+        }
+    }
+
+    size_t hit_capacity = kolibri_shard_count * limit;
+    KolibriShardHit *hits = (KolibriShardHit *)malloc((hit_capacity ? hit_capacity : 1U) * sizeof(KolibriShardHit));
+    size_t hit_count = 0U;
+    size_t answered = 0U;
+    for (size_t i = 0; i < kolibri_shard_count; ++i) {
+        if (!calls[i].done) {
+            shard_call_finish(&calls[i], KOLIBRI_SHARD_TIMEOUT);
+        } else if (calls[i].result == KOLIBRI_SHARD_OK &&
+                   (!hits || shard_collect_hits(&calls[i], i, hits, &hit_count, hit_capacity) != 0)) {
+            calls[i].result = KOLIBRI_SHARD_ERROR;
+        }
+        answered += calls[i].result == KOLIBRI_SHARD_OK;
+        atomic_fetch_add_explicit(&kolibri_shard_results[calls[i].result], 1U, memory_order_relaxed);
+    }
+    if (hits) {
+        qsort(hits, hit_count, sizeof(KolibriShardHit), compare_shard_hits);
+    }
+    output_puts(out, "{\"snippets\":[");
+    for (size_t i = 0; i < hit_count && i < limit; ++i) {
+        if (i > 0U) {
+            output_puts(out, ",");
+        }
+        output_append(out, hits[i].json, hits[i].length);
+    }
+    output_printf(out,
+                  "],\"partial\":%s,\"shards\":{\"total\":%zu,\"ok\":%zu}}",
+                  answered < kolibri_shard_count ? "true" : "false",
+                  kolibri_shard_count,
+                  answered);
+    if (hit_count == 0U) {
+        atomic_fetch_add(&kolibri_search_misses, 1U);
+    } else {
+        atomic_fetch_add(&kolibri_search_hits, 1U);
+    }
+    if (answered < kolibri_shard_count) {
+        atomic_fetch_add(&kolibri_shard_partial_responses, 1U);
+    }
+    free(hits);
+    for (size_t i = 0; i < kolibri_shard_count; ++i) {
+        free(calls[i].data);
+    }
+    output_free(&request);
+    return answered;
+}
+
+/* Маршруты, стадии обработки, текущая нагрузка и память индекса. */
+static void output_service_metrics(KolibriOutput *out, const KolibriKnowledgeIndex *index) {
+    output_puts(out,
+                "# HELP kolibri_http_responses_total HTTP responses by route and status class\n"
+                "# TYPE kolibri_http_responses_total counter\n");
+    for (size_t route = 0; route < KOLIBRI_ROUTE_COUNT; ++route) {
+        for (size_t status_class = 0; status_class < 5U; ++status_class) {
+            size_t count = atomic_load_explicit(&kolibri_route_responses[route][status_class], memory_order_relaxed);
+            if (count > 0U) {
+                output_printf(out,
+                              "kolibri_http_responses_total{route=\"%s\",code=\"%zuxx\"} %zu\n",
+                              kolibri_route_names[route],
+                              status_class + 1U,
+                              count);
+            }
+        }
+    }
+    output_puts(out,
+                "# HELP kolibri_http_request_duration_seconds Time from a fully received request to its response\n"
+                "# TYPE kolibri_http_request_duration_seconds histogram\n");
+    for (size_t route = 0; route < KOLIBRI_ROUTE_COUNT; ++route) {
+        output_latency_histogram(out,
+                                 "kolibri_http_request_duration_seconds",
+                                 "route",
+                                 kolibri_route_names[route],
+                                 &kolibri_route_latency[route]);
+    }
+    output_puts(out,
+                "# HELP kolibri_request_stage_duration_seconds Time spent in parse, search, serialize and journal stages\n"
+                "# TYPE kolibri_request_stage_duration_seconds histogram\n");
+    for (size_t stage = 0; stage < KOLIBRI_STAGE_COUNT; ++stage) {
+        output_latency_histogram(out,
+                                 "kolibri_request_stage_duration_seconds",
+                                 "stage",
+                                 kolibri_stage_names[stage],
+                                 &kolibri_stage_latency[stage]);
+    }
+    output_printf(out,
+                  "# HELP kolibri_bulk_items_total Items received by /api/knowledge/bulk by outcome\n"
+                  "# TYPE kolibri_bulk_items_total counter\n"
+                  "kolibri_bulk_items_total{status=\"accepted\"} %zu\n"
+                  "kolibri_bulk_items_total{status=\"rejected\"} %zu\n",
+                  atomic_load(&kolibri_bulk_accepted),
+                  atomic_load(&kolibri_bulk_rejected));
+    if (kolibri_shard_count > 0U) {
+        output_puts(out,
+                    "# HELP kolibri_shard_requests_total Shard search requests sent by the front by outcome\n"
+                    "# TYPE kolibri_shard_requests_total counter\n");
+        for (size_t result = 0; result < KOLIBRI_SHARD_RESULT_COUNT; ++result) {
+            output_printf(out,
+                          "kolibri_shard_requests_total{result=\"%s\"} %zu\n",
+                          kolibri_shard_result_names[result],
+                          atomic_load_explicit(&kolibri_shard_results[result], memory_order_relaxed));
+        }
+        output_printf(out,
+                      "# HELP kolibri_shard_partial_responses_total Front searches answered without every shard\n"
+                      "# TYPE kolibri_shard_partial_responses_total counter\n"
+                      "kolibri_shard_partial_responses_total %zu\n",
+                      atomic_load(&kolibri_shard_partial_responses));
+    }
+    size_t mapped_bytes = 0U;
+    size_t heap_bytes = kolibri_knowledge_index_memory_usage(index, &mapped_bytes);
+    output_printf(out,
+                  "# HELP kolibri_requests_in_flight Requests currently being handled\n"
+                  "# TYPE kolibri_requests_in_flight gauge\n"
+                  "kolibri_requests_in_flight %zu\n"
+                  "# HELP kolibri_connections_open Accepted client connections not yet closed\n"
+                  "# TYPE kolibri_connections_open gauge\n"
+                  "kolibri_connections_open %zu\n"
+                  "# HELP kolibri_connections_idle Keep-alive connections waiting for a request outside workers\n"
+                  "# TYPE kolibri_connections_idle gauge\n"
+                  "kolibri_connections_idle %zu\n"
+                  "# HELP kolibri_knowledge_index_heap_bytes Estimated heap memory of the serving index\n"
+                  "# TYPE kolibri_knowledge_index_heap_bytes gauge\n"
+                  "kolibri_knowledge_index_heap_bytes %zu\n"
+                  "# HELP kolibri_knowledge_index_mapped_bytes Size of the memory-mapped index.bin\n"
+                  "# TYPE kolibri_knowledge_index_mapped_bytes gauge\n"
+                  "kolibri_knowledge_index_mapped_bytes %zu\n",
+                  atomic_load(&kolibri_requests_in_flight),
+                  atomic_load(&kolibri_connections_open),
+                  atomic_load(&kolibri_connections_idle),
+                  heap_bytes,
+                  mapped_bytes);
+    static const struct {
+        const char *name;
+        const char *help;
+        const char *type;
+    } memory_series[] = {
+        { "kolibri_memory_bytes", "Live heap bytes allocated by each core subsystem", "gauge" },
+        { "kolibri_memory_peak_bytes", "Peak live heap bytes of each core subsystem", "gauge" },
+        { "kolibri_memory_allocations", "Live heap blocks of each core subsystem", "gauge" },
+        { "kolibri_memory_allocations_total", "Heap blocks allocated by each core subsystem", "counter" },
+        { "kolibri_memory_failed_allocations_total", "Failed heap allocations of each core subsystem", "counter" },
+    };
+    KolibriMemoryStats memory[KOLIBRI_MEMORY_SUBSYSTEM_COUNT];
+    for (size_t i = 0; i < KOLIBRI_MEMORY_SUBSYSTEM_COUNT; ++i) {
+        kolibri_memory_stats((KolibriMemorySubsystem)i, &memory[i]);
+    }
+    for (size_t series = 0; series < sizeof(memory_series) / sizeof(memory_series[0]); ++series) {
+        output_printf(out,
+                      "# HELP %s %s\n# TYPE %s %s\n",
+                      memory_series[series].name,
+                      memory_series[series].help,
+                      memory_series[series].name,
+                      memory_series[series].type);
+        for (size_t i = 0; i < KOLIBRI_MEMORY_SUBSYSTEM_COUNT; ++i) {
+            const uint64_t values[] = { memory[i].live_bytes, memory[i].peak_bytes, memory[i].live_allocations,
+                                        memory[i].total_allocations, memory[i].failed_allocations };
+            output_printf(out,
+                          "%s{subsystem=\"%s\"} %llu\n",
+                          memory_series[series].name,
+                          kolibri_memory_subsystem_name((KolibriMemorySubsystem)i),
+                          (unsigned long long)values[series]);
+        }
+    }
+}
+
+/* Решает, можно ли оставить соединение открытым после ответа. */
+static int request_wants_keep_alive(const KolibriHttpRequest *request) {
+    const KolibriSlice *value = http_request_header(request, "Connection");
+    if (slice_equals_ci(request->version, "HTTP/1.1")) {
+        return !(value && slice_equals_ci(*value, "close"));
+    }
+    return value && slice_equals_ci(*value, "keep-alive");
+}
+
+/* Журналирует поиск в геноме: ASK и до трёх TEACH по лучшим документам. */
+static void journal_search(const KolibriKnowledgeIndex *index,
+                           const char *query,
+                           const size_t *indices,
+                           size_t result_count) {
+    if (kolibri_genome_ready) {
+        char ask_payload[512];
+        int query_limit = (int)sizeof(ask_payload) - 3;
+        if (query_limit < 0) {
+            query_limit = 0;
+        }
+        snprintf(ask_payload, sizeof(ask_payload), "q=%.*s", query_limit, query);
+        knowledge_record_event("ASK", ask_payload);
+        size_t replay = result_count < KOLIBRI_SEARCH_REPLAY_DOCS ? result_count : KOLIBRI_SEARCH_REPLAY_DOCS;
+        for (size_t i = 0; i < replay; ++i) {
+            const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
+            if (!doc) {
+                continue;
+            }
+            char teach_payload[512];
+            int remaining = (int)sizeof(teach_payload) - 1 - 5;
+            if (remaining < 0) {
+                remaining = 0;
+            }
+            int teach_q_limit = remaining > 0 ? remaining / 2 : 0;
+            int teach_a_limit = remaining - teach_q_limit;
+            snprintf(teach_payload,
+                     sizeof(teach_payload),
+                     "q=%.*s a=%.*s",
+                     teach_q_limit,
+                     query,
+                     teach_a_limit,
+                     doc->preview ? doc->preview : "");
+            knowledge_record_event("TEACH", teach_payload);
+        }
+    }
+}
+
+typedef struct {
+    const char *question;
+    const char *answer;
+    char id[64];
+    int added;
+} KolibriTeachDocument;
+
+/* Документы добавляются в индекс, текущий на момент записи, а не на момент
+ * начала запроса: иначе параллельная перезагрузка могла бы их потерять.
+ * Пакет проходит под одной блокировкой и сбрасывает кэш один раз. */
+static void teach_add_documents(KolibriTeachDocument *docs, size_t count) {
+    if (count == 0U) {
+        return;
+    }
+    pthread_mutex_lock(&kolibri_publisher.update_lock);
+    KolibriIndexHandle *target = index_acquire();
+    size_t added = 0U;
+    for (size_t i = 0; i < count; ++i) {
+        docs[i].added = 0;
+        docs[i].id[0] = '\0';
+        if (!target) {
+            continue;
+        }
+        snprintf(docs[i].id,
+                 sizeof(docs[i].id),
+                 "teach-%lld-%zu",
+                 (long long)time(NULL),
+                 atomic_fetch_add(&kolibri_teach_documents, 1U));
+        KOLIBRI_TRACE_BEGIN(teach_span, "knowledge.teach");
+        docs[i].added =
+            kolibri_knowledge_index_add_document(target->index, docs[i].id, docs[i].question, "teach", docs[i].answer,
+                                                 NULL) == 0;
+        KOLIBRI_TRACE_END(teach_span);
+        added += (size_t)docs[i].added;
+    }
+    pthread_mutex_unlock(&kolibri_publisher.update_lock);
+    if (added > 0U) {
+        index_content_changed();
+        segment_merger_notify(target);
+    }
+    index_handle_release(target);
+}
+
+static void teach_payload(const char *question, const char *answer, char *payload, size_t payload_size) {
+    snprintf(payload, payload_size, "q=%.*s a=%.*s", 200, question, 200, answer);
+}
+
+static void feedback_payload(const char *rating,
+                             const char *question,
+                             const char *answer,
+                             char *payload,
+                             size_t payload_size) {
+    snprintf(payload,
+             payload_size,
+             "rating=%.*s q=%.*s a=%.*s",
+             64,
+             rating[0] ? rating : "unknown",
+             192,
+             question,
+             192,
+             answer);
+}
+
+/* Строка bulk-запроса: плоский JSON-объект {"route":"teach|feedback","q":...,"a":...,"rating":...}. */
+typedef struct {
+    char route[16];
+    char question[512];
+    char answer[512];
+    char rating[64];
+} KolibriBulkItem;
+
+/* Конвейер bulk-запроса: чтение тела → разбор → проверка → пакет из
+ * KOLIBRI_BULK_BATCH элементов → очередь журнала и индекс. Групповую запись
+ * генома делает поток журнала, пока обработчик разбирает следующий пакет;
+ * память каждой стадии ограничена строкой, пакетом и очередью журнала. */
+typedef struct {
+    KolibriBulkItem items[KOLIBRI_BULK_BATCH];
+    const char *errors[KOLIBRI_BULK_BATCH];
+    size_t count;
+    size_t lines;
+    size_t accepted;
+    size_t rejected;
+    int truncated;
+    KolibriOutput *out;
+} KolibriBulkBatch;
+
+static void skip_json_space(const char **cursor, const char *end) {
+    while (*cursor < end && (**cursor == ' ' || **cursor == '\t' || **cursor == '\r')) {
+        ++*cursor;
+    }
+}
+
+/* Раскрывает JSON-строку, *cursor стоит на открывающей кавычке; не влезшее в out отбрасывается. */
+static int bulk_parse_string(const char **cursor, const char *end, char *out, size_t out_size) {
+    const char *p = *cursor + 1;
+    size_t length = 0U;
+    while (p < end && *p != '"') {
+        char bytes[3];
+        size_t count = 1U;
+        if ((unsigned char)*p < 0x20U) {
+            return -1;
+        }
+        if (*p != '\\') {
+            bytes[0] = *p++;
+        } else {
+            if (++p >= end) {
+                return -1;
+            }
+            switch (*p) {
+            case '"':
+            case '\\':
+            case '/':
+                bytes[0] = *p;
+                break;
+            case 'b':
+                bytes[0] = '\b';
+                break;
+            case 'f':
+                bytes[0] = '\f';
+                break;
+            case 'n':
+                bytes[0] = '\n';
+                break;
+            case 'r':
+                bytes[0] = '\r';
+                break;
+            case 't':
+                bytes[0] = '\t';
+                break;
+            case 'u': {
+                if (end - p < 5) {
+                    return -1;
+                }
+                unsigned code = 0U;
+                for (int i = 1; i <= 4; ++i) {
+                    if (!isxdigit((unsigned char)p[i])) {
+                        return -1;
+                    }
+                    code = code * 16U + (unsigned)(isdigit((unsigned char)p[i]) ? p[i] - '0'
+                                                                                  : (tolower((unsigned char)p[i]) - 'a' + 10));
+                }
+                p += 4;
+                if (code < 0x80U) {
+                    bytes[0] = (char)code;
+                } else if (code < 0x800U) {
+                    bytes[0] = (char)(0xC0U | (code >> 6));
+                    bytes[1] = (char)(0x80U | (code & 0x3FU));
+                    count = 2U;
+                } else {
+                    bytes[0] = (char)(0xE0U | (code >> 12));
+                    bytes[1] = (char)(0x80U | ((code >> 6) & 0x3FU));
+                    bytes[2] = (char)(0x80U | (code & 0x3FU));
+                    count = 3U;
+                }
+                break;
+            }
+            default:
+                return -1;
+            }
+            ++p;
+        }
+        if (length + count < out_size) {
+            memcpy(out + length, bytes, count);
+            length += count;
+        }
+    }
+    if (p >= end) {
+        return -1;
+    }
+    out[length] = '\0';
+    *cursor = p + 1;
+    return 0;
+}
+
+/* Возвращает NULL или текст ошибки для ответа. */
+static const char *bulk_parse_item(const char *line, size_t length, KolibriBulkItem *item) {
+    const char *p = line;
+    const char *end = line + length;
+    item->route[0] = '\0';
+    item->question[0] = '\0';
+    item->answer[0] = '\0';
+    item->rating[0] = '\0';
+    skip_json_space(&p, end);
+    if (p >= end || *p != '{') {
+        return "invalid json";
+    }
+    ++p;
+    skip_json_space(&p, end);
+    if (p < end && *p == '}') {
+        ++p;
+    } else {
+        for (;;) {
+            skip_json_space(&p, end);
+            char key[16];
+            if (p >= end || *p != '"' || bulk_parse_string(&p, end, key, sizeof(key)) != 0) {
+                return "invalid json";
+            }
+            skip_json_space(&p, end);
+            if (p >= end || *p != ':') {
+                return "invalid json";
+            }
+            ++p;
+            skip_json_space(&p, end);
+            char *field = NULL;
+            size_t field_size = 0U;
+            if (strcmp(key, "route") == 0) {
+                field = item->route;
+                field_size = sizeof(item->route);
+            } else if (strcmp(key, "q") == 0) {
+                field = item->question;
+                field_size = sizeof(item->question);
+            } else if (strcmp(key, "a") == 0) {
+                field = item->answer;
+                field_size = sizeof(item->answer);
+            } else if (strcmp(key, "rating") == 0) {
+                field = item->rating;
+                field_size = sizeof(item->rating);
+            }
+            if (p < end && *p == '"') {
+                char ignored[1];
+                if (bulk_parse_string(&p, end, field ? field : ignored, field ? field_size : sizeof(ignored)) != 0) {
+                    return "invalid json";
+                }
+            } else if (p < end && (*p == '{' || *p == '[')) {
+                return "nested values are not supported";
+            } else if (field) {
+                return "expected string value";
+            } else {
+                while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t') {
+                    ++p;
+                }
+            }
+            skip_json_space(&p, end);
+            if (p < end && *p == ',') {
+                ++p;
+                continue;
+            }
+            if (p < end && *p == '}') {
+                ++p;
+                break;
+            }
+            return "invalid json";
+        }
+    }
+    skip_json_space(&p, end);
+    if (p != end) {
+        return "invalid json";
+    }
+    if (strcmp(item->route, "teach") == 0) {
+        return item->question[0] && item->answer[0] ? NULL : "missing q or a";
+    }
+    if (strcmp(item->route, "feedback") == 0) {
+        return NULL;
+    }
+    return item->route[0] ? "unknown route" : "missing route";
+}
+
+static void bulk_commit(KolibriBulkBatch *batch) {
+    KolibriTeachDocument docs[KOLIBRI_BULK_BATCH];
+    size_t doc_items[KOLIBRI_BULK_BATCH];
+    size_t doc_count = 0U;
+    uint64_t started = monotonic_ns();
+    KOLIBRI_TRACE_BEGIN(span, "journal.enqueue");
+    for (size_t i = 0; i < batch->count; ++i) {
+        const KolibriBulkItem *item = &batch->items[i];
+        if (batch->errors[i]) {
+            continue;
+        }
+        char payload[512];
+        if (item->route[0] == 't') {
+            teach_payload(item->question, item->answer, payload, sizeof(payload));
+            journal_enqueue("TEACH", payload);
+            docs[doc_count].question = item->question;
+            docs[doc_count].answer = item->answer;
+            doc_items[doc_count++] = i;
+        } else {
+            feedback_payload(item->rating, item->question, item->answer, payload, sizeof(payload));
+            journal_enqueue("USER_FEEDBACK", payload);
+        }
+    }
+    KOLIBRI_TRACE_END(span);
+    if (kolibri_journal.running) {
+        journal_wake_writer(&kolibri_journal);
+    }
+    stage_record(KOLIBRI_STAGE_JOURNAL, started);
+    teach_add_documents(docs, doc_count);
+
+    size_t next_doc = 0U;
+    for (size_t i = 0; i < batch->count; ++i) {
+        const char *doc_id = NULL;
+        if (next_doc < doc_count && doc_items[next_doc] == i) {
+            if (docs[next_doc].added) {
+                doc_id = docs[next_doc].id;
+            } else {
+                batch->errors[i] = "index unavailable";
+            }
+            next_doc += 1U;
+        }
+        output_puts(batch->out, batch->accepted + batch->rejected > 0U ? "," : "");
+        if (batch->errors[i]) {
+            output_printf(batch->out, "{\"status\":\"error\",\"error\":\"%s\"}", batch->errors[i]);
+            batch->rejected += 1U;
+        } else {
+            if (doc_id) {
+                output_printf(batch->out, "{\"status\":\"ok\",\"id\":\"%s\"}", doc_id);
+            } else {
+                output_puts(batch->out, "{\"status\":\"ok\"}");
             }
-            return 0;
+            batch->accepted += 1U;
         }
-        output[0] = ch;
-        return 1;
     }
+    batch->count = 0U;
 }
 
-static void json_escape(const char *input, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
+static void bulk_accept_line(KolibriBulkBatch *batch, const char *line, size_t length, int overflow) {
+    while (length > 0U && isspace((unsigned char)line[length - 1U])) {
+        length -= 1U;
+    }
+    if (!overflow && length == 0U) {
         return;
     }
-    if (!input) {
-        output[0] = '\0';
+    if (batch->lines >= KOLIBRI_BULK_MAX_ITEMS) {
+        batch->truncated = 1;
         return;
     }
-    size_t out_index = 0;
-    for (size_t i = 0; input[i] != '\0' && out_index + 1 < out_size; ++i) {
-        size_t written = json_escape_char(input[i], output + out_index, out_size - out_index - 1U);
-        if (written == 0) {
-            break;
-        }
-        out_index += written;
+    batch->lines += 1U;
+    size_t slot = batch->count++;
+    batch->errors[slot] = overflow ? "line too long" : bulk_parse_item(line, length, &batch->items[slot]);
+    if (batch->count == KOLIBRI_BULK_BATCH) {
+        bulk_commit(batch);
     }
-    output[out_index] = '\0';
 }
 
-static void build_directories_json(char *buffer, size_t buffer_size) {
-    if (!buffer || buffer_size == 0) {
-        return;
-    }
-    if (buffer_size < 3U) {
-        buffer[0] = '\0';
+/* POST /api/knowledge/bulk: NDJSON-тело читается потоком прямо из сокета,
+ * ответ перечисляет статус каждой строки в исходном порядке. */
+static void handle_bulk_ingest(KolibriConnection *connection) {
+    const KolibriHttpRequest *request = &connection->request;
+    size_t request_end = request->header_len + request->content_length;
+    size_t buffered = (connection->length < request_end ? connection->length : request_end) - request->header_len;
+    size_t remaining = request->content_length - buffered;
+    KolibriBulkBatch *batch = (KolibriBulkBatch *)malloc(sizeof(KolibriBulkBatch));
+    char *line = (char *)malloc(KOLIBRI_BULK_LINE_MAX);
+    if (!batch || !line) {
+        free(batch);
+        free(line);
+        connection->keep_alive = 0;
+        send_response(connection, 503, "application/json", "{\"error\":\"out of memory\"}");
         return;
     }
-    size_t offset = 0U;
-    buffer[offset++] = '[';
-    for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
-        if (offset + 2U >= buffer_size) {
-            break;
-        }
-        if (i > 0U) {
-            buffer[offset++] = ',';
-            if (offset >= buffer_size) {
+    KolibriOutput items;
+    output_init(&items);
+    batch->count = 0U;
+    batch->lines = 0U;
+    batch->accepted = 0U;
+    batch->rejected = 0U;
+    batch->truncated = 0;
+    batch->out = &items;
+
+    size_t line_length = 0U;
+    int overflow = 0;
+    int complete = 1;
+    char chunk[16384];
+    const char *data = connection->buffer + request->header_len;
+    size_t data_length = buffered;
+    for (;;) {
+        const char *cursor = data;
+        const char *end = data + data_length;
+        while (cursor < end) {
+            const char *newline = memchr(cursor, '\n', (size_t)(end - cursor));
+            size_t piece = (size_t)((newline ? newline : end) - cursor);
+            if (line_length + piece > KOLIBRI_BULK_LINE_MAX) {
+                overflow = 1;
+            } else {
+                memcpy(line + line_length, cursor, piece);
+                line_length += piece;
+            }
+            if (!newline) {
                 break;
             }
+            bulk_accept_line(batch, line, line_length, overflow);
+            line_length = 0U;
+            overflow = 0;
+            cursor = newline + 1;
         }
-        buffer[offset++] = '"';
-        if (offset >= buffer_size) {
+        if (remaining == 0U) {
             break;
         }
-        char escaped[256];
-        json_escape(kolibri_knowledge_directories[i], escaped, sizeof(escaped));
-        size_t len = strlen(escaped);
-        if (len > buffer_size - offset - 2U) {
-            len = buffer_size - offset - 2U;
+        ssize_t received = recv(connection->fd, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
         }
-        memcpy(buffer + offset, escaped, len);
-        offset += len;
-        if (offset < buffer_size) {
-            buffer[offset++] = '"';
+        if (received <= 0) {
+            complete = 0;
+            break;
         }
+        remaining -= (size_t)received;
+        data = chunk;
+        data_length = (size_t)received;
     }
-    if (offset >= buffer_size - 1U) {
-        buffer[buffer_size - 1U] = '\0';
-        return;
-    }
-    buffer[offset++] = ']';
-    if (offset < buffer_size) {
-        buffer[offset] = '\0';
+    if (complete) {
+        bulk_accept_line(batch, line, line_length, overflow);
     } else {
-        buffer[buffer_size - 1U] = '\0';
-    }
-}
-
-static void prometheus_escape_label(const char *input, char *output, size_t out_size) {
-    if (!output || out_size == 0) {
-        return;
-    }
-    if (!input) {
-        output[0] = '\0';
-        return;
-    }
-    size_t out_index = 0U;
-    for (size_t i = 0; input[i] != '\0' && out_index + 1U < out_size; ++i) {
-        char ch = input[i];
-        if (ch == '\\' || ch == '"') {
-            if (out_index + 2U >= out_size) {
-                break;
-            }
-            output[out_index++] = '\\';
-            output[out_index++] = ch;
-        } else if (ch == '\n') {
-            if (out_index + 2U >= out_size) {
-                break;
-            }
-            output[out_index++] = '\\';
-            output[out_index++] = 'n';
-        } else {
-            output[out_index++] = ch;
-        }
+        /* Остаток тела потерян: соединение больше нельзя использовать для конвейера. */
+        connection->keep_alive = 0;
     }
-    output[out_index] = '\0';
-}
-
-
-static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
-    char buffer[KOLIBRI_REQUEST_BUFFER];
-    kolibri_requests_total += 1U;
-
-    struct timeval timeout;
-    timeout.tv_sec = 5;
-    timeout.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-
-    size_t header_len = 0U;
-    size_t content_len = 0U;
-    ssize_t total = receive_http_request(client_fd, buffer, sizeof(buffer), &header_len, &content_len);
-    if (total < 0) {
-        if (total == -2) {
-            send_response(client_fd, 408, "application/json", "{\"error\":\"timeout\"}");
-        } else if (total == -3 || total == -5) {
-            send_response(client_fd, 413, "application/json", "{\"error\":\"payload too large\"}");
-        } else {
-            send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        }
-        return;
+    if (batch->count > 0U) {
+        bulk_commit(batch);
     }
+    atomic_fetch_add(&kolibri_bulk_accepted, batch->accepted);
+    atomic_fetch_add(&kolibri_bulk_rejected, batch->rejected);
 
-    char *line_end = strstr(buffer, "\r\n");
-    if (!line_end) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        return;
+    KolibriOutput response;
+    output_init(&response);
+    output_printf(&response,
+                  "{%s\"accepted\":%zu,\"rejected\":%zu,\"truncated\":%s,\"items\":[",
+                  complete ? "" : "\"error\":\"incomplete body\",",
+                  batch->accepted,
+                  batch->rejected,
+                  batch->truncated ? "true" : "false");
+    output_append(&response, items.data, items.length);
+    output_puts(&response, "]}");
+    if (response.failed || items.failed) {
+        send_response(connection, 500, "application/json", "{\"error\":\"internal\"}");
+    } else {
+        send_response_bytes(connection, complete ? 200 : 400, "application/json", response.data, response.length);
     }
-    *line_end = '\0';
+    output_free(&response);
+    output_free(&items);
+    free(line);
+    free(batch);
+}
 
-    char method[8];
-    char *method_end = strchr(buffer, ' ');
-    if (!method_end) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        return;
-    }
-    size_t method_len = (size_t)(method_end - buffer);
-    if (method_len >= sizeof(method)) {
-        method_len = sizeof(method) - 1U;
-    }
-    memcpy(method, buffer, method_len);
-    method[method_len] = '\0';
+static void handle_request(KolibriConnection *connection, KolibriIndexHandle *handle) {
+    const KolibriHttpRequest *request = &connection->request;
+    KolibriKnowledgeIndex *index = handle ? handle->index : NULL;
+    atomic_fetch_add(&kolibri_requests_total, 1U);
 
-    char *path_start = method_end + 1;
-    char *version_start = strchr(path_start, ' ');
-    if (!version_start) {
-        send_response(client_fd, 400, "application/json", "{\"error\":\"bad request\"}");
-        return;
+    const char *method = request->method.data;
+    const char *path_start = request->path.data;
+    const char *body = connection->buffer + request->header_len;
+    if (connection->served + 1U >= KOLIBRI_KEEPALIVE_MAX_REQUESTS || !atomic_load(&kolibri_server_running)) {
+        connection->keep_alive = 0;
+    } else {
+        connection->keep_alive = request_wants_keep_alive(request);
     }
-    *version_start = '\0';
-
-    const char *header_start = line_end + 2;
-    size_t header_bytes = header_len > (size_t)(header_start - buffer) ? header_len - (size_t)(header_start - buffer) : 0U;
-    const char *body = buffer + header_len;
 
     size_t document_count = index ? kolibri_knowledge_index_document_count(index) : 0U;
 
     if (strcmp(method, "GET") == 0 &&
         (strcmp(path_start, "/healthz") == 0 || starts_with(path_start, "/api/knowledge/healthz"))) {
+        connection->route = KOLIBRI_ROUTE_HEALTHZ;
         char generated_iso[64];
         char bootstrap_iso[64];
         char generated_field[72];
         char bootstrap_field[72];
-        if (format_iso8601_utc(kolibri_index_timestamp, generated_iso, sizeof(generated_iso)) == 0) {
+        if (format_iso8601_utc(handle ? handle->timestamp : 0, generated_iso, sizeof(generated_iso)) == 0) {
             snprintf(generated_field, sizeof(generated_field), "\"%s\"", generated_iso);
         } else {
             strcpy(generated_field, "null");
@@ -1252,37 +3861,41 @@ static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
             strcpy(key_origin_field, "null");
         }
         char escaped_source[128];
-        json_escape(kolibri_index_source, escaped_source, sizeof(escaped_source));
+        json_escape(handle ? handle->source : "", escaped_source, sizeof(escaped_source));
         char escaped_cache[256];
         json_escape(kolibri_index_cache_dir, escaped_cache, sizeof(escaped_cache));
         char body_json[1280];
         int len = snprintf(body_json,
                            sizeof(body_json),
-                           "{\"status\":\"ok\",\"documents\":%zu,\"generatedAt\":%s,\"bootstrapGeneratedAt\":%s,"
+                           "{\"status\":\"ok\",\"documents\":%zu,\"pendingDocuments\":%zu,\"indexGeneration\":%llu,\"indexReloads\":%zu,\"generatedAt\":%s,\"bootstrapGeneratedAt\":%s,"
                            "\"requests\":%zu,\"hits\":%zu,\"misses\":%zu,\"uptimeSeconds\":%.0f,\"keyOrigin\":%s,\"indexRoots\":%s,\"indexSource\":\"%s\",\"indexCache\":\"%s\"}",
                            document_count,
+                           kolibri_knowledge_index_pending_count(index),
+                           handle ? (unsigned long long)handle->generation : 0ULL,
+                           atomic_load(&kolibri_publisher.reloads),
                            generated_field,
                            bootstrap_field,
-                           kolibri_requests_total,
-                           kolibri_search_hits,
-                           kolibri_search_misses,
+                           atomic_load(&kolibri_requests_total),
+                           atomic_load(&kolibri_search_hits),
+                           atomic_load(&kolibri_search_misses),
                            uptime,
                            key_origin_field,
                            directories_json,
                            escaped_source,
                            escaped_cache);
         if (len < 0 || (size_t)len >= sizeof(body_json)) {
-            send_response(client_fd, 500, "application/json", "{\"error\":\"internal\"}");
+            send_response(connection, 500, "application/json", "{\"error\":\"internal\"}");
             return;
         }
-        send_response(client_fd, 200, "application/json", body_json);
+        send_response(connection, 200, "application/json", body_json);
         return;
     }
 
     if (strcmp(method, "GET") == 0 &&
         (strcmp(path_start, "/metrics") == 0 || starts_with(path_start, "/api/knowledge/metrics"))) {
+        connection->route = KOLIBRI_ROUTE_METRICS;
         double bootstrap_generated = kolibri_bootstrap_timestamp > 0 ? (double)kolibri_bootstrap_timestamp : 0.0;
-        double index_generated = kolibri_index_timestamp > 0 ? (double)kolibri_index_timestamp : 0.0;
+        double index_generated = handle && handle->timestamp > 0 ? (double)handle->timestamp : 0.0;
         double uptime = 0.0;
         if (kolibri_server_started_at > 0) {
             uptime = difftime(time(NULL), kolibri_server_started_at);
@@ -1290,12 +3903,24 @@ static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
                 uptime = 0.0;
             }
         }
-        char body_metrics[4096];
+        char body_metrics[8192];
         int len = snprintf(body_metrics,
                            sizeof(body_metrics),
                            "# HELP kolibri_knowledge_documents Number of documents in knowledge index\n"
                            "# TYPE kolibri_knowledge_documents gauge\n"
                            "kolibri_knowledge_documents %zu\n"
+                           "# HELP kolibri_knowledge_pending_documents Documents in the live index segment awaiting merge\n"
+                           "# TYPE kolibri_knowledge_pending_documents gauge\n"
+                           "kolibri_knowledge_pending_documents %zu\n"
+                           "# HELP kolibri_knowledge_index_generation Generation of the index currently serving requests\n"
+                           "# TYPE kolibri_knowledge_index_generation gauge\n"
+                           "kolibri_knowledge_index_generation %llu\n"
+                           "# HELP kolibri_knowledge_index_reloads_total Hot index reloads swapped in\n"
+                           "# TYPE kolibri_knowledge_index_reloads_total counter\n"
+                           "kolibri_knowledge_index_reloads_total %zu\n"
+                           "# HELP kolibri_knowledge_index_reload_failures_total Hot index reloads that kept the previous index\n"
+                           "# TYPE kolibri_knowledge_index_reload_failures_total counter\n"
+                           "kolibri_knowledge_index_reload_failures_total %zu\n"
                            "# HELP kolibri_requests_total Total HTTP requests handled\n"
                            "# TYPE kolibri_requests_total counter\n"
                            "kolibri_requests_total %zu\n"
@@ -1319,66 +3944,90 @@ static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
                            "kolibri_knowledge_key_length_bytes %zu\n"
                            "# HELP kolibri_knowledge_directories_total Number of knowledge directories\n"
                            "# TYPE kolibri_knowledge_directories_total gauge\n"
-                           "kolibri_knowledge_directories_total %zu\n",
+                           "kolibri_knowledge_directories_total %zu\n"
+                           "# HELP kolibri_search_cache_hits_total Search responses served from the result cache\n"
+                           "# TYPE kolibri_search_cache_hits_total counter\n"
+                           "kolibri_search_cache_hits_total %zu\n"
+                           "# HELP kolibri_search_cache_misses_total Search requests that missed the result cache\n"
+                           "# TYPE kolibri_search_cache_misses_total counter\n"
+                           "kolibri_search_cache_misses_total %zu\n"
+                           "# HELP kolibri_search_cache_entries Entries currently held in the result cache\n"
+                           "# TYPE kolibri_search_cache_entries gauge\n"
+                           "kolibri_search_cache_entries %zu\n"
+                           "# HELP kolibri_journal_written_total Genome events written by the journal thread\n"
+                           "# TYPE kolibri_journal_written_total counter\n"
+                           "kolibri_journal_written_total %zu\n"
+                           "# HELP kolibri_journal_dropped_total Genome events dropped because the journal queue was full\n"
+                           "# TYPE kolibri_journal_dropped_total counter\n"
+                           "kolibri_journal_dropped_total %zu\n"
+                           "# HELP kolibri_journal_coalesced_total Genome events folded into COALESCED records\n"
+                           "# TYPE kolibri_journal_coalesced_total counter\n"
+                           "kolibri_journal_coalesced_total %zu\n"
+                           "# HELP kolibri_journal_queue_depth Genome events waiting in the journal queue\n"
+                           "# TYPE kolibri_journal_queue_depth gauge\n"
+                           "kolibri_journal_queue_depth %zu\n",
                            document_count,
-                           kolibri_requests_total,
-                           kolibri_search_hits,
-                           kolibri_search_misses,
+                           kolibri_knowledge_index_pending_count(index),
+                           handle ? (unsigned long long)handle->generation : 0ULL,
+                           atomic_load(&kolibri_publisher.reloads),
+                           atomic_load(&kolibri_publisher.failures),
+                           atomic_load(&kolibri_requests_total),
+                           atomic_load(&kolibri_search_hits),
+                           atomic_load(&kolibri_search_misses),
                            bootstrap_generated,
                            index_generated,
                            uptime,
                            kolibri_hmac_key_len,
-                           kolibri_knowledge_directory_count);
-        if (len < 0) {
-            send_response(client_fd, 500, "text/plain", "error");
+                           kolibri_knowledge_directory_count,
+                           atomic_load(&kolibri_search_cache_hits),
+                           atomic_load(&kolibri_search_cache_misses),
+                           search_cache_size(),
+                           atomic_load(&kolibri_journal_written),
+                           atomic_load(&kolibri_journal_dropped),
+                           atomic_load(&kolibri_journal_coalesced),
+                           journal_depth());
+        if (len < 0 || (size_t)len >= sizeof(body_metrics)) {
+            send_response(connection, 500, "text/plain", "error");
             return;
         }
-        size_t offset = (size_t)len;
-        for (size_t i = 0; i < kolibri_knowledge_directory_count && offset < sizeof(body_metrics); ++i) {
+        KolibriOutput metrics;
+        output_init(&metrics);
+        output_append(&metrics, body_metrics, (size_t)len);
+        for (size_t i = 0; i < kolibri_knowledge_directory_count; ++i) {
             char label[256];
             prometheus_escape_label(kolibri_knowledge_directories[i], label, sizeof(label));
-            int written = snprintf(body_metrics + offset,
-                                   sizeof(body_metrics) - offset,
-                                   "kolibri_knowledge_directory_info{path=\"%s\"} 1\n",
-                                   label);
-            if (written < 0 || (size_t)written >= sizeof(body_metrics) - offset) {
-                send_response(client_fd, 500, "text/plain", "error");
-                return;
-            }
-            offset += (size_t)written;
+            output_printf(&metrics, "kolibri_knowledge_directory_info{path=\"%s\"} 1\n", label);
         }
         if (kolibri_hmac_key_origin[0] != '\0') {
             char origin_label[256];
             prometheus_escape_label(kolibri_hmac_key_origin, origin_label, sizeof(origin_label));
-            int written = snprintf(body_metrics + offset,
-                                   sizeof(body_metrics) - offset,
-                                   "kolibri_knowledge_hmac_key_info{origin=\"%s\"} 1\n",
-                                   origin_label);
-            if (written < 0 || (size_t)written >= sizeof(body_metrics) - offset) {
-                send_response(client_fd, 500, "text/plain", "error");
-                return;
-            }
-            offset += (size_t)written;
+            output_printf(&metrics, "kolibri_knowledge_hmac_key_info{origin=\"%s\"} 1\n", origin_label);
+        }
+        output_service_metrics(&metrics, index);
+        if (metrics.failed) {
+            output_free(&metrics);
+            send_response(connection, 500, "text/plain", "error");
+            return;
         }
-        send_response(client_fd, 200, "text/plain; version=0.0.4", body_metrics);
+        send_response_bytes(connection, 200, "text/plain; version=0.0.4", metrics.data, metrics.length);
+        output_free(&metrics);
         return;
     }
 
     if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/feedback") == 0) {
-        int auth_status = require_admin_token(header_start, header_bytes);
+        connection->route = KOLIBRI_ROUTE_FEEDBACK;
+        int auth_status = require_admin_token(request);
         if (auth_status != 0) {
             if (auth_status == 503) {
-                send_response(client_fd, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+                send_response(connection, 503, "application/json", "{\"error\":\"admin token not configured\"}");
             } else if (auth_status == 401) {
-                send_response(client_fd, 401, "application/json", "{\"error\":\"unauthorized\"}");
+                send_response(connection, 401, "application/json", "{\"error\":\"unauthorized\"}");
             } else {
-                send_response(client_fd, 403, "application/json", "{\"error\":\"forbidden\"}");
+                send_response(connection, 403, "application/json", "{\"error\":\"forbidden\"}");
             }
             return;
         }
-        time_t now = time(NULL);
-        if (!rate_limiter_allow(&kolibri_feedback_rate, now, KOLIBRI_RATE_LIMIT_BURST)) {
-            send_response(client_fd, 429, "application/json", "{\"error\":\"rate limited\"}");
+        if (!rate_limit_admit(&kolibri_feedback_rate, connection)) {
             return;
         }
         char rating[64];
@@ -1395,37 +4044,27 @@ static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
         decoded_a[sizeof(decoded_a) - 1U] = '\0';
         url_decode(decoded_q);
         url_decode(decoded_a);
-        const char *rating_value = rating[0] ? rating : "unknown";
         char payload[512];
-        snprintf(payload,
-                 sizeof(payload),
-                 "rating=%.*s q=%.*s a=%.*s",
-                 64,
-                 rating_value,
-                 192,
-                 decoded_q,
-                 192,
-                 decoded_a);
+        feedback_payload(rating, decoded_q, decoded_a, payload, sizeof(payload));
         knowledge_record_event("USER_FEEDBACK", payload);
-        send_response(client_fd, 200, "application/json", "{\"status\":\"ok\"}");
+        send_response(connection, 200, "application/json", "{\"status\":\"ok\"}");
         return;
     }
 
     if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/teach") == 0) {
-        int auth_status = require_admin_token(header_start, header_bytes);
+        connection->route = KOLIBRI_ROUTE_TEACH;
+        int auth_status = require_admin_token(request);
         if (auth_status != 0) {
             if (auth_status == 503) {
-                send_response(client_fd, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+                send_response(connection, 503, "application/json", "{\"error\":\"admin token not configured\"}");
             } else if (auth_status == 401) {
-                send_response(client_fd, 401, "application/json", "{\"error\":\"unauthorized\"}");
+                send_response(connection, 401, "application/json", "{\"error\":\"unauthorized\"}");
             } else {
-                send_response(client_fd, 403, "application/json", "{\"error\":\"forbidden\"}");
+                send_response(connection, 403, "application/json", "{\"error\":\"forbidden\"}");
             }
             return;
         }
-        time_t now = time(NULL);
-        if (!rate_limiter_allow(&kolibri_teach_rate, now, KOLIBRI_RATE_LIMIT_BURST)) {
-            send_response(client_fd, 429, "application/json", "{\"error\":\"rate limited\"}");
+        if (!rate_limit_admit(&kolibri_teach_rate, connection)) {
             return;
         }
         char question[512];
@@ -1433,119 +4072,449 @@ static void handle_client(int client_fd, const KolibriKnowledgeIndex *index) {
         parse_form_field(body, "q", question, sizeof(question));
         parse_form_field(body, "a", answer, sizeof(answer));
         if (question[0] == '\0' || answer[0] == '\0') {
-            send_response(client_fd, 400, "application/json", "{\"error\":\"missing q or a\"}");
+            send_response(connection, 400, "application/json", "{\"error\":\"missing q or a\"}");
             return;
         }
         char payload[512];
-        snprintf(payload, sizeof(payload), "q=%.*s a=%.*s", 200, question, 200, answer);
+        teach_payload(question, answer, payload, sizeof(payload));
         knowledge_record_event("TEACH", payload);
-        send_response(client_fd, 200, "application/json", "{\"status\":\"ok\"}");
+        KolibriTeachDocument doc = { question, answer, "", 0 };
+        teach_add_documents(&doc, 1U);
+        send_response(connection, 200, "application/json", "{\"status\":\"ok\"}");
+        return;
+    }
+
+    if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/bulk") == 0) {
+        connection->route = KOLIBRI_ROUTE_BULK;
+        /* Непрочитанное тело нельзя пропустить, поэтому отказ закрывает соединение. */
+        connection->keep_alive = 0;
+        int auth_status = require_admin_token(request);
+        if (auth_status != 0) {
+            if (auth_status == 503) {
+                send_response(connection, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+            } else if (auth_status == 401) {
+                send_response(connection, 401, "application/json", "{\"error\":\"unauthorized\"}");
+            } else {
+                send_response(connection, 403, "application/json", "{\"error\":\"forbidden\"}");
+            }
+            return;
+        }
+        if (!rate_limit_admit(&kolibri_teach_rate, connection)) {
+            return;
+        }
+        connection->keep_alive = connection->served + 1U < KOLIBRI_KEEPALIVE_MAX_REQUESTS && atomic_load(&kolibri_server_running) &&
+                                 request_wants_keep_alive(request);
+        handle_bulk_ingest(connection);
+        return;
+    }
+
+    if (strcmp(method, "POST") == 0 && strcmp(path_start, "/api/knowledge/reload") == 0) {
+        connection->route = KOLIBRI_ROUTE_RELOAD;
+        int auth_status = require_admin_token(request);
+        if (auth_status != 0) {
+            if (auth_status == 503) {
+                send_response(connection, 503, "application/json", "{\"error\":\"admin token not configured\"}");
+            } else if (auth_status == 401) {
+                send_response(connection, 401, "application/json", "{\"error\":\"unauthorized\"}");
+            } else {
+                send_response(connection, 403, "application/json", "{\"error\":\"forbidden\"}");
+            }
+            return;
+        }
+        if (index_reload_request() != 0) {
+            send_response(connection, 503, "application/json", "{\"error\":\"reload unavailable\"}");
+            return;
+        }
+        send_response(connection, 202, "application/json", "{\"status\":\"reloading\"}");
         return;
     }
 
     if (!(strcmp(method, "GET") == 0 && starts_with(path_start, "/api/knowledge/search"))) {
-        send_response(client_fd, 404, "application/json", "{\"error\":\"not found\"}");
+        send_response(connection, 404, "application/json", "{\"error\":\"not found\"}");
         return;
     }
+    connection->route = KOLIBRI_ROUTE_SEARCH;
 
     char query[512];
     size_t limit = 3U;
-    parse_query(path_start, query, sizeof(query), &limit);
+    unsigned search_flags = 0U;
+    parse_query(request->query, query, sizeof(query), &limit, &search_flags);
+    if (limit > KOLIBRI_SEARCH_LIMIT_MAX) {
+        limit = KOLIBRI_SEARCH_LIMIT_MAX;
+    }
+    if (*query && kolibri_shard_count > 0U) {
+        /* Фронт не ищет сам: кеш и журнал остаются на шардах. */
+        KolibriOutput merged;
+        output_init(&merged);
+        uint64_t fanout_started = monotonic_ns();
+        size_t answered = shard_search(query, limit, search_flags, &merged);
+        stage_record(KOLIBRI_STAGE_SEARCH, fanout_started);
+        if (merged.failed) {
+            send_response(connection, 500, "application/json", "{\"error\":\"internal\"}");
+        } else {
+            send_response_bytes(connection, answered > 0U ? 200 : 503, "application/json", merged.data, merged.length);
+        }
+        output_free(&merged);
+        return;
+    }
     if (!*query || !index) {
-        kolibri_search_misses += 1U;
-        send_response(client_fd, 200, "application/json", "{\"snippets\":[]}");
+        atomic_fetch_add(&kolibri_search_misses, 1U);
+        send_response(connection, 200, "application/json", "{\"snippets\":[]}");
         return;
     }
-    if (limit > 16U) {
-        limit = 16U;
+
+    char cache_key[600];
+    int cache_key_ready = search_cache_key(query, limit, search_flags, cache_key, sizeof(cache_key)) == 0;
+    uint64_t epoch = atomic_load(&kolibri_index_epoch);
+    if (cache_key_ready) {
+        KolibriCachedBody *cached = search_cache_lookup(cache_key, handle->generation);
+        if (cached) {
+            atomic_fetch_add(cached->doc_count > 0U ? &kolibri_search_hits : &kolibri_search_misses, 1U);
+            send_response_bytes(connection, 200, "application/json", cached->data, cached->length);
+            uint64_t journal_started = monotonic_ns();
+            journal_search(index, query, cached->docs, cached->doc_count);
+            stage_record(KOLIBRI_STAGE_JOURNAL, journal_started);
+            cached_body_release(cached);
+            return;
+        }
     }
 
-    size_t indices[16];
-    float scores[16];
+    size_t indices[KOLIBRI_SEARCH_LIMIT_MAX];
+    float scores[KOLIBRI_SEARCH_LIMIT_MAX];
     size_t result_count = 0U;
-    int search_err = kolibri_knowledge_index_search(index, query, limit, indices, scores, &result_count);
+    uint64_t stage_started = monotonic_ns();
+    int search_err =
+        kolibri_knowledge_index_search_flags(index, query, limit, search_flags, indices, scores, &result_count);
+    stage_record(KOLIBRI_STAGE_SEARCH, stage_started);
     if (search_err != 0) {
-        send_response(client_fd, 500, "application/json", "{\"error\":\"search failed\"}");
+        send_response(connection, 500, "application/json", "{\"error\":\"search failed\"}");
         return;
     }
 
-    char response[KOLIBRI_RESPONSE_BUFFER];
-    size_t offset = 0U;
-    offset += (size_t)snprintf(response + offset, sizeof(response) - offset, "{\"snippets\":[");
-    for (size_t i = 0; i < result_count && offset < sizeof(response); ++i) {
+    stage_started = monotonic_ns();
+    KOLIBRI_TRACE_BEGIN(serialize_span, "search.serialize");
+    KolibriOutput response;
+    output_init(&response);
+    output_puts(&response, "{\"snippets\":[");
+    int first = 1;
+    for (size_t i = 0; i < result_count; ++i) {
         const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
         if (!doc) {
             continue;
         }
-        const char *separator = (i + 1U < result_count) ? "," : "";
-        char id_buf[256];
-        char title_buf[512];
-        char content_buf[1024];
-        char source_buf[512];
-        json_escape(doc->id ? doc->id : "", id_buf, sizeof(id_buf));
-        json_escape(doc->title ? doc->title : "", title_buf, sizeof(title_buf));
-        json_escape(doc->content ? doc->content : "", content_buf, sizeof(content_buf));
-        json_escape(doc->source ? doc->source : "", source_buf, sizeof(source_buf));
-        offset += (size_t)snprintf(response + offset,
-                                   sizeof(response) - offset,
-                                   "{\"id\":\"%s\",\"title\":\"%s\",\"content\":\"%s\",\"source\":\"%s\",\"score\":%.3f}%s",
-                                   id_buf,
-                                   title_buf,
-                                   content_buf,
-                                   source_buf,
-                                   scores[i],
-                                   separator);
-    }
+        /* Индекс хранит уже экранированные поля документа. */
+        output_puts(&response, first ? "{" : ",{");
+        first = 0;
+        output_append(&response, doc->json, doc->json_length);
+        output_printf(&response, ",\"score\":%.3f}", scores[i]);
+    }
+    output_puts(&response, "]}");
+    stage_record(KOLIBRI_STAGE_SERIALIZE, stage_started);
+    KOLIBRI_TRACE_END(serialize_span);
     if (result_count == 0U) {
-        kolibri_search_misses += 1U;
+        atomic_fetch_add(&kolibri_search_misses, 1U);
     } else {
-        kolibri_search_hits += 1U;
+        atomic_fetch_add(&kolibri_search_hits, 1U);
     }
+    if (response.failed) {
+        output_free(&response);
+        send_response(connection, 500, "application/json", "{\"error\":\"internal\"}");
+        return;
+    }
+
+    send_response_bytes(connection, 200, "application/json", response.data, response.length);
+
+    if (cache_key_ready) {
+        search_cache_store(cache_key, cached_body_create(response.data, response.length, indices, result_count,
+                                                         handle->generation, epoch));
+    }
+    output_free(&response);
+    stage_started = monotonic_ns();
+    journal_search(index, query, indices, result_count);
+    stage_record(KOLIBRI_STAGE_JOURNAL, stage_started);
+}
 
-    if (offset >= sizeof(response) - 2U) {
-        offset = sizeof(response) - 3U;
+static void request_record(const KolibriConnection *connection, uint64_t started_ns) {
+    latency_record(&kolibri_route_latency[connection->route], monotonic_ns() - started_ns);
+    int status_class = connection->status / 100;
+    if (status_class >= 1 && status_class <= 5) {
+        atomic_fetch_add_explicit(&kolibri_route_responses[connection->route][status_class - 1], 1U,
+                                  memory_order_relaxed);
     }
-    offset += (size_t)snprintf(response + offset, sizeof(response) - offset, "]}");
-    response[sizeof(response) - 1U] = '\0';
+}
 
-    send_response(client_fd, 200, "application/json", response);
+static void connection_close(int fd) {
+    close(fd);
+    atomic_fetch_sub(&kolibri_connections_open, 1U);
+}
 
-    if (kolibri_genome_ready) {
-        char ask_payload[512];
-        int query_limit = (int)sizeof(ask_payload) - 3;
-        if (query_limit < 0) {
-            query_limit = 0;
+static int idle_pool_init(KolibriIdlePool *pool) {
+    pool->count = 0U;
+    pool->wake[0] = -1;
+    pool->wake[1] = -1;
+    pthread_mutex_init(&pool->lock, NULL);
+    if (pipe(pool->wake) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < 2U; ++i) {
+        int flags = fcntl(pool->wake[i], F_GETFL, 0);
+        fcntl(pool->wake[i], F_SETFL, flags | O_NONBLOCK);
+    }
+    return 0;
+}
+
+static void idle_pool_destroy(KolibriIdlePool *pool) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        connection_close(pool->items[i].fd);
+    }
+    atomic_fetch_sub(&kolibri_connections_idle, pool->count);
+    pool->count = 0U;
+    for (size_t i = 0; i < 2U; ++i) {
+        if (pool->wake[i] >= 0) {
+            close(pool->wake[i]);
         }
-        snprintf(ask_payload, sizeof(ask_payload), "q=%.*s", query_limit, query);
-        knowledge_record_event("ASK", ask_payload);
-        size_t replay = result_count < 3U ? result_count : 3U;
-        for (size_t i = 0; i < replay; ++i) {
-            const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[i]);
-            if (!doc) {
-                continue;
+    }
+    pthread_mutex_destroy(&pool->lock);
+}
+
+/* Полный пул закрывает соединение, как истёкший тайм-аут простоя. */
+static int idle_pool_park(KolibriIdlePool *pool, const KolibriConnection *connection) {
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == KOLIBRI_IDLE_CONNECTIONS) {
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
+    }
+    KolibriQueuedConnection *item = &pool->items[pool->count];
+    item->fd = connection->fd;
+    item->client = connection->client;
+    item->served = connection->served;
+    pool->deadlines[pool->count] = monotonic_ns() + (uint64_t)kolibri_keepalive_timeout_ms * 1000000ULL;
+    pool->count += 1U;
+    pthread_mutex_unlock(&pool->lock);
+    atomic_fetch_add(&kolibri_connections_idle, 1U);
+    char byte = 0;
+    ssize_t written = write(pool->wake[1], &byte, 1U);
+    (void)written;
+    return 1;
+}
+
+static void idle_pool_remove(KolibriIdlePool *pool, size_t index) {
+    pool->count -= 1U;
+    pool->items[index] = pool->items[pool->count];
+    pool->deadlines[index] = pool->deadlines[pool->count];
+    atomic_fetch_sub(&kolibri_connections_idle, 1U);
+}
+
+/* Закрывает просроченные соединения и раскладывает остальные в fds; в timeout_ms
+ * попадает время до ближайшего срока или -1. */
+static size_t idle_pool_prepare(KolibriIdlePool *pool, struct pollfd *fds, int *timeout_ms) {
+    uint64_t now = monotonic_ns();
+    uint64_t nearest = UINT64_MAX;
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = pool->count; i-- > 0U;) {
+        if (pool->deadlines[i] <= now) {
+            connection_close(pool->items[i].fd);
+            idle_pool_remove(pool, i);
+        }
+    }
+    for (size_t i = 0; i < pool->count; ++i) {
+        fds[i].fd = pool->items[i].fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+        if (pool->deadlines[i] < nearest) {
+            nearest = pool->deadlines[i];
+        }
+    }
+    size_t watched = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+    if (nearest == UINT64_MAX) {
+        *timeout_ms = -1;
+    } else {
+        uint64_t wait_ms = (nearest - now + 999999ULL) / 1000000ULL;
+        *timeout_ms = wait_ms > (uint64_t)INT32_MAX ? INT32_MAX : (int)wait_ms;
+    }
+    return watched;
+}
+
+/* Соединения с данными или закрытые клиентом уходят обратно в очередь обработчиков.
+ * Обход с конца: перенос последней записи на место удалённой не задевает ещё
+ * не проверенные записи. */
+static size_t idle_pool_take_ready(KolibriIdlePool *pool,
+                                   const struct pollfd *fds,
+                                   size_t watched,
+                                   KolibriQueuedConnection *ready) {
+    size_t taken = 0U;
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = watched; i-- > 0U;) {
+        if (fds[i].revents != 0) {
+            ready[taken++] = pool->items[i];
+            idle_pool_remove(pool, i);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return taken;
+}
+
+static void handle_client(const KolibriQueuedConnection *queued, KolibriIdlePool *idle) {
+    int client_fd = queued->fd;
+    KolibriConnection connection;
+    connection.fd = client_fd;
+    connection.client = queued->client;
+    connection.length = 0U;
+    connection.served = queued->served;
+    connection.keep_alive = 0;
+    connection.buffer[0] = '\0';
+    http_request_reset(&connection.request);
+    if (connection.served == 0U) {
+        struct timeval timeout;
+        timeout.tv_sec = 5;
+        timeout.tv_usec = 0;
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        if (getpeername(client_fd, (struct sockaddr *)&peer, &peer_len) == 0 && peer.sin_family == AF_INET) {
+            connection.client = ntohl(peer.sin_addr.s_addr);
+        }
+    }
+    int parked = 0;
+
+    while (1) {
+        ssize_t total = receive_http_request(&connection);
+        if (total == -7) {
+            break;
+        }
+        uint64_t started = monotonic_ns();
+        connection.route = KOLIBRI_ROUTE_INVALID;
+        connection.status = 0;
+        if (total < 0) {
+            connection.keep_alive = 0;
+            if (total == -2) {
+                send_response(&connection, 408, "application/json", "{\"error\":\"timeout\"}");
+            } else if (total == -3 || total == -5) {
+                send_response(&connection, 413, "application/json", "{\"error\":\"payload too large\"}");
+            } else if (total == -8) {
+                send_response(&connection, 431, "application/json", "{\"error\":\"too many headers\"}");
+            } else {
+                send_response(&connection, 400, "application/json", "{\"error\":\"bad request\"}");
             }
-            const char *answer_src = doc->content ? doc->content : "";
-            char *preview = snippet_preview(answer_src, 200U);
-            char teach_payload[512];
-            int remaining = (int)sizeof(teach_payload) - 1 - 5;
-            if (remaining < 0) {
-                remaining = 0;
+            request_record(&connection, started);
+            break;
+        }
+        latency_record(&kolibri_stage_latency[KOLIBRI_STAGE_PARSE], connection.request.parse_ns);
+
+        /* Тело завершается нулём на месте: отделяем его от следующего конвейерного
+         * запроса и восстанавливаем байт после ответа. */
+        size_t request_len = (size_t)total;
+        char saved = connection.buffer[request_len];
+        connection.buffer[request_len] = '\0';
+        connection.route = KOLIBRI_ROUTE_NOT_FOUND;
+        atomic_fetch_add(&kolibri_requests_in_flight, 1U);
+        KolibriIndexHandle *handle = index_acquire();
+        KOLIBRI_TRACE_BEGIN(request_span, "http.request");
+        handle_request(&connection, handle);
+        KOLIBRI_TRACE_END(request_span);
+        index_handle_release(handle);
+        atomic_fetch_sub(&kolibri_requests_in_flight, 1U);
+        request_record(&connection, started);
+        connection.buffer[request_len] = saved;
+        connection.served += 1U;
+
+        if (!connection.keep_alive) {
+            break;
+        }
+        connection.length -= request_len;
+        memmove(connection.buffer, connection.buffer + request_len, connection.length);
+        connection.buffer[connection.length] = '\0';
+        http_request_reset(&connection.request);
+        /* Следующего запроса ещё нет: обработчик не ждёт его, а отдаёт соединение пулу простоя. */
+        if (connection.length == 0U) {
+            struct pollfd pending = { connection.fd, POLLIN, 0 };
+            if (poll(&pending, 1, 0) == 0) {
+                parked = idle_pool_park(idle, &connection);
+                break;
             }
-            int teach_q_limit = remaining > 0 ? remaining / 2 : 0;
-            int teach_a_limit = remaining - teach_q_limit;
-            snprintf(teach_payload,
-                     sizeof(teach_payload),
-                     "q=%.*s a=%.*s",
-                     teach_q_limit,
-                     query,
-                     teach_a_limit,
-                     preview ? preview : "");
-            knowledge_record_event("TEACH", teach_payload);
-            free(preview);
         }
     }
+    if (!parked) {
+        connection_close(client_fd);
+    }
+}
+
+static void connection_queue_init(KolibriConnectionQueue *queue) {
+    queue->head = 0U;
+    queue->count = 0U;
+    queue->closing = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+static void connection_queue_destroy(KolibriConnectionQueue *queue) {
+    for (size_t i = 0; i < queue->count; ++i) {
+        connection_close(queue->items[(queue->head + i) % KOLIBRI_CONNECTION_QUEUE].fd);
+    }
+    queue->count = 0U;
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+}
+
+/* Блокирует accept-цикл, пока все обработчики заняты и очередь заполнена. */
+static void connection_queue_push(KolibriConnectionQueue *queue, const KolibriQueuedConnection *item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == KOLIBRI_CONNECTION_QUEUE && !queue->closing) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->closing) {
+        pthread_mutex_unlock(&queue->lock);
+        connection_close(item->fd);
+        return;
+    }
+    queue->items[(queue->head + queue->count) % KOLIBRI_CONNECTION_QUEUE] = *item;
+    queue->count += 1U;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static int connection_queue_pop(KolibriConnectionQueue *queue, KolibriQueuedConnection *item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0U && !queue->closing) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count == 0U) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    *item = queue->items[queue->head];
+    queue->head = (queue->head + 1U) % KOLIBRI_CONNECTION_QUEUE;
+    queue->count -= 1U;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+static void connection_queue_close(KolibriConnectionQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closing = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
 }
 
+static void *connection_worker(void *arg) {
+    KolibriWorkerContext *context = (KolibriWorkerContext *)arg;
+    while (1) {
+        KolibriQueuedConnection item;
+        if (connection_queue_pop(context->queue, &item) != 0) {
+            break;
+        }
+        handle_client(&item, context->idle);
+    }
+    return NULL;
+}
 
 int main(int argc, char **argv) {
     kolibri_server_started_at = time(NULL);
@@ -1567,22 +4536,24 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    KolibriKnowledgeIndex *index = NULL;
-    int index_status = load_or_build_index(&index);
-    if (index_status != 0 || !index) {
+    KolibriIndexHandle *index = index_handle_create();
+    int index_status = index ? load_or_build_index(index) : ENOMEM;
+    if (index_status != 0 || !index->index) {
         fprintf(stderr, "[kolibri-knowledge] failed to prepare knowledge index (err=%d)\n", index_status);
+        index_handle_release(index);
         free_knowledge_directories();
         return 1;
     }
 
-    size_t document_count = kolibri_knowledge_index_document_count(index);
-    fprintf(stdout, "[kolibri-knowledge] loaded %zu documents (%s)\n", document_count, kolibri_index_source);
+    size_t document_count = kolibri_knowledge_index_document_count(index->index);
+    fprintf(stdout, "[kolibri-knowledge] loaded %zu documents (%s)\n", document_count, index->source);
     if (document_count > 0U) {
-        write_bootstrap_script(index, KOLIBRI_BOOTSTRAP_SCRIPT);
+        write_bootstrap_script(index->index, KOLIBRI_BOOTSTRAP_SCRIPT);
     }
+    index_publish(index);
 
     if (kolibri_genome_init_or_open() != 0) {
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1591,10 +4562,20 @@ int main(int argc, char **argv) {
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handle_signal;
     sigemptyset(&sa.sa_mask);
-    if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0) {
+    struct sigaction ignore_pipe;
+    memset(&ignore_pipe, 0, sizeof(ignore_pipe));
+    ignore_pipe.sa_handler = SIG_IGN;
+    sigemptyset(&ignore_pipe.sa_mask);
+    /* Клиент, закрывший соединение раньше ответа, не должен завершать весь сервер. */
+    struct sigaction reload;
+    memset(&reload, 0, sizeof(reload));
+    reload.sa_handler = handle_reload_signal;
+    sigemptyset(&reload.sa_mask);
+    if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0 ||
+        sigaction(SIGHUP, &reload, NULL) != 0 || sigaction(SIGPIPE, &ignore_pipe, NULL) != 0) {
         perror("sigaction");
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1603,7 +4584,7 @@ int main(int argc, char **argv) {
     if (server_fd < 0) {
         perror("socket");
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1617,7 +4598,7 @@ int main(int argc, char **argv) {
         fprintf(stderr, "[kolibri-knowledge] invalid bind address: %s\n", kolibri_bind_address);
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1626,7 +4607,7 @@ int main(int argc, char **argv) {
         perror("bind");
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
@@ -1634,17 +4615,108 @@ int main(int argc, char **argv) {
         perror("listen");
         close(server_fd);
         kolibri_genome_close();
-        kolibri_knowledge_index_destroy(index);
+        index_publish(NULL);
+        free_knowledge_directories();
+        return 1;
+    }
+
+    /* Без KOLIBRI_TRACE_PATH спаны не пишутся; ошибка трассировки не мешает работе. */
+    kolibri_trace_start_from_env();
+    if (kolibri_worker_count == 0U) {
+        kolibri_worker_count = default_worker_count();
+    }
+    search_cache_init(kolibri_search_cache_capacity);
+    KolibriConnectionQueue queue;
+    connection_queue_init(&queue);
+    KolibriIdlePool idle;
+    int idle_ready = idle_pool_init(&idle) == 0;
+    if (!idle_ready) {
+        perror("pipe");
+    }
+    KolibriWorkerContext worker_context = { &queue, &idle };
+    pthread_t workers[KOLIBRI_MAX_WORKERS];
+    size_t workers_started = 0U;
+
+    /* Сигналы остановки должен получать только accept-цикл, иначе его poll не прервётся. */
+    sigset_t blocked;
+    sigset_t previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (size_t i = 0; idle_ready && i < kolibri_worker_count; ++i) {
+        if (pthread_create(&workers[i], NULL, connection_worker, &worker_context) != 0) {
+            fprintf(stderr, "[kolibri-knowledge] failed to start worker %zu\n", i);
+            break;
+        }
+        workers_started += 1U;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (workers_started > 0U) {
+        segment_merger_start();
+        index_reloader_start();
+    }
+    if (workers_started == 0U) {
+        connection_queue_destroy(&queue);
+        idle_pool_destroy(&idle);
+        close(server_fd);
+        kolibri_genome_close();
+        kolibri_trace_stop();
+        index_publish(NULL);
         free_knowledge_directories();
         return 1;
     }
 
     fprintf(stdout,
-            "[kolibri-knowledge] listening on http://%s:%d\n",
+            "[kolibri-knowledge] listening on http://%s:%d (%zu workers, journal %s)\n",
             kolibri_bind_address,
-            kolibri_server_port);
+            kolibri_server_port,
+            workers_started,
+            journal_policy_name(kolibri_journal_policy));
+    if (kolibri_shard_count > 0U) {
+        fprintf(stdout,
+                "[kolibri-knowledge] fanning search out to %zu shards (timeout %d ms)\n",
+                kolibri_shard_count,
+                kolibri_shard_timeout_ms);
+    }
 
-    while (kolibri_server_running) {
+    /* Первые два места — сокет сервера и wake пула простоя, дальше простаивающие соединения. */
+    static struct pollfd watch[2U + KOLIBRI_IDLE_CONNECTIONS];
+    static KolibriQueuedConnection ready[KOLIBRI_IDLE_CONNECTIONS];
+    while (atomic_load(&kolibri_server_running)) {
+        int timeout_ms = -1;
+        size_t watched = idle_pool_prepare(&idle, watch + 2, &timeout_ms);
+        watch[0].fd = server_fd;
+        watch[0].events = POLLIN;
+        watch[0].revents = 0;
+        watch[1].fd = idle.wake[0];
+        watch[1].events = POLLIN;
+        watch[1].revents = 0;
+        int polled = poll(watch, 2U + watched, timeout_ms);
+        if (kolibri_reload_requested) {
+            kolibri_reload_requested = 0;
+            index_reload_request();
+        }
+        if (polled < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if (watch[1].revents != 0) {
+            char drain[64];
+            while (read(idle.wake[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        size_t taken = idle_pool_take_ready(&idle, watch + 2, watched, ready);
+        for (size_t i = 0; i < taken; ++i) {
+            connection_queue_push(&queue, &ready[i]);
+        }
+        if (watch[0].revents == 0) {
+            continue;
+        }
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &client_len);
@@ -1655,13 +4727,24 @@ int main(int argc, char **argv) {
             perror("accept");
             break;
         }
-        handle_client(client_fd, index);
-        close(client_fd);
+        atomic_fetch_add(&kolibri_connections_open, 1U);
+        KolibriQueuedConnection accepted = { client_fd, 0U, 0U };
+        connection_queue_push(&queue, &accepted);
     }
 
+    connection_queue_close(&queue);
+    for (size_t i = 0; i < workers_started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    connection_queue_destroy(&queue);
+    idle_pool_destroy(&idle);
+    index_reloader_stop();
+    segment_merger_stop();
+    search_cache_free();
     close(server_fd);
     kolibri_genome_close();
-    kolibri_knowledge_index_destroy(index);
+    kolibri_trace_stop();
+    index_publish(NULL);
     free_knowledge_directories();
     fprintf(stdout, "[kolibri-knowledge] shutdown\n");
     return 0;
@@ -0,0 +1,200 @@
+#include "kolibri/memory.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KOLIBRI_MEMORY_MAGIC 0x4b4d454dU
+
+/* Заголовок перед каждым блоком; выравнивание сохраняет гарантии malloc. */
+typedef struct {
+    _Alignas(max_align_t) size_t size;
+    uint32_t subsystem;
+    uint32_t magic;
+} KolibriBlockHeader;
+
+/* Счётчики подсистем разнесены по строкам кэша. */
+typedef struct {
+    _Alignas(64) _Atomic uint64_t live_bytes;
+    _Atomic uint64_t peak_bytes;
+    _Atomic uint64_t live_allocations;
+    _Atomic uint64_t total_allocations;
+    _Atomic uint64_t failed_allocations;
+} KolibriMemoryCounters;
+
+static KolibriMemoryCounters kolibri_memory_counters[KOLIBRI_MEMORY_SUBSYSTEM_COUNT];
+
+static const char *const kolibri_memory_names[KOLIBRI_MEMORY_SUBSYSTEM_COUNT] = {
+    "knowledge_index",
+    "sigma",
+    "formula",
+    "script",
+};
+
+static void *default_malloc(void *user_data, size_t size) {
+    (void)user_data;
+    return malloc(size);
+}
+
+static void *default_realloc(void *user_data, void *ptr, size_t size) {
+    (void)user_data;
+    return realloc(ptr, size);
+}
+
+static void default_free(void *user_data, void *ptr) {
+    (void)user_data;
+    free(ptr);
+}
+
+static KolibriAllocator kolibri_allocator = { default_malloc, default_realloc, default_free, NULL };
+
+static KolibriMemoryCounters *counters_for(KolibriMemorySubsystem subsystem) {
+    unsigned index = (unsigned)subsystem;
+    if (index >= KOLIBRI_MEMORY_SUBSYSTEM_COUNT) {
+        index = KOLIBRI_MEMORY_SUBSYSTEM_COUNT - 1U;
+    }
+    return &kolibri_memory_counters[index];
+}
+
+static void account_add(KolibriMemoryCounters *counters, size_t size) {
+    uint64_t live = atomic_fetch_add_explicit(&counters->live_bytes, size, memory_order_relaxed) + size;
+    atomic_fetch_add_explicit(&counters->live_allocations, 1U, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->total_allocations, 1U, memory_order_relaxed);
+    uint64_t peak = atomic_load_explicit(&counters->peak_bytes, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&counters->peak_bytes, &peak, live, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+static void account_remove(KolibriMemoryCounters *counters, size_t size) {
+    atomic_fetch_sub_explicit(&counters->live_bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&counters->live_allocations, 1U, memory_order_relaxed);
+}
+
+static KolibriBlockHeader *header_of(void *ptr) {
+    KolibriBlockHeader *header = (KolibriBlockHeader *)ptr - 1;
+    if (header->magic != KOLIBRI_MEMORY_MAGIC) {
+        fprintf(stderr, "[kolibri-memory] block %p was not allocated by kolibri_memory\n", ptr);
+        abort();
+    }
+    return header;
+}
+
+int kolibri_memory_set_allocator(const KolibriAllocator *allocator) {
+    if (allocator && (!allocator->malloc_fn || !allocator->realloc_fn || !allocator->free_fn)) {
+        return -1;
+    }
+    for (size_t i = 0; i < KOLIBRI_MEMORY_SUBSYSTEM_COUNT; ++i) {
+        if (atomic_load_explicit(&kolibri_memory_counters[i].live_allocations, memory_order_relaxed) != 0U) {
+            return -1;
+        }
+    }
+    if (allocator) {
+        kolibri_allocator = *allocator;
+    } else {
+        kolibri_allocator = (KolibriAllocator){ default_malloc, default_realloc, default_free, NULL };
+    }
+    return 0;
+}
+
+void *kolibri_memory_alloc(KolibriMemorySubsystem subsystem, size_t size) {
+    KolibriMemoryCounters *counters = counters_for(subsystem);
+    if (size > SIZE_MAX - sizeof(KolibriBlockHeader)) {
+        atomic_fetch_add_explicit(&counters->failed_allocations, 1U, memory_order_relaxed);
+        return NULL;
+    }
+    KolibriBlockHeader *header =
+        (KolibriBlockHeader *)kolibri_allocator.malloc_fn(kolibri_allocator.user_data, sizeof(*header) + size);
+    if (!header) {
+        atomic_fetch_add_explicit(&counters->failed_allocations, 1U, memory_order_relaxed);
+        return NULL;
+    }
+    header->size = size;
+    header->subsystem = (uint32_t)(counters - kolibri_memory_counters);
+    header->magic = KOLIBRI_MEMORY_MAGIC;
+    account_add(counters, size);
+    return header + 1;
+}
+
+void *kolibri_memory_calloc(KolibriMemorySubsystem subsystem, size_t count, size_t size) {
+    if (size != 0U && count > SIZE_MAX / size) {
+        atomic_fetch_add_explicit(&counters_for(subsystem)->failed_allocations, 1U, memory_order_relaxed);
+        return NULL;
+    }
+    void *ptr = kolibri_memory_alloc(subsystem, count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+/* Нулевой размер даёт пустой живой блок, а не освобождение: вызывающие
+ * считают NULL ошибкой. */
+void *kolibri_memory_realloc(KolibriMemorySubsystem subsystem, void *ptr, size_t size) {
+    if (!ptr) {
+        return kolibri_memory_alloc(subsystem, size);
+    }
+    KolibriMemoryCounters *counters = counters_for(subsystem);
+    KolibriBlockHeader *header = header_of(ptr);
+    if (size > SIZE_MAX - sizeof(KolibriBlockHeader)) {
+        atomic_fetch_add_explicit(&counters->failed_allocations, 1U, memory_order_relaxed);
+        return NULL;
+    }
+    size_t old_size = header->size;
+    KolibriMemoryCounters *old_counters = &kolibri_memory_counters[header->subsystem];
+    KolibriBlockHeader *grown = (KolibriBlockHeader *)kolibri_allocator.realloc_fn(kolibri_allocator.user_data,
+                                                                                   header,
+                                                                                   sizeof(*header) + size);
+    if (!grown) {
+        atomic_fetch_add_explicit(&counters->failed_allocations, 1U, memory_order_relaxed);
+        return NULL;
+    }
+    account_remove(old_counters, old_size);
+    grown->size = size;
+    grown->subsystem = (uint32_t)(counters - kolibri_memory_counters);
+    account_add(counters, size);
+    /* Перенос блока — не новое выделение. */
+    atomic_fetch_sub_explicit(&counters->total_allocations, 1U, memory_order_relaxed);
+    return grown + 1;
+}
+
+char *kolibri_memory_strdup(KolibriMemorySubsystem subsystem, const char *text) {
+    size_t length = strlen(text) + 1U;
+    char *copy = (char *)kolibri_memory_alloc(subsystem, length);
+    if (copy) {
+        memcpy(copy, text, length);
+    }
+    return copy;
+}
+
+void kolibri_memory_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    KolibriBlockHeader *header = header_of(ptr);
+    account_remove(&kolibri_memory_counters[header->subsystem], header->size);
+    header->magic = 0U;
+    kolibri_allocator.free_fn(kolibri_allocator.user_data, header);
+}
+
+int kolibri_memory_stats(KolibriMemorySubsystem subsystem, KolibriMemoryStats *out) {
+    if (!out || (unsigned)subsystem >= KOLIBRI_MEMORY_SUBSYSTEM_COUNT) {
+        return -1;
+    }
+    const KolibriMemoryCounters *counters = &kolibri_memory_counters[subsystem];
+    out->live_bytes = atomic_load_explicit(&counters->live_bytes, memory_order_relaxed);
+    out->peak_bytes = atomic_load_explicit(&counters->peak_bytes, memory_order_relaxed);
+    out->live_allocations = atomic_load_explicit(&counters->live_allocations, memory_order_relaxed);
+    out->total_allocations = atomic_load_explicit(&counters->total_allocations, memory_order_relaxed);
+    out->failed_allocations = atomic_load_explicit(&counters->failed_allocations, memory_order_relaxed);
+    return 0;
+}
+
+const char *kolibri_memory_subsystem_name(KolibriMemorySubsystem subsystem) {
+    if ((unsigned)subsystem >= KOLIBRI_MEMORY_SUBSYSTEM_COUNT) {
+        return "unknown";
+    }
+    return kolibri_memory_names[subsystem];
+}
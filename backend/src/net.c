@@ -6,7 +6,9 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,10 +16,28 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define KOLIBRI_USE_EPOLL 1
+#else
+#include <poll.h>
+#endif
+
 #define KOLIBRI_HEADER_SIZE 3U
 #define KOLIBRI_MAX_PAYLOAD 256U
+#define KOLIBRI_HELLO_SIZE (KOLIBRI_HEADER_SIZE + sizeof(uint32_t))
+#define KOLIBRI_LISTENER_READ_BYTES 4096U
+#define KOLIBRI_LISTENER_EVENTS 64
+
+/* Запись в закрытый сокет должна вернуть ошибку, а не убить процесс. */
+#ifdef MSG_NOSIGNAL
+#define KOLIBRI_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define KOLIBRI_SEND_FLAGS 0
+#endif
 
 static uint64_t kolibri_htonll(uint64_t value) {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
@@ -52,7 +72,8 @@ static size_t kolibri_write_header(uint8_t *buffer, size_t buffer_len,
 static int kolibri_send_all(int sockfd, const uint8_t *data, size_t len) {
   size_t sent_total = 0;
   while (sent_total < len) {
-    ssize_t sent = send(sockfd, data + sent_total, len - sent_total, 0);
+    ssize_t sent = send(sockfd, data + sent_total, len - sent_total,
+                        KOLIBRI_SEND_FLAGS);
     if (sent < 0) {
       if (errno == EINTR) {
         continue;
@@ -67,25 +88,6 @@ static int kolibri_send_all(int sockfd, const uint8_t *data, size_t len) {
   return 0;
 }
 
-static int kolibri_recv_all(int sockfd, uint8_t *data, size_t len) {
-  size_t received_total = 0;
-  while (received_total < len) {
-    ssize_t received = recv(sockfd, data + received_total,
-                            len - received_total, 0);
-    if (received < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      return -1;
-    }
-    if (received == 0) {
-      return -1;
-    }
-    received_total += (size_t)received;
-  }
-  return 0;
-}
-
 size_t kn_message_encode_hello(uint8_t *buffer, size_t buffer_len,
                                uint32_t node_id) {
   if (!buffer) {
@@ -225,70 +227,440 @@ int kn_message_decode(const uint8_t *buffer, size_t buffer_len,
   return 0;
 }
 
-static int kn_send_message(int sockfd, const uint8_t *buffer, size_t len) {
-  if (!buffer || len == 0) {
+static int kn_connect(const char *host, uint16_t port) {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
+    return -1;
+  }
+
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd < 0) {
     return -1;
   }
-  return kolibri_send_all(sockfd, buffer, len);
+  if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sockfd);
+    return -1;
+  }
+  /* Пакеты мелкие и уже собраны в одну запись, ждать Нейгла незачем. */
+  int opt = 1;
+  setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  return sockfd;
 }
 
-int kn_share_formula(const char *host, uint16_t port, uint32_t node_id,
-                     const KolibriFormula *formula) {
-  if (!host || !formula) {
+/* Соединение, закрытое узлом, видно по нулевому recv без ожидания. */
+static bool kn_socket_alive(int sockfd) {
+  uint8_t probe;
+  ssize_t got = recv(sockfd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (got > 0) {
+    return true;
+  }
+  return got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+static void kn_peer_disconnect(KolibriNetPeer *peer) {
+  if (peer->socket_fd >= 0) {
+    close(peer->socket_fd);
+  }
+  peer->socket_fd = -1;
+}
+
+/* Повторная попытка делается только если упало переиспользованное
+ * соединение: свежее соединение с ошибкой означает недоступный узел. */
+/* 0 — очередь ушла по живому соединению, 1 — по только что открытому
+ * (узел мог перезапуститься), -1 — ошибка. */
+static int kn_peer_flush(KolibriNetClient *client, KolibriNetPeer *peer) {
+  if (peer->pending_len == 0) {
+    return 0;
+  }
+  uint8_t frame[KOLIBRI_HELLO_SIZE + KN_CLIENT_BATCH_BYTES];
+  int rc = -1;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (peer->socket_fd >= 0 && !kn_socket_alive(peer->socket_fd)) {
+      kn_peer_disconnect(peer);
+    }
+    bool fresh = peer->socket_fd < 0;
+    if (fresh) {
+      peer->socket_fd = kn_connect(peer->host, peer->port);
+      if (peer->socket_fd < 0) {
+        break;
+      }
+    }
+    size_t len = 0;
+    if (fresh) {
+      len = kn_message_encode_hello(frame, sizeof(frame), client->node_id);
+    }
+    memcpy(frame + len, peer->pending, peer->pending_len);
+    len += peer->pending_len;
+    if (kolibri_send_all(peer->socket_fd, frame, len) == 0) {
+      rc = fresh ? 1 : 0;
+      break;
+    }
+    kn_peer_disconnect(peer);
+    if (fresh) {
+      break;
+    }
+  }
+  peer->pending_len = 0;
+  return rc;
+}
+
+static KolibriNetPeer *kn_client_peer(KolibriNetClient *client,
+                                      const char *host, uint16_t port) {
+  for (size_t i = 0; i < client->count; ++i) {
+    KolibriNetPeer *peer = &client->peers[i];
+    if (peer->port == port && strcmp(peer->host, host) == 0) {
+      return peer;
+    }
+  }
+  if (strlen(host) >= sizeof(client->peers[0].host)) {
+    return NULL;
+  }
+  if (client->count == client->capacity) {
+    size_t new_cap = client->capacity ? client->capacity * 2U : 8U;
+    KolibriNetPeer *peers =
+        realloc(client->peers, new_cap * sizeof(KolibriNetPeer));
+    if (!peers) {
+      return NULL;
+    }
+    client->peers = peers;
+    client->capacity = new_cap;
+  }
+  KolibriNetPeer *peer = &client->peers[client->count++];
+  strcpy(peer->host, host);
+  peer->port = port;
+  peer->socket_fd = -1;
+  peer->pending_len = 0;
+  return peer;
+}
+
+void kn_client_init(KolibriNetClient *client, uint32_t node_id) {
+  if (!client) {
+    return;
+  }
+  client->node_id = node_id;
+  client->peers = NULL;
+  client->count = 0;
+  client->capacity = 0;
+}
+
+int kn_client_queue_formula(KolibriNetClient *client, const char *host,
+                            uint16_t port, const KolibriFormula *formula) {
+  if (!client || !host || !formula) {
     return -1;
   }
+  KolibriNetPeer *peer = kn_client_peer(client, host, port);
+  if (!peer) {
+    return -1;
+  }
+  uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
+  size_t len = kn_message_encode_formula(buffer, sizeof(buffer),
+                                         client->node_id, formula);
+  if (len == 0) {
+    return -1;
+  }
+  int rc = 0;
+  if (peer->pending_len + len > sizeof(peer->pending)) {
+    rc = kn_peer_flush(client, peer) < 0 ? -1 : 0;
+  }
+  memcpy(peer->pending + peer->pending_len, buffer, len);
+  peer->pending_len += len;
+  return rc;
+}
 
-  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-  if (sockfd < 0) {
+int kn_client_flush(KolibriNetClient *client) {
+  if (!client) {
     return -1;
   }
+  int failed = 0;
+  for (size_t i = 0; i < client->count; ++i) {
+    if (kn_peer_flush(client, &client->peers[i]) < 0) {
+      failed++;
+    }
+  }
+  return failed;
+}
 
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons(port);
-  if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0) {
-    close(sockfd);
+int kn_client_share_formula(KolibriNetClient *client, const char *host,
+                            uint16_t port, const KolibriFormula *formula) {
+  if (kn_client_queue_formula(client, host, port, formula) != 0) {
     return -1;
   }
+  return kn_peer_flush(client, kn_client_peer(client, host, port)) < 0 ? -1 : 0;
+}
 
-  if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    close(sockfd);
+int kn_client_flush_peer(KolibriNetClient *client, const char *host,
+                         uint16_t port) {
+  if (!client || !host) {
     return -1;
   }
+  KolibriNetPeer *peer = kn_client_peer(client, host, port);
+  if (!peer) {
+    return -1;
+  }
+  return kn_peer_flush(client, peer);
+}
+
+void kn_client_close(KolibriNetClient *client) {
+  if (!client) {
+    return;
+  }
+  for (size_t i = 0; i < client->count; ++i) {
+    kn_peer_disconnect(&client->peers[i]);
+  }
+  free(client->peers);
+  client->peers = NULL;
+  client->count = 0;
+  client->capacity = 0;
+}
 
-  uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
-  size_t len = kn_message_encode_hello(buffer, sizeof(buffer), node_id);
-  if (len == 0 || kn_send_message(sockfd, buffer, len) != 0) {
-    close(sockfd);
+int kn_share_formula(const char *host, uint16_t port, uint32_t node_id,
+                     const KolibriFormula *formula) {
+  if (!host || !formula) {
     return -1;
   }
+  KolibriNetClient client;
+  kn_client_init(&client, node_id);
+  int rc = kn_client_share_formula(&client, host, port, formula);
+  kn_client_close(&client);
+  return rc;
+}
 
-  len = kn_message_encode_formula(buffer, sizeof(buffer), node_id, formula);
-  if (len == 0 || kn_send_message(sockfd, buffer, len) != 0) {
-    close(sockfd);
+struct KolibriNetConnection {
+  int socket_fd;
+  size_t index;
+  size_t length;
+  uint8_t buffer[KOLIBRI_LISTENER_READ_BYTES];
+};
+
+static int kn_set_nonblocking(int sockfd) {
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if (flags < 0) {
     return -1;
   }
+  return fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+}
 
-  close(sockfd);
+static void kn_listener_reset(KolibriNetListener *listener) {
+  listener->socket_fd = -1;
+  listener->event_fd = -1;
+  listener->connections = NULL;
+  listener->connection_count = 0;
+  listener->connection_capacity = 0;
+  listener->ready = NULL;
+  listener->ready_head = 0;
+  listener->ready_count = 0;
+  listener->ready_capacity = 0;
+}
+
+static int kn_listener_push(KolibriNetListener *listener,
+                            const KolibriNetMessage *message) {
+  if (listener->ready_count == listener->ready_capacity) {
+    size_t new_cap = listener->ready_capacity ? listener->ready_capacity * 2U : 32U;
+    KolibriNetMessage *ready = malloc(new_cap * sizeof(KolibriNetMessage));
+    if (!ready) {
+      return -1;
+    }
+    for (size_t i = 0; i < listener->ready_count; ++i) {
+      ready[i] = listener->ready[(listener->ready_head + i) % listener->ready_capacity];
+    }
+    free(listener->ready);
+    listener->ready = ready;
+    listener->ready_head = 0;
+    listener->ready_capacity = new_cap;
+  }
+  size_t tail = (listener->ready_head + listener->ready_count) % listener->ready_capacity;
+  listener->ready[tail] = *message;
+  listener->ready_count++;
   return 0;
 }
 
+static size_t kn_listener_pop(KolibriNetListener *listener,
+                              KolibriNetMessage *out, size_t max) {
+  size_t taken = 0;
+  while (taken < max && listener->ready_count > 0) {
+    out[taken++] = listener->ready[listener->ready_head];
+    listener->ready_head = (listener->ready_head + 1U) % listener->ready_capacity;
+    listener->ready_count--;
+  }
+  return taken;
+}
+
+static void kn_connection_close(KolibriNetListener *listener,
+                                KolibriNetConnection *conn) {
+#ifdef KOLIBRI_USE_EPOLL
+  epoll_ctl(listener->event_fd, EPOLL_CTL_DEL, conn->socket_fd, NULL);
+#endif
+  close(conn->socket_fd);
+  size_t last = listener->connection_count - 1U;
+  if (conn->index != last) {
+    listener->connections[conn->index] = listener->connections[last];
+    listener->connections[conn->index]->index = conn->index;
+  }
+  listener->connection_count = last;
+  free(conn);
+}
+
+static void kn_listener_accept(KolibriNetListener *listener) {
+  while (true) {
+    int client_fd = accept(listener->socket_fd, NULL, NULL);
+    if (client_fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    if (kn_set_nonblocking(client_fd) != 0) {
+      close(client_fd);
+      continue;
+    }
+    if (listener->connection_count == listener->connection_capacity) {
+      size_t new_cap = listener->connection_capacity ? listener->connection_capacity * 2U : 8U;
+      KolibriNetConnection **connections =
+          realloc(listener->connections, new_cap * sizeof(KolibriNetConnection *));
+      if (!connections) {
+        close(client_fd);
+        return;
+      }
+      listener->connections = connections;
+      listener->connection_capacity = new_cap;
+    }
+    KolibriNetConnection *conn = malloc(sizeof(KolibriNetConnection));
+    if (!conn) {
+      close(client_fd);
+      return;
+    }
+    conn->socket_fd = client_fd;
+    conn->index = listener->connection_count;
+    conn->length = 0;
+#ifdef KOLIBRI_USE_EPOLL
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = conn;
+    if (epoll_ctl(listener->event_fd, EPOLL_CTL_ADD, client_fd, &event) != 0) {
+      close(client_fd);
+      free(conn);
+      continue;
+    }
+#endif
+    listener->connections[listener->connection_count++] = conn;
+  }
+}
+
+/* Одно чтение на событие готовности: быстрый узел не задерживает
+ * остальных, а все целые кадры из прочитанного уходят в очередь. */
+static void kn_connection_read(KolibriNetListener *listener,
+                               KolibriNetConnection *conn) {
+  ssize_t got;
+  do {
+    got = recv(conn->socket_fd, conn->buffer + conn->length,
+               sizeof(conn->buffer) - conn->length, 0);
+  } while (got < 0 && errno == EINTR);
+  if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (got <= 0) {
+    kn_connection_close(listener, conn);
+    return;
+  }
+  conn->length += (size_t)got;
+
+  size_t offset = 0;
+  while (conn->length - offset >= KOLIBRI_HEADER_SIZE) {
+    uint16_t payload_len;
+    memcpy(&payload_len, conn->buffer + offset + 1, sizeof(payload_len));
+    payload_len = ntohs(payload_len);
+    if (payload_len > KOLIBRI_MAX_PAYLOAD) {
+      kn_connection_close(listener, conn);
+      return;
+    }
+    size_t frame_len = KOLIBRI_HEADER_SIZE + payload_len;
+    if (conn->length - offset < frame_len) {
+      break;
+    }
+    KolibriNetMessage decoded;
+    if (kn_message_decode(conn->buffer + offset, frame_len, &decoded) == 0) {
+      kn_listener_push(listener, &decoded);
+    }
+    offset += frame_len;
+  }
+  memmove(conn->buffer, conn->buffer + offset, conn->length - offset);
+  conn->length -= offset;
+}
+
+static int kn_listener_wait(KolibriNetListener *listener, int timeout_ms) {
+#ifdef KOLIBRI_USE_EPOLL
+  struct epoll_event events[KOLIBRI_LISTENER_EVENTS];
+  int ready = epoll_wait(listener->event_fd, events, KOLIBRI_LISTENER_EVENTS,
+                         timeout_ms);
+  if (ready < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+  for (int i = 0; i < ready; ++i) {
+    KolibriNetConnection *conn = events[i].data.ptr;
+    if (conn) {
+      kn_connection_read(listener, conn);
+    } else {
+      kn_listener_accept(listener);
+    }
+  }
+  return 0;
+#else
+  size_t count = listener->connection_count;
+  struct pollfd *fds = malloc((count + 1U) * sizeof(struct pollfd));
+  if (!fds) {
+    return -1;
+  }
+  fds[0].fd = listener->socket_fd;
+  fds[0].events = POLLIN;
+  for (size_t i = 0; i < count; ++i) {
+    fds[i + 1U].fd = listener->connections[i]->socket_fd;
+    fds[i + 1U].events = POLLIN;
+  }
+  int ready = poll(fds, (nfds_t)(count + 1U), timeout_ms);
+  if (ready < 0) {
+    free(fds);
+    return errno == EINTR ? 0 : -1;
+  }
+  /* С конца: закрытие переставляет последнее соединение на место
+     текущего, а оно уже обработано. */
+  for (size_t i = count; i > 0; --i) {
+    if (fds[i].revents) {
+      kn_connection_read(listener, listener->connections[i - 1U]);
+    }
+  }
+  if (fds[0].revents) {
+    kn_listener_accept(listener);
+  }
+  free(fds);
+  return 0;
+#endif
+}
+
+static uint64_t kn_monotonic_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
 int kn_listener_start(KolibriNetListener *listener, uint16_t port) {
   if (!listener) {
     return -1;
   }
+  kn_listener_reset(listener);
 
   int sockfd = socket(AF_INET, SOCK_STREAM, 0);
   if (sockfd < 0) {
-    listener->socket_fd = -1;
     return -1;
   }
 
   int opt = 1;
-  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+      kn_set_nonblocking(sockfd) != 0) {
     close(sockfd);
-    listener->socket_fd = -1;
     return -1;
   }
 
@@ -300,109 +672,90 @@ int kn_listener_start(KolibriNetListener *listener, uint16_t port) {
 
   if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
     close(sockfd);
-    listener->socket_fd = -1;
     return -1;
   }
 
-  if (listen(sockfd, 4) < 0) {
+  if (listen(sockfd, SOMAXCONN) < 0) {
+    close(sockfd);
+    return -1;
+  }
+
+#ifdef KOLIBRI_USE_EPOLL
+  int event_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (event_fd < 0 || epoll_ctl(event_fd, EPOLL_CTL_ADD, sockfd, &event) != 0) {
+    if (event_fd >= 0) {
+      close(event_fd);
+    }
     close(sockfd);
-    listener->socket_fd = -1;
     return -1;
   }
+  listener->event_fd = event_fd;
+#endif
 
   listener->socket_fd = sockfd;
   listener->port = port;
   return 0;
 }
 
-int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms,
-                     KolibriNetMessage *out_message) {
-  if (!listener || listener->socket_fd < 0 || !out_message) {
+int kn_listener_poll_batch(KolibriNetListener *listener, uint32_t timeout_ms,
+                           KolibriNetMessage *out_messages, size_t max) {
+  if (!listener || listener->socket_fd < 0 || !out_messages || max == 0) {
     return -1;
   }
-
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(listener->socket_fd, &readfds);
-
-  struct timeval tv;
-  struct timeval *timeout_ptr = NULL;
-  if (timeout_ms != UINT32_MAX) {
-    /* Pass an explicit zeroed timeval when timeout_ms == 0 to preserve
-       non-blocking semantics. UINT32_MAX can be used to wait indefinitely. */
-    tv.tv_sec = timeout_ms / 1000U;
-    tv.tv_usec = (timeout_ms % 1000U) * 1000U;
-    timeout_ptr = &tv;
-  }
-
-  int ready = select(listener->socket_fd + 1, &readfds, NULL, NULL, timeout_ptr);
-  if (ready < 0) {
-    if (errno == EINTR) {
-      return 0;
+  /* UINT32_MAX ждёт бесконечно, 0 лишь забирает уже пришедшее. */
+  uint64_t deadline = timeout_ms == UINT32_MAX ? 0 : kn_monotonic_ms() + timeout_ms;
+  bool waited = false;
+  while (listener->ready_count == 0) {
+    int wait_ms = -1;
+    if (timeout_ms != UINT32_MAX) {
+      uint64_t now = kn_monotonic_ms();
+      wait_ms = now >= deadline ? 0 : (int)(deadline - now);
     }
-    return -1;
-  }
-  if (ready == 0) {
-    return 0;
-  }
-
-  struct sockaddr_in client_addr;
-  socklen_t client_len = sizeof(client_addr);
-  int client_fd = accept(listener->socket_fd, (struct sockaddr *)&client_addr,
-                         &client_len);
-  if (client_fd < 0) {
-    return -1;
-  }
-
-  uint8_t buffer[KOLIBRI_HEADER_SIZE + KOLIBRI_MAX_PAYLOAD];
-
-  KolibriNetMessage last_message;
-  bool has_last = false;
-
-  while (true) {
-    if (kolibri_recv_all(client_fd, buffer, KOLIBRI_HEADER_SIZE) != 0) {
-      break;
-    }
-    uint16_t payload_len;
-    memcpy(&payload_len, &buffer[1], sizeof(payload_len));
-    payload_len = ntohs(payload_len);
-    if (payload_len > KOLIBRI_MAX_PAYLOAD) {
-      break;
+    if (kn_listener_wait(listener, wait_ms) != 0) {
+      return -1;
     }
-    if (kolibri_recv_all(client_fd, buffer + KOLIBRI_HEADER_SIZE,
-                         payload_len) != 0) {
+    waited = true;
+    if (wait_ms == 0) {
       break;
     }
-    size_t message_len = KOLIBRI_HEADER_SIZE + payload_len;
-    KolibriNetMessage decoded;
-    if (kn_message_decode(buffer, message_len, &decoded) == 0) {
-      has_last = true;
-      last_message = decoded;
-      if (decoded.type == KOLIBRI_MSG_MIGRATE_RULE) {
-        *out_message = decoded;
-        close(client_fd);
-        return 1;
-      }
-      continue;
-    }
   }
-
-  if (has_last) {
-    *out_message = last_message;
-    close(client_fd);
-    return 1;
+  /* Очередь не пуста с прошлого вызова: добираем то, что уже пришло. */
+  if (!waited && listener->ready_count < max) {
+    kn_listener_wait(listener, 0);
   }
+  return (int)kn_listener_pop(listener, out_messages, max);
+}
 
-  close(client_fd);
-  return -1;
+int kn_listener_poll(KolibriNetListener *listener, uint32_t timeout_ms,
+                     KolibriNetMessage *out_message) {
+  return kn_listener_poll_batch(listener, timeout_ms, out_message, 1U);
+}
+
+int kn_listener_fd(const KolibriNetListener *listener) {
+  if (!listener) {
+    return -1;
+  }
+  return listener->event_fd >= 0 ? listener->event_fd : listener->socket_fd;
 }
 
 void kn_listener_close(KolibriNetListener *listener) {
   if (!listener) {
     return;
   }
+  while (listener->connection_count > 0) {
+    kn_connection_close(listener, listener->connections[listener->connection_count - 1U]);
+  }
+  if (listener->event_fd >= 0) {
+    close(listener->event_fd);
+  }
   if (listener->socket_fd >= 0) {
     close(listener->socket_fd);
   }
-  listener->socket_fd = -1;
+  free(listener->connections);
+  free(listener->ready);
+  kn_listener_reset(listener);
 }
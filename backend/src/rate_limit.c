@@ -0,0 +1,62 @@
+#include "kolibri/rate_limit.h"
+
+#include <stddef.h>
+
+static KolibriRateSlot *rate_limit_slot(KolibriRateShard *shard, uint64_t key, uint64_t hash, uint64_t now_ns) {
+    size_t start = (size_t)(hash >> 32) % KOLIBRI_RATE_SHARD_SLOTS;
+    KolibriRateSlot *reusable = NULL;
+    uint64_t reusable_key = 0U;
+    for (size_t i = 0; i < KOLIBRI_RATE_PROBE; ++i) {
+        KolibriRateSlot *slot = &shard->slots[(start + i) % KOLIBRI_RATE_SHARD_SLOTS];
+        uint_least64_t current = atomic_load_explicit(&slot->key, memory_order_acquire);
+        if (current == key) {
+            return slot;
+        }
+        if (current == 0U) {
+            if (atomic_compare_exchange_strong_explicit(&slot->key, &current, key, memory_order_acq_rel,
+                                                        memory_order_acquire) ||
+                current == key) {
+                return slot;
+            }
+            continue;
+        }
+        if (!reusable && atomic_load_explicit(&slot->tat, memory_order_relaxed) <= now_ns) {
+            reusable = slot;
+            reusable_key = current;
+        }
+    }
+    /* Слот с полным ведром неотличим от нового клиента, его можно переназначить. */
+    if (reusable) {
+        uint_least64_t expected = reusable_key;
+        if (atomic_compare_exchange_strong_explicit(&reusable->key, &expected, key, memory_order_acq_rel,
+                                                    memory_order_acquire) ||
+            expected == key) {
+            return reusable;
+        }
+    }
+    return &shard->overflow;
+}
+
+int kolibri_rate_limit_allow(KolibriRateLimiter *limiter, uint32_t client, uint64_t now_ns,
+                             uint64_t *retry_after_ns) {
+    const uint64_t interval_ns = (uint64_t)KOLIBRI_RATE_LIMIT_WINDOW * 1000000000ULL / KOLIBRI_RATE_LIMIT_BURST;
+    const uint64_t tolerance_ns = interval_ns * (KOLIBRI_RATE_LIMIT_BURST - 1U);
+    uint64_t key = (uint64_t)client + 1U;
+    uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+    KolibriRateShard *shard = &limiter->shards[hash >> 60];
+    KolibriRateSlot *slot = rate_limit_slot(shard, key, hash, now_ns);
+    uint_least64_t tat = atomic_load_explicit(&slot->tat, memory_order_relaxed);
+    while (1) {
+        uint64_t base = tat > now_ns ? tat : now_ns;
+        if (base - now_ns > tolerance_ns) {
+            if (retry_after_ns) {
+                *retry_after_ns = base - tolerance_ns - now_ns;
+            }
+            return 0;
+        }
+        if (atomic_compare_exchange_weak_explicit(&slot->tat, &tat, base + interval_ns, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+            return 1;
+        }
+    }
+}
@@ -2,12 +2,21 @@
  * Copyright (c) 2025 Кочуров Владислав Евгеньевич
  */
 
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* recvmmsg/sendmmsg */
+#endif
+#define KOLIBRI_ROY_MMSG 1
+#endif
+
 #include "kolibri/roy.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
-#include <openssl/hmac.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,7 +28,21 @@
 #define KOLIBRI_ROY_VERSIYA 1U
 #define KOLIBRI_ROY_TYP_HELLO 1U
 #define KOLIBRI_ROY_TYP_FORMULA 2U
+/* Обмен выборками известных узлов для пассивного вида. */
+#define KOLIBRI_ROY_TYP_OBMEN 3U
+/* Флаг приветствия: отправитель держит адресата в активном виде. */
+#define KOLIBRI_ROY_PRIVET_AKTIVNYJ 1U
+#define KOLIBRI_ROY_OBMEN_OTVET 1U
+/* Записей (id, IPv4, порт) в одной выборке обмена. */
+#define KOLIBRI_ROY_OBMEN_ZAPISEJ 8U
+#define KOLIBRI_ROY_OBMEN_ZAPIS 10U
+/* Во сколько раз пассивная запись живёт дольше активной. */
+#define KOLIBRI_ROY_PASSIVNYJ_SROK 4U
+/* Слотов кэша уже пересланных формул (степень двойки). */
+#define KOLIBRI_ROY_PAMYAT_FORMUL 512U
 #define KOLIBRI_ROY_MAKSIMALNYJ_PAKET 512U
+/* Сколько датаграмм забирается за одно пробуждение потока. */
+#define KOLIBRI_ROY_PACHKA 32U
 
 /* Преобразует число из хоста в сетевой порядок для 64 бит. */
 static uint64_t kolibri_htonll(uint64_t znachenie) {
@@ -43,21 +66,129 @@ static uint64_t kolibri_ntohll(uint64_t znachenie) {
 #endif
 }
 
-/* Внутренний помощник для записи события в очередь. */
+/* Кольцо одного производителя и одного потребителя: счётчики растут
+ * монотонно, ячейка выбирается маской. */
+struct KolibriRoyOchered {
+    size_t maska;
+    atomic_size_t golova;
+    atomic_size_t hvost;
+    atomic_uint_fast64_t poteri;
+    KolibriRoySobytie sloty[];
+};
+
+static KolibriRoyOchered *kolibri_roy_sozdat_ochered(size_t razmer) {
+
+    size_t emkost = 1U;
+    while (emkost < razmer) {
+        if (emkost > SIZE_MAX / 2U) {
+            return NULL;
+        }
+        emkost *= 2U;
+    }
+    KolibriRoyOchered *ochered =
+        malloc(sizeof(*ochered) + emkost * sizeof(KolibriRoySobytie));
+    if (!ochered) {
+        return NULL;
+    }
+    ochered->maska = emkost - 1U;
+    atomic_init(&ochered->golova, 0U);
+    atomic_init(&ochered->hvost, 0U);
+    atomic_init(&ochered->poteri, 0U);
+    return ochered;
+}
+
+/* Ключ HMAC раскрывается во внутренний и внешний блоки один раз при запуске;
+ * каждый пакет лишь сбрасывает контекст к этому состоянию. Контекст подписи
+ * делят вызывающие потоки и поток роя, контекст проверки — пачки приёма. */
+struct KolibriRoyPodpis {
+    pthread_mutex_t zamek_otpravki;
+    pthread_mutex_t zamek_priema;
+    EVP_MAC_CTX *otpravka;
+    EVP_MAC_CTX *priem;
+};
+
+static EVP_MAC_CTX *kolibri_roy_sozdat_mac(const unsigned char *klyuch,
+                                           size_t dlina_klyucha) {
+
+    EVP_MAC *mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    if (!mac) {
+        return NULL;
+    }
+    EVP_MAC_CTX *kontekst = EVP_MAC_CTX_new(mac);
+    EVP_MAC_free(mac);
+    if (!kontekst) {
+        return NULL;
+    }
+    OSSL_PARAM parametry[2];
+    parametry[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                    (char *)"SHA256", 0);
+    parametry[1] = OSSL_PARAM_construct_end();
+    if (EVP_MAC_init(kontekst, klyuch, dlina_klyucha, parametry) != 1) {
+        EVP_MAC_CTX_free(kontekst);
+        return NULL;
+    }
+    return kontekst;
+}
+
+static void kolibri_roy_osvobodit_podpis(KolibriRoyPodpis *podpis) {
+
+    if (!podpis) {
+        return;
+    }
+    EVP_MAC_CTX_free(podpis->otpravka);
+    EVP_MAC_CTX_free(podpis->priem);
+    pthread_mutex_destroy(&podpis->zamek_otpravki);
+    pthread_mutex_destroy(&podpis->zamek_priema);
+    free(podpis);
+}
+
+static KolibriRoyPodpis *kolibri_roy_sozdat_podpis(const unsigned char *klyuch,
+                                                   size_t dlina_klyucha) {
+
+    KolibriRoyPodpis *podpis = calloc(1U, sizeof(*podpis));
+    if (!podpis) {
+        return NULL;
+    }
+    pthread_mutex_init(&podpis->zamek_otpravki, NULL);
+    pthread_mutex_init(&podpis->zamek_priema, NULL);
+    podpis->otpravka = kolibri_roy_sozdat_mac(klyuch, dlina_klyucha);
+    podpis->priem = kolibri_roy_sozdat_mac(klyuch, dlina_klyucha);
+    if (!podpis->otpravka || !podpis->priem) {
+        kolibri_roy_osvobodit_podpis(podpis);
+        return NULL;
+    }
+    return podpis;
+}
+
+/* Считает HMAC от готового контекста; вызывающий держит его замок. */
+static int kolibri_roy_vychislit_mac(EVP_MAC_CTX *kontekst,
+                                     const uint8_t *dannye, size_t dlina,
+                                     unsigned char *hmac) {
+
+    size_t hmac_dlina = 0U;
+    if (EVP_MAC_init(kontekst, NULL, 0U, NULL) != 1 ||
+        EVP_MAC_update(kontekst, dannye, dlina) != 1 ||
+        EVP_MAC_final(kontekst, hmac, &hmac_dlina, KOLIBRI_ROY_HMAC_SIZE) != 1 ||
+        hmac_dlina < KOLIBRI_ROY_HMAC_SIZE) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Внутренний помощник для записи события в очередь: при переполнении
+ * новое событие отбрасывается и учитывается. */
 static void kolibri_roy_postavit_sobytie(KolibriRoy *roy,
                                          const KolibriRoySobytie *sobytie) {
 
-    pthread_mutex_lock(&roy->ochered_zamek);
-    if (roy->ochered_schetchik == KOLIBRI_ROY_MAX_OCHERED) {
-        /* Переполнение очереди: перезаписываем самое старое событие. */
-        roy->ochered_golova =
-            (roy->ochered_golova + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-        roy->ochered_schetchik--;
+    KolibriRoyOchered *ochered = roy->ochered;
+    size_t hvost = atomic_load_explicit(&ochered->hvost, memory_order_relaxed);
+    size_t golova = atomic_load_explicit(&ochered->golova, memory_order_acquire);
+    if (hvost - golova > ochered->maska) {
+        atomic_fetch_add_explicit(&ochered->poteri, 1U, memory_order_relaxed);
+        return;
     }
-    roy->ochered[roy->ochered_hvost] = *sobytie;
-    roy->ochered_hvost = (roy->ochered_hvost + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-    roy->ochered_schetchik++;
-    pthread_mutex_unlock(&roy->ochered_zamek);
+    ochered->sloty[hvost & ochered->maska] = *sobytie;
+    atomic_store_explicit(&ochered->hvost, hvost + 1U, memory_order_release);
 }
 
 /* Сравнивает два HMAC и защищает от атак по времени. */
@@ -71,53 +202,341 @@ static int kolibri_roy_sravnit_hmac(const unsigned char *levyj,
     return rezultat == 0U ? 0 : -1;
 }
 
-/* Обновляет или создаёт запись о соседе. */
+/* Партиционированный вид соседей: первые aktivnyh записей — активный вид,
+ * которому идут формулы и пульс, остальные — пассивный запас для замены
+ * выбывших. Оба индекса хранят позицию + 1 с открытой адресацией. */
+struct KolibriRoyVid {
+    KolibriRoySosed *zapisi;
+    size_t chislo;
+    size_t aktivnyh;
+    size_t emkost;
+    uint32_t *po_id;
+    uint32_t *po_adresu;
+    size_t maska;
+    uint64_t sluchajnost;
+    uint32_t nomer_formuly;
+    uint64_t vidennye[KOLIBRI_ROY_PAMYAT_FORMUL];
+};
+
+static uint64_t kolibri_roy_peremeshat(uint64_t znachenie) {
+
+    znachenie ^= znachenie >> 33;
+    znachenie *= 0xff51afd7ed558ccdULL;
+    znachenie ^= znachenie >> 33;
+    znachenie *= 0xc4ceb9fe1a85ec53ULL;
+    znachenie ^= znachenie >> 33;
+    return znachenie;
+}
+
+static uint64_t kolibri_roy_klyuch_adresa(const struct sockaddr_in *adres) {
+
+    return ((uint64_t)adres->sin_addr.s_addr << 16) | adres->sin_port;
+}
+
+static size_t kolibri_roy_vid_sluchajnoe(KolibriRoyVid *vid, size_t predel) {
+
+    vid->sluchajnost += 0x9e3779b97f4a7c15ULL;
+    return (size_t)(kolibri_roy_peremeshat(vid->sluchajnost) % predel);
+}
+
+/* Желаемый размер активного вида: ceil(log2(N + 1)) + 1 для N известных. */
+static size_t kolibri_roy_vid_cel(size_t izvestno) {
+
+    size_t cel = 0U;
+    while (cel < 63U && ((uint64_t)1U << cel) < (uint64_t)izvestno + 1U) {
+        cel++;
+    }
+    cel += 1U;
+    return cel > KOLIBRI_ROY_MAX_SOSSEDI / 2U ? KOLIBRI_ROY_MAX_SOSSEDI / 2U
+                                              : cel;
+}
+
+static void kolibri_roy_vid_vstavit(uint32_t *tablica, size_t maska,
+                                    uint64_t klyuch, size_t pozitsiya) {
+
+    size_t slot = (size_t)kolibri_roy_peremeshat(klyuch) & maska;
+    while (tablica[slot] != 0U) {
+        slot = (slot + 1U) & maska;
+    }
+    tablica[slot] = (uint32_t)(pozitsiya + 1U);
+}
+
+static void kolibri_roy_vid_perestroit(KolibriRoyVid *vid) {
+
+    memset(vid->po_id, 0, (vid->maska + 1U) * sizeof(uint32_t));
+    memset(vid->po_adresu, 0, (vid->maska + 1U) * sizeof(uint32_t));
+    for (size_t indeks = 0U; indeks < vid->chislo; ++indeks) {
+        kolibri_roy_vid_vstavit(vid->po_id, vid->maska,
+                                vid->zapisi[indeks].identifikator, indeks);
+        kolibri_roy_vid_vstavit(vid->po_adresu, vid->maska,
+                                kolibri_roy_klyuch_adresa(&vid->zapisi[indeks].adres),
+                                indeks);
+    }
+}
+
+/* Ищет слот индекса, указывающий на позицию; позицию берёт из ключа. */
+static size_t kolibri_roy_vid_slot(const uint32_t *tablica, size_t maska,
+                                   uint64_t klyuch, size_t pozitsiya) {
+
+    size_t slot = (size_t)kolibri_roy_peremeshat(klyuch) & maska;
+    while (tablica[slot] != (uint32_t)(pozitsiya + 1U)) {
+        slot = (slot + 1U) & maska;
+    }
+    return slot;
+}
+
+static size_t kolibri_roy_vid_najti_id(const KolibriRoyVid *vid,
+                                       uint32_t identifikator) {
+
+    size_t slot = (size_t)kolibri_roy_peremeshat(identifikator) & vid->maska;
+    while (vid->po_id[slot] != 0U) {
+        size_t pozitsiya = vid->po_id[slot] - 1U;
+        if (vid->zapisi[pozitsiya].identifikator == identifikator) {
+            return pozitsiya;
+        }
+        slot = (slot + 1U) & vid->maska;
+    }
+    return SIZE_MAX;
+}
+
+static size_t kolibri_roy_vid_najti_adres(const KolibriRoyVid *vid,
+                                          const struct sockaddr_in *adres) {
+
+    uint64_t klyuch = kolibri_roy_klyuch_adresa(adres);
+    size_t slot = (size_t)kolibri_roy_peremeshat(klyuch) & vid->maska;
+    while (vid->po_adresu[slot] != 0U) {
+        size_t pozitsiya = vid->po_adresu[slot] - 1U;
+        if (kolibri_roy_klyuch_adresa(&vid->zapisi[pozitsiya].adres) == klyuch) {
+            return pozitsiya;
+        }
+        slot = (slot + 1U) & vid->maska;
+    }
+    return SIZE_MAX;
+}
+
+/* Меняет местами две записи, поправляя оба индекса без перестройки. */
+static void kolibri_roy_vid_pomenyat(KolibriRoyVid *vid, size_t levaya,
+                                     size_t pravaya) {
+
+    if (levaya == pravaya) {
+        return;
+    }
+    KolibriRoySosed *a = &vid->zapisi[levaya];
+    KolibriRoySosed *b = &vid->zapisi[pravaya];
+    size_t id_a = kolibri_roy_vid_slot(vid->po_id, vid->maska, a->identifikator,
+                                       levaya);
+    size_t id_b = kolibri_roy_vid_slot(vid->po_id, vid->maska, b->identifikator,
+                                       pravaya);
+    size_t adres_a = kolibri_roy_vid_slot(
+        vid->po_adresu, vid->maska, kolibri_roy_klyuch_adresa(&a->adres), levaya);
+    size_t adres_b = kolibri_roy_vid_slot(
+        vid->po_adresu, vid->maska, kolibri_roy_klyuch_adresa(&b->adres), pravaya);
+    vid->po_id[id_a] = (uint32_t)(pravaya + 1U);
+    vid->po_id[id_b] = (uint32_t)(levaya + 1U);
+    vid->po_adresu[adres_a] = (uint32_t)(pravaya + 1U);
+    vid->po_adresu[adres_b] = (uint32_t)(levaya + 1U);
+    KolibriRoySosed vremennyj = *a;
+    *a = *b;
+    *b = vremennyj;
+}
+
+/* Переводит запись из пассивного вида в активный. */
+static void kolibri_roy_vid_povysit(KolibriRoyVid *vid, size_t pozitsiya) {
+
+    if (pozitsiya < vid->aktivnyh) {
+        return;
+    }
+    kolibri_roy_vid_pomenyat(vid, pozitsiya, vid->aktivnyh);
+    vid->aktivnyh++;
+}
+
+static int kolibri_roy_vid_rasshirit(KolibriRoyVid *vid) {
+
+    size_t emkost = vid->emkost ? vid->emkost * 2U : 16U;
+    if (emkost > KOLIBRI_ROY_MAX_IZVESTNYH) {
+        emkost = KOLIBRI_ROY_MAX_IZVESTNYH;
+    }
+    if (emkost <= vid->emkost) {
+        return -1;
+    }
+    KolibriRoySosed *zapisi = realloc(vid->zapisi, emkost * sizeof(*zapisi));
+    if (!zapisi) {
+        return -1;
+    }
+    vid->zapisi = zapisi;
+    size_t yacheek = 1U;
+    while (yacheek < emkost * 2U) {
+        yacheek *= 2U;
+    }
+    uint32_t *po_id = calloc(yacheek, sizeof(uint32_t));
+    uint32_t *po_adresu = calloc(yacheek, sizeof(uint32_t));
+    if (!po_id || !po_adresu) {
+        free(po_id);
+        free(po_adresu);
+        return -1;
+    }
+    free(vid->po_id);
+    free(vid->po_adresu);
+    vid->po_id = po_id;
+    vid->po_adresu = po_adresu;
+    vid->maska = yacheek - 1U;
+    vid->emkost = emkost;
+    kolibri_roy_vid_perestroit(vid);
+    return 0;
+}
+
+static KolibriRoyVid *kolibri_roy_sozdat_vid(uint64_t zatravka) {
+
+    KolibriRoyVid *vid = calloc(1U, sizeof(*vid));
+    if (!vid) {
+        return NULL;
+    }
+    vid->sluchajnost = zatravka;
+    if (kolibri_roy_vid_rasshirit(vid) != 0) {
+        free(vid);
+        return NULL;
+    }
+    return vid;
+}
+
+static void kolibri_roy_osvobodit_vid(KolibriRoyVid *vid) {
+
+    if (!vid) {
+        return;
+    }
+    free(vid->zapisi);
+    free(vid->po_id);
+    free(vid->po_adresu);
+    free(vid);
+}
+
+/* Отмечает формулу как увиденную; возвращает 1, если она уже встречалась. */
+static int kolibri_roy_vid_uzhe_videl(KolibriRoyVid *vid, uint32_t istochnik,
+                                      uint32_t nomer) {
+
+    uint64_t klyuch = (((uint64_t)istochnik << 32) | nomer) + 1U;
+    size_t slot = (size_t)kolibri_roy_peremeshat(klyuch) &
+                  (KOLIBRI_ROY_PAMYAT_FORMUL - 1U);
+    if (vid->vidennye[slot] == klyuch) {
+        return 1;
+    }
+    vid->vidennye[slot] = klyuch;
+    return 0;
+}
+
+/* Обновляет или создаёт запись о соседе. pervoistochnik — пакет пришёл от
+ * самого соседа (а не из чужой выборки), только тогда продлевается срок.
+ * prosit_aktivnyj — сосед держит нас в своём активном виде, и мы отвечаем
+ * тем же, пока активный вид не вдвое больше желаемого. */
 static void kolibri_roy_obnovit_soseda(KolibriRoy *roy, uint32_t identifikator,
-                                       const struct sockaddr_in *adres) {
+                                       const struct sockaddr_in *adres,
+                                       int pervoistochnik, int prosit_aktivnyj) {
 
+    if (identifikator == roy->sobstvennyj_id) {
+        return;
+    }
     pthread_mutex_lock(&roy->zamek);
-    size_t indeks = 0U;
-    for (; indeks < roy->chislo_sosedey; ++indeks) {
-        if (roy->sosedi[indeks].identifikator == identifikator ||
-            (roy->sosedi[indeks].adres.sin_addr.s_addr ==
-                 adres->sin_addr.s_addr &&
-             roy->sosedi[indeks].adres.sin_port == adres->sin_port)) {
-            roy->sosedi[indeks].identifikator = identifikator;
-            roy->sosedi[indeks].adres = *adres;
-            roy->sosedi[indeks].poslednij_otklik = time(NULL);
-            roy->sosedi[indeks].neudachi = 0U;
+    KolibriRoyVid *vid = roy->vid;
+    const time_t seichas = time(NULL);
+    size_t pozitsiya = kolibri_roy_vid_najti_id(vid, identifikator);
+    if (pozitsiya == SIZE_MAX) {
+        pozitsiya = kolibri_roy_vid_najti_adres(vid, adres);
+    }
+    if (pozitsiya != SIZE_MAX) {
+        if (!pervoistochnik) {
             pthread_mutex_unlock(&roy->zamek);
             return;
         }
+        KolibriRoySosed *sosed = &vid->zapisi[pozitsiya];
+        int smena = sosed->identifikator != identifikator ||
+                    kolibri_roy_klyuch_adresa(&sosed->adres) !=
+                        kolibri_roy_klyuch_adresa(adres);
+        sosed->identifikator = identifikator;
+        sosed->adres = *adres;
+        sosed->poslednij_otklik = seichas;
+        sosed->neudachi = 0U;
+        if (smena) {
+            kolibri_roy_vid_perestroit(vid);
+        }
+    } else {
+        if (vid->chislo == vid->emkost && kolibri_roy_vid_rasshirit(vid) != 0) {
+            /* Таблица заполнена: новичок вытесняет случайную пассивную запись. */
+            if (vid->chislo == vid->aktivnyh) {
+                pthread_mutex_unlock(&roy->zamek);
+                return;
+            }
+            pozitsiya = vid->aktivnyh +
+                        kolibri_roy_vid_sluchajnoe(vid, vid->chislo - vid->aktivnyh);
+            kolibri_roy_vid_pomenyat(vid, pozitsiya, vid->chislo - 1U);
+            vid->chislo--;
+            kolibri_roy_vid_perestroit(vid);
+        }
+        pozitsiya = vid->chislo++;
+        KolibriRoySosed *sosed = &vid->zapisi[pozitsiya];
+        sosed->identifikator = identifikator;
+        sosed->adres = *adres;
+        sosed->poslednij_otklik = seichas;
+        sosed->neudachi = 0U;
+        kolibri_roy_vid_vstavit(vid->po_id, vid->maska, identifikator, pozitsiya);
+        kolibri_roy_vid_vstavit(vid->po_adresu, vid->maska,
+                                kolibri_roy_klyuch_adresa(adres), pozitsiya);
     }
-    if (roy->chislo_sosedey < KOLIBRI_ROY_MAX_SOSSEDI) {
-        roy->sosedi[roy->chislo_sosedey].identifikator = identifikator;
-        roy->sosedi[roy->chislo_sosedey].adres = *adres;
-        roy->sosedi[roy->chislo_sosedey].poslednij_otklik = time(NULL);
-        roy->sosedi[roy->chislo_sosedey].neudachi = 0U;
-        roy->chislo_sosedey++;
+    size_t cel = kolibri_roy_vid_cel(vid->chislo);
+    if (vid->aktivnyh < cel ||
+        (prosit_aktivnyj && vid->aktivnyh < 2U * cel)) {
+        kolibri_roy_vid_povysit(vid, pozitsiya);
     }
     pthread_mutex_unlock(&roy->zamek);
 }
 
-/* Удаляет устаревших соседей. */
-static void kolibri_roy_ochistit_sosedey(KolibriRoy *roy) {
+/* Удаляет молчащих соседей и пополняет активный вид из пассивного; адреса
+ * повышенных записей возвращаются, чтобы послать им пульс. Пассивные записи
+ * живут дольше: их обновляют только редкие прямые контакты. */
+static size_t kolibri_roy_ochistit_sosedey(KolibriRoy *roy,
+                                           struct sockaddr_in *povyshennye,
+                                           size_t maksimalno) {
 
     const time_t seichas = time(NULL);
     pthread_mutex_lock(&roy->zamek);
+    KolibriRoyVid *vid = roy->vid;
     size_t zapis = 0U;
-    for (size_t indeks = 0U; indeks < roy->chislo_sosedey; ++indeks) {
-        time_t poslednij = roy->sosedi[indeks].poslednij_otklik;
-        if (poslednij + (time_t)KOLIBRI_ROY_SROK_GODA < seichas) {
+    size_t aktivnyh = 0U;
+    for (size_t indeks = 0U; indeks < vid->chislo; ++indeks) {
+        time_t srok = (time_t)KOLIBRI_ROY_SROK_GODA;
+        if (indeks >= vid->aktivnyh) {
+            srok *= (time_t)KOLIBRI_ROY_PASSIVNYJ_SROK;
+        }
+        if (vid->zapisi[indeks].poslednij_otklik + srok < seichas) {
             continue;
         }
         if (zapis != indeks) {
-            roy->sosedi[zapis] = roy->sosedi[indeks];
+            vid->zapisi[zapis] = vid->zapisi[indeks];
+        }
+        if (indeks < vid->aktivnyh) {
+            aktivnyh++;
         }
         zapis++;
     }
-    roy->chislo_sosedey = zapis;
+    if (zapis != vid->chislo) {
+        vid->chislo = zapis;
+        vid->aktivnyh = aktivnyh;
+        kolibri_roy_vid_perestroit(vid);
+    }
+    size_t povysheno = 0U;
+    size_t cel = kolibri_roy_vid_cel(vid->chislo);
+    while (vid->aktivnyh < cel && vid->aktivnyh < vid->chislo) {
+        size_t pozitsiya =
+            vid->aktivnyh +
+            kolibri_roy_vid_sluchajnoe(vid, vid->chislo - vid->aktivnyh);
+        /* Повышенному даётся полный срок, чтобы он успел ответить на пульс. */
+        vid->zapisi[pozitsiya].poslednij_otklik = seichas;
+        if (povysheno < maksimalno) {
+            povyshennye[povysheno++] = vid->zapisi[pozitsiya].adres;
+        }
+        kolibri_roy_vid_povysit(vid, pozitsiya);
+    }
     pthread_mutex_unlock(&roy->zamek);
+    return povysheno;
 }
 
 /* Формирует общий заголовок KSP-сообщения. */
@@ -150,15 +569,15 @@ static size_t kolibri_roy_prisoedinit_hmac(const KolibriRoy *roy,
                                            uint8_t *buffer,
                                            size_t tekushchaya_dlina) {
 
-    unsigned int hmac_dlina = 0U;
-    unsigned char hmac[KOLIBRI_ROY_HMAC_SIZE];
-    unsigned char *result =
-        HMAC(EVP_sha256(), roy->klyuch, (int)roy->dlina_klyucha, buffer,
-             tekushchaya_dlina, hmac, &hmac_dlina);
-    if (!result || hmac_dlina < KOLIBRI_ROY_HMAC_SIZE) {
+    KolibriRoyPodpis *podpis = roy->podpis;
+    pthread_mutex_lock(&podpis->zamek_otpravki);
+    int rezultat = kolibri_roy_vychislit_mac(podpis->otpravka, buffer,
+                                             tekushchaya_dlina,
+                                             buffer + tekushchaya_dlina);
+    pthread_mutex_unlock(&podpis->zamek_otpravki);
+    if (rezultat != 0) {
         return 0U;
     }
-    memcpy(buffer + tekushchaya_dlina, hmac, KOLIBRI_ROY_HMAC_SIZE);
     return tekushchaya_dlina + KOLIBRI_ROY_HMAC_SIZE;
 }
 
@@ -185,17 +604,20 @@ static void kolibri_roy_shirokoveshchatel(struct sockaddr_in *adres,
     adres->sin_addr.s_addr = htonl(INADDR_BROADCAST);
 }
 
-/* Собирает и отправляет приветственное сообщение. */
+/* Собирает и отправляет приветственное сообщение; flagi занимают
+ * единственный байт полезной нагрузки. */
 static int
 kolibri_roy_soobshchenie_privet(KolibriRoy *roy,
-                                const struct sockaddr_in *naznachenie) {
+                                const struct sockaddr_in *naznachenie,
+                                uint8_t flagi) {
 
     uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
     size_t zagolovok = kolibri_roy_zapolnit_zagolovok(
-        roy, KOLIBRI_ROY_TYP_HELLO, paket, sizeof(paket), 0U);
+        roy, KOLIBRI_ROY_TYP_HELLO, paket, sizeof(paket), 1U);
     if (zagolovok == 0U) {
         return -1;
     }
+    paket[zagolovok++] = flagi;
     size_t polnaja_dlina = kolibri_roy_prisoedinit_hmac(roy, paket, zagolovok);
     if (polnaja_dlina == 0U) {
         return -1;
@@ -203,21 +625,29 @@ kolibri_roy_soobshchenie_privet(KolibriRoy *roy,
     return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
 }
 
-/* Собирает и отправляет формулу. */
-static int
-kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
-                                 const struct sockaddr_in *naznachenie,
-                                 const KolibriFormula *formula) {
+/* Маршрут пересылаемой формулы: оставшиеся прыжки и ключ для отсева
+ * повторов. Старые узлы игнорируют эти байты после приспособленности. */
+typedef struct {
+    uint8_t ttl;
+    uint32_t istochnik;
+    uint32_t nomer;
+} KolibriRoyMarshrut;
+
+/* Собирает подписанный пакет формулы; адресат в подпись не входит, так что
+ * один пакет годится для всех соседей. marshrut == NULL — без пересылки. */
+static size_t kolibri_roy_sobrat_formulu(KolibriRoy *roy,
+                                         const KolibriFormula *formula,
+                                         const KolibriRoyMarshrut *marshrut,
+                                         uint8_t *paket, size_t razmer) {
 
-    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
     uint8_t payload[64];
     size_t offset = 0U;
     if (!formula) {
-        return -1;
+        return 0U;
     }
     uint8_t dlina = (uint8_t)formula->gene.length;
     if (dlina == 0U || dlina > sizeof(formula->gene.digits)) {
-        return -1;
+        return 0U;
     }
     payload[offset++] = dlina;
     memcpy(payload + offset, formula->gene.digits, dlina);
@@ -227,11 +657,62 @@ kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
     kody = kolibri_htonll(kody);
     memcpy(payload + offset, &kody, sizeof(kody));
     offset += sizeof(kody);
+    if (marshrut) {
+        payload[offset++] = marshrut->ttl;
+        uint32_t istochnik = htonl(marshrut->istochnik);
+        memcpy(payload + offset, &istochnik, sizeof(istochnik));
+        offset += sizeof(istochnik);
+        uint32_t nomer = htonl(marshrut->nomer);
+        memcpy(payload + offset, &nomer, sizeof(nomer));
+        offset += sizeof(nomer);
+    }
 
     size_t zagolovok = kolibri_roy_zapolnit_zagolovok(
-        roy, KOLIBRI_ROY_TYP_FORMULA, paket, sizeof(paket), (uint16_t)offset);
+        roy, KOLIBRI_ROY_TYP_FORMULA, paket, razmer, (uint16_t)offset);
     if (zagolovok == 0U ||
-        zagolovok + offset + KOLIBRI_ROY_HMAC_SIZE > sizeof(paket)) {
+        zagolovok + offset + KOLIBRI_ROY_HMAC_SIZE > razmer) {
+        return 0U;
+    }
+    memcpy(paket + zagolovok, payload, offset);
+    return kolibri_roy_prisoedinit_hmac(roy, paket, zagolovok + offset);
+}
+
+/* Отправляет случайную выборку известных узлов; получатель вливает её в
+ * пассивный вид и, если это не ответ, присылает свою. */
+static int kolibri_roy_soobshchenie_obmen(KolibriRoy *roy,
+                                          const struct sockaddr_in *naznachenie,
+                                          uint8_t flagi) {
+
+    uint8_t payload[2U + KOLIBRI_ROY_OBMEN_ZAPISEJ * KOLIBRI_ROY_OBMEN_ZAPIS];
+    size_t offset = 2U;
+    uint8_t zapisej = 0U;
+    pthread_mutex_lock(&roy->zamek);
+    KolibriRoyVid *vid = roy->vid;
+    size_t vyborka = vid->chislo < KOLIBRI_ROY_OBMEN_ZAPISEJ
+                         ? vid->chislo
+                         : KOLIBRI_ROY_OBMEN_ZAPISEJ;
+    for (size_t shag = 0U; shag < vyborka; ++shag) {
+        const KolibriRoySosed *sosed =
+            &vid->zapisi[kolibri_roy_vid_sluchajnoe(vid, vid->chislo)];
+        if (sosed->adres.sin_addr.s_addr == naznachenie->sin_addr.s_addr &&
+            sosed->adres.sin_port == naznachenie->sin_port) {
+            continue;
+        }
+        uint32_t id = htonl(sosed->identifikator);
+        memcpy(payload + offset, &id, sizeof(id));
+        memcpy(payload + offset + 4U, &sosed->adres.sin_addr.s_addr, 4U);
+        memcpy(payload + offset + 8U, &sosed->adres.sin_port, 2U);
+        offset += KOLIBRI_ROY_OBMEN_ZAPIS;
+        zapisej++;
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    payload[0] = flagi;
+    payload[1] = zapisej;
+
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t zagolovok = kolibri_roy_zapolnit_zagolovok(
+        roy, KOLIBRI_ROY_TYP_OBMEN, paket, sizeof(paket), (uint16_t)offset);
+    if (zagolovok == 0U) {
         return -1;
     }
     memcpy(paket + zagolovok, payload, offset);
@@ -243,13 +724,336 @@ kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
     return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
 }
 
+/* Собирает и отправляет формулу. */
+static int
+kolibri_roy_soobshchenie_formula(KolibriRoy *roy,
+                                 const struct sockaddr_in *naznachenie,
+                                 const KolibriFormula *formula) {
+
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t polnaja_dlina =
+        kolibri_roy_sobrat_formulu(roy, formula, NULL, paket, sizeof(paket));
+    if (polnaja_dlina == 0U) {
+        return -1;
+    }
+    return kolibri_roy_otpravit_paket(roy, naznachenie, paket, polnaja_dlina);
+}
+
+/* Отправляет один пакет по списку адресов: на Linux одним sendmmsg на
+ * каждые KOLIBRI_ROY_PACHKA адресатов, иначе по sendto на адрес. Возвращает
+ * число адресатов, которым пакет ушёл. */
+static size_t kolibri_roy_razoslat_paket(const KolibriRoy *roy,
+                                         const struct sockaddr_in *adresa,
+                                         size_t chislo, const uint8_t *paket,
+                                         size_t dlina) {
+
+    size_t otpravleno = 0U;
+#ifdef KOLIBRI_ROY_MMSG
+    struct iovec chast = {(void *)(uintptr_t)paket, dlina};
+    struct mmsghdr soobshcheniya[KOLIBRI_ROY_PACHKA];
+    size_t pozitsiya = 0U;
+    while (pozitsiya < chislo) {
+        size_t porciya = chislo - pozitsiya;
+        if (porciya > KOLIBRI_ROY_PACHKA) {
+            porciya = KOLIBRI_ROY_PACHKA;
+        }
+        memset(soobshcheniya, 0, porciya * sizeof(soobshcheniya[0]));
+        for (size_t indeks = 0U; indeks < porciya; ++indeks) {
+            soobshcheniya[indeks].msg_hdr.msg_name =
+                (void *)(uintptr_t)&adresa[pozitsiya + indeks];
+            soobshcheniya[indeks].msg_hdr.msg_namelen = sizeof(adresa[0]);
+            soobshcheniya[indeks].msg_hdr.msg_iov = &chast;
+            soobshcheniya[indeks].msg_hdr.msg_iovlen = 1U;
+        }
+        int rezultat =
+            sendmmsg(roy->soket, soobshcheniya, (unsigned int)porciya, 0);
+        if (rezultat < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rezultat <= 0) {
+            /* Первый адрес порции не принят: пропускаем его и идём дальше. */
+            pozitsiya++;
+            continue;
+        }
+        pozitsiya += (size_t)rezultat;
+        otpravleno += (size_t)rezultat;
+    }
+#else
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        if (kolibri_roy_otpravit_paket(roy, &adresa[indeks], paket, dlina) == 0) {
+            otpravleno++;
+        }
+    }
+#endif
+    return otpravleno;
+}
+
+size_t kolibri_roy_proverit_pakety(KolibriRoy *roy, const uint8_t *const *pakety,
+                                   const size_t *dliny, size_t chislo,
+                                   uint8_t *verno) {
+
+    if (!roy || !roy->podpis || !pakety || !dliny || !verno) {
+        return 0U;
+    }
+    KolibriRoyPodpis *podpis = roy->podpis;
+    size_t prinyato = 0U;
+    pthread_mutex_lock(&podpis->zamek_priema);
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        verno[indeks] = 0U;
+        if (!pakety[indeks] || dliny[indeks] <= KOLIBRI_ROY_HMAC_SIZE + 10U) {
+            continue;
+        }
+        size_t dlina = dliny[indeks] - KOLIBRI_ROY_HMAC_SIZE;
+        unsigned char rasschet[KOLIBRI_ROY_HMAC_SIZE];
+        if (kolibri_roy_vychislit_mac(podpis->priem, pakety[indeks], dlina,
+                                      rasschet) != 0) {
+            continue;
+        }
+        if (kolibri_roy_sravnit_hmac(pakety[indeks] + dlina, rasschet) != 0) {
+            continue;
+        }
+        verno[indeks] = 1U;
+        ++prinyato;
+    }
+    pthread_mutex_unlock(&podpis->zamek_priema);
+    return prinyato;
+}
+
+/* Пересылает принятую формулу активному виду, кроме её отправителя. */
+static void kolibri_roy_pereslat(KolibriRoy *roy, const KolibriRoySobytie *sobytie,
+                                 const KolibriRoyMarshrut *marshrut) {
+
+    KolibriFormula formula;
+    memset(&formula, 0, sizeof(formula));
+    formula.gene = sobytie->gene;
+    formula.fitness = sobytie->fitness;
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina =
+        kolibri_roy_sobrat_formulu(roy, &formula, marshrut, paket, sizeof(paket));
+    if (dlina == 0U) {
+        return;
+    }
+    struct sockaddr_in adresa[KOLIBRI_ROY_MAX_SOSSEDI];
+    size_t chislo = 0U;
+    pthread_mutex_lock(&roy->zamek);
+    KolibriRoyVid *vid = roy->vid;
+    for (size_t indeks = 0U; indeks < vid->aktivnyh; ++indeks) {
+        if (vid->zapisi[indeks].identifikator != sobytie->identifikator &&
+            vid->zapisi[indeks].identifikator != marshrut->istochnik) {
+            adresa[chislo++] = vid->zapisi[indeks].adres;
+        }
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    kolibri_roy_razoslat_paket(roy, adresa, chislo, paket, dlina);
+}
+
+/* Вливает чужую выборку в пассивный вид и отвечает своей. */
+static void kolibri_roy_obrabotat_obmen(KolibriRoy *roy, uint32_t identifikator,
+                                        const struct sockaddr_in *otkuda,
+                                        const uint8_t *dannye, size_t payload) {
+
+    if (payload < 2U) {
+        return;
+    }
+    kolibri_roy_obnovit_soseda(roy, identifikator, otkuda, 1, 0);
+    size_t zapisej = dannye[1];
+    if (payload < 2U + zapisej * KOLIBRI_ROY_OBMEN_ZAPIS) {
+        return;
+    }
+    for (size_t indeks = 0U; indeks < zapisej; ++indeks) {
+        const uint8_t *zapis = dannye + 2U + indeks * KOLIBRI_ROY_OBMEN_ZAPIS;
+        uint32_t id;
+        memcpy(&id, zapis, sizeof(id));
+        struct sockaddr_in adres;
+        memset(&adres, 0, sizeof(adres));
+        adres.sin_family = AF_INET;
+        memcpy(&adres.sin_addr.s_addr, zapis + 4U, 4U);
+        memcpy(&adres.sin_port, zapis + 8U, 2U);
+        kolibri_roy_obnovit_soseda(roy, ntohl(id), &adres, 0, 0);
+    }
+    if ((dannye[0] & KOLIBRI_ROY_OBMEN_OTVET) == 0U) {
+        kolibri_roy_soobshchenie_obmen(roy, otkuda, KOLIBRI_ROY_OBMEN_OTVET);
+    }
+}
+
+/* Разбирает датаграмму с уже проверенной подписью и ставит её событие в
+ * кольцо. */
+static void kolibri_roy_obrabotat_paket(KolibriRoy *roy, const uint8_t *paket,
+                                        size_t prinyato,
+                                        struct sockaddr_in otkuda) {
+
+    size_t dlina = prinyato - KOLIBRI_ROY_HMAC_SIZE;
+    if (memcmp(paket, KOLIBRI_ROY_MAGIC, 4U) != 0) {
+        return;
+    }
+    uint8_t versiya = paket[4];
+    if (versiya != KOLIBRI_ROY_VERSIYA) {
+        return;
+    }
+    uint8_t tip = paket[5];
+    uint32_t identifikator;
+    memcpy(&identifikator, paket + 6U, sizeof(identifikator));
+    identifikator = ntohl(identifikator);
+    if (identifikator == roy->sobstvennyj_id) {
+        return;
+    }
+    uint16_t port;
+    memcpy(&port, paket + 10U, sizeof(port));
+    port = ntohs(port);
+    uint16_t payload;
+    memcpy(&payload, paket + 12U, sizeof(payload));
+    payload = ntohs(payload);
+    if (12U + payload > dlina) {
+        return;
+    }
+    otkuda.sin_port = htons(port);
+    const uint8_t *dannye = paket + 14U;
+    if (tip == KOLIBRI_ROY_TYP_OBMEN) {
+        kolibri_roy_obrabotat_obmen(roy, identifikator, &otkuda, dannye, payload);
+        return;
+    }
+    uint8_t flagi = 0U;
+    if (tip == KOLIBRI_ROY_TYP_HELLO && payload >= 1U) {
+        flagi = dannye[0];
+    }
+    kolibri_roy_obnovit_soseda(roy, identifikator, &otkuda, 1,
+                               (flagi & KOLIBRI_ROY_PRIVET_AKTIVNYJ) != 0U);
+    KolibriRoySobytie sobytie;
+    memset(&sobytie, 0, sizeof(sobytie));
+    sobytie.identifikator = identifikator;
+    sobytie.adres = otkuda;
+    if (tip == KOLIBRI_ROY_TYP_HELLO) {
+        sobytie.tip = KOLIBRI_ROY_SOBYTIE_HELLO;
+        kolibri_roy_postavit_sobytie(roy, &sobytie);
+    } else if (tip == KOLIBRI_ROY_TYP_FORMULA) {
+        if (payload < 1U + sizeof(uint64_t)) {
+            return;
+        }
+        uint8_t dlina_gena = dannye[0];
+        if (dlina_gena == 0U || dlina_gena > 32U ||
+            payload < 1U + dlina_gena + sizeof(uint64_t)) {
+            return;
+        }
+        memcpy(sobytie.gene.digits, dannye + 1U, dlina_gena);
+        sobytie.gene.length = dlina_gena;
+        uint64_t syrjoj;
+        memcpy(&syrjoj, dannye + 1U + dlina_gena, sizeof(syrjoj));
+        syrjoj = kolibri_ntohll(syrjoj);
+        memcpy(&sobytie.fitness, &syrjoj, sizeof(syrjoj));
+        sobytie.tip = KOLIBRI_ROY_SOBYTIE_FORMULA;
+
+        size_t hvost = 1U + dlina_gena + sizeof(uint64_t);
+        if (payload >= hvost + 9U) {
+            KolibriRoyMarshrut marshrut;
+            marshrut.ttl = dannye[hvost];
+            memcpy(&marshrut.istochnik, dannye + hvost + 1U, 4U);
+            marshrut.istochnik = ntohl(marshrut.istochnik);
+            memcpy(&marshrut.nomer, dannye + hvost + 5U, 4U);
+            marshrut.nomer = ntohl(marshrut.nomer);
+            pthread_mutex_lock(&roy->zamek);
+            int povtor = kolibri_roy_vid_uzhe_videl(roy->vid, marshrut.istochnik,
+                                                    marshrut.nomer);
+            pthread_mutex_unlock(&roy->zamek);
+            if (povtor) {
+                return;
+            }
+            kolibri_roy_postavit_sobytie(roy, &sobytie);
+            if (marshrut.ttl > 1U) {
+                marshrut.ttl--;
+                kolibri_roy_pereslat(roy, &sobytie, &marshrut);
+            }
+            return;
+        }
+        kolibri_roy_postavit_sobytie(roy, &sobytie);
+    }
+}
+
+/* Забирает накопившиеся датаграммы: на Linux до KOLIBRI_ROY_PACHKA за один
+ * recvmmsg, иначе неблокирующими recvfrom до опустошения сокета. Подписи всей
+ * пачки проверяются под одним захватом контекста. */
+static void kolibri_roy_prinyat_pachku(KolibriRoy *roy) {
+
+    uint8_t pakety[KOLIBRI_ROY_PACHKA][KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    struct sockaddr_in otkuda[KOLIBRI_ROY_PACHKA];
+    const uint8_t *ukazateli[KOLIBRI_ROY_PACHKA];
+    size_t dliny[KOLIBRI_ROY_PACHKA];
+    uint8_t verno[KOLIBRI_ROY_PACHKA];
+#ifdef KOLIBRI_ROY_MMSG
+    struct iovec chasti[KOLIBRI_ROY_PACHKA];
+    struct mmsghdr soobshcheniya[KOLIBRI_ROY_PACHKA];
+    memset(soobshcheniya, 0, sizeof(soobshcheniya));
+    for (size_t indeks = 0U; indeks < KOLIBRI_ROY_PACHKA; ++indeks) {
+        chasti[indeks].iov_base = pakety[indeks];
+        chasti[indeks].iov_len = sizeof(pakety[indeks]);
+        soobshcheniya[indeks].msg_hdr.msg_name = &otkuda[indeks];
+        soobshcheniya[indeks].msg_hdr.msg_namelen = sizeof(otkuda[indeks]);
+        soobshcheniya[indeks].msg_hdr.msg_iov = &chasti[indeks];
+        soobshcheniya[indeks].msg_hdr.msg_iovlen = 1U;
+    }
+    int prinyato = recvmmsg(roy->soket, soobshcheniya, KOLIBRI_ROY_PACHKA,
+                            MSG_DONTWAIT, NULL);
+    if (prinyato <= 0) {
+        return;
+    }
+    size_t chislo = (size_t)prinyato;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        ukazateli[indeks] = pakety[indeks];
+        dliny[indeks] =
+            soobshcheniya[indeks].msg_hdr.msg_namelen == sizeof(otkuda[0])
+                ? soobshcheniya[indeks].msg_len
+                : 0U;
+    }
+#else
+    size_t chislo = 0U;
+    while (chislo < KOLIBRI_ROY_PACHKA) {
+        socklen_t otkuda_dlina = sizeof(otkuda[0]);
+        ssize_t prinyato =
+            recvfrom(roy->soket, pakety[chislo], sizeof(pakety[chislo]),
+                     MSG_DONTWAIT, (struct sockaddr *)&otkuda[chislo],
+                     &otkuda_dlina);
+        if (prinyato <= 0) {
+            break;
+        }
+        ukazateli[chislo] = pakety[chislo];
+        dliny[chislo] = (size_t)prinyato;
+        ++chislo;
+    }
+#endif
+    kolibri_roy_proverit_pakety(roy, ukazateli, dliny, chislo, verno);
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        if (verno[indeks]) {
+            kolibri_roy_obrabotat_paket(roy, pakety[indeks], dliny[indeks],
+                                        otkuda[indeks]);
+        }
+    }
+}
+
+/* Раз в интервал приветствия: пульс активному виду, чтобы он держал нас
+ * в своём, и обмен выборками с одним случайным активным соседом. */
+static void kolibri_roy_pulsirovat(KolibriRoy *roy) {
+
+    struct sockaddr_in adresa[KOLIBRI_ROY_MAX_SOSSEDI];
+    pthread_mutex_lock(&roy->zamek);
+    KolibriRoyVid *vid = roy->vid;
+    size_t chislo = vid->aktivnyh;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        adresa[indeks] = vid->zapisi[indeks].adres;
+    }
+    size_t partner = chislo ? kolibri_roy_vid_sluchajnoe(vid, chislo) : 0U;
+    pthread_mutex_unlock(&roy->zamek);
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        kolibri_roy_soobshchenie_privet(roy, &adresa[indeks],
+                                        KOLIBRI_ROY_PRIVET_AKTIVNYJ);
+    }
+    if (chislo > 0U) {
+        kolibri_roy_soobshchenie_obmen(roy, &adresa[partner], 0U);
+    }
+}
+
 /* Главная петля фонового потока: слушает UDP и отправляет приветствия. */
 static void *kolibri_roy_potok(void *argument) {
 
     KolibriRoy *roy = (KolibriRoy *)argument;
-    struct sockaddr_in otkuda;
-    socklen_t otkuda_dlina = sizeof(otkuda);
-    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
     while (roy->zapushchen) {
         struct timeval tv;
         tv.tv_sec = 1;
@@ -268,126 +1072,92 @@ static void *kolibri_roy_potok(void *argument) {
             continue;
         }
         if (gotov > 0 && FD_ISSET(roy->soket, &nabor)) {
-            ssize_t prinyato =
-                recvfrom(roy->soket, paket, sizeof(paket), 0,
-                         (struct sockaddr *)&otkuda, &otkuda_dlina);
-            if (prinyato <= 0) {
-                continue;
-            }
-            if ((size_t)prinyato <= KOLIBRI_ROY_HMAC_SIZE + 10U) {
-                continue;
-            }
-            size_t dlina = (size_t)prinyato;
-            unsigned char prisoyedennyj[KOLIBRI_ROY_HMAC_SIZE];
-            memcpy(prisoyedennyj, paket + dlina - KOLIBRI_ROY_HMAC_SIZE,
-                   KOLIBRI_ROY_HMAC_SIZE);
-            dlina -= KOLIBRI_ROY_HMAC_SIZE;
-            unsigned int hmac_dlina = 0U;
-            unsigned char rasschet[KOLIBRI_ROY_HMAC_SIZE];
-            unsigned char *result =
-                HMAC(EVP_sha256(), roy->klyuch, (int)roy->dlina_klyucha, paket,
-                     dlina, rasschet, &hmac_dlina);
-            if (!result || hmac_dlina < KOLIBRI_ROY_HMAC_SIZE) {
-                continue;
-            }
-            if (kolibri_roy_sravnit_hmac(prisoyedennyj, rasschet) != 0) {
-                continue;
-            }
-            if (memcmp(paket, KOLIBRI_ROY_MAGIC, 4U) != 0) {
-                continue;
-            }
-            uint8_t versiya = paket[4];
-            if (versiya != KOLIBRI_ROY_VERSIYA) {
-                continue;
-            }
-            uint8_t tip = paket[5];
-            uint32_t identifikator;
-            memcpy(&identifikator, paket + 6U, sizeof(identifikator));
-            identifikator = ntohl(identifikator);
-            if (identifikator == roy->sobstvennyj_id) {
-                continue;
-            }
-            uint16_t port;
-            memcpy(&port, paket + 10U, sizeof(port));
-            port = ntohs(port);
-            uint16_t payload;
-            memcpy(&payload, paket + 12U, sizeof(payload));
-            payload = ntohs(payload);
-            if (12U + payload > dlina) {
-                continue;
-            }
-            otkuda.sin_port = htons(port);
-            kolibri_roy_obnovit_soseda(roy, identifikator, &otkuda);
-            KolibriRoySobytie sobytie;
-            memset(&sobytie, 0, sizeof(sobytie));
-            sobytie.identifikator = identifikator;
-            sobytie.adres = otkuda;
-            if (tip == KOLIBRI_ROY_TYP_HELLO) {
-                sobytie.tip = KOLIBRI_ROY_SOBYTIE_HELLO;
-                kolibri_roy_postavit_sobytie(roy, &sobytie);
-            } else if (tip == KOLIBRI_ROY_TYP_FORMULA) {
-                if (payload < 1U + sizeof(uint64_t)) {
-                    continue;
-                }
-                const uint8_t *dannye = paket + 14U;
-                uint8_t dlina_gena = dannye[0];
-                if (dlina_gena == 0U || dlina_gena > 32U ||
-                    payload < 1U + dlina_gena + sizeof(uint64_t)) {
-                    continue;
-                }
-                memcpy(sobytie.formula.gene.digits, dannye + 1U, dlina_gena);
-                sobytie.formula.gene.length = dlina_gena;
-                uint64_t syrjoj;
-                memcpy(&syrjoj, dannye + 1U + dlina_gena, sizeof(syrjoj));
-                syrjoj = kolibri_ntohll(syrjoj);
-                memcpy(&sobytie.formula.fitness, &syrjoj, sizeof(syrjoj));
-                sobytie.formula.feedback = 0.0;
-                sobytie.tip = KOLIBRI_ROY_SOBYTIE_FORMULA;
-                kolibri_roy_postavit_sobytie(roy, &sobytie);
-            }
+            kolibri_roy_prinyat_pachku(roy);
         }
         time_t seichas = time(NULL);
         if (seichas - roy->poslednij_privet >=
             (time_t)KOLIBRI_ROY_PRIVET_INTERVAL) {
             struct sockaddr_in broadcast;
             kolibri_roy_shirokoveshchatel(&broadcast, roy->port);
-            kolibri_roy_soobshchenie_privet(roy, &broadcast);
+            kolibri_roy_soobshchenie_privet(roy, &broadcast, 0U);
+            kolibri_roy_pulsirovat(roy);
             roy->poslednij_privet = seichas;
         }
-        kolibri_roy_ochistit_sosedey(roy);
+        struct sockaddr_in povyshennye[KOLIBRI_ROY_MAX_SOSSEDI];
+        size_t chislo = kolibri_roy_ochistit_sosedey(
+            roy, povyshennye, KOLIBRI_ROY_MAX_SOSSEDI);
+        for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+            kolibri_roy_soobshchenie_privet(roy, &povyshennye[indeks],
+                                            KOLIBRI_ROY_PRIVET_AKTIVNYJ);
+        }
     }
     return NULL;
 }
 
+/* Освобождает кольцо и контексты подписи. */
+static void kolibri_roy_osvobodit_resursy(KolibriRoy *roy) {
+
+    free(roy->ochered);
+    roy->ochered = NULL;
+    kolibri_roy_osvobodit_podpis(roy->podpis);
+    roy->podpis = NULL;
+    kolibri_roy_osvobodit_vid(roy->vid);
+    roy->vid = NULL;
+}
+
 int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
                          const unsigned char *klyuch, size_t dlina_klyucha) {
 
+    return kolibri_roy_zapustit_s_ocheredyu(roy, identifikator, port, klyuch,
+                                            dlina_klyucha, 0U);
+}
+
+int kolibri_roy_zapustit_s_ocheredyu(KolibriRoy *roy, uint32_t identifikator,
+                                     uint16_t port, const unsigned char *klyuch,
+                                     size_t dlina_klyucha,
+                                     size_t razmer_ocheredi) {
+
     if (!roy || !klyuch || dlina_klyucha == 0U) {
         return -1;
     }
     memset(roy, 0, sizeof(*roy));
+    roy->ochered = kolibri_roy_sozdat_ochered(
+        razmer_ocheredi ? razmer_ocheredi : KOLIBRI_ROY_MAX_OCHERED);
+    if (!roy->ochered) {
+        return -1;
+    }
     roy->sobstvennyj_id = identifikator;
     roy->port = port;
     roy->dlina_klyucha = dlina_klyucha > KOLIBRI_ROY_HMAC_SIZE
                              ? KOLIBRI_ROY_HMAC_SIZE
                              : dlina_klyucha;
     memcpy(roy->klyuch, klyuch, roy->dlina_klyucha);
+    roy->podpis = kolibri_roy_sozdat_podpis(roy->klyuch, roy->dlina_klyucha);
+    roy->vid = kolibri_roy_sozdat_vid(
+        kolibri_roy_peremeshat(((uint64_t)identifikator << 16) ^ port ^
+                               (uint64_t)time(NULL)));
+    if (!roy->podpis || !roy->vid) {
+        kolibri_roy_osvobodit_resursy(roy);
+        return -1;
+    }
     pthread_mutex_init(&roy->zamek, NULL);
-    pthread_mutex_init(&roy->ochered_zamek, NULL);
     roy->soket = socket(AF_INET, SOCK_DGRAM, 0);
     if (roy->soket < 0) {
+        kolibri_roy_osvobodit_resursy(roy);
         return -1;
     }
     int reuse = 1;
     if (setsockopt(roy->soket, SOL_SOCKET, SO_REUSEADDR, &reuse,
                    sizeof(reuse)) < 0) {
         close(roy->soket);
+        kolibri_roy_osvobodit_resursy(roy);
         return -1;
     }
     int broadcast = 1;
     if (setsockopt(roy->soket, SOL_SOCKET, SO_BROADCAST, &broadcast,
                    sizeof(broadcast)) < 0) {
         close(roy->soket);
+        kolibri_roy_osvobodit_resursy(roy);
         return -1;
     }
     struct sockaddr_in adres;
@@ -397,6 +1167,7 @@ int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
     adres.sin_port = htons(port);
     if (bind(roy->soket, (struct sockaddr *)&adres, sizeof(adres)) < 0) {
         close(roy->soket);
+        kolibri_roy_osvobodit_resursy(roy);
         return -1;
     }
     roy->zapushchen = 1;
@@ -404,11 +1175,12 @@ int kolibri_roy_zapustit(KolibriRoy *roy, uint32_t identifikator, uint16_t port,
     if (pthread_create(&roy->potok, NULL, kolibri_roy_potok, roy) != 0) {
         close(roy->soket);
         roy->zapushchen = 0;
+        kolibri_roy_osvobodit_resursy(roy);
         return -1;
     }
     struct sockaddr_in broadcast_adres;
     kolibri_roy_shirokoveshchatel(&broadcast_adres, port);
-    kolibri_roy_soobshchenie_privet(roy, &broadcast_adres);
+    kolibri_roy_soobshchenie_privet(roy, &broadcast_adres, 0U);
     return 0;
 }
 
@@ -429,42 +1201,78 @@ void kolibri_roy_ostanovit(KolibriRoy *roy) {
         roy->soket = -1;
     }
     pthread_mutex_destroy(&roy->zamek);
-    pthread_mutex_destroy(&roy->ochered_zamek);
+    kolibri_roy_osvobodit_resursy(roy);
 }
 
 int kolibri_roy_poluchit_sobytie(KolibriRoy *roy, KolibriRoySobytie *sobytie) {
 
-    if (!roy || !sobytie) {
+    if (!roy || !sobytie || !roy->ochered) {
         return -1;
     }
-    pthread_mutex_lock(&roy->ochered_zamek);
-    if (roy->ochered_schetchik == 0U) {
-        pthread_mutex_unlock(&roy->ochered_zamek);
-        return 0;
+    return kolibri_roy_poluchit_sobytiya(roy, sobytie, 1U) == 1U ? 1 : 0;
+}
+
+size_t kolibri_roy_poluchit_sobytiya(KolibriRoy *roy,
+                                     KolibriRoySobytie *naznachenie,
+                                     size_t maksimalno) {
+
+    if (!roy || !naznachenie || !roy->ochered) {
+        return 0U;
+    }
+    KolibriRoyOchered *ochered = roy->ochered;
+    size_t golova = atomic_load_explicit(&ochered->golova, memory_order_relaxed);
+    size_t hvost = atomic_load_explicit(&ochered->hvost, memory_order_acquire);
+    size_t chislo = hvost - golova;
+    if (chislo > maksimalno) {
+        chislo = maksimalno;
     }
-    *sobytie = roy->ochered[roy->ochered_golova];
-    roy->ochered_golova = (roy->ochered_golova + 1U) % KOLIBRI_ROY_MAX_OCHERED;
-    roy->ochered_schetchik--;
-    pthread_mutex_unlock(&roy->ochered_zamek);
-    return 1;
+    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
+        naznachenie[indeks] = ochered->sloty[(golova + indeks) & ochered->maska];
+    }
+    atomic_store_explicit(&ochered->golova, golova + chislo, memory_order_release);
+    return chislo;
+}
+
+uint64_t kolibri_roy_poteryano_sobytiy(const KolibriRoy *roy) {
+
+    if (!roy || !roy->ochered) {
+        return 0U;
+    }
+    return (uint64_t)atomic_load_explicit(&roy->ochered->poteri,
+                                          memory_order_relaxed);
 }
 
 size_t kolibri_roy_spisok_sosedey(KolibriRoy *roy, KolibriRoySosed *naznachenie,
                                   size_t maksimalno) {
 
-    if (!roy || !naznachenie || maksimalno == 0U) {
+    if (!roy || !roy->vid || !naznachenie || maksimalno == 0U) {
         return 0U;
     }
     pthread_mutex_lock(&roy->zamek);
     size_t kopiruem =
-        roy->chislo_sosedey < maksimalno ? roy->chislo_sosedey : maksimalno;
-    for (size_t indeks = 0U; indeks < kopiruem; ++indeks) {
-        naznachenie[indeks] = roy->sosedi[indeks];
-    }
+        roy->vid->chislo < maksimalno ? roy->vid->chislo : maksimalno;
+    memcpy(naznachenie, roy->vid->zapisi, kopiruem * sizeof(*naznachenie));
     pthread_mutex_unlock(&roy->zamek);
     return kopiruem;
 }
 
+size_t kolibri_roy_razmer_vida(KolibriRoy *roy, size_t *passivnyh) {
+
+    if (passivnyh) {
+        *passivnyh = 0U;
+    }
+    if (!roy || !roy->vid) {
+        return 0U;
+    }
+    pthread_mutex_lock(&roy->zamek);
+    size_t aktivnyh = roy->vid->aktivnyh;
+    if (passivnyh) {
+        *passivnyh = roy->vid->chislo - aktivnyh;
+    }
+    pthread_mutex_unlock(&roy->zamek);
+    return aktivnyh;
+}
+
 int kolibri_roy_otpravit_privet(KolibriRoy *roy) {
 
     if (!roy) {
@@ -473,32 +1281,33 @@ int kolibri_roy_otpravit_privet(KolibriRoy *roy) {
     struct sockaddr_in broadcast_adres;
     kolibri_roy_shirokoveshchatel(&broadcast_adres, roy->port);
     roy->poslednij_privet = time(NULL);
-    return kolibri_roy_soobshchenie_privet(roy, &broadcast_adres);
+    return kolibri_roy_soobshchenie_privet(roy, &broadcast_adres, 0U);
 }
 
 int kolibri_roy_dobavit_soseda(KolibriRoy *roy, const struct sockaddr_in *adres,
                                uint32_t identifikator) {
 
-    if (!roy || !adres) {
+    if (!roy || !adres || !roy->vid) {
         return -1;
     }
-    kolibri_roy_obnovit_soseda(roy, identifikator, adres);
-    return kolibri_roy_soobshchenie_privet(roy, adres);
+    kolibri_roy_obnovit_soseda(roy, identifikator, adres, 1, 0);
+    return kolibri_roy_soobshchenie_privet(roy, adres,
+                                           KOLIBRI_ROY_PRIVET_AKTIVNYJ);
 }
 
 int kolibri_roy_otpravit_sluchajnomu(KolibriRoy *roy, uint64_t sluchajnoe,
                                      const KolibriFormula *formula) {
 
-    if (!roy || !formula) {
+    if (!roy || !formula || !roy->vid) {
         return -1;
     }
     pthread_mutex_lock(&roy->zamek);
-    if (roy->chislo_sosedey == 0U) {
+    if (roy->vid->aktivnyh == 0U) {
         pthread_mutex_unlock(&roy->zamek);
         return -1;
     }
-    size_t indeks = (size_t)(sluchajnoe % roy->chislo_sosedey);
-    KolibriRoySosed sosed = roy->sosedi[indeks];
+    size_t indeks = (size_t)(sluchajnoe % roy->vid->aktivnyh);
+    KolibriRoySosed sosed = roy->vid->zapisi[indeks];
     pthread_mutex_unlock(&roy->zamek);
     if (kolibri_roy_soobshchenie_formula(roy, &sosed.adres, formula) != 0) {
         return -1;
@@ -508,21 +1317,30 @@ int kolibri_roy_otpravit_sluchajnomu(KolibriRoy *roy, uint64_t sluchajnoe,
 
 int kolibri_roy_otpravit_vsem(KolibriRoy *roy, const KolibriFormula *formula) {
 
-    if (!roy || !formula) {
+    if (!roy || !formula || !roy->vid) {
         return -1;
     }
-    struct sockaddr_in broadcast_adres;
-    kolibri_roy_shirokoveshchatel(&broadcast_adres, roy->port);
-    kolibri_roy_soobshchenie_formula(roy, &broadcast_adres, formula);
+    KolibriRoyMarshrut marshrut;
+    marshrut.ttl = (uint8_t)KOLIBRI_ROY_TTL;
+    marshrut.istochnik = roy->sobstvennyj_id;
+    struct sockaddr_in adresa[KOLIBRI_ROY_MAX_SOSSEDI + 1U];
+    kolibri_roy_shirokoveshchatel(&adresa[0], roy->port);
     pthread_mutex_lock(&roy->zamek);
-    size_t chislo = roy->chislo_sosedey;
-    KolibriRoySosed lokalnye[KOLIBRI_ROY_MAX_SOSSEDI];
+    KolibriRoyVid *vid = roy->vid;
+    marshrut.nomer = ++vid->nomer_formuly;
+    /* Своё эхо, вернувшееся по кругу, не должно стать событием. */
+    kolibri_roy_vid_uzhe_videl(vid, marshrut.istochnik, marshrut.nomer);
+    size_t chislo = vid->aktivnyh;
     for (size_t indeks = 0U; indeks < chislo; ++indeks) {
-        lokalnye[indeks] = roy->sosedi[indeks];
+        adresa[indeks + 1U] = vid->zapisi[indeks].adres;
     }
     pthread_mutex_unlock(&roy->zamek);
-    for (size_t indeks = 0U; indeks < chislo; ++indeks) {
-        kolibri_roy_soobshchenie_formula(roy, &lokalnye[indeks].adres, formula);
+    uint8_t paket[KOLIBRI_ROY_MAKSIMALNYJ_PAKET];
+    size_t dlina =
+        kolibri_roy_sobrat_formulu(roy, formula, &marshrut, paket, sizeof(paket));
+    if (dlina == 0U) {
+        return -1;
     }
+    kolibri_roy_razoslat_paket(roy, adresa, chislo + 1U, paket, dlina);
     return 0;
 }
@@ -5,10 +5,12 @@
 
 #include "kolibri/script.h"
 #include "kolibri/decimal.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
 #include <errno.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -16,6 +18,9 @@
 #include <string.h>
 #include <time.h>
 
+#define KOLIBRI_MEMORY_SUBSYSTEM KOLIBRI_MEMORY_SCRIPT
+#include "kolibri/memory.h"
+
 #define KOLIBRI_MAX_LOOP_ITERATIONS 1024
 #define KOLIBRI_ARRAY_GROWTH_FACTOR 2U
 
@@ -54,7 +59,137 @@ typedef struct {
     KolibriSourceSpan span;
 } KolibriToken;
 
+/* ===================== Arena ===================== */
+
+/*
+ * Токены, лексемы, диагностика и узлы AST живут одну компиляцию: всё берётся
+ * из страничной bump-арены (как KArena в wasm/kolibri_core.c) и отпускается
+ * разом сбросом. Байткод в арену не попадает — он переживает компиляцию.
+ */
+#define KOLIBRI_ARENA_PAGE_SIZE 16384U
+#define KOLIBRI_ARENA_ALIGNMENT 16U
+#define KOLIBRI_ARENA_RETAIN_BYTES (1024U * 1024U)
+
+typedef struct KolibriArenaPage {
+    struct KolibriArenaPage *next;
+    size_t capacity;
+    size_t offset;
+    _Alignas(KOLIBRI_ARENA_ALIGNMENT) unsigned char data[];
+} KolibriArenaPage;
+
+struct KolibriScriptArena {
+    KolibriArenaPage *head;
+    KolibriArenaPage *current;
+    size_t reserved;
+};
+
+static KolibriArenaPage *kolibri_arena_page_create(size_t capacity) {
+    KolibriArenaPage *page = (KolibriArenaPage *)malloc(sizeof(KolibriArenaPage) + capacity);
+    if (!page) {
+        return NULL;
+    }
+    page->next = NULL;
+    page->capacity = capacity;
+    page->offset = 0U;
+    return page;
+}
+
+static struct KolibriScriptArena *kolibri_arena_create(void) {
+    return (struct KolibriScriptArena *)calloc(1U, sizeof(struct KolibriScriptArena));
+}
+
+static void kolibri_arena_release_pages(KolibriArenaPage *page) {
+    while (page) {
+        KolibriArenaPage *next = page->next;
+        free(page);
+        page = next;
+    }
+}
+
+static void kolibri_arena_dispose(struct KolibriScriptArena *arena) {
+    if (!arena) {
+        return;
+    }
+    kolibri_arena_release_pages(arena->head);
+    free(arena);
+}
+
+/* Сброс за O(1): смещения страниц обнуляются при повторном входе в них. */
+static void kolibri_arena_reset(struct KolibriScriptArena *arena) {
+    if (!arena || !arena->head) {
+        return;
+    }
+    if (arena->reserved > KOLIBRI_ARENA_RETAIN_BYTES) {
+        kolibri_arena_release_pages(arena->head->next);
+        arena->head->next = NULL;
+        arena->reserved = arena->head->capacity;
+    }
+    arena->head->offset = 0U;
+    arena->current = arena->head;
+}
+
+static void *kolibri_arena_alloc(struct KolibriScriptArena *arena, size_t size) {
+    size = (size + KOLIBRI_ARENA_ALIGNMENT - 1U) & ~(size_t)(KOLIBRI_ARENA_ALIGNMENT - 1U);
+    if (!arena->current) {
+        size_t capacity = size > KOLIBRI_ARENA_PAGE_SIZE ? size : KOLIBRI_ARENA_PAGE_SIZE;
+        arena->head = kolibri_arena_page_create(capacity);
+        if (!arena->head) {
+            return NULL;
+        }
+        arena->current = arena->head;
+        arena->reserved = capacity;
+    }
+    KolibriArenaPage *page = arena->current;
+    if (page->capacity - page->offset < size) {
+        KolibriArenaPage *next = page->next;
+        if (!next || next->capacity < size) {
+            /* Крупные блоки получают отдельную страницу своего размера. */
+            size_t capacity = size > KOLIBRI_ARENA_PAGE_SIZE ? size : KOLIBRI_ARENA_PAGE_SIZE;
+            KolibriArenaPage *fresh = kolibri_arena_page_create(capacity);
+            if (!fresh) {
+                return NULL;
+            }
+            fresh->next = next;
+            page->next = fresh;
+            arena->reserved += capacity;
+            next = fresh;
+        }
+        next->offset = 0U;
+        arena->current = next;
+        page = next;
+    }
+    void *ptr = page->data + page->offset;
+    page->offset += size;
+    return ptr;
+}
+
+static char *kolibri_arena_strndup(struct KolibriScriptArena *arena, const char *src, size_t len) {
+    char *copy = (char *)kolibri_arena_alloc(arena, len + 1U);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, src, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* Рост массива внутри арены: старый блок просто остаётся до сброса. */
+static void *kolibri_arena_grow(struct KolibriScriptArena *arena, void *data, size_t count,
+                                size_t *capacity, size_t initial, size_t item_size) {
+    size_t new_capacity = *capacity == 0 ? initial : *capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
+    void *new_data = kolibri_arena_alloc(arena, new_capacity * item_size);
+    if (!new_data) {
+        return NULL;
+    }
+    if (count > 0) {
+        memcpy(new_data, data, count * item_size);
+    }
+    *capacity = new_capacity;
+    return new_data;
+}
+
 typedef struct {
+    struct KolibriScriptArena *arena;
     KolibriToken *data;
     size_t count;
     size_t capacity;
@@ -66,25 +201,14 @@ typedef struct {
 } KolibriDiagnostic;
 
 typedef struct {
+    struct KolibriScriptArena *arena;
     KolibriDiagnostic *data;
     size_t count;
     size_t capacity;
 } KolibriDiagnosticBuffer;
 
-static void kolibri_token_buffer_init(KolibriTokenBuffer *buffer) {
-    buffer->data = NULL;
-    buffer->count = 0;
-    buffer->capacity = 0;
-}
-
-static void kolibri_token_buffer_free(KolibriTokenBuffer *buffer) {
-    if (!buffer) {
-        return;
-    }
-    for (size_t i = 0; i < buffer->count; ++i) {
-        free(buffer->data[i].lexeme);
-    }
-    free(buffer->data);
+static void kolibri_token_buffer_init(KolibriTokenBuffer *buffer, struct KolibriScriptArena *arena) {
+    buffer->arena = arena;
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
@@ -92,32 +216,19 @@ static void kolibri_token_buffer_free(KolibriTokenBuffer *buffer) {
 
 static int kolibri_token_buffer_push(KolibriTokenBuffer *buffer, KolibriToken token) {
     if (buffer->count == buffer->capacity) {
-        size_t new_capacity = buffer->capacity == 0 ? 32U : buffer->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriToken *new_data = (KolibriToken *)realloc(buffer->data, new_capacity * sizeof(KolibriToken));
+        KolibriToken *new_data = (KolibriToken *)kolibri_arena_grow(buffer->arena, buffer->data, buffer->count,
+                                                                    &buffer->capacity, 32U, sizeof(KolibriToken));
         if (!new_data) {
             return -1;
         }
         buffer->data = new_data;
-        buffer->capacity = new_capacity;
     }
     buffer->data[buffer->count++] = token;
     return 0;
 }
 
-static void kolibri_diagnostic_buffer_init(KolibriDiagnosticBuffer *buffer) {
-    buffer->data = NULL;
-    buffer->count = 0;
-    buffer->capacity = 0;
-}
-
-static void kolibri_diagnostic_buffer_free(KolibriDiagnosticBuffer *buffer) {
-    if (!buffer) {
-        return;
-    }
-    for (size_t i = 0; i < buffer->count; ++i) {
-        free(buffer->data[i].message);
-    }
-    free(buffer->data);
+static void kolibri_diagnostic_buffer_init(KolibriDiagnosticBuffer *buffer, struct KolibriScriptArena *arena) {
+    buffer->arena = arena;
     buffer->data = NULL;
     buffer->count = 0;
     buffer->capacity = 0;
@@ -125,17 +236,17 @@ static void kolibri_diagnostic_buffer_free(KolibriDiagnosticBuffer *buffer) {
 
 static int kolibri_diagnostic_buffer_push(KolibriDiagnosticBuffer *buffer, const char *message, KolibriSourceSpan span) {
     if (buffer->count == buffer->capacity) {
-        size_t new_capacity = buffer->capacity == 0 ? 8U : buffer->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriDiagnostic *new_data = (KolibriDiagnostic *)realloc(buffer->data, new_capacity * sizeof(KolibriDiagnostic));
+        KolibriDiagnostic *new_data = (KolibriDiagnostic *)kolibri_arena_grow(buffer->arena, buffer->data, buffer->count,
+                                                                              &buffer->capacity, 8U,
+                                                                              sizeof(KolibriDiagnostic));
         if (!new_data) {
             return -1;
         }
         buffer->data = new_data;
-        buffer->capacity = new_capacity;
     }
     char *dup = NULL;
     if (message) {
-        dup = strdup(message);
+        dup = kolibri_arena_strndup(buffer->arena, message, strlen(message));
         if (!dup) {
             return -1;
         }
@@ -344,16 +455,12 @@ static int kolibri_lexer_emit_token(KolibriLexer *lexer, KolibriTokenType type,
                                     KolibriSourceLocation start_loc, KolibriSourceLocation end_loc) {
     KolibriToken token;
     token.type = type;
-    token.lexeme = lexeme_length > 0 ? kolibri_strndup(lexeme_start, lexeme_length) : NULL;
+    token.lexeme = lexeme_length > 0 ? kolibri_arena_strndup(lexer->tokens->arena, lexeme_start, lexeme_length) : NULL;
     if (lexeme_length > 0 && !token.lexeme) {
         return -1;
     }
     token.span = kolibri_make_span(start_loc, end_loc);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(token.lexeme);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_emit_simple(KolibriLexer *lexer, KolibriTokenType type, size_t length) {
@@ -438,14 +545,10 @@ static int kolibri_lexer_read_string(KolibriLexer *lexer) {
     if (end.column > 0) {
         end.column -= 1U;
     }
-    char *raw = kolibri_strndup(lexer->source + begin, literal_len);
-    if (!raw) {
-        return -1;
-    }
+    const char *raw = lexer->source + begin;
     /* Strip escapes */
-    char *decoded = (char *)malloc(literal_len + 1U);
+    char *decoded = (char *)kolibri_arena_alloc(lexer->tokens->arena, literal_len + 1U);
     if (!decoded) {
-        free(raw);
         return -1;
     }
     size_t write = 0U;
@@ -468,16 +571,11 @@ static int kolibri_lexer_read_string(KolibriLexer *lexer) {
         }
     }
     decoded[write] = '\0';
-    free(raw);
     KolibriToken token;
     token.type = KOLIBRI_TOKEN_STRING;
     token.lexeme = decoded;
     token.span = kolibri_make_span(start, end);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(decoded);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_read_word(KolibriLexer *lexer) {
@@ -501,7 +599,7 @@ static int kolibri_lexer_read_word(KolibriLexer *lexer) {
     if (end.column > 0) {
         end.column -= 1U;
     }
-    char *word = kolibri_strndup(lexer->source + begin, len);
+    char *word = kolibri_arena_strndup(lexer->tokens->arena, lexer->source + begin, len);
     if (!word) {
         return -1;
     }
@@ -510,11 +608,7 @@ static int kolibri_lexer_read_word(KolibriLexer *lexer) {
     token.type = type;
     token.lexeme = word;
     token.span = kolibri_make_span(start, end);
-    if (kolibri_token_buffer_push(lexer->tokens, token) != 0) {
-        free(word);
-        return -1;
-    }
-    return 0;
+    return kolibri_token_buffer_push(lexer->tokens, token);
 }
 
 static int kolibri_lexer_run(KolibriLexer *lexer) {
@@ -707,102 +801,21 @@ static void kolibri_statement_list_init(KolibriStatementList *list) {
     list->capacity = 0;
 }
 
-static void kolibri_free_expression(KolibriExpression *expr) {
-    if (!expr) {
-        return;
-    }
-    free(expr->text);
-    expr->text = NULL;
-}
-
-static void kolibri_free_statement(KolibriStatement *stmt);
-
-static void kolibri_statement_list_free(KolibriStatementList *list) {
-    if (!list) {
-        return;
-    }
-    for (size_t i = 0; i < list->count; ++i) {
-        kolibri_free_statement(list->items[i]);
-    }
-    free(list->items);
-    list->items = NULL;
-    list->count = 0;
-    list->capacity = 0;
-}
-
-static int kolibri_statement_list_push(KolibriStatementList *list, KolibriStatement *stmt) {
+static int kolibri_statement_list_push(struct KolibriScriptArena *arena, KolibriStatementList *list,
+                                       KolibriStatement *stmt) {
     if (list->count == list->capacity) {
-        size_t new_capacity = list->capacity == 0 ? 8U : list->capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriStatement **new_items = (KolibriStatement **)realloc(list->items, new_capacity * sizeof(KolibriStatement *));
+        KolibriStatement **new_items = (KolibriStatement **)kolibri_arena_grow(arena, list->items, list->count,
+                                                                               &list->capacity, 8U,
+                                                                               sizeof(KolibriStatement *));
         if (!new_items) {
             return -1;
         }
         list->items = new_items;
-        list->capacity = new_capacity;
     }
     list->items[list->count++] = stmt;
     return 0;
 }
 
-static void kolibri_free_statement(KolibriStatement *stmt) {
-    if (!stmt) {
-        return;
-    }
-    switch (stmt->kind) {
-    case KOLIBRI_NODE_SHOW:
-        kolibri_free_expression(&stmt->data.show.value);
-        break;
-    case KOLIBRI_NODE_VARIABLE:
-        free(stmt->data.variable.name);
-        kolibri_free_expression(&stmt->data.variable.value);
-        break;
-    case KOLIBRI_NODE_TEACH:
-        kolibri_free_expression(&stmt->data.teach.left);
-        kolibri_free_expression(&stmt->data.teach.right);
-        break;
-    case KOLIBRI_NODE_CREATE_FORMULA:
-        free(stmt->data.create_formula.name);
-        kolibri_free_expression(&stmt->data.create_formula.expression);
-        break;
-    case KOLIBRI_NODE_EVALUATE_FORMULA:
-        free(stmt->data.evaluate_formula.name);
-        kolibri_free_expression(&stmt->data.evaluate_formula.task);
-        break;
-    case KOLIBRI_NODE_SAVE_FORMULA:
-        free(stmt->data.save_formula.name);
-        break;
-    case KOLIBRI_NODE_DROP_FORMULA:
-        free(stmt->data.drop_formula.name);
-        break;
-    case KOLIBRI_NODE_SWARM_SEND:
-        free(stmt->data.swarm_send.name);
-        break;
-    case KOLIBRI_NODE_IF:
-        kolibri_free_expression(&stmt->data.if_stmt.condition);
-        kolibri_statement_list_free(&stmt->data.if_stmt.then_body);
-        kolibri_statement_list_free(&stmt->data.if_stmt.else_body);
-        break;
-    case KOLIBRI_NODE_WHILE:
-        kolibri_free_expression(&stmt->data.while_stmt.condition);
-        kolibri_statement_list_free(&stmt->data.while_stmt.body);
-        break;
-    case KOLIBRI_NODE_MODE:
-        kolibri_free_expression(&stmt->data.mode_stmt.value);
-        break;
-    case KOLIBRI_NODE_CALL_EVOLUTION:
-    case KOLIBRI_NODE_PRINT_CANVAS:
-        break;
-    }
-    free(stmt);
-}
-
-static void kolibri_program_free(KolibriProgram *program) {
-    if (!program) {
-        return;
-    }
-    kolibri_statement_list_free(&program->statements);
-}
-
 /* ===================== Parser ===================== */
 
 typedef struct {
@@ -810,6 +823,7 @@ typedef struct {
     size_t count;
     size_t index;
     KolibriDiagnosticBuffer *diagnostics;
+    struct KolibriScriptArena *arena;
 } KolibriParser;
 
 static void kolibri_parser_init(KolibriParser *parser, const KolibriTokenBuffer *buffer,
@@ -818,6 +832,7 @@ static void kolibri_parser_init(KolibriParser *parser, const KolibriTokenBuffer
     parser->count = buffer->count;
     parser->index = 0;
     parser->diagnostics = diagnostics;
+    parser->arena = buffer->arena;
 }
 
 static const KolibriToken *kolibri_parser_current(const KolibriParser *parser) {
@@ -874,42 +889,30 @@ static void kolibri_parser_skip_newlines(KolibriParser *parser) {
     }
 }
 
-static char *kolibri_expression_build_string(const KolibriToken *start, const KolibriToken *end) {
+static char *kolibri_expression_build_string(struct KolibriScriptArena *arena, const KolibriToken *start,
+                                             const KolibriToken *end) {
     if (!start || !end) {
         return NULL;
     }
-    size_t capacity = 64U;
-    char *buffer = (char *)malloc(capacity);
+    size_t total = 0U;
+    for (const KolibriToken *token = start; token <= end; ++token) {
+        total += (token->lexeme ? strlen(token->lexeme) : 0U) + 1U;
+    }
+    char *buffer = (char *)kolibri_arena_alloc(arena, total + 1U);
     if (!buffer) {
         return NULL;
     }
-    buffer[0] = '\0';
     size_t length = 0U;
-    const KolibriToken *token = start;
-    while (true) {
+    for (const KolibriToken *token = start; token <= end; ++token) {
         const char *fragment = token->lexeme ? token->lexeme : "";
         size_t fragment_len = strlen(fragment);
-        if (length + fragment_len + 2U >= capacity) {
-            size_t new_capacity = capacity * KOLIBRI_ARRAY_GROWTH_FACTOR + fragment_len + 8U;
-            char *new_buffer = (char *)realloc(buffer, new_capacity);
-            if (!new_buffer) {
-                free(buffer);
-                return NULL;
-            }
-            buffer = new_buffer;
-            capacity = new_capacity;
-        }
         if (length > 0) {
             buffer[length++] = ' ';
         }
         memcpy(buffer + length, fragment, fragment_len);
         length += fragment_len;
-        buffer[length] = '\0';
-        if (token == end) {
-            break;
-        }
-        token += 1;
     }
+    buffer[length] = '\0';
     return buffer;
 }
 
@@ -1116,30 +1119,6 @@ static void kolibri_to_lower_ascii(const char *src, char *dst, size_t dst_len) {
     dst[i] = '\0';
 }
 
-static const KolibriAssociation *kolibri_find_partial_association(const KolibriFormulaPool *pool,
-                                                                  const char *question) {
-    if (!pool || !question) {
-        return NULL;
-    }
-    char lowered_question[256];
-    kolibri_to_lower_ascii(question, lowered_question, sizeof(lowered_question));
-    size_t best_len = 0U;
-    const KolibriAssociation *best = NULL;
-    for (size_t i = 0; i < pool->association_count; ++i) {
-        const KolibriAssociation *assoc = &pool->associations[i];
-        char lowered_assoc[256];
-        kolibri_to_lower_ascii(assoc->question, lowered_assoc, sizeof(lowered_assoc));
-        if (strstr(lowered_question, lowered_assoc) || strstr(lowered_assoc, lowered_question)) {
-            size_t len = strlen(assoc->question);
-            if (len > best_len) {
-                best_len = len;
-                best = assoc;
-            }
-        }
-    }
-    return best;
-}
-
 static bool kolibri_try_calculate(const char *question, char *buffer, size_t buffer_len) {
     if (!question || !buffer || buffer_len == 0) {
         return false;
@@ -1286,7 +1265,7 @@ static bool kolibri_parser_parse_expression_until(KolibriParser *parser, Kolibri
         kolibri_parser_report(parser, "Ожидалось выражение", start);
         return false;
     }
-    char *text = kolibri_expression_build_string(first, last);
+    char *text = kolibri_expression_build_string(parser->arena, first, last);
     if (!text) {
         return false;
     }
@@ -1295,11 +1274,13 @@ static bool kolibri_parser_parse_expression_until(KolibriParser *parser, Kolibri
     return true;
 }
 
-static KolibriStatement *kolibri_parser_make_statement(KolibriNodeKind kind, KolibriSourceSpan span) {
-    KolibriStatement *stmt = (KolibriStatement *)calloc(1U, sizeof(KolibriStatement));
+static KolibriStatement *kolibri_parser_make_statement(KolibriParser *parser, KolibriNodeKind kind,
+                                                       KolibriSourceSpan span) {
+    KolibriStatement *stmt = (KolibriStatement *)kolibri_arena_alloc(parser->arena, sizeof(KolibriStatement));
     if (!stmt) {
         return NULL;
     }
+    memset(stmt, 0, sizeof(*stmt));
     stmt->kind = kind;
     stmt->span = span;
     if (kind == KOLIBRI_NODE_IF) {
@@ -1344,9 +1325,8 @@ static KolibriStatement *kolibri_parser_parse_show(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SHOW, kolibri_make_span(start->span.start, expr.span.end));
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SHOW, kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
     stmt->data.show.value = expr;
@@ -1369,18 +1349,12 @@ static KolibriStatement *kolibri_parser_parse_variable(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_VARIABLE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_VARIABLE,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
-        return NULL;
-    }
-    stmt->data.variable.name = strdup(name_token->lexeme);
-    if (!stmt->data.variable.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
+    stmt->data.variable.name = name_token->lexeme;
     stmt->data.variable.value = expr;
     return stmt;
 }
@@ -1393,10 +1367,9 @@ static KolibriStatement *kolibri_parser_parse_mode(KolibriParser *parser) {
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_MODE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_MODE,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
         return NULL;
     }
     stmt->data.mode_stmt.value = expr;
@@ -1416,21 +1389,17 @@ static KolibriStatement *kolibri_parser_parse_teach(KolibriParser *parser) {
     }
     if (!kolibri_parser_match_token(parser, KOLIBRI_TOKEN_ARROW)) {
         kolibri_parser_report(parser, "Ожидался символ '->'", kolibri_parser_current(parser));
-        kolibri_free_expression(&left);
         return NULL;
     }
     const char *terminator_keywords[] = { NULL };
     KolibriTokenType terminator_types[] = { KOLIBRI_TOKEN_NEWLINE, KOLIBRI_TOKEN_EOF };
     KolibriExpression right = { 0 };
     if (!kolibri_parser_parse_expression_until(parser, &right, terminator_keywords, 0, terminator_types, 2U)) {
-        kolibri_free_expression(&left);
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_TEACH,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_TEACH,
                                                            kolibri_make_span(start->span.start, right.span.end));
     if (!stmt) {
-        kolibri_free_expression(&left);
-        kolibri_free_expression(&right);
         return NULL;
     }
     stmt->data.teach.left = left;
@@ -1456,18 +1425,12 @@ static KolibriStatement *kolibri_parser_parse_create_formula(KolibriParser *pars
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_CREATE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_CREATE_FORMULA,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
-        return NULL;
-    }
-    stmt->data.create_formula.name = strdup(name_token->lexeme);
-    if (!stmt->data.create_formula.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
+    stmt->data.create_formula.name = name_token->lexeme;
     stmt->data.create_formula.expression = expr;
     return stmt;
 }
@@ -1487,18 +1450,12 @@ static KolibriStatement *kolibri_parser_parse_evaluate_formula(KolibriParser *pa
     if (!kolibri_parser_parse_expression_until(parser, &expr, terminator_keywords, 0, terminator_types, 2U)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_EVALUATE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_EVALUATE_FORMULA,
                                                            kolibri_make_span(start->span.start, expr.span.end));
     if (!stmt) {
-        kolibri_free_expression(&expr);
-        return NULL;
-    }
-    stmt->data.evaluate_formula.name = strdup(name_token->lexeme);
-    if (!stmt->data.evaluate_formula.name) {
-        kolibri_free_expression(&expr);
-        free(stmt);
         return NULL;
     }
+    stmt->data.evaluate_formula.name = name_token->lexeme;
     stmt->data.evaluate_formula.task = expr;
     return stmt;
 }
@@ -1512,16 +1469,12 @@ static KolibriStatement *kolibri_parser_parse_save_formula(KolibriParser *parser
     if (!kolibri_parser_expect_keyword(parser, "в") || !kolibri_parser_expect_keyword(parser, "геном")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SAVE_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SAVE_FORMULA,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.save_formula.name = strdup(name_token->lexeme);
-    if (!stmt->data.save_formula.name) {
-        free(stmt);
-        return NULL;
-    }
+    stmt->data.save_formula.name = name_token->lexeme;
     return stmt;
 }
 
@@ -1531,16 +1484,12 @@ static KolibriStatement *kolibri_parser_parse_drop_formula(KolibriParser *parser
     if (!kolibri_parser_expect_identifier(parser, &name_token)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_DROP_FORMULA,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_DROP_FORMULA,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.drop_formula.name = strdup(name_token->lexeme);
-    if (!stmt->data.drop_formula.name) {
-        free(stmt);
-        return NULL;
-    }
+    stmt->data.drop_formula.name = name_token->lexeme;
     return stmt;
 }
 
@@ -1553,16 +1502,12 @@ static KolibriStatement *kolibri_parser_parse_swarm(KolibriParser *parser) {
     if (!kolibri_parser_expect_identifier(parser, &name_token)) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_SWARM_SEND,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_SWARM_SEND,
                                                            kolibri_make_span(start->span.start, name_token->span.end));
     if (!stmt) {
         return NULL;
     }
-    stmt->data.swarm_send.name = strdup(name_token->lexeme);
-    if (!stmt->data.swarm_send.name) {
-        free(stmt);
-        return NULL;
-    }
+    stmt->data.swarm_send.name = name_token->lexeme;
     return stmt;
 }
 
@@ -1571,7 +1516,7 @@ static KolibriStatement *kolibri_parser_parse_call_evolution(KolibriParser *pars
     if (!kolibri_parser_expect_keyword(parser, "эволюцию")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_CALL_EVOLUTION, start->span);
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_CALL_EVOLUTION, start->span);
     return stmt;
 }
 
@@ -1580,7 +1525,7 @@ static KolibriStatement *kolibri_parser_parse_print_canvas(KolibriParser *parser
     if (!kolibri_parser_expect_keyword(parser, "канву")) {
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_PRINT_CANVAS, start->span);
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_PRINT_CANVAS, start->span);
     return stmt;
 }
 
@@ -1593,7 +1538,6 @@ static KolibriStatement *kolibri_parser_parse_if(KolibriParser *parser) {
         return NULL;
     }
     if (!kolibri_parser_expect_keyword(parser, "тогда")) {
-        kolibri_free_expression(&condition);
         return NULL;
     }
     kolibri_parser_skip_newlines(parser);
@@ -1611,18 +1555,12 @@ static KolibriStatement *kolibri_parser_parse_if(KolibriParser *parser) {
         end_token = kolibri_parser_current(parser);
     }
     if (!kolibri_parser_expect_keyword(parser, "конец")) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&then_body);
-        kolibri_statement_list_free(&else_body);
         return NULL;
     }
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_IF,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_IF,
                                                            kolibri_make_span(start->span.start,
                                                                              has_else ? end_token->span.end : kolibri_parser_previous(parser)->span.end));
     if (!stmt) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&then_body);
-        kolibri_statement_list_free(&else_body);
         return NULL;
     }
     stmt->data.if_stmt.condition = condition;
@@ -1640,23 +1578,18 @@ static KolibriStatement *kolibri_parser_parse_while(KolibriParser *parser) {
         return NULL;
     }
     if (!kolibri_parser_expect_keyword(parser, "делать")) {
-        kolibri_free_expression(&condition);
         return NULL;
     }
     kolibri_parser_skip_newlines(parser);
     const char *terminators[] = { "конец" };
     KolibriStatementList body = kolibri_parser_parse_statements(parser, terminators, 1U);
     if (!kolibri_parser_expect_keyword(parser, "конец")) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&body);
         return NULL;
     }
     const KolibriToken *end_token = kolibri_parser_previous(parser);
-    KolibriStatement *stmt = kolibri_parser_make_statement(KOLIBRI_NODE_WHILE,
+    KolibriStatement *stmt = kolibri_parser_make_statement(parser, KOLIBRI_NODE_WHILE,
                                                            kolibri_make_span(start->span.start, end_token->span.end));
     if (!stmt) {
-        kolibri_free_expression(&condition);
-        kolibri_statement_list_free(&body);
         return NULL;
     }
     stmt->data.while_stmt.condition = condition;
@@ -1748,8 +1681,7 @@ static KolibriStatementList kolibri_parser_parse_statements(KolibriParser *parse
             kolibri_parser_match_token(parser, KOLIBRI_TOKEN_NEWLINE);
             continue;
         }
-        if (kolibri_statement_list_push(&list, stmt) != 0) {
-            kolibri_free_statement(stmt);
+        if (kolibri_statement_list_push(parser->arena, &list, stmt) != 0) {
             break;
         }
         kolibri_parser_match_token(parser, KOLIBRI_TOKEN_NEWLINE);
@@ -1786,15 +1718,19 @@ typedef enum {
     KOLIBRI_VALUE_NUMBER
 } KolibriValueType;
 
+/* Короткие строки хранятся прямо в значении, длинные — в куче. */
+#define KOLIBRI_VALUE_INLINE 32U
+
 typedef struct {
     KolibriValueType type;
-    char *string_value;
     double number_value;
+    char *heap_text;
+    char inline_text[KOLIBRI_VALUE_INLINE];
 } KolibriValue;
 
 typedef struct KolibriScriptVariable {
-    char *name;
     KolibriValue value;
+    bool assigned;
 } KolibriScriptVariable;
 
 typedef struct KolibriScriptAssociation {
@@ -1802,82 +1738,288 @@ typedef struct KolibriScriptAssociation {
     char *response;
 } KolibriScriptAssociation;
 
+/* Привязка формулы к слоту имени; bound = false, пока формула не создана. */
 typedef struct KolibriScriptFormulaBinding {
-    char *name;
     char *expression;
     size_t pool_index;
     double last_fitness;
+    bool bound;
 } KolibriScriptFormulaBinding;
 
+static int kolibri_reserve(void **data, size_t *capacity, size_t count, size_t initial, size_t elem_size) {
+    if (count < *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity == 0 ? initial : *capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
+    void *grown = realloc(*data, new_capacity * elem_size);
+    if (!grown) {
+        return -1;
+    }
+    *data = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/* ===================== Interner ===================== */
+
+/* Идентификаторы сценария: строка -> плотный номер слота, открытая адресация. */
+typedef struct {
+    char **strings;
+    uint32_t *hashes;
+    size_t count;
+    size_t capacity;
+    uint32_t *table; /* номер + 1, 0 — пустая ячейка */
+    size_t table_size;
+} KolibriInterner;
+
+static uint32_t kolibri_intern_hash(const char *text) {
+    uint32_t hash = 2166136261U;
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        hash ^= *p;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static void kolibri_interner_free(KolibriInterner *interner) {
+    for (size_t i = 0; i < interner->count; ++i) {
+        free(interner->strings[i]);
+    }
+    free(interner->strings);
+    free(interner->hashes);
+    free(interner->table);
+    memset(interner, 0, sizeof(*interner));
+}
+
+static bool kolibri_interner_find(const KolibriInterner *interner, const char *text, uint32_t *out_id) {
+    if (interner->table_size == 0) {
+        return false;
+    }
+    uint32_t hash = kolibri_intern_hash(text);
+    size_t mask = interner->table_size - 1U;
+    for (size_t pos = hash & mask;; pos = (pos + 1U) & mask) {
+        uint32_t entry = interner->table[pos];
+        if (entry == 0) {
+            return false;
+        }
+        if (interner->hashes[entry - 1U] == hash && strcmp(interner->strings[entry - 1U], text) == 0) {
+            *out_id = entry - 1U;
+            return true;
+        }
+    }
+}
+
+static int kolibri_interner_rehash(KolibriInterner *interner, size_t table_size) {
+    uint32_t *table = (uint32_t *)calloc(table_size, sizeof(uint32_t));
+    if (!table) {
+        return -1;
+    }
+    for (size_t i = 0; i < interner->count; ++i) {
+        size_t pos = interner->hashes[i] & (table_size - 1U);
+        while (table[pos] != 0) {
+            pos = (pos + 1U) & (table_size - 1U);
+        }
+        table[pos] = (uint32_t)i + 1U;
+    }
+    free(interner->table);
+    interner->table = table;
+    interner->table_size = table_size;
+    return 0;
+}
+
+static int kolibri_interner_intern(KolibriInterner *interner, const char *text, uint32_t *out_id) {
+    if (kolibri_interner_find(interner, text, out_id)) {
+        return 0;
+    }
+    if ((interner->count + 1U) * 2U > interner->table_size &&
+        kolibri_interner_rehash(interner, interner->table_size == 0 ? 16U : interner->table_size * 2U) != 0) {
+        return -1;
+    }
+    size_t capacity = interner->capacity;
+    if (kolibri_reserve((void **)&interner->strings, &capacity, interner->count, 16U, sizeof(char *)) != 0 ||
+        kolibri_reserve((void **)&interner->hashes, &interner->capacity, interner->count, 16U, sizeof(uint32_t)) != 0) {
+        return -1;
+    }
+    char *copy = strdup(text);
+    if (!copy) {
+        return -1;
+    }
+    uint32_t hash = kolibri_intern_hash(text);
+    size_t id = interner->count++;
+    interner->strings[id] = copy;
+    interner->hashes[id] = hash;
+    size_t pos = hash & (interner->table_size - 1U);
+    while (interner->table[pos] != 0) {
+        pos = (pos + 1U) & (interner->table_size - 1U);
+    }
+    interner->table[pos] = (uint32_t)id + 1U;
+    *out_id = (uint32_t)id;
+    return 0;
+}
+
+/* ===================== Bytecode ===================== */
+
+typedef enum {
+    KOLIBRI_OPERAND_CONST = 0, /* готовое значение: строка или число */
+    KOLIBRI_OPERAND_VARIABLE,  /* слот переменной; пока он пуст, берётся fallback */
+    KOLIBRI_OPERAND_FITNESS    /* фитнес формулы из слота slot */
+} KolibriOperandKind;
+
+typedef struct {
+    KolibriOperandKind kind;
+    KolibriValue value;
+    uint32_t slot;
+    uint32_t fallback;
+} KolibriOperand;
+
+typedef enum {
+    KOLIBRI_COMPARE_NONE = 0,
+    KOLIBRI_COMPARE_GE,
+    KOLIBRI_COMPARE_LE,
+    KOLIBRI_COMPARE_EQ,
+    KOLIBRI_COMPARE_NE,
+    KOLIBRI_COMPARE_GT,
+    KOLIBRI_COMPARE_LT
+} KolibriComparator;
+
+typedef enum {
+    KOLIBRI_OP_SHOW = 0,         /* a — операнд */
+    KOLIBRI_OP_ASSIGN,           /* a — слот, b — операнд */
+    KOLIBRI_OP_MODE,             /* a — операнд */
+    KOLIBRI_OP_TEACH,            /* a — стимул, b — ответ */
+    KOLIBRI_OP_CREATE_FORMULA,   /* a — слот, b — текст выражения */
+    KOLIBRI_OP_EVALUATE_FORMULA, /* a — слот, b — задача */
+    KOLIBRI_OP_SAVE_FORMULA,     /* a — слот */
+    KOLIBRI_OP_DROP_FORMULA,     /* a — слот */
+    KOLIBRI_OP_CALL_EVOLUTION,
+    KOLIBRI_OP_PRINT_CANVAS,
+    KOLIBRI_OP_SWARM_SEND,       /* a — слот */
+    KOLIBRI_OP_BRANCH_FALSE,     /* a cmp b; при ложном условии переход на c */
+    KOLIBRI_OP_JUMP,             /* переход на c */
+    KOLIBRI_OP_LOOP_ENTER,       /* обнуляет счётчик цикла a */
+    KOLIBRI_OP_LOOP_BACK,        /* увеличивает счётчик a и переходит на c */
+    KOLIBRI_OP_HALT
+} KolibriOpcode;
+
+#define KOLIBRI_BRANCH_LOOP 1U
+
+typedef struct {
+    uint8_t op;
+    uint8_t cmp;
+    uint8_t flags;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+} KolibriInstruction;
+
+/* Скомпилированная программа: инструкции, пул операндов и имена слотов.
+ * Номер слота общий для переменной и формулы с тем же именем. */
+struct KolibriBytecode {
+    KolibriInstruction *code;
+    size_t code_count;
+    size_t code_capacity;
+    KolibriOperand *operands;
+    size_t operands_count;
+    size_t operands_capacity;
+    KolibriInterner names;
+    size_t loop_count;
+    uint32_t result_slot;
+    uint64_t source_hash;   /* FNV-1a исходного текста — ключ кэша */
+    uint64_t source_length;
+    size_t refs;            /* владельцы: сценарии и кэш; под kolibri_script_cache_lock */
+};
+
+static const char *kolibri_value_text(const KolibriValue *value) {
+    return value->heap_text ? value->heap_text : value->inline_text;
+}
+
 static void kolibri_value_free(KolibriValue *value) {
     if (!value) {
         return;
     }
-    if (value->type == KOLIBRI_VALUE_STRING) {
-        free(value->string_value);
-    }
-    value->string_value = NULL;
+    free(value->heap_text);
+    value->heap_text = NULL;
+    value->inline_text[0] = '\0';
     value->number_value = 0.0;
     value->type = KOLIBRI_VALUE_NONE;
 }
 
-static KolibriValue kolibri_value_from_string(const char *text) {
-    KolibriValue value;
-    value.type = KOLIBRI_VALUE_STRING;
-    value.string_value = text ? strdup(text) : NULL;
-    value.number_value = 0.0;
-    return value;
+static int kolibri_value_set_text(KolibriValue *value, const char *text, size_t len) {
+    value->type = KOLIBRI_VALUE_STRING;
+    value->number_value = 0.0;
+    value->heap_text = NULL;
+    if (len < KOLIBRI_VALUE_INLINE) {
+        memcpy(value->inline_text, text, len);
+        value->inline_text[len] = '\0';
+        return 0;
+    }
+    value->inline_text[0] = '\0';
+    value->heap_text = kolibri_strndup(text, len);
+    return value->heap_text ? 0 : -1;
+}
+
+static int kolibri_value_init_string(KolibriValue *value, const char *text) {
+    if (!text) {
+        text = "";
+    }
+    return kolibri_value_set_text(value, text, strlen(text));
 }
 
 static KolibriValue kolibri_value_from_number(double number) {
     KolibriValue value;
     value.type = KOLIBRI_VALUE_NUMBER;
     value.number_value = number;
-    value.string_value = NULL;
+    value.heap_text = NULL;
+    value.inline_text[0] = '\0';
     return value;
 }
 
-static KolibriScriptVariable *kolibri_script_find_variable(KolibriScript *script, const char *name) {
-    if (!script || !name) {
-        return NULL;
-    }
-    for (size_t i = 0; i < script->variables_count; ++i) {
-        if (strcmp(script->variables[i].name, name) == 0) {
-            return &script->variables[i];
-        }
+static int kolibri_value_copy(const KolibriValue *src, KolibriValue *dst) {
+    if (src->type == KOLIBRI_VALUE_NUMBER) {
+        *dst = kolibri_value_from_number(src->number_value);
+        return 0;
     }
-    return NULL;
+    return kolibri_value_init_string(dst, kolibri_value_text(src));
 }
 
-static int kolibri_script_set_variable(KolibriScript *script, const char *name, KolibriValue value) {
-    if (!script || !name) {
-        kolibri_value_free(&value);
-        return -1;
-    }
-    KolibriScriptVariable *existing = kolibri_script_find_variable(script, name);
-    if (existing) {
-        kolibri_value_free(&existing->value);
-        existing->value = value;
-        return 0;
+/* Готовит слоты переменных и формул под программу; всё ещё не присвоено. */
+/* Слоты только растут: потоковое исполнение дописывает имена по ходу чтения. */
+static int kolibri_script_bind_slots(KolibriScript *script, const struct KolibriBytecode *bytecode) {
+    size_t count = bytecode->names.count;
+    if (count > script->variables_count) {
+        KolibriScriptVariable *variables =
+            (KolibriScriptVariable *)realloc(script->variables, count * sizeof(KolibriScriptVariable));
+        if (!variables) {
+            return -1;
+        }
+        memset(variables + script->variables_count, 0,
+               (count - script->variables_count) * sizeof(KolibriScriptVariable));
+        script->variables = variables;
+        script->variables_count = script->variables_capacity = count;
     }
-    if (script->variables_count == script->variables_capacity) {
-        size_t new_capacity = script->variables_capacity == 0 ? 8U : script->variables_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriScriptVariable *new_items = (KolibriScriptVariable *)realloc(script->variables, new_capacity * sizeof(KolibriScriptVariable));
-        if (!new_items) {
-            kolibri_value_free(&value);
+    if (count > script->formulas_count) {
+        KolibriScriptFormulaBinding *formulas =
+            (KolibriScriptFormulaBinding *)realloc(script->formulas, count * sizeof(KolibriScriptFormulaBinding));
+        if (!formulas) {
             return -1;
         }
-        script->variables = new_items;
-        script->variables_capacity = new_capacity;
+        memset(formulas + script->formulas_count, 0,
+               (count - script->formulas_count) * sizeof(KolibriScriptFormulaBinding));
+        script->formulas = formulas;
+        script->formulas_count = script->formulas_capacity = count;
     }
-    KolibriScriptVariable *slot = &script->variables[script->variables_count++];
-    slot->name = strdup(name);
-    if (!slot->name) {
-        --script->variables_count;
+    return 0;
+}
+
+static int kolibri_script_store_slot(KolibriScript *script, uint32_t slot, KolibriValue value) {
+    if (slot >= script->variables_count) {
         kolibri_value_free(&value);
         return -1;
     }
-    slot->value = value;
+    KolibriScriptVariable *variable = &script->variables[slot];
+    kolibri_value_free(&variable->value);
+    variable->value = value;
+    variable->assigned = true;
     return 0;
 }
 
@@ -1886,7 +2028,6 @@ static void kolibri_script_clear_variables(KolibriScript *script) {
         return;
     }
     for (size_t i = 0; i < script->variables_count; ++i) {
-        free(script->variables[i].name);
         kolibri_value_free(&script->variables[i].value);
     }
     free(script->variables);
@@ -1915,9 +2056,7 @@ static void kolibri_script_clear_formulas(KolibriScript *script) {
         return;
     }
     for (size_t i = 0; i < script->formulas_count; ++i) {
-        KolibriScriptFormulaBinding *binding = &script->formulas[i];
-        free(binding->name);
-        free(binding->expression);
+        free(script->formulas[i].expression);
     }
     free(script->formulas);
     script->formulas = NULL;
@@ -1925,68 +2064,40 @@ static void kolibri_script_clear_formulas(KolibriScript *script) {
     script->formulas_capacity = 0;
 }
 
-static KolibriScriptFormulaBinding *kolibri_script_find_formula(KolibriScript *script, const char *name) {
-    if (!script || !name) {
+static KolibriScriptFormulaBinding *kolibri_script_find_formula(KolibriScript *script, uint32_t slot) {
+    if (!script || slot >= script->formulas_count || !script->formulas[slot].bound) {
         return NULL;
     }
-    for (size_t i = 0; i < script->formulas_count; ++i) {
-        if (strcmp(script->formulas[i].name, name) == 0) {
-            return &script->formulas[i];
-        }
-    }
-    return NULL;
+    return &script->formulas[slot];
 }
 
-static int kolibri_script_bind_formula(KolibriScript *script, const char *name, const char *expression) {
-    if (!script || !name) {
+static int kolibri_script_bind_formula(KolibriScript *script, uint32_t slot, const char *expression) {
+    if (!script || slot >= script->formulas_count) {
         return -1;
     }
-    KolibriScriptFormulaBinding *existing = kolibri_script_find_formula(script, name);
-    if (existing) {
-        free(existing->expression);
-        existing->expression = expression ? strdup(expression) : NULL;
-        existing->last_fitness = 0.0;
-        return (!existing->expression && expression) ? -1 : 0;
-    }
-    if (script->formulas_count == script->formulas_capacity) {
-        size_t new_capacity = script->formulas_capacity == 0 ? 4U : script->formulas_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
-        KolibriScriptFormulaBinding *new_items = (KolibriScriptFormulaBinding *)realloc(script->formulas, new_capacity * sizeof(KolibriScriptFormulaBinding));
-        if (!new_items) {
-            return -1;
-        }
-        script->formulas = new_items;
-        script->formulas_capacity = new_capacity;
-    }
-    KolibriScriptFormulaBinding *slot = &script->formulas[script->formulas_count++];
-    slot->name = strdup(name);
-    slot->expression = expression ? strdup(expression) : NULL;
-    slot->pool_index = 0;
-    slot->last_fitness = 0.0;
-    if (!slot->name || (expression && !slot->expression)) {
-        free(slot->name);
-        free(slot->expression);
-        --script->formulas_count;
+    KolibriScriptFormulaBinding *binding = &script->formulas[slot];
+    char *copy = expression ? strdup(expression) : NULL;
+    if (expression && !copy) {
         return -1;
     }
+    free(binding->expression);
+    binding->expression = copy;
+    binding->last_fitness = 0.0;
+    if (!binding->bound) {
+        binding->pool_index = 0;
+        binding->bound = true;
+    }
     return 0;
 }
 
-static int kolibri_script_remove_formula(KolibriScript *script, const char *name) {
-    if (!script || !name) {
+static int kolibri_script_remove_formula(KolibriScript *script, uint32_t slot) {
+    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, slot);
+    if (!binding) {
         return -1;
     }
-    for (size_t i = 0; i < script->formulas_count; ++i) {
-        if (strcmp(script->formulas[i].name, name) == 0) {
-            free(script->formulas[i].name);
-            free(script->formulas[i].expression);
-            if (i + 1U < script->formulas_count) {
-                memmove(&script->formulas[i], &script->formulas[i + 1U], (script->formulas_count - i - 1U) * sizeof(KolibriScriptFormulaBinding));
-            }
-            script->formulas_count -= 1U;
-            return 0;
-        }
-    }
-    return -1;
+    free(binding->expression);
+    memset(binding, 0, sizeof(*binding));
+    return 0;
 }
 
 /* ===================== Utilities ===================== */
@@ -2057,19 +2168,15 @@ static double kolibri_parse_number(const char *text, bool *ok) {
     return value;
 }
 
-static int kolibri_value_to_string(const KolibriValue *value, char **out) {
-    if (!value || !out) {
-        return -1;
-    }
+/* Текстовое представление без выделения памяти: числа форматируются в buffer. */
+static const char *kolibri_value_view(const KolibriValue *value, char *buffer, size_t buffer_len) {
     if (value->type == KOLIBRI_VALUE_STRING) {
-        *out = value->string_value ? strdup(value->string_value) : strdup("");
-        return *out ? 0 : -1;
+        return kolibri_value_text(value);
     }
     if (value->type == KOLIBRI_VALUE_NUMBER) {
-        char buffer[64];
-        int written = snprintf(buffer, sizeof(buffer), "%.6f", value->number_value);
+        int written = snprintf(buffer, buffer_len, "%.6f", value->number_value);
         if (written < 0) {
-            return -1;
+            return NULL;
         }
         /* Trim trailing zeros */
         for (int i = written - 1; i > 0; --i) {
@@ -2082,10 +2189,21 @@ static int kolibri_value_to_string(const KolibriValue *value, char **out) {
                 break;
             }
         }
-        *out = strdup(buffer);
-        return *out ? 0 : -1;
+        return buffer;
+    }
+    return "";
+}
+
+static int kolibri_value_to_string(const KolibriValue *value, char **out) {
+    if (!value || !out) {
+        return -1;
+    }
+    char buffer[64];
+    const char *text = kolibri_value_view(value, buffer, sizeof(buffer));
+    if (!text) {
+        return -1;
     }
-    *out = strdup("");
+    *out = strdup(text);
     return *out ? 0 : -1;
 }
 
@@ -2097,9 +2215,9 @@ static int kolibri_value_to_number(const KolibriValue *value, double *out) {
         *out = value->number_value;
         return 0;
     }
-    if (value->type == KOLIBRI_VALUE_STRING && value->string_value) {
+    if (value->type == KOLIBRI_VALUE_STRING) {
         bool ok = false;
-        double parsed = kolibri_parse_number(value->string_value, &ok);
+        double parsed = kolibri_parse_number(kolibri_value_text(value), &ok);
         if (ok) {
             *out = parsed;
             return 0;
@@ -2108,134 +2226,713 @@ static int kolibri_value_to_number(const KolibriValue *value, double *out) {
     return -1;
 }
 
-static int kolibri_evaluate_expression(KolibriScript *script, const KolibriExpression *expr, KolibriValue *out_value) {
-    char *trimmed = kolibri_trim_copy(expr->text);
+/* ===================== Compiler ===================== */
+
+static void kolibri_bytecode_free(struct KolibriBytecode *bytecode) {
+    if (!bytecode) {
+        return;
+    }
+    for (size_t i = 0; i < bytecode->operands_count; ++i) {
+        kolibri_value_free(&bytecode->operands[i].value);
+    }
+    kolibri_interner_free(&bytecode->names);
+    free(bytecode->operands);
+    free(bytecode->code);
+    free(bytecode);
+}
+
+static int kolibri_bytecode_emit(struct KolibriBytecode *bytecode, KolibriInstruction instruction, size_t *out_index) {
+    if (kolibri_reserve((void **)&bytecode->code, &bytecode->code_capacity, bytecode->code_count, 32U,
+                        sizeof(KolibriInstruction)) != 0) {
+        return -1;
+    }
+    if (out_index) {
+        *out_index = bytecode->code_count;
+    }
+    bytecode->code[bytecode->code_count++] = instruction;
+    return 0;
+}
+
+static int kolibri_bytecode_add_operand(struct KolibriBytecode *bytecode, KolibriOperand operand, uint32_t *out_index) {
+    if (kolibri_reserve((void **)&bytecode->operands, &bytecode->operands_capacity, bytecode->operands_count, 16U,
+                        sizeof(KolibriOperand)) != 0) {
+        kolibri_value_free(&operand.value);
+        return -1;
+    }
+    *out_index = (uint32_t)bytecode->operands_count;
+    bytecode->operands[bytecode->operands_count++] = operand;
+    return 0;
+}
+
+static int kolibri_bytecode_add_string(struct KolibriBytecode *bytecode, const char *text, uint32_t *out_index) {
+    KolibriOperand operand = { KOLIBRI_OPERAND_CONST, kolibri_value_from_number(0.0), 0U, 0U };
+    if (kolibri_value_init_string(&operand.value, text) != 0) {
+        return -1;
+    }
+    return kolibri_bytecode_add_operand(bytecode, operand, out_index);
+}
+
+static int kolibri_bytecode_slot(struct KolibriBytecode *bytecode, const char *name, uint32_t *out_slot) {
+    return kolibri_interner_intern(&bytecode->names, name, out_slot);
+}
+
+/* Первый проход: переменными могут быть только имена из 'переменная' и 'итог'. */
+static int kolibri_collect_slots(struct KolibriBytecode *bytecode, const KolibriStatementList *list) {
+    for (size_t i = 0; i < list->count; ++i) {
+        const KolibriStatement *stmt = list->items[i];
+        uint32_t slot = 0U;
+        int rc = 0;
+        if (stmt->kind == KOLIBRI_NODE_VARIABLE) {
+            rc = kolibri_bytecode_slot(bytecode, stmt->data.variable.name, &slot);
+        } else if (stmt->kind == KOLIBRI_NODE_IF) {
+            rc = kolibri_collect_slots(bytecode, &stmt->data.if_stmt.then_body);
+            if (rc == 0) {
+                rc = kolibri_collect_slots(bytecode, &stmt->data.if_stmt.else_body);
+            }
+        } else if (stmt->kind == KOLIBRI_NODE_WHILE) {
+            rc = kolibri_collect_slots(bytecode, &stmt->data.while_stmt.body);
+        }
+        if (rc != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Разбирает текст выражения один раз: литерал, слот переменной, фитнес
+ * формулы, число или строка. Порядок проверок повторяет прежний интерпретатор.
+ */
+static int kolibri_compile_operand(struct KolibriBytecode *bytecode, const char *text, uint32_t *out_index) {
+    char *trimmed = kolibri_trim_copy(text);
     if (!trimmed) {
         return -1;
     }
+    KolibriOperand base = { KOLIBRI_OPERAND_CONST, kolibri_value_from_number(0.0), 0U, 0U };
     if (kolibri_is_string_literal(trimmed)) {
         char *stripped = kolibri_strip_quotes(trimmed);
         free(trimmed);
-        if (!stripped) {
-            return -1;
-        }
-        *out_value = kolibri_value_from_string(stripped);
-        if (!out_value->string_value && stripped) {
+        if (!stripped || kolibri_value_init_string(&base.value, stripped) != 0) {
             free(stripped);
             return -1;
         }
         free(stripped);
-        return 0;
-    }
-    KolibriScriptVariable *var = kolibri_script_find_variable(script, trimmed);
-    if (var) {
-        if (var->value.type == KOLIBRI_VALUE_STRING) {
-            *out_value = kolibri_value_from_string(var->value.string_value);
-        } else if (var->value.type == KOLIBRI_VALUE_NUMBER) {
-            *out_value = kolibri_value_from_number(var->value.number_value);
-        } else {
-            *out_value = kolibri_value_from_string("");
-        }
-        free(trimmed);
-        return 0;
+        return kolibri_bytecode_add_operand(bytecode, base, out_index);
     }
+    bool ok = false;
+    double numeric = 0.0;
+    int rc = 0;
     if (strncmp(trimmed, "фитнес", strlen("фитнес")) == 0) {
         const char *name_start = trimmed + strlen("фитнес");
         while (*name_start && isspace((unsigned char)*name_start)) {
             ++name_start;
         }
-        KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, name_start);
+        base.kind = KOLIBRI_OPERAND_FITNESS;
+        rc = kolibri_bytecode_slot(bytecode, name_start, &base.slot);
+    } else if ((numeric = kolibri_parse_number(trimmed, &ok)), ok) {
+        base.value = kolibri_value_from_number(numeric);
+    } else {
+        rc = kolibri_value_init_string(&base.value, trimmed);
+    }
+    if (rc != 0) {
         free(trimmed);
-        if (binding) {
-            *out_value = kolibri_value_from_number(binding->last_fitness);
-            return 0;
+        return -1;
+    }
+    /* Имена переменных уже интернированы первым проходом; имя формулы тоже
+     * получает слот переменной, но он никогда не присваивается. */
+    uint32_t slot = 0U;
+    bool is_variable = kolibri_interner_find(&bytecode->names, trimmed, &slot);
+    free(trimmed);
+    if (kolibri_bytecode_add_operand(bytecode, base, out_index) != 0) {
+        return -1;
+    }
+    if (!is_variable) {
+        return 0;
+    }
+    KolibriOperand variable = { KOLIBRI_OPERAND_VARIABLE, kolibri_value_from_number(0.0), slot, *out_index };
+    return kolibri_bytecode_add_operand(bytecode, variable, out_index);
+}
+
+static int kolibri_compile_branch(struct KolibriBytecode *bytecode, const KolibriExpression *condition,
+                                  uint8_t flags, size_t *out_index) {
+    static const char *const comparators[] = { ">=", "<=", "==", "!=", ">", "<" };
+    static const uint8_t kinds[] = { KOLIBRI_COMPARE_GE, KOLIBRI_COMPARE_LE, KOLIBRI_COMPARE_EQ,
+                                     KOLIBRI_COMPARE_NE, KOLIBRI_COMPARE_GT, KOLIBRI_COMPARE_LT };
+    KolibriInstruction instruction = { KOLIBRI_OP_BRANCH_FALSE, KOLIBRI_COMPARE_NONE, flags, 0U, 0U, 0U };
+    char *text = kolibri_trim_copy(condition->text);
+    if (!text) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(comparators) / sizeof(comparators[0]); ++i) {
+        const char *found = strstr(text, comparators[i]);
+        if (!found) {
+            continue;
+        }
+        char *left = kolibri_strndup(text, (size_t)(found - text));
+        int rc = left ? kolibri_compile_operand(bytecode, left, &instruction.a) : -1;
+        if (rc == 0) {
+            rc = kolibri_compile_operand(bytecode, found + strlen(comparators[i]), &instruction.b);
         }
-        *out_value = kolibri_value_from_number(0.0);
+        free(left);
+        free(text);
+        if (rc != 0) {
+            return -1;
+        }
+        instruction.cmp = kinds[i];
+        return kolibri_bytecode_emit(bytecode, instruction, out_index);
+    }
+    /* Без оператора сравнения условие ошибочно, но сообщаем об этом при исполнении. */
+    free(text);
+    return kolibri_bytecode_emit(bytecode, instruction, out_index);
+}
+
+static int kolibri_compile_block(struct KolibriBytecode *bytecode, const KolibriStatementList *list);
+
+static int kolibri_compile_statement(struct KolibriBytecode *bytecode, const KolibriStatement *stmt) {
+    KolibriInstruction instruction = { 0U, KOLIBRI_COMPARE_NONE, 0U, 0U, 0U, 0U };
+    switch (stmt->kind) {
+    case KOLIBRI_NODE_SHOW:
+        instruction.op = KOLIBRI_OP_SHOW;
+        if (kolibri_compile_operand(bytecode, stmt->data.show.value.text, &instruction.a) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_VARIABLE:
+        instruction.op = KOLIBRI_OP_ASSIGN;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.variable.name, &instruction.a) != 0 ||
+            kolibri_compile_operand(bytecode, stmt->data.variable.value.text, &instruction.b) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_MODE:
+        instruction.op = KOLIBRI_OP_MODE;
+        if (kolibri_compile_operand(bytecode, stmt->data.mode_stmt.value.text, &instruction.a) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_TEACH:
+        instruction.op = KOLIBRI_OP_TEACH;
+        if (kolibri_compile_operand(bytecode, stmt->data.teach.left.text, &instruction.a) != 0 ||
+            kolibri_compile_operand(bytecode, stmt->data.teach.right.text, &instruction.b) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_CREATE_FORMULA:
+        instruction.op = KOLIBRI_OP_CREATE_FORMULA;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.create_formula.name, &instruction.a) != 0 ||
+            kolibri_bytecode_add_string(bytecode, stmt->data.create_formula.expression.text, &instruction.b) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_EVALUATE_FORMULA:
+        instruction.op = KOLIBRI_OP_EVALUATE_FORMULA;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.evaluate_formula.name, &instruction.a) != 0 ||
+            kolibri_compile_operand(bytecode, stmt->data.evaluate_formula.task.text, &instruction.b) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_SAVE_FORMULA:
+        instruction.op = KOLIBRI_OP_SAVE_FORMULA;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.save_formula.name, &instruction.a) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_DROP_FORMULA:
+        instruction.op = KOLIBRI_OP_DROP_FORMULA;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.drop_formula.name, &instruction.a) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_SWARM_SEND:
+        instruction.op = KOLIBRI_OP_SWARM_SEND;
+        if (kolibri_bytecode_slot(bytecode, stmt->data.swarm_send.name, &instruction.a) != 0) {
+            return -1;
+        }
+        break;
+    case KOLIBRI_NODE_CALL_EVOLUTION:
+        instruction.op = KOLIBRI_OP_CALL_EVOLUTION;
+        break;
+    case KOLIBRI_NODE_PRINT_CANVAS:
+        instruction.op = KOLIBRI_OP_PRINT_CANVAS;
+        break;
+    case KOLIBRI_NODE_IF: {
+        size_t branch = 0U;
+        size_t jump = 0U;
+        KolibriInstruction skip = { KOLIBRI_OP_JUMP, KOLIBRI_COMPARE_NONE, 0U, 0U, 0U, 0U };
+        if (kolibri_compile_branch(bytecode, &stmt->data.if_stmt.condition, 0U, &branch) != 0 ||
+            kolibri_compile_block(bytecode, &stmt->data.if_stmt.then_body) != 0 ||
+            kolibri_bytecode_emit(bytecode, skip, &jump) != 0) {
+            return -1;
+        }
+        bytecode->code[branch].c = (uint32_t)bytecode->code_count;
+        if (kolibri_compile_block(bytecode, &stmt->data.if_stmt.else_body) != 0) {
+            return -1;
+        }
+        bytecode->code[jump].c = (uint32_t)bytecode->code_count;
         return 0;
     }
-    bool ok = false;
-    double numeric = kolibri_parse_number(trimmed, &ok);
-    if (ok) {
-        *out_value = kolibri_value_from_number(numeric);
-        free(trimmed);
+    case KOLIBRI_NODE_WHILE: {
+        uint32_t counter = (uint32_t)bytecode->loop_count++;
+        KolibriInstruction enter = { KOLIBRI_OP_LOOP_ENTER, KOLIBRI_COMPARE_NONE, 0U, counter, 0U, 0U };
+        size_t branch = 0U;
+        if (kolibri_bytecode_emit(bytecode, enter, NULL) != 0) {
+            return -1;
+        }
+        uint32_t top = (uint32_t)bytecode->code_count;
+        if (kolibri_compile_branch(bytecode, &stmt->data.while_stmt.condition, KOLIBRI_BRANCH_LOOP, &branch) != 0 ||
+            kolibri_compile_block(bytecode, &stmt->data.while_stmt.body) != 0) {
+            return -1;
+        }
+        KolibriInstruction back = { KOLIBRI_OP_LOOP_BACK, KOLIBRI_COMPARE_NONE, 0U, counter, 0U, top };
+        if (kolibri_bytecode_emit(bytecode, back, NULL) != 0) {
+            return -1;
+        }
+        bytecode->code[branch].c = (uint32_t)bytecode->code_count;
         return 0;
     }
-    *out_value = kolibri_value_from_string(trimmed);
-    if (!out_value->string_value) {
-        free(trimmed);
+    default:
+        return 0;
+    }
+    return kolibri_bytecode_emit(bytecode, instruction, NULL);
+}
+
+static int kolibri_compile_block(struct KolibriBytecode *bytecode, const KolibriStatementList *list) {
+    for (size_t i = 0; i < list->count; ++i) {
+        if (kolibri_compile_statement(bytecode, list->items[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Перекомпилирует программу в существующий байткод: код и операнды
+ * сбрасываются, имена слотов сохраняются. */
+static int kolibri_compile_into(struct KolibriBytecode *bytecode, const KolibriProgram *program) {
+    for (size_t i = 0; i < bytecode->operands_count; ++i) {
+        kolibri_value_free(&bytecode->operands[i].value);
+    }
+    bytecode->operands_count = 0;
+    bytecode->code_count = 0;
+    bytecode->loop_count = 0;
+    KolibriInstruction halt = { KOLIBRI_OP_HALT, KOLIBRI_COMPARE_NONE, 0U, 0U, 0U, 0U };
+    if (kolibri_bytecode_slot(bytecode, "итог", &bytecode->result_slot) != 0 ||
+        kolibri_collect_slots(bytecode, &program->statements) != 0 ||
+        kolibri_compile_block(bytecode, &program->statements) != 0 ||
+        kolibri_bytecode_emit(bytecode, halt, NULL) != 0) {
         return -1;
     }
     return 0;
 }
 
-static bool kolibri_evaluate_condition(KolibriScript *script, const KolibriExpression *expr, bool *result) {
-    char *text = kolibri_trim_copy(expr->text);
-    if (!text) {
-        return false;
+static struct KolibriBytecode *kolibri_compile_program(const KolibriProgram *program) {
+    struct KolibriBytecode *bytecode = (struct KolibriBytecode *)calloc(1U, sizeof(struct KolibriBytecode));
+    if (!bytecode) {
+        return NULL;
     }
-    const char *comparators[] = { ">=", "<=", "==", "!=", ">", "<" };
-    const char *found = NULL;
-    const char *comp = NULL;
-    for (size_t i = 0; i < sizeof(comparators) / sizeof(comparators[0]); ++i) {
-        comp = comparators[i];
-        found = strstr(text, comp);
-        if (found) {
-            break;
+    if (kolibri_compile_into(bytecode, program) != 0) {
+        kolibri_bytecode_free(bytecode);
+        return NULL;
+    }
+    return bytecode;
+}
+
+/* ===================== Compiled Image ===================== */
+
+/*
+ * Переносимый образ байткода (little-endian), его пишет ks_compiler --bytecode:
+ *   "KSBC" u32 версия, u64 хеш и u64 длина исходника,
+ *   u32 число инструкций, операндов, имён, циклов и слот 'итог',
+ *   инструкции (u8 op, cmp, flags; u32 a, b, c),
+ *   операнды (u8 kind, u8 тип; u32 slot, fallback; u64 число или u32 длина + текст),
+ *   имена (u32 длина + текст).
+ * При загрузке все индексы проверяются, поэтому VM может им доверять.
+ */
+#define KOLIBRI_IMAGE_MAGIC "KSBC"
+#define KOLIBRI_IMAGE_VERSION 1U
+
+static uint64_t kolibri_source_hash(const char *text, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} KolibriImageWriter;
+
+static void kolibri_image_put(KolibriImageWriter *writer, const void *bytes, size_t length) {
+    if (writer->failed) {
+        return;
+    }
+    while (writer->length + length > writer->capacity) {
+        if (kolibri_reserve((void **)&writer->data, &writer->capacity, writer->capacity, 256U, 1U) != 0) {
+            writer->failed = true;
+            return;
         }
     }
-    if (!found) {
-        free(text);
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void kolibri_image_put_u8(KolibriImageWriter *writer, uint8_t value) {
+    kolibri_image_put(writer, &value, 1U);
+}
+
+static void kolibri_image_put_u32(KolibriImageWriter *writer, uint32_t value) {
+    unsigned char bytes[4];
+    for (size_t i = 0; i < 4U; ++i) {
+        bytes[i] = (unsigned char)(value >> (8U * i));
+    }
+    kolibri_image_put(writer, bytes, sizeof(bytes));
+}
+
+static void kolibri_image_put_u64(KolibriImageWriter *writer, uint64_t value) {
+    unsigned char bytes[8];
+    for (size_t i = 0; i < 8U; ++i) {
+        bytes[i] = (unsigned char)(value >> (8U * i));
+    }
+    kolibri_image_put(writer, bytes, sizeof(bytes));
+}
+
+static void kolibri_image_put_text(KolibriImageWriter *writer, const char *text) {
+    size_t length = strlen(text);
+    if (length > UINT32_MAX) {
+        writer->failed = true;
+        return;
+    }
+    kolibri_image_put_u32(writer, (uint32_t)length);
+    kolibri_image_put(writer, text, length);
+}
+
+static int kolibri_bytecode_encode(const struct KolibriBytecode *bytecode, KolibriImageWriter *writer) {
+    if (bytecode->code_count > UINT32_MAX || bytecode->operands_count > UINT32_MAX ||
+        bytecode->names.count > UINT32_MAX || bytecode->loop_count > UINT32_MAX) {
+        return -1;
+    }
+    kolibri_image_put(writer, KOLIBRI_IMAGE_MAGIC, 4U);
+    kolibri_image_put_u32(writer, KOLIBRI_IMAGE_VERSION);
+    kolibri_image_put_u64(writer, bytecode->source_hash);
+    kolibri_image_put_u64(writer, bytecode->source_length);
+    kolibri_image_put_u32(writer, (uint32_t)bytecode->code_count);
+    kolibri_image_put_u32(writer, (uint32_t)bytecode->operands_count);
+    kolibri_image_put_u32(writer, (uint32_t)bytecode->names.count);
+    kolibri_image_put_u32(writer, (uint32_t)bytecode->loop_count);
+    kolibri_image_put_u32(writer, bytecode->result_slot);
+    for (size_t i = 0; i < bytecode->code_count; ++i) {
+        const KolibriInstruction *instruction = &bytecode->code[i];
+        kolibri_image_put_u8(writer, instruction->op);
+        kolibri_image_put_u8(writer, instruction->cmp);
+        kolibri_image_put_u8(writer, instruction->flags);
+        kolibri_image_put_u32(writer, instruction->a);
+        kolibri_image_put_u32(writer, instruction->b);
+        kolibri_image_put_u32(writer, instruction->c);
+    }
+    for (size_t i = 0; i < bytecode->operands_count; ++i) {
+        const KolibriOperand *operand = &bytecode->operands[i];
+        kolibri_image_put_u8(writer, (uint8_t)operand->kind);
+        kolibri_image_put_u8(writer, (uint8_t)operand->value.type);
+        kolibri_image_put_u32(writer, operand->slot);
+        kolibri_image_put_u32(writer, operand->fallback);
+        if (operand->value.type == KOLIBRI_VALUE_NUMBER) {
+            uint64_t bits = 0U;
+            memcpy(&bits, &operand->value.number_value, sizeof(bits));
+            kolibri_image_put_u64(writer, bits);
+        } else if (operand->value.type == KOLIBRI_VALUE_STRING) {
+            kolibri_image_put_text(writer, kolibri_value_text(&operand->value));
+        }
+    }
+    for (size_t i = 0; i < bytecode->names.count; ++i) {
+        kolibri_image_put_text(writer, bytecode->names.strings[i]);
+    }
+    return writer->failed ? -1 : 0;
+}
+
+typedef struct {
+    const unsigned char *data;
+    size_t length;
+    size_t offset;
+} KolibriImageReader;
+
+static bool kolibri_image_get(KolibriImageReader *reader, size_t length, const unsigned char **out) {
+    if (reader->length - reader->offset < length) {
         return false;
     }
-    size_t left_len = (size_t)(found - text);
-    char *left = kolibri_strndup(text, left_len);
-    char *right = kolibri_trim_copy(found + strlen(comp));
-    free(text);
-    if (!left || !right) {
-        free(left);
-        free(right);
+    *out = reader->data + reader->offset;
+    reader->offset += length;
+    return true;
+}
+
+static bool kolibri_image_get_u8(KolibriImageReader *reader, uint8_t *value) {
+    const unsigned char *bytes = NULL;
+    if (!kolibri_image_get(reader, 1U, &bytes)) {
         return false;
     }
-    KolibriExpression left_expr = { left, expr->span };
-    KolibriExpression right_expr = { right, expr->span };
-    KolibriValue left_value;
-    KolibriValue right_value;
-    if (kolibri_evaluate_expression(script, &left_expr, &left_value) != 0 ||
-        kolibri_evaluate_expression(script, &right_expr, &right_value) != 0) {
-        free(left);
-        free(right);
+    *value = bytes[0];
+    return true;
+}
+
+static bool kolibri_image_get_u32(KolibriImageReader *reader, uint32_t *value) {
+    const unsigned char *bytes = NULL;
+    if (!kolibri_image_get(reader, 4U, &bytes)) {
         return false;
     }
-    double left_num = 0.0;
-    double right_num = 0.0;
-    bool numeric = kolibri_value_to_number(&left_value, &left_num) == 0 && kolibri_value_to_number(&right_value, &right_num) == 0;
-    if (!numeric) {
-        kolibri_value_free(&left_value);
-        kolibri_value_free(&right_value);
-        free(left);
-        free(right);
+    *value = 0U;
+    for (size_t i = 0; i < 4U; ++i) {
+        *value |= (uint32_t)bytes[i] << (8U * i);
+    }
+    return true;
+}
+
+static bool kolibri_image_get_u64(KolibriImageReader *reader, uint64_t *value) {
+    const unsigned char *bytes = NULL;
+    if (!kolibri_image_get(reader, 8U, &bytes)) {
         return false;
     }
-    if (strcmp(comp, ">=") == 0) {
-        *result = left_num >= right_num;
-    } else if (strcmp(comp, "<=") == 0) {
-        *result = left_num <= right_num;
-    } else if (strcmp(comp, "==") == 0) {
-        *result = fabs(left_num - right_num) <= 1e-9;
-    } else if (strcmp(comp, "!=") == 0) {
-        *result = fabs(left_num - right_num) > 1e-9;
-    } else if (strcmp(comp, ">") == 0) {
-        *result = left_num > right_num;
-    } else {
-        *result = left_num < right_num;
+    *value = 0U;
+    for (size_t i = 0; i < 8U; ++i) {
+        *value |= (uint64_t)bytes[i] << (8U * i);
+    }
+    return true;
+}
+
+/* Текст копируется во временный буфер: в образе он без завершающего нуля. */
+static char *kolibri_image_get_text(KolibriImageReader *reader) {
+    uint32_t length = 0U;
+    const unsigned char *bytes = NULL;
+    if (!kolibri_image_get_u32(reader, &length) || !kolibri_image_get(reader, length, &bytes) ||
+        memchr(bytes, '\0', length) != NULL) {
+        return NULL;
+    }
+    return kolibri_strndup((const char *)bytes, length);
+}
+
+static bool kolibri_image_is_compiled(const char *data, size_t length) {
+    return length >= 4U && memcmp(data, KOLIBRI_IMAGE_MAGIC, 4U) == 0;
+}
+
+static bool kolibri_bytecode_validate(const struct KolibriBytecode *bytecode) {
+    size_t slots = bytecode->names.count;
+    size_t operands = bytecode->operands_count;
+    if (bytecode->result_slot >= slots || bytecode->code_count == 0 ||
+        bytecode->code[bytecode->code_count - 1U].op != KOLIBRI_OP_HALT) {
+        return false;
+    }
+    for (size_t i = 0; i < operands; ++i) {
+        const KolibriOperand *operand = &bytecode->operands[i];
+        switch (operand->kind) {
+        case KOLIBRI_OPERAND_CONST:
+            break;
+        case KOLIBRI_OPERAND_VARIABLE:
+            /* fallback всегда раньше самого операнда — цепочка конечна */
+            if (operand->slot >= slots || operand->fallback >= i) {
+                return false;
+            }
+            break;
+        case KOLIBRI_OPERAND_FITNESS:
+            if (operand->slot >= slots) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    for (size_t i = 0; i < bytecode->code_count; ++i) {
+        const KolibriInstruction *instruction = &bytecode->code[i];
+        bool ok = true;
+        switch ((KolibriOpcode)instruction->op) {
+        case KOLIBRI_OP_SHOW:
+        case KOLIBRI_OP_MODE:
+            ok = instruction->a < operands;
+            break;
+        case KOLIBRI_OP_TEACH:
+            ok = instruction->a < operands && instruction->b < operands;
+            break;
+        case KOLIBRI_OP_ASSIGN:
+        case KOLIBRI_OP_EVALUATE_FORMULA:
+            ok = instruction->a < slots && instruction->b < operands;
+            break;
+        case KOLIBRI_OP_CREATE_FORMULA:
+            ok = instruction->a < slots && instruction->b < operands &&
+                 bytecode->operands[instruction->b].kind == KOLIBRI_OPERAND_CONST;
+            break;
+        case KOLIBRI_OP_SAVE_FORMULA:
+        case KOLIBRI_OP_DROP_FORMULA:
+        case KOLIBRI_OP_SWARM_SEND:
+            ok = instruction->a < slots;
+            break;
+        case KOLIBRI_OP_BRANCH_FALSE:
+            ok = instruction->cmp <= KOLIBRI_COMPARE_LT && instruction->c <= bytecode->code_count &&
+                 (instruction->cmp == KOLIBRI_COMPARE_NONE ||
+                  (instruction->a < operands && instruction->b < operands));
+            break;
+        case KOLIBRI_OP_JUMP:
+            ok = instruction->c <= bytecode->code_count;
+            break;
+        case KOLIBRI_OP_LOOP_ENTER:
+            ok = instruction->a < bytecode->loop_count;
+            break;
+        case KOLIBRI_OP_LOOP_BACK:
+            ok = instruction->a < bytecode->loop_count && instruction->c <= bytecode->code_count;
+            break;
+        case KOLIBRI_OP_CALL_EVOLUTION:
+        case KOLIBRI_OP_PRINT_CANVAS:
+        case KOLIBRI_OP_HALT:
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok) {
+            return false;
+        }
     }
-    kolibri_value_free(&left_value);
-    kolibri_value_free(&right_value);
-    free(left);
-    free(right);
     return true;
 }
 
+static struct KolibriBytecode *kolibri_bytecode_decode(const char *data, size_t length) {
+    KolibriImageReader reader = { (const unsigned char *)data, length, 0U };
+    const unsigned char *magic = NULL;
+    uint32_t version = 0U;
+    uint32_t code_count = 0U;
+    uint32_t operands_count = 0U;
+    uint32_t names_count = 0U;
+    uint32_t loop_count = 0U;
+    if (!kolibri_image_get(&reader, 4U, &magic) || memcmp(magic, KOLIBRI_IMAGE_MAGIC, 4U) != 0 ||
+        !kolibri_image_get_u32(&reader, &version) || version != KOLIBRI_IMAGE_VERSION) {
+        return NULL;
+    }
+    struct KolibriBytecode *bytecode = (struct KolibriBytecode *)calloc(1U, sizeof(struct KolibriBytecode));
+    if (!bytecode) {
+        return NULL;
+    }
+    bool ok = kolibri_image_get_u64(&reader, &bytecode->source_hash) &&
+              kolibri_image_get_u64(&reader, &bytecode->source_length) &&
+              kolibri_image_get_u32(&reader, &code_count) && kolibri_image_get_u32(&reader, &operands_count) &&
+              kolibri_image_get_u32(&reader, &names_count) && kolibri_image_get_u32(&reader, &loop_count) &&
+              kolibri_image_get_u32(&reader, &bytecode->result_slot);
+    /* Каждая запись занимает хотя бы байт — отсекаем абсурдные счётчики до выделения. */
+    ok = ok && (size_t)code_count + operands_count + names_count <= reader.length - reader.offset;
+    bytecode->loop_count = loop_count;
+    for (uint32_t i = 0; ok && i < code_count; ++i) {
+        KolibriInstruction instruction = { 0U, 0U, 0U, 0U, 0U, 0U };
+        ok = kolibri_image_get_u8(&reader, &instruction.op) && kolibri_image_get_u8(&reader, &instruction.cmp) &&
+             kolibri_image_get_u8(&reader, &instruction.flags) && kolibri_image_get_u32(&reader, &instruction.a) &&
+             kolibri_image_get_u32(&reader, &instruction.b) && kolibri_image_get_u32(&reader, &instruction.c) &&
+             kolibri_bytecode_emit(bytecode, instruction, NULL) == 0;
+    }
+    for (uint32_t i = 0; ok && i < operands_count; ++i) {
+        uint8_t kind = 0U;
+        uint8_t type = 0U;
+        KolibriOperand operand = { KOLIBRI_OPERAND_CONST, kolibri_value_from_number(0.0), 0U, 0U };
+        ok = kolibri_image_get_u8(&reader, &kind) && kolibri_image_get_u8(&reader, &type) &&
+             kolibri_image_get_u32(&reader, &operand.slot) && kolibri_image_get_u32(&reader, &operand.fallback);
+        operand.kind = (KolibriOperandKind)kind;
+        if (ok && type == KOLIBRI_VALUE_NUMBER) {
+            uint64_t bits = 0U;
+            ok = kolibri_image_get_u64(&reader, &bits);
+            memcpy(&operand.value.number_value, &bits, sizeof(bits));
+        } else if (ok && type == KOLIBRI_VALUE_STRING) {
+            char *text = kolibri_image_get_text(&reader);
+            ok = text && kolibri_value_init_string(&operand.value, text) == 0;
+            free(text);
+        } else if (ok) {
+            ok = type == KOLIBRI_VALUE_NONE;
+            operand.value.type = KOLIBRI_VALUE_NONE;
+        }
+        uint32_t index = 0U;
+        ok = ok && kolibri_bytecode_add_operand(bytecode, operand, &index) == 0;
+    }
+    for (uint32_t i = 0; ok && i < names_count; ++i) {
+        char *name = kolibri_image_get_text(&reader);
+        uint32_t slot = 0U;
+        ok = name && kolibri_bytecode_slot(bytecode, name, &slot) == 0 && slot == i;
+        free(name);
+    }
+    if (!ok || reader.offset != reader.length || !kolibri_bytecode_validate(bytecode)) {
+        kolibri_bytecode_free(bytecode);
+        return NULL;
+    }
+    bytecode->refs = 1U;
+    return bytecode;
+}
+
+/* ===================== Compile Cache ===================== */
+
+/*
+ * Общий на процесс кэш: хеш и длина исходника -> готовый байткод. Байткод
+ * после компиляции не меняется, поэтому сценарии делят его по счётчику ссылок.
+ */
+#define KOLIBRI_SCRIPT_CACHE_SLOTS 8U
+
+typedef struct {
+    struct KolibriBytecode *bytecode;
+    uint64_t stamp;
+} KolibriScriptCacheEntry;
+
+static KolibriScriptCacheEntry kolibri_script_cache[KOLIBRI_SCRIPT_CACHE_SLOTS];
+static uint64_t kolibri_script_cache_clock;
+static pthread_mutex_t kolibri_script_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void kolibri_bytecode_release(struct KolibriBytecode *bytecode) {
+    if (!bytecode) {
+        return;
+    }
+    pthread_mutex_lock(&kolibri_script_cache_lock);
+    bool last = --bytecode->refs == 0;
+    pthread_mutex_unlock(&kolibri_script_cache_lock);
+    if (last) {
+        kolibri_bytecode_free(bytecode);
+    }
+}
+
+static struct KolibriBytecode *kolibri_script_cache_lookup(uint64_t hash, uint64_t length) {
+    struct KolibriBytecode *found = NULL;
+    pthread_mutex_lock(&kolibri_script_cache_lock);
+    for (size_t i = 0; i < KOLIBRI_SCRIPT_CACHE_SLOTS; ++i) {
+        KolibriScriptCacheEntry *entry = &kolibri_script_cache[i];
+        if (entry->bytecode && entry->bytecode->source_hash == hash && entry->bytecode->source_length == length) {
+            entry->stamp = ++kolibri_script_cache_clock;
+            found = entry->bytecode;
+            found->refs += 1U;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kolibri_script_cache_lock);
+    return found;
+}
+
+/* Вытесняет самую давнюю запись. */
+static void kolibri_script_cache_store(struct KolibriBytecode *bytecode) {
+    struct KolibriBytecode *evicted = NULL;
+    pthread_mutex_lock(&kolibri_script_cache_lock);
+    KolibriScriptCacheEntry *victim = &kolibri_script_cache[0];
+    for (size_t i = 0; i < KOLIBRI_SCRIPT_CACHE_SLOTS; ++i) {
+        KolibriScriptCacheEntry *entry = &kolibri_script_cache[i];
+        if (!entry->bytecode) {
+            victim = entry;
+            break;
+        }
+        if (entry->stamp < victim->stamp) {
+            victim = entry;
+        }
+    }
+    if (victim->bytecode && --victim->bytecode->refs == 0) {
+        evicted = victim->bytecode;
+    }
+    bytecode->refs += 1U;
+    victim->bytecode = bytecode;
+    victim->stamp = ++kolibri_script_cache_clock;
+    pthread_mutex_unlock(&kolibri_script_cache_lock);
+    kolibri_bytecode_free(evicted);
+}
+
 static void kolibri_script_log(KolibriScript *script, const char *event, const char *message) {
     if (!script || !script->genome) {
         return;
@@ -2247,95 +2944,155 @@ static void kolibri_script_log(KolibriScript *script, const char *event, const c
     if (!message) {
         message = "";
     }
-    snprintf(payload, sizeof(payload), "%s", message);
-    kg_append(script->genome, event, payload, NULL);
+    snprintf(payload, sizeof(payload), "%s", message);
+    kg_append(script->genome, event, payload, NULL);
+}
+
+/* Весь вывод сценария проходит здесь: в приёмник, если он задан, иначе в vyvod. */
+static void kolibri_script_emit(KolibriScript *script, const char *text, size_t length) {
+    if (script->sink) {
+        script->sink(script->sink_data, text, length);
+        return;
+    }
+    if (!script->vyvod) {
+        script->vyvod = stdout;
+    }
+    fwrite(text, 1U, length, script->vyvod);
+}
+
+/* ===================== Virtual Machine ===================== */
+
+/* Возвращает значение операнда без копирования; scratch нужен для фитнеса. */
+static const KolibriValue *kolibri_vm_load(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                           uint32_t index, KolibriValue *scratch) {
+    const KolibriOperand *operand = &bytecode->operands[index];
+    while (operand->kind == KOLIBRI_OPERAND_VARIABLE) {
+        if (operand->slot < script->variables_count && script->variables[operand->slot].assigned) {
+            return &script->variables[operand->slot].value;
+        }
+        operand = &bytecode->operands[operand->fallback];
+    }
+    if (operand->kind == KOLIBRI_OPERAND_FITNESS) {
+        KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, operand->slot);
+        *scratch = kolibri_value_from_number(binding ? binding->last_fitness : 0.0);
+        return scratch;
+    }
+    return &operand->value;
+}
+
+static int kolibri_vm_load_string(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                  uint32_t index, char **out) {
+    KolibriValue scratch = kolibri_value_from_number(0.0);
+    return kolibri_value_to_string(kolibri_vm_load(script, bytecode, index, &scratch), out);
+}
+
+/* Как kolibri_vm_load_string, но без копии: указатель живёт до записи в слот. */
+static const char *kolibri_vm_view(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                   uint32_t index, char *buffer, size_t buffer_len) {
+    KolibriValue scratch = kolibri_value_from_number(0.0);
+    return kolibri_value_view(kolibri_vm_load(script, bytecode, index, &scratch), buffer, buffer_len);
+}
+
+static const char *kolibri_vm_name(const struct KolibriBytecode *bytecode, uint32_t slot) {
+    return bytecode->names.strings[slot];
+}
+
+static bool kolibri_vm_condition(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                 const KolibriInstruction *instruction, bool *result) {
+    if (instruction->cmp == KOLIBRI_COMPARE_NONE) {
+        return false;
+    }
+    KolibriValue left_scratch = kolibri_value_from_number(0.0);
+    KolibriValue right_scratch = kolibri_value_from_number(0.0);
+    double left_num = 0.0;
+    double right_num = 0.0;
+    if (kolibri_value_to_number(kolibri_vm_load(script, bytecode, instruction->a, &left_scratch), &left_num) != 0 ||
+        kolibri_value_to_number(kolibri_vm_load(script, bytecode, instruction->b, &right_scratch), &right_num) != 0) {
+        return false;
+    }
+    switch (instruction->cmp) {
+    case KOLIBRI_COMPARE_GE:
+        *result = left_num >= right_num;
+        break;
+    case KOLIBRI_COMPARE_LE:
+        *result = left_num <= right_num;
+        break;
+    case KOLIBRI_COMPARE_EQ:
+        *result = fabs(left_num - right_num) <= 1e-9;
+        break;
+    case KOLIBRI_COMPARE_NE:
+        *result = fabs(left_num - right_num) > 1e-9;
+        break;
+    case KOLIBRI_COMPARE_GT:
+        *result = left_num > right_num;
+        break;
+    default:
+        *result = left_num < right_num;
+        break;
+    }
+    return true;
 }
 
-/* ===================== Interpreter ===================== */
-
-static int kolibri_execute_show(KolibriScript *script, const KolibriStatement *stmt) {
-    KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.show.value, &value) != 0) {
+static int kolibri_execute_show(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                const KolibriInstruction *instruction) {
+    char buffer[64];
+    const char *text = kolibri_vm_view(script, bytecode, instruction->a, buffer, sizeof(buffer));
+    if (!text) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить аргумент команды 'показать'");
         return -1;
     }
-    char *text = NULL;
-    if (kolibri_value_to_string(&value, &text) != 0) {
-        kolibri_value_free(&value);
-        return -1;
-    }
-    if (!script->vyvod) {
-        script->vyvod = stdout;
-    }
-    fprintf(script->vyvod, "%s\n", text);
+    kolibri_script_emit(script, text, strlen(text));
+    kolibri_script_emit(script, "\n", 1U);
     kolibri_script_log(script, "SCRIPT_SHOW", text);
-    free(text);
-    kolibri_value_free(&value);
     return 0;
 }
 
-static int kolibri_execute_variable(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_variable(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                    const KolibriInstruction *instruction) {
+    KolibriValue scratch = kolibri_value_from_number(0.0);
     KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.variable.value, &value) != 0) {
+    if (kolibri_value_copy(kolibri_vm_load(script, bytecode, instruction->b, &scratch), &value) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить выражение переменной");
         return -1;
     }
-    if (kolibri_script_set_variable(script, stmt->data.variable.name, value) != 0) {
-        kolibri_value_free(&value);
-        return -1;
-    }
-    return 0;
+    return kolibri_script_store_slot(script, instruction->a, value);
 }
 
-static int kolibri_execute_mode(KolibriScript *script, const KolibriStatement *stmt) {
-    KolibriValue value;
-    if (kolibri_evaluate_expression(script, &stmt->data.mode_stmt.value, &value) != 0) {
+static int kolibri_execute_mode(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                const KolibriInstruction *instruction) {
+    char buffer[64];
+    const char *text = kolibri_vm_view(script, bytecode, instruction->a, buffer, sizeof(buffer));
+    if (!text) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить режим");
         return -1;
     }
-    char *text = NULL;
-    if (kolibri_value_to_string(&value, &text) != 0) {
-        kolibri_value_free(&value);
-        return -1;
-    }
     kolibri_script_set_mode(script, text);
     char log_payload[128];
     snprintf(log_payload, sizeof(log_payload), "mode=%s", script->mode);
     kolibri_script_log(script, "SCRIPT_MODE", log_payload);
-    if (script->vyvod) {
-        fprintf(script->vyvod, "[Колибри] Режим установлен: %s\n", script->mode);
+    char line[96];
+    int length = snprintf(line, sizeof(line), "[Колибри] Режим установлен: %s\n", script->mode);
+    if (length > 0) {
+        kolibri_script_emit(script, line, (size_t)length < sizeof(line) ? (size_t)length : sizeof(line) - 1U);
     }
-    free(text);
-    kolibri_value_free(&value);
     return 0;
 }
 
-static int kolibri_execute_teach(KolibriScript *script, const KolibriStatement *stmt) {
-    KolibriValue left;
-    KolibriValue right;
-    if (kolibri_evaluate_expression(script, &stmt->data.teach.left, &left) != 0 ||
-        kolibri_evaluate_expression(script, &stmt->data.teach.right, &right) != 0) {
-        kolibri_value_free(&left);
-        kolibri_value_free(&right);
-        kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось получить аргументы для 'обучить связь'");
-        return -1;
-    }
+static int kolibri_execute_teach(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                 const KolibriInstruction *instruction) {
     char *left_text = NULL;
     char *right_text = NULL;
-    if (kolibri_value_to_string(&left, &left_text) != 0 ||
-        kolibri_value_to_string(&right, &right_text) != 0) {
-        kolibri_value_free(&left);
-        kolibri_value_free(&right);
+    if (kolibri_vm_load_string(script, bytecode, instruction->a, &left_text) != 0 ||
+        kolibri_vm_load_string(script, bytecode, instruction->b, &right_text) != 0) {
         free(left_text);
         free(right_text);
+        kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось получить аргументы для 'обучить связь'");
         return -1;
     }
     if (script->associations_count == script->associations_capacity) {
         size_t new_capacity = script->associations_capacity == 0 ? 4U : script->associations_capacity * KOLIBRI_ARRAY_GROWTH_FACTOR;
         KolibriScriptAssociation *new_items = (KolibriScriptAssociation *)realloc(script->associations, new_capacity * sizeof(KolibriScriptAssociation));
         if (!new_items) {
-            kolibri_value_free(&left);
-            kolibri_value_free(&right);
             free(left_text);
             free(right_text);
             return -1;
@@ -2353,48 +3110,48 @@ static int kolibri_execute_teach(KolibriScript *script, const KolibriStatement *
         kolibri_record_ngrams(script, left_text, right_text, "teach", now);
     }
     kolibri_script_log(script, "SCRIPT_TEACH", assoc->stimulus);
-    kolibri_value_free(&left);
-    kolibri_value_free(&right);
     return 0;
 }
 
-static int kolibri_execute_create_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_create_formula(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                          const KolibriInstruction *instruction) {
     if (!script->pool) {
         return 0;
     }
-    if (kolibri_script_bind_formula(script, stmt->data.create_formula.name, stmt->data.create_formula.expression.text) != 0) {
+    const char *name = kolibri_vm_name(bytecode, instruction->a);
+    const char *expression = kolibri_value_text(&bytecode->operands[instruction->b].value);
+    if (kolibri_script_bind_formula(script, instruction->a, expression) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось зарегистрировать формулу");
         return -1;
     }
-    kolibri_script_log(script, "SCRIPT_FORMULA_CREATE", stmt->data.create_formula.name);
+    kolibri_script_log(script, "SCRIPT_FORMULA_CREATE", name);
     return 0;
 }
 
-static int kolibri_execute_evaluate_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_evaluate_formula(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                            const KolibriInstruction *instruction) {
     if (!script->pool) {
         return 0;
     }
-    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, stmt->data.evaluate_formula.name);
+    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, instruction->a);
     if (!binding) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена");
         return -1;
     }
-    KolibriValue task_value;
-    if (kolibri_evaluate_expression(script, &stmt->data.evaluate_formula.task, &task_value) != 0) {
+    char task_buffer[64];
+    const char *task_text = kolibri_vm_view(script, bytecode, instruction->b, task_buffer, sizeof(task_buffer));
+    if (!task_text) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить задачу для формулы");
         return -1;
     }
-    char *task_text = NULL;
-    if (kolibri_value_to_string(&task_value, &task_text) != 0) {
-        kolibri_value_free(&task_value);
+    int task_int = kf_hash_from_text(task_text);
+    KolibriFormula view;
+    if (kf_pool_formula(script->pool, binding->pool_index % script->pool->count, &view) != 0) {
         return -1;
     }
-    int task_int = kf_hash_from_text(task_text);
-    KolibriFormula *formula = &script->pool->formulas[binding->pool_index % script->pool->count];
+    const KolibriFormula *formula = &view;
     int output = 0;
     if (kf_formula_apply(formula, task_int, &output) != 0) {
-        free(task_text);
-        kolibri_value_free(&task_value);
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула вернула ошибку");
         return -1;
     }
@@ -2404,7 +3161,7 @@ static int kolibri_execute_evaluate_formula(KolibriScript *script, const Kolibri
         answer_generated = true;
     }
     if (!answer_generated) {
-        const KolibriAssociation *partial = kolibri_find_partial_association(script->pool, task_text);
+        const KolibriAssociation *partial = kf_pool_match_association(script->pool, task_text);
         if (partial) {
             strncpy(answer_buffer, partial->answer, sizeof(answer_buffer) - 1U);
             answer_buffer[sizeof(answer_buffer) - 1U] = '\0';
@@ -2444,23 +3201,27 @@ static int kolibri_execute_evaluate_formula(KolibriScript *script, const Kolibri
     kolibri_script_log(script, "SCRIPT_EVALUATE", task_text);
     kolibri_clean_answer(answer_buffer);
     kolibri_apply_mode(script, answer_buffer);
-    KolibriValue result_value = kolibri_value_from_string(answer_buffer);
-    kolibri_script_set_variable(script, "итог", result_value);
-    free(task_text);
-    kolibri_value_free(&task_value);
+    KolibriValue result_value;
+    if (kolibri_value_init_string(&result_value, answer_buffer) == 0) {
+        kolibri_script_store_slot(script, bytecode->result_slot, result_value);
+    }
     return 0;
 }
 
-static int kolibri_execute_save_formula(KolibriScript *script, const KolibriStatement *stmt) {
+static int kolibri_execute_save_formula(KolibriScript *script, const KolibriInstruction *instruction) {
     if (!script->pool) {
         return 0;
     }
-    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, stmt->data.save_formula.name);
+    KolibriScriptFormulaBinding *binding = kolibri_script_find_formula(script, instruction->a);
     if (!binding) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена для сохранения");
         return -1;
     }
-    KolibriFormula *formula = &script->pool->formulas[binding->pool_index % script->pool->count];
+    KolibriFormula view;
+    if (kf_pool_formula(script->pool, binding->pool_index % script->pool->count, &view) != 0) {
+        return -1;
+    }
+    const KolibriFormula *formula = &view;
     uint8_t digits[128];
     size_t len = kf_formula_digits(formula, digits, sizeof(digits));
     if (len == 0 || len >= sizeof(digits)) {
@@ -2476,12 +3237,14 @@ static int kolibri_execute_save_formula(KolibriScript *script, const KolibriStat
     return 0;
 }
 
-static int kolibri_execute_drop_formula(KolibriScript *script, const KolibriStatement *stmt) {
-    if (kolibri_script_remove_formula(script, stmt->data.drop_formula.name) != 0) {
+static int kolibri_execute_drop_formula(KolibriScript *script, const struct KolibriBytecode *bytecode,
+                                        const KolibriInstruction *instruction) {
+    const char *name = kolibri_vm_name(bytecode, instruction->a);
+    if (kolibri_script_remove_formula(script, instruction->a) != 0) {
         kolibri_script_log(script, "SCRIPT_ERROR", "Формула не найдена для удаления");
         return -1;
     }
-    kolibri_script_log(script, "SCRIPT_FORMULA_DROP", stmt->data.drop_formula.name);
+    kolibri_script_log(script, "SCRIPT_FORMULA_DROP", name);
     return 0;
 }
 
@@ -2500,98 +3263,99 @@ static int kolibri_execute_call_evolution(KolibriScript *script) {
 }
 
 static int kolibri_execute_print_canvas(KolibriScript *script) {
-    if (!script->vyvod) {
-        script->vyvod = stdout;
-    }
-    fprintf(script->vyvod, "[Kolibri] визуализация памяти пока не реализована\n");
+    static const char notice[] = "[Kolibri] визуализация памяти пока не реализована\n";
+    kolibri_script_emit(script, notice, sizeof(notice) - 1U);
     kolibri_script_log(script, "SCRIPT_CANVAS", "недоступно");
     return 0;
 }
 
-static int kolibri_execute_swarm(KolibriScript *script, const KolibriStatement *stmt) {
-    (void)script;
-    (void)stmt;
+static int kolibri_execute_swarm(KolibriScript *script) {
     kolibri_script_log(script, "SCRIPT_SWARM", "отправка не реализована");
     return 0;
 }
 
-static int kolibri_execute_statement(KolibriScript *script, const KolibriStatement *stmt);
 
-static int kolibri_execute_block(KolibriScript *script, const KolibriStatementList *list) {
-    for (size_t i = 0; i < list->count; ++i) {
-        if (kolibri_execute_statement(script, list->items[i]) != 0) {
+static int kolibri_vm_run(KolibriScript *script, const struct KolibriBytecode *bytecode) {
+    size_t *loops = NULL;
+    if (bytecode->loop_count > 0) {
+        loops = (size_t *)calloc(bytecode->loop_count, sizeof(size_t));
+        if (!loops) {
             return -1;
         }
     }
-    return 0;
-}
-
-static int kolibri_execute_if(KolibriScript *script, const KolibriStatement *stmt) {
-    bool condition = false;
-    if (!kolibri_evaluate_condition(script, &stmt->data.if_stmt.condition, &condition)) {
-        kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить условие 'если'");
-        return -1;
-    }
-    if (condition) {
-        return kolibri_execute_block(script, &stmt->data.if_stmt.then_body);
-    }
-    return kolibri_execute_block(script, &stmt->data.if_stmt.else_body);
-}
-
-static int kolibri_execute_while(KolibriScript *script, const KolibriStatement *stmt) {
-    size_t iterations = 0U;
-    while (iterations < KOLIBRI_MAX_LOOP_ITERATIONS) {
-        bool condition = false;
-        if (!kolibri_evaluate_condition(script, &stmt->data.while_stmt.condition, &condition)) {
-            kolibri_script_log(script, "SCRIPT_ERROR", "Не удалось вычислить условие 'пока'");
-            return -1;
-        }
-        if (!condition) {
+    int status = 0;
+    size_t pc = 0U;
+    while (status == 0 && pc < bytecode->code_count) {
+        const KolibriInstruction *instruction = &bytecode->code[pc++];
+        switch ((KolibriOpcode)instruction->op) {
+        case KOLIBRI_OP_SHOW:
+            status = kolibri_execute_show(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_ASSIGN:
+            status = kolibri_execute_variable(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_MODE:
+            status = kolibri_execute_mode(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_TEACH:
+            status = kolibri_execute_teach(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_CREATE_FORMULA:
+            status = kolibri_execute_create_formula(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_EVALUATE_FORMULA:
+            status = kolibri_execute_evaluate_formula(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_SAVE_FORMULA:
+            status = kolibri_execute_save_formula(script, instruction);
+            break;
+        case KOLIBRI_OP_DROP_FORMULA:
+            status = kolibri_execute_drop_formula(script, bytecode, instruction);
+            break;
+        case KOLIBRI_OP_CALL_EVOLUTION:
+            status = kolibri_execute_call_evolution(script);
+            break;
+        case KOLIBRI_OP_PRINT_CANVAS:
+            status = kolibri_execute_print_canvas(script);
+            break;
+        case KOLIBRI_OP_SWARM_SEND:
+            status = kolibri_execute_swarm(script);
+            break;
+        case KOLIBRI_OP_BRANCH_FALSE: {
+            bool condition = false;
+            if (!kolibri_vm_condition(script, bytecode, instruction, &condition)) {
+                kolibri_script_log(script, "SCRIPT_ERROR",
+                                   (instruction->flags & KOLIBRI_BRANCH_LOOP)
+                                       ? "Не удалось вычислить условие 'пока'"
+                                       : "Не удалось вычислить условие 'если'");
+                status = -1;
+            } else if (!condition) {
+                pc = instruction->c;
+            }
             break;
         }
-        if (kolibri_execute_block(script, &stmt->data.while_stmt.body) != 0) {
-            return -1;
+        case KOLIBRI_OP_JUMP:
+            pc = instruction->c;
+            break;
+        case KOLIBRI_OP_LOOP_ENTER:
+            loops[instruction->a] = 0U;
+            break;
+        case KOLIBRI_OP_LOOP_BACK:
+            if (++loops[instruction->a] >= KOLIBRI_MAX_LOOP_ITERATIONS) {
+                kolibri_script_log(script, "SCRIPT_ERROR", "Превышен лимит итераций цикла");
+                status = -1;
+            } else {
+                pc = instruction->c;
+            }
+            break;
+        case KOLIBRI_OP_HALT:
+        default:
+            pc = bytecode->code_count;
+            break;
         }
-        iterations += 1U;
-    }
-    if (iterations >= KOLIBRI_MAX_LOOP_ITERATIONS) {
-        kolibri_script_log(script, "SCRIPT_ERROR", "Превышен лимит итераций цикла");
-        return -1;
-    }
-    return 0;
-}
-
-static int kolibri_execute_statement(KolibriScript *script, const KolibriStatement *stmt) {
-    switch (stmt->kind) {
-    case KOLIBRI_NODE_SHOW:
-        return kolibri_execute_show(script, stmt);
-    case KOLIBRI_NODE_VARIABLE:
-        return kolibri_execute_variable(script, stmt);
-    case KOLIBRI_NODE_TEACH:
-        return kolibri_execute_teach(script, stmt);
-    case KOLIBRI_NODE_CREATE_FORMULA:
-        return kolibri_execute_create_formula(script, stmt);
-    case KOLIBRI_NODE_EVALUATE_FORMULA:
-        return kolibri_execute_evaluate_formula(script, stmt);
-    case KOLIBRI_NODE_SAVE_FORMULA:
-        return kolibri_execute_save_formula(script, stmt);
-    case KOLIBRI_NODE_DROP_FORMULA:
-        return kolibri_execute_drop_formula(script, stmt);
-    case KOLIBRI_NODE_CALL_EVOLUTION:
-        return kolibri_execute_call_evolution(script);
-    case KOLIBRI_NODE_PRINT_CANVAS:
-        return kolibri_execute_print_canvas(script);
-    case KOLIBRI_NODE_SWARM_SEND:
-        return kolibri_execute_swarm(script, stmt);
-    case KOLIBRI_NODE_IF:
-        return kolibri_execute_if(script, stmt);
-    case KOLIBRI_NODE_WHILE:
-        return kolibri_execute_while(script, stmt);
-    case KOLIBRI_NODE_MODE:
-        return kolibri_execute_mode(script, stmt);
-    default:
-        return 0;
     }
+    free(loops);
+    return status;
 }
 
 static void kolibri_script_reset(KolibriScript *script) {
@@ -2637,6 +3401,10 @@ void ks_free(KolibriScript *skript) {
         return;
     }
     kolibri_script_reset(skript);
+    kolibri_bytecode_release(skript->bytecode);
+    skript->bytecode = NULL;
+    kolibri_arena_dispose(skript->arena);
+    skript->arena = NULL;
     free(skript->source_text);
     skript->source_text = NULL;
     skript->pool = NULL;
@@ -2644,11 +3412,78 @@ void ks_free(KolibriScript *skript) {
     skript->vyvod = NULL;
 }
 
+static size_t kolibri_value_memory(const KolibriValue *value) {
+    return value->heap_text ? strlen(value->heap_text) + 1U : 0U;
+}
+
+size_t ks_memory_usage(const KolibriScript *skript) {
+    if (!skript) {
+        return 0U;
+    }
+    size_t total = skript->source_text ? strlen(skript->source_text) + 1U : 0U;
+    total += skript->variables_capacity * sizeof(KolibriScriptVariable);
+    for (size_t i = 0; i < skript->variables_count; ++i) {
+        total += kolibri_value_memory(&skript->variables[i].value);
+    }
+    total += skript->associations_capacity * sizeof(KolibriScriptAssociation);
+    for (size_t i = 0; i < skript->associations_count; ++i) {
+        const KolibriScriptAssociation *assoc = &skript->associations[i];
+        total += assoc->stimulus ? strlen(assoc->stimulus) + 1U : 0U;
+        total += assoc->response ? strlen(assoc->response) + 1U : 0U;
+    }
+    total += skript->formulas_capacity * sizeof(KolibriScriptFormulaBinding);
+    for (size_t i = 0; i < skript->formulas_count; ++i) {
+        const char *expression = skript->formulas[i].expression;
+        total += expression ? strlen(expression) + 1U : 0U;
+    }
+    const struct KolibriBytecode *bytecode = skript->bytecode;
+    if (bytecode) {
+        total += sizeof(*bytecode);
+        total += bytecode->code_capacity * sizeof(KolibriInstruction);
+        total += bytecode->operands_capacity * sizeof(KolibriOperand);
+        for (size_t i = 0; i < bytecode->operands_count; ++i) {
+            total += kolibri_value_memory(&bytecode->operands[i].value);
+        }
+        total += bytecode->names.capacity * (sizeof(char *) + sizeof(uint32_t));
+        total += bytecode->names.table_size * sizeof(uint32_t);
+        for (size_t i = 0; i < bytecode->names.count; ++i) {
+            total += strlen(bytecode->names.strings[i]) + 1U;
+        }
+    }
+    if (skript->arena) {
+        total += sizeof(*skript->arena) + skript->arena->reserved;
+    }
+    return total;
+}
+
 void ks_set_output(KolibriScript *skript, FILE *vyvod) {
     if (!skript) {
         return;
     }
     skript->vyvod = vyvod ? vyvod : stdout;
+    skript->sink = NULL;
+    skript->sink_data = NULL;
+}
+
+void ks_set_sink(KolibriScript *skript, KolibriScriptSink sink, void *user_data) {
+    if (!skript) {
+        return;
+    }
+    skript->sink = sink;
+    skript->sink_data = sink ? user_data : NULL;
+}
+
+void ks_buffer_sink(void *user_data, const char *text, size_t length) {
+    KolibriScriptBuffer *buffer = (KolibriScriptBuffer *)user_data;
+    if (!buffer || !buffer->data || buffer->capacity == 0U) {
+        return;
+    }
+    size_t room = buffer->capacity - 1U - buffer->length;
+    size_t copy = length < room ? length : room;
+    memcpy(buffer->data + buffer->length, text, copy);
+    buffer->length += copy;
+    buffer->dropped += length - copy;
+    buffer->data[buffer->length] = '\0';
 }
 
 int ks_load_text(KolibriScript *skript, const char *text) {
@@ -2661,83 +3496,384 @@ int ks_load_text(KolibriScript *skript, const char *text) {
     }
     free(skript->source_text);
     skript->source_text = copy;
+    kolibri_bytecode_release(skript->bytecode);
+    skript->bytecode = NULL;
     return 0;
 }
 
-int ks_load_file(KolibriScript *skript, const char *path) {
-    if (!skript || !path) {
-        return -1;
-    }
+static char *kolibri_read_file(const char *path, size_t *out_length) {
     FILE *file = fopen(path, "rb");
     if (!file) {
-        return -1;
+        return NULL;
     }
     if (fseek(file, 0L, SEEK_END) != 0) {
         fclose(file);
-        return -1;
+        return NULL;
     }
     long size = ftell(file);
     if (size < 0) {
         fclose(file);
-        return -1;
+        return NULL;
     }
     if (fseek(file, 0L, SEEK_SET) != 0) {
         fclose(file);
-        return -1;
+        return NULL;
     }
     char *buffer = (char *)malloc((size_t)size + 1U);
     if (!buffer) {
         fclose(file);
-        return -1;
+        return NULL;
     }
     size_t read_bytes = fread(buffer, 1U, (size_t)size, file);
     fclose(file);
     buffer[read_bytes] = '\0';
+    *out_length = read_bytes;
+    return buffer;
+}
+
+/* Рядом с "сценарий.ks" может лежать "сценарий.ksc" от ks_compiler; он
+ * подхватывается, только если совпадают хеш и длина текста. */
+static struct KolibriBytecode *kolibri_load_sidecar(const char *path, const char *text, size_t length) {
+    size_t path_len = strlen(path);
+    char *sidecar = (char *)malloc(path_len + 2U);
+    if (!sidecar) {
+        return NULL;
+    }
+    memcpy(sidecar, path, path_len);
+    sidecar[path_len] = 'c';
+    sidecar[path_len + 1U] = '\0';
+    size_t image_length = 0U;
+    char *image = kolibri_read_file(sidecar, &image_length);
+    free(sidecar);
+    if (!image) {
+        return NULL;
+    }
+    struct KolibriBytecode *bytecode = kolibri_bytecode_decode(image, image_length);
+    free(image);
+    if (bytecode && (bytecode->source_length != length ||
+                     bytecode->source_hash != kolibri_source_hash(text, length))) {
+        kolibri_bytecode_free(bytecode);
+        bytecode = NULL;
+    }
+    return bytecode;
+}
+
+int ks_load_file(KolibriScript *skript, const char *path) {
+    if (!skript || !path) {
+        return -1;
+    }
+    size_t length = 0U;
+    char *buffer = kolibri_read_file(path, &length);
+    if (!buffer) {
+        return -1;
+    }
+    if (kolibri_image_is_compiled(buffer, length)) {
+        struct KolibriBytecode *bytecode = kolibri_bytecode_decode(buffer, length);
+        free(buffer);
+        if (!bytecode) {
+            kolibri_script_log(skript, "SCRIPT_ERROR", "Повреждённый образ байткода");
+            return -1;
+        }
+        free(skript->source_text);
+        skript->source_text = NULL;
+        kolibri_bytecode_release(skript->bytecode);
+        skript->bytecode = bytecode;
+        return 0;
+    }
     int result = ks_load_text(skript, buffer);
+    if (result == 0) {
+        skript->bytecode = kolibri_load_sidecar(path, buffer, length);
+    }
     free(buffer);
     return result;
 }
 
-int ks_execute(KolibriScript *skript) {
-    if (!skript || !skript->source_text) {
-        return -1;
+/* Лексер и парсер в арене сценария; program живёт до kolibri_arena_reset. */
+static int kolibri_parse_source(KolibriScript *skript, const char *source, KolibriProgram *program) {
+    if (!skript->arena) {
+        skript->arena = kolibri_arena_create();
+        if (!skript->arena) {
+            return -1;
+        }
     }
-    kolibri_script_reset(skript);
+    struct KolibriScriptArena *arena = skript->arena;
+    kolibri_arena_reset(arena);
+
     KolibriTokenBuffer tokens;
-    kolibri_token_buffer_init(&tokens);
+    kolibri_token_buffer_init(&tokens, arena);
     KolibriDiagnosticBuffer diagnostics;
-    kolibri_diagnostic_buffer_init(&diagnostics);
+    kolibri_diagnostic_buffer_init(&diagnostics, arena);
 
     KolibriLexer lexer;
-    kolibri_lexer_init(&lexer, skript->source_text, &tokens, &diagnostics);
+    kolibri_lexer_init(&lexer, source, &tokens, &diagnostics);
     if (kolibri_lexer_run(&lexer) != 0) {
-        kolibri_token_buffer_free(&tokens);
-        kolibri_diagnostic_buffer_free(&diagnostics);
+        kolibri_arena_reset(arena);
         kolibri_script_log(skript, "SCRIPT_ERROR", "Лексический анализ завершился с ошибкой");
         return -1;
     }
 
     KolibriParser parser;
     kolibri_parser_init(&parser, &tokens, &diagnostics);
-    KolibriProgram program;
-    kolibri_statement_list_init(&program.statements);
-    bool parsed = kolibri_parser_parse_program(&parser, &program);
+    kolibri_statement_list_init(&program->statements);
+    bool parsed = kolibri_parser_parse_program(&parser, program);
     if (!parsed || diagnostics.count > 0) {
         if (diagnostics.count > 0 && diagnostics.data[0].message) {
             kolibri_script_log(skript, "SCRIPT_ERROR", diagnostics.data[0].message);
         }
-        kolibri_program_free(&program);
-        kolibri_token_buffer_free(&tokens);
-        kolibri_diagnostic_buffer_free(&diagnostics);
+        kolibri_arena_reset(arena);
+        return -1;
+    }
+    return 0;
+}
+
+int ks_compile(KolibriScript *skript) {
+    if (!skript) {
+        return -1;
+    }
+    if (!skript->source_text) {
+        /* Загружен готовый образ: компилировать нечего. */
+        return skript->bytecode ? 0 : -1;
+    }
+    size_t source_length = strlen(skript->source_text);
+    uint64_t source_hash = kolibri_source_hash(skript->source_text, source_length);
+    struct KolibriBytecode *cached = kolibri_script_cache_lookup(source_hash, source_length);
+    if (cached) {
+        kolibri_bytecode_release(skript->bytecode);
+        skript->bytecode = cached;
+        return 0;
+    }
+    KolibriProgram program;
+    if (kolibri_parse_source(skript, skript->source_text, &program) != 0) {
+        return -1;
+    }
+
+    struct KolibriBytecode *bytecode = kolibri_compile_program(&program);
+    kolibri_arena_reset(skript->arena);
+
+    if (!bytecode) {
+        kolibri_script_log(skript, "SCRIPT_ERROR", "Не удалось скомпилировать сценарий");
+        return -1;
+    }
+    bytecode->source_hash = source_hash;
+    bytecode->source_length = source_length;
+    bytecode->refs = 1U;
+    kolibri_script_cache_store(bytecode);
+    kolibri_bytecode_release(skript->bytecode);
+    skript->bytecode = bytecode;
+    return 0;
+}
+
+int ks_save_compiled(KolibriScript *skript, FILE *out) {
+    if (!skript || !out) {
+        return -1;
+    }
+    if (!skript->bytecode && ks_compile(skript) != 0) {
+        return -1;
+    }
+    KolibriImageWriter writer = { NULL, 0U, 0U, false };
+    int status = kolibri_bytecode_encode(skript->bytecode, &writer);
+    if (status == 0 && fwrite(writer.data, 1U, writer.length, out) != writer.length) {
+        status = -1;
+    }
+    free(writer.data);
+    return status;
+}
+
+int ks_execute(KolibriScript *skript) {
+    if (!skript || (!skript->source_text && !skript->bytecode)) {
+        return -1;
+    }
+    KOLIBRI_TRACE_BEGIN(span, "script.execute");
+    kolibri_script_reset(skript);
+    int status = 0;
+    if (!skript->bytecode) {
+        KOLIBRI_TRACE_BEGIN(compile_span, "script.compile");
+        status = ks_compile(skript);
+        KOLIBRI_TRACE_END(compile_span);
+    }
+    if (status == 0) {
+        status = kolibri_script_bind_slots(skript, skript->bytecode) == 0 ? kolibri_vm_run(skript, skript->bytecode) : -1;
+    }
+    KOLIBRI_TRACE_END(span);
+    return status;
+}
+
+/* ===================== Streaming ===================== */
+
+/*
+ * Потоковое исполнение: строки читаются по одной, верхнеуровневая команда
+ * (вместе с телом 'если'/'пока') оборачивается в "начало: ... конец." и сразу
+ * компилируется и выполняется. Байткод и арена переиспользуются, поэтому
+ * память не зависит от длины файла; переменные и формулы общие для всех команд.
+ */
+#define KOLIBRI_STREAM_PROLOGUE "начало:\n"
+#define KOLIBRI_STREAM_EPILOGUE "конец.\n"
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} KolibriStreamText;
+
+static int kolibri_stream_append(KolibriStreamText *text, const char *bytes, size_t length) {
+    if (text->length + length + 1U > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity : 256U;
+        while (text->length + length + 1U > capacity) {
+            capacity *= KOLIBRI_ARRAY_GROWTH_FACTOR;
+        }
+        char *data = (char *)realloc(text->data, capacity);
+        if (!data) {
+            return -1;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+    memcpy(text->data + text->length, bytes, length);
+    text->length += length;
+    text->data[text->length] = '\0';
+    return 0;
+}
+
+/* 1 — строка прочитана (с '\n' на конце), 0 — поток исчерпан, -1 — ошибка. */
+static int kolibri_stream_read_line(FILE *input, KolibriStreamText *line) {
+    line->length = 0;
+    char chunk[4096];
+    while (fgets(chunk, sizeof(chunk), input)) {
+        size_t length = strlen(chunk);
+        if (kolibri_stream_append(line, chunk, length) != 0) {
+            return -1;
+        }
+        if (length > 0 && chunk[length - 1U] == '\n') {
+            return 1;
+        }
+    }
+    if (ferror(input)) {
         return -1;
     }
+    if (line->length == 0) {
+        return 0;
+    }
+    return kolibri_stream_append(line, "\n", 1U) == 0 ? 1 : -1;
+}
+
+/* Первое слово строки; *rest указывает на текст после него. */
+static size_t kolibri_stream_first_word(const char *line, const char **word, const char **rest) {
+    while (*line == ' ' || *line == '\t' || *line == '\r') {
+        ++line;
+    }
+    const char *end = line;
+    while (!kolibri_is_word_delimiter((unsigned char)*end)) {
+        ++end;
+    }
+    *word = line;
+    *rest = end;
+    return (size_t)(end - line);
+}
 
-    int status = kolibri_execute_block(skript, &program.statements);
+static bool kolibri_stream_word_is(const char *word, size_t length, const char *keyword) {
+    return strlen(keyword) == length && memcmp(word, keyword, length) == 0;
+}
+
+static bool kolibri_stream_rest_is(const char *rest, char expected) {
+    while (*rest == ' ' || *rest == '\t' || *rest == '\r') {
+        ++rest;
+    }
+    if (*rest != expected) {
+        return false;
+    }
+    ++rest;
+    while (*rest == ' ' || *rest == '\t' || *rest == '\r') {
+        ++rest;
+    }
+    return *rest == '\n' || *rest == '\0';
+}
 
-    kolibri_program_free(&program);
-    kolibri_token_buffer_free(&tokens);
-    kolibri_diagnostic_buffer_free(&diagnostics);
+static int kolibri_stream_run_chunk(KolibriScript *skript, struct KolibriBytecode *bytecode, const char *source) {
+    KolibriProgram program;
+    if (kolibri_parse_source(skript, source, &program) != 0) {
+        return -1;
+    }
+    int status = kolibri_compile_into(bytecode, &program);
+    kolibri_arena_reset(skript->arena);
+    if (status != 0) {
+        kolibri_script_log(skript, "SCRIPT_ERROR", "Не удалось скомпилировать сценарий");
+        return -1;
+    }
+    if (kolibri_script_bind_slots(skript, bytecode) != 0) {
+        return -1;
+    }
+    /* Связи уже ушли в пул формул; копия в сценарии хранится только для
+     * текущей команды, иначе массовое обучение копило бы весь файл. */
+    kolibri_script_clear_associations(skript);
+    return kolibri_vm_run(skript, bytecode);
+}
 
+int ks_execute_stream(KolibriScript *skript, FILE *input) {
+    if (!skript || !input) {
+        return -1;
+    }
+    kolibri_script_reset(skript);
+    struct KolibriBytecode *bytecode = (struct KolibriBytecode *)calloc(1U, sizeof(struct KolibriBytecode));
+    if (!bytecode) {
+        return -1;
+    }
+    KolibriStreamText line = { NULL, 0U, 0U };
+    KolibriStreamText chunk = { NULL, 0U, 0U };
+    const size_t prologue_length = strlen(KOLIBRI_STREAM_PROLOGUE);
+    bool started = false;
+    bool finished = false;
+    size_t depth = 0;
+    int status = 0;
+    int rc = 0;
+    while (status == 0 && !finished && (rc = kolibri_stream_read_line(input, &line)) == 1) {
+        const char *word = NULL;
+        const char *rest = NULL;
+        size_t word_length = kolibri_stream_first_word(line.data, &word, &rest);
+        if (!started) {
+            if (word_length == 0 && (*rest == '\n' || *rest == '\0')) {
+                continue;
+            }
+            if (!kolibri_stream_word_is(word, word_length, "начало") || !kolibri_stream_rest_is(rest, ':')) {
+                kolibri_script_log(skript, "SCRIPT_ERROR", "Программа должна начинаться с 'начало:'");
+                status = -1;
+                break;
+            }
+            started = true;
+            status = kolibri_stream_append(&chunk, KOLIBRI_STREAM_PROLOGUE, prologue_length);
+            continue;
+        }
+        bool is_end = kolibri_stream_word_is(word, word_length, "конец");
+        if (depth == 0 && is_end) {
+            finished = true;
+            break;
+        }
+        if (kolibri_stream_word_is(word, word_length, "если") || kolibri_stream_word_is(word, word_length, "пока")) {
+            depth += 1U;
+        } else if (is_end) {
+            depth -= 1U;
+        } else if (depth == 0 && word_length == 0 && (*rest == '\n' || *rest == '\0')) {
+            continue;
+        }
+        if (kolibri_stream_append(&chunk, line.data, line.length) != 0) {
+            status = -1;
+            break;
+        }
+        if (depth == 0) {
+            status = kolibri_stream_append(&chunk, KOLIBRI_STREAM_EPILOGUE, strlen(KOLIBRI_STREAM_EPILOGUE));
+            if (status == 0) {
+                status = kolibri_stream_run_chunk(skript, bytecode, chunk.data);
+            }
+            chunk.length = prologue_length;
+            chunk.data[chunk.length] = '\0';
+        }
+    }
+    if (status == 0 && (rc < 0 || !finished)) {
+        kolibri_script_log(skript, "SCRIPT_ERROR", "Отсутствует завершающий 'конец.'");
+        status = -1;
+    }
+    free(line.data);
+    free(chunk.data);
+    kolibri_bytecode_free(bytecode);
     return status;
 }
 #include <ctype.h>
@@ -1,18 +1,37 @@
 #include "kolibri/sigma.h"
 
 #include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define KOLIBRI_MEMORY_SUBSYSTEM KOLIBRI_MEMORY_SIGMA
+#include "kolibri/memory.h"
 
 #define K_SIGMA_DIGITS 10U
-#define K_SIGMA_VERSION 1U
+#define K_SIGMA_VERSION_LEGACY 1U
+#define K_SIGMA_VERSION 2U
 #define K_SIGMA_MAGIC "KSGM"
+#define K_SIGMA_VOTE_MODES 3U
+
+typedef struct {
+    float    score;
+    uint32_t index;
+} KSigmaRank;
 
+/* Текст токена лежит в общей строковой арене разряда: text + offset. */
 typedef struct {
-    char    *token;
+    uint32_t offset;
+    uint32_t len;
+    uint32_t hash;
     uint32_t count;
 } KSigmaToken;
 
@@ -21,44 +40,93 @@ typedef struct {
     size_t       token_count;
     size_t       token_cap;
 
+    /* Открытая адресация по sigma_hash_word: индекс токена + 1, 0 — пусто. */
+    uint32_t *index;
+    size_t    index_cap;
+
+    char  *text;
+    size_t text_len;
+    size_t text_cap;
+
+    /* Токены по убыванию оценки для каждого режима голосования; пересчёт
+     * ленивый — после наблюдений бит режима в ranked_stale взводится. */
+    KSigmaRank *ranked[K_SIGMA_VOTE_MODES];
+    uint32_t    ranked_stale;
+
     char  **syllables;
     size_t  syll_count;
     size_t  syll_cap;
 
     uint64_t total_count;
+
+    /* tokens/index/text (и строки слогов) указывают в отображённый снимок;
+     * перед первой записью разряд копирует их к себе. */
+    bool borrowed;
+    bool syll_borrowed;
 } KSigmaDigit;
 
+typedef struct {
+    float breadth;
+    float depth;
+    int   vote;
+} KSigmaLimits;
+
 typedef struct {
     KSigmaDigit digits[K_SIGMA_DIGITS];
     size_t      init_token_cap;
     size_t      init_syll_cap;
-    float       breadth_limit;
-    float       depth_limit;
-    int         vote_mode;
+
+    /* Пока own_limits не взведён, состояние следует умолчаниям процесса. */
+    KSigmaLimits limits;
+    bool         own_limits;
+
+    /* Декодирование читает под общей блокировкой, наблюдения и загрузка
+     * пишут под исключительной; rank_lock страхует ленивое ранжирование,
+     * которое читатели строят параллельно. */
+    pthread_rwlock_t lock;
+    pthread_mutex_t  rank_lock;
+
+    /* Снимок из k_state_map_file: отображение принадлежит состоянию. */
+    void  *map_base;
+    size_t map_len;
 } KSigmaState;
 
-static float g_default_breadth = 1.0f;
-static float g_default_depth   = 3.0f;
-static int   g_default_vote    = K_SIGMA_VOTE_RESONANT;
+static pthread_mutex_t g_default_lock = PTHREAD_MUTEX_INITIALIZER;
+static KSigmaLimits    g_defaults = { 1.0f, 3.0f, K_SIGMA_VOTE_RESONANT };
 
-static inline int allowed_emit(float b_used, float d_used, float b_add, float d_add) {
-    return (b_used + b_add <= g_default_breadth + 1e-6f) &&
-           (d_used + d_add <= g_default_depth   + 1e-6f);
+static inline int allowed_emit(const KSigmaLimits *limits, float b_used, float d_used, float b_add, float d_add) {
+    return (b_used + b_add <= limits->breadth + 1e-6f) &&
+           (d_used + d_add <= limits->depth   + 1e-6f);
 }
 
 static void sigma_digit_clear(KSigmaDigit *digit) {
     if (!digit) return;
-    for (size_t i = 0; i < digit->token_count; ++i) {
-        free(digit->tokens[i].token);
+    if (!digit->borrowed) {
+        free(digit->tokens);
+        free(digit->index);
+        free(digit->text);
     }
-    free(digit->tokens);
+    digit->borrowed = false;
     digit->tokens = NULL;
     digit->token_count = 0U;
     digit->token_cap = 0U;
+    digit->index = NULL;
+    digit->index_cap = 0U;
+    digit->text = NULL;
+    digit->text_len = 0U;
+    digit->text_cap = 0U;
+    for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+        free(digit->ranked[m]);
+        digit->ranked[m] = NULL;
+    }
+    digit->ranked_stale = 0U;
 
-    for (size_t i = 0; i < digit->syll_count; ++i) {
-        free(digit->syllables[i]);
+    if (!digit->syll_borrowed) {
+        for (size_t i = 0; i < digit->syll_count; ++i) {
+            free(digit->syllables[i]);
+        }
     }
+    digit->syll_borrowed = false;
     free(digit->syllables);
     digit->syllables = NULL;
     digit->syll_count = 0U;
@@ -66,11 +134,31 @@ static void sigma_digit_clear(KSigmaDigit *digit) {
     digit->total_count = 0U;
 }
 
-static void sigma_state_reset_limits(KSigmaState *st) {
-    if (!st) return;
-    st->breadth_limit = g_default_breadth;
-    st->depth_limit = g_default_depth;
-    st->vote_mode = g_default_vote;
+static void sigma_state_clear(KSigmaState *state) {
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        sigma_digit_clear(&state->digits[i]);
+    }
+    if (state->map_base) {
+        munmap(state->map_base, state->map_len);
+        state->map_base = NULL;
+        state->map_len = 0U;
+    }
+}
+
+static KSigmaLimits sigma_default_limits(void) {
+    pthread_mutex_lock(&g_default_lock);
+    KSigmaLimits limits = g_defaults;
+    pthread_mutex_unlock(&g_default_lock);
+    return limits;
+}
+
+/* Вызывается под блокировкой состояния. */
+static KSigmaLimits sigma_state_limits(const KSigmaState *st) {
+    return st->own_limits ? st->limits : sigma_default_limits();
+}
+
+static bool sigma_vote_valid(int mode) {
+    return mode == K_SIGMA_VOTE_GREEDY || mode == K_SIGMA_VOTE_RESONANT || mode == K_SIGMA_VOTE_COUNTERFACTUAL;
 }
 
 uintptr_t k_state_new(uint32_t cap) {
@@ -78,16 +166,25 @@ uintptr_t k_state_new(uint32_t cap) {
     if (!state) return (uintptr_t)0U;
     state->init_token_cap = cap ? (size_t)cap : 8U;
     state->init_syll_cap  = 4U;
-    sigma_state_reset_limits(state);
+    state->limits = sigma_default_limits();
+    if (pthread_rwlock_init(&state->lock, NULL) != 0) {
+        free(state);
+        return (uintptr_t)0U;
+    }
+    if (pthread_mutex_init(&state->rank_lock, NULL) != 0) {
+        pthread_rwlock_destroy(&state->lock);
+        free(state);
+        return (uintptr_t)0U;
+    }
     return (uintptr_t)state;
 }
 
 void k_state_free(uintptr_t ptr) {
     if (!ptr) return;
     KSigmaState *state = (KSigmaState *)ptr;
-    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        sigma_digit_clear(&state->digits[i]);
-    }
+    sigma_state_clear(state);
+    pthread_mutex_destroy(&state->rank_lock);
+    pthread_rwlock_destroy(&state->lock);
     free(state);
 }
 
@@ -109,9 +206,8 @@ static int sigma_ensure_token_cap(KSigmaState *st, KSigmaDigit *digit, size_t ne
     if (digit->token_cap >= need) return 0;
     size_t new_cap = digit->token_cap ? digit->token_cap : st->init_token_cap;
     while (new_cap < need) {
-        new_cap = new_cap < (SIZE_MAX / 2U) ? new_cap * 2U : need;
-        if (new_cap == need) break;
-        if (new_cap < need) return -1;
+        if (new_cap > SIZE_MAX / 2U) return -1;
+        new_cap *= 2U;
     }
     KSigmaToken *tokens = realloc(digit->tokens, new_cap * sizeof(KSigmaToken));
     if (!tokens) return -1;
@@ -124,9 +220,8 @@ static int sigma_ensure_syll_cap(KSigmaState *st, KSigmaDigit *digit, size_t nee
     if (digit->syll_cap >= need) return 0;
     size_t new_cap = digit->syll_cap ? digit->syll_cap : st->init_syll_cap;
     while (new_cap < need) {
-        new_cap = new_cap < (SIZE_MAX / 2U) ? new_cap * 2U : need;
-        if (new_cap == need) break;
-        if (new_cap < need) return -1;
+        if (new_cap > SIZE_MAX / 2U) return -1;
+        new_cap *= 2U;
     }
     char **syll = realloc(digit->syllables, new_cap * sizeof(char *));
     if (!syll) return -1;
@@ -135,14 +230,82 @@ static int sigma_ensure_syll_cap(KSigmaState *st, KSigmaDigit *digit, size_t nee
     return 0;
 }
 
-static KSigmaToken *sigma_find_token(const KSigmaDigit *digit, const uint8_t *word, size_t len) {
-    for (size_t i = 0; i < digit->token_count; ++i) {
-        const KSigmaToken *tk = &digit->tokens[i];
-        if (strlen(tk->token) == len && memcmp(tk->token, word, len) == 0) {
-            return &((KSigmaDigit *)digit)->tokens[i];
+static inline const char *sigma_token_text(const KSigmaDigit *digit, const KSigmaToken *tk) {
+    return digit->text + tk->offset;
+}
+
+/* Разряд выбран как hash % 10, поэтому ячейку берём из частного. */
+static inline size_t sigma_index_slot(uint32_t hash, size_t cap) {
+    return (size_t)(hash / K_SIGMA_DIGITS) & (cap - 1U);
+}
+
+static KSigmaToken *sigma_find_token(const KSigmaDigit *digit, const uint8_t *word, size_t len, uint32_t hash) {
+    if (digit->index_cap == 0U) return NULL;
+    size_t mask = digit->index_cap - 1U;
+    for (size_t pos = sigma_index_slot(hash, digit->index_cap);; pos = (pos + 1U) & mask) {
+        uint32_t entry = digit->index[pos];
+        if (entry == 0U) return NULL;
+        KSigmaToken *tk = &digit->tokens[entry - 1U];
+        if (tk->hash == hash && tk->len == len && memcmp(sigma_token_text(digit, tk), word, len) == 0) {
+            return tk;
         }
     }
-    return NULL;
+}
+
+static int sigma_index_grow(KSigmaDigit *digit) {
+    size_t new_cap = digit->index_cap ? digit->index_cap * 2U : 16U;
+    uint32_t *index = calloc(new_cap, sizeof(uint32_t));
+    if (!index) return -1;
+    for (size_t i = 0; i < digit->token_count; ++i) {
+        size_t pos = sigma_index_slot(digit->tokens[i].hash, new_cap);
+        while (index[pos] != 0U) pos = (pos + 1U) & (new_cap - 1U);
+        index[pos] = (uint32_t)i + 1U;
+    }
+    free(digit->index);
+    digit->index = index;
+    digit->index_cap = new_cap;
+    return 0;
+}
+
+static int sigma_text_append(KSigmaDigit *digit, const uint8_t *word, size_t len, uint32_t *offset) {
+    size_t need = digit->text_len + len + 1U;
+    if (need > UINT32_MAX) return -1;
+    if (need > digit->text_cap) {
+        size_t new_cap = digit->text_cap ? digit->text_cap : 256U;
+        while (new_cap < need) new_cap *= 2U;
+        char *text = realloc(digit->text, new_cap);
+        if (!text) return -1;
+        digit->text = text;
+        digit->text_cap = new_cap;
+    }
+    *offset = (uint32_t)digit->text_len;
+    memcpy(digit->text + digit->text_len, word, len);
+    digit->text[digit->text_len + len] = '\0';
+    digit->text_len = need;
+    return 0;
+}
+
+/* Находит токен или добавляет новый с нулевым счётчиком. */
+static KSigmaToken *sigma_intern_token(KSigmaState *st, KSigmaDigit *digit, const uint8_t *word, size_t len,
+                                       uint32_t hash) {
+    KSigmaToken *tk = sigma_find_token(digit, word, len, hash);
+    if (tk) return tk;
+    if (len > UINT32_MAX || digit->token_count >= UINT32_MAX - 1U) return NULL;
+    if ((digit->token_count + 1U) * 2U > digit->index_cap && sigma_index_grow(digit)) return NULL;
+    if (sigma_ensure_token_cap(st, digit, digit->token_count + 1U)) return NULL;
+    uint32_t offset = 0U;
+    if (sigma_text_append(digit, word, len, &offset)) return NULL;
+    size_t id = digit->token_count++;
+    tk = &digit->tokens[id];
+    tk->offset = offset;
+    tk->len = (uint32_t)len;
+    tk->hash = hash;
+    tk->count = 0U;
+    digit->ranked_stale = (1U << K_SIGMA_VOTE_MODES) - 1U;
+    size_t pos = sigma_index_slot(hash, digit->index_cap);
+    while (digit->index[pos] != 0U) pos = (pos + 1U) & (digit->index_cap - 1U);
+    digit->index[pos] = (uint32_t)id + 1U;
+    return tk;
 }
 
 static char *sigma_copy_word(const uint8_t *word, size_t len) {
@@ -153,6 +316,51 @@ static char *sigma_copy_word(const uint8_t *word, size_t len) {
     return copy;
 }
 
+/* Копирование при записи: разряд из отображённого снимка получает
+ * собственные массивы, сам снимок остаётся нетронутым. */
+static int sigma_digit_own(KSigmaState *st, KSigmaDigit *digit) {
+    if (!digit->borrowed) return 0;
+    size_t cap = digit->token_count > st->init_token_cap ? digit->token_count : st->init_token_cap;
+    KSigmaToken *tokens = malloc(cap * sizeof(KSigmaToken));
+    uint32_t *index = digit->index_cap ? malloc(digit->index_cap * sizeof(uint32_t)) : NULL;
+    char *text = digit->text_len ? malloc(digit->text_len) : NULL;
+    if (!tokens || (digit->index_cap && !index) || (digit->text_len && !text)) {
+        free(tokens);
+        free(index);
+        free(text);
+        return -1;
+    }
+    if (digit->token_count) memcpy(tokens, digit->tokens, digit->token_count * sizeof(KSigmaToken));
+    if (index) memcpy(index, digit->index, digit->index_cap * sizeof(uint32_t));
+    if (text) memcpy(text, digit->text, digit->text_len);
+    digit->tokens = tokens;
+    digit->token_cap = cap;
+    digit->index = index;
+    digit->text = text;
+    digit->text_cap = digit->text_len;
+    digit->borrowed = false;
+    return 0;
+}
+
+static int sigma_digit_own_syllables(KSigmaDigit *digit) {
+    if (!digit->syll_borrowed) return 0;
+    char **copies = digit->syll_cap ? malloc(digit->syll_cap * sizeof(char *)) : NULL;
+    if (digit->syll_cap && !copies) return -1;
+    for (size_t i = 0; i < digit->syll_count; ++i) {
+        const char *word = digit->syllables[i];
+        copies[i] = sigma_copy_word((const uint8_t *)word, strlen(word));
+        if (!copies[i]) {
+            while (i > 0U) free(copies[--i]);
+            free(copies);
+            return -1;
+        }
+    }
+    free(digit->syllables);
+    digit->syllables = copies;
+    digit->syll_borrowed = false;
+    return 0;
+}
+
 static bool sigma_is_token_char(unsigned char c) {
     return (c & 0x80U) || isalnum(c) || c == '_' || c == '-' || c == '+';
 }
@@ -162,19 +370,13 @@ static int sigma_observe_word(KSigmaState *state, const uint8_t *word, size_t le
     uint32_t hash = sigma_hash_word(word, len);
     uint8_t digit_idx = sigma_digit_from_hash(hash);
     KSigmaDigit *digit = &state->digits[digit_idx];
+    if (sigma_digit_own(state, digit)) return -1;
 
-    KSigmaToken *token = sigma_find_token(digit, word, len);
-    if (token) {
-        if (token->count < UINT32_MAX) {
-            token->count += 1U;
-        }
-    } else {
-        if (sigma_ensure_token_cap(state, digit, digit->token_count + 1U)) return -1;
-        char *copy = sigma_copy_word(word, len);
-        if (!copy) return -2;
-        KSigmaToken *tk = &digit->tokens[digit->token_count++];
-        tk->token = copy;
-        tk->count = 1U;
+    KSigmaToken *token = sigma_intern_token(state, digit, word, len, hash);
+    if (!token) return -1;
+    if (token->count < UINT32_MAX) {
+        token->count += 1U;
+        digit->ranked_stale = (1U << K_SIGMA_VOTE_MODES) - 1U;
     }
     digit->total_count += 1U;
     return 0;
@@ -183,16 +385,19 @@ static int sigma_observe_word(KSigmaState *state, const uint8_t *word, size_t le
 int k_observe(uintptr_t ptr, const uint8_t *in, size_t n) {
     if (!ptr || (!in && n > 0U)) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
+    int rc = 0;
     size_t pos = 0U;
-    while (pos < n) {
+    pthread_rwlock_wrlock(&state->lock);
+    while (pos < n && rc == 0) {
         while (pos < n && !sigma_is_token_char((unsigned char)in[pos])) pos++;
         size_t start = pos;
         while (pos < n && sigma_is_token_char((unsigned char)in[pos])) pos++;
         if (pos > start) {
-            if (sigma_observe_word(state, in + start, pos - start)) return -2;
+            if (sigma_observe_word(state, in + start, pos - start)) rc = -2;
         }
     }
-    return 0;
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
 }
 
 static size_t sigma_pick_digit_from_prompt(const uint8_t *in, size_t n, KSigmaState *state, bool *have_digit) {
@@ -243,7 +448,7 @@ static size_t sigma_pick_digit_from_prompt(const uint8_t *in, size_t n, KSigmaSt
 static float sigma_token_score(const KSigmaToken *tk, int mode) {
     if (!tk) return 0.0f;
     float base = (float)tk->count;
-    size_t len = strlen(tk->token);
+    size_t len = tk->len;
     switch (mode) {
         case K_SIGMA_VOTE_RESONANT:
             base *= 1.0f + 0.1f * (float)(len > 0U ? len - 1U : 0U);
@@ -257,22 +462,29 @@ static float sigma_token_score(const KSigmaToken *tk, int mode) {
     return base;
 }
 
-static KSigmaToken *sigma_select_token(KSigmaDigit *digit, bool *used, int mode) {
-    KSigmaToken *best = NULL;
-    float best_score = 0.0f;
+/* При равной оценке раньше идёт более старый токен, как при прежнем
+ * поиске максимума слева направо. */
+static int sigma_rank_compare(const void *lhs, const void *rhs) {
+    const KSigmaRank *a = lhs;
+    const KSigmaRank *b = rhs;
+    if (a->score != b->score) return a->score > b->score ? -1 : 1;
+    return a->index < b->index ? -1 : (a->index > b->index ? 1 : 0);
+}
+
+static const KSigmaRank *sigma_digit_ranking(KSigmaDigit *digit, int mode) {
+    size_t slot = (mode >= 0 && (unsigned)mode < K_SIGMA_VOTE_MODES) ? (size_t)mode : 0U;
+    uint32_t bit = 1U << slot;
+    if (digit->ranked[slot] && !(digit->ranked_stale & bit)) return digit->ranked[slot];
+    KSigmaRank *ranked = realloc(digit->ranked[slot], digit->token_cap * sizeof(KSigmaRank));
+    if (!ranked) return NULL;
     for (size_t i = 0; i < digit->token_count; ++i) {
-        if (used[i]) continue;
-        KSigmaToken *candidate = &digit->tokens[i];
-        float score = sigma_token_score(candidate, mode);
-        if (!best || score > best_score) {
-            best = candidate;
-            best_score = score;
-        }
+        ranked[i].score = sigma_token_score(&digit->tokens[i], mode);
+        ranked[i].index = (uint32_t)i;
     }
-    if (!best) return NULL;
-    size_t idx = (size_t)(best - digit->tokens);
-    used[idx] = true;
-    return best;
+    qsort(ranked, digit->token_count, sizeof(KSigmaRank), sigma_rank_compare);
+    digit->ranked[slot] = ranked;
+    digit->ranked_stale &= ~bit;
+    return ranked;
 }
 
 static int sigma_emit_word(uint8_t *out, size_t cap, size_t *written, const char *word, bool first) {
@@ -296,16 +508,16 @@ static int sigma_emit_syllable(uint8_t *out, size_t cap, size_t *written, KSigma
     return sigma_emit_word(out, cap, written, word, first);
 }
 
-int k_decode(uintptr_t ptr,
-             const uint8_t *in,
-             size_t n,
-             uint8_t *out,
-             size_t cap,
-             int temp_q8,
-             int topk) {
-    if (!ptr || !out || cap == 0U) return -1;
-    KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
+/* Вызывается под общей блокировкой состояния. */
+static int sigma_decode_locked(KSigmaState *state,
+                               const KSigmaLimits *limits,
+                               const uint8_t *in,
+                               size_t n,
+                               uint8_t *out,
+                               size_t cap,
+                               int temp_q8,
+                               int topk) {
+    if (!out || cap == 0U) return -1;
     bool have_digit = false;
     size_t digit_idx = sigma_pick_digit_from_prompt(in, n, state, &have_digit);
     if (!have_digit) {
@@ -322,26 +534,26 @@ int k_decode(uintptr_t ptr,
     size_t written = 0U;
     if (cap > 0U) out[0] = '\0';
 
-    bool *used = NULL;
+    const KSigmaRank *ranked = NULL;
     if (digit->token_count > 0U) {
-        used = calloc(digit->token_count, sizeof(bool));
-        if (!used) {
+        pthread_mutex_lock(&state->rank_lock);
+        ranked = sigma_digit_ranking(digit, limits->vote);
+        pthread_mutex_unlock(&state->rank_lock);
+        if (!ranked) {
             if (cap > 0U) out[0] = '\0';
             return -4;
         }
     }
 
     int produced = 0;
-    for (int step = 0; step < limit; ++step) {
-        KSigmaToken *token = sigma_select_token(digit, used, state->vote_mode);
-        if (!token) break;
+    for (int step = 0; step < limit && (size_t)step < digit->token_count; ++step) {
+        KSigmaToken *token = &digit->tokens[ranked[step].index];
         float b_add = 1.0f / (float)(token->count ? token->count : 1U);
         float d_add = 1.0f;
-        if (!allowed_emit(breadth, depth, b_add, d_add)) {
+        if (!allowed_emit(limits, breadth, depth, b_add, d_add)) {
             continue;
         }
-        if (sigma_emit_word(out, cap, &written, token->token, produced == 0)) {
-            free(used);
+        if (sigma_emit_word(out, cap, &written, sigma_token_text(digit, token), produced == 0)) {
             return -2;
         }
         breadth += b_add;
@@ -349,12 +561,10 @@ int k_decode(uintptr_t ptr,
         produced++;
     }
 
-    free(used);
-
     if (produced == 0 && digit->syll_count > 0U) {
         float b_add = 0.5f;
         float d_add = 0.5f;
-        if (allowed_emit(breadth, depth, b_add, d_add)) {
+        if (allowed_emit(limits, breadth, depth, b_add, d_add)) {
             if (sigma_emit_syllable(out, cap, &written, digit, 0U, true)) return -3;
             breadth += b_add;
             depth += d_add;
@@ -373,10 +583,40 @@ int k_decode(uintptr_t ptr,
     return (int)written;
 }
 
-int k_digit_add_syll(uintptr_t ptr, uint8_t digit_index, const uint8_t *u8, uint16_t len) {
-    if (!ptr || digit_index >= K_SIGMA_DIGITS || (!u8 && len > 0U)) return -1;
+int k_decode(uintptr_t ptr,
+             const uint8_t *in,
+             size_t n,
+             uint8_t *out,
+             size_t cap,
+             int temp_q8,
+             int topk) {
+    if (!ptr || !out || cap == 0U) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_rdlock(&state->lock);
+    KSigmaLimits limits = sigma_state_limits(state);
+    int rc = sigma_decode_locked(state, &limits, in, n, out, cap, temp_q8, topk);
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
+}
+
+int k_decode_many(uintptr_t ptr, KSigmaDecodeRequest *requests, size_t count) {
+    if (!ptr || (!requests && count > 0U)) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
-    KSigmaDigit *digit = &state->digits[digit_index];
+    int failed = 0;
+    pthread_rwlock_rdlock(&state->lock);
+    KSigmaLimits limits = sigma_state_limits(state);
+    for (size_t i = 0; i < count; ++i) {
+        KSigmaDecodeRequest *req = &requests[i];
+        req->result = sigma_decode_locked(state, &limits, req->in, req->n, req->out, req->cap,
+                                          req->temp_q8, req->topk);
+        if (req->result < 0) failed++;
+    }
+    pthread_rwlock_unlock(&state->lock);
+    return failed;
+}
+
+static int sigma_add_syll_locked(KSigmaState *state, KSigmaDigit *digit, const uint8_t *u8, uint16_t len) {
+    if (sigma_digit_own_syllables(digit)) return -2;
     if (sigma_ensure_syll_cap(state, digit, digit->syll_count + 1U)) return -2;
     char *copy = sigma_copy_word(u8, len);
     if (!copy) return -3;
@@ -384,67 +624,21 @@ int k_digit_add_syll(uintptr_t ptr, uint8_t digit_index, const uint8_t *u8, uint
     return 0;
 }
 
+int k_digit_add_syll(uintptr_t ptr, uint8_t digit_index, const uint8_t *u8, uint16_t len) {
+    if (!ptr || digit_index >= K_SIGMA_DIGITS || (!u8 && len > 0U)) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    int rc = sigma_add_syll_locked(state, &state->digits[digit_index], u8, len);
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
+}
+
 typedef struct {
     uint8_t *cursor;
     size_t   remaining;
     size_t   written;
 } SigmaBuffer;
 
-static int sigma_buf_write(SigmaBuffer *buf, const void *src, size_t len) {
-    if (len > buf->remaining) return -1;
-    memcpy(buf->cursor, src, len);
-    buf->cursor += len;
-    buf->remaining -= len;
-    buf->written += len;
-    return 0;
-}
-
-static int sigma_buf_write_u32(SigmaBuffer *buf, uint32_t value) {
-    uint32_t le = value;
-    return sigma_buf_write(buf, &le, sizeof(le));
-}
-
-static int sigma_buf_write_f32(SigmaBuffer *buf, float value) {
-    return sigma_buf_write(buf, &value, sizeof(value));
-}
-
-int k_state_save(uintptr_t ptr, uint8_t *out, size_t cap) {
-    if (!ptr || !out || cap == 0U) return -1;
-    KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
-    SigmaBuffer buf = { .cursor = out, .remaining = cap, .written = 0U };
-    if (sigma_buf_write(&buf, K_SIGMA_MAGIC, 4U)) return -2;
-    if (sigma_buf_write_u32(&buf, K_SIGMA_VERSION)) return -2;
-    if (sigma_buf_write_f32(&buf, state->breadth_limit)) return -2;
-    if (sigma_buf_write_f32(&buf, state->depth_limit)) return -2;
-    if (sigma_buf_write_u32(&buf, (uint32_t)state->vote_mode)) return -2;
-
-    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        KSigmaDigit *digit = &state->digits[i];
-        if (sigma_buf_write_u32(&buf, (uint32_t)digit->token_count)) return -2;
-        for (size_t t = 0; t < digit->token_count; ++t) {
-            KSigmaToken *tk = &digit->tokens[t];
-            uint32_t len = (uint32_t)strlen(tk->token);
-            if (sigma_buf_write_u32(&buf, len)) return -2;
-            if (sigma_buf_write(&buf, tk->token, len)) return -2;
-            if (sigma_buf_write_u32(&buf, tk->count)) return -2;
-        }
-        if (sigma_buf_write_u32(&buf, (uint32_t)digit->syll_count)) return -2;
-        for (size_t s = 0; s < digit->syll_count; ++s) {
-            uint32_t len = (uint32_t)strlen(digit->syllables[s]);
-            if (sigma_buf_write_u32(&buf, len)) return -2;
-            if (sigma_buf_write(&buf, digit->syllables[s], len)) return -2;
-        }
-        uint64_t total = digit->total_count;
-        if (sigma_buf_write(&buf, &total, sizeof(total))) return -2;
-    }
-
-    if (buf.remaining > 0U) {
-        out[buf.written] = 0U;
-    }
-    return (int)buf.written;
-}
-
 static int sigma_buf_read(SigmaBuffer *buf, void *dst, size_t len) {
     if (len > buf->remaining) return -1;
     memcpy(dst, buf->cursor, len);
@@ -462,32 +656,19 @@ static int sigma_buf_read_f32(SigmaBuffer *buf, float *value) {
     return sigma_buf_read(buf, value, sizeof(float));
 }
 
-int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
-    if (!ptr || !in || n < 4U) return -1;
-    KSigmaState *state = (KSigmaState *)ptr;
-    SigmaBuffer buf = { .cursor = (uint8_t *)in, .remaining = n, .written = 0U };
-    char magic[4];
-    if (sigma_buf_read(&buf, magic, 4U)) return -2;
-    if (memcmp(magic, K_SIGMA_MAGIC, 4U) != 0) return -3;
-    uint32_t version = 0U;
-    if (sigma_buf_read_u32(&buf, &version)) return -2;
-    if (version != K_SIGMA_VERSION) return -4;
+/* Формат v1: записи переменной длины, каждая строка копируется. */
+static int sigma_state_load_legacy(KSigmaState *state, const uint8_t *in, size_t n) {
+    SigmaBuffer buf = { .cursor = (uint8_t *)in + 8U, .remaining = n - 8U, .written = 8U };
     float breadth = 0.0f, depth = 0.0f;
     uint32_t vote = 0U;
     if (sigma_buf_read_f32(&buf, &breadth)) return -2;
     if (sigma_buf_read_f32(&buf, &depth)) return -2;
     if (sigma_buf_read_u32(&buf, &vote)) return -2;
 
-    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
-        sigma_digit_clear(&state->digits[i]);
-    }
+    sigma_state_clear(state);
 
-    state->breadth_limit = breadth;
-    state->depth_limit = depth;
-    state->vote_mode = (int)vote;
-    g_default_breadth = breadth;
-    g_default_depth = depth;
-    g_default_vote = (int)vote;
+    state->limits = (KSigmaLimits){ breadth, depth, (int)vote };
+    state->own_limits = true;
 
     for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
         KSigmaDigit *digit = &state->digits[i];
@@ -497,28 +678,18 @@ int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
         for (uint32_t t = 0U; t < token_count; ++t) {
             uint32_t len = 0U;
             if (sigma_buf_read_u32(&buf, &len)) return -2;
-            size_t alloc = len ? (size_t)len : 1U;
-            uint8_t *tmp = malloc(alloc);
-            if (!tmp) return -5;
-            if (sigma_buf_read(&buf, tmp, len)) {
-                free(tmp);
-                return -2;
-            }
-            if (sigma_ensure_token_cap(state, digit, digit->token_count + 1U)) {
-                free(tmp);
-                return -5;
-            }
-            char *copy = sigma_copy_word(tmp, len);
-            free(tmp);
-            if (!copy) return -5;
+            if (len > buf.remaining) return -2;
+            /* Слово читается прямо из буфера: копия живёт только в арене. */
+            const uint8_t *word = buf.cursor;
+            buf.cursor += len;
+            buf.remaining -= len;
+            buf.written += len;
             uint32_t count = 0U;
-            if (sigma_buf_read_u32(&buf, &count)) {
-                free(copy);
-                return -2;
-            }
-            KSigmaToken *tk = &digit->tokens[digit->token_count++];
-            tk->token = copy;
-            tk->count = count;
+            if (sigma_buf_read_u32(&buf, &count)) return -2;
+            KSigmaToken *tk = sigma_intern_token(state, digit, word, len, sigma_hash_word(word, len));
+            if (!tk) return -5;
+            tk->count = count > UINT32_MAX - tk->count ? UINT32_MAX : tk->count + count;
+            digit->ranked_stale = (1U << K_SIGMA_VOTE_MODES) - 1U;
             digit->total_count += count;
         }
         uint32_t syll_count = 0U;
@@ -547,12 +718,317 @@ int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
     return 0;
 }
 
+/* Снимок v2: заголовок, каталог разрядов и выровненные секции массивов в
+ * том виде, в каком они лежат в памяти. Снимок можно отобразить и читать на
+ * месте; порядок байт родной для машины, записавшей снимок. */
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    float    breadth;
+    float    depth;
+    uint32_t vote;
+    uint32_t digit_count;
+} KSigmaSnapHeader;
+
+typedef struct {
+    uint64_t total_count;
+    uint32_t token_count;
+    uint32_t tokens_off;
+    uint32_t index_cap;
+    uint32_t index_off;
+    uint32_t text_len;
+    uint32_t text_off;
+    uint32_t syll_count;
+    uint32_t syll_off; /* syll_count смещений строк в syll_text */
+    uint32_t syll_text_len;
+    uint32_t syll_text_off;
+} KSigmaSnapDigit;
+
+#define K_SIGMA_SNAP_ALIGN 8U
+#define K_SIGMA_SNAP_DATA (sizeof(KSigmaSnapHeader) + K_SIGMA_DIGITS * sizeof(KSigmaSnapDigit))
+
+static size_t sigma_snap_reserve(size_t *offset, size_t count, size_t size) {
+    size_t start = (*offset + K_SIGMA_SNAP_ALIGN - 1U) & ~(size_t)(K_SIGMA_SNAP_ALIGN - 1U);
+    *offset = start + count * size;
+    return start;
+}
+
+static int sigma_state_save_locked(const KSigmaState *state, uint8_t *out, size_t cap) {
+    KSigmaLimits limits = sigma_state_limits(state);
+    KSigmaSnapHeader header = {
+        .version = K_SIGMA_VERSION,
+        .breadth = limits.breadth,
+        .depth = limits.depth,
+        .vote = (uint32_t)limits.vote,
+        .digit_count = K_SIGMA_DIGITS,
+    };
+    memcpy(header.magic, K_SIGMA_MAGIC, 4U);
+
+    KSigmaSnapDigit dir[K_SIGMA_DIGITS];
+    memset(dir, 0, sizeof(dir));
+    size_t size = K_SIGMA_SNAP_DATA;
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        const KSigmaDigit *digit = &state->digits[i];
+        KSigmaSnapDigit *d = &dir[i];
+        size_t syll_text = 0U;
+        for (size_t s = 0; s < digit->syll_count; ++s) {
+            syll_text += strlen(digit->syllables[s]) + 1U;
+        }
+        d->total_count = digit->total_count;
+        d->token_count = (uint32_t)digit->token_count;
+        d->tokens_off = (uint32_t)sigma_snap_reserve(&size, digit->token_count, sizeof(KSigmaToken));
+        d->index_cap = (uint32_t)digit->index_cap;
+        d->index_off = (uint32_t)sigma_snap_reserve(&size, digit->index_cap, sizeof(uint32_t));
+        d->text_len = (uint32_t)digit->text_len;
+        d->text_off = (uint32_t)sigma_snap_reserve(&size, digit->text_len, 1U);
+        d->syll_count = (uint32_t)digit->syll_count;
+        d->syll_off = (uint32_t)sigma_snap_reserve(&size, digit->syll_count, sizeof(uint32_t));
+        d->syll_text_len = (uint32_t)syll_text;
+        d->syll_text_off = (uint32_t)sigma_snap_reserve(&size, syll_text, 1U);
+        if (size > INT_MAX) return -2;
+    }
+    if (size > cap) return -2;
+
+    memset(out, 0, size);
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), dir, sizeof(dir));
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        const KSigmaDigit *digit = &state->digits[i];
+        const KSigmaSnapDigit *d = &dir[i];
+        if (digit->token_count) memcpy(out + d->tokens_off, digit->tokens, digit->token_count * sizeof(KSigmaToken));
+        if (digit->index_cap) memcpy(out + d->index_off, digit->index, digit->index_cap * sizeof(uint32_t));
+        if (digit->text_len) memcpy(out + d->text_off, digit->text, digit->text_len);
+        uint32_t pos = 0U;
+        for (size_t s = 0; s < digit->syll_count; ++s) {
+            size_t len = strlen(digit->syllables[s]) + 1U;
+            memcpy(out + d->syll_off + s * sizeof(uint32_t), &pos, sizeof(pos));
+            memcpy(out + d->syll_text_off + pos, digit->syllables[s], len);
+            pos += (uint32_t)len;
+        }
+    }
+
+    if (cap > size) out[size] = 0U;
+    return (int)size;
+}
+
+int k_state_save(uintptr_t ptr, uint8_t *out, size_t cap) {
+    if (!ptr || !out || cap == 0U) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_rdlock(&state->lock);
+    int rc = sigma_state_save_locked(state, out, cap);
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
+}
+
+static bool sigma_snap_section(size_t n, uint32_t off, uint32_t count, size_t size) {
+    if (off % sizeof(uint32_t) != 0U || off > n) return false;
+    return (size_t)count <= (n - off) / size;
+}
+
+static bool sigma_snap_digit_valid(const uint8_t *in, size_t n, const KSigmaSnapDigit *d) {
+    if (!sigma_snap_section(n, d->tokens_off, d->token_count, sizeof(KSigmaToken)) ||
+        !sigma_snap_section(n, d->index_off, d->index_cap, sizeof(uint32_t)) ||
+        !sigma_snap_section(n, d->text_off, d->text_len, 1U) ||
+        !sigma_snap_section(n, d->syll_off, d->syll_count, sizeof(uint32_t)) ||
+        !sigma_snap_section(n, d->syll_text_off, d->syll_text_len, 1U)) {
+        return false;
+    }
+    const char *text = (const char *)in + d->text_off;
+    const KSigmaToken *tokens = (const KSigmaToken *)(const void *)(in + d->tokens_off);
+    for (uint32_t t = 0U; t < d->token_count; ++t) {
+        if (tokens[t].offset >= d->text_len || tokens[t].len >= d->text_len - tokens[t].offset) return false;
+        if (text[tokens[t].offset + tokens[t].len] != '\0') return false;
+    }
+    /* Пробирование в sigma_find_token должно натыкаться на пустую ячейку. */
+    if (d->index_cap & (d->index_cap - 1U)) return false;
+    if (d->token_count > 0U && d->index_cap <= d->token_count) return false;
+    const uint32_t *index = (const uint32_t *)(const void *)(in + d->index_off);
+    uint32_t used = 0U;
+    for (uint32_t i = 0U; i < d->index_cap; ++i) {
+        if (index[i] > d->token_count) return false;
+        if (index[i] != 0U) used++;
+    }
+    if (used > d->token_count) return false;
+    const char *syll_text = (const char *)in + d->syll_text_off;
+    if (d->syll_text_len > 0U && syll_text[d->syll_text_len - 1U] != '\0') return false;
+    for (uint32_t s = 0U; s < d->syll_count; ++s) {
+        uint32_t off = 0U;
+        memcpy(&off, in + d->syll_off + s * sizeof(uint32_t), sizeof(off));
+        if (off >= d->syll_text_len) return false;
+    }
+    return true;
+}
+
+/* Проверяет снимок v2 целиком и лишь затем подключает его секции к
+ * состоянию без копирования; буфер должен пережить состояние. */
+static int sigma_state_attach(KSigmaState *state, const uint8_t *in, size_t n) {
+    if (n < K_SIGMA_SNAP_DATA) return -2;
+    if ((uintptr_t)in % sizeof(uint32_t) != 0U) return -6;
+    KSigmaSnapHeader header;
+    KSigmaSnapDigit dir[K_SIGMA_DIGITS];
+    memcpy(&header, in, sizeof(header));
+    memcpy(dir, in + sizeof(header), sizeof(dir));
+    if (header.digit_count != K_SIGMA_DIGITS) return -2;
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        if (!sigma_snap_digit_valid(in, n, &dir[i])) return -2;
+    }
+
+    sigma_state_clear(state);
+    state->limits = (KSigmaLimits){ header.breadth, header.depth, (int)header.vote };
+    state->own_limits = true;
+
+    for (size_t i = 0; i < K_SIGMA_DIGITS; ++i) {
+        KSigmaDigit *digit = &state->digits[i];
+        const KSigmaSnapDigit *d = &dir[i];
+        digit->borrowed = true;
+        digit->tokens = d->token_count ? (KSigmaToken *)(uintptr_t)(in + d->tokens_off) : NULL;
+        digit->token_count = d->token_count;
+        digit->token_cap = d->token_count;
+        digit->index = d->index_cap ? (uint32_t *)(uintptr_t)(in + d->index_off) : NULL;
+        digit->index_cap = d->index_cap;
+        digit->text = d->text_len ? (char *)(uintptr_t)(in + d->text_off) : NULL;
+        digit->text_len = d->text_len;
+        digit->text_cap = d->text_len;
+        digit->ranked_stale = (1U << K_SIGMA_VOTE_MODES) - 1U;
+        digit->total_count = d->total_count;
+        if (d->syll_count == 0U) continue;
+        digit->syllables = malloc(d->syll_count * sizeof(char *));
+        if (!digit->syllables) return -5;
+        digit->syll_borrowed = true;
+        digit->syll_cap = d->syll_count;
+        for (uint32_t s = 0U; s < d->syll_count; ++s) {
+            uint32_t off = 0U;
+            memcpy(&off, in + d->syll_off + s * sizeof(uint32_t), sizeof(off));
+            digit->syllables[s] = (char *)(uintptr_t)(in + d->syll_text_off + off);
+        }
+        digit->syll_count = d->syll_count;
+    }
+    return 0;
+}
+
+static int sigma_snap_version(const uint8_t *in, size_t n, uint32_t *version) {
+    if (n < 8U) return -2;
+    if (memcmp(in, K_SIGMA_MAGIC, 4U) != 0) return -3;
+    memcpy(version, in + 4U, sizeof(*version));
+    if (*version != K_SIGMA_VERSION && *version != K_SIGMA_VERSION_LEGACY) return -4;
+    return 0;
+}
+
+static int sigma_state_load_locked(KSigmaState *state, const uint8_t *in, size_t n) {
+    uint32_t version = 0U;
+    int rc = sigma_snap_version(in, n, &version);
+    if (rc) return rc;
+    if (version == K_SIGMA_VERSION_LEGACY) return sigma_state_load_legacy(state, in, n);
+
+    /* Загрузка — то же подключение с немедленным копированием всех разрядов. */
+    uint8_t *aligned = NULL;
+    if ((uintptr_t)in % sizeof(uint32_t) != 0U) {
+        aligned = malloc(n);
+        if (!aligned) return -5;
+        memcpy(aligned, in, n);
+    }
+    rc = sigma_state_attach(state, aligned ? aligned : in, n);
+    for (size_t i = 0; rc == 0 && i < K_SIGMA_DIGITS; ++i) {
+        if (sigma_digit_own(state, &state->digits[i]) ||
+            sigma_digit_own_syllables(&state->digits[i])) {
+            rc = -5;
+        }
+    }
+    if (rc == -5) sigma_state_clear(state);
+    free(aligned);
+    return rc;
+}
+
+static int sigma_state_map_locked(KSigmaState *state, const uint8_t *in, size_t n) {
+    uint32_t version = 0U;
+    int rc = sigma_snap_version(in, n, &version);
+    if (rc) return rc;
+    if (version != K_SIGMA_VERSION) return -4;
+    rc = sigma_state_attach(state, in, n);
+    if (rc == -5) sigma_state_clear(state);
+    return rc;
+}
+
+int k_state_load(uintptr_t ptr, const uint8_t *in, size_t n) {
+    if (!ptr || !in || n < 4U) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    int rc = sigma_state_load_locked(state, in, n);
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
+}
+
+int k_state_map(uintptr_t ptr, const uint8_t *in, size_t n) {
+    if (!ptr || !in || n < 4U) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    int rc = sigma_state_map_locked(state, in, n);
+    pthread_rwlock_unlock(&state->lock);
+    return rc;
+}
+
+int k_state_map_file(uintptr_t ptr, const char *path) {
+    if (!ptr || !path) return -1;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -7;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)K_SIGMA_SNAP_DATA) {
+        close(fd);
+        return -7;
+    }
+    size_t size = (size_t)st.st_size;
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return -7;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    int rc = sigma_state_map_locked(state, mapped, size);
+    if (rc == 0) {
+        state->map_base = mapped;
+        state->map_len = size;
+    }
+    pthread_rwlock_unlock(&state->lock);
+    if (rc != 0) munmap(mapped, size);
+    return rc;
+}
+
+size_t k_state_memory_usage(uintptr_t ptr, size_t *out_mapped_bytes) {
+    if (out_mapped_bytes) *out_mapped_bytes = 0U;
+    if (!ptr) return 0U;
+    KSigmaState *state = (KSigmaState *)ptr;
+    size_t total = sizeof(*state);
+    pthread_rwlock_rdlock(&state->lock);
+    pthread_mutex_lock(&state->rank_lock);
+    for (size_t d = 0; d < K_SIGMA_DIGITS; ++d) {
+        const KSigmaDigit *digit = &state->digits[d];
+        if (!digit->borrowed) {
+            total += digit->token_cap * sizeof(KSigmaToken);
+            total += digit->index_cap * sizeof(uint32_t);
+            total += digit->text_cap;
+        }
+        for (size_t m = 0; m < K_SIGMA_VOTE_MODES; ++m) {
+            if (digit->ranked[m]) total += digit->token_cap * sizeof(KSigmaRank);
+        }
+        total += digit->syll_cap * sizeof(char *);
+        if (!digit->syll_borrowed) {
+            for (size_t i = 0; i < digit->syll_count; ++i) {
+                total += strlen(digit->syllables[i]) + 1U;
+            }
+        }
+    }
+    if (out_mapped_bytes) *out_mapped_bytes = state->map_len;
+    pthread_mutex_unlock(&state->rank_lock);
+    pthread_rwlock_unlock(&state->lock);
+    return total;
+}
+
 int k_profile(uintptr_t ptr, uint32_t what, uint8_t *out, size_t cap) {
     if (!ptr || !out || cap == 0U) return -1;
     KSigmaState *state = (KSigmaState *)ptr;
-    sigma_state_reset_limits(state);
     if (what != K_SIGMA_PROFILE_DIGITS) return -2;
     size_t written = 0U;
+    pthread_rwlock_rdlock(&state->lock);
+    KSigmaLimits limits = sigma_state_limits(state);
     int rc = snprintf((char *)out, cap,
                       "{\"digits\":[%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu],\"breadth\":%.3f,\"depth\":%.3f,\"mode\":%d}",
                       state->digits[0].token_count,
@@ -565,9 +1041,10 @@ int k_profile(uintptr_t ptr, uint32_t what, uint8_t *out, size_t cap) {
                       state->digits[7].token_count,
                       state->digits[8].token_count,
                       state->digits[9].token_count,
-                      state->breadth_limit,
-                      state->depth_limit,
-                      state->vote_mode);
+                      limits.breadth,
+                      limits.depth,
+                      limits.vote);
+    pthread_rwlock_unlock(&state->lock);
     if (rc < 0 || (size_t)rc >= cap) return -3;
     written = (size_t)rc;
     if (written < cap) out[written] = '\0';
@@ -576,15 +1053,42 @@ int k_profile(uintptr_t ptr, uint32_t what, uint8_t *out, size_t cap) {
 
 int k_set_constraints(float breadth, float depth) {
     if (breadth <= 0.0f || depth <= 0.0f) return -1;
-    g_default_breadth = breadth;
-    g_default_depth = depth;
+    pthread_mutex_lock(&g_default_lock);
+    g_defaults.breadth = breadth;
+    g_defaults.depth = depth;
+    pthread_mutex_unlock(&g_default_lock);
     return 0;
 }
 
 int k_vote_mode(int mode) {
-    int prev = g_default_vote;
-    if (mode == K_SIGMA_VOTE_GREEDY || mode == K_SIGMA_VOTE_RESONANT || mode == K_SIGMA_VOTE_COUNTERFACTUAL) {
-        g_default_vote = mode;
-    }
+    pthread_mutex_lock(&g_default_lock);
+    int prev = g_defaults.vote;
+    if (sigma_vote_valid(mode)) g_defaults.vote = mode;
+    pthread_mutex_unlock(&g_default_lock);
+    return prev;
+}
+
+/* Первая собственная настройка отвязывает состояние от умолчаний процесса. */
+int k_state_set_constraints(uintptr_t ptr, float breadth, float depth) {
+    if (!ptr || breadth <= 0.0f || depth <= 0.0f) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    state->limits = sigma_state_limits(state);
+    state->limits.breadth = breadth;
+    state->limits.depth = depth;
+    state->own_limits = true;
+    pthread_rwlock_unlock(&state->lock);
+    return 0;
+}
+
+int k_state_vote_mode(uintptr_t ptr, int mode) {
+    if (!ptr) return -1;
+    KSigmaState *state = (KSigmaState *)ptr;
+    pthread_rwlock_wrlock(&state->lock);
+    state->limits = sigma_state_limits(state);
+    int prev = state->limits.vote;
+    if (sigma_vote_valid(mode)) state->limits.vote = mode;
+    state->own_limits = true;
+    pthread_rwlock_unlock(&state->lock);
     return prev;
 }
@@ -11,10 +11,22 @@
 
 #define KOLIBRI_SIM_LOG_CAPACITY 512
 #define KOLIBRI_SIM_POP_SIZE 24
+#define KOLIBRI_SIM_LOG_MESSAGE 128
 
+/* Типы журнала интернированы: запись хранит номер, а не копию строки. */
+static const char *const kolibri_sim_log_tips[] = {"init", "reset", "pool", "best"};
+
+enum {
+    KOLIBRI_SIM_LOG_INIT,
+    KOLIBRI_SIM_LOG_RESET,
+    KOLIBRI_SIM_LOG_POOL,
+    KOLIBRI_SIM_LOG_BEST,
+};
+
+/* Запись кольца фиксированного размера: push ничего не выделяет. */
 typedef struct {
-    char *tip;
-    char *soobshenie;
+    unsigned char tip;
+    char soobshenie[KOLIBRI_SIM_LOG_MESSAGE];
     double metka;
 } LogItem;
 
@@ -28,52 +40,37 @@ struct KolibriSim {
     size_t log_offset;
 };
 
-static void log_item_free(LogItem *item) {
-    free(item->tip);
-    free(item->soobshenie);
-    item->tip = NULL;
-    item->soobshenie = NULL;
-}
-
-static char *kolibri_sim_strdup(const char *text) {
-    if (!text) {
-        return NULL;
-    }
-    size_t len = strlen(text);
-    char *copy = (char *)malloc(len + 1U);
-    if (!copy) {
-        return NULL;
-    }
-    memcpy(copy, text, len + 1U);
-    return copy;
-}
-
-static void log_push(KolibriSim *sim, const char *tip, const char *message) {
+static void log_push_at(KolibriSim *sim, unsigned char tip, const char *message, double metka) {
     size_t index = (sim->log_head + sim->log_count) % KOLIBRI_SIM_LOG_CAPACITY;
     if (sim->log_count == KOLIBRI_SIM_LOG_CAPACITY) {
-        log_item_free(&sim->logs[sim->log_head]);
         sim->log_head = (sim->log_head + 1U) % KOLIBRI_SIM_LOG_CAPACITY;
         sim->log_offset += 1U;
         sim->log_count -= 1U;
     }
     LogItem *item = &sim->logs[index];
-    item->tip = kolibri_sim_strdup(tip);
-    item->soobshenie = kolibri_sim_strdup(message);
-    item->metka = (double)time(NULL);
+    item->tip = tip;
+    snprintf(item->soobshenie, sizeof(item->soobshenie), "%s", message);
+    item->metka = metka;
     sim->log_count += 1U;
 }
 
+static void log_push(KolibriSim *sim, unsigned char tip, const char *message) {
+    log_push_at(sim, tip, message, (double)time(NULL));
+}
+
 static void sim_reset_logs(KolibriSim *sim) {
-    for (size_t i = 0; i < sim->log_count; ++i) {
-        size_t index = (sim->log_head + i) % KOLIBRI_SIM_LOG_CAPACITY;
-        log_item_free(&sim->logs[index]);
-    }
     sim->log_head = 0U;
     sim->log_count = 0U;
     sim->log_offset = 0U;
 }
 
-static void sim_init_pool(KolibriSim *sim) {
+/* Возвращает 1, если пул поднят из контрольной точки конфигурации. */
+static int sim_init_pool(KolibriSim *sim) {
+    kf_pool_destroy(&sim->pool);
+    if (sim->config.pool_checkpoint_path &&
+        kf_pool_load_checkpoint(&sim->pool, sim->config.pool_checkpoint_path) == 0) {
+        return 1;
+    }
     kf_pool_init(&sim->pool, (uint64_t)sim->config.seed);
     kf_pool_clear_examples(&sim->pool);
     const int inputs[] = {0, 1, 2, 3};
@@ -81,6 +78,7 @@ static void sim_init_pool(KolibriSim *sim) {
     for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
         kf_pool_add_example(&sim->pool, inputs[i], targets[i]);
     }
+    return 0;
 }
 
 static KolibriSim *kolibri_sim_alloc(void) {
@@ -93,6 +91,7 @@ static void kolibri_sim_free(KolibriSim *sim) {
         return;
     }
     sim_reset_logs(sim);
+    kf_pool_destroy(&sim->pool);
     free(sim);
 }
 
@@ -106,8 +105,11 @@ KolibriSim *kolibri_sim_create(const KolibriSimConfig *config) {
     }
     sim->config = *config;
     k_rng_seed(&sim->rng, (uint64_t)config->seed);
-    sim_init_pool(sim);
-    log_push(sim, "init", "KolibriSim initialized");
+    int restored = sim_init_pool(sim);
+    log_push(sim, KOLIBRI_SIM_LOG_INIT, "KolibriSim initialized");
+    if (restored) {
+        log_push(sim, KOLIBRI_SIM_LOG_POOL, "pool restored from checkpoint");
+    }
     return sim;
 }
 
@@ -122,24 +124,65 @@ int kolibri_sim_reset(KolibriSim *sim, const KolibriSimConfig *config) {
     sim_reset_logs(sim);
     sim->config = *config;
     k_rng_seed(&sim->rng, (uint64_t)config->seed);
-    sim_init_pool(sim);
-    log_push(sim, "reset", "KolibriSim reset");
+    int restored = sim_init_pool(sim);
+    log_push(sim, KOLIBRI_SIM_LOG_RESET, "KolibriSim reset");
+    if (restored) {
+        log_push(sim, KOLIBRI_SIM_LOG_POOL, "pool restored from checkpoint");
+    }
     return 0;
 }
 
-int kolibri_sim_tick(KolibriSim *sim) {
+int kolibri_sim_save_pool(KolibriSim *sim, const char *path) {
     if (!sim) {
         return -1;
     }
-    kf_pool_tick(&sim->pool, KOLIBRI_SIM_POP_SIZE);
+    if (!path) {
+        path = sim->config.pool_checkpoint_path;
+    }
+    return path ? kf_pool_save_checkpoint(&sim->pool, path) : -1;
+}
+
+int kolibri_sim_configure_pool(KolibriSim *sim, const KolibriSimPoolParams *params) {
+    if (!sim || !params) {
+        return -1;
+    }
+    kf_pool_set_penalties(&sim->pool, params->lambda_b, params->lambda_d);
+    kf_pool_set_sampling(&sim->pool, params->temperature, params->top_k);
+    return 0;
+}
+
+static void sim_log_best(KolibriSim *sim, double metka) {
     const KolibriFormula *best = kf_pool_best(&sim->pool);
     if (!best) {
-        log_push(sim, "pool", "empty");
-        return 0;
+        log_push_at(sim, KOLIBRI_SIM_LOG_POOL, "empty", metka);
+        return;
     }
-    char description[128];
+    char description[KOLIBRI_SIM_LOG_MESSAGE];
     if (kf_formula_describe(best, description, sizeof(description)) == 0) {
-        log_push(sim, "best", description);
+        log_push_at(sim, KOLIBRI_SIM_LOG_BEST, description, metka);
+    }
+}
+
+int kolibri_sim_tick(KolibriSim *sim) {
+    if (!sim) {
+        return -1;
+    }
+    kf_pool_tick(&sim->pool, KOLIBRI_SIM_POP_SIZE);
+    sim_log_best(sim, (double)time(NULL));
+    return 0;
+}
+
+int kolibri_sim_tick_n(KolibriSim *sim, size_t ticks, size_t log_every) {
+    if (!sim) {
+        return -1;
+    }
+    /* Метка времени одна на пакет: тики внутри него не различимы по секундам. */
+    double metka = (double)time(NULL);
+    for (size_t i = 1; i <= ticks; ++i) {
+        kf_pool_tick(&sim->pool, KOLIBRI_SIM_POP_SIZE);
+        if (i == ticks || (log_every != 0U && i % log_every == 0U)) {
+            sim_log_best(sim, metka);
+        }
     }
     return 0;
 }
@@ -155,7 +198,7 @@ int kolibri_sim_get_logs(KolibriSim *sim,
     size_t count = sim->log_count < capacity ? sim->log_count : capacity;
     for (size_t i = 0; i < count; ++i) {
         size_t index = (sim->log_head + i) % KOLIBRI_SIM_LOG_CAPACITY;
-        buffer[i].tip = sim->logs[index].tip;
+        buffer[i].tip = kolibri_sim_log_tips[sim->logs[index].tip];
         buffer[i].soobshenie = sim->logs[index].soobshenie;
         buffer[i].metka = sim->logs[index].metka;
     }
@@ -176,8 +219,11 @@ int kolibri_sim_get_formulas(KolibriSim *sim,
         count = capacity;
     }
     for (size_t i = 0; i < count; ++i) {
-        KolibriFormula *formula = &sim->pool.formulas[i];
-        buffer[i].fitness = formula->fitness;
+        KolibriFormula formula;
+        if (kf_pool_formula(&sim->pool, i, &formula) != 0) {
+            return -1;
+        }
+        buffer[i].fitness = formula.fitness;
         buffer[i].context = NULL;
         buffer[i].parents = NULL;
         buffer[i].kod = NULL;
@@ -1,4 +1,5 @@
 #include "kolibri/swarm.h"
+#include "kolibri/trace.h"
 
 #include <ctype.h>
 #include <math.h>
@@ -67,18 +68,146 @@ static void compute_signature(const char *text, double signature[KOLIBRI_SWARM_D
     compute_signature_from_seed(seed, signature);
 }
 
-static KolibriSwarmNode *find_node(KolibriSwarm *swarm, const char *node_id) {
-    if (!swarm || !node_id) {
-        return NULL;
+/* Хэш id по тем же KOLIBRI_SWARM_ID_MAX - 1 байтам, что хранятся в узле. */
+static uint64_t swarm_hash_id(const char *id) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i + 1U < KOLIBRI_SWARM_ID_MAX && id[i]; ++i) {
+        hash ^= (uint64_t)(unsigned char)id[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void index_insert(KolibriSwarm *swarm, size_t position) {
+    size_t slot = (size_t)swarm_hash_id(swarm->nodes[position].id) & swarm->index_mask;
+    while (swarm->index[slot] != 0U) {
+        slot = (slot + 1U) & swarm->index_mask;
+    }
+    swarm->index[slot] = (uint32_t)(position + 1U);
+}
+
+/* Держит заполнение индекса не выше половины. */
+static int index_reserve(KolibriSwarm *swarm, size_t count) {
+    size_t slots = swarm->index ? swarm->index_mask + 1U : 0U;
+    if (slots >= count * 2U && slots > 0U) {
+        return 0;
     }
+    size_t wanted = 16U;
+    while (wanted < count * 2U) {
+        wanted *= 2U;
+    }
+    uint32_t *index = (uint32_t *)calloc(wanted, sizeof(uint32_t));
+    if (!index) {
+        return -1;
+    }
+    free(swarm->index);
+    swarm->index = index;
+    swarm->index_mask = wanted - 1U;
     for (size_t i = 0; i < swarm->node_count; ++i) {
-        if (strncmp(swarm->nodes[i].id, node_id, KOLIBRI_SWARM_ID_MAX) == 0) {
-            return &swarm->nodes[i];
+        index_insert(swarm, i);
+    }
+    return 0;
+}
+
+static KolibriSwarmNode *find_node(const KolibriSwarm *swarm, const char *node_id) {
+    if (!swarm || !node_id || !swarm->index) {
+        return NULL;
+    }
+    size_t slot = (size_t)swarm_hash_id(node_id) & swarm->index_mask;
+    while (swarm->index[slot] != 0U) {
+        KolibriSwarmNode *node = &swarm->nodes[swarm->index[slot] - 1U];
+        if (strncmp(node->id, node_id, KOLIBRI_SWARM_ID_MAX - 1U) == 0) {
+            return node;
         }
+        slot = (slot + 1U) & swarm->index_mask;
     }
     return NULL;
 }
 
+static double base_score(const KolibriSwarm *swarm, const KolibriSwarmNode *node) {
+    double alignment = 0.0;
+    for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+        alignment += node->signature[j] * swarm->signature[j];
+    }
+    return alignment * 0.55 + node->energy * 0.25;
+}
+
+static double heap_score(const KolibriSwarm *swarm, size_t position) {
+    return swarm->nodes[swarm->heap[position]].score;
+}
+
+static void heap_swap(KolibriSwarm *swarm, size_t a, size_t b) {
+    size_t node = swarm->heap[a];
+    swarm->heap[a] = swarm->heap[b];
+    swarm->heap[b] = node;
+    swarm->heap_slot[swarm->heap[a]] = a;
+    swarm->heap_slot[swarm->heap[b]] = b;
+}
+
+static void heap_sift_up(KolibriSwarm *swarm, size_t position) {
+    while (position > 0U) {
+        size_t parent = (position - 1U) / 2U;
+        if (heap_score(swarm, parent) >= heap_score(swarm, position)) {
+            break;
+        }
+        heap_swap(swarm, parent, position);
+        position = parent;
+    }
+}
+
+static void heap_sift_down(KolibriSwarm *swarm, size_t position) {
+    for (;;) {
+        size_t left = position * 2U + 1U;
+        size_t best = position;
+        if (left < swarm->node_count && heap_score(swarm, left) > heap_score(swarm, best)) {
+            best = left;
+        }
+        if (left + 1U < swarm->node_count && heap_score(swarm, left + 1U) > heap_score(swarm, best)) {
+            best = left + 1U;
+        }
+        if (best == position) {
+            return;
+        }
+        heap_swap(swarm, position, best);
+        position = best;
+    }
+}
+
+/* Пересчитывает оценку одного узла и восстанавливает пирамиду: O(log n). */
+static void refresh_node(KolibriSwarm *swarm, KolibriSwarmNode *node) {
+    size_t position = (size_t)(node - swarm->nodes);
+    node->score = base_score(swarm, node);
+    size_t slot = swarm->heap_slot[position];
+    heap_sift_up(swarm, slot);
+    heap_sift_down(swarm, swarm->heap_slot[position]);
+}
+
+static int reserve_nodes(KolibriSwarm *swarm, size_t capacity) {
+    if (capacity <= swarm->node_capacity && swarm->nodes) {
+        return 0;
+    }
+    KolibriSwarmNode *nodes = (KolibriSwarmNode *)realloc(swarm->nodes, capacity * sizeof(KolibriSwarmNode));
+    if (!nodes) {
+        return -1;
+    }
+    swarm->nodes = nodes;
+    for (size_t i = swarm->node_capacity; i < capacity; ++i) {
+        memset(&nodes[i], 0, sizeof(KolibriSwarmNode));
+    }
+    size_t *heap = (size_t *)realloc(swarm->heap, capacity * sizeof(size_t));
+    if (!heap) {
+        return -1;
+    }
+    swarm->heap = heap;
+    size_t *heap_slot = (size_t *)realloc(swarm->heap_slot, capacity * sizeof(size_t));
+    if (!heap_slot) {
+        return -1;
+    }
+    swarm->heap_slot = heap_slot;
+    swarm->node_capacity = capacity;
+    return 0;
+}
+
 int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_capacity) {
     if (!swarm) {
         return -1;
@@ -97,12 +226,17 @@ int kolibri_swarm_init(KolibriSwarm *swarm, const char *self_id, size_t initial_
     if (initial_capacity == 0U) {
         initial_capacity = 4U;
     }
-    swarm->nodes = (KolibriSwarmNode *)calloc(initial_capacity, sizeof(KolibriSwarmNode));
-    if (!swarm->nodes) {
+    if (reserve_nodes(swarm, initial_capacity) != 0 ||
+        index_reserve(swarm, initial_capacity) != 0) {
+        free(swarm->nodes);
+        free(swarm->heap);
+        free(swarm->heap_slot);
+        free(swarm->index);
+        memset(swarm, 0, sizeof(*swarm));
         return -1;
     }
-    swarm->node_capacity = initial_capacity;
     swarm->node_count = 0U;
+    pthread_rwlock_init(&swarm->lock, NULL);
     return 0;
 }
 
@@ -110,8 +244,18 @@ void kolibri_swarm_free(KolibriSwarm *swarm) {
     if (!swarm) {
         return;
     }
+    if (swarm->nodes) {
+        pthread_rwlock_destroy(&swarm->lock);
+    }
     free(swarm->nodes);
     swarm->nodes = NULL;
+    free(swarm->heap);
+    swarm->heap = NULL;
+    free(swarm->heap_slot);
+    swarm->heap_slot = NULL;
+    free(swarm->index);
+    swarm->index = NULL;
+    swarm->index_mask = 0U;
     swarm->node_capacity = 0U;
     swarm->node_count = 0U;
     swarm->self_id[0] = '\0';
@@ -124,28 +268,28 @@ void kolibri_swarm_free(KolibriSwarm *swarm) {
 }
 
 int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char *endpoint) {
-    if (!swarm || !node_id || !endpoint || *endpoint == '\0') {
+    if (!swarm || !node_id || !endpoint || *endpoint == '\0' || !swarm->nodes) {
         return -1;
     }
+    pthread_rwlock_wrlock(&swarm->lock);
     KolibriSwarmNode *existing = find_node(swarm, node_id);
     if (existing) {
         strncpy(existing->endpoint, endpoint, sizeof(existing->endpoint) - 1U);
         existing->endpoint[sizeof(existing->endpoint) - 1U] = '\0';
+        pthread_rwlock_unlock(&swarm->lock);
         return 0;
     }
-    if (swarm->node_count >= swarm->node_capacity) {
-        size_t new_capacity = swarm->node_capacity ? swarm->node_capacity * 2U : 4U;
-        KolibriSwarmNode *resized = (KolibriSwarmNode *)realloc(swarm->nodes, new_capacity * sizeof(KolibriSwarmNode));
-        if (!resized) {
-            return -1;
-        }
-        for (size_t i = swarm->node_capacity; i < new_capacity; ++i) {
-            memset(&resized[i], 0, sizeof(KolibriSwarmNode));
-        }
-        swarm->nodes = resized;
-        swarm->node_capacity = new_capacity;
+    if (swarm->node_count >= swarm->node_capacity &&
+        reserve_nodes(swarm, swarm->node_capacity ? swarm->node_capacity * 2U : 4U) != 0) {
+        pthread_rwlock_unlock(&swarm->lock);
+        return -1;
+    }
+    if (index_reserve(swarm, swarm->node_count + 1U) != 0) {
+        pthread_rwlock_unlock(&swarm->lock);
+        return -1;
     }
-    KolibriSwarmNode *node = &swarm->nodes[swarm->node_count++];
+    size_t position = swarm->node_count++;
+    KolibriSwarmNode *node = &swarm->nodes[position];
     memset(node, 0, sizeof(*node));
     strncpy(node->id, node_id, sizeof(node->id) - 1U);
     node->id[sizeof(node->id) - 1U] = '\0';
@@ -155,6 +299,11 @@ int kolibri_swarm_add_node(KolibriSwarm *swarm, const char *node_id, const char
     node->exchange_count = 0U;
     node->last_activity = 0;
     compute_signature(node->id[0] ? node->id : node->endpoint, node->signature);
+    index_insert(swarm, position);
+    swarm->heap[position] = position;
+    swarm->heap_slot[position] = position;
+    refresh_node(swarm, node);
+    pthread_rwlock_unlock(&swarm->lock);
     return 0;
 }
 
@@ -170,9 +319,10 @@ static void update_signature_with_pulse(double signature[KOLIBRI_SWARM_DIGITS],
 }
 
 void kolibri_swarm_record_local_activity(KolibriSwarm *swarm, const char *stimulus, double impact) {
-    if (!swarm) {
+    if (!swarm || !swarm->nodes) {
         return;
     }
+    pthread_rwlock_wrlock(&swarm->lock);
     double pulse[KOLIBRI_SWARM_DIGITS];
     if (stimulus && *stimulus) {
         compute_signature(stimulus, pulse);
@@ -184,14 +334,27 @@ void kolibri_swarm_record_local_activity(KolibriSwarm *swarm, const char *stimul
     swarm->self_energy = clamp_unit(swarm->self_energy * 0.96 + 0.5 * 0.04 + impact * 0.04);
     swarm->fractal_seed += (uint64_t)(fabs(impact) * 997.0) + 1U;
     swarm->last_local_update = time(NULL);
+    /* Согласие зависит от собственной сигнатуры, так что пересчитываются все
+     * оценки; пирамида строится заново за O(n). */
+    for (size_t i = 0; i < swarm->node_count; ++i) {
+        swarm->nodes[i].score = base_score(swarm, &swarm->nodes[i]);
+    }
+    for (size_t i = swarm->node_count / 2U; i-- > 0U;) {
+        heap_sift_down(swarm, i);
+    }
+    pthread_rwlock_unlock(&swarm->lock);
 }
 
 void kolibri_swarm_record_peer_activity(KolibriSwarm *swarm, const char *node_id, double impact, const char *stimulus) {
-    if (!swarm || !node_id) {
+    if (!swarm || !node_id || !swarm->nodes) {
         return;
     }
+    KOLIBRI_TRACE_BEGIN(span, "swarm.peer_activity");
+    pthread_rwlock_wrlock(&swarm->lock);
     KolibriSwarmNode *node = find_node(swarm, node_id);
     if (!node) {
+        pthread_rwlock_unlock(&swarm->lock);
+        KOLIBRI_TRACE_END(span);
         return;
     }
     double pulse[KOLIBRI_SWARM_DIGITS];
@@ -207,10 +370,21 @@ void kolibri_swarm_record_peer_activity(KolibriSwarm *swarm, const char *node_id
     if (node->exchange_count < UINT64_MAX) {
         node->exchange_count += 1U;
     }
+    refresh_node(swarm, node);
+    pthread_rwlock_unlock(&swarm->lock);
+    KOLIBRI_TRACE_END(span);
 }
 
 const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, double exploration_bias) {
-    if (!swarm || swarm->node_count == 0U) {
+    if (!swarm || !swarm->nodes) {
+        return NULL;
+    }
+    pthread_rwlock_t *lock = (pthread_rwlock_t *)&swarm->lock;
+    KOLIBRI_TRACE_BEGIN(span, "swarm.select_peer");
+    pthread_rwlock_rdlock(lock);
+    if (swarm->node_count == 0U) {
+        pthread_rwlock_unlock(lock);
+        KOLIBRI_TRACE_END(span);
         return NULL;
     }
     double exploration[KOLIBRI_SWARM_DIGITS];
@@ -219,12 +393,29 @@ const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, dou
     const KolibriSwarmNode *best = NULL;
     double best_score = -1e12;
     time_t now = time(NULL);
-    for (size_t i = 0; i < swarm->node_count; ++i) {
-        const KolibriSwarmNode *node = &swarm->nodes[i];
-        double alignment = 0.0;
+    /* Лидеры пирамиды извлекаются без её изменения: фронт хранит позиции,
+     * чьи родители уже взяты. */
+    size_t frontier[KOLIBRI_SWARM_TOP_K * 2 + 1];
+    size_t frontier_count = 1U;
+    frontier[0] = 0U;
+    for (size_t taken = 0; taken < KOLIBRI_SWARM_TOP_K && frontier_count > 0U; ++taken) {
+        size_t pick = 0U;
+        for (size_t f = 1U; f < frontier_count; ++f) {
+            if (heap_score(swarm, frontier[f]) > heap_score(swarm, frontier[pick])) {
+                pick = f;
+            }
+        }
+        size_t position = frontier[pick];
+        frontier[pick] = frontier[--frontier_count];
+        for (size_t child = position * 2U + 1U; child <= position * 2U + 2U; ++child) {
+            if (child < swarm->node_count) {
+                frontier[frontier_count++] = child;
+            }
+        }
+
+        const KolibriSwarmNode *node = &swarm->nodes[swarm->heap[position]];
         double fractal = 0.0;
         for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
-            alignment += node->signature[j] * swarm->signature[j];
             fractal += exploration[j] * node->signature[j];
         }
         double recency = 1.0;
@@ -232,7 +423,7 @@ const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, dou
             double delta = difftime(now, node->last_activity);
             recency = 1.0 / (1.0 + delta / 120.0);
         }
-        double score = alignment * 0.55 + node->energy * 0.25 + fractal * 0.15 + recency * 0.05;
+        double score = node->score + fractal * 0.15 + recency * 0.05;
         if (exploration_bias > 0.5) {
             score += exploration_bias * fractal * 0.05;
         }
@@ -241,6 +432,8 @@ const KolibriSwarmNode *kolibri_swarm_select_peer(const KolibriSwarm *swarm, dou
             best_score = score;
         }
     }
+    pthread_rwlock_unlock(lock);
+    KOLIBRI_TRACE_END(span);
     return best;
 }
 
@@ -277,10 +470,7 @@ static void escape_json_string(const char *input, char *output, size_t output_si
     output[index] = '\0';
 }
 
-int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size) {
-    if (!swarm || !buffer || buffer_size == 0U) {
-        return -1;
-    }
+static int format_status_locked(const KolibriSwarm *swarm, char *buffer, size_t buffer_size) {
     buffer[0] = '\0';
     char escaped_id[KOLIBRI_SWARM_ID_MAX * 2];
     escape_json_string(swarm->self_id, escaped_id, sizeof(escaped_id));
@@ -362,3 +552,14 @@ int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t
     }
     return 0;
 }
+
+int kolibri_swarm_format_status(const KolibriSwarm *swarm, char *buffer, size_t buffer_size) {
+    if (!swarm || !buffer || buffer_size == 0U || !swarm->nodes) {
+        return -1;
+    }
+    pthread_rwlock_t *lock = (pthread_rwlock_t *)&swarm->lock;
+    pthread_rwlock_rdlock(lock);
+    int rc = format_status_locked(swarm, buffer, buffer_size);
+    pthread_rwlock_unlock(lock);
+    return rc;
+}
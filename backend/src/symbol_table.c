@@ -7,15 +7,37 @@
 static void kolibri_symbol_table_next_digits(KolibriSymbolTable *table,
                                              uint8_t out_digits[KOLIBRI_SYMBOL_DIGITS]);
 
+static size_t kolibri_symbol_hash(uint32_t codepoint) {
+    return (size_t)((codepoint * 2654435761U) >> 23) & (KOLIBRI_SYMBOL_HASH_SIZE - 1U);
+}
+
+static int kolibri_symbol_digits_code(const uint8_t digits[KOLIBRI_SYMBOL_DIGITS]) {
+    if (digits[0] > 9U || digits[1] > 9U || digits[2] > 9U) {
+        return -1;
+    }
+    return (int)digits[0] * 100 + (int)digits[1] * 10 + (int)digits[2];
+}
+
+/* ASCII берётся из прямой таблицы, остальные точки — из хеша с линейным
+ * пробированием; записей не больше KOLIBRI_SYMBOL_MAX, хеш вдвое шире. */
 static int kolibri_symbol_table_find(const KolibriSymbolTable *table,
                                      uint32_t codepoint) {
     if (!table) {
         return -1;
     }
-    for (size_t i = 0; i < table->count; ++i) {
-        if (table->entries[i].codepoint == codepoint) {
-            return (int)i;
+    if (codepoint < KOLIBRI_SYMBOL_ASCII) {
+        return (int)table->ascii_index[codepoint] - 1;
+    }
+    size_t slot = kolibri_symbol_hash(codepoint);
+    for (size_t probe = 0; probe < KOLIBRI_SYMBOL_HASH_SIZE; ++probe) {
+        uint16_t index = table->hash_index[slot];
+        if (index == 0U) {
+            return -1;
+        }
+        if (table->entries[index - 1U].codepoint == codepoint) {
+            return (int)index - 1;
         }
+        slot = (slot + 1U) & (KOLIBRI_SYMBOL_HASH_SIZE - 1U);
     }
     return -1;
 }
@@ -25,30 +47,30 @@ static int kolibri_symbol_table_find_digits(const KolibriSymbolTable *table,
     if (!table || !digits) {
         return -1;
     }
-    for (size_t i = 0; i < table->count; ++i) {
-        if (memcmp(table->entries[i].digits, digits, KOLIBRI_SYMBOL_DIGITS) == 0) {
-            return (int)i;
-        }
+    int code = kolibri_symbol_digits_code(digits);
+    if (code < 0) {
+        return -1;
     }
-    return -1;
+    return (int)table->digits_index[code] - 1;
 }
 
-static uint64_t decode_u64_be_symbol(const unsigned char *data) {
-    uint64_t value = 0;
-    for (int i = 0; i < 8; ++i) {
-        value = (value << 8) | (uint64_t)data[i];
+static void kolibri_symbol_table_index(KolibriSymbolTable *table, size_t index) {
+    const KolibriSymbolEntry *entry = &table->entries[index];
+    uint16_t stored = (uint16_t)(index + 1U);
+    if (entry->codepoint < KOLIBRI_SYMBOL_ASCII) {
+        table->ascii_index[entry->codepoint] = stored;
+    } else {
+        size_t slot = kolibri_symbol_hash(entry->codepoint);
+        while (table->hash_index[slot] != 0U) {
+            slot = (slot + 1U) & (KOLIBRI_SYMBOL_HASH_SIZE - 1U);
+        }
+        table->hash_index[slot] = stored;
+    }
+    /* При повторе цифр декодер, как и прежде, видит первую запись. */
+    int code = kolibri_symbol_digits_code(entry->digits);
+    if (code >= 0 && table->digits_index[code] == 0U) {
+        table->digits_index[code] = stored;
     }
-    return value;
-}
-
-static void symbol_deserialize(const unsigned char *bytes, ReasonBlock *block) {
-    memset(block, 0, sizeof(*block));
-    block->index = decode_u64_be_symbol(bytes);
-    block->timestamp = decode_u64_be_symbol(bytes + 8);
-    memcpy(block->prev_hash, bytes + 16, KOLIBRI_HASH_SIZE);
-    memcpy(block->hmac, bytes + 16 + KOLIBRI_HASH_SIZE, KOLIBRI_HASH_SIZE);
-    memcpy(block->event_type, bytes + 16 + KOLIBRI_HASH_SIZE * 2, KOLIBRI_EVENT_TYPE_SIZE);
-    memcpy(block->payload, bytes + 16 + KOLIBRI_HASH_SIZE * 2 + KOLIBRI_EVENT_TYPE_SIZE, KOLIBRI_PAYLOAD_SIZE);
 }
 
 static void kolibri_symbol_table_log_add(KolibriSymbolTable *table,
@@ -79,9 +101,11 @@ static void kolibri_symbol_table_add_entry(KolibriSymbolTable *table,
     if (!table || table->count >= KOLIBRI_SYMBOL_MAX) {
         return;
     }
-    KolibriSymbolEntry *entry = &table->entries[table->count++];
+    KolibriSymbolEntry *entry = &table->entries[table->count];
     entry->codepoint = codepoint;
     memcpy(entry->digits, digits, KOLIBRI_SYMBOL_DIGITS);
+    kolibri_symbol_table_index(table, table->count);
+    table->count += 1U;
     table->version += 1U;
     if (log_event) {
         kolibri_symbol_table_log_add(table, codepoint, digits);
@@ -112,18 +136,13 @@ void kolibri_symbol_table_load(KolibriSymbolTable *table) {
     if (!table || !table->genome || !table->genome->file) {
         return;
     }
-    KolibriGenome *ctx = table->genome;
-    long original_pos = ftell(ctx->file);
-    if (original_pos < 0) {
-        original_pos = 0;
-    }
-    if (fseek(ctx->file, 0, SEEK_SET) != 0) {
+    /* Читаем файл отдельно от дескриптора генома: формат может быть любым. */
+    KolibriGenomeReader reader;
+    if (kg_reader_open(&reader, table->genome->path) != 0) {
         return;
     }
-    unsigned char bytes[KOLIBRI_BLOCK_SIZE];
-    while (fread(bytes, 1, KOLIBRI_BLOCK_SIZE, ctx->file) == KOLIBRI_BLOCK_SIZE) {
-        ReasonBlock block;
-        symbol_deserialize(bytes, &block);
+    ReasonBlock block;
+    while (kg_reader_next(&reader, &block) == 1) {
         if (strncmp(block.event_type, "SYMBOL_MAP", KOLIBRI_EVENT_TYPE_SIZE) != 0) {
             continue;
         }
@@ -174,7 +193,7 @@ void kolibri_symbol_table_load(KolibriSymbolTable *table) {
         }
         kolibri_symbol_table_add_entry(table, codepoint, digits, 0);
     }
-    fseek(ctx->file, original_pos, SEEK_SET);
+    kg_reader_close(&reader);
 }
 
 void kolibri_symbol_table_seed_defaults(KolibriSymbolTable *table) {
@@ -0,0 +1,350 @@
+#include "kolibri/trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KOLIBRI_TRACE_RING 4096U
+#define KOLIBRI_TRACE_DEFAULT_FLUSH_MS 100U
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t depth;
+    uint32_t thread;
+} TraceRecord;
+
+/* Кольцо одного потока: head двигает владелец, tail — фоновый сброс.
+ * Буфер завершившегося потока освобождается для следующего и не удаляется
+ * из списка до конца процесса. */
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    atomic_int in_use;
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    TraceRecord records[KOLIBRI_TRACE_RING];
+} TraceBuffer;
+
+static _Atomic(TraceBuffer *) trace_buffers;
+static atomic_int trace_active;
+static _Atomic uint32_t trace_sample_threshold;
+static atomic_int trace_sample_all;
+static _Atomic uint32_t trace_thread_ids;
+static _Atomic uint64_t trace_written;
+
+static _Thread_local TraceBuffer *trace_local;
+static _Thread_local uint32_t trace_local_thread;
+static _Thread_local uint32_t trace_depth;
+static _Thread_local int trace_sampled;
+static _Thread_local uint64_t trace_rng;
+
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+/* Состояние писателя меняют только start/stop и фоновый поток. */
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t trace_flusher;
+static int trace_running;
+static FILE *trace_file;
+static KolibriTraceFormat trace_format;
+static unsigned trace_flush_ms;
+static int64_t trace_wall_offset_ns;
+static size_t trace_chrome_events;
+
+static uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void trace_release_buffer(void *value) {
+    TraceBuffer *buffer = (TraceBuffer *)value;
+    if (buffer) {
+        atomic_store_explicit(&buffer->in_use, 0, memory_order_release);
+    }
+}
+
+static void trace_key_create(void) {
+    pthread_key_create(&trace_key, trace_release_buffer);
+}
+
+static TraceBuffer *trace_acquire_buffer(void) {
+    pthread_once(&trace_key_once, trace_key_create);
+    TraceBuffer *buffer = atomic_load_explicit(&trace_buffers, memory_order_acquire);
+    for (; buffer; buffer = buffer->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&buffer->in_use, &expected, 1, memory_order_acq_rel,
+                                                    memory_order_relaxed)) {
+            break;
+        }
+    }
+    if (!buffer) {
+        buffer = (TraceBuffer *)calloc(1U, sizeof(*buffer));
+        if (!buffer) {
+            return NULL;
+        }
+        atomic_init(&buffer->in_use, 1);
+        TraceBuffer *head = atomic_load_explicit(&trace_buffers, memory_order_relaxed);
+        do {
+            buffer->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&trace_buffers, &head, buffer, memory_order_release,
+                                                        memory_order_relaxed));
+    }
+    pthread_setspecific(trace_key, buffer);
+    trace_local = buffer;
+    trace_local_thread = atomic_fetch_add_explicit(&trace_thread_ids, 1U, memory_order_relaxed) + 1U;
+    return buffer;
+}
+
+static int trace_sample(void) {
+    if (atomic_load_explicit(&trace_sample_all, memory_order_relaxed)) {
+        return 1;
+    }
+    if (trace_rng == 0U) {
+        trace_rng = (trace_now_ns() ^ (uint64_t)(uintptr_t)&trace_rng) | 1U;
+    }
+    trace_rng ^= trace_rng << 13;
+    trace_rng ^= trace_rng >> 7;
+    trace_rng ^= trace_rng << 17;
+    return (uint32_t)(trace_rng >> 32) < atomic_load_explicit(&trace_sample_threshold, memory_order_relaxed);
+}
+
+KolibriTraceSpan kolibri_trace_begin(const char *name) {
+    KolibriTraceSpan span = { name, 0U, 0U };
+    if (!atomic_load_explicit(&trace_active, memory_order_relaxed)) {
+        return span;
+    }
+    if (trace_depth == 0U) {
+        trace_sampled = trace_sample();
+    }
+    span.depth = ++trace_depth;
+    if (trace_sampled) {
+        span.start_ns = trace_now_ns();
+    }
+    return span;
+}
+
+void kolibri_trace_end(KolibriTraceSpan *span) {
+    if (!span || span->depth == 0U) {
+        return;
+    }
+    trace_depth = span->depth - 1U;
+    if (span->start_ns == 0U || !atomic_load_explicit(&trace_active, memory_order_relaxed)) {
+        return;
+    }
+    uint64_t finished = trace_now_ns();
+    TraceBuffer *buffer = trace_local ? trace_local : trace_acquire_buffer();
+    if (!buffer) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&buffer->tail, memory_order_acquire);
+    if (head - tail >= KOLIBRI_TRACE_RING) {
+        atomic_fetch_add_explicit(&buffer->dropped, 1U, memory_order_relaxed);
+        return;
+    }
+    TraceRecord *record = &buffer->records[head & (KOLIBRI_TRACE_RING - 1U)];
+    record->name = span->name;
+    record->start_ns = span->start_ns;
+    record->duration_ns = finished - span->start_ns;
+    record->depth = span->depth - 1U;
+    record->thread = trace_local_thread;
+    atomic_store_explicit(&buffer->head, head + 1U, memory_order_release);
+}
+
+static void trace_write_name(FILE *out, const char *name) {
+    for (const unsigned char *p = (const unsigned char *)(name ? name : ""); *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+            fputc(*p, out);
+        } else if (*p < 0x20U) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+}
+
+static void trace_write_record(const TraceRecord *record) {
+    int64_t wall_ns = (int64_t)record->start_ns + trace_wall_offset_ns;
+    if (trace_format == KOLIBRI_TRACE_FORMAT_CHROME) {
+        fputs(trace_chrome_events++ ? ",\n{\"name\":\"" : "{\"name\":\"", trace_file);
+        trace_write_name(trace_file, record->name);
+        fprintf(trace_file,
+                "\",\"cat\":\"kolibri\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                (double)wall_ns / 1e3,
+                (double)record->duration_ns / 1e3,
+                (int)getpid(),
+                record->thread);
+        return;
+    }
+    /* Порядок и разделители полей — как у json.dumps(sort_keys=True) в core/tracing.py. */
+    fprintf(trace_file, "{\"event\": {\"metka\": %.6f, \"soobshenie\": \"", (double)wall_ns / 1e9);
+    trace_write_name(trace_file, record->name);
+    fprintf(trace_file,
+            "\", \"tip\": \"SPAN\"}, \"span\": {\"depth\": %u, \"duration_ns\": %llu, \"start_ns\": %lld, "
+            "\"thread\": %u}}\n",
+            record->depth,
+            (unsigned long long)record->duration_ns,
+            (long long)wall_ns,
+            record->thread);
+}
+
+static void trace_drain(void) {
+    TraceBuffer *buffer = atomic_load_explicit(&trace_buffers, memory_order_acquire);
+    uint64_t written = 0U;
+    for (; buffer; buffer = buffer->next) {
+        uint64_t tail = atomic_load_explicit(&buffer->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        for (; tail != head; ++tail) {
+            trace_write_record(&buffer->records[tail & (KOLIBRI_TRACE_RING - 1U)]);
+            written++;
+        }
+        atomic_store_explicit(&buffer->tail, tail, memory_order_release);
+    }
+    if (written > 0U) {
+        fflush(trace_file);
+        atomic_fetch_add_explicit(&trace_written, written, memory_order_relaxed);
+    }
+}
+
+static void *trace_flusher_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&trace_lock);
+    while (trace_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + (uint64_t)trace_flush_ms * 1000000ULL;
+        deadline.tv_sec += (time_t)(nsec / 1000000000ULL);
+        deadline.tv_nsec = (long)(nsec % 1000000000ULL);
+        pthread_cond_timedwait(&trace_wake, &trace_lock, &deadline);
+        if (trace_running) {
+            trace_drain();
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return NULL;
+}
+
+int kolibri_trace_start(const KolibriTraceConfig *config) {
+    if (!config || !config->path || !config->path[0] || config->sample_rate < 0.0 || config->sample_rate > 1.0) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_running) {
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    int chrome = config->format == KOLIBRI_TRACE_FORMAT_CHROME;
+    trace_file = fopen(config->path, chrome ? "w" : "a");
+    if (!trace_file) {
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    trace_format = chrome ? KOLIBRI_TRACE_FORMAT_CHROME : KOLIBRI_TRACE_FORMAT_JSONL;
+    trace_flush_ms = config->flush_interval_ms ? config->flush_interval_ms : KOLIBRI_TRACE_DEFAULT_FLUSH_MS;
+    trace_chrome_events = 0U;
+    if (chrome) {
+        fputs("[\n", trace_file);
+    }
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    trace_wall_offset_ns =
+        (int64_t)wall.tv_sec * 1000000000LL + (int64_t)wall.tv_nsec - (int64_t)trace_now_ns();
+    /* Спаны, оставшиеся в кольцах от прошлой сессии, не попадают в новый файл. */
+    for (TraceBuffer *buffer = atomic_load_explicit(&trace_buffers, memory_order_acquire); buffer;
+         buffer = buffer->next) {
+        atomic_store_explicit(&buffer->tail, atomic_load_explicit(&buffer->head, memory_order_acquire),
+                              memory_order_release);
+    }
+    atomic_store_explicit(&trace_sample_all, config->sample_rate >= 1.0, memory_order_relaxed);
+    atomic_store_explicit(&trace_sample_threshold, (uint32_t)(config->sample_rate * 4294967295.0),
+                          memory_order_relaxed);
+    trace_running = 1;
+    if (pthread_create(&trace_flusher, NULL, trace_flusher_main, NULL) != 0) {
+        trace_running = 0;
+        fclose(trace_file);
+        trace_file = NULL;
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    atomic_store_explicit(&trace_active, 1, memory_order_release);
+    pthread_mutex_unlock(&trace_lock);
+    return 0;
+}
+
+int kolibri_trace_start_from_env(void) {
+    const char *path = getenv("KOLIBRI_TRACE_PATH");
+    if (!path || !path[0]) {
+        return 0;
+    }
+    KolibriTraceConfig config = { path, KOLIBRI_TRACE_FORMAT_JSONL, 1.0, 0U };
+    const char *format = getenv("KOLIBRI_TRACE_FORMAT");
+    if (format && strcmp(format, "chrome") == 0) {
+        config.format = KOLIBRI_TRACE_FORMAT_CHROME;
+    } else if (format && format[0] && strcmp(format, "jsonl") != 0) {
+        fprintf(stderr, "[kolibri-trace] unknown KOLIBRI_TRACE_FORMAT: %s (jsonl|chrome)\n", format);
+        return -1;
+    }
+    const char *sample = getenv("KOLIBRI_TRACE_SAMPLE");
+    if (sample && sample[0]) {
+        char *end = NULL;
+        errno = 0;
+        config.sample_rate = strtod(sample, &end);
+        if (errno != 0 || !end || *end != '\0' || config.sample_rate < 0.0 || config.sample_rate > 1.0) {
+            fprintf(stderr, "[kolibri-trace] invalid KOLIBRI_TRACE_SAMPLE: %s\n", sample);
+            return -1;
+        }
+    }
+    if (kolibri_trace_start(&config) != 0) {
+        fprintf(stderr, "[kolibri-trace] cannot open %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void kolibri_trace_stop(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_running) {
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+    atomic_store_explicit(&trace_active, 0, memory_order_release);
+    trace_running = 0;
+    pthread_cond_signal(&trace_wake);
+    pthread_mutex_unlock(&trace_lock);
+    pthread_join(trace_flusher, NULL);
+
+    pthread_mutex_lock(&trace_lock);
+    trace_drain();
+    if (trace_format == KOLIBRI_TRACE_FORMAT_CHROME) {
+        fputs("\n]\n", trace_file);
+    }
+    fclose(trace_file);
+    trace_file = NULL;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+int kolibri_trace_enabled(void) {
+    return atomic_load_explicit(&trace_active, memory_order_relaxed);
+}
+
+void kolibri_trace_stats(KolibriTraceStats *out) {
+    if (!out) {
+        return;
+    }
+    out->written = atomic_load_explicit(&trace_written, memory_order_relaxed);
+    out->dropped = 0U;
+    for (TraceBuffer *buffer = atomic_load_explicit(&trace_buffers, memory_order_acquire); buffer;
+         buffer = buffer->next) {
+        out->dropped += atomic_load_explicit(&buffer->dropped, memory_order_relaxed);
+    }
+}
@@ -1,16 +1,14 @@
-#define _GNU_SOURCE
-
 #include "kolibri/formula.h"
 #include "kolibri/script.h"
 
 #include <math.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 static KolibriFormulaPool g_pool;
 static KolibriScript g_script;
 static int g_bridge_ready = 0;
+static KolibriScriptBuffer g_output;
 static KolibriScriptControls g_controls = {
     .lambda_b = 0.25,
     .lambda_d = 0.2,
@@ -26,13 +24,17 @@ static int bridge_ensure_initialized(void) {
         return 0;
     }
 
-    kf_pool_init(&g_pool, 424242ULL);
+    kf_pool_destroy(&g_pool);
+    if (kf_pool_init(&g_pool, 424242ULL) != 0) {
+        return -1;
+    }
     if (ks_init(&g_script, &g_pool, NULL) != 0) {
         return -1;
     }
     if (ks_set_controls(&g_script, &g_controls) != 0) {
         return -1;
     }
+    ks_set_sink(&g_script, ks_buffer_sink, &g_output);
 
     g_bridge_ready = 1;
     return 0;
@@ -80,74 +82,30 @@ int kolibri_bridge_execute(const char *program_utf8, char *out_buffer, size_t ou
         return -5;
     }
 
+    out_buffer[0] = '\0';
     if (bridge_ensure_initialized() != 0) {
-        out_buffer[0] = '\0';
         return -1;
     }
 
-    FILE *sink = NULL;
-#if defined(__EMSCRIPTEN__)
-    char *sink_buffer = NULL;
-    size_t sink_size = 0U;
-    sink = open_memstream(&sink_buffer, &sink_size);
-#else
-    sink = tmpfile();
-#endif
-    if (!sink) {
-        out_buffer[0] = '\0';
-        return -2;
-    }
-
-    ks_set_output(&g_script, sink);
+    /* Вывод пишется прямо в буфер вызывающего, без временного файла. */
+    g_output.data = out_buffer;
+    g_output.capacity = out_capacity;
+    g_output.length = 0U;
+    g_output.dropped = 0U;
+    int rc = 0;
     if (ks_load_text(&g_script, program_utf8) != 0) {
-        fclose(sink);
-#if defined(__EMSCRIPTEN__)
-        free(sink_buffer);
-#endif
-        ks_set_output(&g_script, stdout);
-        out_buffer[0] = '\0';
-        return -3;
-    }
-
-    if (ks_execute(&g_script) != 0) {
-        fclose(sink);
-#if defined(__EMSCRIPTEN__)
-        free(sink_buffer);
-#endif
-        ks_set_output(&g_script, stdout);
-        out_buffer[0] = '\0';
-        return -4;
-    }
-
-    fflush(sink);
-#if defined(__EMSCRIPTEN__)
-    fclose(sink);
-    ks_set_output(&g_script, stdout);
-
-    size_t copy = sink_size < (out_capacity - 1U) ? sink_size : (out_capacity - 1U);
-    if (copy > 0U) {
-        memcpy(out_buffer, sink_buffer, copy);
+        rc = -3;
+    } else if (ks_execute(&g_script) != 0) {
+        rc = -4;
     }
-    out_buffer[copy] = '\0';
-    free(sink_buffer);
-
-    return (int)copy;
-#else
-    if (fseek(sink, 0L, SEEK_SET) != 0) {
-        fclose(sink);
-        ks_set_output(&g_script, stdout);
+    size_t written = g_output.length;
+    g_output.data = NULL;
+    g_output.capacity = 0U;
+    if (rc != 0) {
         out_buffer[0] = '\0';
-        return -2;
+        return rc;
     }
-
-    size_t written = fread(out_buffer, 1U, out_capacity - 1U, sink);
-    out_buffer[written] = '\0';
-
-    fclose(sink);
-    ks_set_output(&g_script, stdout);
-
     return (int)written;
-#endif
 }
 
 int kolibri_bridge_has_simd(void) {
@@ -18,6 +18,24 @@ int kg_append(KolibriGenome *ctx, const char *event_type, const char *payload, R
     return 0;
 }
 
+int kg_append_batch(KolibriGenome *ctx, const KolibriGenomeEvent *events, size_t count, ReasonBlock *out_blocks) {
+    (void)ctx;
+    (void)events;
+    (void)count;
+    (void)out_blocks;
+    return 0;
+}
+
+void kg_set_sync_interval(KolibriGenome *ctx, uint64_t interval_ms) {
+    (void)ctx;
+    (void)interval_ms;
+}
+
+int kg_sync(KolibriGenome *ctx) {
+    (void)ctx;
+    return 0;
+}
+
 int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key, size_t key_len) {
     (void)ctx;
     (void)path;
@@ -26,6 +44,12 @@ int kg_open(KolibriGenome *ctx, const char *path, const unsigned char *key, size
     return -1;
 }
 
+int kg_open_with(KolibriGenome *ctx, const char *path, const unsigned char *key, size_t key_len,
+                 const KolibriGenomeOptions *options) {
+    (void)options;
+    return kg_open(ctx, path, key, key_len);
+}
+
 void kg_close(KolibriGenome *ctx) {
     (void)ctx;
 }
@@ -37,6 +61,74 @@ int kg_verify_file(const char *path, const unsigned char *key, size_t key_len) {
     return -1;
 }
 
+int kg_verify_file_threads(const char *path, const unsigned char *key, size_t key_len, size_t threads) {
+    (void)threads;
+    return kg_verify_file(path, key, key_len);
+}
+
+int kg_convert_file(const char *src, const char *dst, const unsigned char *key, size_t key_len,
+                    const KolibriGenomeOptions *options) {
+    (void)src;
+    (void)dst;
+    (void)key;
+    (void)key_len;
+    (void)options;
+    return -1;
+}
+
+int kg_reader_open(KolibriGenomeReader *reader, const char *path) {
+    (void)reader;
+    (void)path;
+    return -1;
+}
+
+int kg_reader_seek(KolibriGenomeReader *reader, uint64_t index) {
+    (void)reader;
+    (void)index;
+    return -1;
+}
+
+int kg_reader_seek_time(KolibriGenomeReader *reader, uint64_t timestamp) {
+    (void)reader;
+    (void)timestamp;
+    return -1;
+}
+
+int kg_reader_next(KolibriGenomeReader *reader, ReasonBlock *block) {
+    (void)reader;
+    (void)block;
+    return -1;
+}
+
+int kg_reader_next_type(KolibriGenomeReader *reader, const char *event_type,
+                        ReasonBlock *block) {
+    (void)reader;
+    (void)event_type;
+    (void)block;
+    return -1;
+}
+
+void kg_reader_close(KolibriGenomeReader *reader) {
+    (void)reader;
+}
+
+int kg_read_range(const char *path, uint64_t first, size_t count, ReasonBlock *out,
+                  size_t *out_count) {
+    (void)path;
+    (void)first;
+    (void)count;
+    (void)out;
+    if (out_count) {
+        *out_count = 0;
+    }
+    return -1;
+}
+
+int kg_write_checkpoint(KolibriGenome *ctx) {
+    (void)ctx;
+    return -1;
+}
+
 int kg_encode_payload(const char *utf8, char *out, size_t out_len) {
     if (!out || out_len == 0) {
         return -1;
@@ -3,8 +3,10 @@ SECTION .text
 bits 32
 global isr_timer
 global isr_keyboard
+global isr_serial
 extern obrabotat_tajmer
 extern obrabotat_klaviaturu
+extern obrabotat_serial
 
 isr_timer:
     pusha
@@ -17,3 +19,9 @@ isr_keyboard:
     call obrabotat_klaviaturu
     popa
     iretd
+
+isr_serial:
+    pusha
+    call obrabotat_serial
+    popa
+    iretd
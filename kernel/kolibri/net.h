@@ -13,6 +13,7 @@ typedef struct {
     uint8_t tx_buffer[KOLIBRI_SLIP_MAX_PAYLOAD + 32U];
 } KolibriSlipUdp;
 
+void kn_slip_send_frame(const uint8_t *data, size_t length);
 void kn_slip_udp_init(KolibriSlipUdp *ctx, uint16_t local_port);
 void kn_slip_udp_set_remote(KolibriSlipUdp *ctx, const uint8_t ip[4], uint16_t port);
 void kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length);
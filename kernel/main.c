@@ -11,6 +11,7 @@
 #include "kolibri/net.h"
 #include "kolibri/random.h"
 #include "ramdisk.h"
+#include "scheduler.h"
 #include "serial.h"
 #include "support.h"
 
@@ -28,6 +29,15 @@
 
 #define PIT_PORT_KANAL0 0x40U
 #define PIT_PORT_KOMANDA 0x43U
+#define PIT_CHASTOTA_GC 100U
+
+/* Периоды задач в тиках PIT (10 мс). */
+#define ZADACHA_POOL_PERIOD 1U
+#define ZADACHA_POOL_POKOLENIYA 2U
+#define ZADACHA_GENOME_PERIOD 100U
+#define ZADACHA_SLIP_PERIOD 10U
+#define ZADACHA_SLIP_HELLO 500U
+#define ZADACHA_OTCHET_PERIOD 1000U
 
 struct gdt_zapis {
     uint16_t limit_nizkij;
@@ -60,12 +70,17 @@ static volatile uint16_t *vga_okno = VGA_ADRES;
 static size_t vga_poziciya = 0U;
 static struct gdt_zapis gdt_tablica[3];
 static struct idt_zapis idt_tablica[256];
-static uint64_t schetchik_tickov = 0ULL;
 
 static KolibriFormulaPool kernel_pool;
 static KolibriSlipUdp net_interface;
 static KolibriGenome genome_context;
 static bool genome_ready = false;
+static char best_opisanie[KOLIBRI_PAYLOAD_SIZE];
+static bool genome_izmenen = false;
+static bool set_izmenena = false;
+static uint32_t set_node_id = 0U;
+static uint16_t set_port = 0U;
+static uint32_t set_poslednij_hello = 0U;
 
 struct KolibriBootConfig {
     uint32_t seed;
@@ -76,6 +91,7 @@ struct KolibriBootConfig {
 
 extern void isr_timer(void);
 extern void isr_keyboard(void);
+extern void isr_serial(void);
 
 static void serial_state(const char *message) {
     serial_write_string("[STATE] ");
@@ -243,22 +259,23 @@ static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
         serial_state_value("preview", (uint32_t)preview);
     }
 
+    if (kf_formula_describe(best, best_opisanie, sizeof(best_opisanie)) != 0) {
+        k_strlcpy(best_opisanie, "unknown", sizeof(best_opisanie));
+    }
     if (genome_ready) {
-        char payload[128];
-        if (kf_formula_describe(best, payload, sizeof(payload)) != 0) {
-            k_strlcpy(payload, "unknown", sizeof(payload));
-        }
-        if (kg_append(&genome_context, "AUTOPILOT", payload, NULL) == 0) {
+        if (kg_append(&genome_context, "AUTOPILOT", best_opisanie, NULL) == 0) {
             serial_state("genome.append");
         }
         ramdisk_commit(genome_context.size);
-        kg_close(&genome_context);
     }
 
+    set_node_id = node_id;
+    set_port = listen_port;
     if (listen_port != 0U) {
         vga_pechat_stroku("[Kolibri] swarm bootstrap\n");
         kn_slip_udp_init(&net_interface, listen_port);
         kn_slip_udp_send_hello(&net_interface, node_id);
+        set_poslednij_hello = scheduler_ticks();
         serial_state("network.hello_sent");
     } else {
         serial_state("network.disabled");
@@ -267,6 +284,69 @@ static void kolibri_autopilot(const struct KolibriBootConfig *cfg) {
     serial_state("autopilot.done");
 }
 
+/* Задача эволюции: короткий срез поколений за тик. */
+static void zadacha_pool(void *ctx) {
+    (void)ctx;
+    kf_pool_tick(&kernel_pool, ZADACHA_POOL_POKOLENIYA);
+    const KolibriFormula *best = kf_pool_best(&kernel_pool);
+    char opisanie[KOLIBRI_PAYLOAD_SIZE];
+    if (!best || kf_formula_describe(best, opisanie, sizeof(opisanie)) != 0) {
+        return;
+    }
+    if (k_strcmp(opisanie, best_opisanie) == 0) {
+        return;
+    }
+    k_strlcpy(best_opisanie, opisanie, sizeof(best_opisanie));
+    genome_izmenen = true;
+    set_izmenena = true;
+    serial_write_string("[BEST ] ");
+    serial_write_string(best_opisanie);
+    serial_write_char('\n');
+}
+
+/* Задача журнала: сбрасывает новую лучшую формулу на RAM-диск. */
+static void zadacha_genome(void *ctx) {
+    (void)ctx;
+    if (!genome_ready || !genome_izmenen) {
+        return;
+    }
+    genome_izmenen = false;
+    if (kg_append(&genome_context, "EVOLVE", best_opisanie, NULL) != 0) {
+        serial_state("genome.full");
+        kg_close(&genome_context);
+        genome_ready = false;
+        return;
+    }
+    ramdisk_commit(genome_context.size);
+    serial_state_value("genome.entries", genome_context.next_index);
+}
+
+/* Задача SLIP: анонс новой формулы и периодический HELLO. */
+static void zadacha_slip(void *ctx) {
+    (void)ctx;
+    if (set_port == 0U) {
+        return;
+    }
+    if (set_izmenena) {
+        char soobshenie[KOLIBRI_PAYLOAD_SIZE + 8U];
+        k_strlcpy(soobshenie, "FORMULA:", sizeof(soobshenie));
+        k_strlcpy(soobshenie + 8, best_opisanie, sizeof(soobshenie) - 8U);
+        kn_slip_udp_send(&net_interface, (const uint8_t *)soobshenie, k_strlen(soobshenie));
+        set_izmenena = false;
+    }
+    uint32_t seychas = scheduler_ticks();
+    if (seychas - set_poslednij_hello >= ZADACHA_SLIP_HELLO) {
+        kn_slip_udp_send_hello(&net_interface, set_node_id);
+        set_poslednij_hello = seychas;
+    }
+}
+
+static void zadacha_otchet(void *ctx) {
+    (void)ctx;
+    serial_state_value("ticks", scheduler_ticks());
+    scheduler_report();
+}
+
 /* Создаёт запись GDT с заданными параметрами. */
 static void zapolnit_gdt_zapis(struct gdt_zapis *zapis, uint32_t baza,
                                uint32_t limit, uint8_t dostup,
@@ -314,13 +394,14 @@ static void zapolnit_idt_zapis(int nomer, uint32_t baza, uint16_t selektor,
     zapis->baza_verh = (uint16_t)((baza >> 16U) & 0xFFFFU);
 }
 
-/* Настраивает IDT и подключает обработчики таймера и клавиатуры. */
+/* Настраивает IDT и подключает обработчики таймера, клавиатуры и COM1. */
 static void nastroit_idt(void) {
     for (int indeks = 0; indeks < 256; ++indeks) {
         zapolnit_idt_zapis(indeks, 0U, 0x08U, 0x8EU);
     }
     zapolnit_idt_zapis(32, (uint32_t)isr_timer, 0x08U, 0x8EU);
     zapolnit_idt_zapis(33, (uint32_t)isr_keyboard, 0x08U, 0x8EU);
+    zapolnit_idt_zapis(36, (uint32_t)isr_serial, 0x08U, 0x8EU);
 
     struct idt_registr reg;
     reg.limit = sizeof(idt_tablica) - 1U;
@@ -350,13 +431,13 @@ static void nastroit_pic(void) {
     zapisat_port8(PIC1_PORT_DANNYE, 0x01U);
     zapisat_port8(PIC2_PORT_DANNYE, 0x01U);
 
-    zapisat_port8(PIC1_PORT_DANNYE, mask1 & ~0x03U);
+    zapisat_port8(PIC1_PORT_DANNYE, mask1 & ~0x13U);
     zapisat_port8(PIC2_PORT_DANNYE, mask2 & ~0x00U);
 }
 
 /* Настраивает программируемый таймер на частоту 100 Гц. */
 static void nastroit_pit(void) {
-    uint16_t delitel = 1193180U / 100U;
+    uint16_t delitel = 1193180U / PIT_CHASTOTA_GC;
     zapisat_port8(PIT_PORT_KOMANDA, 0x36U);
     zapisat_port8(PIT_PORT_KANAL0, (uint8_t)(delitel & 0xFFU));
     zapisat_port8(PIT_PORT_KANAL0, (uint8_t)((delitel >> 8U) & 0xFFU));
@@ -372,8 +453,8 @@ static void preobrazovat_bajt_v_hex(uint8_t znachenie, char *vyhod) {
 
 /* Обработчик аппаратного таймера. */
 void obrabotat_tajmer(void) {
-    ++schetchik_tickov;
-    if (((uint32_t)schetchik_tickov % 100U) == 0U) {
+    scheduler_tick();
+    if ((scheduler_ticks() % PIT_CHASTOTA_GC) == 0U) {
         vga_pechat_stroku("[TICK]\n");
     }
     poslati_eoi(0U);
@@ -390,6 +471,12 @@ void obrabotat_klaviaturu(void) {
     poslati_eoi(1U);
 }
 
+/* Обработчик IRQ4: дозаполняет FIFO передатчика COM1 из кольца. */
+void obrabotat_serial(void) {
+    serial_irq_handler();
+    poslati_eoi(4U);
+}
+
 /* Точка входа ядра Kolibri OS после загрузчика GRUB. */
 void kolibri_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
     (void)multiboot_info;
@@ -400,15 +487,18 @@ void kolibri_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
     if (multiboot_magic != 0x36D76289U) {
         vga_pechat_stroku("[ОШИБКА] загрузчик не соответствует Multiboot2\n");
         serial_state_value("boot.magic", multiboot_magic);
+        serial_flush();
         for (;;) {
             __asm__ __volatile__("hlt");
         }
     }
 
+    scheduler_init();
     nastroit_gdt();
     nastroit_idt();
     nastroit_pic();
     nastroit_pit();
+    serial_enable_tx_irq();
 
     vga_pechat_stroku("Прерывания активируются...\n");
     __asm__ __volatile__("sti");
@@ -417,7 +507,10 @@ void kolibri_kernel_main(uint32_t multiboot_magic, uint32_t multiboot_info) {
     const struct KolibriBootConfig *config = (const struct KolibriBootConfig *)0x00008000U;
     kolibri_autopilot(config);
 
-    for (;;) {
-        __asm__ __volatile__("hlt");
-    }
+    scheduler_add("pool.tick", ZADACHA_POOL_PERIOD, zadacha_pool, NULL);
+    scheduler_add("genome.flush", ZADACHA_GENOME_PERIOD, zadacha_genome, NULL);
+    scheduler_add("slip.io", ZADACHA_SLIP_PERIOD, zadacha_slip, NULL);
+    scheduler_add("sched.report", ZADACHA_OTCHET_PERIOD, zadacha_otchet, NULL);
+    serial_state("scheduler.start");
+    scheduler_run();
 }
@@ -10,18 +10,6 @@
 
 static const uint8_t LOCAL_IP[4] = {192U, 168U, 0U, 2U};
 
-static void slip_send_byte(uint8_t byte) {
-    if (byte == SLIP_END) {
-        serial_write_char((char)SLIP_ESC);
-        serial_write_char((char)SLIP_ESC_END);
-    } else if (byte == SLIP_ESC) {
-        serial_write_char((char)SLIP_ESC);
-        serial_write_char((char)SLIP_ESC_ESC);
-    } else {
-        serial_write_char((char)byte);
-    }
-}
-
 static uint16_t ip_checksum(const uint8_t *data, size_t length) {
     uint32_t sum = 0U;
     for (size_t i = 0; i + 1 < length; i += 2) {
@@ -77,6 +65,38 @@ static size_t build_ipv4_udp(const KolibriSlipUdp *ctx, const uint8_t *payload,
     return total;
 }
 
+void kn_slip_send_frame(const uint8_t *data, size_t length) {
+    if (!data) {
+        return;
+    }
+    /* Экранируем порциями и отдаём в кольцо UART без перевода строк. */
+    uint8_t chunk[128];
+    size_t used = 0U;
+    chunk[used++] = SLIP_END;
+    for (size_t i = 0; i < length; ++i) {
+        if (used + 2U > sizeof(chunk)) {
+            serial_write(chunk, used);
+            used = 0U;
+        }
+        uint8_t byte = data[i];
+        if (byte == SLIP_END) {
+            chunk[used++] = SLIP_ESC;
+            chunk[used++] = SLIP_ESC_END;
+        } else if (byte == SLIP_ESC) {
+            chunk[used++] = SLIP_ESC;
+            chunk[used++] = SLIP_ESC_ESC;
+        } else {
+            chunk[used++] = byte;
+        }
+    }
+    if (used + 1U > sizeof(chunk)) {
+        serial_write(chunk, used);
+        used = 0U;
+    }
+    chunk[used++] = SLIP_END;
+    serial_write(chunk, used);
+}
+
 void kn_slip_udp_init(KolibriSlipUdp *ctx, uint16_t local_port) {
     if (!ctx) {
         return;
@@ -103,11 +123,7 @@ void kn_slip_udp_send(KolibriSlipUdp *ctx, const uint8_t *payload, size_t length
         return;
     }
     size_t packet_len = build_ipv4_udp(ctx, payload, length, ctx->tx_buffer);
-    serial_write_char((char)SLIP_END);
-    for (size_t i = 0; i < packet_len; ++i) {
-        slip_send_byte(ctx->tx_buffer[i]);
-    }
-    serial_write_char((char)SLIP_END);
+    kn_slip_send_frame(ctx->tx_buffer, packet_len);
 }
 
 static size_t u32_to_dec(uint32_t value, char *buffer, size_t buffer_len) {
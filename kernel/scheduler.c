@@ -0,0 +1,112 @@
+#include "scheduler.h"
+
+#include "serial.h"
+
+/* Кооперативный планировщик: IRQ0 только считает тики, задачи идут в основном цикле. */
+static KolibriTask scheduler_tasks[KOLIBRI_SCHEDULER_MAX_TASKS];
+static size_t scheduler_count = 0U;
+static volatile uint32_t scheduler_tick_count = 0U;
+
+void scheduler_init(void) {
+    scheduler_count = 0U;
+    scheduler_tick_count = 0U;
+}
+
+int scheduler_add(const char *name, uint32_t period_ticks, KolibriTaskFn fn, void *ctx) {
+    if (!name || !fn || period_ticks == 0U || scheduler_count >= KOLIBRI_SCHEDULER_MAX_TASKS) {
+        return -1;
+    }
+    KolibriTask *task = &scheduler_tasks[scheduler_count++];
+    task->name = name;
+    task->fn = fn;
+    task->ctx = ctx;
+    task->period = period_ticks;
+    task->next_due = scheduler_tick_count;
+    task->runs = 0U;
+    task->lag_max = 0U;
+    task->lag_total = 0U;
+    task->run_max = 0U;
+    return 0;
+}
+
+void scheduler_tick(void) {
+    scheduler_tick_count = scheduler_tick_count + 1U;
+}
+
+uint32_t scheduler_ticks(void) {
+    return scheduler_tick_count;
+}
+
+/* Разница со знаком переживает переполнение счётчика тиков. */
+static int task_due(const KolibriTask *task, uint32_t now) {
+    return (int32_t)(now - task->next_due) >= 0;
+}
+
+int scheduler_run_pending(void) {
+    int executed = 0;
+    for (size_t i = 0; i < scheduler_count; ++i) {
+        KolibriTask *task = &scheduler_tasks[i];
+        uint32_t start = scheduler_tick_count;
+        if (!task_due(task, start)) {
+            continue;
+        }
+        uint32_t lag = start - task->next_due;
+        task->fn(task->ctx);
+        uint32_t duration = scheduler_tick_count - start;
+
+        task->runs++;
+        task->lag_total += lag;
+        if (lag > task->lag_max) {
+            task->lag_max = lag;
+        }
+        if (duration > task->run_max) {
+            task->run_max = duration;
+        }
+        /* Пропущенные периоды не догоняем пачкой. */
+        task->next_due += task->period;
+        if (task_due(task, scheduler_tick_count)) {
+            task->next_due = scheduler_tick_count + task->period;
+        }
+        ++executed;
+    }
+    return executed;
+}
+
+void scheduler_run(void) {
+    for (;;) {
+        if (scheduler_run_pending() > 0) {
+            continue;
+        }
+        /* sti действует после следующей инструкции, поэтому тик не теряется между проверкой и hlt. */
+        __asm__ __volatile__("cli");
+        int any_due = 0;
+        uint32_t now = scheduler_tick_count;
+        for (size_t i = 0; i < scheduler_count && !any_due; ++i) {
+            any_due = task_due(&scheduler_tasks[i], now);
+        }
+        if (any_due) {
+            __asm__ __volatile__("sti");
+        } else {
+            __asm__ __volatile__("sti\n"
+                                 "hlt");
+        }
+    }
+}
+
+void scheduler_report(void) {
+    for (size_t i = 0; i < scheduler_count; ++i) {
+        const KolibriTask *task = &scheduler_tasks[i];
+        uint32_t lag_avg = task->runs ? task->lag_total / task->runs : 0U;
+        serial_write_string("[SCHED] ");
+        serial_write_string(task->name);
+        serial_write_string(" runs=");
+        serial_write_hex32(task->runs);
+        serial_write_string(" lag.avg=");
+        serial_write_hex32(lag_avg);
+        serial_write_string(" lag.max=");
+        serial_write_hex32(task->lag_max);
+        serial_write_string(" run.max=");
+        serial_write_hex32(task->run_max);
+        serial_write_char('\n');
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef KOLIBRI_KERNEL_SCHEDULER_H
+#define KOLIBRI_KERNEL_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KOLIBRI_SCHEDULER_MAX_TASKS 8U
+
+typedef void (*KolibriTaskFn)(void *ctx);
+
+typedef struct {
+    const char *name;
+    KolibriTaskFn fn;
+    void *ctx;
+    uint32_t period;
+    uint32_t next_due;
+    uint32_t runs;
+    uint32_t lag_max;
+    uint32_t lag_total;
+    uint32_t run_max;
+} KolibriTask;
+
+void scheduler_init(void);
+int scheduler_add(const char *name, uint32_t period_ticks, KolibriTaskFn fn, void *ctx);
+void scheduler_tick(void);
+uint32_t scheduler_ticks(void);
+int scheduler_run_pending(void);
+void scheduler_run(void);
+void scheduler_report(void);
+
+#endif /* KOLIBRI_KERNEL_SCHEDULER_H */
@@ -11,6 +11,41 @@ static inline uint8_t io_in8(uint16_t port) {
 }
 
 #define COM1_BASE 0x3F8U
+#define COM1_IER (COM1_BASE + 1U)
+#define COM1_IIR (COM1_BASE + 2U)
+#define COM1_LSR (COM1_BASE + 5U)
+#define COM1_IER_THRE 0x02U
+#define COM1_LSR_THRE 0x20U
+#define COM1_LSR_TEMT 0x40U
+#define COM1_FIFO_GLUBINA 16U
+
+/* Кольцо передачи: пишет основной код, разбирает обработчик IRQ4. */
+#define SERIAL_TX_RAZMER 4096U
+#define SERIAL_TX_MASKA (SERIAL_TX_RAZMER - 1U)
+
+static uint8_t tx_kolco[SERIAL_TX_RAZMER];
+static volatile uint32_t tx_golova = 0U;
+static volatile uint32_t tx_hvost = 0U;
+static volatile int tx_po_preryvaniyu = 0;
+
+static inline uint32_t irq_sohranit(void) {
+    uint32_t flagi;
+    __asm__ __volatile__("pushfl\n"
+                         "popl %0\n"
+                         "cli"
+                         : "=r"(flagi)
+                         :
+                         : "memory");
+    return flagi;
+}
+
+static inline void irq_vosstanovit(uint32_t flagi) {
+    __asm__ __volatile__("pushl %0\n"
+                         "popfl"
+                         :
+                         : "r"(flagi)
+                         : "memory", "cc");
+}
 
 void serial_init(uint32_t baud_divisor) {
     io_out8(COM1_BASE + 1U, 0x00U);
@@ -20,19 +55,89 @@ void serial_init(uint32_t baud_divisor) {
     io_out8(COM1_BASE + 3U, 0x03U);
     io_out8(COM1_BASE + 2U, 0xC7U);
     io_out8(COM1_BASE + 4U, 0x0BU);
+    tx_golova = 0U;
+    tx_hvost = 0U;
+    tx_po_preryvaniyu = 0;
 }
 
 static void serial_wait_tx(void) {
-    while ((io_in8(COM1_BASE + 5U) & 0x20U) == 0U) {
+    while ((io_in8(COM1_LSR) & COM1_LSR_THRE) == 0U) {
+    }
+}
+
+/* Переносит до 16 байт из кольца в FIFO; вызывается при запрещённых прерываниях. */
+static void serial_tx_pump(void) {
+    if ((io_in8(COM1_LSR) & COM1_LSR_THRE) != 0U) {
+        for (uint32_t n = 0U; n < COM1_FIFO_GLUBINA && tx_hvost != tx_golova; ++n) {
+            io_out8(COM1_BASE, tx_kolco[tx_hvost & SERIAL_TX_MASKA]);
+            tx_hvost = tx_hvost + 1U;
+        }
+    }
+    io_out8(COM1_IER, tx_hvost != tx_golova ? COM1_IER_THRE : 0x00U);
+}
+
+void serial_enable_tx_irq(void) {
+    tx_po_preryvaniyu = 1;
+}
+
+void serial_irq_handler(void) {
+    (void)io_in8(COM1_IIR);
+    serial_tx_pump();
+}
+
+void serial_write(const uint8_t *data, size_t length) {
+    if (!data) {
+        return;
+    }
+    if (!tx_po_preryvaniyu) {
+        for (size_t i = 0; i < length; ++i) {
+            serial_wait_tx();
+            io_out8(COM1_BASE, data[i]);
+        }
+        return;
+    }
+    while (length > 0U) {
+        uint32_t flagi = irq_sohranit();
+        uint32_t svobodno = SERIAL_TX_RAZMER - (tx_golova - tx_hvost);
+        if (svobodno == 0U) {
+            /* Кольцо заполнено: освобождаем место опросом, даже если IF сброшен. */
+            serial_wait_tx();
+            serial_tx_pump();
+            irq_vosstanovit(flagi);
+            continue;
+        }
+        size_t porciya = length < svobodno ? length : svobodno;
+        uint32_t golova = tx_golova;
+        for (size_t i = 0; i < porciya; ++i) {
+            tx_kolco[(golova + (uint32_t)i) & SERIAL_TX_MASKA] = data[i];
+        }
+        tx_golova = golova + (uint32_t)porciya;
+        serial_tx_pump();
+        irq_vosstanovit(flagi);
+        data += porciya;
+        length -= porciya;
+    }
+}
+
+void serial_flush(void) {
+    while (tx_hvost != tx_golova) {
+        uint32_t flagi = irq_sohranit();
+        serial_wait_tx();
+        serial_tx_pump();
+        irq_vosstanovit(flagi);
+    }
+    while ((io_in8(COM1_LSR) & COM1_LSR_TEMT) == 0U) {
     }
 }
 
 void serial_write_char(char c) {
     if (c == '\n') {
-        serial_write_char('\r');
+        static const uint8_t crlf[2] = {'\r', '\n'};
+        serial_write(crlf, sizeof(crlf));
+        return;
     }
-    serial_wait_tx();
-    io_out8(COM1_BASE, (uint8_t)c);
+    uint8_t byte = (uint8_t)c;
+    serial_write(&byte, 1U);
 }
 
 void serial_write_string(const char *str) {
@@ -40,7 +145,18 @@ void serial_write_string(const char *str) {
         return;
     }
     while (*str) {
-        serial_write_char(*str++);
+        const char *konec = str;
+        while (*konec && *konec != '\n') {
+            ++konec;
+        }
+        if (konec != str) {
+            serial_write((const uint8_t *)str, (size_t)(konec - str));
+        }
+        if (*konec == '\n') {
+            serial_write_char('\n');
+            ++konec;
+        }
+        str = konec;
     }
 }
 
@@ -50,10 +166,14 @@ static char to_hex(uint8_t nibble) {
 }
 
 void serial_write_hex32(uint32_t value) {
-    serial_write_string("0x");
+    uint8_t buffer[10];
+    buffer[0] = '0';
+    buffer[1] = 'x';
+    size_t index = 2U;
     for (int shift = 28; shift >= 0; shift -= 4) {
-        serial_write_char(to_hex((uint8_t)((value >> shift) & 0x0FU)));
+        buffer[index++] = (uint8_t)to_hex((uint8_t)((value >> shift) & 0x0FU));
     }
+    serial_write(buffer, sizeof(buffer));
 }
 
 int serial_read_char(char *out) {
@@ -5,6 +5,10 @@
 #include <stdint.h>
 
 void serial_init(uint32_t baud_divisor);
+void serial_enable_tx_irq(void);
+void serial_irq_handler(void);
+void serial_write(const uint8_t *data, size_t length);
+void serial_flush(void);
 void serial_write_char(char c);
 void serial_write_string(const char *str);
 void serial_write_hex32(uint32_t value);
@@ -109,6 +109,7 @@ kernel_sources=(
     "$proekt_koren/kernel/net.c"
     "$proekt_koren/kernel/ramdisk.c"
     "$proekt_koren/kernel/serial.c"
+    "$proekt_koren/kernel/scheduler.c"
     "$proekt_koren/kernel/main.c"
 )
 
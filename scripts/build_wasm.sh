@@ -1044,7 +1044,11 @@ exports=(
     "_k_state_free"
     "_k_state_save"
     "_k_state_load"
+    "_k_state_save_delta"
+    "_k_state_compact"
     "_k_observe"
+    "_k_observe_chunk"
+    "_k_observe_flush"
     "_k_decode"
     "_k_digit_add_syll"
     "_k_profile"
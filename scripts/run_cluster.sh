@@ -3,13 +3,16 @@ set -euo pipefail
 
 usage() {
     cat <<USAGE
-Использование: $0 [-n количество] [-b порт] [-d секунды] [-s зерно]
+Использование: $0 [-n количество] [-b порт] [-d секунды] [-s зерно] [-A [-f ветвление]]
 
 Опции:
   -n количество    Сколько узлов запустить (по умолчанию 3)
   -b порт          Стартовый порт прослушивания (по умолчанию 4100)
   -d секунды       Продолжительность работы (0 — до Ctrl+C, по умолчанию 60)
   -s зерно         Базовое зерно детерминизма (по умолчанию 20250923)
+  -A               Запустить координатор
+  -f ветвление     С -A: по ретранслятору на каждые N узлов, корень
+                   рассылает только ретрансляторам (0 — без дерева)
 USAGE
 }
 
@@ -21,7 +24,8 @@ propustit_sborku="${KOLIBRI_CLUSTER_SKIP_BUILD:-0}"
 
 koordinator=0
 koordinator_port=4099
-while getopts "n:b:d:s:hA" flag; do
+vetvlenie=0
+while getopts "n:b:d:s:f:hA" flag; do
     case "$flag" in
         n)
             kolichestvo="$OPTARG"
@@ -38,6 +42,9 @@ while getopts "n:b:d:s:hA" flag; do
         A)
             koordinator=1
             ;;
+        f)
+            vetvlenie="$OPTARG"
+            ;;
         h|*)
             usage
             exit 0
@@ -60,6 +67,17 @@ if ! [[ "$prodolzhitelnost" =~ ^[0-9]+$ ]]; then
     exit 1
 fi
 
+if ! [[ "$vetvlenie" =~ ^[0-9]+$ ]]; then
+    echo "[Ошибка] Ветвление должно быть неотрицательным числом" >&2
+    exit 1
+fi
+
+# Ретрансляторы занимают порты ниже корневого координатора.
+retranslyatorov=0
+if [ "$koordinator" -eq 1 ] && [ "$vetvlenie" -gt 0 ] && [ "$kolichestvo" -gt "$vetvlenie" ]; then
+    retranslyatorov=$(((kolichestvo + vetvlenie - 1) / vetvlenie))
+fi
+
 root_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
 build_dir="$root_dir/build"
 cluster_dir="$build_dir/cluster"
@@ -121,7 +139,9 @@ for ((indeks = 0; indeks < kolichestvo; ++indeks)); do
     zhurnal="$cluster_dir/node_${nomer}.log"
     seed=$((bazovoe_zerno + nomer))
     komanda=("$build_dir/kolibri_node" "--node-id" "$nomer" "--listen" "$port" "--genome" "$geneticheskij" "--seed" "$seed" "--verify-genome" "--hmac-key" "$key_path" "--auto-learn")
-    if [ "$koordinator" -eq 1 ]; then
+    if [ "$retranslyatorov" -gt 0 ]; then
+        komanda+=("--peer" "127.0.0.1:$((koordinator_port - 1 - indeks / vetvlenie))")
+    elif [ "$koordinator" -eq 1 ]; then
         komanda+=("--peer" "127.0.0.1:${koordinator_port}")
     else
         if [ "$kolichestvo" -gt 1 ]; then
@@ -138,10 +158,25 @@ echo "[Рой] Все узлы запущены. Для остановки на
 if [ "$koordinator" -eq 1 ]; then
     echo "[Рой] Запускаю координатор на порту $koordinator_port"
     targets_args=()
-    for ((indeks = 0; indeks < kolichestvo; ++indeks)); do
-        port=$((bazovyj_port + indeks))
-        targets_args+=("--node" "127.0.0.1:${port}")
-    done
+    if [ "$retranslyatorov" -gt 0 ]; then
+        for ((gruppa = 0; gruppa < retranslyatorov; ++gruppa)); do
+            port_releya=$((koordinator_port - 1 - gruppa))
+            relej_args=("--parent" "127.0.0.1:${koordinator_port}")
+            for ((indeks = gruppa * vetvlenie; indeks < kolichestvo && indeks < (gruppa + 1) * vetvlenie; ++indeks)); do
+                relej_args+=("--node" "127.0.0.1:$((bazovyj_port + indeks))")
+            done
+            "$build_dir/kolibri_coordinator" --listen "$port_releya" "${relej_args[@]}" \
+                >"$cluster_dir/relay_${gruppa}.log" 2>&1 &
+            pids+=($!)
+            targets_args+=("--node" "127.0.0.1:${port_releya}")
+        done
+        echo "[Рой] Запущено ретрансляторов: $retranslyatorov"
+    else
+        for ((indeks = 0; indeks < kolichestvo; ++indeks)); do
+            port=$((bazovyj_port + indeks))
+            targets_args+=("--node" "127.0.0.1:${port}")
+        done
+    fi
     "$build_dir/kolibri_coordinator" --listen "$koordinator_port" "${targets_args[@]}" \
         >"$cluster_dir/coordinator.log" 2>&1 &
     pids+=($!)
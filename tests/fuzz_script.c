@@ -15,6 +15,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 
     KolibriScript script;
     if (ks_init(&script, &pool, &genome) != 0) {
+        kf_pool_destroy(&pool);
         return 0;
     }
 
@@ -30,5 +31,6 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
     }
 
     ks_free(&script);
+    kf_pool_destroy(&pool);
     return 0;
 }
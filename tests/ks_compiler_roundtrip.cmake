@@ -26,3 +26,44 @@ file(READ "${decoded_path}" decoded_contents)
 if(NOT decoded_contents STREQUAL sample_script)
     message(FATAL_ERROR "Декодированный текст не совпадает с исходным")
 endif()
+
+# Образ байткода: магия KSBC в начале файла.
+set(image_path "${CMAKE_CURRENT_BINARY_DIR}/ks_roundtrip.ksc")
+execute_process(
+    COMMAND "${ks_compiler}" --bytecode "${sample_path}" -o "${image_path}"
+    RESULT_VARIABLE bytecode_result
+)
+if(NOT bytecode_result EQUAL 0)
+    message(FATAL_ERROR "ks_compiler не смог скомпилировать сценарий в байткод")
+endif()
+
+file(READ "${image_path}" image_magic LIMIT 4)
+if(NOT image_magic STREQUAL "KSBC")
+    message(FATAL_ERROR "Образ байткода не начинается с KSBC")
+endif()
+
+# Несколько входов за один вызов: результаты ложатся в каталог -o.
+set(batch_dir "${CMAKE_CURRENT_BINARY_DIR}/ks_roundtrip_batch")
+file(REMOVE_RECURSE "${batch_dir}")
+file(MAKE_DIRECTORY "${batch_dir}")
+set(second_path "${CMAKE_CURRENT_BINARY_DIR}/ks_roundtrip_second.ks")
+file(WRITE "${second_path}" "второй\n")
+execute_process(
+    COMMAND "${ks_compiler}" -j 2 "${sample_path}" "${second_path}" -o "${batch_dir}"
+    RESULT_VARIABLE batch_result
+)
+if(NOT batch_result EQUAL 0)
+    message(FATAL_ERROR "ks_compiler не смог закодировать несколько файлов")
+endif()
+
+execute_process(
+    COMMAND "${ks_compiler}" --decode "${batch_dir}/ks_roundtrip_second.ksd"
+    OUTPUT_VARIABLE batch_decoded
+    RESULT_VARIABLE batch_decode_result
+)
+if(NOT batch_decode_result EQUAL 0 OR NOT batch_decoded STREQUAL "второй\n")
+    message(FATAL_ERROR "Пакетный результат не декодируется обратно")
+endif()
+if(NOT EXISTS "${batch_dir}/ks_roundtrip.ksd")
+    message(FATAL_ERROR "Нет результата для первого входа пакета")
+endif()
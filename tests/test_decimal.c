@@ -44,8 +44,55 @@ static void test_text_roundtrip(void) {
   assert(strcmp(text, decoded) == 0);
 }
 
+static void test_bulk_codec(void) {
+  unsigned char bytes[301];
+  for (size_t i = 0; i < sizeof(bytes); ++i) {
+    bytes[i] = (unsigned char)((i * 37U + 11U) & 0xFFU);
+  }
+  uint8_t digits[sizeof(bytes) * 3U];
+  char ascii[sizeof(bytes) * 3U];
+  unsigned char restored[sizeof(bytes)];
+  k_encode_digits_bulk(bytes, sizeof(bytes), digits);
+  k_encode_ascii_bulk(bytes, sizeof(bytes), ascii);
+  for (size_t i = 0; i < sizeof(bytes); ++i) {
+    assert(digits[i * 3U] == bytes[i] / 100U);
+    assert(digits[i * 3U + 1U] == (bytes[i] / 10U) % 10U);
+    assert(digits[i * 3U + 2U] == bytes[i] % 10U);
+    assert(ascii[i * 3U] == (char)('0' + digits[i * 3U]));
+  }
+  assert(k_decode_digits_bulk(digits, sizeof(digits), restored) == 0);
+  assert(memcmp(bytes, restored, sizeof(bytes)) == 0);
+  memset(restored, 0, sizeof(restored));
+  assert(k_decode_ascii_bulk(ascii, sizeof(ascii), restored) == 0);
+  assert(memcmp(bytes, restored, sizeof(bytes)) == 0);
+
+  assert(k_decode_digits_bulk(digits, sizeof(digits) - 1U, restored) != 0);
+  digits[40] = 10U;
+  assert(k_decode_digits_bulk(digits, sizeof(digits), restored) != 0);
+  ascii[3] = '2';
+  ascii[4] = '5';
+  ascii[5] = '6';
+  assert(k_decode_ascii_bulk(ascii, sizeof(ascii), restored) != 0);
+}
+
+static void test_long_text_roundtrip(void) {
+  char text[700];
+  for (size_t i = 0; i + 1U < sizeof(text); ++i) {
+    text[i] = (char)('a' + (i % 26U));
+  }
+  text[sizeof(text) - 1U] = '\0';
+  static char encoded[sizeof(text) * 3U];
+  static char decoded[sizeof(text)];
+  assert(k_encode_text(text, encoded, sizeof(encoded)) == 0);
+  assert(strlen(encoded) == (sizeof(text) - 1U) * 3U);
+  assert(k_decode_text(encoded, decoded, sizeof(decoded)) == 0);
+  assert(strcmp(text, decoded) == 0);
+}
+
 void test_decimal(void) {
   test_transducer_roundtrip();
   test_digit_stream_bounds();
   test_text_roundtrip();
+  test_bulk_codec();
+  test_long_text_roundtrip();
 }
@@ -1,9 +1,12 @@
 #include "kolibri/formula.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void teach_linear_task(KolibriFormulaPool *pool) {
   for (int i = 0; i < 4; ++i) {
@@ -33,6 +36,8 @@ static void assert_deterministic(void) {
       kf_formula_digits(best_second, digits_second, sizeof(digits_second));
   assert(len_first == len_second);
   assert(memcmp(digits_first, digits_second, len_first) == 0);
+  kf_pool_destroy(first);
+  kf_pool_destroy(second);
   free(first);
   free(second);
 }
@@ -54,12 +59,13 @@ static void test_feedback_adjustment(void) {
   const KolibriFormula *after_penalty = kf_pool_best(&pool);
   assert(after_penalty != NULL);
   assert(after_penalty->fitness >= 0.0);
+  kf_pool_destroy(&pool);
 }
 
 static void test_sampling_controls(void) {
   KolibriFormulaPool pool;
   kf_pool_init(&pool, 11);
-  size_t capacity = sizeof(pool.formulas) / sizeof(pool.formulas[0]);
+  size_t capacity = KOLIBRI_POOL_CAPACITY;
 
   kf_pool_set_sampling(&pool, 0.05, 0);
   assert(fabs(pool.temperature - 0.1) < 1e-9);
@@ -72,6 +78,382 @@ static void test_sampling_controls(void) {
   kf_pool_set_sampling(&pool, 9.0, capacity + 7);
   assert(fabs(pool.temperature - 2.0) < 1e-9);
   assert(pool.top_k == capacity);
+  kf_pool_destroy(&pool);
+}
+
+static void test_ranked_views(void) {
+  KolibriFormulaPool *pool = malloc(sizeof(*pool));
+  assert(pool);
+  kf_pool_init(pool, 99);
+  teach_linear_task(pool);
+  assert(kf_pool_add_association(pool, NULL, "привет", "здравствуй", "test", 1U) == 0);
+  kf_pool_tick(pool, 16);
+
+  KolibriFormula previous;
+  assert(kf_pool_formula(pool, 0, &previous) == 0);
+  assert(previous.fitness == kf_pool_best(pool)->fitness);
+  for (size_t rank = 1; rank < pool->count; ++rank) {
+    KolibriFormula current;
+    assert(kf_pool_formula(pool, rank, &current) == 0);
+    assert(current.fitness <= previous.fitness);
+    previous = current;
+  }
+  KolibriFormula missing;
+  assert(kf_pool_formula(pool, pool->count, &missing) == -1);
+
+  /* Лучшая формула отвечает из общего хранилища ассоциаций. */
+  char answer[64];
+  const KolibriFormula *best = kf_pool_best(pool);
+  assert(kf_formula_lookup_answer(best, kf_hash_from_text("привет"), answer, sizeof(answer)) == 0);
+  assert(strcmp(answer, "здравствуй") == 0);
+
+  /* Вытеснение не сдвигает слоты: переполнение заменяет только самую старую запись. */
+  for (int i = 0; i < KOLIBRI_POOL_MAX_ASSOCIATIONS; ++i) {
+    char question[32];
+    snprintf(question, sizeof(question), "вопрос %d", i);
+    kf_pool_add_association(pool, NULL, question, "ответ", "test", 2U);
+  }
+  assert(pool->association_count == KOLIBRI_POOL_MAX_ASSOCIATIONS);
+  assert(pool->association_head == 1U);
+  assert(strcmp(pool->associations[0].question, "вопрос 63") == 0);
+  assert(strcmp(pool->associations[1].question, "вопрос 0") == 0);
+
+  KolibriFormula imported;
+  memset(&imported, 0, sizeof(imported));
+  imported.gene = kf_pool_best(pool)->gene;
+  imported.fitness = 1.0;
+  assert(kf_pool_import(pool, &imported) == 0);
+  assert(kf_pool_best(pool)->fitness == 1.0);
+  kf_pool_destroy(pool);
+  free(pool);
+}
+
+static void run_islands_with_threads(KolibriFormulaPool *pool, size_t threads) {
+  kf_pool_init(pool, 4242);
+  teach_linear_task(pool);
+  kf_pool_set_islands(pool, 4, 4, threads);
+  kf_pool_tick_parallel(pool, 12);
+}
+
+static void test_island_evolution(void) {
+  KolibriFormulaPool *single = malloc(sizeof(*single));
+  KolibriFormulaPool *multi = malloc(sizeof(*multi));
+  assert(single && multi);
+
+  /* Результат не зависит от числа потоков. */
+  run_islands_with_threads(single, 1);
+  run_islands_with_threads(multi, 3);
+  assert(single->best.fitness == multi->best.fitness);
+  assert(memcmp(&single->best.gene, &multi->best.gene, sizeof(KolibriGene)) == 0);
+  for (size_t rank = 1; rank < multi->count; ++rank) {
+    assert(multi->fitness[multi->order[rank]] <= multi->fitness[multi->order[rank - 1]]);
+  }
+  int output = 0;
+  assert(kf_formula_apply(kf_pool_best(multi), 5, &output) == 0);
+  assert(kf_pool_profile(multi)->generation_steps >= 12U);
+
+  /* Один остров сводится к обычному kf_pool_tick. */
+  kf_pool_destroy(single);
+  kf_pool_destroy(multi);
+  kf_pool_init(single, 4242);
+  teach_linear_task(single);
+  kf_pool_init(multi, 4242);
+  teach_linear_task(multi);
+  kf_pool_set_islands(multi, 1, 4, 0);
+  kf_pool_tick(single, 6);
+  kf_pool_tick_parallel(multi, 6);
+  assert(single->best.fitness == multi->best.fitness);
+
+  kf_pool_destroy(single);
+  kf_pool_destroy(multi);
+  free(single);
+  free(multi);
+}
+
+static void test_runtime_capacity(void) {
+  KolibriFormulaPool pool;
+  KolibriPoolCapacity invalid = {0, 16, 16};
+  assert(kf_pool_init_with_capacity(&pool, &invalid, 1) == -1);
+  assert(pool.count == 0 && pool.arena == NULL);
+
+  KolibriPoolCapacity capacity = {600, 5000, 100};
+  assert(kf_pool_init_with_capacity(&pool, &capacity, 2024) == 0);
+  assert(pool.count == 600);
+  for (int i = 0; i < 5000; ++i) {
+    assert(kf_pool_add_example(&pool, i % 8, 2 * (i % 8) + 1) == 0);
+  }
+  assert(kf_pool_add_example(&pool, 1, 3) == -1);
+
+  /* Большой пул ранжируется слиянием; порядок остаётся перестановкой. */
+  kf_pool_tick(&pool, 3);
+  unsigned char *seen = calloc(pool.count, 1);
+  assert(seen);
+  for (size_t rank = 0; rank < pool.count; ++rank) {
+    assert(pool.order[rank] < pool.count && !seen[pool.order[rank]]);
+    seen[pool.order[rank]] = 1;
+    if (rank > 0) {
+      assert(pool.fitness[pool.order[rank]] <= pool.fitness[pool.order[rank - 1]]);
+    }
+  }
+  free(seen);
+  assert(kf_pool_best(&pool)->fitness == pool.fitness[pool.order[0]]);
+
+  kf_pool_clear_examples(&pool);
+  for (int i = 0; i <= 100; ++i) {
+    char question[32];
+    snprintf(question, sizeof(question), "q%d", i);
+    assert(kf_pool_add_association(&pool, NULL, question, "a", "test", 1U) == 0);
+  }
+  assert(pool.association_count == 100 && pool.association_head == 1);
+  kf_pool_tick(&pool, 1);
+  char answer[8];
+  assert(kf_formula_lookup_answer(kf_pool_best(&pool), kf_hash_from_text("q1"), answer, sizeof(answer)) == 0);
+  kf_pool_destroy(&pool);
+  assert(pool.arena == NULL && pool.count == 0);
+}
+
+static void test_fitness_memo(void) {
+  KolibriFormulaPool pool;
+  assert(kf_pool_init(&pool, 606) == 0);
+  teach_linear_task(&pool);
+  kf_pool_tick(&pool, 8);
+  const KolibriPoolProfile *profile = kf_pool_profile(&pool);
+  /* Каждый слот оценивается (generations + 1) раз: прогоном или из памятки;
+   * элиты переживают каждое поколение и берутся из памятки. */
+  size_t elite = pool.count / 3U;
+  assert(profile->evaluation_cache_hits + profile->evaluation_calls == 9U * pool.count);
+  assert(profile->evaluation_cache_hits >= 8U * elite);
+
+  /* Поколения попадают в гистограмму по одному разу, стадии измерены. */
+  uint64_t generations = 0U;
+  for (size_t bucket = 0; bucket < KOLIBRI_PROFILE_LATENCY_BUCKETS; ++bucket) {
+    generations += profile->generation_latency[bucket];
+  }
+  assert(profile->generation_steps == 8U && generations == 8U);
+  assert(profile->stage_ns[KOLIBRI_STAGE_EVALUATE] > 0U);
+  assert(profile->stage_ns[KOLIBRI_STAGE_COHERENCE] == 0U);
+  assert(strcmp(kf_pool_stage_name(KOLIBRI_STAGE_REPRODUCE), "reproduce") == 0);
+
+  /* Новый пример сбрасывает памятку: первый проход тика оценивает всех заново. */
+  assert(kf_pool_add_example(&pool, 10, 21) == 0);
+  uint64_t hits_before = profile->evaluation_cache_hits;
+  kf_pool_tick(&pool, 1);
+  assert(profile->evaluation_cache_hits - hits_before <= pool.count);
+  kf_pool_destroy(&pool);
+}
+
+static void test_coherence_modes(void) {
+  KolibriFormulaPool histogram;
+  KolibriFormulaPool pairwise;
+  assert(kf_pool_init(&histogram, 515) == 0);
+  assert(kf_pool_init(&pairwise, 515) == 0);
+  teach_linear_task(&histogram);
+  teach_linear_task(&pairwise);
+  kf_pool_set_coherence_gain(&histogram, 0.4);
+  kf_pool_set_coherence_gain(&pairwise, 0.4);
+  kf_pool_set_coherence_mode(&pairwise, KOLIBRI_COHERENCE_PAIRWISE);
+  assert(histogram.coherence_mode == KOLIBRI_COHERENCE_HISTOGRAM);
+  kf_pool_tick(&histogram, 4);
+  kf_pool_tick(&pairwise, 4);
+  /* Разложение точное: расходится только округление. */
+  for (size_t rank = 0; rank < histogram.count; ++rank) {
+    double lhs = histogram.fitness[histogram.order[rank]];
+    double rhs = pairwise.fitness[pairwise.order[rank]];
+    assert(fabs(lhs - rhs) < 1e-9);
+  }
+  kf_pool_destroy(&histogram);
+  kf_pool_destroy(&pairwise);
+}
+
+static const KolibriAssociation *reference_match(const KolibriFormulaPool *pool, const char *query) {
+  char lowered_query[256];
+  size_t n = 0;
+  for (; query[n] && n + 1 < sizeof(lowered_query); ++n) {
+    lowered_query[n] = (char)tolower((unsigned char)query[n]);
+  }
+  lowered_query[n] = '\0';
+  const KolibriAssociation *best = NULL;
+  size_t best_len = 0;
+  for (size_t i = 0; i < pool->association_count; ++i) {
+    char lowered[256];
+    size_t m = 0;
+    for (; pool->associations[i].question[m]; ++m) {
+      lowered[m] = (char)tolower((unsigned char)pool->associations[i].question[m]);
+    }
+    lowered[m] = '\0';
+    if ((strstr(lowered_query, lowered) || strstr(lowered, lowered_query)) && m > best_len) {
+      best_len = m;
+      best = &pool->associations[i];
+    }
+  }
+  return best;
+}
+
+static void test_association_index(void) {
+  KolibriPoolCapacity capacity = {8U, 512U, 16U};
+  KolibriFormulaPool pool;
+  assert(kf_pool_init_with_capacity(&pool, &capacity, 61U) == 0);
+  assert(kf_pool_add_association(&pool, NULL, "как тебя зовут", "Колибри", "test", 1U) == 0);
+  assert(kf_pool_add_association(&pool, NULL, "как", "так", "test", 1U) == 0);
+  assert(kf_pool_add_association(&pool, NULL, "Hello world", "hi", "test", 1U) == 0);
+
+  /* Точный вопрос находится по хешу, повторное обучение заменяет ответ. */
+  assert(strcmp(kf_pool_find_association(&pool, "как")->answer, "так") == 0);
+  assert(kf_pool_find_association(&pool, "Hello") == NULL);
+  assert(kf_pool_add_association(&pool, NULL, "Hello world", "hello", "test", 2U) == 0);
+  assert(pool.association_count == 3U);
+  assert(strcmp(kf_pool_find_association(&pool, "Hello world")->answer, "hello") == 0);
+
+  /* Частичное совпадение: самый длинный вопрос, вложенный в запрос или вмещающий его. */
+  assert(strcmp(kf_pool_match_association(&pool, "скажи, как тебя зовут?")->answer, "Колибри") == 0);
+  assert(strcmp(kf_pool_match_association(&pool, "WORLD")->answer, "hello") == 0);
+  assert(kf_pool_match_association(&pool, "пока") == NULL);
+
+  /* После вытеснений индекс совпадает с полным перебором. */
+  KolibriRng rng;
+  k_rng_seed(&rng, 7U);
+  const char *words[] = {"ab", "hello", "мир", "x", "World", "как дела", "abc"};
+  for (int step = 0; step < 400; ++step) {
+    char question[96] = "";
+    int parts = 1 + (int)(k_rng_next(&rng) % 3U);
+    for (int p = 0; p < parts; ++p) {
+      strcat(question, words[k_rng_next(&rng) % 7U]);
+      if (k_rng_next(&rng) % 2U) {
+        strcat(question, " ");
+      }
+    }
+    if (k_rng_next(&rng) % 2U) {
+      assert(kf_pool_add_association(&pool, NULL, question, "a", "test", (uint64_t)step) == 0);
+      assert(kf_pool_find_association(&pool, question) != NULL);
+    }
+    const KolibriAssociation *expected = reference_match(&pool, question);
+    assert(kf_pool_match_association(&pool, question) == expected);
+    if (pool.examples >= pool.example_capacity) {
+      kf_pool_clear_examples(&pool);
+      assert(kf_pool_match_association(&pool, "hello") == NULL);
+    }
+  }
+  kf_pool_destroy(&pool);
+}
+
+static void assert_same_pool(const KolibriFormulaPool *lhs, const KolibriFormulaPool *rhs) {
+  assert(lhs->count == rhs->count && lhs->examples == rhs->examples);
+  for (size_t rank = 0; rank < lhs->count; ++rank) {
+    KolibriFormula a;
+    KolibriFormula b;
+    assert(kf_pool_formula(lhs, rank, &a) == 0);
+    assert(kf_pool_formula(rhs, rank, &b) == 0);
+    assert(a.gene.length == b.gene.length);
+    assert(memcmp(a.gene.digits, b.gene.digits, a.gene.length) == 0);
+    assert(a.fitness == b.fitness && a.feedback == b.feedback);
+    assert(a.association_count == b.association_count);
+  }
+}
+
+static void test_checkpoint(void) {
+  KolibriPoolCapacity capacity = {12U, 16U, 4U};
+  KolibriFormulaPool pool;
+  assert(kf_pool_init_with_capacity(&pool, &capacity, 31U) == 0);
+  teach_linear_task(&pool);
+  char question[32];
+  /* Шесть вопросов в хранилище на четыре: кольцо уже провернулось. */
+  for (int i = 0; i < 6; ++i) {
+    snprintf(question, sizeof(question), "вопрос номер %d", i);
+    assert(kf_pool_add_association(&pool, NULL, question, "ответ", "test", (uint64_t)i) == 0);
+  }
+  kf_pool_set_sampling(&pool, 0.5, 6U);
+  kf_pool_tick(&pool, 16);
+  assert(kf_pool_feedback(&pool, &kf_pool_best(&pool)->gene, 0.25) == 0);
+
+  char path[] = "/tmp/kolibri_poolXXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  fclose(fdopen(fd, "wb"));
+  assert(kf_pool_save_checkpoint(&pool, path) == 0);
+
+  KolibriFormulaPool restored;
+  assert(kf_pool_load_checkpoint(&restored, path) == 0);
+  assert_same_pool(&pool, &restored);
+  assert(restored.association_count == 4U && restored.association_head == pool.association_head);
+  assert(restored.temperature == 0.5 && restored.top_k == 6U);
+  assert(kf_pool_find_association(&restored, "вопрос номер 1") == NULL);
+  const KolibriAssociation *found = kf_pool_find_association(&restored, "вопрос номер 5");
+  assert(found && strcmp(found->answer, "ответ") == 0 && found->timestamp == 5U);
+  assert(kf_pool_match_association(&restored, "номер 4") != NULL);
+
+  /* Генератор и настройки восстановлены: дальше пулы эволюционируют одинаково. */
+  kf_pool_tick(&pool, 8);
+  kf_pool_tick(&restored, 8);
+  assert_same_pool(&pool, &restored);
+  kf_pool_destroy(&restored);
+
+  FILE *file = fopen(path, "r+b");
+  assert(file != NULL);
+  fseek(file, -1L, SEEK_END);
+  int last = fgetc(file);
+  fseek(file, -1L, SEEK_END);
+  fputc(last ^ 0x5a, file);
+  fclose(file);
+  assert(kf_pool_load_checkpoint(&restored, path) == -3);
+  assert(restored.arena == NULL);
+
+  assert(truncate(path, 100) == 0);
+  assert(kf_pool_load_checkpoint(&restored, path) == -2);
+  remove(path);
+  assert(kf_pool_load_checkpoint(&restored, path) == -1);
+  kf_pool_destroy(&pool);
+}
+
+/* Векторная пакетная оценка (AVX2/NEON/wasm SIMD) обязана совпадать со скалярной
+ * kf_formula_apply на каждом гене, включая хвост набора и насыщение до int32. */
+static void test_batch_kernel_matches_scalar(void) {
+#if defined(KOLIBRI_EXPECT_AVX2)
+  assert(strcmp(kf_formula_batch_kernel(), "avx2") == 0);
+#endif
+  enum { BATCH_EXAMPLES = 37 };
+  int inputs[BATCH_EXAMPLES];
+  int targets[BATCH_EXAMPLES];
+  KolibriRng rng;
+  k_rng_seed(&rng, 14U);
+  for (size_t i = 0; i < BATCH_EXAMPLES; ++i) {
+    inputs[i] = (int)(k_rng_next(&rng) % 2001U) - 1000;
+    targets[i] = (int)(k_rng_next(&rng) % 20001U) - 10000;
+  }
+  /* k*x выходит за int32 и насыщается; x*x*k для операции 3 ещё укладывается в int64. */
+  inputs[3] = 300000000;
+  inputs[8] = -300000000;
+  inputs[13] = 30000000;
+  targets[21] = INT32_MIN;
+  for (int trial = 0; trial < 512; ++trial) {
+    KolibriFormula formula;
+    memset(&formula, 0, sizeof(formula));
+    formula.gene.length = 12U;
+    for (size_t d = 0; d < formula.gene.length; ++d) {
+      formula.gene.digits[d] = (uint8_t)(k_rng_next(&rng) % 10U);
+    }
+    for (size_t count = 0; count <= BATCH_EXAMPLES; count += 1U + (size_t)(trial % 5)) {
+      int64_t expected_error = 0;
+      int64_t expected_sum = 0;
+      for (size_t i = 0; i < count; ++i) {
+        int prediction = 0;
+        assert(kf_formula_apply(&formula, inputs[i], &prediction) == 0);
+        int64_t diff = (int64_t)targets[i] - prediction;
+        expected_error += diff < 0 ? -diff : diff;
+        expected_sum += prediction;
+      }
+      int64_t error = -1;
+      int64_t sum = -1;
+      assert(kf_formula_batch_error(&formula, inputs, targets, count, &error, &sum) == 0);
+      /* Ядро целочисленное: допуск нулевой. */
+      assert(error == expected_error);
+      assert(sum == expected_sum);
+    }
+  }
+  KolibriFormula empty;
+  memset(&empty, 0, sizeof(empty));
+  int64_t error = 0;
+  assert(kf_formula_batch_error(&empty, inputs, targets, 4U, &error, NULL) == -1);
+  assert(kf_formula_batch_error(NULL, inputs, targets, 4U, &error, NULL) == -1);
 }
 
 void test_formula(void) {
@@ -97,7 +479,16 @@ void test_formula(void) {
     errors += abs((2 * i + 1) - local);
   }
   assert(errors <= baseline_errors);
+  kf_pool_destroy(&pool);
   assert_deterministic();
   test_feedback_adjustment();
   test_sampling_controls();
+  test_ranked_views();
+  test_island_evolution();
+  test_runtime_capacity();
+  test_fitness_memo();
+  test_coherence_modes();
+  test_association_index();
+  test_checkpoint();
+  test_batch_kernel_matches_scalar();
 }
@@ -36,6 +36,418 @@ static void assert_payload_digits(const char *digits) {
   }
 }
 
+static void remove_checkpoint(const char *path) {
+  char ckpt[512];
+  snprintf(ckpt, sizeof(ckpt), "%s.ckpt", path);
+  remove(ckpt);
+}
+
+static void test_genome_batch(void) {
+  char template[] = "/tmp/kolibri_genome_batchXXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "batch-key";
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  kg_set_sync_interval(&genome, 1U);
+
+  char payloads[5][KOLIBRI_PAYLOAD_SIZE];
+  KolibriGenomeEvent events[5];
+  for (size_t i = 0; i < 5U; ++i) {
+    char text[32];
+    snprintf(text, sizeof(text), "batch-%zu", i);
+    assert(kg_encode_payload(text, payloads[i], sizeof(payloads[i])) == 0);
+    events[i].event_type = "BATCH";
+    events[i].payload = payloads[i];
+  }
+
+  ReasonBlock single;
+  assert(kg_append(&genome, "TEST", payloads[0], &single) == 0);
+  ReasonBlock blocks[5];
+  assert(kg_append_batch(&genome, events, 5U, blocks) == 0);
+  for (size_t i = 0; i < 5U; ++i) {
+    assert(blocks[i].index == i + 1U);
+  }
+
+  /* Ошибка в любом событии отклоняет всю пачку и не сдвигает цепочку. */
+  events[2].payload = "notdigits";
+  assert(kg_append_batch(&genome, events, 5U, NULL) == -1);
+  events[2].payload = payloads[2];
+  assert(kg_append_batch(&genome, events, 0U, NULL) == 0);
+  assert(kg_sync(&genome) == 0);
+  assert(kg_append_batch(&genome, events, 2U, blocks) == 0);
+  assert(blocks[0].index == 6U);
+  assert(blocks[1].index == 7U);
+  kg_close(&genome);
+
+  assert(kg_verify_file(template, key, sizeof(key) - 1) == 0);
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  assert(genome.next_index == 8U);
+  kg_close(&genome);
+  remove(template);
+  remove_checkpoint(template);
+}
+
+/* fdatasync на канале даёт EINVAL: fwrite проходит, а плановая синхронизация нет. */
+static void test_genome_sync_failure(void) {
+  char template[] = "/tmp/kolibri_genome_syncXXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "sync-key";
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("sync", payload, sizeof(payload)) == 0);
+  assert(kg_append(&genome, "TEST", payload, NULL) == 0);
+
+  int pipe_fds[2];
+  assert(pipe(pipe_fds) == 0);
+  int file_fd = fileno(genome.file);
+  int saved_fd = dup(file_fd);
+  assert(saved_fd != -1);
+  assert(dup2(pipe_fds[1], file_fd) == file_fd);
+
+  kg_set_sync_interval(&genome, 1U);
+  usleep(2000);
+  KolibriGenomeEvent events[2] = {{"BATCH", payload}, {"BATCH", payload}};
+  ReasonBlock blocks[2];
+  /* Блоки уже в цепочке: вызывающий не должен писать их повторно. */
+  assert(kg_append_batch(&genome, events, 2U, blocks) ==
+         KOLIBRI_GENOME_SYNC_FAILED);
+  assert(blocks[0].index == 1U && blocks[1].index == 2U);
+  assert(genome.next_index == 3U);
+
+  assert(dup2(saved_fd, file_fd) == file_fd);
+  close(saved_fd);
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  kg_set_sync_interval(&genome, 0U);
+  kg_close(&genome);
+  remove(template);
+  remove_checkpoint(template);
+}
+
+static void test_genome_checkpoint(void) {
+  char template[] = "/tmp/kolibri_genome_ckptXXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "ckpt-key";
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("checkpoint", payload, sizeof(payload)) == 0);
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  for (int i = 0; i < 6; ++i) {
+    assert(kg_append(&genome, "TEST", payload, NULL) == 0);
+  }
+  kg_close(&genome);
+
+  char ckpt[512];
+  snprintf(ckpt, sizeof(ckpt), "%s.ckpt", template);
+  FILE *f = fopen(ckpt, "rb");
+  assert(f != NULL);
+  fclose(f);
+
+  /* Хвост после контрольной точки проверяется и продолжает цепочку. */
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  assert(genome.next_index == 6U);
+  assert(kg_append(&genome, "TEST", payload, NULL) == 0);
+  kg_close(&genome);
+  assert(kg_verify_file_threads(template, key, sizeof(key) - 1, 4U) == 0);
+
+  /* Контрольная точка с чужой подписью игнорируется, геном проверяется целиком. */
+  f = fopen(ckpt, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, 8L, SEEK_SET) == 0);
+  fputc(0x7f, f);
+  fclose(f);
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  assert(genome.next_index == 7U);
+  kg_close(&genome);
+
+  /* Порча блока в последнем диапазоне видна параллельной проверке. */
+  f = fopen(template, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, (long)KOLIBRI_BLOCK_SIZE * 6L + 120L, SEEK_SET) == 0);
+  int byte = fgetc(f);
+  assert(byte != EOF);
+  assert(fseek(f, (long)KOLIBRI_BLOCK_SIZE * 6L + 120L, SEEK_SET) == 0);
+  fputc((byte == 0x30) ? 0x31 : 0x30, f);
+  fclose(f);
+  assert(kg_verify_file_threads(template, key, sizeof(key) - 1, 4U) == -1);
+  assert(kg_verify_file_threads(template, key, sizeof(key) - 1, 1U) == -1);
+
+  remove(template);
+  remove_checkpoint(template);
+}
+
+static long file_size(const char *path) {
+  FILE *f = fopen(path, "rb");
+  assert(f != NULL);
+  assert(fseek(f, 0, SEEK_END) == 0);
+  long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+static void test_genome_v2(void) {
+  char template[] = "/tmp/kolibri_genome_v2XXXXXX";
+  int fd = mkstemp(template);
+  assert(fd != -1);
+  close(fd);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "v2-key";
+  KolibriGenomeOptions options = {.format = KOLIBRI_GENOME_FORMAT_V2,
+                                  .flags = KOLIBRI_GENOME_COMPRESS};
+  assert(kg_open_with(&genome, template, key, sizeof(key) - 1, &options) == 0);
+  assert(genome.format == KOLIBRI_GENOME_FORMAT_V2);
+
+  char payloads[4][KOLIBRI_PAYLOAD_SIZE];
+  KolibriGenomeEvent events[4];
+  static const char *const types[4] = {"TEACH", "ASK", "TEACH", ""};
+  for (size_t i = 0; i < 4U; ++i) {
+    char text[32];
+    snprintf(text, sizeof(text), "v2-%zu%s", i, i == 1 ? "x" : "");
+    assert(kg_encode_payload(text, payloads[i], sizeof(payloads[i])) == 0);
+    events[i].event_type = types[i];
+    events[i].payload = payloads[i];
+  }
+  events[3].payload = "";
+
+  ReasonBlock written[6];
+  assert(kg_append(&genome, "BOOT", payloads[0], &written[0]) == 0);
+  assert(kg_append_batch(&genome, events, 4U, &written[1]) == 0);
+  kg_close(&genome);
+
+  /* Открытие по умолчанию сохраняет формат файла и продолжает словарь. */
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == 0);
+  assert(genome.format == KOLIBRI_GENOME_FORMAT_V2);
+  assert(genome.next_index == 5U);
+  assert(genome.types.count == 4U);
+  assert(kg_append(&genome, "ASK", payloads[1], &written[5]) == 0);
+  kg_close(&genome);
+  assert(file_size(template) < 6L * (long)KOLIBRI_BLOCK_SIZE / 2L);
+  assert(kg_verify_file_threads(template, key, sizeof(key) - 1, 3U) == 0);
+
+  KolibriGenomeReader reader;
+  ReasonBlock block;
+  assert(kg_reader_open(&reader, template) == 0);
+  for (size_t i = 0; i < 6U; ++i) {
+    assert(kg_reader_next(&reader, &block) == 1);
+    assert(memcmp(&block, &written[i], sizeof(block)) == 0);
+  }
+  assert(kg_reader_next(&reader, &block) == 0);
+  assert(kg_reader_seek(&reader, 3U) == 0);
+  assert(kg_reader_next(&reader, &block) == 1);
+  assert(memcmp(&block, &written[3], sizeof(block)) == 0);
+  kg_reader_close(&reader);
+
+  /* Байт последней записи подписан так же, как в v1. */
+  FILE *f = fopen(template, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, -1L, SEEK_END) == 0);
+  int byte = fgetc(f);
+  assert(byte != EOF);
+  assert(fseek(f, -1L, SEEK_END) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+  assert(kg_verify_file(template, key, sizeof(key) - 1) == -1);
+  assert(kg_open(&genome, template, key, sizeof(key) - 1) == -1);
+
+  remove(template);
+  remove_checkpoint(template);
+}
+
+/* v1 → v2 → v1 сохраняет цепочку байт в байт. */
+static void test_genome_convert(void) {
+  char v1_path[] = "/tmp/kolibri_genome_cv1XXXXXX";
+  int fd = mkstemp(v1_path);
+  assert(fd != -1);
+  close(fd);
+  char v2_path[64];
+  char back_path[64];
+  snprintf(v2_path, sizeof(v2_path), "%s.v2", v1_path);
+  snprintf(back_path, sizeof(back_path), "%s.v1", v1_path);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "convert-key";
+  assert(kg_open(&genome, v1_path, key, sizeof(key) - 1) == 0);
+  char payloads[8][KOLIBRI_PAYLOAD_SIZE];
+  KolibriGenomeEvent events[8];
+  for (size_t i = 0; i < 8U; ++i) {
+    char text[48];
+    snprintf(text, sizeof(text), "событие номер %zu", i);
+    assert(kg_encode_payload(text, payloads[i], sizeof(payloads[i])) == 0);
+    events[i].event_type = (i % 3U) ? "TEACH" : "USER_FEEDBACK";
+    events[i].payload = payloads[i];
+  }
+  for (size_t round = 0; round < 700U; ++round) {
+    assert(kg_append_batch(&genome, events, 8U, NULL) == 0);
+  }
+  kg_close(&genome);
+
+  KolibriGenomeOptions v2 = {.format = KOLIBRI_GENOME_FORMAT_V2,
+                             .flags = KOLIBRI_GENOME_COMPRESS};
+  KolibriGenomeOptions v1 = {.format = KOLIBRI_GENOME_FORMAT_V1};
+  assert(kg_convert_file(v1_path, v2_path, key, sizeof(key) - 1, &v2) == 0);
+  assert(file_size(v2_path) * 4L < file_size(v1_path));
+  assert(kg_verify_file_threads(v2_path, key, sizeof(key) - 1, 4U) == 0);
+  assert(kg_convert_file(v2_path, back_path, key, sizeof(key) - 1, &v1) == 0);
+
+  long size = file_size(v1_path);
+  assert(file_size(back_path) == size);
+  unsigned char *original = (unsigned char *)malloc((size_t)size);
+  unsigned char *restored = (unsigned char *)malloc((size_t)size);
+  assert(original && restored);
+  FILE *f = fopen(v1_path, "rb");
+  assert(f && fread(original, 1, (size_t)size, f) == (size_t)size);
+  fclose(f);
+  f = fopen(back_path, "rb");
+  assert(f && fread(restored, 1, (size_t)size, f) == (size_t)size);
+  fclose(f);
+  assert(memcmp(original, restored, (size_t)size) == 0);
+  free(original);
+  free(restored);
+
+  /* Продолжение сконвертированного генома принимается с контрольной точкой. */
+  assert(kg_open(&genome, v2_path, key, sizeof(key) - 1) == 0);
+  assert(genome.next_index == 5600U);
+  assert(kg_append(&genome, "TEACH", payloads[0], NULL) == 0);
+  kg_close(&genome);
+  assert(kg_verify_file(v2_path, key, sizeof(key) - 1) == 0);
+
+  const unsigned char wrong[] = "other-key";
+  assert(kg_convert_file(v1_path, back_path, wrong, sizeof(wrong) - 1, &v2) == -1);
+
+  remove(v1_path);
+  remove_checkpoint(v1_path);
+  remove(v2_path);
+  remove_checkpoint(v2_path);
+  remove(back_path);
+  remove_checkpoint(back_path);
+}
+
+static void remove_segments(const char *path) {
+  char name[96];
+  for (unsigned int segment = 0; segment < 64U; ++segment) {
+    if (segment == 0) {
+      snprintf(name, sizeof(name), "%s", path);
+    } else {
+      snprintf(name, sizeof(name), "%s.%u", path, segment);
+    }
+    remove(name);
+    strncat(name, ".idx", sizeof(name) - strlen(name) - 1);
+    remove(name);
+  }
+  remove_checkpoint(path);
+}
+
+static void test_genome_segments_format(int format) {
+  char path[] = "/tmp/kolibri_genome_segXXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  close(fd);
+  remove(path);
+
+  KolibriGenome genome;
+  const unsigned char key[] = "segment-key";
+  KolibriGenomeOptions options = {.format = format,
+                                  .segment_bytes = 16U * 1024U};
+  assert(kg_open_with(&genome, path, key, sizeof(key) - 1, &options) == 0);
+  char payload[KOLIBRI_PAYLOAD_SIZE];
+  assert(kg_encode_payload("сегментированный журнал", payload,
+                           sizeof(payload)) == 0);
+  KolibriGenomeEvent events[4];
+  for (size_t i = 0; i < 4U; ++i) {
+    events[i].event_type = (i % 2U) ? "TEACH" : "USER_FEEDBACK";
+    events[i].payload = payload;
+  }
+  KolibriGenomeEvent audit = {"AUDIT", payload};
+  ReasonBlock blocks[4];
+  uint64_t probe_time = 0;
+  for (size_t round = 0; round < 300U; ++round) {
+    assert(kg_append_batch(&genome, round == 250U ? &audit : events,
+                           round == 250U ? 1U : 4U, blocks) == 0);
+    if (round == 200U) {
+      probe_time = blocks[0].timestamp;
+    }
+  }
+  assert(genome.segment > 1U);
+  uint64_t total = genome.next_index;
+  assert(total == 299U * 4U + 1U);
+  kg_close(&genome);
+
+  char name[96];
+  snprintf(name, sizeof(name), "%s.1", path);
+  assert(file_size(name) > 0);
+  snprintf(name, sizeof(name), "%s.idx", path);
+  assert(file_size(name) > 0);
+  assert(kg_verify_file_threads(path, key, sizeof(key) - 1, 2U) == 0);
+
+  /* Повторное открытие продолжает цепочку в последнем сегменте. */
+  assert(kg_open_with(&genome, path, key, sizeof(key) - 1, &options) == 0);
+  assert(genome.next_index == total);
+  assert(genome.format == format);
+  assert(kg_append(&genome, "TEACH", payload, NULL) == 0);
+  kg_close(&genome);
+  total += 1U;
+  assert(kg_verify_file(path, key, sizeof(key) - 1) == 0);
+
+  KolibriGenomeReader reader;
+  ReasonBlock block;
+  assert(kg_reader_open(&reader, path) == 0);
+  assert(kg_reader_seek(&reader, 777U) == 0);
+  assert(kg_reader_next(&reader, &block) == 1 && block.index == 777U);
+  assert(kg_reader_seek(&reader, 12U) == 0);
+  assert(kg_reader_next(&reader, &block) == 1 && block.index == 12U);
+
+  assert(kg_reader_seek_time(&reader, probe_time) == 0);
+  assert(kg_reader_next(&reader, &block) == 1);
+  assert(block.timestamp >= probe_time && block.index <= 800U);
+  ReasonBlock before;
+  size_t got = 0;
+  assert(kg_read_range(path, block.index - 1U, 1U, &before, &got) == 0);
+  assert(got == 1U && before.timestamp < probe_time);
+
+  assert(kg_reader_seek(&reader, 0U) == 0);
+  assert(kg_reader_next_type(&reader, "AUDIT", &block) == 1);
+  assert(block.index == 1000U && strcmp(block.event_type, "AUDIT") == 0);
+  assert(kg_reader_next_type(&reader, "AUDIT", &block) == 0);
+  assert(kg_reader_next_type(&reader, "MISSING", &block) == 0);
+  assert(kg_reader_seek_time(&reader, UINT64_MAX) == 0);
+  assert(kg_reader_next(&reader, &block) == 0);
+  kg_reader_close(&reader);
+
+  ReasonBlock tail[64];
+  assert(kg_read_range(path, total - 10U, 64U, tail, &got) == 0);
+  assert(got == 10U && tail[9].index == total - 1U);
+
+  /* Подмена байта в закрытом сегменте обнаруживается полной проверкой. */
+  snprintf(name, sizeof(name), "%s.1", path);
+  FILE *f = fopen(name, "r+b");
+  assert(f != NULL);
+  assert(fseek(f, -1L, SEEK_END) == 0);
+  int byte = fgetc(f);
+  assert(byte != EOF);
+  assert(fseek(f, -1L, SEEK_END) == 0);
+  fputc(byte ^ 0x01, f);
+  fclose(f);
+  assert(kg_verify_file(path, key, sizeof(key) - 1) == -1);
+
+  remove_segments(path);
+}
+
+static void test_genome_segments(void) {
+  test_genome_segments_format(KOLIBRI_GENOME_FORMAT_V1);
+  test_genome_segments_format(KOLIBRI_GENOME_FORMAT_V2);
+}
+
 void test_genome(void) {
   char template[] = "/tmp/kolibri_genomeXXXXXX";
   int fd = mkstemp(template);
@@ -155,7 +567,15 @@ void test_genome(void) {
   assert(rc == -1);
 
   remove(template);
+  remove_checkpoint(template);
 
   rc = kg_verify_file(template, key, sizeof(key) - 1);
   assert(rc == 1);
+
+  test_genome_batch();
+  test_genome_sync_failure();
+  test_genome_checkpoint();
+  test_genome_v2();
+  test_genome_convert();
+  test_genome_segments();
 }
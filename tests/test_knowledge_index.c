@@ -1,7 +1,9 @@
 #include "kolibri/knowledge_index.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static int write_markdown(const char *path, const char *content) {
     FILE *f = fopen(path, "wb");
@@ -17,6 +19,519 @@ static void cleanup(void) {
     system("rm -rf ./test_data");
 }
 
+static void fail(KolibriKnowledgeIndex *index, const char *message) {
+    fprintf(stderr, "%s\n", message);
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+    exit(1);
+}
+
+static void expect_single_hit(KolibriKnowledgeIndex *index, const char *query, const char *expected_id) {
+    size_t indices[4];
+    float scores[4];
+    size_t result_count = 0U;
+    if (kolibri_knowledge_index_search(index, query, 4U, indices, scores, &result_count) != 0) {
+        fail(index, "search returned error");
+    }
+    if (result_count != 1U) {
+        fprintf(stderr, "query '%s': expected 1 hit, got %zu\n", query, result_count);
+        fail(index, "unexpected hit count");
+    }
+    const KolibriKnowledgeDoc *doc = kolibri_knowledge_index_document(index, indices[0]);
+    if (!doc || strcmp(doc->id, expected_id) != 0 || scores[0] <= 0.0f) {
+        fail(index, "unexpected document for query");
+    }
+}
+
+static void test_knowledge_index_postings(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    write_markdown("./test_data/one.md", "# One\nalpha shared\n");
+    write_markdown("./test_data/two.md", "# Two\nbeta shared\n");
+    write_markdown("./test_data/three.md", "# Three\ngamma shared gamma\n");
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "postings index build failed");
+    }
+    expect_single_hit(index, "beta", "two");
+    expect_single_hit(index, "gamma unknownword", "three");
+
+    size_t indices[4];
+    float scores[4];
+    size_t result_count = 0U;
+    if (kolibri_knowledge_index_search(index, "shared", 4U, indices, scores, &result_count) != 0 ||
+        result_count != 3U) {
+        fail(index, "shared term should match every document");
+    }
+    if (kolibri_knowledge_index_search(index, "missing", 4U, indices, scores, &result_count) != 0 ||
+        result_count != 0U) {
+        fail(index, "unknown term should not match");
+    }
+
+    if (kolibri_knowledge_index_write_json(index, "./test_data/out") != 0) {
+        fail(index, "write json failed");
+    }
+    kolibri_knowledge_index_destroy(index);
+    index = NULL;
+    if (kolibri_knowledge_index_load_json("./test_data/out", &index) != 0 || !index) {
+        fail(index, "load json failed");
+    }
+    expect_single_hit(index, "alpha", "one");
+    expect_single_hit(index, "gamma", "three");
+
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static void test_knowledge_index_large_vocabulary(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    char content[8192];
+    size_t offset = (size_t)snprintf(content, sizeof(content), "# Vocabulary\n");
+    for (int i = 0; i < 500 && offset < sizeof(content) - 16U; ++i) {
+        offset += (size_t)snprintf(content + offset, sizeof(content) - offset, "w%d ", i);
+    }
+    write_markdown("./test_data/vocab.md", content);
+    write_markdown("./test_data/other.md", "# Other\nw7 rare\n");
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "vocabulary index build failed");
+    }
+    if (kolibri_knowledge_index_token_count(index) != 503U) {
+        fprintf(stderr, "unexpected vocabulary size: %zu\n", kolibri_knowledge_index_token_count(index));
+        fail(index, "vocabulary size mismatch");
+    }
+    expect_single_hit(index, "rare", "other");
+
+    char query[1024];
+    size_t query_len = 0U;
+    for (int i = 0; i < 80; ++i) {
+        query_len += (size_t)snprintf(query + query_len, sizeof(query) - query_len, "w%d ", i);
+    }
+    size_t indices[4];
+    float scores[4];
+    size_t result_count = 0U;
+    if (kolibri_knowledge_index_search(index, query, 4U, indices, scores, &result_count) != 0 ||
+        result_count != 2U) {
+        fail(index, "long query should match both documents");
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static void test_knowledge_index_pruned_search(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    for (int i = 0; i < 40; ++i) {
+        char path[64];
+        char content[512];
+        size_t offset = (size_t)snprintf(content, sizeof(content), "# Doc %d\n", i);
+        for (int r = 0; r <= i % 7; ++r) {
+            offset += (size_t)snprintf(content + offset, sizeof(content) - offset, "common ");
+        }
+        for (int r = 0; r <= i % 3; ++r) {
+            offset += (size_t)snprintf(content + offset, sizeof(content) - offset, "t%d ", i % 5);
+        }
+        snprintf(content + offset, sizeof(content) - offset, "filler%d\n", i);
+        snprintf(path, sizeof(path), "./test_data/doc%02d.md", i);
+        write_markdown(path, content);
+    }
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "pruned index build failed");
+    }
+    const char *queries[] = {"common t1", "t2 t3 filler7", "common", "t4 filler12 common", "filler3"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        size_t full_indices[5];
+        float full_scores[5];
+        size_t full_count = 0U;
+        size_t pruned_indices[5];
+        float pruned_scores[5];
+        size_t pruned_count = 0U;
+        if (kolibri_knowledge_index_search(index, queries[q], 5U, full_indices, full_scores, &full_count) != 0 ||
+            kolibri_knowledge_index_search_flags(index,
+                                                 queries[q],
+                                                 5U,
+                                                 KOLIBRI_KNOWLEDGE_SEARCH_PRUNE,
+                                                 pruned_indices,
+                                                 pruned_scores,
+                                                 &pruned_count) != 0) {
+            fail(index, "search failed");
+        }
+        if (full_count == 0U || full_count != pruned_count) {
+            fail(index, "pruned search changed result count");
+        }
+        for (size_t i = 0; i < full_count; ++i) {
+            if (full_indices[i] != pruned_indices[i] || fabsf(full_scores[i] - pruned_scores[i]) > 1e-6f) {
+                fprintf(stderr, "query '%s' diverged at rank %zu\n", queries[q], i);
+                fail(index, "pruned search changed ranking");
+            }
+            if (i > 0 && full_scores[i] > full_scores[i - 1]) {
+                fail(index, "results are not sorted by score");
+            }
+        }
+
+        /* Оценки по int8-весам близки к точным; MaxScore и полный обход считают их одинаково. */
+        size_t approx_indices[5];
+        float approx_scores[5];
+        size_t approx_count = 0U;
+        size_t approx_pruned_indices[5];
+        float approx_pruned_scores[5];
+        size_t approx_pruned_count = 0U;
+        if (kolibri_knowledge_index_search_flags(index, queries[q], 5U, KOLIBRI_KNOWLEDGE_SEARCH_APPROX,
+                                                 approx_indices, approx_scores, &approx_count) != 0 ||
+            kolibri_knowledge_index_search_flags(index, queries[q], 5U,
+                                                 KOLIBRI_KNOWLEDGE_SEARCH_APPROX | KOLIBRI_KNOWLEDGE_SEARCH_PRUNE,
+                                                 approx_pruned_indices, approx_pruned_scores,
+                                                 &approx_pruned_count) != 0) {
+            fail(index, "approximate search failed");
+        }
+        if (approx_count != full_count || approx_pruned_count != full_count) {
+            fail(index, "approximate search changed result count");
+        }
+        for (size_t i = 0; i < approx_count; ++i) {
+            if (fabsf(approx_scores[i] - full_scores[i]) > 0.02f ||
+                fabsf(approx_scores[i] - approx_pruned_scores[i]) > 1e-5f) {
+                fprintf(stderr, "query '%s' approximate score diverged at rank %zu\n", queries[q], i);
+                fail(index, "approximate score out of tolerance");
+            }
+        }
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static void test_knowledge_index_binary_roundtrip(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    write_markdown("./test_data/one.md", "# One\nalpha shared\n");
+    write_markdown("./test_data/two.md", "# Two\nbeta shared \"quoted\"\n");
+    write_markdown("./test_data/three.md", "# Three\ngamma shared gamma\n");
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "binary index build failed");
+    }
+    if (kolibri_knowledge_index_write_binary(index, "./test_data/out") != 0) {
+        fail(index, "binary index write failed");
+    }
+    KolibriKnowledgeIndex *mapped = NULL;
+    if (kolibri_knowledge_index_load_binary("./test_data/out", &mapped) != 0 || !mapped) {
+        fail(index, "binary index load failed");
+    }
+    if (kolibri_knowledge_index_document_count(mapped) != kolibri_knowledge_index_document_count(index) ||
+        kolibri_knowledge_index_token_count(mapped) != kolibri_knowledge_index_token_count(index)) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "binary index changed counts");
+    }
+    const char *queries[] = {"shared", "gamma", "beta quoted", "alpha gamma"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        size_t expected_indices[3];
+        float expected_scores[3];
+        size_t expected_count = 0U;
+        size_t actual_indices[3];
+        float actual_scores[3];
+        size_t actual_count = 0U;
+        if (kolibri_knowledge_index_search(index, queries[q], 3U, expected_indices, expected_scores, &expected_count) != 0 ||
+            kolibri_knowledge_index_search(mapped, queries[q], 3U, actual_indices, actual_scores, &actual_count) != 0 ||
+            expected_count == 0U || expected_count != actual_count) {
+            kolibri_knowledge_index_destroy(mapped);
+            fail(index, "binary index search diverged");
+        }
+        for (size_t i = 0; i < expected_count; ++i) {
+            const KolibriKnowledgeDoc *a = kolibri_knowledge_index_document(index, expected_indices[i]);
+            const KolibriKnowledgeDoc *b = kolibri_knowledge_index_document(mapped, actual_indices[i]);
+            if (expected_indices[i] != actual_indices[i] || expected_scores[i] != actual_scores[i] ||
+                strcmp(a->id, b->id) != 0 || strcmp(a->title, b->title) != 0 ||
+                strcmp(a->content, b->content) != 0 || strcmp(a->source, b->source) != 0 ||
+                a->json_length != b->json_length || strcmp(a->json, b->json) != 0 ||
+                a->preview_length != b->preview_length || strcmp(a->preview, b->preview) != 0) {
+                kolibri_knowledge_index_destroy(mapped);
+                fail(index, "binary index returned different document");
+            }
+        }
+    }
+    /* Ответ поиска копирует готовый фрагмент: кавычки и переводы строк уже экранированы. */
+    size_t hit = 0U;
+    float hit_score = 0.0f;
+    size_t hit_count = 0U;
+    if (kolibri_knowledge_index_search(mapped, "quoted", 1U, &hit, &hit_score, &hit_count) != 0 || hit_count != 1U) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "quoted document not found");
+    }
+    const KolibriKnowledgeDoc *quoted = kolibri_knowledge_index_document(mapped, hit);
+    if (!strstr(quoted->json, "\"content\":\"# Two\\nbeta shared \\\"quoted\\\"\\n\"") ||
+        strncmp(quoted->json, "\"id\":\"", 6U) != 0 || quoted->json_length != strlen(quoted->json) ||
+        strcmp(quoted->preview, quoted->content) != 0) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "unexpected pre-escaped document fragment");
+    }
+    kolibri_knowledge_index_destroy(mapped);
+    kolibri_knowledge_index_destroy(index);
+
+    /* Обрезанный файл отвергается, а не читается за границей отображения. */
+    system("head -c 200 ./test_data/out/index.bin > ./test_data/out/index.cut && "
+           "mv ./test_data/out/index.cut ./test_data/out/index.bin");
+    mapped = NULL;
+    if (kolibri_knowledge_index_load_binary("./test_data/out", &mapped) == 0 || mapped) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(NULL, "truncated binary index accepted");
+    }
+    cleanup();
+}
+
+static void test_knowledge_index_live_segment(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    write_markdown("./test_data/one.md", "# One\nalpha shared\n");
+    write_markdown("./test_data/two.md", "# Two\nbeta shared\n");
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "live segment index build failed");
+    }
+    size_t heap_before = kolibri_knowledge_index_memory_usage(index, NULL);
+    size_t doc_index = 0U;
+    if (kolibri_knowledge_index_add_document(index, "taught", "Omega", "teach", "omega shared", &doc_index) != 0 ||
+        doc_index != 2U || kolibri_knowledge_index_document_count(index) != 3U ||
+        kolibri_knowledge_index_pending_count(index) != 1U) {
+        fail(index, "add_document did not extend the index");
+    }
+    if (heap_before == 0U || kolibri_knowledge_index_memory_usage(index, NULL) <= heap_before) {
+        fail(index, "memory usage should grow with the live segment");
+    }
+    /* Новый токен ищется до слияния, старые документы по-прежнему находятся. */
+    expect_single_hit(index, "omega", "taught");
+    expect_single_hit(index, "beta", "two");
+
+    if (kolibri_knowledge_index_write_binary(index, "./test_data/out") != 0) {
+        fail(index, "binary write with live segment failed");
+    }
+    KolibriKnowledgeIndex *mapped = NULL;
+    if (kolibri_knowledge_index_load_binary("./test_data/out", &mapped) != 0 || !mapped ||
+        kolibri_knowledge_index_pending_count(mapped) != 1U) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "binary index lost the live segment");
+    }
+    expect_single_hit(mapped, "omega", "taught");
+    size_t mapped_bytes = 0U;
+    kolibri_knowledge_index_memory_usage(mapped, &mapped_bytes);
+    if (mapped_bytes == 0U) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "mapped index should report its mapping size");
+    }
+    if (kolibri_knowledge_index_add_document(mapped, "later", "Later", "teach", "zeta", NULL) != 0 ||
+        kolibri_knowledge_index_merge(mapped) != 2U || kolibri_knowledge_index_pending_count(mapped) != 0U) {
+        kolibri_knowledge_index_destroy(mapped);
+        fail(index, "merge of mapped index failed");
+    }
+    expect_single_hit(mapped, "zeta", "later");
+    expect_single_hit(mapped, "alpha", "one");
+    kolibri_knowledge_index_destroy(mapped);
+
+    if (kolibri_knowledge_index_merge(index) != 1U || kolibri_knowledge_index_pending_count(index) != 0U) {
+        fail(index, "merge did not absorb the live segment");
+    }
+    expect_single_hit(index, "omega", "taught");
+    size_t indices[4];
+    float scores[4];
+    size_t result_count = 0U;
+    if (kolibri_knowledge_index_search_flags(index, "shared", 4U, KOLIBRI_KNOWLEDGE_SEARCH_PRUNE, indices, scores,
+                                             &result_count) != 0 ||
+        result_count != 3U) {
+        fail(index, "merged index should match all shared documents");
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static void test_knowledge_index_parallel_matches_serial(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    for (int i = 0; i < 48; ++i) {
+        char path[64];
+        char content[256];
+        snprintf(path, sizeof(path), "./test_data/p%02d.md", i);
+        snprintf(content, sizeof(content), "# Part %d\nshared t%d u%d t%d v%d\n", i, i % 5, i % 7, i % 5, i);
+        write_markdown(path, content);
+    }
+    KolibriKnowledgeIndex *serial = NULL;
+    KolibriKnowledgeIndex *parallel = NULL;
+    if (kolibri_knowledge_index_create_threads(roots, 1U, 256U, 1U, &serial) != 0 || !serial ||
+        kolibri_knowledge_index_create_threads(roots, 1U, 256U, 3U, &parallel) != 0 || !parallel) {
+        kolibri_knowledge_index_destroy(parallel);
+        fail(serial, "parallel index build failed");
+    }
+    size_t tokens = kolibri_knowledge_index_token_count(serial);
+    if (tokens != kolibri_knowledge_index_token_count(parallel) ||
+        kolibri_knowledge_index_document_count(serial) != kolibri_knowledge_index_document_count(parallel)) {
+        kolibri_knowledge_index_destroy(parallel);
+        fail(serial, "parallel build changed counts");
+    }
+    for (size_t t = 0; t < tokens; ++t) {
+        if (strcmp(kolibri_knowledge_index_token(serial, t)->token, kolibri_knowledge_index_token(parallel, t)->token) != 0) {
+            kolibri_knowledge_index_destroy(parallel);
+            fail(serial, "parallel build changed token order");
+        }
+    }
+    const char *queries[] = {"shared t3", "u2 v17", "t0 t1 t2"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        size_t a_indices[5];
+        size_t b_indices[5];
+        float a_scores[5];
+        float b_scores[5];
+        size_t a_count = 0U;
+        size_t b_count = 0U;
+        kolibri_knowledge_index_search(serial, queries[q], 5U, a_indices, a_scores, &a_count);
+        kolibri_knowledge_index_search(parallel, queries[q], 5U, b_indices, b_scores, &b_count);
+        if (a_count == 0U || a_count != b_count ||
+            memcmp(a_indices, b_indices, a_count * sizeof(size_t)) != 0 ||
+            memcmp(a_scores, b_scores, a_count * sizeof(float)) != 0) {
+            kolibri_knowledge_index_destroy(parallel);
+            fail(serial, "parallel build changed ranking");
+        }
+    }
+    kolibri_knowledge_index_destroy(parallel);
+    kolibri_knowledge_index_destroy(serial);
+    cleanup();
+}
+
+static void test_knowledge_index_partition(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    for (int i = 0; i < 40; ++i) {
+        char path[64];
+        char content[256];
+        snprintf(path, sizeof(path), "./test_data/s%02d.md", i);
+        snprintf(content, sizeof(content), "# Shard %d\nshared t%d u%d t%d v%d\n", i, i % 5, i % 7, i % 5, i);
+        write_markdown(path, content);
+    }
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "partition source build failed");
+    }
+    KolibriKnowledgeIndex *shards[3] = { NULL, NULL, NULL };
+    if (kolibri_knowledge_index_partition(index, 3U, 3U, &shards[0]) == 0) {
+        fail(index, "shard outside of shard_count should be rejected");
+    }
+    size_t total = 0U;
+    for (size_t s = 0; s < 3U; ++s) {
+        if (kolibri_knowledge_index_partition(index, s, 3U, &shards[s]) != 0 || !shards[s] ||
+            kolibri_knowledge_index_token_count(shards[s]) != kolibri_knowledge_index_token_count(index)) {
+            fail(index, "partition failed");
+        }
+        total += kolibri_knowledge_index_document_count(shards[s]);
+    }
+    if (total != kolibri_knowledge_index_document_count(index)) {
+        fail(index, "shards should cover every document exactly once");
+    }
+    /* Глобальный idf: слитый top-k шардов совпадает с поиском по целому индексу. */
+    const char *queries[] = {"shared t3", "u2 v17", "t0 t1 t2"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+        size_t indices[5];
+        float expected[5];
+        size_t expected_count = 0U;
+        kolibri_knowledge_index_search(index, queries[q], 5U, indices, expected, &expected_count);
+        float merged[15];
+        size_t merged_count = 0U;
+        for (size_t s = 0; s < 3U; ++s) {
+            size_t count = 0U;
+            kolibri_knowledge_index_search(shards[s], queries[q], 5U, indices, merged + merged_count, &count);
+            merged_count += count;
+        }
+        for (size_t i = 0; i < merged_count; ++i) {
+            for (size_t j = i + 1U; j < merged_count; ++j) {
+                if (merged[j] > merged[i]) {
+                    float tmp = merged[i];
+                    merged[i] = merged[j];
+                    merged[j] = tmp;
+                }
+            }
+        }
+        if (expected_count == 0U || merged_count < expected_count) {
+            fail(index, "shards lost matches");
+        }
+        for (size_t i = 0; i < expected_count; ++i) {
+            if (fabsf(merged[i] - expected[i]) > 1e-5f) {
+                fail(index, "shard scores differ from the full index");
+            }
+        }
+    }
+    for (size_t s = 0; s < 3U; ++s) {
+        kolibri_knowledge_index_destroy(shards[s]);
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
+static const char *top_hit(KolibriKnowledgeIndex *index, const char *query, unsigned flags) {
+    size_t indices[4];
+    float scores[4];
+    size_t result_count = 0U;
+    if (kolibri_knowledge_index_search_flags(index, query, 4U, flags, indices, scores, &result_count) != 0) {
+        fail(index, "search returned error");
+    }
+    if (result_count == 0U) {
+        return NULL;
+    }
+    return kolibri_knowledge_index_document(index, indices[0])->id;
+}
+
+static void test_knowledge_index_expanded_terms(void) {
+    const char *roots[1];
+    roots[0] = "./test_data";
+    system("mkdir -p ./test_data");
+    write_markdown("./test_data/bird.md", "# Bird\nhummingbird migration\n");
+    write_markdown("./test_data/keys.md", "# Keys\nencryption keys rotation\n");
+    write_markdown("./test_data/genome.md", "# Genome\ngenome journal\n");
+
+    KolibriKnowledgeIndex *index = NULL;
+    if (kolibri_knowledge_index_create(roots, 1U, 256U, &index) != 0 || !index) {
+        fail(index, "expansion index build failed");
+    }
+    /* Без флагов незаконченный или опечатанный терм ничего не находит. */
+    if (top_hit(index, "hummi", 0U) || top_hit(index, "encrypton", 0U)) {
+        fail(index, "exact search should ignore partial terms");
+    }
+    const char *hit = top_hit(index, "hummi", KOLIBRI_KNOWLEDGE_SEARCH_PREFIX);
+    if (!hit || strcmp(hit, "bird") != 0) {
+        fail(index, "prefix search should complete the last term");
+    }
+    hit = top_hit(index, "encrypton", KOLIBRI_KNOWLEDGE_SEARCH_FUZZY);
+    if (!hit || strcmp(hit, "keys") != 0) {
+        fail(index, "fuzzy search should tolerate a missing letter");
+    }
+    hit = top_hit(index, "genmoe", KOLIBRI_KNOWLEDGE_SEARCH_FUZZY);
+    if (hit) {
+        fail(index, "transposition costs two edits in a short term");
+    }
+    /* Токены живого сегмента расширяются до слияния. */
+    if (kolibri_knowledge_index_add_document(index, "taught", "Taught", "teach", "kolibri swarm", NULL) != 0) {
+        fail(index, "add_document failed");
+    }
+    hit = top_hit(index, "kolib swrm", KOLIBRI_KNOWLEDGE_SEARCH_PREFIX | KOLIBRI_KNOWLEDGE_SEARCH_FUZZY);
+    if (!hit || strcmp(hit, "taught") != 0) {
+        fail(index, "live tokens should be expanded");
+    }
+    kolibri_knowledge_index_merge(index);
+    hit = top_hit(index, "kolib swrm", KOLIBRI_KNOWLEDGE_SEARCH_PREFIX | KOLIBRI_KNOWLEDGE_SEARCH_FUZZY);
+    if (!hit || strcmp(hit, "taught") != 0) {
+        fail(index, "merged tokens should be expanded");
+    }
+    kolibri_knowledge_index_destroy(index);
+    cleanup();
+}
+
 void test_knowledge_index(void) {
     const char *roots[1];
     roots[0] = "./test_data";
@@ -61,4 +576,13 @@ void test_knowledge_index(void) {
 
     kolibri_knowledge_index_destroy(index);
     cleanup();
+
+    test_knowledge_index_postings();
+    test_knowledge_index_large_vocabulary();
+    test_knowledge_index_pruned_search();
+    test_knowledge_index_binary_roundtrip();
+    test_knowledge_index_live_segment();
+    test_knowledge_index_parallel_matches_serial();
+    test_knowledge_index_partition();
+    test_knowledge_index_expanded_terms();
 }
@@ -11,6 +11,15 @@ static void cleanup(void) {
     system("rm -rf ./queue_export");
 }
 
+/* seen[0] — число строк, дальше их id. */
+static int collect_ids(const KolibriQueueRecord *record, void *user_data) {
+    long long *seen = (long long *)user_data;
+    if (seen[0] < 3) {
+        seen[++seen[0]] = record->submission_id;
+    }
+    return 0;
+}
+
 void test_knowledge_queue(void) {
     KolibriQueue *queue = NULL;
     if (kolibri_queue_open(DB_PATH, &queue) != SQLITE_OK) {
@@ -46,6 +55,61 @@ void test_knowledge_queue(void) {
         exit(1);
     }
 
+    KolibriQueueSubmission batch[3] = {
+        { "Первый", "Текст 1", "lab", NULL },
+        { "Второй", "Текст 2", NULL, NULL },
+        { "Третий", "Текст 3", NULL, "{}" },
+    };
+    long long ids[3] = { 0, 0, 0 };
+    if (kolibri_queue_enqueue_many(queue, batch, 3U, ids) != SQLITE_OK || ids[0] == 0 || ids[2] != ids[0] + 2) {
+        fprintf(stderr, "enqueue batch failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+
+    KolibriQueueModeration decisions[3] = {
+        { ids[0], KOLIBRI_QUEUE_STATUS_APPROVED, "tester", NULL },
+        { ids[1], KOLIBRI_QUEUE_STATUS_REJECTED, "tester", "дубликат" },
+        { ids[2] + 100, KOLIBRI_QUEUE_STATUS_APPROVED, "tester", NULL },
+    };
+    size_t updated = 0U;
+    if (kolibri_queue_moderate_many(queue, decisions, 3U, &updated) != SQLITE_OK || updated != 2U) {
+        fprintf(stderr, "moderate batch failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    if (kolibri_queue_fetch(queue, KOLIBRI_QUEUE_STATUS_PENDING, 10U, &records, &count) != SQLITE_OK || count != 1U ||
+        records[0].submission_id != ids[2]) {
+        fprintf(stderr, "fetch after batch failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    kolibri_queue_free_records(records, count);
+
+    long long seen[4] = { 0, 0, 0, 0 };
+    long long cursor = 0;
+    if (kolibri_queue_scan(queue, KOLIBRI_QUEUE_STATUS_APPROVED, 0, 1U, collect_ids, seen, &cursor) != SQLITE_OK ||
+        seen[0] != 1 || seen[1] != id ||
+        kolibri_queue_scan(queue, KOLIBRI_QUEUE_STATUS_APPROVED, cursor, 0U, collect_ids, seen, &cursor) != SQLITE_OK ||
+        seen[0] != 2 || seen[2] != ids[0] || cursor != ids[0]) {
+        fprintf(stderr, "scan failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+
+    if (kolibri_queue_export_markdown_incremental(queue, KOLIBRI_QUEUE_STATUS_APPROVED, "./queue_export", &count) != SQLITE_OK ||
+        count != 1U) {
+        fprintf(stderr, "incremental export failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+    if (kolibri_queue_export_markdown_incremental(queue, KOLIBRI_QUEUE_STATUS_APPROVED, "./queue_export", &count) != SQLITE_OK ||
+        count != 0U) {
+        fprintf(stderr, "repeated incremental export failed\n");
+        kolibri_queue_close(queue);
+        exit(1);
+    }
+
     kolibri_queue_close(queue);
     cleanup();
 }
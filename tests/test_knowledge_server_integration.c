@@ -111,6 +111,317 @@ static void wait_for_server(int port) {
     assert(!"knowledge server did not become ready");
 }
 
+static int open_idle_connection(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return sock;
+}
+
+static size_t count_occurrences(const char *haystack, const char *needle) {
+    size_t count = 0U;
+    size_t needle_len = strlen(needle);
+    for (const char *cursor = strstr(haystack, needle); cursor; cursor = strstr(cursor + needle_len, needle)) {
+        count += 1U;
+    }
+    return count;
+}
+
+/* Два конвейерных запроса в одном сегменте должны получить два ответа по одному соединению. */
+static void check_pipelined_keep_alive(int port) {
+    int sock = open_idle_connection(port);
+    struct timeval tv;
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    const char *requests =
+        "GET /healthz HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "GET /api/knowledge/search?q=Kolibri HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    ssize_t sent = send(sock, requests, strlen(requests), 0);
+    assert(sent == (ssize_t)strlen(requests));
+
+    char response[8192];
+    size_t total = 0U;
+    while (total + 1U < sizeof(response)) {
+        ssize_t chunk = recv(sock, response + total, sizeof(response) - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+        response[total] = '\0';
+        if (strstr(response, "snippets") && strstr(strstr(response, "snippets"), "]}")) {
+            break;
+        }
+    }
+    response[total] = '\0';
+    assert(count_occurrences(response, "HTTP/1.1 200") == 2U);
+    assert(strstr(response, "Connection: keep-alive"));
+
+    const char *closing = "GET /healthz HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    sent = send(sock, closing, strlen(closing), 0);
+    assert(sent == (ssize_t)strlen(closing));
+    total = 0U;
+    while (total + 1U < sizeof(response)) {
+        ssize_t chunk = recv(sock, response + total, sizeof(response) - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+    }
+    response[total] = '\0';
+    assert(strstr(response, "HTTP/1.1 200"));
+    assert(strstr(response, "Connection: close"));
+    close(sock);
+}
+
+/* Запрос, пришедший кусками, и тело POST, за которым сразу идёт следующий запрос. */
+static void check_split_and_body_pipeline(int port) {
+    int sock = open_idle_connection(port);
+    struct timeval tv;
+    tv.tv_sec = 2;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    const char *pieces[] = { "GET /api/knowledge/sea", "rch?q=Kolibri&limit=1 HT", "TP/1.1\r\nHost: loc",
+                             "alhost\r", "\n\r\n" };
+    for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); ++i) {
+        ssize_t sent = send(sock, pieces[i], strlen(pieces[i]), 0);
+        assert(sent == (ssize_t)strlen(pieces[i]));
+        usleep(20000);
+    }
+    const char *body = "rating=good&q=split&a=answer";
+    char requests[512];
+    int len = snprintf(requests,
+                       sizeof(requests),
+                       "POST /api/knowledge/feedback HTTP/1.1\r\nHost: localhost\r\n"
+                       "Authorization: Bearer secret-token\r\nContent-Length: %zu\r\n\r\n%s"
+                       "GET /healthz HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n",
+                       strlen(body),
+                       body);
+    assert(len > 0 && (size_t)len < sizeof(requests));
+    assert(send(sock, requests, (size_t)len, 0) == (ssize_t)len);
+
+    char response[16384];
+    size_t total = 0U;
+    while (total + 1U < sizeof(response)) {
+        ssize_t chunk = recv(sock, response + total, sizeof(response) - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+    }
+    response[total] = '\0';
+    assert(count_occurrences(response, "HTTP/1.1 200") == 3U);
+    assert(strstr(response, "snippets"));
+    assert(strstr(response, "Connection: close"));
+    close(sock);
+}
+
+/* NDJSON-тело больше приёмного буфера соединения читается потоком; ответ
+ * сохраняет порядок строк, а следующий запрос на том же соединении не теряется. */
+static void check_bulk_ingest(int port) {
+    size_t capacity = 32768U;
+    char *body = malloc(capacity);
+    assert(body);
+    size_t length = 0U;
+    for (int i = 0; i < 150; ++i) {
+        length += (size_t)snprintf(body + length, capacity - length,
+                                   "{\"route\":\"teach\",\"q\":\"bulk question %d\",\"a\":\"bulkanswer%d \\u043e\\u043a\"}\n",
+                                   i, i);
+    }
+    length += (size_t)snprintf(body + length, capacity - length,
+                               "\n{\"route\":\"feedback\",\"rating\":\"good\",\"q\":\"bulk\",\"a\":\"ok\"}\n"
+                               "{\"route\":\"teach\",\"q\":\"no answer\"}\n"
+                               "{\"route\":\"teach\",\"q\":\"broken\"\n"
+                               "{\"route\":\"feedback\",\"q\":{\"nested\":1}}");
+    assert(length < capacity && length > 8192U);
+
+    char *request = malloc(capacity + 512U);
+    assert(request);
+    int head = snprintf(request, 512U,
+                        "POST /api/knowledge/bulk HTTP/1.1\r\nHost: localhost\r\n"
+                        "Authorization: Bearer secret-token\r\nContent-Length: %zu\r\n\r\n",
+                        length);
+    memcpy(request + head, body, length);
+    size_t total = (size_t)head + length;
+    total += (size_t)snprintf(request + total, 512U, "GET /healthz HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(send(sock, request, total, 0) == (ssize_t)total);
+    static char response[65536];
+    size_t received = 0U;
+    while (received + 1U < sizeof(response)) {
+        ssize_t chunk = recv(sock, response + received, sizeof(response) - received - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        received += (size_t)chunk;
+    }
+    response[received] = '\0';
+    close(sock);
+    free(request);
+    free(body);
+
+    assert(count_occurrences(response, "HTTP/1.1 200") == 2U);
+    assert(strstr(response, "{\"accepted\":151,\"rejected\":3,\"truncated\":false,\"items\":[{\"status\":\"ok\",\"id\":\"teach-"));
+    assert(count_occurrences(response, "{\"status\":\"ok\",\"id\":\"teach-") == 150U);
+    assert(strstr(response, "},{\"status\":\"ok\"},{\"status\":\"error\",\"error\":\"missing q or a\"},"
+                            "{\"status\":\"error\",\"error\":\"invalid json\"},"
+                            "{\"status\":\"error\",\"error\":\"nested values are not supported\"}]}"));
+    assert(strstr(response, "\"indexSource\":\"prebuilt\""));
+
+    char search[4096];
+    int status = http_request("GET", "/api/knowledge/search?q=bulkanswer149", NULL, NULL, search, sizeof(search), port);
+    assert(status == 200);
+    assert(strstr(search, "bulk question 149"));
+    assert(strstr(search, "bulkanswer149 ок"));
+}
+
+static unsigned long long metric_value(const char *metrics, const char *name) {
+    char needle[128];
+    snprintf(needle, sizeof(needle), "\n%s ", name);
+    const char *line = strstr(metrics, needle);
+    assert(line != NULL);
+    return strtoull(line + strlen(needle), NULL, 10);
+}
+
+/* Читает один ответ целиком: заголовки и Content-Length байт тела. */
+static size_t read_one_response(int sock, char *response, size_t size) {
+    size_t total = 0U;
+    while (total + 1U < size) {
+        ssize_t chunk = recv(sock, response + total, size - total - 1U, 0);
+        if (chunk <= 0) {
+            break;
+        }
+        total += (size_t)chunk;
+        response[total] = '\0';
+        const char *head_end = strstr(response, "\r\n\r\n");
+        const char *length = strstr(response, "Content-Length: ");
+        if (head_end && length &&
+            total >= (size_t)(head_end + 4 - response) + strtoul(length + strlen("Content-Length: "), NULL, 10)) {
+            break;
+        }
+    }
+    response[total] = '\0';
+    return total;
+}
+
+/* Простаивающие keep-alive соединения ждут в пуле accept-цикла: их больше, чем
+ * обработчиков, а новый запрос обслуживается сразу и старое соединение живо. */
+static void check_idle_keep_alive_release_workers(int port) {
+    enum { IDLE_CLIENTS = 4 };
+    int socks[IDLE_CLIENTS];
+    static char response[65536];
+    const char *request = "GET /healthz HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (int i = 0; i < IDLE_CLIENTS; ++i) {
+        socks[i] = open_idle_connection(port);
+        struct timeval tv;
+        tv.tv_sec = 2;
+        tv.tv_usec = 0;
+        setsockopt(socks[i], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        assert(send(socks[i], request, strlen(request), 0) == (ssize_t)strlen(request));
+        assert(read_one_response(socks[i], response, sizeof(response)) > 0U);
+        assert(strstr(response, "HTTP/1.1 200"));
+        assert(strstr(response, "Connection: keep-alive"));
+    }
+
+    unsigned long long idle = 0U;
+    for (int attempt = 0; attempt < 100 && idle < IDLE_CLIENTS; ++attempt) {
+        assert(http_request("GET", "/metrics", NULL, NULL, response, sizeof(response), port) == 200);
+        idle = metric_value(response, "kolibri_connections_idle");
+        if (idle < IDLE_CLIENTS) {
+            usleep(20000);
+        }
+    }
+    assert(idle >= IDLE_CLIENTS);
+
+    struct timespec started;
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    assert(http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port) == 200);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    long elapsed_ms = (finished.tv_sec - started.tv_sec) * 1000L + (finished.tv_nsec - started.tv_nsec) / 1000000L;
+    assert(elapsed_ms < 1000L);
+
+    /* Из пула соединение возвращается к обработчику, как только приходит запрос. */
+    const char *closing = "GET /healthz HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    for (int i = 0; i < IDLE_CLIENTS; ++i) {
+        assert(send(socks[i], closing, strlen(closing), 0) == (ssize_t)strlen(closing));
+        assert(read_one_response(socks[i], response, sizeof(response)) > 0U);
+        assert(strstr(response, "HTTP/1.1 200"));
+        assert(strstr(response, "Connection: close"));
+        close(socks[i]);
+    }
+}
+
+/* Ждёт, пока фоновая перезагрузка не опубликует индекс новее previous. */
+static unsigned long long wait_for_generation(int port, unsigned long long previous, char *metrics, size_t size) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        assert(http_request("GET", "/metrics", NULL, NULL, metrics, size, port) == 200);
+        unsigned long long generation = metric_value(metrics, "kolibri_knowledge_index_generation");
+        if (generation > previous) {
+            return generation;
+        }
+        usleep(20000);
+    }
+    assert(!"index reload did not publish a new generation");
+    return previous;
+}
+
+/* Перезагрузка через API и по SIGHUP: индекс пересобирается, выученное сохраняется,
+ * кэш ответов сбрасывается. */
+static void check_index_reload(int port, pid_t pid) {
+    static char metrics[65536];
+    char response[4096];
+    int status = http_request("POST", "/api/knowledge/teach", "q=reload+question&a=reloadprobe+answer",
+                              "Authorization: Bearer secret-token\r\n", response, sizeof(response), port);
+    assert(status == 200);
+    status = http_request("GET", "/api/knowledge/search?q=reloadprobe", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "reload question"));
+    assert(http_request("GET", "/metrics", NULL, NULL, metrics, sizeof(metrics), port) == 200);
+    assert(metric_value(metrics, "kolibri_search_cache_entries") >= 1U);
+    unsigned long long generation = metric_value(metrics, "kolibri_knowledge_index_generation");
+
+    status = http_request("POST", "/api/knowledge/reload", NULL, NULL, response, sizeof(response), port);
+    assert(status == 401);
+    status = http_request("POST", "/api/knowledge/reload", NULL, "Authorization: Bearer secret-token\r\n", response,
+                          sizeof(response), port);
+    assert(status == 202);
+    unsigned long long reloaded = wait_for_generation(port, generation, metrics, sizeof(metrics));
+    assert(metric_value(metrics, "kolibri_knowledge_index_reloads_total") == 1U);
+    assert(metric_value(metrics, "kolibri_search_cache_entries") == 0U);
+
+    /* Повтор запроса не берётся из кэша: промахов становится больше, попаданий нет. */
+    unsigned long long hits = metric_value(metrics, "kolibri_search_cache_hits_total");
+    unsigned long long misses = metric_value(metrics, "kolibri_search_cache_misses_total");
+    status = http_request("GET", "/api/knowledge/search?q=reloadprobe", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "reload question"));
+    assert(http_request("GET", "/metrics", NULL, NULL, metrics, sizeof(metrics), port) == 200);
+    assert(metric_value(metrics, "kolibri_search_cache_hits_total") == hits);
+    assert(metric_value(metrics, "kolibri_search_cache_misses_total") == misses + 1U);
+
+    assert(kill(pid, SIGHUP) == 0);
+    wait_for_generation(port, reloaded, metrics, sizeof(metrics));
+    assert(metric_value(metrics, "kolibri_knowledge_index_reloads_total") == 2U);
+    assert(metric_value(metrics, "kolibri_search_cache_entries") == 0U);
+    status = http_request("GET", "/api/knowledge/search?q=reloadprobe", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "reload question"));
+}
+
 static void spawn_env_set(const char *key, const char *value) {
     if (value) {
         assert(setenv(key, value, 1) == 0);
@@ -123,6 +434,120 @@ static void remove_path(const char *path) {
     (void)remove(path);
 }
 
+static pid_t spawn_shard_server(const char *workdir, const char *port, const char *index_dir, const char *shards) {
+    char server[1024];
+    assert(getcwd(server, sizeof(server) - 32U) != NULL);
+    strcat(server, "/kolibri_knowledge_server");
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        /* Каждый сервер ведёт свой геном в .kolibri рабочего каталога. */
+        assert(chdir(workdir) == 0);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_PORT", port);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_BIND", "127.0.0.1");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_JSON", index_dir);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_CACHE", index_dir);
+        spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SHARDS", shards);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_SHARD_TIMEOUT_MS", shards ? "300" : NULL);
+        execl(server, "kolibri_knowledge_server", NULL);
+        perror("execl");
+        _exit(1);
+    }
+    return pid;
+}
+
+/* Два шарда, молчащий и недоступный узел: фронт сливает top-k живых шардов
+ * и помечает ответ как частичный, не дожидаясь дольше тайм-аута. */
+static void check_sharded_search(void) {
+    char root_template[] = "/tmp/kolibri_shardsXXXXXX";
+    char *root = mkdtemp(root_template);
+    assert(root);
+    char path[512];
+    snprintf(path, sizeof(path), "%s/docs", root);
+    assert(mkdir(path, 0755) == 0);
+    const char *names[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        char content[128];
+        snprintf(path, sizeof(path), "%s/docs/%s.md", root, names[i]);
+        snprintf(content, sizeof(content), "# %s\n\nshardword %s\n", names[i], names[i]);
+        write_file(path, content);
+    }
+    char command[1536];
+    snprintf(command, sizeof(command), "./kolibri_indexer build --shards 2 --output %s/out %s/docs >/dev/null 2>&1",
+             root, root);
+    assert(system(command) == 0);
+
+    int silent = socket(AF_INET, SOCK_STREAM, 0);
+    assert(silent >= 0);
+    int one = 1;
+    setsockopt(silent, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(19085);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(silent, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(silent, 4) == 0);
+
+    pid_t pids[3];
+    for (int shard = 0; shard < 3; ++shard) {
+        char workdir[512];
+        char index_dir[512];
+        char port[16];
+        snprintf(workdir, sizeof(workdir), "%s/work%d", root, shard);
+        snprintf(index_dir, sizeof(index_dir), "%s/out/shard-%d", root, shard < 2 ? shard : 0);
+        snprintf(port, sizeof(port), "%d", 19082 + shard);
+        assert(mkdir(workdir, 0755) == 0);
+        pids[shard] = spawn_shard_server(workdir,
+                                         port,
+                                         index_dir,
+                                         shard < 2 ? NULL
+                                                   : "127.0.0.1:19082,localhost:19083,127.0.0.1:19085,127.0.0.1:19086");
+    }
+    wait_for_server(19082);
+    wait_for_server(19083);
+    wait_for_server(19084);
+
+    char response[8192];
+    char shard_bodies[2][8192];
+    for (int shard = 0; shard < 2; ++shard) {
+        assert(http_request("GET", "/api/knowledge/search?q=shardword&limit=10", NULL, NULL, shard_bodies[shard],
+                            sizeof(shard_bodies[shard]), 19082 + shard) == 200);
+        assert(strstr(shard_bodies[shard], "\"score\":"));
+    }
+    struct timespec started;
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int status = http_request("GET", "/api/knowledge/search?q=shardword&limit=10", NULL, NULL, response,
+                              sizeof(response), 19084);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    assert(status == 200);
+    double elapsed = (double)(finished.tv_sec - started.tv_sec) + (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
+    assert(elapsed < 1.5);
+    assert(count_occurrences(response, "\"score\":") == sizeof(names) / sizeof(names[0]));
+    assert(strstr(response, "\"partial\":true,\"shards\":{\"total\":4,\"ok\":2}"));
+    status = http_request("GET", "/api/knowledge/search?q=alpha&limit=1", NULL, NULL, response, sizeof(response),
+                          19084);
+    assert(status == 200);
+    assert(strstr(response, "\"id\":\"alpha\"") && count_occurrences(response, "\"score\":") == 1U);
+    static char metrics[65536];
+    status = http_request("GET", "/metrics", NULL, NULL, metrics, sizeof(metrics), 19084);
+    assert(status == 200);
+    assert(strstr(metrics, "kolibri_shard_requests_total{result=\"ok\"} 4\n"));
+    assert(strstr(metrics, "kolibri_shard_requests_total{result=\"timeout\"} 2\n"));
+    assert(strstr(metrics, "kolibri_shard_requests_total{result=\"error\"} 2\n"));
+    assert(strstr(metrics, "kolibri_shard_partial_responses_total 2\n"));
+
+    for (int shard = 0; shard < 3; ++shard) {
+        kill(pids[shard], SIGTERM);
+        waitpid(pids[shard], NULL, 0);
+    }
+    close(silent);
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+}
+
 void test_knowledge_server_integration(void) {
     char docs_template[] = "/tmp/kolibri_docsXXXXXX";
     char cache_template[] = "/tmp/kolibri_cacheXXXXXX";
@@ -146,6 +571,7 @@ void test_knowledge_server_integration(void) {
         spawn_env_set("KOLIBRI_KNOWLEDGE_INDEX_CACHE", cache_dir);
         spawn_env_set("KOLIBRI_HMAC_KEY", "integration-key");
         spawn_env_set("KOLIBRI_KNOWLEDGE_ADMIN_TOKEN", token);
+        spawn_env_set("KOLIBRI_KNOWLEDGE_WORKERS", "2");
         execl("./kolibri_knowledge_server", "kolibri_knowledge_server", NULL);
         perror("execl");
         _exit(1);
@@ -153,9 +579,12 @@ void test_knowledge_server_integration(void) {
 
     wait_for_server(port);
 
+    /* Молчащий клиент занимает один обработчик, остальные запросы не должны ждать его тайм-аута. */
+    int idle_sock = open_idle_connection(port);
     char response[4096];
     int status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
     assert(status == 200);
+    close(idle_sock);
     assert(strstr(response, "\"documents\":1"));
     assert(strstr(response, "\"indexSource\":\"directories\""));
 
@@ -163,6 +592,31 @@ void test_knowledge_server_integration(void) {
     assert(status == 200);
     assert(strstr(response, "snippets"));
 
+    /* Тот же запрос в другом регистре обслуживается из кэша ответов без изменения тела. */
+    char first_search[4096];
+    snprintf(first_search, sizeof(first_search), "%s", response);
+    status = http_request("GET", "/api/knowledge/search?q=KOLIBRI", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strcmp(response, first_search) == 0);
+    status = http_request("GET", "/metrics", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "kolibri_search_cache_hits_total 1\n"));
+    assert(strstr(response, "kolibri_search_cache_entries 1\n"));
+
+    /* События генома пишет фоновый поток: ждём, пока он догонит очередь. */
+    int journal_flushed = 0;
+    for (int attempt = 0; attempt < 50 && !journal_flushed; ++attempt) {
+        status = http_request("GET", "/metrics", NULL, NULL, response, sizeof(response), port);
+        assert(status == 200);
+        journal_flushed = strstr(response, "kolibri_journal_queue_depth 0\n") != NULL &&
+                          strstr(response, "kolibri_journal_written_total 0\n") == NULL;
+        if (!journal_flushed) {
+            usleep(20000);
+        }
+    }
+    assert(journal_flushed);
+    assert(strstr(response, "kolibri_journal_dropped_total 0\n"));
+
     status = http_request("POST",
                           "/api/knowledge/feedback",
                           "rating=good&q=question&a=answer",
@@ -172,6 +626,11 @@ void test_knowledge_server_integration(void) {
                           port);
     assert(status == 401);
 
+    check_pipelined_keep_alive(port);
+    check_split_and_body_pipeline(port);
+    check_idle_keep_alive_release_workers(port);
+    check_index_reload(port, pid);
+
     status = http_request("POST",
                           "/api/knowledge/feedback",
                           "rating=good&q=question&a=answer",
@@ -181,6 +640,24 @@ void test_knowledge_server_integration(void) {
                           port);
     assert(status == 200);
 
+    /* Сверх всплеска в 30 запросов клиент получает 429 и срок ожидания. */
+    for (int attempt = 0; attempt < 31 && status != 429; ++attempt) {
+        status = http_request("POST",
+                              "/api/knowledge/feedback",
+                              "rating=good&q=question&a=answer",
+                              "Authorization: Bearer secret-token\r\n",
+                              response,
+                              sizeof(response),
+                              port);
+        assert(status == 200 || status == 429);
+    }
+    assert(status == 429);
+    const char *retry_after = strstr(response, "\r\nRetry-After: ");
+    assert(retry_after);
+    long retry_seconds = strtol(retry_after + strlen("\r\nRetry-After: "), NULL, 10);
+    assert(retry_seconds >= 1 && retry_seconds <= 60);
+    assert(strstr(response, "{\"error\":\"rate limited\"}"));
+
     kill(pid, SIGTERM);
     waitpid(pid, NULL, 0);
 
@@ -206,20 +683,69 @@ void test_knowledge_server_integration(void) {
     status = http_request("GET", "/healthz", NULL, NULL, response, sizeof(response), port);
     assert(status == 200);
     assert(strstr(response, "\"indexSource\":\"prebuilt\""));
-    assert(strstr(response, "\"documents\":1"));
+    /* Снимок в кэше хранит и документ, выученный до перезагрузки. */
+    assert(strstr(response, "\"documents\":2"));
 
     status = http_request("GET", "/api/knowledge/search?q=Kolibri", NULL, NULL, response, sizeof(response), port);
     assert(status == 200);
     assert(strstr(response, "Kolibri"));
 
+    /* Незаконченный терм находится только в режиме prefix, опечатка — в fuzzy. */
+    status = http_request("GET", "/api/knowledge/search?q=integr", NULL, NULL, response, sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "{\"snippets\":[]}"));
+    status = http_request("GET", "/api/knowledge/search?q=integr&mode=prefix", NULL, NULL, response, sizeof(response),
+                          port);
+    assert(status == 200);
+    assert(strstr(response, "\"id\":\"guide\""));
+    status = http_request("GET", "/api/knowledge/search?q=integraton&mode=prefix,fuzzy", NULL, NULL, response,
+                          sizeof(response), port);
+    assert(status == 200);
+    assert(strstr(response, "\"id\":\"guide\""));
+
+    check_bulk_ingest(port);
+
+    /* Нагрузочный генератор проигрывает журнал по всем маршрутам и видит записи генома. */
+    char load_log[512];
+    char load_report[512];
+    snprintf(load_log, sizeof(load_log), "%s/load.jsonl", cache_dir);
+    snprintf(load_report, sizeof(load_report), "%s/load.json", cache_dir);
+    write_file(load_log,
+               "Kolibri\n"
+               "{\"q\":\"integr\",\"mode\":\"prefix\",\"limit\":2}\n"
+               "{\"route\":\"teach\",\"q\":\"load\",\"a\":\"generator\"}\n"
+               "{\"route\":\"feedback\",\"rating\":\"good\",\"q\":\"Kolibri\",\"a\":\"ok\"}\n");
+    char command[1536];
+    snprintf(command,
+             sizeof(command),
+             "./kolibri_loadgen --log %s --port %d --connections 2 --requests 40 --token %s "
+             "--max-error-rate 0 --output %s",
+             load_log,
+             port,
+             token,
+             load_report);
+    assert(system(command) == 0);
+    FILE *report = fopen(load_report, "r");
+    assert(report != NULL);
+    size_t report_length = fread(response, 1U, sizeof(response) - 1U, report);
+    fclose(report);
+    response[report_length] = '\0';
+    assert(strstr(response, "\"search\":{\"requests\":20,\"ok\":20,"));
+    assert(strstr(response, "\"teach\":{\"requests\":10,\"ok\":10,"));
+    assert(strstr(response, "\"journal\":{\"written\":"));
+    remove_path(load_log);
+    remove_path(load_report);
+
     kill(pid, SIGTERM);
     waitpid(pid, NULL, 0);
 
-    char cache_index[512];
-    char cache_manifest[512];
-    snprintf(cache_index, sizeof(cache_index), "%s/index.json", cache_dir);
-    snprintf(cache_manifest, sizeof(cache_manifest), "%s/manifest.json", cache_dir);
-    remove_path(cache_index);
-    remove_path(cache_manifest);
-    rmdir(cache_dir);
+    static const char *const cache_files[] = { "index.json", "manifest.json", "index.bin" };
+    for (size_t i = 0; i < sizeof(cache_files) / sizeof(cache_files[0]); ++i) {
+        char cache_path[512];
+        snprintf(cache_path, sizeof(cache_path), "%s/%s", cache_dir, cache_files[i]);
+        remove_path(cache_path);
+    }
+    assert(rmdir(cache_dir) == 0);
+
+    check_sharded_search();
 }
@@ -7,14 +7,26 @@ void test_net(void);
 void test_digits(void);
 void test_script(void);
 void test_script_load_file(void);
+void test_script_bytecode(void);
+void test_script_slots(void);
+void test_script_arena(void);
+void test_script_compiled_image(void);
+void test_script_stream(void);
+void test_script_sink(void);
 void test_knowledge_index(void);
 void test_knowledge_queue(void);
 void test_sim(void);
 void test_public_api(void);
 void test_knowledge_server_integration(void);
 void test_sigma(void);
+void test_swarm(void);
+void test_trace(void);
+void test_memory(void);
+void test_rate_limit(void);
 
 int main(void) {
+  /* Первым: замена распределителя требует, чтобы живых блоков не было. */
+  test_memory();
   test_decimal();
   test_genome();
   test_formula();
@@ -22,12 +34,21 @@ int main(void) {
   test_net();
   test_script();
   test_script_load_file();
+  test_script_bytecode();
+  test_script_slots();
+  test_script_arena();
+  test_script_compiled_image();
+  test_script_stream();
+  test_script_sink();
   test_knowledge_index();
   test_knowledge_queue();
   test_sim();
   test_public_api();
   test_knowledge_server_integration();
   test_sigma();
+  test_swarm();
+  test_trace();
+  test_rate_limit();
   printf("all tests passed\n");
   return 0;
 }
@@ -0,0 +1,122 @@
+#include "kolibri/memory.h"
+#include "kolibri/formula.h"
+#include "kolibri/knowledge_index.h"
+#include "kolibri/sigma.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    size_t mallocs;
+    size_t reallocs;
+    size_t frees;
+} CountingAllocator;
+
+static void *counting_malloc(void *user_data, size_t size) {
+    ((CountingAllocator *)user_data)->mallocs++;
+    return malloc(size);
+}
+
+static void *counting_realloc(void *user_data, void *ptr, size_t size) {
+    ((CountingAllocator *)user_data)->reallocs++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *user_data, void *ptr) {
+    ((CountingAllocator *)user_data)->frees++;
+    free(ptr);
+}
+
+void test_memory(void) {
+    KolibriMemoryStats before;
+    KolibriMemoryStats stats;
+    assert(kolibri_memory_stats(KOLIBRI_MEMORY_SCRIPT, &before) == 0);
+    assert(kolibri_memory_stats(KOLIBRI_MEMORY_SUBSYSTEM_COUNT, &stats) != 0);
+    assert(strcmp(kolibri_memory_subsystem_name(KOLIBRI_MEMORY_KNOWLEDGE_INDEX), "knowledge_index") == 0);
+
+    /* Распределитель меняется только без живых блоков. */
+    CountingAllocator counting = { 0U, 0U, 0U };
+    KolibriAllocator allocator = { counting_malloc, counting_realloc, counting_free, &counting };
+    assert(kolibri_memory_set_allocator(&allocator) == 0);
+
+    char *text = (char *)kolibri_memory_alloc(KOLIBRI_MEMORY_SCRIPT, 100U);
+    assert(text != NULL);
+    assert(((uintptr_t)text % _Alignof(max_align_t)) == 0U);
+    assert(kolibri_memory_set_allocator(NULL) != 0);
+    kolibri_memory_stats(KOLIBRI_MEMORY_SCRIPT, &stats);
+    assert(stats.live_bytes == before.live_bytes + 100U);
+    assert(stats.live_allocations == before.live_allocations + 1U);
+    assert(stats.peak_bytes >= stats.live_bytes);
+
+    memset(text, 'x', 100U);
+    text = (char *)kolibri_memory_realloc(KOLIBRI_MEMORY_SCRIPT, text, 4000U);
+    assert(text != NULL && text[99] == 'x');
+    kolibri_memory_stats(KOLIBRI_MEMORY_SCRIPT, &stats);
+    assert(stats.live_bytes == before.live_bytes + 4000U);
+    assert(stats.total_allocations == before.total_allocations + 1U);
+
+    /* Блок можно перевести в другую подсистему при realloc. */
+    text = (char *)kolibri_memory_realloc(KOLIBRI_MEMORY_FORMULA, text, 10U);
+    kolibri_memory_stats(KOLIBRI_MEMORY_SCRIPT, &stats);
+    assert(stats.live_bytes == before.live_bytes && stats.live_allocations == before.live_allocations);
+    kolibri_memory_free(text);
+    kolibri_memory_free(NULL);
+
+    int *zeros = (int *)kolibri_memory_calloc(KOLIBRI_MEMORY_SIGMA, 16U, sizeof(int));
+    assert(zeros != NULL && zeros[15] == 0);
+    kolibri_memory_free(zeros);
+    assert(kolibri_memory_calloc(KOLIBRI_MEMORY_SIGMA, SIZE_MAX, 16U) == NULL);
+    kolibri_memory_stats(KOLIBRI_MEMORY_SIGMA, &stats);
+    assert(stats.failed_allocations >= 1U && stats.live_allocations == 0U);
+
+    char *copy = kolibri_memory_strdup(KOLIBRI_MEMORY_KNOWLEDGE_INDEX, "колибри");
+    assert(copy != NULL && strcmp(copy, "колибри") == 0);
+    kolibri_memory_free(copy);
+
+    /* Подсистемы выделяют через тот же распределитель. */
+    uintptr_t state = k_state_new(8U);
+    assert(state != 0U);
+    assert(k_observe(state, (const uint8_t *)"мир дом", 13U) == 0);
+    size_t mapped = 1U;
+    size_t sigma_bytes = k_state_memory_usage(state, &mapped);
+    assert(sigma_bytes > 0U && mapped == 0U);
+    kolibri_memory_stats(KOLIBRI_MEMORY_SIGMA, &stats);
+    assert(stats.live_bytes >= sigma_bytes / 2U && stats.live_allocations > 0U);
+    k_state_free(state);
+    kolibri_memory_stats(KOLIBRI_MEMORY_SIGMA, &stats);
+    assert(stats.live_bytes == 0U && stats.live_allocations == 0U);
+
+    KolibriFormulaPool pool;
+    assert(kf_pool_init(&pool, 7U) == 0);
+    kolibri_memory_stats(KOLIBRI_MEMORY_FORMULA, &stats);
+    assert(kf_pool_memory_usage(&pool) >= pool.arena_size);
+    assert(stats.live_bytes >= pool.arena_size);
+    kf_pool_destroy(&pool);
+    kolibri_memory_stats(KOLIBRI_MEMORY_FORMULA, &stats);
+    assert(stats.live_allocations == 0U);
+
+    char root[] = "/tmp/kolibri_memoryXXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char doc_path[64];
+    snprintf(doc_path, sizeof(doc_path), "%s/doc.md", root);
+    FILE *doc = fopen(doc_path, "w");
+    assert(doc != NULL);
+    fputs("# Память\nучёт памяти подсистем\n", doc);
+    fclose(doc);
+    const char *roots[1] = { root };
+    KolibriKnowledgeIndex *index = NULL;
+    assert(kolibri_knowledge_index_create(roots, 1U, 256U, &index) == 0 && index != NULL);
+    kolibri_memory_stats(KOLIBRI_MEMORY_KNOWLEDGE_INDEX, &stats);
+    assert(stats.live_allocations > 0U);
+    kolibri_knowledge_index_destroy(index);
+    kolibri_memory_stats(KOLIBRI_MEMORY_KNOWLEDGE_INDEX, &stats);
+    assert(stats.live_allocations == 0U);
+    remove(doc_path);
+    rmdir(root);
+
+    assert(counting.mallocs > 0U && counting.frees == counting.mallocs);
+    assert(kolibri_memory_set_allocator(NULL) == 0);
+}
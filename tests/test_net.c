@@ -1,8 +1,12 @@
 #include "kolibri/net.h"
 
+#include <arpa/inet.h>
 #include <assert.h>
 #include <math.h>
+#include <stdbool.h>
+#include <netinet/in.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 
 void test_net(void) {
@@ -51,5 +55,67 @@ void test_net(void) {
   assert(poll_status == 0);
   assert(elapsed_ms >= 0.0);
   assert(elapsed_ms < 50.0);
+
+  struct sockaddr_in bound;
+  socklen_t bound_len = sizeof(bound);
+  assert(getsockname(listener.socket_fd, (struct sockaddr *)&bound, &bound_len) == 0);
+  uint16_t port = ntohs(bound.sin_port);
+
+  /* Соединение остаётся открытым: второй раунд идёт тем же сокетом. */
+  KolibriNetClient client;
+  kn_client_init(&client, 9U);
+  int first_fd = -1;
+  for (int round = 0; round < 2; ++round) {
+    formula.fitness = 0.5 + round;
+    assert(kn_client_share_formula(&client, "127.0.0.1", port, &formula) == 0);
+    if (round == 0) {
+      first_fd = client.peers[0].socket_fd;
+    }
+    assert(client.peers[0].socket_fd == first_fd);
+    bool received = false;
+    while (!received) {
+      assert(kn_listener_poll(&listener, 1000U, &message) == 1);
+      received = message.type == KOLIBRI_MSG_MIGRATE_RULE;
+    }
+    assert(message.data.formula.node_id == 9U);
+    assert(fabs(message.data.formula.fitness - formula.fitness) < 1e-9);
+  }
+  assert(client.count == 1U);
+
+  /* Пачка от нескольких узлов разбирается целиком. */
+  KolibriNetClient others[3];
+  for (int c = 0; c < 3; ++c) {
+    kn_client_init(&others[c], 100U + (uint32_t)c);
+    for (int i = 0; i < 5; ++i) {
+      assert(kn_client_queue_formula(&others[c], "127.0.0.1", port, &formula) == 0);
+    }
+    assert(kn_client_flush(&others[c]) == 0);
+  }
+  KolibriNetMessage batch[8];
+  size_t migrated = 0;
+  size_t hellos = 0;
+  while (migrated < 15U) {
+    int got = kn_listener_poll_batch(&listener, 1000U, batch, 8U);
+    assert(got > 0);
+    for (int i = 0; i < got; ++i) {
+      if (batch[i].type == KOLIBRI_MSG_MIGRATE_RULE) {
+        assert(batch[i].data.formula.node_id >= 100U);
+        migrated++;
+      } else if (batch[i].type == KOLIBRI_MSG_HELLO) {
+        hellos++;
+      }
+    }
+  }
+  assert(migrated == 15U);
+  assert(hellos == 3U);
+  assert(listener.connection_count == 4U);
+  for (int c = 0; c < 3; ++c) {
+    kn_client_close(&others[c]);
+  }
   kn_listener_close(&listener);
+
+  assert(kn_client_queue_formula(&client, "127.0.0.1", port, &formula) == 0);
+  assert(kn_client_flush(&client) == 1);
+  assert(client.peers[0].pending_len == 0U);
+  kn_client_close(&client);
 }
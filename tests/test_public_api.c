@@ -31,6 +31,7 @@ static void test_script_smoke(void) {
 
     fclose(capture);
     ks_free(&script);
+    kf_pool_destroy(&pool);
 }
 
 static void test_genome_smoke(void) {
@@ -73,6 +74,23 @@ static void test_symbol_table_cyrillic(void) {
     size_t before = table.count;
     assert(kolibri_symbol_encode(&table, 0x2728U, digits) == 0); /* новая точка */
     assert(table.count == before + 1U);
+    assert(kolibri_symbol_decode(&table, digits, &decoded) == 0);
+    assert(decoded == 0x2728U);
+
+    /* Заполняем таблицу до предела: хеш и обратный индекс остаются согласованы. */
+    for (uint32_t codepoint = 0x4E00U; table.count < KOLIBRI_SYMBOL_MAX; ++codepoint) {
+        assert(kolibri_symbol_encode(&table, codepoint, digits) == 0);
+    }
+    for (size_t i = 0; i < table.count; ++i) {
+        uint8_t again[KOLIBRI_SYMBOL_DIGITS];
+        assert(kolibri_symbol_encode(&table, table.entries[i].codepoint, again) == 0);
+        assert(memcmp(again, table.entries[i].digits, KOLIBRI_SYMBOL_DIGITS) == 0);
+        assert(kolibri_symbol_decode(&table, again, &decoded) == 0);
+        assert(decoded == table.entries[i].codepoint);
+    }
+    assert(table.count == KOLIBRI_SYMBOL_MAX);
+    const uint8_t unknown[KOLIBRI_SYMBOL_DIGITS] = {9, 9, 9};
+    assert(kolibri_symbol_decode(&table, unknown, &decoded) == -1);
 }
 
 void test_public_api(void) {
@@ -0,0 +1,60 @@
+#include "kolibri/rate_limit.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define RATE_TEST_SECOND 1000000000ULL
+#define RATE_TEST_CLIENTS 4096U
+
+static void test_burst_and_retry_after(void) {
+    KolibriRateLimiter *limiter = calloc(1U, sizeof(*limiter));
+    assert(limiter != NULL);
+    const uint64_t t0 = 1000U * RATE_TEST_SECOND;
+    uint64_t retry = 0U;
+    for (unsigned i = 0; i < KOLIBRI_RATE_LIMIT_BURST; ++i) {
+        assert(kolibri_rate_limit_allow(limiter, 7U, t0, &retry) == 1);
+    }
+    /* Сверх всплеска ждать ровно один интервал: 60 с / 30 запросов. */
+    assert(kolibri_rate_limit_allow(limiter, 7U, t0, &retry) == 0);
+    assert(retry == 2U * RATE_TEST_SECOND);
+    assert(kolibri_rate_limit_allow(limiter, 7U, t0 + retry - 1U, &retry) == 0);
+    assert(retry == 1U);
+    assert(kolibri_rate_limit_allow(limiter, 7U, t0 + 2U * RATE_TEST_SECOND, &retry) == 1);
+    assert(kolibri_rate_limit_allow(limiter, 7U, t0 + 2U * RATE_TEST_SECOND, &retry) == 0);
+    /* Соседний клиент со своим ведром не страдает. */
+    assert(kolibri_rate_limit_allow(limiter, 8U, t0, &retry) == 1);
+    /* NULL вместо retry_after допустим. */
+    assert(kolibri_rate_limit_allow(limiter, 7U, t0, NULL) == 0);
+    free(limiter);
+}
+
+static void test_slot_reuse(void) {
+    KolibriRateLimiter *limiter = calloc(1U, sizeof(*limiter));
+    assert(limiter != NULL);
+    const uint64_t t0 = 1000U * RATE_TEST_SECOND;
+    /* Клиентов больше, чем слотов: лишние делят общее ведро шарда. */
+    size_t denied = 0U;
+    for (uint32_t client = 1U; client <= RATE_TEST_CLIENTS; ++client) {
+        denied += kolibri_rate_limit_allow(limiter, client, t0, NULL) == 0;
+    }
+    assert(denied > 0U);
+    /* После полного восстановления слоты достаются новым клиентам. */
+    const uint64_t t1 = t0 + (KOLIBRI_RATE_LIMIT_WINDOW + 1U) * RATE_TEST_SECOND;
+    size_t full_burst = 0U;
+    for (uint32_t client = 100000U; client < 100000U + RATE_TEST_CLIENTS; ++client) {
+        unsigned allowed = 0U;
+        for (unsigned i = 0; i < KOLIBRI_RATE_LIMIT_BURST; ++i) {
+            allowed += (unsigned)kolibri_rate_limit_allow(limiter, client, t1, NULL);
+        }
+        full_burst += allowed == KOLIBRI_RATE_LIMIT_BURST;
+    }
+    /* Через одни лишь общие вёдра полный всплеск получили бы не больше 16 клиентов. */
+    assert(full_burst > (size_t)KOLIBRI_RATE_SHARDS * KOLIBRI_RATE_SHARD_SLOTS / 4U);
+    assert(full_burst <= (size_t)KOLIBRI_RATE_SHARDS * (KOLIBRI_RATE_SHARD_SLOTS + 1U));
+    free(limiter);
+}
+
+void test_rate_limit(void) {
+    test_burst_and_retry_after();
+    test_slot_reuse();
+}
@@ -2,6 +2,7 @@
 #include "kolibri/roy.h"
 
 #include <arpa/inet.h>
+#include <openssl/hmac.h>
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
@@ -51,10 +52,11 @@ void test_roy(void) {
     KolibriRoySobytie sobytie;
     while (kolibri_roy_poluchit_sobytie(&vtoroj, &sobytie) > 0) {
         if (sobytie.tip == KOLIBRI_ROY_SOBYTIE_FORMULA) {
-            assert(sobytie.formula.gene.length == 3U);
-            assert(sobytie.formula.gene.digits[0] == 1U);
-            assert(sobytie.formula.gene.digits[1] == 2U);
-            assert(sobytie.formula.gene.digits[2] == 3U);
+            assert(sobytie.gene.length == 3U);
+            assert(sobytie.gene.digits[0] == 1U);
+            assert(sobytie.gene.digits[1] == 2U);
+            assert(sobytie.gene.digits[2] == 3U);
+            assert(sobytie.fitness == 0.75);
             nashli_formulu = 1;
         }
     }
@@ -62,4 +64,131 @@ void test_roy(void) {
 
     kolibri_roy_ostanovit(&pervyj);
     kolibri_roy_ostanovit(&vtoroj);
+
+    /* Переполненное кольцо отбрасывает новые события и считает их. */
+    assert(kolibri_roy_zapustit(&pervyj, 3003U, 51202U, TEST_KEY,
+                                sizeof(TEST_KEY) - 1U) == 0);
+    assert(kolibri_roy_zapustit_s_ocheredyu(&vtoroj, 4004U, 51203U, TEST_KEY,
+                                            sizeof(TEST_KEY) - 1U, 3U) == 0);
+    adres.sin_port = htons(51203U);
+    assert(kolibri_roy_dobavit_soseda(&pervyj, &adres, 4004U) == 0);
+    for (int povtor = 0; povtor < 20; ++povtor) {
+        assert(kolibri_roy_otpravit_sluchajnomu(&pervyj, (uint64_t)povtor,
+                                                &formula) == 0);
+    }
+    usleep(200000);
+    KolibriRoySobytie paket[16];
+    size_t polucheno = kolibri_roy_poluchit_sobytiya(&vtoroj, paket, 16U);
+    assert(polucheno == 4U);
+    assert(kolibri_roy_poteryano_sobytiy(&vtoroj) > 0U);
+    assert(kolibri_roy_poluchit_sobytiya(&vtoroj, paket, 16U) == 0U);
+
+    kolibri_roy_ostanovit(&pervyj);
+    kolibri_roy_ostanovit(&vtoroj);
+
+    /* Пачка датаграмм и рассылка нескольким соседям доходят без потерь. */
+    KolibriRoy tretij;
+    assert(kolibri_roy_zapustit(&pervyj, 5005U, 51204U, TEST_KEY,
+                                sizeof(TEST_KEY) - 1U) == 0);
+    assert(kolibri_roy_zapustit(&vtoroj, 6006U, 51205U, TEST_KEY,
+                                sizeof(TEST_KEY) - 1U) == 0);
+    assert(kolibri_roy_zapustit(&tretij, 7007U, 51206U, TEST_KEY,
+                                sizeof(TEST_KEY) - 1U) == 0);
+    adres.sin_port = htons(51205U);
+    assert(kolibri_roy_dobavit_soseda(&pervyj, &adres, 6006U) == 0);
+    adres.sin_port = htons(51206U);
+    assert(kolibri_roy_dobavit_soseda(&pervyj, &adres, 7007U) == 0);
+    for (int povtor = 0; povtor < 40; ++povtor) {
+        assert(kolibri_roy_otpravit_sluchajnomu(&pervyj, 0U, &formula) == 0);
+    }
+    assert(kolibri_roy_otpravit_vsem(&pervyj, &formula) == 0);
+    usleep(200000);
+    size_t formul_vtoroj = 0U;
+    size_t formul_tretij = 0U;
+    while ((polucheno = kolibri_roy_poluchit_sobytiya(&vtoroj, paket, 16U)) >
+           0U) {
+        for (size_t indeks = 0U; indeks < polucheno; ++indeks) {
+            formul_vtoroj += paket[indeks].tip == KOLIBRI_ROY_SOBYTIE_FORMULA;
+        }
+    }
+    while ((polucheno = kolibri_roy_poluchit_sobytiya(&tretij, paket, 16U)) >
+           0U) {
+        for (size_t indeks = 0U; indeks < polucheno; ++indeks) {
+            formul_tretij += paket[indeks].tip == KOLIBRI_ROY_SOBYTIE_FORMULA;
+        }
+    }
+    assert(formul_vtoroj + formul_tretij == 42U);
+    assert(formul_vtoroj >= 1U && formul_tretij >= 1U);
+    assert(kolibri_roy_poteryano_sobytiy(&vtoroj) == 0U);
+
+    /* Пачечная проверка совпадает с разовым HMAC и отвергает подделки. */
+    uint8_t podlinnyj[48 + KOLIBRI_ROY_HMAC_SIZE];
+    for (size_t indeks = 0U; indeks < 48U; ++indeks) {
+        podlinnyj[indeks] = (uint8_t)(indeks * 7U);
+    }
+    unsigned int hmac_dlina = 0U;
+    assert(HMAC(EVP_sha256(), TEST_KEY, (int)(sizeof(TEST_KEY) - 1U),
+                podlinnyj, 48U, podlinnyj + 48U, &hmac_dlina));
+    uint8_t poddelka[sizeof(podlinnyj)];
+    memcpy(poddelka, podlinnyj, sizeof(poddelka));
+    poddelka[3] ^= 0x01U;
+    const uint8_t *proverka[3] = {podlinnyj, poddelka, podlinnyj};
+    size_t dliny[3] = {sizeof(podlinnyj), sizeof(poddelka), 20U};
+    uint8_t verno[3];
+    assert(kolibri_roy_proverit_pakety(&vtoroj, proverka, dliny, 3U, verno) ==
+           1U);
+    assert(verno[0] == 1U && verno[1] == 0U && verno[2] == 0U);
+
+    kolibri_roy_ostanovit(&pervyj);
+    kolibri_roy_ostanovit(&vtoroj);
+    kolibri_roy_ostanovit(&tretij);
+
+    /* Активный вид держится около log2(N) + 1, остальное уходит в пассивный;
+     * повторное знакомство не плодит записей. */
+    assert(kolibri_roy_zapustit(&pervyj, 8008U, 51207U, TEST_KEY,
+                                sizeof(TEST_KEY) - 1U) == 0);
+    for (int povtor = 0; povtor < 2; ++povtor) {
+        for (uint16_t nomer = 0U; nomer < 40U; ++nomer) {
+            adres.sin_port = htons((uint16_t)(52000U + nomer));
+            assert(kolibri_roy_dobavit_soseda(&pervyj, &adres,
+                                              9000U + nomer) == 0);
+        }
+    }
+    size_t passivnyh = 0U;
+    assert(kolibri_roy_razmer_vida(&pervyj, &passivnyh) == 7U);
+    assert(passivnyh == 33U);
+    KolibriRoySosed izvestnye[64];
+    assert(kolibri_roy_spisok_sosedey(&pervyj, izvestnye, 64U) == 40U);
+    kolibri_roy_ostanovit(&pervyj);
+
+    /* Кольцо из шести узлов: формула обходит его пересылками по активным
+     * видам, и каждый узел получает её ровно один раз. */
+    KolibriRoy koltso[6];
+    for (uint16_t nomer = 0U; nomer < 6U; ++nomer) {
+        assert(kolibri_roy_zapustit(&koltso[nomer], 100U + nomer,
+                                    (uint16_t)(51210U + nomer), TEST_KEY,
+                                    sizeof(TEST_KEY) - 1U) == 0);
+    }
+    for (uint16_t nomer = 0U; nomer < 6U; ++nomer) {
+        uint16_t sleduyushchij = (uint16_t)((nomer + 1U) % 6U);
+        adres.sin_port = htons((uint16_t)(51210U + sleduyushchij));
+        assert(kolibri_roy_dobavit_soseda(&koltso[nomer], &adres,
+                                          100U + sleduyushchij) == 0);
+    }
+    usleep(200000);
+    assert(kolibri_roy_otpravit_vsem(&koltso[0], &formula) == 0);
+    usleep(300000);
+    for (size_t nomer = 0U; nomer < 6U; ++nomer) {
+        size_t formul = 0U;
+        while ((polucheno = kolibri_roy_poluchit_sobytiya(&koltso[nomer], paket,
+                                                          16U)) > 0U) {
+            for (size_t indeks = 0U; indeks < polucheno; ++indeks) {
+                formul += paket[indeks].tip == KOLIBRI_ROY_SOBYTIE_FORMULA;
+            }
+        }
+        assert(formul == (nomer == 0U ? 0U : 1U));
+    }
+    for (size_t nomer = 0U; nomer < 6U; ++nomer) {
+        kolibri_roy_ostanovit(&koltso[nomer]);
+    }
 }
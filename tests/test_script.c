@@ -48,6 +48,7 @@ void test_script(void) {
     assert(luchshaja != NULL);
     assert(strstr(bufer, "Kolibri приветствует Архитектора") != NULL);
     assert(strstr(bufer, "4") != NULL);
+    kf_pool_destroy(&pool);
 }
 
 static void zapisat_skript_text(char *path, size_t path_dlina, const char *programma) {
@@ -88,4 +89,302 @@ void test_script_load_file(void) {
 
     remove(vremya);
     ks_free(&skript);
+    kf_pool_destroy(&pool);
+}
+
+void test_script_bytecode(void) {
+    KolibriScript skript;
+    assert(ks_init(&skript, NULL, NULL) == 0);
+
+    const char *programma =
+        "начало:\n"
+        "    переменная n = 0\n"
+        "    пока n < 3 делать\n"
+        "        переменная m = 0\n"
+        "        пока m < 2 делать\n"
+        "            показать m\n"
+        "            переменная m = 5\n"
+        "        конец\n"
+        "        переменная n = 4\n"
+        "    конец\n"
+        "    если n >= 4 тогда\n"
+        "        показать \"да\"\n"
+        "    иначе\n"
+        "        показать \"нет\"\n"
+        "    конец\n"
+        "    показать k\n"
+        "    показать n\n"
+        "конец.\n";
+
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    assert(ks_load_text(&skript, programma) == 0);
+    assert(ks_compile(&skript) == 0);
+    assert(ks_execute(&skript) == 0);
+    /* Повторный запуск использует уже построенный байткод. */
+    assert(ks_execute(&skript) == 0);
+
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    char bufer[256];
+    size_t prochitano = fread(bufer, 1U, sizeof(bufer) - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    assert(strcmp(bufer, "0\nда\nk\n4\n0\nда\nk\n4\n") == 0);
+
+    const char *beskonechnyj =
+        "начало:\n"
+        "    переменная i = 0\n"
+        "    пока i < 1 делать\n"
+        "        переменная i = 0\n"
+        "    конец\n"
+        "конец.\n";
+    assert(ks_load_text(&skript, beskonechnyj) == 0);
+    assert(ks_execute(&skript) != 0);
+    ks_free(&skript);
+}
+
+void test_script_slots(void) {
+    KolibriFormulaPool pool;
+    kf_pool_init(&pool, 5150ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, &pool, NULL) == 0);
+
+    size_t emkost = 32768U;
+    char *programma = (char *)malloc(emkost);
+    assert(programma != NULL);
+    size_t dlina = (size_t)snprintf(programma, emkost, "начало:\n");
+    for (int i = 0; i < 300; ++i) {
+        dlina += (size_t)snprintf(programma + dlina, emkost - dlina, "    переменная v%d = %d\n", i, i);
+    }
+    dlina += (size_t)snprintf(programma + dlina, emkost - dlina,
+                              "    переменная dlinnaja = \"строка заметно длиннее встроенного буфера значения\"\n"
+                              "    переменная kopija = dlinnaja\n"
+                              "    показать kopija\n"
+                              "    показать v299\n"
+                              "    создать формулу f из \"ассоциация\"\n"
+                              "    отбросить f\n"
+                              "    создать формулу f из \"снова\"\n"
+                              "    показать фитнес f\n"
+                              "конец.\n");
+    assert(dlina < emkost);
+
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    assert(ks_load_text(&skript, programma) == 0);
+    assert(ks_execute(&skript) == 0);
+    free(programma);
+
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    char bufer[256];
+    size_t prochitano = fread(bufer, 1U, sizeof(bufer) - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    assert(strcmp(bufer, "строка заметно длиннее встроенного буфера значения\n299\n0\n") == 0);
+
+    ks_free(&skript);
+    kf_pool_destroy(&pool);
+}
+
+void test_script_arena(void) {
+    KolibriFormulaPool pool;
+    kf_pool_init(&pool, 6160ULL);
+    KolibriScript skript;
+    assert(ks_init(&skript, &pool, NULL) == 0);
+
+    /* Литерал больше страницы арены и повторная компиляция после ошибки. */
+    size_t dlina_literala = 40000U;
+    size_t emkost = dlina_literala + 128U;
+    char *programma = (char *)malloc(emkost);
+    assert(programma != NULL);
+    size_t dlina = (size_t)snprintf(programma, emkost, "начало:\n    показать \"");
+    memset(programma + dlina, 'a', dlina_literala);
+    dlina += dlina_literala;
+    dlina += (size_t)snprintf(programma + dlina, emkost - dlina, "\"\nконец.\n");
+    assert(dlina < emkost);
+
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    for (int i = 0; i < 3; ++i) {
+        assert(ks_load_text(&skript, programma) == 0);
+        assert(ks_execute(&skript) == 0);
+        assert(ks_load_text(&skript, "начало:\n    показать\n") == 0);
+        assert(ks_compile(&skript) != 0);
+    }
+    free(programma);
+
+    fflush(vyvod);
+    assert(ftell(vyvod) == (long)(3U * (dlina_literala + 1U)));
+    fclose(vyvod);
+
+    ks_free(&skript);
+    kf_pool_destroy(&pool);
+}
+
+void test_script_compiled_image(void) {
+    const char *programma =
+        "начало:\n"
+        "    переменная n = 1\n"
+        "    пока n < 3 делать\n"
+        "        показать n\n"
+        "        переменная n = 3\n"
+        "    конец\n"
+        "    создать формулу f из \"ассоциация\"\n"
+        "    показать \"образ\"\n"
+        "конец.\n";
+
+    char vremya[sizeof "/tmp/kolibri_scriptXXXXXX"];
+    zapisat_skript_text(vremya, sizeof(vremya), programma);
+    char obraz[sizeof(vremya) + 1U];
+    snprintf(obraz, sizeof(obraz), "%sc", vremya);
+
+    /* Одинаковый текст компилируется один раз и делится через кэш. */
+    KolibriScript pervyj;
+    KolibriScript vtoroj;
+    assert(ks_init(&pervyj, NULL, NULL) == 0);
+    assert(ks_init(&vtoroj, NULL, NULL) == 0);
+    assert(ks_load_text(&pervyj, programma) == 0);
+    assert(ks_compile(&pervyj) == 0);
+    assert(ks_load_text(&vtoroj, programma) == 0);
+    assert(ks_compile(&vtoroj) == 0);
+    assert(pervyj.bytecode == vtoroj.bytecode);
+
+    FILE *fajl = fopen(obraz, "wb");
+    assert(fajl != NULL);
+    assert(ks_save_compiled(&pervyj, fajl) == 0);
+    fclose(fajl);
+    ks_free(&pervyj);
+    ks_free(&vtoroj);
+
+    /* Образ исполняется без исходного текста. */
+    KolibriScript skript;
+    assert(ks_init(&skript, NULL, NULL) == 0);
+    FILE *vyvod = tmpfile();
+    assert(vyvod != NULL);
+    ks_set_output(&skript, vyvod);
+    assert(ks_load_file(&skript, obraz) == 0);
+    assert(skript.source_text == NULL);
+    assert(ks_execute(&skript) == 0);
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    char bufer[128];
+    size_t prochitano = fread(bufer, 1U, sizeof(bufer) - 1U, vyvod);
+    bufer[prochitano] = '\0';
+    fclose(vyvod);
+    assert(strcmp(bufer, "1\nобраз\n") == 0);
+
+    /* Соседний .ksc подхватывается для того же текста и игнорируется для другого. */
+    assert(ks_load_file(&skript, vremya) == 0);
+    assert(skript.source_text != NULL && skript.bytecode != NULL);
+    fajl = fopen(vremya, "wb");
+    assert(fajl != NULL);
+    fputs("начало:\n    показать 2\nконец.\n", fajl);
+    fclose(fajl);
+    assert(ks_load_file(&skript, vremya) == 0);
+    assert(skript.bytecode == NULL);
+
+    /* Повреждённый образ отвергается целиком. */
+    fajl = fopen(obraz, "wb");
+    assert(fajl != NULL);
+    fputs("KSBC\x01\x00\x00\x00мусор", fajl);
+    fclose(fajl);
+    assert(ks_load_file(&skript, obraz) != 0);
+
+    remove(vremya);
+    remove(obraz);
+    ks_free(&skript);
+}
+
+static void prochitat_vyvod(FILE *vyvod, char *bufer, size_t razmer) {
+    fflush(vyvod);
+    fseek(vyvod, 0L, SEEK_SET);
+    size_t prochitano = fread(bufer, 1U, razmer - 1U, vyvod);
+    bufer[prochitano] = '\0';
+}
+
+void test_script_stream(void) {
+    const char *programma =
+        "\n"
+        "начало:\n"
+        "    переменная n = 0\n"
+        "    обучить связь \"2\" -> \"4\"\n"
+        "\n"
+        "    пока n < 2 делать\n"
+        "        если n == 0 тогда\n"
+        "            показать \"ноль\"\n"
+        "        иначе\n"
+        "            показать \"не ноль\"\n"
+        "        конец\n"
+        "        переменная n = 5\n"
+        "    конец\n"
+        "    показать n\n"
+        "    создать формулу f из \"ассоциация\"\n"
+        "    показать фитнес f\n"
+        "конец.\n";
+
+    /* Потоковый режим печатает то же, что и обычное исполнение. */
+    KolibriScript skript;
+    assert(ks_init(&skript, NULL, NULL) == 0);
+    FILE *obychnyj = tmpfile();
+    assert(obychnyj != NULL);
+    ks_set_output(&skript, obychnyj);
+    assert(ks_load_text(&skript, programma) == 0);
+    assert(ks_execute(&skript) == 0);
+    char ozhidaemo[256];
+    prochitat_vyvod(obychnyj, ozhidaemo, sizeof(ozhidaemo));
+    fclose(obychnyj);
+
+    FILE *vhod = tmpfile();
+    assert(vhod != NULL);
+    fputs(programma, vhod);
+    fseek(vhod, 0L, SEEK_SET);
+    FILE *potokovyj = tmpfile();
+    assert(potokovyj != NULL);
+    ks_set_output(&skript, potokovyj);
+    assert(ks_execute_stream(&skript, vhod) == 0);
+    fclose(vhod);
+    char bufer[256];
+    prochitat_vyvod(potokovyj, bufer, sizeof(bufer));
+    fclose(potokovyj);
+    assert(strcmp(bufer, "ноль\n5\n0\n") == 0);
+    assert(strcmp(bufer, ozhidaemo) == 0);
+
+    /* Команды до обрыва уже выполнены, но отсутствие 'конец.' — ошибка. */
+    vhod = tmpfile();
+    assert(vhod != NULL);
+    fputs("начало:\n    показать \"сразу\"\n", vhod);
+    fseek(vhod, 0L, SEEK_SET);
+    potokovyj = tmpfile();
+    assert(potokovyj != NULL);
+    ks_set_output(&skript, potokovyj);
+    assert(ks_execute_stream(&skript, vhod) != 0);
+    fclose(vhod);
+    prochitat_vyvod(potokovyj, bufer, sizeof(bufer));
+    fclose(potokovyj);
+    assert(strcmp(bufer, "сразу\n") == 0);
+
+    ks_free(&skript);
+}
+
+void test_script_sink(void) {
+    KolibriScript skript;
+    assert(ks_init(&skript, NULL, NULL) == 0);
+    char bufer[16];
+    KolibriScriptBuffer priemnik = {bufer, sizeof(bufer), 0U, 0U};
+    ks_set_sink(&skript, ks_buffer_sink, &priemnik);
+    assert(ks_load_text(&skript, "начало:\n    показать \"раз\"\n    показать \"два\"\nконец.\n") == 0);
+    assert(ks_execute(&skript) == 0);
+    assert(strcmp(bufer, "раз\nдва\n") == 0);
+
+    /* Переполнение обрезает вывод, но не ломает строку. */
+    priemnik.length = 0U;
+    assert(ks_load_text(&skript, "начало:\n    показать \"очень длинная строка\"\nконец.\n") == 0);
+    assert(ks_execute(&skript) == 0);
+    assert(priemnik.length == sizeof(bufer) - 1U && priemnik.dropped > 0U);
+    assert(bufer[sizeof(bufer) - 1U] == '\0');
+    ks_free(&skript);
 }
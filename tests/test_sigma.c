@@ -1,9 +1,12 @@
 #include "kolibri/sigma.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void test_sigma_learn_and_decode(void) {
     uintptr_t st = k_state_new(0);
@@ -45,6 +48,255 @@ static void test_sigma_learn_and_decode(void) {
     k_state_free(st2);
 }
 
+static void test_sigma_vocabulary(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+
+    /* Повторные наблюдения попадают в тот же токен, а не создают новый. */
+    char word[32];
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 5000; ++i) {
+            int len = snprintf(word, sizeof(word), "w%d ", i);
+            assert(k_observe(st, (const uint8_t *)word, (size_t)len) == 0);
+        }
+    }
+    const char *hot = "w42 w42 w42";
+    assert(k_observe(st, (const uint8_t *)hot, strlen(hot)) == 0);
+
+    uint8_t profile[256];
+    int prof = k_profile(st, K_SIGMA_PROFILE_DIGITS, profile, sizeof(profile));
+    assert(prof > 0);
+    profile[prof] = '\0';
+    size_t total = 0U;
+    const char *cursor = strchr((const char *)profile, '[');
+    assert(cursor != NULL);
+    for (int i = 0; i < 10; ++i) {
+        char *end = NULL;
+        total += (size_t)strtoul(cursor + 1, &end, 10);
+        cursor = end;
+    }
+    assert(total == 5000U);
+
+    uint8_t out[64];
+    int produced = k_decode(st, (const uint8_t *)"w42", 3U, out, sizeof(out), 0, 1);
+    assert(produced > 0);
+
+    size_t cap = 256U * 1024U;
+    uint8_t *snapshot = malloc(cap);
+    assert(snapshot != NULL);
+    int snap = k_state_save(st, snapshot, cap);
+    assert(snap > 0);
+    uintptr_t st2 = k_state_new(0);
+    assert(st2 != 0U);
+    assert(k_state_load(st2, snapshot, (size_t)snap) == 0);
+    uint8_t out2[64];
+    int produced2 = k_decode(st2, (const uint8_t *)"w42", 3U, out2, sizeof(out2), 0, 1);
+    assert(produced2 == produced);
+    assert(memcmp(out, out2, (size_t)produced) == 0);
+    uint8_t profile2[256];
+    int prof2 = k_profile(st2, K_SIGMA_PROFILE_DIGITS, profile2, sizeof(profile2));
+    assert(prof2 == prof);
+    assert(memcmp(profile, profile2, (size_t)prof) == 0);
+
+    free(snapshot);
+    k_state_free(st);
+    k_state_free(st2);
+}
+
+static void test_sigma_ranking_refresh(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    const char *corpus = "one two three four five six seven eight nine ten";
+    assert(k_observe(st, (const uint8_t *)corpus, strlen(corpus)) == 0);
+    uint8_t out[64];
+    assert(k_decode(st, NULL, 0U, out, sizeof(out), 0, 1) > 0);
+
+    /* После наблюдений ранжирование пересчитывается: лидер меняется. */
+    for (int i = 0; i < 20; ++i) {
+        assert(k_observe(st, (const uint8_t *)"zeta ", 5U) == 0);
+    }
+    int produced = k_decode(st, NULL, 0U, out, sizeof(out), 0, 1);
+    assert(produced == 4);
+    assert(memcmp(out, "zeta", 4U) == 0);
+    k_state_free(st);
+}
+
+static void test_sigma_snapshot_map(void) {
+    uintptr_t st = k_state_new(0);
+    assert(st != 0U);
+    const char *corpus = "mir dom mir les dom mir reka";
+    assert(k_observe(st, (const uint8_t *)corpus, strlen(corpus)) == 0);
+    assert(k_digit_add_syll(st, 3U, (const uint8_t *)"ka", 2U) == 0);
+
+    size_t cap = 8192U;
+    uint8_t *snapshot = malloc(cap);
+    uint8_t *pristine = malloc(cap);
+    assert(snapshot != NULL && pristine != NULL);
+    int snap = k_state_save(st, snapshot, cap);
+    assert(snap > 0);
+    memcpy(pristine, snapshot, (size_t)snap);
+
+    uint8_t expected[64];
+    int produced = k_decode(st, NULL, 0U, expected, sizeof(expected), 0, 3);
+    assert(produced > 0);
+
+    uintptr_t mapped = k_state_new(0);
+    assert(mapped != 0U);
+    assert(k_state_map(mapped, snapshot, (size_t)snap) == 0);
+    uint8_t out[64];
+    assert(k_decode(mapped, NULL, 0U, out, sizeof(out), 0, 3) == produced);
+    assert(memcmp(out, expected, (size_t)produced) == 0);
+
+    /* Запись в подключённое состояние не трогает сам снимок. */
+    assert(k_observe(mapped, (const uint8_t *)"mir dom novyi", 13U) == 0);
+    assert(k_digit_add_syll(mapped, 3U, (const uint8_t *)"ro", 2U) == 0);
+    assert(memcmp(snapshot, pristine, (size_t)snap) == 0);
+    assert(k_state_map(mapped, snapshot, 64U) == -2);
+
+    /* Невыровненный буфер не подключается, но загружается копией. */
+    uint8_t *shifted = malloc((size_t)snap + 1U);
+    assert(shifted != NULL);
+    memcpy(shifted + 1, snapshot, (size_t)snap);
+    uintptr_t copied = k_state_new(0);
+    assert(copied != 0U);
+    assert(k_state_map(copied, shifted + 1, (size_t)snap) == -6);
+    assert(k_state_load(copied, shifted + 1, (size_t)snap) == 0);
+    free(shifted);
+    assert(k_decode(copied, NULL, 0U, out, sizeof(out), 0, 3) == produced);
+    assert(memcmp(out, expected, (size_t)produced) == 0);
+    k_state_free(copied);
+
+    char template[] = "/tmp/kolibri_sigmaXXXXXX";
+    int fd = mkstemp(template);
+    assert(fd != -1);
+    assert(write(fd, snapshot, (size_t)snap) == snap);
+    close(fd);
+    uintptr_t from_file = k_state_new(0);
+    assert(from_file != 0U);
+    assert(k_state_map_file(from_file, template) == 0);
+    assert(k_decode(from_file, NULL, 0U, out, sizeof(out), 0, 3) == produced);
+    assert(memcmp(out, expected, (size_t)produced) == 0);
+    assert(k_observe(from_file, (const uint8_t *)corpus, strlen(corpus)) == 0);
+    unlink(template);
+
+    /* Старый формат v1 по-прежнему читается. */
+    uint8_t legacy[256];
+    size_t len = 0U;
+    uint32_t u32 = 1U;
+    float f32 = 1.0f;
+    memcpy(legacy, "KSGM", 4U);
+    len = 4U;
+    memcpy(legacy + len, &u32, 4U);
+    len += 4U;
+    memcpy(legacy + len, &f32, 4U);
+    len += 4U;
+    f32 = 3.0f;
+    memcpy(legacy + len, &f32, 4U);
+    len += 4U;
+    u32 = K_SIGMA_VOTE_RESONANT;
+    memcpy(legacy + len, &u32, 4U);
+    len += 4U;
+    for (int d = 0; d < 10; ++d) {
+        uint32_t tokens = d == 0 ? 1U : 0U;
+        memcpy(legacy + len, &tokens, 4U);
+        len += 4U;
+        if (tokens) {
+            u32 = 3U;
+            memcpy(legacy + len, &u32, 4U);
+            memcpy(legacy + len + 4U, "sol", 3U);
+            u32 = 2U;
+            memcpy(legacy + len + 7U, &u32, 4U);
+            len += 11U;
+        }
+        u32 = 0U;
+        memcpy(legacy + len, &u32, 4U);
+        len += 4U;
+        uint64_t total = tokens ? 2U : 0U;
+        memcpy(legacy + len, &total, 8U);
+        len += 8U;
+    }
+    uintptr_t old = k_state_new(0);
+    assert(old != 0U);
+    assert(k_state_load(old, legacy, len) == 0);
+    produced = k_decode(old, NULL, 0U, out, sizeof(out), 0, 1);
+    assert(produced == 3 && memcmp(out, "sol", 3U) == 0);
+
+    k_state_free(old);
+    k_state_free(from_file);
+    k_state_free(mapped);
+    k_state_free(st);
+    free(pristine);
+    free(snapshot);
+}
+
+typedef struct {
+    uintptr_t state;
+    int       failures;
+} SigmaReader;
+
+static void *sigma_reader_main(void *arg) {
+    SigmaReader *reader = arg;
+    uint8_t buffers[4][64];
+    KSigmaDecodeRequest batch[4];
+    for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 4; ++i) {
+            batch[i] = (KSigmaDecodeRequest){ .out = buffers[i], .cap = sizeof(buffers[i]), .topk = i + 1 };
+        }
+        reader->failures += k_decode_many(reader->state, batch, 4U);
+        for (int i = 0; i < 4; ++i) {
+            if (batch[i].result <= 0) reader->failures++;
+        }
+    }
+    return NULL;
+}
+
+static void test_sigma_concurrency(void) {
+    uintptr_t a = k_state_new(0);
+    uintptr_t b = k_state_new(0);
+    assert(a != 0U && b != 0U);
+    const char *corpus = "sol sol sol luna luna terra";
+    assert(k_observe(a, (const uint8_t *)corpus, strlen(corpus)) == 0);
+    assert(k_observe(b, (const uint8_t *)corpus, strlen(corpus)) == 0);
+
+    /* Настройки одного состояния не влияют на другое. */
+    assert(k_state_set_constraints(a, 0.1f, 0.1f) == 0);
+    assert(k_state_vote_mode(b, K_SIGMA_VOTE_GREEDY) == K_SIGMA_VOTE_RESONANT);
+    uint8_t out[64];
+    assert(k_decode(a, NULL, 0U, out, sizeof(out), 0, 3) == 0);
+    assert(k_decode(b, NULL, 0U, out, sizeof(out), 0, 3) > 0);
+    uint8_t profile[256];
+    int prof = k_profile(b, K_SIGMA_PROFILE_DIGITS, profile, sizeof(profile));
+    assert(prof > 0);
+    assert(strstr((char *)profile, "\"mode\":0") != NULL);
+
+    SigmaReader readers[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; ++i) {
+        readers[i] = (SigmaReader){ .state = b, .failures = 0 };
+        assert(pthread_create(&threads[i], NULL, sigma_reader_main, &readers[i]) == 0);
+    }
+    char word[32];
+    for (int i = 0; i < 2000; ++i) {
+        int len = snprintf(word, sizeof(word), "x%d sol ", i);
+        assert(k_observe(b, (const uint8_t *)word, (size_t)len) == 0);
+    }
+    for (int i = 0; i < 4; ++i) {
+        pthread_join(threads[i], NULL);
+        assert(readers[i].failures == 0);
+    }
+
+    KSigmaDecodeRequest bad = { .out = NULL, .cap = 0U, .topk = 1 };
+    assert(k_decode_many(b, &bad, 1U) == 1);
+    assert(bad.result == -1);
+
+    k_state_free(a);
+    k_state_free(b);
+}
+
 void test_sigma(void) {
     test_sigma_learn_and_decode();
+    test_sigma_vocabulary();
+    test_sigma_ranking_refresh();
+    test_sigma_snapshot_map();
+    test_sigma_concurrency();
 }
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 void test_sim(void) {
     KolibriSimConfig cfg = {
@@ -39,6 +40,14 @@ void test_sim(void) {
         exit(1);
     }
 
+    size_t before = offset + count;
+    if (kolibri_sim_tick_n(sim, 1000U, 0U) != 0 ||
+        kolibri_sim_get_logs(sim, logs, 8U, &count, &offset) != 0 || offset + count != before + 1U) {
+        fprintf(stderr, "kolibri_sim_tick_n should log only the last tick\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+
     KolibriSimFormula formulas[8];
     size_t fcount = 0U;
     if (kolibri_sim_get_formulas(sim, formulas, 8U, &fcount) != 0) {
@@ -53,6 +62,27 @@ void test_sim(void) {
         exit(1);
     }
 
+    /* Пул переживает пересоздание через контрольную точку. */
+    char path[] = "/tmp/kolibri_sim_poolXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || close(fd) != 0 || kolibri_sim_save_pool(sim, NULL) == 0 || kolibri_sim_save_pool(sim, path) != 0) {
+        fprintf(stderr, "kolibri_sim_save_pool failed\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+    kolibri_sim_destroy(sim);
+    cfg.seed = 99U;
+    cfg.pool_checkpoint_path = path;
+    sim = kolibri_sim_create(&cfg);
+    KolibriSimFormula restored[8];
+    size_t rcount = 0U;
+    if (!sim || kolibri_sim_get_formulas(sim, restored, 8U, &rcount) != 0 || rcount != fcount ||
+        restored[0].fitness != formulas[0].fitness || restored[rcount - 1U].fitness != formulas[fcount - 1U].fitness) {
+        fprintf(stderr, "kolibri_sim_create should restore the pool checkpoint\n");
+        kolibri_sim_destroy(sim);
+        exit(1);
+    }
+    remove(path);
     kolibri_sim_destroy(sim);
 }
 
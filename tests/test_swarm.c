@@ -0,0 +1,70 @@
+#include "kolibri/swarm.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Выбранный узел обязан входить в KOLIBRI_SWARM_TOP_K лидеров по score. */
+static void assert_selected_in_top(const KolibriSwarm *swarm, const KolibriSwarmNode *chosen) {
+    assert(chosen);
+    size_t better = 0U;
+    for (size_t i = 0; i < swarm->node_count; ++i) {
+        if (swarm->nodes[i].score > chosen->score) {
+            better++;
+        }
+    }
+    assert(better < KOLIBRI_SWARM_TOP_K);
+}
+
+void test_swarm(void) {
+    KolibriSwarm swarm;
+    assert(kolibri_swarm_init(&swarm, "self", 0U) == 0);
+    assert(kolibri_swarm_select_peer(&swarm, 0.3) == NULL);
+
+    char id[32];
+    char endpoint[64];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(id, sizeof(id), "peer-%d", i);
+        snprintf(endpoint, sizeof(endpoint), "10.0.%d.%d:7000", i / 250, i % 250);
+        assert(kolibri_swarm_add_node(&swarm, id, endpoint) == 0);
+    }
+    assert(kolibri_swarm_add_node(&swarm, "peer-17", "10.9.9.9:7000") == 0);
+    assert(swarm.node_count == 1000U);
+    size_t found = 0U;
+    for (size_t i = 0; i < swarm.node_count; ++i) {
+        if (strcmp(swarm.nodes[i].id, "peer-17") == 0) {
+            assert(strcmp(swarm.nodes[i].endpoint, "10.9.9.9:7000") == 0);
+            found++;
+        }
+    }
+    assert(found == 1U);
+
+    assert_selected_in_top(&swarm, kolibri_swarm_select_peer(&swarm, 0.3));
+    assert_selected_in_top(&swarm, kolibri_swarm_select_peer(&swarm, 0.9));
+
+    /* Активность пира поднимает его оценку и место в пирамиде. */
+    for (int i = 0; i < 50; ++i) {
+        kolibri_swarm_record_peer_activity(&swarm, "peer-512", 1.0, NULL);
+    }
+    kolibri_swarm_record_peer_activity(&swarm, "missing", 1.0, NULL);
+    const KolibriSwarmNode *chosen = kolibri_swarm_select_peer(&swarm, 0.1);
+    assert_selected_in_top(&swarm, chosen);
+
+    /* Своя активность меняет согласие со всеми узлами; оценки пересчитаны. */
+    kolibri_swarm_record_local_activity(&swarm, "новый стимул", 0.8);
+    for (size_t i = 0; i < swarm.node_count; ++i) {
+        double alignment = 0.0;
+        for (size_t j = 0; j < KOLIBRI_SWARM_DIGITS; ++j) {
+            alignment += swarm.nodes[i].signature[j] * swarm.signature[j];
+        }
+        double expected = alignment * 0.55 + swarm.nodes[i].energy * 0.25;
+        assert(swarm.nodes[i].score > expected - 1e-9 && swarm.nodes[i].score < expected + 1e-9);
+    }
+    assert_selected_in_top(&swarm, kolibri_swarm_select_peer(&swarm, 0.6));
+
+    static char status[1 << 20];
+    assert(kolibri_swarm_format_status(&swarm, status, sizeof(status)) == 0);
+    assert(strstr(status, "\"id\":\"peer-999\""));
+
+    kolibri_swarm_free(&swarm);
+}
@@ -0,0 +1,119 @@
+#include "kolibri/trace.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_THREAD_SPANS 200
+
+static char *read_all(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    assert(fp != NULL);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = (char *)malloc((size_t)size + 1U);
+    assert(data != NULL);
+    assert(fread(data, 1U, (size_t)size, fp) == (size_t)size);
+    data[size] = '\0';
+    fclose(fp);
+    return data;
+}
+
+static size_t count_substr(const char *text, const char *needle) {
+    size_t count = 0U;
+    for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) {
+        count++;
+    }
+    return count;
+}
+
+static void *trace_worker(void *arg) {
+    (void)arg;
+    for (int i = 0; i < TRACE_THREAD_SPANS; ++i) {
+        KolibriTraceSpan span = kolibri_trace_begin("worker");
+        kolibri_trace_end(&span);
+    }
+    return NULL;
+}
+
+void test_trace(void) {
+    char path[] = "/tmp/kolibri_traceXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    /* Без запуска спаны ничего не стоят и не пишутся. */
+    KolibriTraceSpan idle = kolibri_trace_begin("idle");
+    assert(idle.start_ns == 0U && idle.depth == 0U);
+    kolibri_trace_end(&idle);
+
+    KolibriTraceConfig config = { path, KOLIBRI_TRACE_FORMAT_JSONL, 1.0, 5U };
+    assert(kolibri_trace_start(&config) == 0);
+    assert(kolibri_trace_enabled());
+    assert(kolibri_trace_start(&config) != 0);
+
+    KolibriTraceSpan outer = kolibri_trace_begin("outer");
+    KolibriTraceSpan inner = kolibri_trace_begin("inner \"q\"");
+    assert(inner.depth == 2U && inner.start_ns >= outer.start_ns);
+    kolibri_trace_end(&inner);
+    kolibri_trace_end(&outer);
+
+    pthread_t threads[2];
+    for (int i = 0; i < 2; ++i) {
+        assert(pthread_create(&threads[i], NULL, trace_worker, NULL) == 0);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    kolibri_trace_stop();
+    assert(!kolibri_trace_enabled());
+
+    char *text = read_all(path);
+    assert(count_substr(text, "\n") == 2U + 2U * TRACE_THREAD_SPANS);
+    assert(strstr(text, "{\"event\": {\"metka\": "));
+    assert(strstr(text, "\"soobshenie\": \"outer\", \"tip\": \"SPAN\"}, \"span\": {\"depth\": 0, "));
+    assert(strstr(text, "\"soobshenie\": \"inner \\\"q\\\"\", \"tip\": \"SPAN\"}, \"span\": {\"depth\": 1, "));
+    assert(count_substr(text, "\"soobshenie\": \"worker\"") == 2U * TRACE_THREAD_SPANS);
+    free(text);
+    KolibriTraceStats stats;
+    kolibri_trace_stats(&stats);
+    assert(stats.written >= 2U + 2U * TRACE_THREAD_SPANS);
+    assert(stats.dropped == 0U);
+
+    /* Нулевая выборка отбрасывает корень вместе с вложенными спанами. */
+    config.format = KOLIBRI_TRACE_FORMAT_CHROME;
+    config.sample_rate = 0.0;
+    assert(kolibri_trace_start(&config) == 0);
+    outer = kolibri_trace_begin("dropped");
+    inner = kolibri_trace_begin("dropped");
+    assert(outer.start_ns == 0U && inner.start_ns == 0U && inner.depth == 2U);
+    kolibri_trace_end(&inner);
+    kolibri_trace_end(&outer);
+    kolibri_trace_stop();
+    text = read_all(path);
+    assert(strcmp(text, "[\n\n]\n") == 0);
+    free(text);
+
+    config.sample_rate = 1.0;
+    assert(kolibri_trace_start(&config) == 0);
+    outer = kolibri_trace_begin("chrome");
+    kolibri_trace_end(&outer);
+    outer = kolibri_trace_begin("chrome");
+    kolibri_trace_end(&outer);
+    kolibri_trace_stop();
+    text = read_all(path);
+    const char *chrome_head = "[\n{\"name\":\"chrome\",\"cat\":\"kolibri\",\"ph\":\"X\",\"ts\":";
+    assert(strncmp(text, chrome_head, strlen(chrome_head)) == 0);
+    assert(count_substr(text, "\"ph\":\"X\"") == 2U);
+    assert(strstr(text, "},\n{\"name\""));
+    assert(strcmp(text + strlen(text) - 3U, "\n]\n") == 0);
+    free(text);
+
+    config.sample_rate = 1.5;
+    assert(kolibri_trace_start(&config) != 0);
+    remove(path);
+}
@@ -0,0 +1,96 @@
+/* Нативная проверка wasm/kolibri_core.c: ядро держит глобальное состояние и
+ * экспортирует те же имена, что и kolibri/sigma.h, поэтому собирается
+ * отдельным исполняемым файлом. */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void *k_state_new(void);
+void k_state_free(void);
+size_t k_state_save(uint8_t *buffer, size_t capacity);
+size_t k_state_save_delta(uint8_t *buffer, size_t capacity);
+int k_state_load(const uint8_t *buffer, size_t length);
+int k_observe(const uint8_t *data, size_t length);
+
+#define SNAPSHOT_CAPACITY (4u << 20)
+
+/* Засоряет кучу, чтобы неинициализированные хвосты realloc отличались между прогонами. */
+static void poison_heap(uint8_t fill) {
+    void *chunks[64];
+    for (size_t i = 0; i < 64u; ++i) {
+        size_t size = (i + 1u) * 1024u;
+        chunks[i] = malloc(size);
+        assert(chunks[i] != NULL);
+        memset(chunks[i], fill, size);
+    }
+    for (size_t i = 0; i < 64u; ++i) {
+        free(chunks[i]);
+    }
+}
+
+static void observe_corpus(unsigned round) {
+    char word[48];
+    for (unsigned i = 0; i < 400u; ++i) {
+        int len = snprintf(word, sizeof(word), "r%u слово%u корень%u ", round, i, i % 37u);
+        assert(len > 0);
+        assert(k_observe((const uint8_t *)word, (size_t)len) == 0);
+    }
+}
+
+/* Оба прогона стартуют с одного пустого снимка: зерно ГПСЧ берётся из адреса состояния. */
+static size_t build_and_save(const uint8_t *seed, size_t seed_size, uint8_t fill, uint8_t *full, uint8_t *delta,
+                             size_t *delta_size) {
+    poison_heap(fill);
+    assert(k_state_new() != NULL);
+    assert(k_state_load(seed, seed_size) == 0);
+    observe_corpus(0u);
+    size_t full_size = k_state_save(full, SNAPSHOT_CAPACITY);
+    assert(full_size > 0u);
+    poison_heap((uint8_t)~fill);
+    observe_corpus(1u);
+    *delta_size = k_state_save_delta(delta, SNAPSHOT_CAPACITY);
+    assert(*delta_size > 0u);
+    k_state_free();
+    return full_size;
+}
+
+static void test_wasm_core_snapshot_deterministic(void) {
+    uint8_t *full_a = malloc(SNAPSHOT_CAPACITY);
+    uint8_t *full_b = malloc(SNAPSHOT_CAPACITY);
+    uint8_t *delta_a = malloc(SNAPSHOT_CAPACITY);
+    uint8_t *delta_b = malloc(SNAPSHOT_CAPACITY);
+    uint8_t *seed = malloc(SNAPSHOT_CAPACITY);
+    assert(full_a && full_b && delta_a && delta_b && seed);
+
+    assert(k_state_new() != NULL);
+    size_t seed_size = k_state_save(seed, SNAPSHOT_CAPACITY);
+    assert(seed_size > 0u);
+    k_state_free();
+
+    size_t delta_a_size = 0u;
+    size_t delta_b_size = 0u;
+    size_t full_a_size = build_and_save(seed, seed_size, 0xA5u, full_a, delta_a, &delta_a_size);
+    size_t full_b_size = build_and_save(seed, seed_size, 0x3Cu, full_b, delta_b, &delta_b_size);
+
+    /* Одинаковые наблюдения дают побайтно одинаковые снимки, полные и дельты. */
+    assert(full_a_size == full_b_size);
+    assert(memcmp(full_a, full_b, full_a_size) == 0);
+    assert(delta_a_size == delta_b_size);
+    assert(memcmp(delta_a, delta_b, delta_a_size) == 0);
+
+    free(full_a);
+    free(full_b);
+    free(delta_a);
+    free(delta_b);
+    free(seed);
+}
+
+int main(void) {
+    test_wasm_core_snapshot_deterministic();
+    printf("wasm core tests passed\n");
+    return 0;
+}
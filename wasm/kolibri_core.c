@@ -5,10 +5,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#if __STDC_VERSION__ >= 201112L
-#include <stdalign.h>
-#else
-#define alignof(type) __alignof__(type)
+
+#if defined(KOLIBRI_USE_WASM_SIMD) && defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define K_SIMD_WASM 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define K_SIMD_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define K_SIMD_NEON 1
 #endif
 
 #ifndef EMSCRIPTEN_KEEPALIVE
@@ -21,107 +27,59 @@
 #define K_VM_PROGRAM_MAX 64
 #define K_WINDOW 128
 #define K_MAX_TOKEN 128
-#define K_SAVE_VERSION 1u
-#define K_PAGE_SIZE 4096u
+#define K_SAVE_VERSION 2u
+#define K_SNAPSHOT_FULL 0u
+#define K_SNAPSHOT_DELTA 1u
 #define K_DEFAULT_B_LIMIT 240.0
 #define K_DEFAULT_D_LIMIT 160.0
 #define K_MIN_TOPK 1
 #define K_MAX_TOPK 10
 #define K_MAX_PROFILE 4096
-
-/* -------------------------- Bump arena allocator -------------------------- */
-
-typedef struct KArenaPage {
-    uint8_t *data;
-    size_t capacity;
-    size_t offset;
-    struct KArenaPage *next;
-} KArenaPage;
-
+#define K_OBSERVE_REFRESH_TOKENS 256u
+/* Цифры, разложенные по дорожкам: K_DIGIT_COUNT, дополненное до кратного 4. */
+#define K_LANES 12u
+
+/* ---------------------------- 4-lane vectors ----------------------------- */
+
+#if defined(K_SIMD_WASM)
+typedef v128_t KVec4;
+static inline KVec4 k_vec_load(const float *p) { return wasm_v128_load(p); }
+static inline void k_vec_store(float *p, KVec4 v) { wasm_v128_store(p, v); }
+static inline KVec4 k_vec_splat(float x) { return wasm_f32x4_splat(x); }
+static inline KVec4 k_vec_add(KVec4 a, KVec4 b) { return wasm_f32x4_add(a, b); }
+static inline KVec4 k_vec_sub(KVec4 a, KVec4 b) { return wasm_f32x4_sub(a, b); }
+static inline KVec4 k_vec_mul(KVec4 a, KVec4 b) { return wasm_f32x4_mul(a, b); }
+static inline KVec4 k_vec_abs(KVec4 a) { return wasm_f32x4_abs(a); }
+#elif defined(K_SIMD_SSE)
+typedef __m128 KVec4;
+static inline KVec4 k_vec_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void k_vec_store(float *p, KVec4 v) { _mm_storeu_ps(p, v); }
+static inline KVec4 k_vec_splat(float x) { return _mm_set1_ps(x); }
+static inline KVec4 k_vec_add(KVec4 a, KVec4 b) { return _mm_add_ps(a, b); }
+static inline KVec4 k_vec_sub(KVec4 a, KVec4 b) { return _mm_sub_ps(a, b); }
+static inline KVec4 k_vec_mul(KVec4 a, KVec4 b) { return _mm_mul_ps(a, b); }
+static inline KVec4 k_vec_abs(KVec4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+#elif defined(K_SIMD_NEON)
+typedef float32x4_t KVec4;
+static inline KVec4 k_vec_load(const float *p) { return vld1q_f32(p); }
+static inline void k_vec_store(float *p, KVec4 v) { vst1q_f32(p, v); }
+static inline KVec4 k_vec_splat(float x) { return vdupq_n_f32(x); }
+static inline KVec4 k_vec_add(KVec4 a, KVec4 b) { return vaddq_f32(a, b); }
+static inline KVec4 k_vec_sub(KVec4 a, KVec4 b) { return vsubq_f32(a, b); }
+static inline KVec4 k_vec_mul(KVec4 a, KVec4 b) { return vmulq_f32(a, b); }
+static inline KVec4 k_vec_abs(KVec4 a) { return vabsq_f32(a); }
+#else
 typedef struct {
-    KArenaPage *head;
-    KArenaPage *current;
-    size_t page_size;
-    size_t fragmentation;
-} KArena;
-
-static KArenaPage *k_arena_page_create(size_t page_size) {
-    KArenaPage *page = (KArenaPage *)malloc(sizeof(KArenaPage));
-    if (!page) {
-        return NULL;
-    }
-    page->data = (uint8_t *)malloc(page_size);
-    if (!page->data) {
-        free(page);
-        return NULL;
-    }
-    page->capacity = page_size;
-    page->offset = 0u;
-    page->next = NULL;
-    return page;
-}
-
-static void k_arena_init(KArena *arena, size_t page_size) {
-    arena->head = NULL;
-    arena->current = NULL;
-    arena->page_size = page_size ? page_size : K_PAGE_SIZE;
-    arena->fragmentation = 0u;
-}
-
-static void k_arena_dispose(KArena *arena) {
-    KArenaPage *page = arena->head;
-    while (page) {
-        KArenaPage *next = page->next;
-        free(page->data);
-        free(page);
-        page = next;
-    }
-    arena->head = NULL;
-    arena->current = NULL;
-    arena->fragmentation = 0u;
-}
-
-static void k_arena_reset(KArena *arena) {
-    KArenaPage *page = arena->head;
-    while (page) {
-        page->offset = 0u;
-        page = page->next;
-    }
-    arena->current = arena->head;
-}
-
-static void *k_arena_alloc(KArena *arena, size_t size, size_t alignment) {
-    if (alignment == 0u) {
-        alignment = sizeof(void *);
-    }
-    if (!arena->current) {
-        arena->head = k_arena_page_create(arena->page_size);
-        arena->current = arena->head;
-        if (!arena->current) {
-            return NULL;
-        }
-    }
-
-    KArenaPage *page = arena->current;
-    size_t aligned_offset = (page->offset + alignment - 1u) & ~(alignment - 1u);
-    if (aligned_offset + size > page->capacity) {
-        arena->fragmentation += (uint32_t)(page->capacity - page->offset);
-        if (!page->next) {
-            page->next = k_arena_page_create(arena->page_size);
-            if (!page->next) {
-                return NULL;
-            }
-        }
-        arena->current = page->next;
-        page = arena->current;
-        page->offset = 0u;
-        aligned_offset = 0u;
-    }
-
-    void *ptr = page->data + aligned_offset;
-    page->offset = aligned_offset + size;
-    return ptr;
-}
+    float v[4];
+} KVec4;
+static inline KVec4 k_vec_load(const float *p) { KVec4 r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void k_vec_store(float *p, KVec4 v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline KVec4 k_vec_splat(float x) { return (KVec4){ { x, x, x, x } }; }
+static inline KVec4 k_vec_add(KVec4 a, KVec4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+static inline KVec4 k_vec_sub(KVec4 a, KVec4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline KVec4 k_vec_mul(KVec4 a, KVec4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline KVec4 k_vec_abs(KVec4 a) { for (int i = 0; i < 4; ++i) a.v[i] = fabsf(a.v[i]); return a; }
+#endif
 
 /* -------------------------- Reversible sketches -------------------------- */
 
@@ -148,10 +106,6 @@ static void k_sketch_update(KSketch *sk, const uint8_t *data, size_t len) {
     }
 }
 
-static uint64_t k_sketch_compose(uint64_t a, uint64_t b) {
-    return k_rotl64(a, 17u) ^ k_rotl64(b, 29u) ^ (a + 0x632be59bd9b4e019ull * b);
-}
-
 static uint64_t k_sketch_hint(const KSketch *sk, uint64_t salt) {
     return k_rotl64(sk->checksum, 11u) ^ (sk->state + salt * 0x100000001b3ull);
 }
@@ -181,243 +135,320 @@ static uint32_t k_random_u32(uint64_t *state, uint32_t bound) {
 
 /* --------------------------- Directed acyclic DAWG ------------------------ */
 
-typedef struct KDaawgNode KDaawgNode;
+/* Узлы и рёбра лежат в двух растущих массивах и ссылаются друг на друга
+ * 32-битными индексами: ребро 12 байт вместо 24, узел 16 вместо 56.
+ * Дети узла — непрерывный блок рёбер, отсортированный по символу. */
+
+#define K_DAAWG_NONE UINT32_MAX
+#define K_DAAWG_MAX_FANOUT 256u
+#define K_DAAWG_LINEAR_SCAN 8u
+#define K_DAAWG_BLOCK_CLASSES 9u
+/* Страница для дельта-снимков: 64 узла (1 КБ) или 64 ребра (768 Б). */
+#define K_DAAWG_PAGE_SHIFT 6u
+#define K_DAAWG_PAGE_SIZE (1u << K_DAAWG_PAGE_SHIFT)
 
 typedef struct {
-    uint32_t symbol;
+    uint32_t target;
     uint32_t frequency;
+    uint8_t symbol;
     uint8_t flags;
-    uint8_t padding[3];
-    KDaawgNode *target;
+    uint16_t reserved;
 } KDaawgEdge;
 
-struct KDaawgNode {
-    uint32_t id;
-    uint32_t depth;
+typedef struct {
+    uint32_t children;
     uint32_t frequency;
-    uint32_t signature;
     uint16_t child_count;
     uint16_t child_capacity;
+    uint16_t depth;
     uint8_t is_attractor;
     uint8_t boundary_flags;
-    uint8_t reserved[2];
-    KDaawgEdge *children;
-    uint64_t sketch;
-};
+} KDaawgNode;
 
 typedef struct {
-    uint64_t signature;
-    KDaawgNode *node;
-} KDaawgBucket;
-
-typedef struct {
-    KArena arena;
-    KDaawgNode *root;
-    KDaawgBucket *dedupe;
-    size_t dedupe_capacity;
-    size_t node_count;
-    size_t edge_count;
+    KDaawgNode *nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    KDaawgEdge *edges;
+    uint32_t edge_count;
+    uint32_t edge_capacity;
+    /* Освобождённые блоки детей по классам ёмкости 2^k; next хранится в target. */
+    uint32_t free_blocks[K_DAAWG_BLOCK_CLASSES];
+    size_t fragmentation;
+    /* Флаг изменения на страницу с последнего снимка; длина по ёмкости массива. */
+    uint8_t *node_dirty;
+    uint8_t *edge_dirty;
 } KDaawg;
 
-static uint64_t k_daawg_signature(const KDaawgNode *node) {
-    uint64_t sig = ((uint64_t)node->frequency << 32u) ^ (uint64_t)node->child_count;
-    for (uint16_t i = 0; i < node->child_count; ++i) {
-        const KDaawgEdge *edge = &node->children[i];
-        sig = k_sketch_compose(sig ^ (edge->symbol * 0x9e3779b1u), edge->target ? edge->target->sketch : 0u);
-        sig ^= ((uint64_t)edge->frequency << (i & 31u));
-    }
-    return sig;
-}
-
 static void k_daawg_init(KDaawg *graph) {
-    k_arena_init(&graph->arena, K_PAGE_SIZE);
-    graph->root = NULL;
-    graph->dedupe = NULL;
-    graph->dedupe_capacity = 0u;
-    graph->node_count = 0u;
-    graph->edge_count = 0u;
+    memset(graph, 0, sizeof(*graph));
+    for (size_t i = 0; i < K_DAAWG_BLOCK_CLASSES; ++i) {
+        graph->free_blocks[i] = K_DAAWG_NONE;
+    }
 }
 
 static void k_daawg_dispose(KDaawg *graph) {
-    if (graph->dedupe) {
-        free(graph->dedupe);
-        graph->dedupe = NULL;
-    }
-    k_arena_dispose(&graph->arena);
-    graph->root = NULL;
-    graph->dedupe_capacity = 0u;
-    graph->node_count = 0u;
-    graph->edge_count = 0u;
+    free(graph->nodes);
+    free(graph->edges);
+    free(graph->node_dirty);
+    free(graph->edge_dirty);
+    k_daawg_init(graph);
 }
 
-static KDaawgNode *k_daawg_new_node(KDaawg *graph, uint32_t depth) {
-    KDaawgNode *node = (KDaawgNode *)k_arena_alloc(&graph->arena, sizeof(KDaawgNode), alignof(KDaawgNode));
-    if (!node) {
-        return NULL;
-    }
-    node->id = (uint32_t)graph->node_count++;
-    node->depth = depth;
-    node->frequency = 0u;
-    node->signature = 0u;
-    node->child_count = 0u;
-    node->child_capacity = 0u;
-    node->is_attractor = 0u;
-    node->boundary_flags = 0u;
-    node->children = NULL;
-    node->sketch = 0u;
-    return node;
-}
-
-static bool k_daawg_nodes_equivalent(const KDaawgNode *lhs, const KDaawgNode *rhs) {
-    if (lhs->frequency != rhs->frequency || lhs->child_count != rhs->child_count) {
-        return false;
-    }
-    if (lhs->is_attractor != rhs->is_attractor || lhs->boundary_flags != rhs->boundary_flags) {
-        return false;
-    }
-    for (uint16_t i = 0; i < lhs->child_count; ++i) {
-        const KDaawgEdge *le = &lhs->children[i];
-        const KDaawgEdge *re = &rhs->children[i];
-        if (le->symbol != re->symbol || le->frequency != re->frequency || le->flags != re->flags) {
-            return false;
-        }
-        if (le->target != re->target) {
-            return false;
-        }
-    }
-    return true;
+static uint32_t k_daawg_pages(uint32_t count) {
+    return (uint32_t)(((uint64_t)count + K_DAAWG_PAGE_SIZE - 1u) >> K_DAAWG_PAGE_SHIFT);
 }
 
-static KDaawgNode *k_daawg_dedupe(KDaawg *graph, KDaawgNode *node) {
-    if (!graph->dedupe) {
-        graph->dedupe_capacity = 1024u;
-        graph->dedupe = (KDaawgBucket *)calloc(graph->dedupe_capacity, sizeof(KDaawgBucket));
-        if (!graph->dedupe) {
-            return node;
-        }
+static void k_daawg_touch(uint8_t *dirty, uint32_t first, uint32_t count) {
+    if (count == 0u) {
+        return;
     }
-
-    uint64_t signature = k_daawg_signature(node);
-    node->signature = (uint32_t)(signature & 0xffffffffu);
-    size_t mask = graph->dedupe_capacity - 1u;
-    size_t index = (size_t)(signature & mask);
-    for (;;) {
-        KDaawgBucket *bucket = &graph->dedupe[index];
-        if (!bucket->node) {
-            bucket->node = node;
-            bucket->signature = signature;
-            return node;
-        }
-        if (bucket->signature == signature && k_daawg_nodes_equivalent(bucket->node, node)) {
-            return bucket->node;
-        }
-        index = (index + 1u) & mask;
+    uint32_t last = (first + count - 1u) >> K_DAAWG_PAGE_SHIFT;
+    for (uint32_t page = first >> K_DAAWG_PAGE_SHIFT; page <= last; ++page) {
+        dirty[page] = 1u;
     }
 }
 
-static int k_daawg_reserve_children(KDaawgNode *node, KArena *arena, uint16_t capacity) {
-    if (node->child_capacity >= capacity) {
+static int k_daawg_grow(void **data, uint32_t *capacity, uint32_t required, size_t elem_size, uint8_t **dirty) {
+    if (required <= *capacity) {
         return 0;
     }
-    KDaawgEdge *next = (KDaawgEdge *)k_arena_alloc(arena, sizeof(KDaawgEdge) * capacity, alignof(KDaawgEdge));
-    if (!next) {
+    uint32_t next = *capacity ? *capacity : 64u;
+    while (next < required) {
+        if (next > UINT32_MAX / 2u) {
+            return -1;
+        }
+        next *= 2u;
+    }
+    void *grown = realloc(*data, (size_t)next * elem_size);
+    if (!grown) {
         return -1;
     }
-    if (node->child_count) {
-        memcpy(next, node->children, sizeof(KDaawgEdge) * node->child_count);
+    *data = grown;
+    uint32_t old_pages = k_daawg_pages(*capacity);
+    uint32_t pages = k_daawg_pages(next);
+    uint8_t *map = (uint8_t *)realloc(*dirty, pages);
+    if (!map) {
+        return -1;
     }
-    node->children = next;
-    node->child_capacity = capacity;
+    memset(map + old_pages, 0, pages - old_pages);
+    *dirty = map;
+    *capacity = next;
     return 0;
 }
 
-static KDaawgEdge *k_daawg_get_child(KDaawgNode *node, uint32_t symbol) {
-    for (uint16_t i = 0; i < node->child_count; ++i) {
-        if (node->children[i].symbol == symbol) {
-            return &node->children[i];
+static uint32_t k_daawg_new_node(KDaawg *graph, uint32_t depth) {
+    if (graph->node_count == K_DAAWG_NONE ||
+        k_daawg_grow((void **)&graph->nodes, &graph->node_capacity, graph->node_count + 1u, sizeof(KDaawgNode),
+                     &graph->node_dirty) != 0) {
+        return K_DAAWG_NONE;
+    }
+    uint32_t index = graph->node_count++;
+    k_daawg_touch(graph->node_dirty, index, 1u);
+    KDaawgNode *node = &graph->nodes[index];
+    memset(node, 0, sizeof(*node));
+    node->children = K_DAAWG_NONE;
+    node->depth = (uint16_t)(depth > UINT16_MAX ? UINT16_MAX : depth);
+    return index;
+}
+
+static uint32_t k_daawg_block_class(uint32_t capacity) {
+    uint32_t cls = 0u;
+    while ((1u << cls) < capacity) {
+        ++cls;
+    }
+    return cls;
+}
+
+static void k_daawg_release_block(KDaawg *graph, uint32_t first, uint32_t capacity) {
+    uint32_t cls = k_daawg_block_class(capacity);
+    graph->edges[first].target = graph->free_blocks[cls];
+    k_daawg_touch(graph->edge_dirty, first, 1u);
+    graph->free_blocks[cls] = first;
+    graph->fragmentation += (size_t)capacity * sizeof(KDaawgEdge);
+}
+
+static uint32_t k_daawg_acquire_block(KDaawg *graph, uint32_t capacity) {
+    uint32_t cls = k_daawg_block_class(capacity);
+    uint32_t first = graph->free_blocks[cls];
+    if (first != K_DAAWG_NONE) {
+        graph->free_blocks[cls] = graph->edges[first].target;
+        graph->fragmentation -= (size_t)capacity * sizeof(KDaawgEdge);
+    } else {
+        if (graph->edge_count > K_DAAWG_NONE - capacity ||
+            k_daawg_grow((void **)&graph->edges, &graph->edge_capacity, graph->edge_count + capacity,
+                         sizeof(KDaawgEdge), &graph->edge_dirty) != 0) {
+            return K_DAAWG_NONE;
         }
+        first = graph->edge_count;
+        graph->edge_count += capacity;
     }
-    return NULL;
+    /* Хвост блока попадает в снимок: без обнуления там мусор realloc или ссылка free-list. */
+    memset(graph->edges + first, 0, (size_t)capacity * sizeof(KDaawgEdge));
+    k_daawg_touch(graph->edge_dirty, first, capacity);
+    return first;
 }
 
-static KDaawgEdge *k_daawg_add_child(KDaawg *graph, KDaawgNode *node, uint32_t symbol) {
-    if (node->child_count == node->child_capacity) {
-        uint16_t next_capacity = node->child_capacity ? (uint16_t)(node->child_capacity * 2u) : 2u;
-        if (next_capacity < node->child_capacity) {
-            next_capacity = (uint16_t)(node->child_capacity + 4u);
+/* Позиция символа среди детей: найденная или точка вставки. */
+static uint32_t k_daawg_lower_bound(const KDaawg *graph, const KDaawgNode *node, uint8_t symbol) {
+    const KDaawgEdge *children = graph->edges + node->children;
+    uint32_t lo = 0u;
+    uint32_t hi = node->child_count;
+    if (hi <= K_DAAWG_LINEAR_SCAN) {
+        while (lo < hi && children[lo].symbol < symbol) {
+            ++lo;
         }
-        if (k_daawg_reserve_children(node, &graph->arena, next_capacity) != 0) {
-            return NULL;
+        return lo;
+    }
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2u;
+        if (children[mid].symbol < symbol) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
         }
     }
-    KDaawgEdge *edge = &node->children[node->child_count++];
-    edge->symbol = symbol;
-    edge->frequency = 0u;
-    edge->flags = 0u;
-    edge->target = NULL;
-    graph->edge_count += 1u;
-    return edge;
+    return lo;
+}
+
+/* Возвращает индекс ребра с символом, при необходимости вставляя его на место. */
+static uint32_t k_daawg_child(KDaawg *graph, uint32_t node_index, uint8_t symbol, bool *created) {
+    KDaawgNode *node = &graph->nodes[node_index];
+    uint32_t pos = node->child_count ? k_daawg_lower_bound(graph, node, symbol) : 0u;
+    *created = false;
+    if (pos < node->child_count && graph->edges[node->children + pos].symbol == symbol) {
+        return node->children + pos;
+    }
+    if (node->child_count == node->child_capacity) {
+        uint32_t capacity = node->child_capacity ? node->child_capacity * 2u : 2u;
+        if (capacity > K_DAAWG_MAX_FANOUT) {
+            capacity = K_DAAWG_MAX_FANOUT;
+        }
+        uint32_t block = k_daawg_acquire_block(graph, capacity);
+        if (block == K_DAAWG_NONE) {
+            return K_DAAWG_NONE;
+        }
+        node = &graph->nodes[node_index];
+        if (node->child_count) {
+            memcpy(graph->edges + block, graph->edges + node->children, sizeof(KDaawgEdge) * node->child_count);
+            k_daawg_release_block(graph, node->children, node->child_capacity);
+        }
+        node->children = block;
+        node->child_capacity = (uint16_t)capacity;
+        k_daawg_touch(graph->edge_dirty, block, node->child_count);
+    }
+    KDaawgEdge *children = graph->edges + node->children;
+    memmove(children + pos + 1u, children + pos, sizeof(KDaawgEdge) * (node->child_count - pos));
+    children[pos] = (KDaawgEdge){ .target = K_DAAWG_NONE, .symbol = symbol };
+    node->child_count += 1u;
+    k_daawg_touch(graph->edge_dirty, node->children + pos, node->child_count - pos);
+    k_daawg_touch(graph->node_dirty, node_index, 1u);
+    *created = true;
+    return node->children + pos;
 }
 
 static void k_daawg_update_attractor(KDaawgNode *node) {
     node->is_attractor = (uint8_t)((node->frequency > 8u && node->child_count > 1u) ? 1u : 0u);
 }
 
+/* Новый узел без детей и с нулевой частотой не может совпасть ни с одним
+ * существующим (у каждого частота уже не меньше 1), поэтому слияние при
+ * вставке не ищется. */
 static int k_daawg_insert(KDaawg *graph, const uint8_t *data, size_t len, uint32_t boundary_mask) {
-    if (!graph->root) {
-        graph->root = k_daawg_new_node(graph, 0u);
-        if (!graph->root) {
-            return -1;
-        }
-        k_sketch_init((KSketch *)&graph->root->sketch, 0x1234u);
+    if (graph->node_count == 0u && k_daawg_new_node(graph, 0u) == K_DAAWG_NONE) {
+        return -1;
     }
 
-    KDaawgNode *node = graph->root;
-    node->frequency += 1u;
-    k_daawg_update_attractor(node);
+    uint32_t node_index = 0u;
+    graph->nodes[node_index].frequency += 1u;
+    k_daawg_update_attractor(&graph->nodes[node_index]);
+    k_daawg_touch(graph->node_dirty, node_index, 1u);
 
     for (size_t i = 0; i < len; ++i) {
-        uint32_t symbol = (uint32_t)data[i];
-        KDaawgEdge *edge = k_daawg_get_child(node, symbol);
-        if (!edge) {
-            edge = k_daawg_add_child(graph, node, symbol);
-            if (!edge) {
-                return -1;
-            }
-            KDaawgNode *child = k_daawg_new_node(graph, node->depth + 1u);
-            if (!child) {
+        bool created = false;
+        uint32_t edge_index = k_daawg_child(graph, node_index, data[i], &created);
+        if (edge_index == K_DAAWG_NONE) {
+            return -1;
+        }
+        if (created) {
+            uint32_t child = k_daawg_new_node(graph, (uint32_t)graph->nodes[node_index].depth + 1u);
+            if (child == K_DAAWG_NONE) {
                 return -1;
             }
-            child->sketch = node->sketch ^ k_sketch_compose((uint64_t)symbol, node->depth + 1u);
-            edge->target = k_daawg_dedupe(graph, child);
+            graph->edges[edge_index].target = child;
         }
+        KDaawgEdge *edge = &graph->edges[edge_index];
         edge->frequency += 1u;
-        node = edge->target;
-        if (!node) {
-            return -1;
-        }
+        k_daawg_touch(graph->edge_dirty, edge_index, 1u);
+        node_index = edge->target;
+        KDaawgNode *node = &graph->nodes[node_index];
         node->frequency += 1u;
         if (i + 1u == len) {
             node->boundary_flags |= (uint8_t)boundary_mask;
         }
         k_daawg_update_attractor(node);
-        node->sketch ^= k_sketch_compose(node->sketch, (uint64_t)symbol + ((uint64_t)node->frequency << 1u));
+        k_daawg_touch(graph->node_dirty, node_index, 1u);
     }
 
     return 0;
 }
 
-static size_t k_daawg_collect(const KDaawgNode *node, uint8_t *buffer, size_t capacity, size_t depth) {
-    if (!node || !buffer) {
+/* Переупаковывает рёбра подряд, выбрасывая освобождённые блоки. Ёмкости
+ * блоков сохраняются, чтобы классы свободных списков оставались верными. */
+static size_t k_daawg_compact(KDaawg *graph) {
+    size_t reclaimed = graph->fragmentation;
+    if (reclaimed == 0u) {
+        return 0u;
+    }
+    uint32_t used = 0u;
+    for (uint32_t i = 0; i < graph->node_count; ++i) {
+        used += graph->nodes[i].child_capacity;
+    }
+    uint32_t pages = k_daawg_pages(used);
+    KDaawgEdge *packed = (KDaawgEdge *)calloc(used ? used : 1u, sizeof(KDaawgEdge));
+    uint8_t *dirty = (uint8_t *)malloc(pages ? pages : 1u);
+    if (!packed || !dirty) {
+        free(packed);
+        free(dirty);
+        return 0u;
+    }
+    uint32_t cursor = 0u;
+    for (uint32_t i = 0; i < graph->node_count; ++i) {
+        KDaawgNode *node = &graph->nodes[i];
+        if (node->child_capacity == 0u) {
+            continue;
+        }
+        memcpy(packed + cursor, graph->edges + node->children, sizeof(KDaawgEdge) * node->child_count);
+        node->children = cursor;
+        cursor += node->child_capacity;
+    }
+    free(graph->edges);
+    free(graph->edge_dirty);
+    graph->edges = packed;
+    graph->edge_dirty = dirty;
+    graph->edge_count = used;
+    graph->edge_capacity = used;
+    memset(dirty, 1, pages);
+    k_daawg_touch(graph->node_dirty, 0u, graph->node_count);
+    for (size_t i = 0; i < K_DAAWG_BLOCK_CLASSES; ++i) {
+        graph->free_blocks[i] = K_DAAWG_NONE;
+    }
+    graph->fragmentation = 0u;
+    return reclaimed;
+}
+
+static size_t k_daawg_collect(const KDaawg *graph, uint32_t node_index, uint8_t *buffer, size_t capacity, size_t depth) {
+    if (node_index >= graph->node_count || !buffer) {
         return 0u;
     }
+    const KDaawgNode *node = &graph->nodes[node_index];
     size_t length = 0u;
     if (node->boundary_flags && depth < capacity) {
         buffer[length++] = (uint8_t)node->boundary_flags;
     }
     for (uint16_t i = 0; i < node->child_count && length + 9u < capacity; ++i) {
-        const KDaawgEdge *edge = &node->children[i];
-        buffer[length++] = (uint8_t)edge->symbol;
+        const KDaawgEdge *edge = &graph->edges[node->children + i];
+        buffer[length++] = edge->symbol;
         uint32_t freq = edge->frequency;
         memcpy(buffer + length, &freq, sizeof(uint32_t));
         length += sizeof(uint32_t);
@@ -426,33 +457,32 @@ static size_t k_daawg_collect(const KDaawgNode *node, uint8_t *buffer, size_t ca
 }
 
 static size_t k_daawg_generate(const KDaawg *graph, char *output, size_t capacity, double *delta_b, double *delta_d, uint64_t *rng) {
-    if (!graph->root || capacity == 0u) {
+    if (graph->node_count == 0u || capacity == 0u) {
         return 0u;
     }
-    const KDaawgNode *node = graph->root;
+    const KDaawgNode *node = &graph->nodes[0];
     size_t written = 0u;
     double coverage = 0.0;
     double depth = 0.0;
 
     while (written + 1u < capacity && node && node->child_count > 0u) {
+        const KDaawgEdge *children = graph->edges + node->children;
         uint32_t best = 0u;
         float best_score = -1.0e9f;
         for (uint16_t i = 0; i < node->child_count; ++i) {
-            const KDaawgEdge *edge = &node->children[i];
-            float base = (float)edge->frequency;
+            float base = (float)children[i].frequency;
             float noise = (k_random_float(rng) - 0.5f) * 0.1f;
-            float score = base + noise + (edge->flags ? 1.0f : 0.0f);
+            float score = base + noise + (children[i].flags ? 1.0f : 0.0f);
             if (score > best_score) {
                 best_score = score;
                 best = i;
             }
         }
-        const KDaawgEdge *edge = &node->children[best];
-        uint8_t symbol = (uint8_t)(edge->symbol & 0xffu);
-        output[written++] = (char)symbol;
+        const KDaawgEdge *edge = &children[best];
+        output[written++] = (char)edge->symbol;
         coverage += 1.0;
         depth = (double)node->depth;
-        node = edge->target;
+        node = edge->target != K_DAAWG_NONE ? &graph->nodes[edge->target] : NULL;
         if (node && node->boundary_flags) {
             break;
         }
@@ -600,6 +630,107 @@ static float k_vm_exec(const KVmProgram *program, const float *ctx, size_t ctx_l
     return sp ? stack[sp - 1u] : 0.0f;
 }
 
+/* Программы всех цифр одной формы (одинаковые опкоды, без NOISE) идут
+ * в ногу: дорожка — цифра, на каждом уровне стека K_LANES значений.
+ * Для каждой дорожки результат совпадает с k_vm_exec бит в бит. */
+static bool k_vm_same_shape(const KVmProgram *const *programs) {
+    const KVmProgram *shape = programs[0];
+    for (size_t lane = 0; lane < K_DIGIT_COUNT; ++lane) {
+        const KVmProgram *program = programs[lane];
+        if (program->length != shape->length) {
+            return false;
+        }
+        for (uint16_t ip = 0u; ip < program->length && ip < K_VM_PROGRAM_MAX; ++ip) {
+            if (program->code[ip].opcode != shape->code[ip].opcode || program->code[ip].opcode == K_VM_OP_NOISE) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void k_vm_exec_lanes(const KVmProgram *const *programs, const float ctx[][K_LANES], size_t ctx_len, float *out) {
+    float stack[K_VM_STACK_MAX][K_LANES];
+    size_t sp = 0u;
+    const KVmProgram *shape = programs[0];
+    for (uint16_t ip = 0u; ip < shape->length && ip < K_VM_PROGRAM_MAX; ++ip) {
+        KVmOpcode opcode = (KVmOpcode)shape->code[ip].opcode;
+        if (opcode == K_VM_OP_END) {
+            break;
+        }
+        if (opcode == K_VM_OP_PUSH_CONST || opcode == K_VM_OP_PUSH_CTX) {
+            if (sp >= K_VM_STACK_MAX) {
+                continue;
+            }
+            float *top = stack[sp++];
+            for (size_t lane = 0; lane < K_LANES; ++lane) {
+                const KVmInstr *instr = lane < K_DIGIT_COUNT ? &programs[lane]->code[ip] : NULL;
+                if (!instr) {
+                    top[lane] = 0.0f;
+                } else if (opcode == K_VM_OP_PUSH_CONST) {
+                    top[lane] = instr->operand_value;
+                } else {
+                    top[lane] = instr->operand_index < ctx_len ? ctx[instr->operand_index][lane] : 0.0f;
+                }
+            }
+            continue;
+        }
+        if (opcode >= K_VM_OP_ADD && opcode <= K_VM_OP_MAX) {
+            if (sp < 2u) {
+                continue;
+            }
+            float *a = stack[sp - 2u];
+            const float *b = stack[sp - 1u];
+            sp -= 1u;
+            for (size_t lane = 0; lane < K_LANES; lane += 4u) {
+                KVec4 va = k_vec_load(a + lane);
+                KVec4 vb = k_vec_load(b + lane);
+                if (opcode == K_VM_OP_ADD) {
+                    k_vec_store(a + lane, k_vec_add(va, vb));
+                } else if (opcode == K_VM_OP_SUB) {
+                    k_vec_store(a + lane, k_vec_sub(va, vb));
+                } else if (opcode == K_VM_OP_MUL) {
+                    k_vec_store(a + lane, k_vec_mul(va, vb));
+                } else {
+                    for (size_t k = lane; k < lane + 4u; ++k) {
+                        if (opcode == K_VM_OP_DIV) {
+                            a[k] = b[k] != 0.0f ? a[k] / b[k] : a[k];
+                        } else {
+                            a[k] = opcode == K_VM_OP_MIN ? fminf(a[k], b[k]) : fmaxf(a[k], b[k]);
+                        }
+                    }
+                }
+            }
+            continue;
+        }
+        if (sp < 1u) {
+            continue;
+        }
+        float *top = stack[sp - 1u];
+        for (size_t lane = 0; lane < K_LANES; ++lane) {
+            switch (opcode) {
+                case K_VM_OP_SIGMOID:
+                    top[lane] = k_vm_sigmoid(top[lane]);
+                    break;
+                case K_VM_OP_TANH:
+                    top[lane] = tanhf(top[lane]);
+                    break;
+                case K_VM_OP_ABS:
+                    top[lane] = fabsf(top[lane]);
+                    break;
+                case K_VM_OP_CLAMP01:
+                    top[lane] = top[lane] < 0.0f ? 0.0f : (top[lane] > 1.0f ? 1.0f : top[lane]);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    for (size_t lane = 0; lane < K_LANES; ++lane) {
+        out[lane] = sp ? stack[sp - 1u][lane] : 0.0f;
+    }
+}
+
 static void k_vm_fill_default(KVmProgram *program, float bias) {
     program->length = 0u;
     program->code[program->length++] = (KVmInstr){ .opcode = K_VM_OP_PUSH_CONST, .operand_value = bias };
@@ -635,6 +766,13 @@ typedef struct {
     double transitions[K_DIGIT_COUNT][K_DIGIT_COUNT];
     double usage[K_DIGIT_COUNT];
     KSketch summary_sketch;
+    /* Хвост токена, разрезанного границей чанка; длиннее K_MAX_TOKEN не копится. */
+    char pending[K_MAX_TOKEN];
+    size_t pending_len;
+    size_t pending_total;
+    uint32_t unrefreshed_tokens;
+    /* Номер последнего снимка; 0 — базы для дельты нет. */
+    uint32_t save_sequence;
 } KState;
 
 typedef struct {
@@ -740,10 +878,10 @@ static void k_state_dispose(KState *state) {
 
 /* -------------------------- Observation pipeline ------------------------- */
 
-static void k_digit_apply_vm(KDigit *digit, const float *ctx, size_t ctx_len, uint64_t *rng) {
-    digit->energy = k_vm_exec(&digit->vm_g, ctx, ctx_len, rng);
-    digit->phase = k_vm_exec(&digit->vm_d, ctx, ctx_len, rng);
-    digit->weight = 1.0f + k_vm_exec(&digit->vm_v, ctx, ctx_len, rng);
+static void k_digit_store_vm(KDigit *digit, float energy, float phase, float weight) {
+    digit->energy = energy;
+    digit->phase = phase;
+    digit->weight = 1.0f + weight;
     if (digit->weight < 0.1f) {
         digit->weight = 0.1f;
     }
@@ -778,60 +916,152 @@ static void k_observe_token(KState *state, const char *token, size_t len) {
     k_state_recompute_budgets(state);
 }
 
+static bool k_is_separator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static void k_flush_pending(KState *state) {
+    if (state->pending_total > 0u) {
+        k_observe_token(state, state->pending, state->pending_len);
+        state->unrefreshed_tokens += 1u;
+    }
+    state->pending_len = 0u;
+    state->pending_total = 0u;
+}
+
+/* Разбирает чанк; незавершённый токен в конце переносится в следующий вызов,
+ * так что разбиение входа на чанки не меняет результат. Как и раньше,
+ * токен длиннее K_MAX_TOKEN обрезается до первых K_MAX_TOKEN байт. */
 static void k_parse_observation(KState *state, const char *text, size_t len) {
     size_t start = 0u;
-    for (size_t i = 0; i <= len; ++i) {
-        bool is_end = i == len || text[i] == ' ' || text[i] == '\n' || text[i] == '\t' || text[i] == '\r';
-        if (!is_end) {
+    for (size_t i = 0; i < len; ++i) {
+        if (!k_is_separator(text[i])) {
             continue;
         }
-        size_t token_len = i - start;
-        if (token_len > 0u) {
-            if (token_len > K_MAX_TOKEN) {
-                token_len = K_MAX_TOKEN;
-            }
-            k_observe_token(state, text + start, token_len);
+        if (state->pending_total > 0u) {
+            size_t room = K_MAX_TOKEN - state->pending_len;
+            size_t take = i < room ? i : room;
+            memcpy(state->pending + state->pending_len, text, take);
+            state->pending_len += take;
+            state->pending_total += i;
+            k_flush_pending(state);
+        } else if (i > start) {
+            size_t token_len = i - start;
+            k_observe_token(state, text + start, token_len > K_MAX_TOKEN ? K_MAX_TOKEN : token_len);
+            state->unrefreshed_tokens += 1u;
         }
         start = i + 1u;
     }
+    if (start < len) {
+        size_t tail = len - start;
+        size_t room = K_MAX_TOKEN - state->pending_len;
+        size_t take = tail < room ? tail : room;
+        memcpy(state->pending + state->pending_len, text + start, take);
+        state->pending_len += take;
+        state->pending_total += tail;
+    }
+}
+
+#define K_VM_CONTEXT 16u
+
+static void k_digit_context(KState *state, size_t i, float *ctx) {
+    ctx[0] = (float)(state->usage[i]);
+    ctx[1] = (float)(state->digits[i].budget_b);
+    ctx[2] = (float)(state->digits[i].budget_d);
+    ctx[3] = (float)(state->limit_b);
+    ctx[4] = (float)(state->limit_d);
+    ctx[5] = (float)(state->digits[i].energy);
+    ctx[6] = (float)(state->digits[i].phase);
+    ctx[7] = (float)(state->digits[i].weight);
+    ctx[8] = (float)(i);
+    ctx[9] = (float)(state->window_size);
+    ctx[10] = (float)(state->transitions[i][i]);
+    ctx[11] = (float)(state->usage[(i + 1u) % K_DIGIT_COUNT]);
+    ctx[12] = (float)k_random_float(&state->rng_state);
+    ctx[13] = 1.0f;
+    ctx[14] = (float)(state->digits[i].bias[i]);
+    ctx[15] = (float)(state->digits[i].logits[i]);
 }
 
 static void k_refresh_digit_programs(KState *state) {
-    float ctx[16];
+    state->unrefreshed_tokens = 0u;
+    const KVmProgram *programs[3][K_DIGIT_COUNT];
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        ctx[0] = (float)(state->usage[i]);
-        ctx[1] = (float)(state->digits[i].budget_b);
-        ctx[2] = (float)(state->digits[i].budget_d);
-        ctx[3] = (float)(state->limit_b);
-        ctx[4] = (float)(state->limit_d);
-        ctx[5] = (float)(state->digits[i].energy);
-        ctx[6] = (float)(state->digits[i].phase);
-        ctx[7] = (float)(state->digits[i].weight);
-        ctx[8] = (float)(i);
-        ctx[9] = (float)(state->window_size);
-        ctx[10] = (float)(state->transitions[i][i]);
-        ctx[11] = (float)(state->usage[(i + 1u) % K_DIGIT_COUNT]);
-        ctx[12] = (float)k_random_float(&state->rng_state);
-        ctx[13] = 1.0f;
-        ctx[14] = (float)(state->digits[i].bias[i]);
-        ctx[15] = (float)(state->digits[i].logits[i]);
-        k_digit_apply_vm(&state->digits[i], ctx, 16u, &state->rng_state);
+        programs[0][i] = &state->digits[i].vm_g;
+        programs[1][i] = &state->digits[i].vm_d;
+        programs[2][i] = &state->digits[i].vm_v;
+    }
+    if (!k_vm_same_shape(programs[0]) || !k_vm_same_shape(programs[1]) || !k_vm_same_shape(programs[2])) {
+        float ctx[K_VM_CONTEXT];
+        for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+            KDigit *digit = &state->digits[i];
+            k_digit_context(state, i, ctx);
+            float energy = k_vm_exec(&digit->vm_g, ctx, K_VM_CONTEXT, &state->rng_state);
+            float phase = k_vm_exec(&digit->vm_d, ctx, K_VM_CONTEXT, &state->rng_state);
+            float weight = k_vm_exec(&digit->vm_v, ctx, K_VM_CONTEXT, &state->rng_state);
+            k_digit_store_vm(digit, energy, phase, weight);
+        }
+        return;
+    }
+    /* Без NOISE программы не трогают rng, так что контексты можно собрать
+     * заранее в том же порядке случайных чисел. */
+    float lanes[K_VM_CONTEXT][K_LANES];
+    float ctx[K_VM_CONTEXT];
+    memset(lanes, 0, sizeof(lanes));
+    for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+        k_digit_context(state, i, ctx);
+        for (size_t k = 0; k < K_VM_CONTEXT; ++k) {
+            lanes[k][i] = ctx[k];
+        }
+    }
+    float energy[K_LANES];
+    float phase[K_LANES];
+    float weight[K_LANES];
+    k_vm_exec_lanes(programs[0], (const float (*)[K_LANES])lanes, K_VM_CONTEXT, energy);
+    k_vm_exec_lanes(programs[1], (const float (*)[K_LANES])lanes, K_VM_CONTEXT, phase);
+    k_vm_exec_lanes(programs[2], (const float (*)[K_LANES])lanes, K_VM_CONTEXT, weight);
+    for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+        k_digit_store_vm(&state->digits[i], energy[i], phase[i], weight[i]);
     }
 }
 
 /* ---------------------------- Resonance voting --------------------------- */
 
+/* score[j] += w_i * (bias_i[j] + e_i) * cos(phase_i - phase_j); косинус
+ * разности раскладывается в cos*cos + sin*sin, так что вместо 100 cosf
+ * нужно 20 вызовов, а сумма по j считается сразу по четыре дорожки. */
 static void k_resonance_scores(KState *state, float temperature, int topk, float *scores) {
-    float baseline_phase[K_DIGIT_COUNT];
+    float cos_phase[K_LANES] = { 0.0f };
+    float sin_phase[K_LANES] = { 0.0f };
+    float bias[K_LANES] = { 0.0f };
+    float acc[K_LANES] = { 0.0f };
     for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
-        baseline_phase[i] = state->digits[i].phase;
-        for (size_t j = 0; j < K_DIGIT_COUNT; ++j) {
-            float phase_delta = state->digits[i].phase - baseline_phase[j];
-            float resonance = cosf(phase_delta);
-            float logit = state->digits[i].bias[j] + state->digits[i].energy;
-            scores[j] += state->digits[i].weight * logit * resonance;
+        cos_phase[i] = cosf(state->digits[i].phase);
+        sin_phase[i] = sinf(state->digits[i].phase);
+        acc[i] = scores[i];
+    }
+    KVec4 sum[K_LANES / 4u];
+    for (size_t v = 0; v < K_LANES / 4u; ++v) {
+        sum[v] = k_vec_load(acc + v * 4u);
+    }
+    for (size_t i = 0; i < K_DIGIT_COUNT; ++i) {
+        const KDigit *digit = &state->digits[i];
+        memcpy(bias, digit->bias, sizeof(digit->bias));
+        KVec4 energy = k_vec_splat(digit->energy);
+        KVec4 weight = k_vec_splat(digit->weight);
+        KVec4 cos_i = k_vec_splat(cos_phase[i]);
+        KVec4 sin_i = k_vec_splat(sin_phase[i]);
+        for (size_t v = 0; v < K_LANES / 4u; ++v) {
+            KVec4 logit = k_vec_add(k_vec_load(bias + v * 4u), energy);
+            KVec4 resonance = k_vec_add(k_vec_mul(cos_i, k_vec_load(cos_phase + v * 4u)),
+                                        k_vec_mul(sin_i, k_vec_load(sin_phase + v * 4u)));
+            sum[v] = k_vec_add(sum[v], k_vec_mul(weight, k_vec_mul(logit, resonance)));
         }
     }
+    for (size_t v = 0; v < K_LANES / 4u; ++v) {
+        k_vec_store(acc + v * 4u, sum[v]);
+    }
+    memcpy(scores, acc, sizeof(float) * K_DIGIT_COUNT);
     if (temperature <= 0.0f) {
         temperature = 1.0f;
     }
@@ -902,85 +1132,277 @@ void k_state_free(void) {
     }
 }
 
-EMSCRIPTEN_KEEPALIVE
-size_t k_state_save(uint8_t *buffer, size_t capacity) {
-    if (!g_state || !buffer || capacity < sizeof(uint32_t) * 6u) {
-        return 0u;
+/* ------------------------------- Snapshots -------------------------------- */
+
+/* Снимок v2: заголовок {версия, вид, номер, номер базы}, скаляры (как в v1) и
+ * по каждой цифре счётчики графа со страницами узлов и рёбер. Полный снимок
+ * несёт все страницы, дельта — только изменённые с предыдущего снимка, и
+ * применяется лишь поверх снимка с номером базы. */
+
+typedef struct {
+    uint8_t *cursor;
+    const uint8_t *end;
+    bool ok;
+} KWriter;
+
+typedef struct {
+    const uint8_t *cursor;
+    const uint8_t *end;
+    bool ok;
+} KReader;
+
+static void k_put(KWriter *writer, const void *data, size_t len) {
+    if (!writer->ok || (size_t)(writer->end - writer->cursor) < len) {
+        writer->ok = false;
+        return;
     }
-    uint8_t *cursor = buffer;
-    const uint8_t *end = buffer + capacity;
-    if ((size_t)(end - cursor) < sizeof(uint32_t)) {
-        return 0u;
+    memcpy(writer->cursor, data, len);
+    writer->cursor += len;
+}
+
+static const uint8_t *k_take(KReader *reader, size_t len) {
+    if (!reader->ok || (size_t)(reader->end - reader->cursor) < len) {
+        reader->ok = false;
+        return NULL;
     }
-    uint32_t version = K_SAVE_VERSION;
-    memcpy(cursor, &version, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
+    const uint8_t *data = reader->cursor;
+    reader->cursor += len;
+    return data;
+}
 
-    double limits[2] = { g_state->limit_b, g_state->limit_d };
-    if ((size_t)(end - cursor) < sizeof(limits)) {
-        return 0u;
+static void k_get(KReader *reader, void *out, size_t len) {
+    const uint8_t *data = k_take(reader, len);
+    if (data) {
+        memcpy(out, data, len);
     }
-    memcpy(cursor, limits, sizeof(limits));
-    cursor += sizeof(limits);
+}
 
-    if ((size_t)(end - cursor) < sizeof(g_state->usage)) {
-        return 0u;
+static void k_snapshot_put_scalars(KWriter *writer, const KState *state) {
+    k_put(writer, &state->limit_b, sizeof(state->limit_b));
+    k_put(writer, &state->limit_d, sizeof(state->limit_d));
+    k_put(writer, state->usage, sizeof(state->usage));
+    k_put(writer, state->transitions, sizeof(state->transitions));
+    k_put(writer, state->window_b, sizeof(state->window_b));
+    k_put(writer, state->window_d, sizeof(state->window_d));
+    k_put(writer, &state->window_index, sizeof(state->window_index));
+    k_put(writer, &state->window_size, sizeof(state->window_size));
+    k_put(writer, &state->rng_state, sizeof(state->rng_state));
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        const KDigit *digit = &state->digits[d];
+        k_put(writer, digit->bias, sizeof(digit->bias));
+        k_put(writer, &digit->energy, sizeof(digit->energy));
+        k_put(writer, &digit->phase, sizeof(digit->phase));
+        k_put(writer, &digit->weight, sizeof(digit->weight));
+        k_put(writer, &digit->budget_b, sizeof(digit->budget_b));
+        k_put(writer, &digit->budget_d, sizeof(digit->budget_d));
     }
-    memcpy(cursor, g_state->usage, sizeof(g_state->usage));
-    cursor += sizeof(g_state->usage);
+}
 
-    if ((size_t)(end - cursor) < sizeof(g_state->transitions)) {
-        return 0u;
+static void k_snapshot_get_scalars(KReader *reader, KState *state) {
+    k_get(reader, &state->limit_b, sizeof(state->limit_b));
+    k_get(reader, &state->limit_d, sizeof(state->limit_d));
+    k_get(reader, state->usage, sizeof(state->usage));
+    k_get(reader, state->transitions, sizeof(state->transitions));
+    k_get(reader, state->window_b, sizeof(state->window_b));
+    k_get(reader, state->window_d, sizeof(state->window_d));
+    k_get(reader, &state->window_index, sizeof(state->window_index));
+    k_get(reader, &state->window_size, sizeof(state->window_size));
+    k_get(reader, &state->rng_state, sizeof(state->rng_state));
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        KDigit *digit = &state->digits[d];
+        k_get(reader, digit->bias, sizeof(digit->bias));
+        k_get(reader, &digit->energy, sizeof(digit->energy));
+        k_get(reader, &digit->phase, sizeof(digit->phase));
+        k_get(reader, &digit->weight, sizeof(digit->weight));
+        k_get(reader, &digit->budget_b, sizeof(digit->budget_b));
+        k_get(reader, &digit->budget_d, sizeof(digit->budget_d));
     }
-    memcpy(cursor, g_state->transitions, sizeof(g_state->transitions));
-    cursor += sizeof(g_state->transitions);
+    if (state->window_size > K_WINDOW || state->window_index >= K_WINDOW) {
+        reader->ok = false;
+    }
+}
 
-    if ((size_t)(end - cursor) < sizeof(g_state->window_b) + sizeof(g_state->window_d)) {
-        return 0u;
+static void k_snapshot_put_page(KWriter *writer, uint8_t section, uint32_t page, const void *base, uint32_t count,
+                                size_t elem_size) {
+    uint32_t first = page << K_DAAWG_PAGE_SHIFT;
+    uint32_t entries = count - first < K_DAAWG_PAGE_SIZE ? count - first : K_DAAWG_PAGE_SIZE;
+    k_put(writer, &section, sizeof(section));
+    k_put(writer, &page, sizeof(page));
+    k_put(writer, (const uint8_t *)base + (size_t)first * elem_size, (size_t)entries * elem_size);
+}
+
+static void k_snapshot_put_graph(KWriter *writer, const KDaawg *graph, bool full) {
+    uint64_t fragmentation = graph->fragmentation;
+    uint32_t node_pages = k_daawg_pages(graph->node_count);
+    uint32_t edge_pages = k_daawg_pages(graph->edge_count);
+    uint32_t page_count = 0u;
+    for (uint32_t p = 0; p < node_pages; ++p) {
+        page_count += (full || graph->node_dirty[p]) ? 1u : 0u;
+    }
+    for (uint32_t p = 0; p < edge_pages; ++p) {
+        page_count += (full || graph->edge_dirty[p]) ? 1u : 0u;
+    }
+    k_put(writer, &graph->node_count, sizeof(graph->node_count));
+    k_put(writer, &graph->edge_count, sizeof(graph->edge_count));
+    k_put(writer, graph->free_blocks, sizeof(graph->free_blocks));
+    k_put(writer, &fragmentation, sizeof(fragmentation));
+    k_put(writer, &page_count, sizeof(page_count));
+    for (uint32_t p = 0; p < node_pages; ++p) {
+        if (full || graph->node_dirty[p]) {
+            k_snapshot_put_page(writer, 0u, p, graph->nodes, graph->node_count, sizeof(KDaawgNode));
+        }
+    }
+    for (uint32_t p = 0; p < edge_pages; ++p) {
+        if (full || graph->edge_dirty[p]) {
+            k_snapshot_put_page(writer, 1u, p, graph->edges, graph->edge_count, sizeof(KDaawgEdge));
+        }
     }
-    memcpy(cursor, g_state->window_b, sizeof(g_state->window_b));
-    cursor += sizeof(g_state->window_b);
-    memcpy(cursor, g_state->window_d, sizeof(g_state->window_d));
-    cursor += sizeof(g_state->window_d);
+}
 
-    if ((size_t)(end - cursor) < sizeof(uint32_t) * 2u + sizeof(uint64_t)) {
-        return 0u;
+static void k_daawg_clean(KDaawg *graph) {
+    if (graph->node_dirty) {
+        memset(graph->node_dirty, 0, k_daawg_pages(graph->node_capacity));
     }
-    memcpy(cursor, &g_state->window_index, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-    memcpy(cursor, &g_state->window_size, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-    memcpy(cursor, &g_state->rng_state, sizeof(uint64_t));
-    cursor += sizeof(uint64_t);
+    if (graph->edge_dirty) {
+        memset(graph->edge_dirty, 0, k_daawg_pages(graph->edge_capacity));
+    }
+}
 
-    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
-        const KDigit *digit = &g_state->digits[d];
-        if ((size_t)(end - cursor) < sizeof(digit->bias)) {
-            return 0u;
+/* Загруженный граф должен быть безопасен для обхода: дети и свободные блоки
+ * внутри массива рёбер, цели рёбер — существующие узлы. */
+static bool k_daawg_valid(const KDaawg *graph) {
+    for (uint32_t i = 0; i < graph->node_count; ++i) {
+        const KDaawgNode *node = &graph->nodes[i];
+        if (node->child_count > node->child_capacity || node->child_capacity > K_DAAWG_MAX_FANOUT) {
+            return false;
         }
-        memcpy(cursor, digit->bias, sizeof(digit->bias));
-        cursor += sizeof(digit->bias);
-        if ((size_t)(end - cursor) < sizeof(digit->energy) + sizeof(digit->phase) + sizeof(digit->weight)) {
-            return 0u;
+        if (node->child_capacity == 0u) {
+            continue;
         }
-        memcpy(cursor, &digit->energy, sizeof(digit->energy));
-        cursor += sizeof(digit->energy);
-        memcpy(cursor, &digit->phase, sizeof(digit->phase));
-        cursor += sizeof(digit->phase);
-        memcpy(cursor, &digit->weight, sizeof(digit->weight));
-        cursor += sizeof(digit->weight);
-        if ((size_t)(end - cursor) < sizeof(digit->budget_b) + sizeof(digit->budget_d)) {
-            return 0u;
+        if (node->children > graph->edge_count || graph->edge_count - node->children < node->child_capacity) {
+            return false;
+        }
+        for (uint16_t c = 0; c < node->child_count; ++c) {
+            if (graph->edges[node->children + c].target >= graph->node_count) {
+                return false;
+            }
+        }
+    }
+    for (uint32_t cls = 0; cls < K_DAAWG_BLOCK_CLASSES; ++cls) {
+        uint32_t block = graph->free_blocks[cls];
+        for (uint32_t steps = 0; block != K_DAAWG_NONE; ++steps) {
+            if (steps >= graph->edge_count || block > graph->edge_count ||
+                graph->edge_count - block < (1u << cls)) {
+                return false;
+            }
+            block = graph->edges[block].target;
+        }
+    }
+    return true;
+}
+
+static int k_snapshot_get_graph(KReader *reader, KDaawg *graph, bool full) {
+    uint32_t node_count = 0u;
+    uint32_t edge_count = 0u;
+    uint32_t free_blocks[K_DAAWG_BLOCK_CLASSES];
+    uint64_t fragmentation = 0u;
+    uint32_t page_count = 0u;
+    k_get(reader, &node_count, sizeof(node_count));
+    k_get(reader, &edge_count, sizeof(edge_count));
+    k_get(reader, free_blocks, sizeof(free_blocks));
+    k_get(reader, &fragmentation, sizeof(fragmentation));
+    k_get(reader, &page_count, sizeof(page_count));
+    if (!reader->ok || node_count == K_DAAWG_NONE || edge_count == K_DAAWG_NONE) {
+        return -1;
+    }
+    if (full) {
+        k_daawg_dispose(graph);
+    }
+    if (k_daawg_grow((void **)&graph->nodes, &graph->node_capacity, node_count, sizeof(KDaawgNode),
+                     &graph->node_dirty) != 0 ||
+        k_daawg_grow((void **)&graph->edges, &graph->edge_capacity, edge_count, sizeof(KDaawgEdge),
+                     &graph->edge_dirty) != 0) {
+        return -1;
+    }
+    if (full) {
+        memset(graph->nodes, 0, (size_t)node_count * sizeof(KDaawgNode));
+        memset(graph->edges, 0, (size_t)edge_count * sizeof(KDaawgEdge));
+    }
+    for (uint32_t i = 0; i < page_count; ++i) {
+        uint8_t section = 0u;
+        uint32_t page = 0u;
+        k_get(reader, &section, sizeof(section));
+        k_get(reader, &page, sizeof(page));
+        uint32_t count = section ? edge_count : node_count;
+        size_t elem_size = section ? sizeof(KDaawgEdge) : sizeof(KDaawgNode);
+        if (!reader->ok || section > 1u || page >= k_daawg_pages(count)) {
+            return -1;
+        }
+        uint32_t first = page << K_DAAWG_PAGE_SHIFT;
+        uint32_t entries = count - first < K_DAAWG_PAGE_SIZE ? count - first : K_DAAWG_PAGE_SIZE;
+        const uint8_t *data = k_take(reader, (size_t)entries * elem_size);
+        if (!data) {
+            return -1;
         }
-        memcpy(cursor, &digit->budget_b, sizeof(digit->budget_b));
-        cursor += sizeof(digit->budget_b);
-        memcpy(cursor, &digit->budget_d, sizeof(digit->budget_d));
-        cursor += sizeof(digit->budget_d);
+        uint8_t *target = section ? (uint8_t *)graph->edges : (uint8_t *)graph->nodes;
+        memcpy(target + (size_t)first * elem_size, data, (size_t)entries * elem_size);
+    }
+    graph->node_count = node_count;
+    graph->edge_count = edge_count;
+    memcpy(graph->free_blocks, free_blocks, sizeof(free_blocks));
+    graph->fragmentation = (size_t)fragmentation;
+    if (!k_daawg_valid(graph)) {
+        k_daawg_dispose(graph);
+        return -1;
     }
+    k_daawg_clean(graph);
+    return 0;
+}
 
-    return (size_t)(cursor - buffer);
+static size_t k_snapshot_write(uint8_t *buffer, size_t capacity, uint32_t kind) {
+    if (!g_state || !buffer) {
+        return 0u;
+    }
+    if (kind == K_SNAPSHOT_DELTA && g_state->save_sequence == 0u) {
+        return 0u;
+    }
+    KWriter writer = { buffer, buffer + capacity, true };
+    uint32_t header[4] = {
+        K_SAVE_VERSION,
+        kind,
+        g_state->save_sequence + 1u,
+        kind == K_SNAPSHOT_DELTA ? g_state->save_sequence : 0u,
+    };
+    k_put(&writer, header, sizeof(header));
+    k_snapshot_put_scalars(&writer, g_state);
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        k_snapshot_put_graph(&writer, &g_state->digits[d].graph, kind == K_SNAPSHOT_FULL);
+    }
+    if (!writer.ok) {
+        return 0u;
+    }
+    g_state->save_sequence += 1u;
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        k_daawg_clean(&g_state->digits[d].graph);
+    }
+    return (size_t)(writer.cursor - buffer);
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t k_state_save(uint8_t *buffer, size_t capacity) {
+    return k_snapshot_write(buffer, capacity, K_SNAPSHOT_FULL);
+}
+
+/* Дельта с последнего k_state_save/k_state_save_delta/k_state_load;
+ * 0 — нет базового снимка или не хватило места. */
+EMSCRIPTEN_KEEPALIVE
+size_t k_state_save_delta(uint8_t *buffer, size_t capacity) {
+    return k_snapshot_write(buffer, capacity, K_SNAPSHOT_DELTA);
 }
 
+/* Принимает снимки v1 (только скаляры, графы не трогаются), полные v2 и
+ * дельты v2 поверх текущего номера. После ошибки цепочка дельт рвётся:
+ * следующей должна быть загрузка полного снимка. */
 EMSCRIPTEN_KEEPALIVE
 int k_state_load(const uint8_t *buffer, size_t length) {
     if (!buffer || length < sizeof(uint32_t)) {
@@ -991,91 +1413,97 @@ int k_state_load(const uint8_t *buffer, size_t length) {
             return -1;
         }
     }
-    const uint8_t *cursor = buffer;
-    const uint8_t *end = buffer + length;
-
-    uint32_t version = 0u;
-    memcpy(&version, cursor, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-    if (version != K_SAVE_VERSION) {
-        return -1;
-    }
-
-    if ((size_t)(end - cursor) < sizeof(double) * 2u) {
-        return -1;
+    KReader reader = { buffer, buffer + length, true };
+    uint32_t header[4] = { 0u, 0u, 0u, 0u };
+    k_get(&reader, &header[0], sizeof(uint32_t));
+    if (header[0] == 1u) {
+        k_snapshot_get_scalars(&reader, g_state);
+        return reader.ok ? 0 : -1;
     }
-    memcpy(&g_state->limit_b, cursor, sizeof(double));
-    cursor += sizeof(double);
-    memcpy(&g_state->limit_d, cursor, sizeof(double));
-    cursor += sizeof(double);
-
-    if ((size_t)(end - cursor) < sizeof(g_state->usage)) {
+    if (header[0] != K_SAVE_VERSION) {
         return -1;
     }
-    memcpy(g_state->usage, cursor, sizeof(g_state->usage));
-    cursor += sizeof(g_state->usage);
-
-    if ((size_t)(end - cursor) < sizeof(g_state->transitions)) {
+    k_get(&reader, &header[1], sizeof(uint32_t) * 3u);
+    uint32_t kind = header[1];
+    if (!reader.ok || kind > K_SNAPSHOT_DELTA || header[2] == 0u) {
         return -1;
     }
-    memcpy(g_state->transitions, cursor, sizeof(g_state->transitions));
-    cursor += sizeof(g_state->transitions);
-
-    if ((size_t)(end - cursor) < sizeof(g_state->window_b) + sizeof(g_state->window_d)) {
+    if (kind == K_SNAPSHOT_DELTA && (g_state->save_sequence == 0u || header[3] != g_state->save_sequence)) {
         return -1;
     }
-    memcpy(g_state->window_b, cursor, sizeof(g_state->window_b));
-    cursor += sizeof(g_state->window_b);
-    memcpy(g_state->window_d, cursor, sizeof(g_state->window_d));
-    cursor += sizeof(g_state->window_d);
+    g_state->pending_len = 0u;
+    g_state->pending_total = 0u;
+    g_state->unrefreshed_tokens = 0u;
+    g_state->save_sequence = 0u;
 
-    if ((size_t)(end - cursor) < sizeof(uint32_t) * 2u + sizeof(uint64_t)) {
+    k_snapshot_get_scalars(&reader, g_state);
+    if (!reader.ok) {
         return -1;
     }
-    memcpy(&g_state->window_index, cursor, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-    memcpy(&g_state->window_size, cursor, sizeof(uint32_t));
-    cursor += sizeof(uint32_t);
-    memcpy(&g_state->rng_state, cursor, sizeof(uint64_t));
-    cursor += sizeof(uint64_t);
-
     for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
-        if ((size_t)(end - cursor) < sizeof(g_state->digits[d].bias)) {
-            return -1;
-        }
-        memcpy(g_state->digits[d].bias, cursor, sizeof(g_state->digits[d].bias));
-        cursor += sizeof(g_state->digits[d].bias);
-        if ((size_t)(end - cursor) < sizeof(float) * 3u) {
-            return -1;
-        }
-        memcpy(&g_state->digits[d].energy, cursor, sizeof(float));
-        cursor += sizeof(float);
-        memcpy(&g_state->digits[d].phase, cursor, sizeof(float));
-        cursor += sizeof(float);
-        memcpy(&g_state->digits[d].weight, cursor, sizeof(float));
-        cursor += sizeof(float);
-        if ((size_t)(end - cursor) < sizeof(double) * 2u) {
+        if (k_snapshot_get_graph(&reader, &g_state->digits[d].graph, kind == K_SNAPSHOT_FULL) != 0) {
             return -1;
         }
-        memcpy(&g_state->digits[d].budget_b, cursor, sizeof(double));
-        cursor += sizeof(double);
-        memcpy(&g_state->digits[d].budget_d, cursor, sizeof(double));
-        cursor += sizeof(double);
     }
-
+    g_state->save_sequence = header[2];
     return 0;
 }
 
+/* Сжимает арены рёбер всех цифр и возвращает освобождённые байты. Сжатие
+ * переписывает все страницы, поэтому после него стоит сохранить полный
+ * снимок и отбросить накопленную цепочку дельт. */
+EMSCRIPTEN_KEEPALIVE
+size_t k_state_compact(void) {
+    if (!g_state) {
+        return 0u;
+    }
+    size_t reclaimed = 0u;
+    for (size_t d = 0; d < K_DIGIT_COUNT; ++d) {
+        reclaimed += k_daawg_compact(&g_state->digits[d].graph);
+    }
+    return reclaimed;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int k_observe(const uint8_t *data, size_t length) {
     if (!g_state || !data || length == 0u) {
         return -1;
     }
     k_parse_observation(g_state, (const char *)data, length);
+    k_flush_pending(g_state);
     k_refresh_digit_programs(g_state);
     return 0;
 }
 
+/* Потоковое наблюдение: большой текст подаётся частями (например, из Web
+ * Worker между сообщениями), программы цифр пересчитываются раз в
+ * K_OBSERVE_REFRESH_TOKENS токенов. Возвращает число токенов, ждущих
+ * пересчёта. */
+EMSCRIPTEN_KEEPALIVE
+int k_observe_chunk(const uint8_t *data, size_t length) {
+    if (!g_state || (!data && length > 0u)) {
+        return -1;
+    }
+    k_parse_observation(g_state, (const char *)data, length);
+    if (g_state->unrefreshed_tokens >= K_OBSERVE_REFRESH_TOKENS) {
+        k_refresh_digit_programs(g_state);
+    }
+    return (int)g_state->unrefreshed_tokens;
+}
+
+/* Завершает поток: учитывает последний токен и пересчитывает программы. */
+EMSCRIPTEN_KEEPALIVE
+int k_observe_flush(void) {
+    if (!g_state) {
+        return -1;
+    }
+    k_flush_pending(g_state);
+    if (g_state->unrefreshed_tokens > 0u) {
+        k_refresh_digit_programs(g_state);
+    }
+    return 0;
+}
+
 EMSCRIPTEN_KEEPALIVE
 size_t k_decode(const uint8_t *prompt, size_t prompt_len, uint8_t *output, size_t capacity, int temp_q8, int topk) {
     if (!g_state || !output || capacity == 0u) {
@@ -1166,7 +1594,7 @@ size_t k_profile(uint32_t query, uint8_t *buffer, size_t capacity) {
         sizeof(scratch) - offset,
         "],\n  \"window\": %u,\n  \"fragmentation\": %zu\n}\n",
         g_state->window_size,
-        g_state->digits[0].graph.arena.fragmentation + g_state->digits[1].graph.arena.fragmentation);
+        g_state->digits[0].graph.fragmentation + g_state->digits[1].graph.fragmentation);
     if (written < 0) {
         return 0u;
     }